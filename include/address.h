@@ -0,0 +1,86 @@
+/* Address parsers and validator
+ *
+ * Copyright (C) 2010-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_ADDRESS_H_
+#define INADYN_ADDRESS_H_
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/* Binary address, parsed once, compared and checked without parsing */
+typedef struct {
+	int family;			/* AF_INET, AF_INET6, or AF_UNSPEC */
+	union {
+		struct in_addr  in;
+		struct in6_addr in6;
+	};
+} ddns_addr_t;
+
+/* POSIX OK(0) if @str is an IPv4 or IPv6 address, otherwise unset */
+int addr_parse         (ddns_addr_t *addr, const char *str);
+
+/* Non-zero if @addr is a globally valid address */
+int is_addr_valid      (const ddns_addr_t *addr);
+
+/* Non-zero if @host is a globally valid address */
+int is_address_valid   (int family, const char *host);
+
+/* Non-zero if a valid address was found in @buffer */
+int parse_ipv4_address (char *buffer, char *address, size_t len);
+int parse_ipv6_address (char *buffer, char *address, size_t len);
+
+/* POSIX OK(0) if a valid address, IPv6 preferred, was found in @buffer */
+int parse_my_address   (char *buffer, char *address, size_t len);
+int parse_family_address (int family, char *buffer, char *address, size_t len);
+
+static inline size_t addr_len(const ddns_addr_t *addr)
+{
+	switch (addr->family) {
+	case AF_INET:
+		return sizeof(addr->in);
+	case AF_INET6:
+		return sizeof(addr->in6);
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* Same family and address, unset addresses are never equal */
+static inline int addr_equal(const ddns_addr_t *a, const ddns_addr_t *b)
+{
+	if (a->family != b->family || a->family == AF_UNSPEC)
+		return 0;
+
+	return !memcmp(&a->in6, &b->in6, addr_len(a));
+}
+
+#endif /* INADYN_ADDRESS_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
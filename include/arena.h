@@ -0,0 +1,48 @@
+/* Per-cycle arena for short-lived allocations
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_ARENA_H_
+#define INADYN_ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE	4096		/* Smallest block allocated */
+#define ARENA_MAX_KEEP		(256 * 1024)	/* Cap for block kept by arena_reset() */
+
+typedef struct arena arena_t;
+
+arena_t *arena_new     (void);
+void     arena_free    (arena_t *arena);
+
+void    *arena_alloc   (arena_t *arena, size_t len);
+void    *arena_realloc (arena_t *arena, void *ptr, size_t old, size_t len);
+char    *arena_strdup  (arena_t *arena, const char *str);
+void     arena_reset   (arena_t *arena);
+
+#endif /* INADYN_ARENA_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,62 @@
+/* Circuit breakers for failing DDNS and checkip servers
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_BREAKER_H_
+#define INADYN_BREAKER_H_
+
+#include <time.h>
+
+#define BREAKER_DEFAULT_THRESHOLD	3	/* Failures in a row, 0: disabled */
+#define BREAKER_DEFAULT_TIMEOUT		300	/* sec, until the first probe */
+#define BREAKER_MAX_TIMEOUT		3600	/* sec, doubled for every failed probe */
+
+typedef enum {
+	BREAKER_CLOSED = 0,		/* Server used as usual */
+	BREAKER_OPEN,			/* Skipped until the timeout */
+	BREAKER_HALF_OPEN,		/* Timed out, next request is a probe */
+} breaker_state_t;
+
+typedef struct {
+	breaker_state_t state;
+	unsigned int    fails;		/* In a row */
+	unsigned int    trips;		/* Opened, without any success since */
+	time_t          opened;		/* event_wall() when last opened */
+} breaker_t;
+
+extern int breaker_threshold;
+extern int breaker_timeout;
+
+int  breaker_allow   (breaker_t *b, const char *name);
+int  breaker_open    (breaker_t *b);
+int  breaker_wait    (breaker_t *b);
+int  breaker_failure (breaker_t *b, const char *name);
+void breaker_success (breaker_t *b, const char *name);
+void breaker_restore (breaker_t *b, unsigned int fails, unsigned int trips, time_t opened);
+
+#endif /* INADYN_BREAKER_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,50 @@
+/* Cycle deadline and per-provider time budgets
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_BUDGET_H_
+#define INADYN_BUDGET_H_
+
+typedef struct {
+	int       limit;	/* msec, 0: only the cycle deadline */
+	long long spent;	/* msec, in this cycle */
+	long long start;	/* event_msec() of budget_enter() */
+} budget_t;
+
+extern int budget_cycle_sec;	/* 0: the period */
+extern int budget_provider_sec;	/* 0: no limit */
+
+void      budget_cycle    (long long until);
+void      budget_reset    (budget_t *b, int sec);
+void      budget_enter    (budget_t *b);
+void      budget_leave    (budget_t *b);
+long long budget_deadline (void);
+long long budget_clamp    (long long deadline);
+int       budget_expired  (void);
+
+#endif /* INADYN_BUDGET_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
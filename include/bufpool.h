@@ -0,0 +1,54 @@
+/* Interface for the shared buffer pool
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_BUFPOOL_H_
+#define INADYN_BUFPOOL_H_
+
+#include <stddef.h>
+
+#define BUF_MIN_SIZE	1024		/* Smallest buffer handed out */
+#define BUF_MAX_SIZE	(512 * 1024)	/* Cap for buf_grow() */
+#define BUF_POOL_SIZE	16		/* Idle buffers kept for reuse */
+
+typedef struct buf {
+	char       *data;
+	size_t      size;		/* Allocated, including room for \0 */
+	struct buf *next;		/* Idle list, private */
+} buf_t;
+
+typedef struct buf_pool buf_pool_t;
+
+buf_pool_t *buf_pool_new  (void);
+void        buf_pool_free (buf_pool_t *pool);
+
+buf_t      *buf_get       (buf_pool_t *pool, size_t size);
+void        buf_put       (buf_pool_t *pool, buf_t *buf);
+int         buf_grow      (buf_t *buf, size_t size);
+
+#endif /* INADYN_BUFPOOL_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -24,11 +24,31 @@
 
 #include "ddns.h"
 
+/* cache-sync, how hard to try getting the state file to disk */
+enum {
+	CACHE_SYNC_NONE = 0,		/* Once per cycle, leave it to the OS */
+	CACHE_SYNC_CYCLE,		/* Once per cycle, fsync() */
+	CACHE_SYNC_ALWAYS,		/* Every update, fsync() */
+};
+
+/* State file writes since startup, see cache_stats() */
+typedef struct {
+	unsigned long written;		/* Replaced the state file */
+	unsigned long synced;		/* ... and fsync()'ed it */
+	unsigned long skipped;		/* Content unchanged, not written */
+	unsigned long failed;
+} cache_stats_t;
+
 extern char *cache_dir;
+extern int   cache_sync;
 
 char *cache_file       (char *name, const char *sysname, char *buf, size_t len);
 int   read_cache_file  (ddns_t *ctx);
 int   write_cache_file (ddns_alias_t *alias, const char *name);
+void  cache_touch      (void);
+int   cache_flush      (void);
+
+const cache_stats_t *cache_stats (void);
 
 #endif /* INADYN_CACHE_H_ */
 
@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <sys/param.h> /* MAX(), isset(), setbit(), TRUE, FALSE, et consortes. :-) */
+#include <sys/stat.h>
 #include <sys/types.h>
 #include "strdupa.h"
 
@@ -83,6 +84,17 @@ static inline int fexist(char *file)
 	return 1;
 }
 
+/* Last modification time of a file, or zero if it does not exist */
+static inline time_t fmtime(const char *file)
+{
+	struct stat st;
+
+	if (!file || stat(file, &st))
+		return 0;
+
+	return st.st_mtime;
+}
+
 /* Validate string, non NULL and not zero length */
 static inline int string_valid(const char *s)
 {
@@ -103,4 +115,13 @@ static inline int string_compare(const char *a, const char *b)
    return strlen(a) == strlen(b) && !strcmp(a, b);
 }
 
+/* Clear secrets, e.g. credentials, a plain memset() before free() may be optimized away */
+static inline void memwipe(void *ptr, size_t len)
+{
+   volatile unsigned char *p = ptr;
+
+   while (len--)
+      *p++ = 0;
+}
+
 #endif /* INADYN_COMPAT_H_ */
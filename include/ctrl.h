@@ -0,0 +1,43 @@
+/* Interface for the control socket
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_CTRL_H_
+#define INADYN_CTRL_H_
+
+#include "ddns.h"
+
+#define CTRL_TIMEOUT	1000	/* msec, for a client to send its command */
+#define CTRL_MAX_CMD	512	/* Longest command line */
+
+extern char *ctrl_path;
+
+int  ctrl_init    (ddns_t *ctx);
+void ctrl_exit    (void);
+int  ctrl_handoff (int force);
+
+#endif /* INADYN_CTRL_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
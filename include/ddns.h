@@ -26,9 +26,14 @@
 
 #include "config.h"
 #include "compat.h"
+#include "address.h"
+#include "arena.h"
+#include "breaker.h"
+#include "budget.h"
 #include "os.h"
 #include "error.h"
 #include "http.h"
+#include "json.h"
 #include "log.h"
 #include "plugin.h"
 #include "queue.h"		/* BSD sys/queue.h API */
@@ -47,17 +52,34 @@
 
 /* Some default settings */
 #define DDNS_DEFAULT_STARTUP_SLEEP        0       /* sec */
+#define DDNS_NOTIFY_TIMEOUT               90      /* sec, start timeout asked for after startup delay */
 #define DDNS_DEFAULT_PERIOD               120     /* sec */
 #define DDNS_MIN_PERIOD                   30      /* sec */
 #define DDNS_MAX_PERIOD                   (10 * 24 * 3600)        /* 10 days in sec */
-#define DDNS_ERROR_UPDATE_PERIOD          600     /* 10 min */
+#define DDNS_ERROR_UPDATE_PERIOD          600     /* 10 min, max backoff after errors */
+#define DDNS_MIN_RETRY_PERIOD             60      /* sec, first retry after an error */
 #define DDNS_FORCED_UPDATE_PERIOD         (30 * 24 * 3600)        /* 30 days in sec */
 #define DDNS_DEFAULT_CMD_CHECK_PERIOD     1       /* sec */
 #define DDNS_DEFAULT_ITERATIONS           0       /* Forever */
+#define DDNS_DEFAULT_CONCURRENCY          1       /* One provider at a time */
+#define DDNS_ONCE_CONCURRENCY             8       /* Default with --once, one quick cycle */
+#define DDNS_MAX_CONCURRENCY              64      /* Max parallel provider checks and updates */
+#define DDNS_ADAPTIVE_MAX_PERIOD          3600    /* sec, default period-max of adaptive-period */
+#define DDNS_HISTORY_LEN                  8       /* Address changes remembered per alias */
+#define DDNS_ADAPTIVE_STRETCH             8       /* Period up to 1/8 of time address is stable */
+#define DDNS_MAX_PREWARM                  60      /* sec, max lead time to connect before due */
+#define DDNS_PREWARM_IDLE                 15      /* sec after due, pre-warmed connection closed if unused */
+#define DDNS_DEFAULT_DEBOUNCE             1000    /* msec, quiet time before acting on a command */
+#define DDNS_MAX_DEBOUNCE                 60000   /* msec */
+#define DDNS_DEBOUNCE_LIMIT               4       /* Bursts are not waited out longer than this many times */
 #define DDNS_HTTP_RESPONSE_BUFFER_SIZE	  (BUFSIZ < 8192 ? 8192 : BUFSIZ) /* at least 8 Kib */
 #define DDNS_HTTP_REQUEST_BUFFER_SIZE     2500    /* Bytes */
-#define DDNS_MAX_ALIAS_NUMBER             50      /* maximum number of aliases per server that can be maintained */
-#define DDNS_MAX_SERVER_NUMBER            5       /* maximum number of servers that can be maintained */
+#define DDNS_MAX_CHECKIP                  4       /* checkip-server list, excluding fallback */
+#define DDNS_CHECKIP_MIN_DELAY            250     /* msec, before hedging with next server */
+#define DDNS_CHECKIP_MAX_DELAY            2000    /* msec, same, or when reply time unknown */
+#define DDNS_CHECKIP_CMD_TIMEOUT          10      /* sec, before killing checkip-command */
+#define DDNS_QUOTA_PERIOD                 60      /* sec, default quota-period */
+#define DDNS_MAX_RC                       80      /* RC_* codes counted per provider, see metrics.c */
 
 /* SSL support status in plugin definition */
 #define DDNS_CHECKIP_SSL_UNSUPPORTED     -1       /* HTTPS not supported by checkip-server (default) */
@@ -67,7 +89,9 @@
 /* local configs */
 #define USERNAME_LEN                      128     /* chars */
 #define PASSWORD_LEN                      256     /* chars */
+#define ENCODED_CREDS_LEN                 (((USERNAME_LEN + PASSWORD_LEN + 2) / 3) * 4 + 1)
 #define SERVER_NAME_LEN                   256     /* chars */
+#define DDNS_ID_LEN                       128     /* chars, plugin record ID(s) */
 #define SERVER_URL_LEN                    256     /* chars */
 #ifdef INET6_ADDRSTRLEN
 # define MAX_ADDRESS_LEN                  INET6_ADDRSTRLEN
@@ -78,23 +102,27 @@
 #define MAX_NUM_RESPONSES                 6
 #define MAX_RESPONSE_LEN                  32
 
+/* In order of precedence, a pending command is only replaced by a stronger, see ddns_cmd() */
 typedef enum {
 	NO_CMD = 0,
 	CMD_STOP,
 	CMD_RESTART,
 	CMD_FORCED_UPDATE,
 	CMD_CHECK_NOW,
+	CMD_WAKEUP,		/* Schedule changed, e.g. by control socket */
 } ddns_cmd_t;
 
 typedef enum {
 	EXEC_MODE_COMPAT,
-	EXEC_MODE_EVENT
+	EXEC_MODE_EVENT,
+	EXEC_MODE_BATCH,	/* All events of a cycle in one invocation */
 } ddns_exec_mode_t;
 
+/* Encoded once, when the provider is set up, wiped when it is freed */
 typedef struct {
 	char           username[USERNAME_LEN];
 	char           password[PASSWORD_LEN];
-	char          *encoded_password;
+	char           encoded_password[ENCODED_CREDS_LEN];	/* base64 user:pass */
 	int            size;
 	int            encoded;
 } ddns_creds_t;
@@ -105,19 +133,43 @@ typedef struct {
 	int            port;
 } ddns_name_t;
 
+/* "What's my IP" server, and how it has performed so far */
+typedef struct {
+	ddns_name_t    name;
+	char           url[SERVER_URL_LEN];
+	int            ssl;
+	int            backup;	/* Only queried if all others fail */
+	http_t         client;
+
+	unsigned int   fails;	/* In a row, zero after a valid reply */
+	int            rtt;	/* msec, moving average, for ordering */
+	breaker_t      breaker;	/* Skipped while failing, see breaker.c */
+} ddns_checkip_t;
+
+/* Fields scanned every period first, the rest only used when updating */
 typedef struct {
 	int            force_addr_update;
 	int            ip_has_changed;
-	char           address[MAX_ADDRESS_LEN];
-
-	char           name[SERVER_NAME_LEN];
 	int            update_required;
+	unsigned int   fails;		/* Failed updates in a row */
+	int            rc;		/* Result of last update, RC_* */
 	time_t         last_update;
+	int            family;		/* Of the record, A or AAAA */
+	ddns_addr_t    addr;		/* Binary, set with alias_set_address() */
+	char           address[MAX_ADDRESS_LEN]; /* String form of addr */
+
+	char           name[SERVER_NAME_LEN];
+	char           id[DDNS_ID_LEN];	/* Provider's record ID(s), opaque */
+
+	/* Address changes seen, wall clock, newest first, for adaptive-period */
+	time_t         changed[DDNS_HISTORY_LEN];
 } ddns_alias_t;
 
 typedef struct di {
 	LIST_ENTRY(di) link;
 	int            id;
+	int            initialized;	/* Runtime state set up, kept on reload */
+	int            prefetched;	/* Plugin lookups done ahead, see prefetch() */
 
 	ddns_creds_t   creds;
 	ddns_system_t *system;
@@ -137,23 +189,36 @@ typedef struct di {
 	/* Interface for IP */
 	char           *ifname;
 
-	/* Address of "What's my IP" checker */
-	ddns_name_t    checkip_name;
-	char           checkip_url[SERVER_URL_LEN];
-	int            checkip_ssl; /* checkip server ssl mode */
-	http_t         checkip;
+	/* Last address read from interface, valid until ifmon_generation() changes */
+	unsigned int   ifgen;
+	char           ifaddr[MAX_ADDRESS_LEN];
+
+	/* Addresses of "What's my IP" checkers, queried in parallel */
+	ddns_checkip_t *checkip;	/* Up to DDNS_MAX_CHECKIP + fallback */
+	size_t         checkip_num;
+	int            checkip_quorum; /* Agreeing replies needed, 1: fastest wins */
+
+	/* Gateway, or UDP, address discovery, tried before the checkip server(s) */
+	ddns_name_t    checkip_stun;
+	int            checkip_dns;    /* DISCOVER_DNS_*, zero if unused */
+	int            checkip_gateway; /* GATEWAY_*, zero if unused */
+	char           checkip_gateway_addr[MAX_ADDRESS_LEN]; /* Empty: default route */
 
 	/* Shell command for "What's my IP" checker */
 	char          *checkip_cmd;
+	int            checkip_cmd_timeout; /* sec */
 
 	/* Optional local proxy server for this DDNS provider */
 	tcp_proxy_type_t proxy_type;
 	ddns_name_t    proxy_name;
 
-	/* Your aliases/names to update */
-	ddns_alias_t   alias[DDNS_MAX_ALIAS_NUMBER];
+	/* Your aliases/names to update, one contiguous array */
+	ddns_alias_t  *alias;
 	size_t         alias_count;
 
+	/* Each hostname twice, one A and one AAAA record alias */
+	int            dual_stack;
+
 	/* Use wildcard, *.foo.bar */
 	int            wildcard;
 
@@ -166,13 +231,45 @@ typedef struct di {
 	/*
 	 * Provider specific data, per-conf-entry.  E.g., the Cloudflare
 	 * plugin stores zone_id and hostname_id here.  Set up by the
-	 * plugin setup callback, and is automatically freed by Inadyn.
+	 * plugin setup callback, and is automatically freed by Inadyn,
+	 * with mem_free(), so allocate it with the mem_*() wrappers.
 	 */
 	void          *data;
 
+	/* Pre-rendered update request, see common_request() */
+	void          *tmpl;
+
 	/* Does the provider support SSL? */
 	int            ssl_enabled;
+	int            http2;       /* Offer HTTP/2, multiplexed lookups */
 	int            append_myip; /* For custom setups! */
+
+	/* Ask the zone's name servers before sending an update */
+	int            verify_record;
+
+	/* Per provider schedule, sec, zero means use the global setting */
+	int            period;
+	int            retry_period;
+	int            forced_update;
+	int            budget;		/* Time it may take per cycle */
+
+	/* Request quota, token bucket, see quota.c */
+	int            quota;		/* Requests per quota_period, 0: unlimited */
+	int            quota_period;	/* sec */
+	long long      quota_level;	/* Tokens, in msec of quota_period */
+	long long      quota_ts;	/* event_msec() of last refill, 0: full */
+
+	/* Runtime state of the schedule, kept on reload */
+	time_t         next_check;	/* event_now() time of next check */
+	int            due;		/* Checked in this pass of the main loop */
+	int            status;		/* Result of last check, RC_* */
+	unsigned int   retries;		/* Failed checks in a row, for backoff */
+	int            retry_after;	/* sec, server hint from last check */
+	breaker_t      breaker;		/* Of the DDNS server, see breaker.c */
+	budget_t       cycle_budget;	/* Time taken in this cycle, see budget.c */
+
+	/* Update results by RC_* code, kept on reload, see metrics.c */
+	unsigned long  updates[DDNS_MAX_RC];
 } ddns_info_t;
 
 /* Client context */
@@ -180,12 +277,21 @@ typedef struct {
 	char          *cfgfile;
 
 	ddns_cmd_t     cmd;
+	unsigned int   cmds;        /* Received, incl. merged, for the debounce log */
+	long long      cmd_msec;    /* event_msec() of the last command */
+	int            debounce;    /* msec of quiet before acting on a command, 0: disabled */
 	int            update_period; /* time between 2 updates */
 	int            normal_update_period_sec;
 	int            error_update_period_sec;
 	int            forced_update_period_sec;
 	int            forced_update_fake_addr;
 	int            cmd_check_period; /*time to wait for a command */
+	int            concurrency; /* max providers checked and updated in parallel */
+	int            prewarm;     /* sec before due to connect, 0: disabled */
+	int            prefetch;    /* Plugin lookups while idle, see prefetch() */
+	int            adaptive;    /* adaptive-period, see next_period() */
+	int            period_min;
+	int            period_max;
 	int            total_iterations;
 	int            num_iterations;
 	int            initialized;
@@ -193,15 +299,23 @@ typedef struct {
 	int            use_proxy;
 	int            abort;
 
-	http_trans_t   http_transaction;
+	buf_pool_t    *pool;     /* Shared by core, plugins and update workers */
+	arena_t       *arena;    /* Plugin temporaries, reset after each cycle */
 
-	char          *work_buf; /* for HTTP responses */
-	int            work_buflen;
+	buf_t         *work_buf; /* for HTTP responses, grows on demand */
 
-	char          *request_buf; /* for HTTP requests */
+	buf_t         *request;  /* for HTTP requests, from pool */
+	char          *request_buf;
 	size_t         request_buflen;
 } ddns_t;
 
+/* Response to plugin_query() and plugin_queries() */
+typedef struct {
+	http_trans_t trans;	/* Status, headers in rsp, and rsp_body */
+	json_t       json;	/* Tokens, if the body is JSON, num > 0 */
+	buf_t       *buf;	/* Own response buffer, plugin_queries() */
+} plugin_rsp_t;
+
 extern int once;
 extern int force;
 extern int ignore_errors;
@@ -221,11 +335,30 @@ extern const char * const generic_responses[];
 extern uid_t uid;
 extern gid_t gid;
 
-int ddns_main_loop (ddns_t *ctx);
+int  ddns_main_loop (ddns_t *ctx);
+void ddns_cmd       (ddns_t *ctx, ddns_cmd_t cmd);
+
+void alias_set_address (ddns_alias_t *alias, const char *address);
 
 int common_request (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 int common_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
+int common_request_batch (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t **alias, size_t num);
+int common_response_batch(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc);
+
+void common_free          (ddns_info_t *info);
+
+#define URL_KEEP_DELIMS   0x01	/* Leave / ? & = as is */
+#define URL_KEEP_ESCAPES  0x02	/* Leave already encoded %XX as is */
+#define URL_SPACE_PLUS    0x04	/* Space as +, not %20 */
+
+int  url_encode           (char *dst, size_t len, const char *src, size_t srclen, int flags);
+
+int  plugin_query         (ddns_t *ctx, ddns_info_t *info, char *msg, size_t len, plugin_rsp_t *rsp);
+void plugin_query_done    (plugin_rsp_t *rsp);
+int  plugin_queries       (ddns_t *ctx, ddns_info_t *info, char *msg, char *req[], plugin_rsp_t rsp[], size_t num);
+void plugin_queries_done  (ddns_t *ctx, plugin_rsp_t rsp[], size_t num);
+
 #endif /* DDNS_H_ */
 
 /**
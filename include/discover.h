@@ -0,0 +1,58 @@
+/* Interface for UDP based public address discovery, STUN and DNS
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_DISCOVER_H_
+#define INADYN_DISCOVER_H_
+
+#include <stddef.h>
+
+#define DISCOVER_STUN_PORT	3478
+#define DISCOVER_TIMEOUT	1000	/* msec, per attempt */
+#define DISCOVER_RETRIES	3	/* attempts, UDP may be lost */
+#define DISCOVER_AUTH_SERVERS	3	/* name servers to ask, in order */
+
+/* DNS services that tell the address a query came from */
+enum {
+	DISCOVER_DNS_NONE = 0,
+	DISCOVER_DNS_OPENDNS,
+	DISCOVER_DNS_GOOGLE,
+	DISCOVER_DNS_CLOUDFLARE,
+};
+
+int         discover_dns_lookup (const char *name);
+const char *discover_dns_name   (int service);
+
+int         discover_stun       (const char *host, int port, int family, char *address, size_t len);
+int         discover_dns        (int service, int family, char *address, size_t len);
+
+int         discover_auth       (const char *name, int family, char *address, size_t len);
+
+int         discover_query      (void *buf, size_t len, const char *name, int family);
+int         discover_answer     (const void *rsp, size_t n, int family, char *address, size_t len);
+
+#endif /* INADYN_DISCOVER_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
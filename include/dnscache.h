@@ -0,0 +1,51 @@
+/* Interface for the in-process resolver cache
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_DNSCACHE_H_
+#define INADYN_DNSCACHE_H_
+
+#include "config.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define DNSCACHE_SIZE		16	/* Number of (host, port, family) entries */
+#define DNSCACHE_MAX_ADDRS	8	/* Addresses kept per entry */
+#define DNSCACHE_DEFAULT_TTL	300	/* sec, when record TTL is unknown */
+#define DNSCACHE_MAX_TTL	3600	/* sec, cap for very long TTLs */
+
+typedef struct {
+	socklen_t               len;
+	struct sockaddr_storage ss;
+} dns_addr_t;
+
+int  dnscache_resolve    (const char *host, int port, int family, dns_addr_t *addr, int *num);
+void dnscache_invalidate (const char *host, int port, int family);
+void dnscache_flush      (void);
+
+#endif /* INADYN_DNSCACHE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
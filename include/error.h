@@ -38,7 +38,11 @@
 #define RC_TCP_RECV_ERROR               15
 
 #define RC_TCP_OBJECT_NOT_INITIALIZED   16
+#define RC_TCP_WANT_READ                17 /* Non-blocking, not an error */
+#define RC_TCP_WANT_WRITE               18 /* Non-blocking, not an error */
+#define RC_TCP_PROXY_FAILED             19
 #define RC_HTTP_OBJECT_NOT_INITIALIZED  22
+#define RC_HTTP_BAD_RESPONSE            23
 
 #define RC_HTTPS_NO_TRUSTED_CA_STORE    31
 #define RC_HTTPS_OUT_OF_MEMORY          32
@@ -56,6 +60,10 @@
 #define RC_DDNS_RSP_RETRY_LATER         49
 #define RC_DDNS_RSP_AUTH_FAIL           50
 #define RC_DDNS_RSP_TOO_FREQUENT        51
+#define RC_DDNS_RATE_LIMITED            52
+#define RC_DDNS_CIRCUIT_OPEN            53
+#define RC_DDNS_RECORD_CURRENT          54 /* Not an error, see setup_fn_t */
+#define RC_DDNS_OVER_BUDGET             55
 
 #define RC_OS_INVALID_IP_ADDRESS        61
 #define RC_OS_FORK_FAILURE              62
@@ -73,7 +81,8 @@
 #define TRY(fn)      {     rc = fn; if (rc) break; }
 #define ASSERT(cond) { if (!cond) return RC_INVALID_POINTER; }
 
-const char *error_str(int rc);
+const char *error_str (int rc);
+const char *error_name(int rc);
 
 #endif /* INADYN_ERROR_H_ */
 
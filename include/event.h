@@ -0,0 +1,58 @@
+/* Interface for the main loop event dispatcher
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_EVENT_H_
+#define INADYN_EVENT_H_
+
+#include <poll.h>
+#include <time.h>
+
+#define EVENT_MAX_FDS		16
+#define EVENT_CLOCK_SLACK	2	/* sec, wall clock jitter that is not a step */
+
+/* How to wait for descriptors, see event_poll() */
+typedef enum {
+	EVENT_BACKEND_POLL = 0,
+	EVENT_BACKEND_IO_URING,	/* Linux, if built with --enable-io-uring */
+} event_backend_t;
+
+typedef void (*event_cb_t)(int fd, void *arg);
+
+extern int event_backend;
+
+int       event_add   (int fd, event_cb_t cb, void *arg);
+int       event_del   (int fd);
+int       event_wait  (int msec);
+int       event_poll  (struct pollfd *pfd, int num, int msec);
+
+time_t    event_now   (void);
+long long event_msec  (void);
+time_t    event_wall  (void);
+time_t    event_clock (time_t *from, time_t *until);
+
+#endif /* INADYN_EVENT_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
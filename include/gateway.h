@@ -0,0 +1,58 @@
+/* Discovery of the public address from the default gateway
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_GATEWAY_H_
+#define INADYN_GATEWAY_H_
+
+#include <stddef.h>
+#include "ddns.h"
+
+#define GATEWAY_PORT		5351	/* NAT-PMP and PCP server */
+#define GATEWAY_CLIENT_PORT	5350	/* NAT-PMP and PCP announcements */
+#define GATEWAY_TIMEOUT		250	/* msec, first attempt, then doubled */
+#define GATEWAY_RETRIES		4	/* attempts, UDP may be lost */
+#define GATEWAY_PCP_LIFETIME	60	/* sec, of the throwaway mapping */
+#define GATEWAY_SSDP_TIMEOUT	2000	/* msec, wait for UPnP gateways */
+
+/* Protocols to ask the gateway with */
+enum {
+	GATEWAY_NONE = 0,
+	GATEWAY_NATPMP,
+	GATEWAY_PCP,
+	GATEWAY_UPNP,
+};
+
+int         gateway_lookup  (const char *name);
+const char *gateway_name    (int proto);
+
+int         gateway_address (int proto, const char *gw, char *address, size_t len);
+
+int         gateway_init    (ddns_t *ctx);
+void        gateway_exit    (void);
+
+#endif /* INADYN_GATEWAY_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,51 @@
+/* Active/standby coordination of two inadyn instances
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_HA_H_
+#define INADYN_HA_H_
+
+#include "ddns.h"
+
+#define HA_DEFAULT_PORT		4747	/* UDP, state replication */
+#define HA_POLL_INTERVAL	1000	/* msec, ha-state file */
+#define HA_RESEND		300	/* sec, full state to peer, also if unchanged */
+#define HA_MAX_PACKET		1400	/* Stay below the path MTU */
+
+extern char *ha_state;
+extern char *ha_peer;
+extern char *ha_secret;
+
+int  ha_init   (ddns_t *ctx);
+void ha_exit   (void);
+
+int  ha_active (void);
+void ha_poll   (ddns_t *ctx);
+int  ha_next   (void);
+void ha_send   (void);
+
+#endif /* INADYN_HA_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
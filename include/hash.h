@@ -0,0 +1,93 @@
+/* Streaming hash and HMAC interface
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_HASH_H_
+#define INADYN_HASH_H_
+
+#include <stddef.h>
+
+#define HASH_MAX_SIZE	32	/* SHA-256 */
+#define HASH_BLOCK_SIZE	64	/* All supported algorithms */
+
+typedef enum {
+	HASH_MD5,
+	HASH_SHA1,
+	HASH_SHA256,
+} hash_alg_t;
+
+/*
+ * With a TLS library the hashing is done by the library, which uses
+ * CPU acceleration where available, otherwise by the bundled code.
+ */
+typedef struct {
+	hash_alg_t alg;
+	void      *priv;		/* Backend state */
+} hash_ctx_t;
+
+typedef struct {
+	hash_ctx_t    hash;
+	unsigned char opad[HASH_BLOCK_SIZE];
+} hmac_ctx_t;
+
+int  hash_init   (hash_ctx_t *ctx, hash_alg_t alg);
+int  hash_update (hash_ctx_t *ctx, const void *data, size_t len);
+int  hash_final  (hash_ctx_t *ctx, unsigned char *digest);
+
+int  hmac_init   (hmac_ctx_t *ctx, hash_alg_t alg, const void *key, size_t len);
+int  hmac_update (hmac_ctx_t *ctx, const void *data, size_t len);
+int  hmac_final  (hmac_ctx_t *ctx, unsigned char *digest);
+
+void hash_hex    (const unsigned char *digest, size_t len, char *str);
+
+static inline size_t hash_size(hash_alg_t alg)
+{
+	switch (alg) {
+	case HASH_MD5:
+		return 16;
+	case HASH_SHA1:
+		return 20;
+	default:
+		break;
+	}
+
+	return 32;
+}
+
+/* Calculate the digest of one buffer */
+static inline int hash_digest(hash_alg_t alg, const void *data, size_t len, unsigned char *digest)
+{
+	hash_ctx_t ctx;
+
+	if (hash_init(&ctx, alg))
+		return -1;
+	hash_update(&ctx, data, len);
+
+	return hash_final(&ctx, digest);
+}
+
+#endif /* INADYN_HASH_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
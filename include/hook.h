@@ -0,0 +1,45 @@
+/* Bounded-time executor of --exec hooks
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_HOOK_H_
+#define INADYN_HOOK_H_
+
+#define HOOK_DEFAULT_TIMEOUT		60	/* sec, 0: no limit */
+#define HOOK_DEFAULT_CONCURRENCY	4
+#define HOOK_MAX_CONCURRENCY		16
+
+extern int hook_timeout;
+extern int hook_concurrency;
+
+int  hook_event   (const char *event, const char *name, const char *ip, int error);
+int  hook_flush   (void);
+void hook_reap    (void);
+int  hook_next    (void);
+int  hook_running (void);
+
+#endif /* INADYN_HOOK_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -32,22 +32,89 @@
 #include <openssl/tls1.h>
 #include <openssl/err.h>
 #elif defined(CONFIG_MBEDTLS)
-#include <mbedtls/ctr_drbg.h>
-#include <mbedtls/entropy.h>
-#include <mbedtls/net_sockets.h>
 #include <mbedtls/ssl.h>
 #elif defined(CONFIG_GNUTLS)
 #include <gnutls/gnutls.h>
 #endif
 
+#include "bufpool.h"
 #include "error.h"
 #include "os.h"
 #include "tcp.h"
 
 #define HTTP_DEFAULT_TIMEOUT	10000	/* msec */
+
+/* http_start() and http_step() return either of these while in progress */
+#define HTTP_PENDING(rc)	((rc) == RC_TCP_WANT_READ || (rc) == RC_TCP_WANT_WRITE)
 #define	HTTP_DEFAULT_PORT	80
 #define	HTTPS_DEFAULT_PORT	443
 
+typedef enum {
+	HTTP_IDLE = 0,
+	HTTP_CONNECT,		/* Resolve and TCP connect */
+	HTTP_PROXY,		/* Tunnel through proxy, if any */
+	HTTP_HANDSHAKE,		/* TLS handshake, HTTPS only */
+	HTTP_SEND,		/* Send request */
+	HTTP_RECV,		/* Receive and parse response */
+	HTTP_STREAMS,		/* HTTP/2 requests and responses, see http2.c */
+	HTTP_REPLAY,		/* Recorded response, see replay.c */
+	HTTP_DONE,
+	HTTP_FAILED,
+} http_state_t;
+
+/* Response parser state, see http_parse() */
+typedef enum {
+	HTTP_PARSE_STATUS = 0,	/* Status line */
+	HTTP_PARSE_HEADERS,
+	HTTP_PARSE_BODY,	/* Content-Length, or until server closes */
+	HTTP_PARSE_CHUNK_SIZE,
+	HTTP_PARSE_CHUNK_DATA,
+	HTTP_PARSE_CHUNK_END,	/* CRLF after chunk data */
+	HTTP_PARSE_TRAILER,
+	HTTP_PARSE_DONE,
+} http_parse_t;
+
+/*
+ * For requests of plugins that want large listings compressed, empty
+ * unless built with zlib.  Any gzip Content-Encoding in the response
+ * is undone by http_parse().
+ */
+#ifdef HAVE_ZLIB
+#define HTTP_ACCEPT_GZIP	"Accept-Encoding: gzip\r\n"
+#else
+#define HTTP_ACCEPT_GZIP	""
+#endif
+
+/* Phases of a conversation, for latency accounting */
+typedef enum {
+	HTTP_PHASE_RESOLVE = 0,	/* DNS lookup of the server */
+	HTTP_PHASE_CONNECT,	/* TCP connect, incl. Happy Eyeballs and proxy */
+	HTTP_PHASE_HANDSHAKE,	/* TLS handshake, HTTPS only */
+	HTTP_PHASE_FIRST_BYTE,	/* Request sent until first byte of response */
+	HTTP_PHASE_COMPLETE,	/* Whole conversation, incl. any connect */
+	HTTP_PHASE_MAX
+} http_phase_t;
+
+#define HTTP_HIST_BUCKETS	12	/* Plus one for +Inf, see http_hist_bound() */
+
+/* Latency histogram of one phase, msec */
+typedef struct {
+	unsigned long count[HTTP_HIST_BUCKETS + 1];
+	unsigned long num;
+	long long     sum;
+} http_hist_t;
+
+/* Per server, kept across connections for as long as the http_t lives */
+typedef struct {
+	http_hist_t   phase[HTTP_PHASE_MAX];
+	unsigned long failed;
+	unsigned long logged;	/* Transactions at last http_stats_log() */
+} http_stats_t;
+
+struct http_trans;
+struct http2;
+struct http_gzip;
+
 typedef struct {
 	tcp_sock_t tcp;
 
@@ -55,14 +122,9 @@ typedef struct {
 #if defined(ENABLE_SSL)
 #if defined(CONFIG_OPENSSL)
 	SSL       *ssl;
-	SSL_CTX   *ssl_ctx;
 #elif defined(CONFIG_MBEDTLS)
 	mbedtls_ssl_context      ssl;
-	mbedtls_net_context      server_fd;
-	mbedtls_ssl_config       conf;
-	mbedtls_x509_crt         cacert;
-	mbedtls_ctr_drbg_context ctr_drbg;
-	mbedtls_entropy_context  entropy;
+	mbedtls_x509_crt        *cacert;	/* Shared, see ca_get() */
 #else
 	gnutls_session_t ssl;
 #endif
@@ -70,9 +132,44 @@ typedef struct {
 
 	int        initialized;
 	int        connected;
+
+	/* Non-blocking engine, see http_start() */
+	http_state_t       state;
+	struct http_trans *trans;
+	const char        *msg;
+	int                sent;
+	int                events;	/* POLLIN or POLLOUT */
+	long long          deadline;	/* msec, monotonic */
+	int                rc;
+	int                replay;	/* Transaction, see replay_find() */
+
+	/* TLS 1.3 early data, see http_exchange() */
+	int                early_data;	/* Requests are safe to replay */
+	int                early;	/* Request is being sent as early data */
+
+	/* HTTP/2, if offered in ALPN and selected by the server */
+	int                http2;	/* Offer h2 on new connections */
+	struct http2      *h2;		/* Session, see http2_open() */
+
+	/* HTTP/1.1 keep-alive, connection may be reused by http_init() */
+	int                keepalive;
+	int                reused;
+	char               conn_host[256];
+	int                conn_port;
+	int                conn_ssl;
+	char               conn_proxy[300];	/* See proxy_id() */
+	long long          idle_until;	/* Pre-warmed, closed if unused by then */
+
+	/* Phase timestamps, msec from event_msec(), see http_account() */
+	long long          ts_start;	/* Connect started, zero if reused */
+	long long          ts_connected;
+	long long          ts_secure;	/* TLS handshake done */
+	long long          ts_request;
+	long long          ts_first;	/* First byte of response */
+	http_stats_t       stats;
 } http_t;
 
-typedef struct {
+typedef struct http_trans {
 	char *req;
 	int   req_len;
 
@@ -80,10 +177,27 @@ typedef struct {
 	int   rsp_len;
 	int   max_rsp_len;
 
+	/* Optional, if set rsp is buf->data and grows as needed */
+	buf_t *buf;
+
 	char *rsp_body;
 
 	int   status;
 	char  status_desc[256];
+
+	/* Response framing, updated by http_parse() as data arrives */
+	http_parse_t parse;
+	int   pos;		/* Parsed this far into rsp */
+	int   body;		/* Offset of body in rsp */
+	int   body_len;	/* Decoded body length, so far */
+	long  content_len;	/* -1 if not given */
+	long  chunk_len;	/* Remaining of current chunk */
+	int   chunked;
+	int   close;		/* Server closes after this response */
+	int   retry_after;	/* Seconds, zero if not given */
+	int   truncated;	/* Did not fit in rsp */
+	int   gzip;		/* Content-Encoding: gzip */
+	struct http_gzip *z;	/* Inflate state, while body arrives */
 } http_trans_t;
 
 int http_construct          (http_t *client);
@@ -93,7 +207,28 @@ int http_init               (http_t *client, char *msg, int force);
 int http_exit               (http_t *client);
 
 int http_transaction        (http_t *client, http_trans_t *trans);
+int http_transactions       (http_t *client, http_trans_t *trans[], int num);
+int http_exchange           (http_t *client, http_trans_t *trans, char *msg, int force);
+int http_release            (http_t *client);
+
+int http_start              (http_t *client, http_trans_t *trans, const char *msg, int force);
+int http_step               (http_t *client, int revents);
+int http_poll               (http_t *clients[], int num);
+int http_poll_once          (http_t *clients[], int num, long long wakeup);
+int http_cancel             (http_t *client);
+int http_reuse              (http_t *client);
+int http_prewarm            (http_t *client, const char *msg, int force, long long idle_until);
+int http_idle               (http_t *client);
 int http_status_valid       (int status);
+int http_grow               (http_trans_t *trans);
+
+const char *http_phase_name (http_phase_t phase);
+long long   http_hist_bound (int bucket);
+void        http_stats_log  (http_t *client, const char *name);
+
+void http_parse_init        (http_trans_t *trans);
+int  http_parse             (http_trans_t *trans, int eof);
+void http_parse_free        (http_trans_t *trans);
 
 int http_set_port           (http_t *client, int  porg);
 int http_get_port           (http_t *client, int *port);
@@ -101,6 +236,8 @@ int http_get_port           (http_t *client, int *port);
 int http_set_remote_name    (http_t *client, const char  *name);
 int http_get_remote_name    (http_t *client, const char **name);
 
+int http_set_proxy          (http_t *client, tcp_proxy_type_t type, const char *name, int port);
+
 int http_set_remote_timeout (http_t *client, int  timeout);
 int http_get_remote_timeout (http_t *client, int *timeout);
 
@@ -0,0 +1,54 @@
+/* HTTP/2 transport, multiplexed requests over one connection
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_HTTP2_H_
+#define INADYN_HTTP2_H_
+
+#include "config.h"
+#include "http.h"
+
+#define HTTP2_ALPN		"h2"
+#define HTTP2_MAX_HEADERS	32	/* Request header fields, incl. pseudo-headers */
+
+#ifdef ENABLE_HTTP2
+int  http2_open     (http_t *client);
+void http2_close    (http_t *client);
+int  http2_submit   (http_t *client, http_trans_t *trans);
+int  http2_step     (http_t *client);
+int  http2_alive    (http_t *client);
+int  http2_reusable (http_t *client);
+#else
+#define http2_open(client)     0
+#define http2_close(client)
+#define http2_submit(client, trans) RC_HTTP_OBJECT_NOT_INITIALIZED
+#define http2_step(client)     RC_HTTP_OBJECT_NOT_INITIALIZED
+#define http2_alive(client)    0
+#define http2_reusable(client) 0
+#endif
+
+#endif /* INADYN_HTTP2_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,50 @@
+/* Interface for the kernel interface address monitor
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_IFMON_H_
+#define INADYN_IFMON_H_
+
+#include "ddns.h"
+
+/* How to choose among the IPv6 addresses of an interface, see ifmon.c */
+#define IFMON_POLICY_STABLE	0	/* Skip temporary and deprecated */
+#define IFMON_POLICY_FIRST	1	/* First valid address */
+
+extern int ipv6_policy;
+
+int          ifmon_init       (ddns_t *ctx);
+void         ifmon_exit       (void);
+
+int          ifmon_active     (void);
+unsigned int ifmon_generation (void);
+void         ifmon_cycle      (void);
+
+int          ifmon_address    (const char *ifname, int family, char *address, size_t len);
+int          ifmon_match      (const char *pfx, const char *sfx);
+
+#endif /* INADYN_IFMON_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
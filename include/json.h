@@ -22,9 +22,50 @@
 #ifndef INADYN_JSON_H_
 #define INADYN_JSON_H_
 
+#include "config.h"
+#include <stddef.h>
+
+#include "arena.h"
+
 #define JSMN_HEADER
 #include "jsmn.h"
 
+#ifndef DROP_JSON
+#define JSON_LOCAL_TOKENS 128	/* Tokens before json_parse() needs the heap */
+#else
+#define JSON_LOCAL_TOKENS 1	/* Built without the JSON plugins, never parsed */
+#endif
+
+/*
+ * Parsed JSON document.  Small documents fit in the embedded token
+ * array, so a json_t on the stack needs no allocation at all.  Always
+ * call json_free() when done, it releases any grown token array.
+ */
+typedef struct {
+	const char *json;
+	jsmntok_t  *tokens;
+	int         num;		/* Tokens in use */
+	int         size;		/* Tokens in tokens[] */
+	arena_t    *arena;		/* Grown tokens[] from, %NULL: heap */
+	jsmntok_t   local[JSON_LOCAL_TOKENS];
+} json_t;
+
+int  json_parse    (json_t *js, const char *json, size_t len);
+int  json_parse_in (json_t *js, arena_t *arena, const char *json, size_t len);
+#ifndef DROP_JSON
+void json_free     (json_t *js);
+#else
+#define json_free(js)	do { } while (0)
+#endif
+
+int  json_skip     (const json_t *js, int tok);
+int  json_find     (const json_t *js, int tok, const char *path);
+
+int  json_get_str  (const json_t *js, int tok, const char *path, char *buf, size_t len);
+int  json_get_int  (const json_t *js, int tok, const char *path, long *out_value);
+int  json_get_bool (const json_t *js, int tok, const char *path, int *out_value);
+int  json_str_eq   (const json_t *js, int tok, const char *path, const char *s);
+
 int parse_json(const char *json, jsmntok_t *out_tokens[]);
 int jsoneq(const char *json, const jsmntok_t *tok, const char *s);
 int json_bool(const char *json, const jsmntok_t *token, int *out_value);
@@ -23,21 +23,69 @@
 #define INADYN_LOG_H_
 
 #include <stdarg.h>
+#include <time.h>
 #include "os.h"
 
 #ifndef MAX_LOG_LEVEL
 #define MAX_LOG_LEVEL LOG_DEBUG
 #endif
 
-void log_init  (char *ident, int log, int bg);
-void log_exit  (void);
+#define LOG_RING_SIZE       128	/* Messages queued in async mode */
+#define LOG_MSG_LEN         512	/* Longer messages are truncated in async mode */
+#define LOG_LIMIT_BURST     5	/* Messages per message site ... */
+#define LOG_LIMIT_INTERVAL  600	/* ... and this many seconds, see logit_limit() */
 
-int  log_level (char *level);
+/* Rate limit state, one per message site */
+typedef struct {
+	time_t       start;
+	unsigned int num;
+	unsigned int suppressed;
+} log_limit_t;
 
-void logitf     (int prio, const char *fmt, ...);
-void vlogit    (int prio, const char *fmt, va_list args);
+/*
+ * A structured event, e.g., an update, for log pipelines.  With the
+ * JSON log format the fields are logged as keys, otherwise only the
+ * message is.  NULL strings are left out, as is the duration unless
+ * @start is set.
+ */
+typedef struct {
+	const char *event;	/* Type, e.g., "update" or "update-failed" */
+	const char *provider;
+	const char *alias;
+	const char *address;
+	const char *server;
+	int         rc;		/* Logged with error_str(rc) */
+	long long   start;	/* msec, from event_msec(), for the duration */
+} log_event_t;
+
+extern int log_upto;		/* Highest priority logged, from log_level() */
+
+void log_init     (char *ident, int log, int bg);
+void log_exit     (void);
+
+int  log_level    (char *level);
+int  log_format   (char *format);
+
+void log_async    (int on);
+void log_flush    (void);
+int  log_suppress (log_limit_t *rl, int prio);
+
+void logitf       (int prio, const char *fmt, ...);
+void log_event    (int prio, const log_event_t *ev, const char *fmt, ...);
+void vlogit       (int prio, const char *fmt, va_list args);
+
+#define log_enabled(p) ((p) <= MAX_LOG_LEVEL && (p) <= log_upto)
+
+#define logit(p, ...) do if (log_enabled(p)) logitf((p), __VA_ARGS__); while (0)
+
+#define logit_event(p, ev, ...) do if (log_enabled(p)) log_event((p), (ev), __VA_ARGS__); while (0)
 
-#define logit(p, ...) do if ((p) <= MAX_LOG_LEVEL) logitf((p), __VA_ARGS__); while (0)
+/* For messages that may repeat every cycle, e.g., when the network is down */
+#define logit_limit(p, ...) do {						\
+		static log_limit_t rl_;						\
+		if (log_enabled(p) && !log_suppress(&rl_, (p)))			\
+			logitf((p), __VA_ARGS__);				\
+	} while (0)
 
 #endif /* INADYN_LOG_H_ */
 
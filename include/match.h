@@ -0,0 +1,52 @@
+/* Multi-pattern matcher for classifying server responses
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_MATCH_H_
+#define INADYN_MATCH_H_
+
+#include <stddef.h>
+
+#define MATCH_NOCASE	0x01	/* Case insensitive */
+#define MATCH_WORD	0x02	/* Whole words only, e.g. not "good" in "goodbye" */
+
+/* One pattern and its result, earlier entries in a table win */
+typedef struct {
+	const char *pattern;
+	int         rc;
+} match_rule_t;
+
+typedef struct matcher matcher_t;
+
+/* One allocation, release with match_free() */
+matcher_t *match_compile (const match_rule_t *rules, size_t num, int flags);
+void       match_free    (matcher_t *m);
+
+int        match_find    (const matcher_t *m, const char *text, size_t len);
+int        match_rc      (const matcher_t *m, const char *text, size_t len, int def);
+
+#endif /* INADYN_MATCH_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
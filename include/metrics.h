@@ -0,0 +1,52 @@
+/* Interface for the Prometheus metrics exporter
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_METRICS_H_
+#define INADYN_METRICS_H_
+
+#include <stdio.h>
+#include "ddns.h"
+
+#ifndef DROP_METRICS
+extern char *metrics_file;
+
+void metrics_update (ddns_info_t *info, int rc);
+void metrics_cycle  (long long msec);
+void metrics_worker (int id, unsigned long jobs, long long msec);
+
+int  metrics_render (FILE *fp);
+int  metrics_write  (void);
+#else
+/* Built with --disable-metrics, nothing is collected */
+static inline void metrics_update (ddns_info_t *info, int rc) { }
+static inline void metrics_cycle  (long long msec) { }
+static inline void metrics_worker (int id, unsigned long jobs, long long msec) { }
+static inline int  metrics_write  (void) { return 0; }
+#endif
+
+#endif /* INADYN_METRICS_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
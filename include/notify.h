@@ -0,0 +1,41 @@
+/* Service manager integration, readiness, status, watchdog and sockets
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_NOTIFY_H_
+#define INADYN_NOTIFY_H_
+
+#define NOTIFY_MAX_MSG	256	/* Longest message to the service manager */
+#define NOTIFY_MAX_FDS	8	/* Sockets accepted with socket activation */
+
+void notify_init     (void);
+int  notify          (const char *fmt, ...) __attribute__ ((format (printf, 1, 2)));
+void notify_watchdog (void);
+int  notify_next     (void);
+int  notify_fd       (const char *name);
+
+#endif /* INADYN_NOTIFY_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -60,7 +60,8 @@
 
 int os_install_signal_handler (void *ctx);
 int os_check_perms            (void);
-int os_shell_execute          (char *cmd, char *ip, char *hostname, char *event, int error);
+ssize_t os_shell_read         (const char *cmd, const char *name, const char *user,
+			       char *buf, size_t len, int timeout);
 
 #endif /* INADYN_OS_H_ */
 
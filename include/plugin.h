@@ -25,10 +25,12 @@
 #define INADYN_PLUGIN_H_
 
 #include "config.h"
+#include <stddef.h>
 #include "queue.h"		/* BSD sys/queue.h API */
+#include "resource.h"
 
 #define GENERIC_HTTP_REQUEST                                      	\
-	"GET %s HTTP/1.0\r\n"						\
+	"GET %s HTTP/1.1\r\n"						\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -38,11 +40,25 @@
 #define PLUGIN_ITERATOR(x, tmp) TAILQ_FOREACH_SAFE(x, &plugins, link, tmp)
 
 /* Types used for DNS system specific configuration */
-/* Function to prepare DNS system specific server requests */
+/*
+ * Function to prepare DNS system specific server requests.  May return
+ * %RC_DDNS_RECORD_CURRENT if it finds the record already up to date,
+ * then no update is sent.
+ */
 typedef int (*setup_fn_t) (void* this, void* info, void* alias);
 typedef int (*req_fn_t) (void *this, void *info, void *alias);
 typedef int (*rsp_fn_t) (void *this, void *info, void *alias);
 
+/* Several aliases in one request, @alias is an array of @num pointers */
+typedef int (*req_batch_fn_t) (void *this, void *info, void *alias, size_t num);
+typedef int (*rsp_batch_fn_t) (void *this, void *info, void *alias, size_t num, int *rc);
+
+/* Update without HTTP, e.g. DNS UPDATE, all @num aliases, results in @rc */
+typedef int (*update_fn_t) (void *this, void *info, void *alias, size_t num, int *rc);
+
+/* Look up, and keep, what setup() needs for all aliases, e.g. record IDs */
+typedef int (*prefetch_fn_t) (void *this, void *info);
+
 typedef struct ddns_system {
 	TAILQ_ENTRY(ddns_system) link; /* BSD sys/queue.h linked list node. */
 
@@ -55,7 +71,23 @@ typedef struct ddns_system {
 	req_fn_t       request;
 	rsp_fn_t       response;
 
+	/* Optional, update up to batch hostnames per request, e.g. dyndns2 */
+	const size_t   batch;
+	req_batch_fn_t request_batch;
+	rsp_batch_fn_t response_batch;
+
+	/* Optional, replaces request/response, all hostnames at once */
+	update_fn_t    update;
+
+	/* Optional, run while idle, before the first update, see prefetch */
+	prefetch_fn_t  prefetch;
+
 	const int      nousername;    /* Provider does not require username='' */
+	const int      early_data;    /* Requests are idempotent, may be sent as TLS 1.3 early data */
+
+	/* Optional, API rate limit: quota requests per quota_period sec */
+	const int      quota;
+	const int      quota_period;
 
 	const char    *checkip_name;
 	const char    *checkip_url;
@@ -66,7 +98,49 @@ typedef struct ddns_system {
 	const char    *server_req;
 } ddns_system_t;
 
-/* Public plugin API */
+/*
+ * Built-in plugins are collected in a linker section, the registry, by
+ * PLUGIN_REGISTER() instead of registering from a constructor.  So
+ * registering them does not allocate or search the list.  Plugins that
+ * compile a response matcher still do that from a PLUGIN_INIT()
+ * constructor, e.g. common.c, easydns.c and zoneedit.c.
+ *
+ * The ipv6 variant of a plugin is declared by PLUGIN_REGISTER_V6(),
+ * with its own name and request, the rest is filled in from the IPv4
+ * plugin when the registry is first used.
+ *
+ * The section is writable, the entries hold pointers, which are
+ * relocated at load time in position independent executables.
+ */
+typedef struct {
+	ddns_system_t       *system;
+	const char          *req;
+	const ddns_system_t *v4;      /* Set for ipv6 variants */
+} plugin_entry_t;
+
+#ifdef __APPLE__
+#define PLUGIN_SECTION "__DATA,inadyn_plugins"
+#else
+#define PLUGIN_SECTION "inadyn_plugins"
+#endif
+
+/* Keep source order in the registry, GCC otherwise reverses it */
+#ifdef __clang__
+#define PLUGIN_ORDER
+#else
+#define PLUGIN_ORDER no_reorder,
+#endif
+
+#define PLUGIN_ENTRY(sys, req, v4)					\
+	static const plugin_entry_t plugin_entry_##sys			\
+	__attribute__ ((used, PLUGIN_ORDER section(PLUGIN_SECTION), aligned(sizeof(void *)))) = { &sys, req, v4 }
+
+#define PLUGIN_REGISTER(sys, req) PLUGIN_ENTRY(sys, req, NULL)
+#define PLUGIN_REGISTER_V6(sys, v6name, req)				\
+	static ddns_system_t sys##_ipv6 = { .name = v6name };		\
+	PLUGIN_ENTRY(sys##_ipv6, req, &sys)
+
+/* Public plugin API, for plugins loaded at runtime */
 int            plugin_register    (ddns_system_t *system, const char *req);
 int            plugin_register_v6 (ddns_system_t *system, const char *req);
 int            plugin_unregister  (ddns_system_t *system);
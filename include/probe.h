@@ -0,0 +1,70 @@
+/* USDT static probes, for bpftrace, perf and SystemTap
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_PROBE_H_
+#define INADYN_PROBE_H_
+
+/*
+ * Built with --enable-usdt every PROBE() is a nop instruction and a
+ * note in the ELF file, e.g. to see slow updates without a rebuild:
+ *
+ *     bpftrace -e 'usdt:/usr/sbin/inadyn:inadyn:update__done
+ *                  { printf("%s %s rc %d %d ms\n", str(arg0), str(arg1), arg2, arg3); }'
+ *
+ * Strings are passed as pointers, numbers as int or long long.
+ *
+ *     update__start   provider, alias, address
+ *     update__done    provider, alias, rc, msec
+ *     request__start  provider, alias, request length
+ *     request__done   provider, alias, rc, HTTP status
+ *     http__start     host, request length
+ *     http__done      host, rc, HTTP status
+ *     http__phases    host, resolve, connect, handshake, first byte, total msec
+ *     tcp__connect    host, port, number of addresses
+ *     tcp__connected  host, rc
+ *     ssl__open       host
+ *     ssl__handshake  host, rc
+ *     address__start  provider, address family
+ *     address__done   provider, rc, address
+ *     cache__write    alias, address
+ *     cache__save     records, fsync
+ *
+ * Arguments are not evaluated at all without --enable-usdt.
+ */
+
+#include "config.h"
+
+#ifdef ENABLE_USDT
+#include <sys/sdt.h>
+#define PROBE(name, ...)	STAP_PROBEV(inadyn, name, __VA_ARGS__)
+#else
+#define PROBE(name, ...)	do { } while (0)
+#endif
+
+#endif /* INADYN_PROBE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
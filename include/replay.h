@@ -0,0 +1,47 @@
+/* Record and replay of HTTP transactions
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_REPLAY_H_
+#define INADYN_REPLAY_H_
+
+#include "http.h"
+
+#define REPLAY_DEFAULT_SCALE	100	/* percent of recorded latency */
+
+extern char *record_file;
+extern char *replay_file;
+extern int   replay_scale;
+
+int  replay_init   (void);
+void replay_exit   (void);
+
+void replay_record (http_t *client, int rc);
+int  replay_find   (http_t *client, http_trans_t *trans, int *msec);
+int  replay_get    (int id, const char **rsp, int *len);
+
+#endif /* INADYN_REPLAY_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
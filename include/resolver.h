@@ -0,0 +1,52 @@
+/* DNS-over-HTTPS resolver for alias lookups
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_RESOLVER_H_
+#define INADYN_RESOLVER_H_
+
+#include "ddns.h"
+
+#define RESOLVER_DEFAULT_PATH	"/dns-query"
+#define RESOLVER_CONNECTIONS	4	/* Lookups in flight, one per connection */
+#define RESOLVER_TIMEOUT	10000	/* msec, for all lookups of a batch */
+
+typedef struct {
+	const char *name;
+	int         family;		/* AF_INET or AF_INET6 */
+	int         rc;			/* POSIX OK(0), or RC_* */
+	char        address[MAX_ADDRESS_LEN];
+} resolver_query_t;
+
+int  resolver_set     (const char *url);
+int  resolver_enabled (void);
+
+int  resolver_lookup  (resolver_query_t *query, size_t num, int timeout);
+void resolver_exit    (void);
+
+#endif /* INADYN_RESOLVER_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,88 @@
+/* Heap and resource accounting, for the metrics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_RESOURCE_H_
+#define INADYN_RESOURCE_H_
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Heap in use by one subsystem or plugin, see MEM_TAG() */
+typedef struct mem_tag {
+	const char     *name;
+	unsigned long   allocs;
+	unsigned long   frees;
+	size_t          bytes;		/* In use, excl. accounting overhead */
+	size_t          peak;
+	struct mem_tag *next;
+} mem_tag_t;
+
+#ifdef ENABLE_MEMSTAT
+/*
+ * Declare the tag of a source file, at file scope, before any of the
+ * mem_*() wrappers below.  Memory from them must be released with
+ * mem_free(), also when it is passed on to other files, e.g. plugin
+ * state in info->data.
+ */
+#define MEM_TAG(str)							\
+	static void __attribute__ ((constructor)) mem_tag_init(void);	\
+	static mem_tag_t mem_tag = { .name = str };			\
+	static void mem_tag_init(void) { mem_register(&mem_tag); }	\
+	static mem_tag_t mem_tag
+
+#define mem_malloc(len)		mem_tag_malloc(&mem_tag, len)
+#define mem_calloc(num, len)	mem_tag_calloc(&mem_tag, num, len)
+#define mem_realloc(ptr, len)	mem_tag_realloc(&mem_tag, ptr, len)
+#define mem_strdup(str)		mem_tag_strdup(&mem_tag, str)
+#define mem_free(ptr)		mem_tag_free(ptr)
+
+void       mem_register    (mem_tag_t *tag);
+mem_tag_t *mem_tags        (void);
+
+void      *mem_tag_malloc  (mem_tag_t *tag, size_t len);
+void      *mem_tag_calloc  (mem_tag_t *tag, size_t num, size_t len);
+void      *mem_tag_realloc (mem_tag_t *tag, void *ptr, size_t len);
+char      *mem_tag_strdup  (mem_tag_t *tag, const char *str);
+void       mem_tag_free    (void *ptr);
+#else
+#define MEM_TAG(str)		struct mem_tag
+
+#define mem_malloc(len)		malloc(len)
+#define mem_calloc(num, len)	calloc(num, len)
+#define mem_realloc(ptr, len)	realloc(ptr, len)
+#define mem_strdup(str)		strdup(str)
+#define mem_free(ptr)		free(ptr)
+
+#define mem_tags()		((mem_tag_t *)NULL)
+#endif
+
+int res_fds (void);
+
+#endif /* INADYN_RESOURCE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,42 @@
+/* SHA-256 cryptographic hash function, FIPS 180-4
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* Same API as the bundled md5.h and sha1.h, only used without SSL */
+typedef struct
+{
+	uint64_t      total;		/* number of bytes processed  */
+	uint32_t      state[8];		/* intermediate digest state  */
+	unsigned char buffer[64];	/* data block being processed */
+}
+sha256_context;
+
+void sha256_starts (sha256_context *ctx);
+void sha256_update (sha256_context *ctx, const unsigned char *input, size_t ilen);
+void sha256_finish (sha256_context *ctx, unsigned char output[32]);
+void sha256        (const unsigned char *input, size_t ilen, unsigned char output[32]);
+
+#endif /* sha256.h */
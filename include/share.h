@@ -0,0 +1,47 @@
+/* Address discovery shared by the inadyn instances on a host
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef INADYN_SHARE_H_
+#define INADYN_SHARE_H_
+
+#include <stddef.h>
+#include "ddns.h"
+
+#define SHARE_MAX_RECORDS	32	/* Different checkip setups on one host */
+#define SHARE_KEY_LEN		64	/* Hex SHA-256 of the checkip setup */
+
+extern char *share_file;
+
+int  share_init    (ddns_t *ctx);
+void share_exit    (void);
+
+int  share_enabled (void);
+int  share_lookup  (const char *key, int family, int max_age, char *address, size_t len);
+void share_publish (const char *key, int family, const char *address);
+
+#endif /* INADYN_SHARE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
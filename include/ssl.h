@@ -33,24 +33,49 @@ extern char *ca_trust_file;
 extern int secure_ssl;
 extern int broken_rtc;
 
+/*
+ * Each backend keeps a long-lived TLS context, shared by all clients,
+ * and remembers the last session with each server, by hostname, for an
+ * abbreviated handshake the next time we connect.  The CA trust store
+ * is loaded once, and reloaded only after ssl_reload(), e.g. on SIGHUP,
+ * or when the CA bundle file is modified.
+ */
+#define SSL_SESSION_CACHE_SIZE 16
+
+/*
+ * The session is set up on top of an already connected, non-blocking,
+ * client->tcp.  Like tcp_send() and tcp_recv(), ssl_handshake() and the
+ * send/recv functions return RC_TCP_WANT_READ or RC_TCP_WANT_WRITE when
+ * they need to be called again once the socket is ready.  Without
+ * ssl_enabled they fall back to plain TCP.
+ *
+ * With client->http2 set, and HTTP/2 support built in, h2 is offered
+ * in ALPN before http/1.1, ssl_alpn_h2() tells what the server chose.
+ */
 #ifdef ENABLE_SSL
 int     ssl_init(void);
 void    ssl_exit(void);
+void    ssl_reload(void);
 
-int     ssl_open(http_t *client, char *msg, int force);
+int     ssl_open(http_t *client, char *msg);
+int     ssl_handshake(http_t *client);
 int     ssl_close(http_t *client);
+int     ssl_alpn_h2(http_t *client);
 
-int     ssl_send(http_t *client, const char *buf, int     len);
+int     ssl_send(http_t *client, const char *buf, int     len, int *sent);
 int     ssl_recv(http_t *client,       char *buf, int buf_len, int *recv_len);
 
 #else
 #define ssl_init()  0
 #define ssl_exit()
+#define ssl_reload()
 
-#define ssl_open(client, msg, force)                    tcp_init(&client->tcp, msg, force)
+#define ssl_open(client, msg)                    0
+#define ssl_handshake(client)                    0
 #define ssl_close(client)                        tcp_exit(&client->tcp)
+#define ssl_alpn_h2(client)                      0
 
-#define ssl_send(client, buf, len)               tcp_send(&client->tcp, buf, len)
+#define ssl_send(client, buf, len, sent)         tcp_send(&client->tcp, buf, len, sent)
 #define ssl_recv(client, buf, buf_len, recv_len) tcp_recv(&client->tcp, buf, buf_len, recv_len)
 
 #endif /* ENABLE_SSL */
@@ -23,12 +23,17 @@
 #ifndef INADYN_TCP_H_
 #define INADYN_TCP_H_
 
+#include "config.h"
 #include "os.h"
 #include "error.h"
+#include "dnscache.h"
+
+struct pollfd;
 
 #define TCP_DEFAULT_TIMEOUT		5000	/* msec */
+#define TCP_ATTEMPT_DELAY		250	/* msec, RFC 8305 Connection Attempt Delay */
 #define TCP_SOCKET_MAX_PORT		65535
-#define TCP_DEFAULT_READ_CHUNK_SIZE	100
+#define TCP_PROXY_BUF_LEN		1024	/* Proxy handshake, see tcp_proxy() */
 
 #define TCP_AUTO	0
 #define TCP_FORCE_IPV4	1
@@ -40,7 +45,7 @@ typedef enum {
 	PROXY_SOCKS4A,
 	PROXY_SOCKS5,
 	PROXY_SOCKS5_HOSTNAME,
-	PROXY_HTTP_CONNECT, /* SSL only. */
+	PROXY_HTTP_CONNECT,
 } tcp_proxy_type_t;
 
 typedef struct {
@@ -52,18 +57,48 @@ typedef struct {
 	unsigned short      port;
 	int                 timeout;
 
+	/* Non-blocking connect in progress, remaining addresses to try */
+	dns_addr_t          addr[DNSCACHE_MAX_ADDRS];
+	int                 num_addrs;
+	int                 next_addr;
+
+	/* Happy Eyeballs, connection attempts racing each other */
+	struct {
+		int         sd;
+		dns_addr_t *addr;
+	}                   attempt[DNSCACHE_MAX_ADDRS];
+	int                 num_attempts;
+	long long           next_attempt;
+	long long           deadline;
+	long long           resolved;	/* msec, event_msec() when resolved */
+	const char         *msg;
+	int                 force;
+	int                 tries;
+
 	tcp_proxy_type_t    proxy_type;
 	const char         *proxy_host;
 	unsigned short      proxy_port;
+
+#ifndef DROP_PROXY
+	/* Proxy handshake in progress, see tcp_proxy() */
+	int                 proxy_phase;
+	unsigned char       proxy_buf[TCP_PROXY_BUF_LEN];
+	int                 proxy_out;	/* Bytes in proxy_buf to send */
+	int                 proxy_pos;	/* Sent, or received, so far */
+#endif
 } tcp_sock_t;
 
 int tcp_construct          (tcp_sock_t *tcp);
 int tcp_destruct           (tcp_sock_t *tcp);
 
-int tcp_init               (tcp_sock_t *tcp, char *msg, int force);
+int tcp_connect            (tcp_sock_t *tcp, const char *msg, int force);
+int tcp_connect_check      (tcp_sock_t *tcp);
+int tcp_connect_fds        (tcp_sock_t *tcp, struct pollfd *pfd, int max);
+long long tcp_connect_deadline (tcp_sock_t *tcp);
+int tcp_proxy              (tcp_sock_t *tcp);
 int tcp_exit               (tcp_sock_t *tcp);
 
-int tcp_send               (tcp_sock_t *tcp, const char *buf, int len);
+int tcp_send               (tcp_sock_t *tcp, const char *buf, int len, int *sent);
 int tcp_recv               (tcp_sock_t *tcp,       char *buf, int len, int *recv_len);
 
 int tcp_set_port           (tcp_sock_t *tcp, int  port);
@@ -72,6 +107,8 @@ int tcp_get_port           (tcp_sock_t *tcp, int *port);
 int tcp_set_remote_name    (tcp_sock_t *tcp, const char  *name);
 int tcp_get_remote_name    (tcp_sock_t *tcp, const char **name);
 
+int tcp_set_proxy          (tcp_sock_t *tcp, tcp_proxy_type_t type, const char *name, int port);
+
 int tcp_set_remote_timeout (tcp_sock_t *tcp, int  timeout);
 int tcp_get_remote_timeout (tcp_sock_t *tcp, int *timeout);
 
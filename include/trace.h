@@ -0,0 +1,52 @@
+/* Per-cycle trace timeline, in the Chrome trace event format
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_TRACE_H_
+#define INADYN_TRACE_H_
+
+#include <stdio.h>
+
+#define TRACE_MAX_EVENTS	1024	/* Per cycle, any more are counted as dropped */
+#define TRACE_LABEL_LEN		96
+
+extern int   trace_enabled;
+extern char *trace_file;
+
+long long trace_cycle  (void);
+long long trace_start  (void);
+void      trace_span   (long long start, const char *cat, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+void      trace_range  (long long start, long long end, const char *cat, const char *fmt, ...)
+	__attribute__ ((format (printf, 4, 5)));
+void      trace_thread (int id);
+
+int       trace_render (FILE *fp);
+int       trace_write  (void);
+
+#endif /* INADYN_TRACE_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,44 @@
+/* io_uring backend for event_poll(), Linux only
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef INADYN_URING_H_
+#define INADYN_URING_H_
+
+#include "config.h"
+#include <poll.h>
+
+#ifdef ENABLE_IO_URING
+int  uring_poll (struct pollfd *pfd, int num, int msec);
+void uring_exit (void);
+#else
+#define uring_poll(pfd, num, msec) poll(pfd, num, msec)
+#define uring_exit()
+#endif
+
+#endif /* INADYN_URING_H_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -24,7 +24,7 @@
 #define ALL_INKL_UPDATE_IP_REQUEST					\
 	"GET %s?"							\
 	"myip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -68,16 +68,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return 0;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, ALL_INKL_UPDATE_IP_REQUEST);
-	plugin_register_v6(&plugin, ALL_INKL_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, ALL_INKL_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@all-inkl.com", ALL_INKL_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
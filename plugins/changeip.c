@@ -28,7 +28,7 @@
 	"system=dyndns&"						\
 	"hostname=%s&"							\
 	"myip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -95,21 +95,11 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return common_response(trans, info, alias);
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&ovh, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&ovh, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&strato, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&strato, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-	plugin_unregister(&ovh);
-	plugin_unregister(&strato);
-}
+PLUGIN_REGISTER(plugin, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(ovh, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(ovh, "ipv6@ovh.com", CHANGEIP_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(strato, CHANGEIP_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(strato, "ipv6@strato.com", CHANGEIP_UPDATE_IP_HTTP_REQUEST);
 
 /**
  * Local Variables:
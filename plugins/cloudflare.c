@@ -22,21 +22,25 @@
 #include "plugin.h"
 #include "json.h"
 
+MEM_TAG("cloudflare");
+
 #define CHECK(fn)       { rc = (fn); if (rc) goto cleanup; }
 
 #define API_HOST "api.cloudflare.com"
 #define API_URL "/client/v4"
+#define CLOUDFLARE_MAX_BATCH 100	/* Records per batch DNS records request */
 
 /* https://developers.cloudflare.com/api/operations/zones-get */
-static const char *CLOUDFLARE_ZONE_ID_REQUEST = "GET " API_URL "/zones?name=%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_ZONE_ID_REQUEST = "GET " API_URL "/zones?name=%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
+	HTTP_ACCEPT_GZIP				\
 	"Authorization: Bearer %s\r\n"	\
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-dns-record-details */	
-static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zones/%s/dns_records/%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zones/%s/dns_records/%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -44,15 +48,16 @@ static const char *CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID	= "GET " API_URL "/zon
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-list-dns-records */	
-static const char *CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME	= "GET " API_URL "/zones/%s/dns_records?type=%s&name=%s%s HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME	= "GET " API_URL "/zones/%s/dns_records?type=%s&name=%s%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
+	HTTP_ACCEPT_GZIP				\
 	"Authorization: Bearer %s\r\n"	\
 	"Content-Type: application/json\r\n\r\n";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-create-dns-record */	
-static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/%s/dns_records HTTP/1.0\r\n"	\
+static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/%s/dns_records HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -62,7 +67,7 @@ static const char *CLOUDFLARE_HOSTNAME_CREATE_REQUEST	= "POST " API_URL "/zones/
 	"%s";
 
 /* https://developers.cloudflare.com/api/operations/dns-records-for-a-zone-update-dns-record */
-static const char *CLOUDFLARE_HOSTNAME_UPDATE_REQUEST	= "PUT " API_URL "/zones/%s/dns_records/%s HTTP/1.0\r\n"	\
+static const char CLOUDFLARE_HOSTNAME_UPDATE_REQUEST[]	= "PUT " API_URL "/zones/%s/dns_records/%s HTTP/1.1\r\n"	\
 	"Host: " API_HOST "\r\n"		\
 	"User-Agent: %s\r\n"			\
 	"Accept: */*\r\n"				\
@@ -71,23 +76,49 @@ static const char *CLOUDFLARE_HOSTNAME_UPDATE_REQUEST	= "PUT " API_URL "/zones/%
 	"Content-Length: %zd\r\n\r\n" \
 	"%s";
 	
+/* https://developers.cloudflare.com/api/resources/dns/subresources/records/methods/batch/ */
+static const char *CLOUDFLARE_BATCH_REQUEST	= "POST " API_URL "/zones/%s/dns_records/batch HTTP/1.1\r\n"	\
+	"Host: " API_HOST "\r\n"		\
+	"User-Agent: %s\r\n"			\
+	"Accept: */*\r\n"				\
+	"Authorization: Bearer %s\r\n"	\
+	"Content-Type: application/json\r\n" \
+	"Content-Length: %zd\r\n\r\n" \
+	"%s";
+
+static const char *CLOUDFLARE_BATCH_PUT_JSON_FORMAT = "{\"id\":\"%s\",\"type\":\"%s\",\"name\":\"%s%s\",\"content\":\"%s\",\"ttl\":%li,\"proxied\":%s}";
+
 static const char *CLOUDFLARE_UPDATE_JSON_FORMAT = "{\"type\":\"%s\",\"name\":\"%s%s\",\"content\":\"%s\",\"ttl\":%li,\"proxied\":%s}";
 
 static const char *IPV4_RECORD_TYPE = "A";
 static const char *IPV6_RECORD_TYPE = "AAAA";
 static const char *KEY_SUCCESS = "success";
 
+static int prefetch (ddns_t       *ctx,   ddns_info_t *info);
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *hostname);
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *hostname);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *hostname);
 
+static int request_batch  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t **hostname, size_t num);
+static int response_batch (http_trans_t *trans, ddns_info_t *info, ddns_alias_t **hostname, size_t num, int *rc);
+
 static ddns_system_t plugin = {
 	.name         = "default@cloudflare.com",
 
+	.prefetch     = (prefetch_fn_t)prefetch,
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
+	/* Record updates with the same address as one batch request */
+	.batch          = CLOUDFLARE_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
+
+	/* API rate limit, 1200 requests per five minutes */
+	.quota        = 1200,
+	.quota_period = 300,
+
 	/*
 	 * 1.1.1.1 is chosen here due to "allow-ipv6" is default to false
 	 * www.cloudflare.com would also work but is dual stack and may return ipv6 address
@@ -104,13 +135,23 @@ static ddns_system_t plugin = {
 
 /*
  * filled by the setup() callback and handed to ddns_info_t
- * for use later in the request() callback .
+ * for use later in the request() callback.  The zone and record
+ * IDs are kept across updates, until Cloudflare says 404, and saved
+ * in the alias for the state file to keep them across restarts.
  */
 #define MAX_ID (32 + 1)
 
+struct cfrecord {
+	char name[SERVER_NAME_LEN];	/* Alias name the ID was looked up for */
+	const char *type;
+	char id[MAX_ID];		/* Empty if not known, or to be created */
+	char current[MAX_ADDRESS_LEN];	/* Record has this address, by the last lookup */
+};
+
 struct cfdata {
+	char zone[SERVER_NAME_LEN];
 	char zone_id[MAX_ID];
-	char hostname_id[MAX_ID];
+	struct cfrecord record[];	/* Per alias, info->alias_count */
 };
 
 static int check_response_code(int status)
@@ -129,6 +170,9 @@ static int check_response_code(int status)
 	case 429:
 		logit(LOG_WARNING, "HTTP 429: We got rate limited.");
 		return RC_DDNS_RSP_RETRY_LATER;
+	case 404:
+		logit(LOG_WARNING, "HTTP 404: Zone or record not found, looking it up again.");
+		return RC_DDNS_RSP_RETRY_LATER;
 	case 405:
 		logit(LOG_ERR, "HTTP 405: Bad HTTP method; has the interface changed?");
 		return RC_DDNS_RSP_NOTOK;
@@ -141,162 +185,344 @@ static int check_response_code(int status)
 	}
 }
 
-static int check_success(const char *json, const jsmntok_t tokens[], const int num_tokens)
+static int check_success(const json_t *js)
 {
-	int i;
-
-	for (i = 1; i < num_tokens; i++) {
-		int set;
-
-		if (jsoneq(json, tokens + i, KEY_SUCCESS) != 0)
-			continue;
+	int set;
 
-		if (i < num_tokens - 1 && json_bool(json, tokens + i + 1, &set) == 0)
-			return set ? 0 : -1;
-				
+	if (json_get_bool(js, 0, KEY_SUCCESS, &set))
 		return -1;
-	}
-	
-	return -1;
+
+	return set ? 0 : -1;
 }
 
-static int check_success_only(const char *json)
+static int check_success_only(const char *json, size_t len)
 {
-	jsmntok_t *tokens;
-	int num_tokens;
-	int result;
-	
-	num_tokens = parse_json(json, &tokens);	
-	if (num_tokens == -1)
-		return -1;
+	json_t js;
+	int result = -1;
 
-	result = check_success(json, tokens, num_tokens);
-	free(tokens);
+	if (json_parse(&js, json, len) > 0)
+		result = check_success(&js);
+	json_free(&js);
 
 	return result;
 }
 
-static int get_result_value(const char *json, const char *key, jsmntok_t *out_result)
+/* Copy string at @path, e.g. "result[0].id", from a successful response */
+static int get_result_value(const json_t *js, const char *path, char *dest, size_t dest_size)
 {
-	jsmntok_t *tokens;
-	int i, num_tokens;
-	
-	num_tokens = parse_json(json, &tokens);
-	if (num_tokens < 0)
-		return -1;
-	
-	if (tokens[0].type != JSMN_OBJECT) {
+	int rc;
+
+	if (js->num <= 0 || js->tokens[0].type != JSMN_OBJECT) {
 		logit(LOG_ERR, "JSON response contained no objects.");
-		goto cleanup;
+		return -1;
 	}
-	
-	if (check_success(json, tokens, num_tokens) == -1) {
+
+	if (check_success(js) == -1) {
 		logit(LOG_ERR, "Request was unsuccessful.");
-		goto cleanup;
+		return -1;
 	}
-	
-	for (i = 1; i < num_tokens; i++) {
-		if (jsoneq(json, tokens + i, key) != 0)
-			continue;
 
-		if (i < num_tokens - 1) {
-			*out_result = tokens[i+1];
-			free(tokens);
-			return 0;
-		}
+	rc = json_get_str(js, 0, path, dest, dest_size);
+	if (rc == -1)
+		logit(LOG_INFO, "Could not find key '%s'.", path);
+	else if (rc == -2)
+		logit(LOG_ERR, "Key value did not fit into buffer.");
+
+	return rc;
+}
+
+/*
+ * Does the record at @path, e.g. "result[0]", already have the address,
+ * ttl and proxied setting that we would send?  Then the update is a
+ * no-op, only costing API quota.
+ */
+static int is_current(const json_t *js, const char *path, ddns_info_t *info, ddns_alias_t *hostname)
+{
+	char key[32], content[MAX_ADDRESS_LEN];
+	ddns_addr_t addr;
+	int proxied;
+	long ttl;
+
+	snprintf(key, sizeof(key), "%s.content", path);
+	if (json_get_str(js, 0, key, content, sizeof(content)) < 0)
+		return 0;
+	if (addr_parse(&addr, content) || !addr_equal(&addr, &hostname->addr))
+		return 0;
+
+	snprintf(key, sizeof(key), "%s.ttl", path);
+	if (json_get_int(js, 0, key, &ttl) || ttl != (info->ttl >= 0 ? info->ttl : 1))
+		return 0;
+
+	snprintf(key, sizeof(key), "%s.proxied", path);
+	if (json_get_bool(js, 0, key, &proxied) || !proxied != !info->proxied)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Uses the same, kept-alive, connection as the update that follows.
+ * With @current, also check if the record at @path is up to date.
+ */
+static int json_extract(ddns_t *ctx, char *dest, size_t dest_size, ddns_info_t *info, size_t request_len,
+			const char *key, const char *path, ddns_alias_t *hostname, int *current)
+{
+	plugin_rsp_t rsp;
+	int rc;
+
+	rc = plugin_query(ctx, info, "Json query", request_len, &rsp);
+	if (rc)
+		goto cleanup;
+
+	rc = check_response_code(rsp.trans.status);
+	if (rc)
+		goto cleanup;
+
+	switch (get_result_value(&rsp.json, key, dest, dest_size)) {
+	case 0:
+		logit(LOG_DEBUG, "Key '%s' = %s", key, dest);
+		if (current)
+			*current = is_current(&rsp.json, path, info, hostname);
+		break;
+	case -2:
+		rc = RC_BUFFER_OVERFLOW;
+		break;
+	default:
+		rc = RC_DDNS_RSP_NOHOST;
+		break;
 	}
-	
-	logit(LOG_INFO, "Could not find key '%s'.", key);
 
 cleanup:
-	free(tokens);
-	return -1;
+	plugin_query_done(&rsp);
+
+	return rc;
 }
 
-static int json_copy_value(char *dest, size_t dest_size, const char *json, const jsmntok_t *token)
+static const char* get_record_type(const ddns_alias_t *alias)
 {
-	size_t length;
+	if (alias->addr.family == AF_INET6)
+		return IPV6_RECORD_TYPE;
 
-	if (token->type != JSMN_STRING)
-		return -1;
-	
-	length = token->end - token->start + 1;
-	if (length > dest_size)
-		return -2;
-	
-	strlcpy(dest, json + token->start, length);
+	return IPV4_RECORD_TYPE;
+}
 
-	return 0;
+static struct cfdata *get_data(ddns_info_t *info)
+{
+	if (!info->data)
+		info->data = mem_calloc(1, sizeof(struct cfdata) + info->alias_count * sizeof(struct cfrecord));
+
+	return (struct cfdata *)info->data;
 }
 
-static int json_extract(char *dest, size_t dest_size, const ddns_info_t *info, char *request, size_t request_len, const char *key)
+/* Forget IDs after a 404, the zone or record may have been recreated */
+static void invalidate(struct cfdata *data, struct cfrecord *rec, ddns_alias_t *hostname)
 {
-	const char   *body;
-	http_trans_t  trans;
-	jsmntok_t     key_value;
-	http_t        client;
-	char         *response_buf;
-	size_t        response_buflen = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
-	int           rc = RC_OK;
-
-	response_buf = calloc(response_buflen, sizeof(char));
-	if (!response_buf)
-		return RC_OUT_OF_MEMORY;
+	logit(LOG_DEBUG, "Dropping cached Cloudflare IDs for %s", rec->name);
+	data->zone_id[0] = 0;
+	rec->id[0] = 0;
+	rec->type  = NULL;
+	hostname->id[0] = 0;
+}
 
-	CHECK(http_construct(&client));
+/* Save IDs in the alias, "zone_id:record_id:type", for the state file */
+static void save_ids(struct cfdata *data, struct cfrecord *rec, ddns_alias_t *hostname)
+{
+	snprintf(hostname->id, sizeof(hostname->id), "%s:%s:%s", data->zone_id, rec->id, rec->type);
+}
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
+/* Restore IDs from a previous invocation, if nothing is known yet */
+static void load_ids(struct cfdata *data, struct cfrecord *rec, ddns_alias_t *hostname,
+		     const char *zone_name, const char *record_type)
+{
+	char zone_id[MAX_ID], id[MAX_ID], type[8];
+
+	if (rec->id[0] || !hostname->id[0])
+		return;
+
+	if (sscanf(hostname->id, "%32[0-9a-f]:%32[0-9a-f]:%7s", zone_id, id, type) != 3)
+		return;
+	if (strcmp(type, record_type))
+		return;
+	if (data->zone_id[0] && (strcmp(data->zone, zone_name) || strcmp(data->zone_id, zone_id)))
+		return;
+
+	strlcpy(data->zone, zone_name, sizeof(data->zone));
+	strlcpy(data->zone_id, zone_id, sizeof(data->zone_id));
+	strlcpy(rec->name, hostname->name, sizeof(rec->name));
+	strlcpy(rec->id, id, sizeof(rec->id));
+	rec->type = record_type;
+}
 
-	client.ssl_enabled = info->ssl_enabled;
-	CHECK(http_init(&client, "Json query",strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4));
+/* Is the ID of the record for @hostname known from before? */
+static int cached(struct cfrecord *rec, ddns_alias_t *hostname, const char *record_type)
+{
+	return rec->id[0] && rec->type == record_type && !strcmp(rec->name, hostname->name);
+}
 
-	trans.req = request;
-	trans.req_len = request_len;
-	trans.rsp = response_buf;
-	trans.max_rsp_len = response_buflen - 1; /* Save place for a \0 at the end */
+/* Hostname is a Cloudflare ID, for round-robin records, see setup() */
+static int is_record_id(const char *name)
+{
+	return strlen(name) == 32 && strtoull(name, NULL, 16) == ULLONG_MAX;
+}
 
-	logit(LOG_DEBUG, "Request:\n%s", request);
-	CHECK(http_transaction(&client, &trans));
+/* Up to date, by a lookup, see setup() */
+static void mark_current(struct cfrecord *rec, ddns_alias_t *hostname, int current)
+{
+	if (current)
+		strlcpy(rec->current, hostname->address, sizeof(rec->current));
+	else
+		rec->current[0] = 0;
+}
 
-	http_exit(&client);
-	http_destruct(&client, 1);
+static int lookup_zone(ddns_t *ctx, ddns_info_t *info, struct cfdata *data, const char *zone_name)
+{
+	size_t len;
+	int rc;
 
-	logit(LOG_DEBUG, "Response:\n%s", trans.rsp);
-	CHECK(check_response_code(trans.status));
+	if (data->zone_id[0] && !strcmp(data->zone, zone_name))
+		return RC_OK;
 
-	body = trans.rsp_body;
-	if (get_result_value(body, key, &key_value) < 0) {
-		rc = RC_DDNS_RSP_NOHOST;
-		goto cleanup;
+	logit(LOG_DEBUG, "Zone: %s", zone_name);
+
+	len = snprintf(ctx->request_buf, ctx->request_buflen,
+		       CLOUDFLARE_ZONE_ID_REQUEST,
+		       zone_name,
+		       info->user_agent,
+		       info->creds.password);
+
+	if (len >= ctx->request_buflen) {
+		logit(LOG_ERR, "Request for zone '%s' did not fit into buffer.", zone_name);
+		return RC_BUFFER_OVERFLOW;
 	}
 
-	if (json_copy_value(dest, dest_size, body, &key_value) < 0) {
-		logit(LOG_ERR, "Key value did not fit into buffer.");
-		rc = RC_BUFFER_OVERFLOW;
+	rc = json_extract(ctx, data->zone_id, MAX_ID, info, len, "result[0].id", NULL, NULL, NULL);
+	if (rc != RC_OK) {
+		logit(LOG_ERR, "Zone '%s' not found.", zone_name);
+		data->zone_id[0] = 0;
+		return rc;
 	}
-	logit(LOG_DEBUG, "Key '%s' = %s", key, dest);
+	strlcpy(data->zone, zone_name, sizeof(data->zone));
 
-cleanup:
-	free(response_buf);
+	logit(LOG_DEBUG, "Cloudflare Zone: '%s' Id: %s", zone_name, data->zone_id);
 
-	return rc;
+	return RC_OK;
 }
 
-static const char* get_record_type(const char *address)
+/*
+ * IDs of all records due for update, or @all of them, and not known
+ * yet, in one go.  On an HTTP/2 connection the lookups are concurrent
+ * streams, otherwise they are sent back-to-back.  Found IDs are cached
+ * for setup() of each alias, anything else is left for setup() to look
+ * up, and report.
+ */
+static void lookup_records(ddns_t *ctx, ddns_info_t *info, struct cfdata *data, const char *zone_name, int all)
 {
-	if (strstr(address, ":"))
-		return IPV6_RECORD_TYPE;
+	plugin_rsp_t *rsp;
+	size_t *idx, i, num = 0;
+	char **req;
+
+	req = arena_alloc(ctx->arena, info->alias_count * sizeof(*req));
+	idx = arena_alloc(ctx->arena, info->alias_count * sizeof(*idx));
+	rsp = arena_alloc(ctx->arena, info->alias_count * sizeof(*rsp));
+	if (!req || !idx || !rsp)
+		return;
+
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+		struct cfrecord *rec = &data->record[i];
+		const char *record_type = get_record_type(alias);
+		size_t len;
+
+		if (is_record_id(alias->name))
+			continue;
+		if (all ? !alias->address[0] : !alias->update_required)
+			continue;
 
-	return IPV4_RECORD_TYPE;
+		load_ids(data, rec, alias, zone_name, record_type);
+		if (cached(rec, alias, record_type))
+			continue;
+
+		len = strlen(CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME) + strlen(data->zone_id) +
+			strlen(alias->name) + strlen(info->user_agent) + strlen(info->creds.password) + 8;
+		req[num] = arena_alloc(ctx->arena, len);
+		if (!req[num])
+			return;
+
+		snprintf(req[num], len, CLOUDFLARE_HOSTNAME_ID_REQUEST_BY_NAME,
+			 data->zone_id,
+			 record_type,
+			 info->wildcard ? "*." : "",
+			 alias->name,
+			 info->user_agent,
+			 info->creds.password);
+		idx[num++] = i;
+	}
+
+	/* A single lookup is done by setup() as usual */
+	if (!num || (num < 2 && !all))
+		return;
+
+	logit(LOG_DEBUG, "Looking up %zu Cloudflare record IDs", num);
+	if (plugin_queries(ctx, info, "Json query", req, rsp, num))
+		goto done;
+
+	for (i = 0; i < num; i++) {
+		ddns_alias_t *alias = &info->alias[idx[i]];
+		struct cfrecord *rec = &data->record[idx[i]];
+		char id[MAX_ID];
+
+		if (rsp[i].trans.status != 200)
+			continue;
+		if (get_result_value(&rsp[i].json, "result[0].id", id, sizeof(id)))
+			continue;
+
+		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", alias->name, id);
+		strlcpy(rec->name, alias->name, sizeof(rec->name));
+		strlcpy(rec->id, id, sizeof(rec->id));
+		rec->type = get_record_type(alias);
+		mark_current(rec, alias, !all && is_current(&rsp[i].json, "result[0]", info, alias));
+		save_ids(data, rec, alias);
+	}
+done:
+	plugin_queries_done(ctx, rsp, num);
+}
+
+/*
+ * Zone and record IDs of all hostnames, before the first update, see
+ * setup().  Whether a record is already current is not kept, the
+ * address may well have changed by the time it is updated.
+ */
+static int prefetch(ddns_t *ctx, ddns_info_t *info)
+{
+	const char *zone_name = info->creds.username;
+	struct cfdata *data;
+	size_t i;
+
+	if (*zone_name == '\0' || !strchr(zone_name, '.'))
+		return RC_DDNS_INVALID_OPTION;
+
+	data = get_data(info);
+	if (!data)
+		return RC_OUT_OF_MEMORY;
+
+	/* Known from the state file, maybe no need to look up the zone */
+	for (i = 0; i < info->alias_count; i++)
+		load_ids(data, &data->record[i], &info->alias[i], zone_name, get_record_type(&info->alias[i]));
+
+	DO(lookup_zone(ctx, info, data, zone_name));
+	lookup_records(ctx, info, data, zone_name, 1);
+
+	return 0;
 }
 
 static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 {
 	const char *record_type;
 	struct cfdata *data;
+	struct cfrecord *rec;
 	size_t len;
 	const char *zone_name = info->creds.username;
+	int current = 0;
 	int rc = RC_OK;
 
 	if (*zone_name == '\0' || !strchr(zone_name, '.'))
@@ -305,51 +531,42 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 		return RC_DDNS_INVALID_OPTION;
 	}
 
-	data = calloc(1, sizeof(struct cfdata));
+	data = get_data(info);
 	if (!data)
 		return RC_OUT_OF_MEMORY;
 
-	if (info->data)
-		free(info->data);
-	info->data = data;
+	record_type = get_record_type(hostname);
+	rec = &data->record[hostname - info->alias];
+	load_ids(data, rec, hostname, zone_name, record_type);
 
-	record_type = get_record_type(hostname->address);
-
-	logit(LOG_DEBUG, "Zone: %s", zone_name);
-
-	len = snprintf(ctx->request_buf, ctx->request_buflen,
-		       CLOUDFLARE_ZONE_ID_REQUEST,
-		       zone_name,
-		       info->user_agent,
-		       info->creds.password);
-
-	if (len >= ctx->request_buflen) {
-		logit(LOG_ERR, "Request for zone '%s' did not fit into buffer.", zone_name);
-		return RC_BUFFER_OVERFLOW;
-	}
-
-	rc = json_extract(data->zone_id, MAX_ID, info, ctx->request_buf, len, "id");
-	if (rc != RC_OK) {
-		logit(LOG_ERR, "Zone '%s' not found.", zone_name);
+	rc = lookup_zone(ctx, info, data, zone_name);
+	if (rc)
 		return rc;
+
+	/* Known from a previous update, or looked up with the others */
+	lookup_records(ctx, info, data, zone_name, 0);
+	if (cached(rec, hostname, record_type)) {
+		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s (cached)", hostname->name, rec->id);
+		save_ids(data, rec, hostname);
+		goto done;
 	}
-	
-	logit(LOG_DEBUG, "Cloudflare Zone: '%s' Id: %s", zone_name, data->zone_id);
+	rec->id[0] = 0;
+	rec->type  = NULL;
 
-	if (strlen(hostname->name) == 32 && strtoull(hostname->name, NULL, 16) == ULLONG_MAX) {
+	if (is_record_id(hostname->name)) {
 		/* hostname contains a cloudflare id (32 chars and only hex digits). 
 
 		   This is needed to update Round-Robin DNS entries.
 		   https://developers.cloudflare.com/dns/manage-dns-records/how-to/round-robin-dns */
 
 		/* Use the id already provided by the user */
-		strcpy(data->hostname_id, hostname->name);
+		strcpy(rec->id, hostname->name);
 
 		/* Query the hostname */
 		len = snprintf(ctx->request_buf, ctx->request_buflen,
 				CLOUDFLARE_HOSTNAME_NAME_REQUEST_BY_ID,
 				data->zone_id,
-				data->hostname_id,
+				rec->id,
 				info->user_agent,
 				info->creds.password);
 		if (len >= ctx->request_buflen) {
@@ -358,7 +575,8 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 			return RC_BUFFER_OVERFLOW;
 		}
 
-		rc = json_extract(hostname->name, MAX_ID, info, ctx->request_buf, ctx->request_buflen, "name");
+		rc = json_extract(ctx, hostname->name, MAX_ID, info, len, "result.name",
+				  "result", hostname, &current);
 	} else {
 		/* hostname contains a hostname. This is the default inadyn behavior across all plugins. */
 
@@ -378,29 +596,49 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 			return RC_BUFFER_OVERFLOW;
 		}
 
-		rc = json_extract(data->hostname_id, MAX_ID, info, ctx->request_buf, ctx->request_buflen, "id");
+		rc = json_extract(ctx, rec->id, MAX_ID, info, len, "result[0].id",
+				  "result[0]", hostname, &current);
 	}
 
 	if (rc == RC_OK) {
-		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", hostname->name, data->hostname_id);
+		logit(LOG_DEBUG, "Cloudflare Host: '%s' Id: %s", hostname->name, rec->id);
+		strlcpy(rec->name, hostname->name, sizeof(rec->name));
+		rec->type = record_type;
+		mark_current(rec, hostname, current);
+		save_ids(data, rec, hostname);
 	} else if (rc == RC_DDNS_RSP_NOHOST) {
-		strcpy(data->hostname_id, "");
+		/* Not found, created by request(), looked up again next time */
+		strcpy(rec->id, "");
 		return RC_OK;
 	} else {
+		rec->id[0] = 0;
 		logit(LOG_INFO, "Hostname '%s' not found.", hostname->name);
+		return rc;
+	}
+done:
+	/*
+	 * Only known when the record was looked up, the IDs are otherwise
+	 * cached, and asking first would cost as much quota as the update.
+	 */
+	if (rec->current[0] && !strcmp(rec->current, hostname->address)) {
+		rec->current[0] = 0;
+		logit(LOG_DEBUG, "Cloudflare record %s already up to date, skipping update.", hostname->name);
+		return RC_DDNS_RECORD_CURRENT;
 	}
+	rec->current[0] = 0;
 
-	return rc;
+	return RC_OK;
 }
 
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 {
 	const char *record_type;
 	struct cfdata *data = (struct cfdata *)info->data;
+	struct cfrecord *rec = &data->record[hostname - info->alias];
 	size_t content_len;
 	char json_data[256];
 
-	record_type = get_record_type(hostname->address);
+	record_type = get_record_type(hostname);
 	content_len = snprintf(json_data, sizeof(json_data),
 			       CLOUDFLARE_UPDATE_JSON_FORMAT,
 			       record_type,
@@ -411,7 +649,7 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 			       info->proxied ? "true" : "false");
 
 
-	if (strlen(data->hostname_id) == 0)
+	if (strlen(rec->id) == 0)
 		return snprintf(ctx->request_buf, ctx->request_buflen,
 			CLOUDFLARE_HOSTNAME_CREATE_REQUEST,
 			data->zone_id,
@@ -422,7 +660,7 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			data->zone_id,
-			data->hostname_id,
+			rec->id,
 			info->user_agent,
 			info->creds.password,
 			content_len, json_data);
@@ -430,29 +668,103 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *hostname)
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *hostname)
 {
+	struct cfdata *data = (struct cfdata *)info->data;
 	int rc;
 
-	(void)info;
-	(void)hostname;
-
 	rc = check_response_code(trans->status);
-	if (rc == RC_OK && check_success_only(trans->rsp_body) < 0)
+	if (rc == RC_OK && check_success_only(trans->rsp_body, strlen(trans->rsp_body)) < 0)
 		rc = RC_DDNS_RSP_NOTOK;
 
+	if (trans->status == 404)
+		invalidate(data, &data->record[hostname - info->alias], hostname);
+
 	return rc;
 }
 
-PLUGIN_INIT(plugin_init)
+/*
+ * All records in one request: existing ones as "puts", new ones as
+ * "posts".  Cloudflare applies the batch as one transaction, so the
+ * result is the same for all.
+ */
+static int request_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **hostname, size_t num)
 {
-	plugin_register(&plugin, CLOUDFLARE_HOSTNAME_UPDATE_REQUEST);
-	plugin_register_v6(&plugin, CLOUDFLARE_HOSTNAME_UPDATE_REQUEST);
+	struct cfdata *data = (struct cfdata *)info->data;
+	char *puts, *posts, *body;
+	size_t i, len, size;
+
+	/* Each record is at most a name, an ID, and an address, plus JSON */
+	size  = num * (SERVER_NAME_LEN + MAX_ID + MAX_ADDRESS_LEN + 128);
+	puts  = arena_alloc(ctx->arena, size);
+	posts = arena_alloc(ctx->arena, size);
+	body  = arena_alloc(ctx->arena, 2 * size + 32);
+	if (!puts || !posts || !body)
+		return -1;
+	puts[0] = posts[0] = 0;
+
+	for (i = 0; i < num; i++) {
+		struct cfrecord *rec = &data->record[hostname[i] - info->alias];
+		const char *record_type = get_record_type(hostname[i]);
+		char *list = rec->id[0] ? puts : posts;
+
+		len = strlen(list);
+		if (len)
+			list[len++] = ',';
+
+		if (rec->id[0])
+			snprintf(list + len, size - len, CLOUDFLARE_BATCH_PUT_JSON_FORMAT,
+				 rec->id, record_type, info->wildcard ? "*." : "", hostname[i]->name,
+				 hostname[i]->address, info->ttl >= 0 ? info->ttl : 1,
+				 info->proxied ? "true" : "false");
+		else
+			snprintf(list + len, size - len, CLOUDFLARE_UPDATE_JSON_FORMAT,
+				 record_type, info->wildcard ? "*." : "", hostname[i]->name,
+				 hostname[i]->address, info->ttl >= 0 ? info->ttl : 1,
+				 info->proxied ? "true" : "false");
+	}
+
+	len = snprintf(body, 2 * size + 32, "{\"puts\":[%s],\"posts\":[%s]}", puts, posts);
+
+	/* Many records do not fit the default request buffer */
+	size = strlen(CLOUDFLARE_BATCH_REQUEST) + strlen(data->zone_id) + strlen(info->user_agent) +
+		strlen(info->creds.password) + len + 32;
+	if (size > ctx->request_buflen && !buf_grow(ctx->request, size)) {
+		ctx->request_buf    = ctx->request->data;
+		ctx->request_buflen = ctx->request->size;
+	}
+
+	return snprintf(ctx->request_buf, ctx->request_buflen,
+			CLOUDFLARE_BATCH_REQUEST,
+			data->zone_id,
+			info->user_agent,
+			info->creds.password,
+			len, body);
 }
 
-PLUGIN_EXIT(plugin_exit)
+static int response_batch(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **hostname, size_t num, int *rc)
 {
-	plugin_unregister(&plugin);
+	struct cfdata *data = (struct cfdata *)info->data;
+	size_t i;
+	int err;
+
+	err = check_response_code(trans->status);
+	if (err == RC_OK && check_success_only(trans->rsp_body, strlen(trans->rsp_body)) < 0)
+		err = RC_DDNS_RSP_NOTOK;
+
+	for (i = 0; i < num; i++) {
+		struct cfrecord *rec = &data->record[hostname[i] - info->alias];
+
+		/* Created records get their ID looked up next time */
+		rc[i] = err;
+		if (trans->status == 404)
+			invalidate(data, rec, hostname[i]);
+	}
+
+	return err;
 }
 
+PLUGIN_REGISTER(plugin, CLOUDFLARE_HOSTNAME_UPDATE_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@cloudflare.com", CLOUDFLARE_HOSTNAME_UPDATE_REQUEST);
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -22,13 +22,15 @@
 #include <stdarg.h>
 #include <time.h>
 
-#include "md5.h"
+#include "hash.h"
 #include "plugin.h"
 
+MEM_TAG("cloudxns");
+
 /* cloudxns.net specific update request format */
 #define CLOUDXNS_UPDATE_IP_REQUEST		\
 	"PUT %s/%u "				\
-	"HTTP/1.0\r\n"				\
+	"HTTP/1.1\r\n"				\
 	"Host: %s\r\n"				\
 	"User-Agent: %s\r\n"			\
 	"API-KEY: %s\r\n"			\
@@ -37,7 +39,7 @@
 	"Content-Length: %zu\r\n\r\n"		\
 	"%s"
 #define CLOUDXNS_GET_REQUEST			\
-	"GET %s HTTP/1.0\r\n"			\
+	"GET %s HTTP/1.1\r\n"			\
 	"Host: %s\r\n"				\
 	"User-Agent: %s\r\n"			\
 	"API-KEY: %s\r\n"			\
@@ -62,7 +64,7 @@ struct cx {
 struct http {
 	ddns_t      *ctx;
 	ddns_info_t *info;
-	char        *response;	/* pointer to ctx->work_buf */
+	char        *response;	/* pointer into ctx->work_buf */
 };
 
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
@@ -111,69 +113,57 @@ static char *get_time(char *str, size_t len)
 	return str;
 }
 
-static void hmac(char *dst, size_t sz, char *fmt, ...)
+static void update(hash_ctx_t *ctx, const char *str)
 {
-	unsigned char out[MD5_DIGEST_BYTES];
-	va_list ap;
-	size_t i, len;
-	char buf[256];
-
-	va_start(ap, fmt);
-	len = vsnprintf(buf, sizeof(buf), fmt, ap);
-	va_end(ap);
-
-	md5((unsigned char *)buf, len, out);
-	memset(dst, 0, sz);
+	hash_update(ctx, str, strlen(str));
+}
 
-	for (i = 0; i < MD5_DIGEST_BYTES; i++) {
-		char hex[3];
+/* HMAC=md5(API_KEY+URL+[PARAM_BODY+]DATE+SECRET_KEY), hashed piece by piece */
+static void hmac(char *dst, ddns_info_t *info, const char *path, const char *body, const char *date)
+{
+	unsigned char out[MD5_DIGEST_BYTES];
+	hash_ctx_t ctx;
 
-                snprintf(hex, sizeof(hex), "%02x", out[i]);
-                strlcat(dst, hex, sz);
+	if (hash_init(&ctx, HASH_MD5)) {
+		*dst = 0;
+		return;
 	}
+
+	update(&ctx, info->creds.username);
+	update(&ctx, info->ssl_enabled ? "https" : "http");
+	update(&ctx, "://www.cloudxns.net");
+	update(&ctx, path);
+	if (body)
+		update(&ctx, body);
+	update(&ctx, date);
+	update(&ctx, info->creds.password);
+
+	if (hash_final(&ctx, out))
+		*dst = 0;
+	else
+		hash_hex(out, sizeof(out), dst);
 }
 
+/* Lookups use the same, kept-alive, connection as the update */
 static int http_send(struct http *http, char *msg, char *fmt, ...)
 {
-	http_trans_t trans;
-	ddns_info_t *info;
+	plugin_rsp_t rsp;
+	ddns_t *ctx = http->ctx;
 	va_list ap;
-	http_t client;
-	ddns_t *ctx;
-	int rc;
-
-	info = http->info;
-	ctx = http->ctx;
+	int rc, len;
 
 	va_start(ap, fmt);
-	trans.req_len     = vsnprintf(ctx->request_buf, ctx->request_buflen, fmt, ap);
-	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
+	len = vsnprintf(ctx->request_buf, ctx->request_buflen, fmt, ap);
 	va_end(ap);
 
-	rc = http_construct(&client);
+	rc = plugin_query(ctx, http->info, msg, len, &rsp);
+	plugin_query_done(&rsp);
 	if (rc)
 		return rc;
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-	client.ssl_enabled = info->ssl_enabled;
+	http->response = rsp.trans.rsp_body;
 
-	rc = http_init(&client, msg, TCP_AUTO);
-	if (rc)
-		goto err;
-
-	rc = http_transaction(&client, &trans);
-	http_exit(&client);
-err:
-	http_destruct(&client, 1);
-	if (rc)
-		return rc;
-
-	http->response = trans.rsp_body;
-
-	return http_status_valid(trans.status);
+	return http_status_valid(rsp.trans.status);
 }
 
 /*
@@ -191,7 +181,7 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	int           rc = 0;
 
 	if (!info->data) {
-		info->data = malloc(sizeof(struct cx));
+		info->data = mem_malloc(sizeof(struct cx));
 		if (!info->data)
 			return RC_OUT_OF_MEMORY;
 	}
@@ -200,10 +190,7 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 	get_time(cx->date, sizeof(cx->date));
 
-	/* HMAC=md5(API_KEY+URL+DATE+SECRET_KEY) */
-	hmac(str, sizeof(str), "%shttp%s://www.cloudxns.net/api2/domain%s%s",
-	     info->creds.username, info->ssl_enabled ? "s" : "",
-	     cx->date, info->creds.password);
+	hmac(str, info, "/api2/domain", NULL, cx->date);
 
 	rc = http_send(&http, "Sending domain list query",
 		       CLOUDXNS_GET_REQUEST, "/api2/domain",
@@ -255,12 +242,8 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 	logit(LOG_DEBUG, "CloudXNS Domain: '%s' ID: %u", domain, cx->domain_id);
 
-	/* HMAC=md5(API_KEY+URL+DATE+SECRET_KEY) */
-	hmac(str, sizeof(str), "%shttp%s://www.cloudxns.net/api2/record/%u%s%s",
-	     info->creds.username, info->ssl_enabled ? "s" : "",
-	     cx->domain_id, cx->date, info->creds.password);
-
 	snprintf(buffer, sizeof(buffer), "/api2/record/%u", cx->domain_id);
+	hmac(str, info, buffer, NULL, cx->date);
 	rc = http_send(&http, "Sending records list query",
 		       CLOUDXNS_GET_REQUEST, buffer,
 		       info->server_name.name, info->user_agent,
@@ -314,15 +297,12 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 			   CLOUDXNS_UPDATE_PARAM_BODY,
 			   cx->domain_id, prefix, alias->address);
 
-	/* HMAC=md5(API_KEY+URL+PARAM_BODY+DATE+SECRET_KEY) */
-	hmac(cx->hmac, sizeof(cx->hmac),
-	     "%shttp%s://www.cloudxns.net/api2/record/%u%s%s%s",
-	     info->creds.username, info->ssl_enabled ? "s" : "",
-	     cx->record_id, cx->body, cx->date, info->creds.password);
+	snprintf(buffer, sizeof(buffer), "/api2/record/%u", cx->record_id);
+	hmac(cx->hmac, info, buffer, cx->body, cx->date);
 
 	return 0;
 err:
-	free(info->data);
+	mem_free(info->data);
 	info->data = NULL;
 	return rc;
 }
@@ -372,15 +352,7 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, CLOUDXNS_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, CLOUDXNS_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
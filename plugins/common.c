@@ -21,59 +21,377 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <ctype.h>
+
+#include "match.h"
 #include "plugin.h"
 
+MEM_TAG("common");
+
+#define COMMON_RETRY_AFTER	1800	/* sec, after dnserr, 911, or abuse */
+
 /*
- * DynDNS request composer -- common to many other DDNS providers as well
+ * Everything in a DynDNS request but the hostname and address is the
+ * same for every update of a provider.  So the request is rendered
+ * once, with markers for the two, and split into segments.  Updates
+ * then only copy the segments and the two strings, no format parsing.
  */
-int common_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+#define TMPL_HOSTNAME		"\001"
+#define TMPL_ADDRESS		"\002"
+#define TMPL_MAX_SEGMENTS	8
+
+enum { SEG_TEXT, SEG_HOSTNAME, SEG_ADDRESS };
+
+struct tmpl {
+	size_t size;		/* Of text[], for common_free() */
+	size_t num;
+	struct {
+		int    type;
+		size_t off;
+		size_t len;
+	} seg[TMPL_MAX_SEGMENTS];
+	char   text[];
+};
+
+static int render(ddns_info_t *info, char *buf, size_t len, const char *hostname, const char *address)
 {
 	char wildcard[20] = "";
 
 	if (info->wildcard)
 		strlcpy(wildcard, "&wildcard=ON", sizeof(wildcard));
 
-	return snprintf(ctx->request_buf, ctx->request_buflen,
+	return snprintf(buf, len,
 			info->system->server_req,
 			info->server_url,
-			alias->name,
-			alias->address,
+			hostname,
+			address,
 			wildcard,
 			info->server_name.name,
 			info->creds.encoded_password,
 			info->user_agent);
 }
 
+/* Render the request once with markers, NULL if it does not fit the template */
+static struct tmpl *compile(ddns_info_t *info, size_t size)
+{
+	struct tmpl *t;
+	char *ptr;
+	int len;
+
+	t = mem_malloc(sizeof(*t) + size);
+	if (!t)
+		return NULL;
+
+	t->size = size;
+	len = render(info, t->text, size, TMPL_HOSTNAME, TMPL_ADDRESS);
+	if (len < 0 || (size_t)len >= size)
+		goto fail;
+
+	t->num = 0;
+	ptr = t->text;
+	while (*ptr) {
+		size_t run = strcspn(ptr, TMPL_HOSTNAME TMPL_ADDRESS);
+
+		if (t->num + 2 > TMPL_MAX_SEGMENTS)
+			goto fail;
+
+		if (run) {
+			t->seg[t->num].type = SEG_TEXT;
+			t->seg[t->num].off  = ptr - t->text;
+			t->seg[t->num].len  = run;
+			t->num++;
+			ptr += run;
+		}
+
+		if (*ptr) {
+			t->seg[t->num].type = *ptr == TMPL_HOSTNAME[0] ? SEG_HOSTNAME : SEG_ADDRESS;
+			t->num++;
+			ptr++;
+		}
+	}
+
+	return t;
+fail:
+	memwipe(t->text, size);
+	mem_free(t);
+	return NULL;
+}
+
+/* Same as snprintf(), returns the length the request would have */
+static int fill(struct tmpl *t, char *buf, size_t size, const char *hostname, const char *address)
+{
+	size_t i, pos = 0;
+
+	for (i = 0; i < t->num; i++) {
+		const char *src;
+		size_t len;
+
+		switch (t->seg[i].type) {
+		case SEG_HOSTNAME:
+			src = hostname;
+			len = strlen(hostname);
+			break;
+		case SEG_ADDRESS:
+			src = address;
+			len = strlen(address);
+			break;
+		default:
+			src = t->text + t->seg[i].off;
+			len = t->seg[i].len;
+			break;
+		}
+
+		if (pos < size)
+			memcpy(buf + pos, src, pos + len < size ? len : size - pos - 1);
+		pos += len;
+	}
+
+	if (size)
+		buf[pos < size ? pos : size - 1] = 0;
+
+	return (int)pos;
+}
+
+static int compose(ddns_t *ctx, ddns_info_t *info, const char *hostname, const char *address)
+{
+	/* Compiled on first update, when credentials have been encoded */
+	if (!info->tmpl)
+		info->tmpl = compile(info, ctx->request_buflen);
+	if (!info->tmpl)
+		return render(info, ctx->request_buf, ctx->request_buflen, hostname, address);
+
+	return fill(info->tmpl, ctx->request_buf, ctx->request_buflen, hostname, address);
+}
+
+/* The pre-rendered request holds the credentials, wipe before free */
+void common_free(ddns_info_t *info)
+{
+	struct tmpl *t = info->tmpl;
+
+	if (!t)
+		return;
+
+	memwipe(t->text, t->size);
+	mem_free(t);
+	info->tmpl = NULL;
+}
+
+/*
+ * DynDNS request composer -- common to many other DDNS providers as well
+ */
+int common_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	return compose(ctx, info, alias->name, alias->address);
+}
+
+/*
+ * DynDNS request composer for several aliases with the same address,
+ * dyndns2 takes a comma separated hostname list.
+ */
+int common_request_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num)
+{
+	size_t i, len = num * (sizeof(alias[0]->name) + 1);
+	char *hosts;
+
+	hosts = arena_alloc(ctx->arena, len);
+	if (!hosts)
+		return -1;
+
+	hosts[0] = 0;
+	for (i = 0; i < num; i++) {
+		if (i)
+			strlcat(hosts, ",", len);
+		strlcat(hosts, alias[i]->name, len);
+	}
+
+	return compose(ctx, info, hosts, alias[0]->address);
+}
+
+/*
+ * DynDNS return codes, in order of priority.  The code is the first word
+ * of a response line, but some servers prefix it, e.g. Loopia responds
+ * "[200 OK] nohost" when no DNS record exists, so whole words anywhere
+ * on the line are matched.
+ */
+static const match_rule_t codes[] = {
+	{ "good",     0                       },
+	{ "nochg",    0                       },
+	{ "nohost",   RC_DDNS_RSP_NOHOST      },
+	{ "nofqdn",   RC_DDNS_RSP_NOHOST      },
+	{ "OK",       0                       },
+	{ "dnserr",   RC_DDNS_RSP_RETRY_LATER },
+	{ "911",      RC_DDNS_RSP_RETRY_LATER },
+	{ "abuse",    RC_DDNS_RSP_RETRY_LATER },
+	{ "badauth",  RC_DDNS_RSP_AUTH_FAIL   },
+	{ "!donator", RC_DDNS_RSP_AUTH_FAIL   },
+};
+
+static matcher_t *matcher;
+
+/* Result code of one response line */
+static int response_code(const char *line, size_t len)
+{
+	return match_rc(matcher, line, len, RC_DDNS_RSP_NOTOK);
+}
+
+/*
+ * The DynDNS protocol asks clients to hold off updates for at least 30
+ * minutes after dnserr, 911 or abuse.  Unless the server says otherwise
+ * in a Retry-After header, pass that on to the backoff in the core.
+ */
+static int retry_hint(http_trans_t *trans, int rc)
+{
+	if (rc == RC_DDNS_RSP_RETRY_LATER && !trans->retry_after)
+		trans->retry_after = COMMON_RETRY_AFTER;
+
+	return rc;
+}
+
 /*
  * DynDNS response validator -- common to many other DDNS providers as well
  *  'good' or 'nochg' are the good answers,
  */
 int common_response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *body = trans->rsp_body;
+	const char *line;
 
 	(void)info;
 	(void)alias;
 
 	DO(http_status_valid(trans->status));
 
-	if (strstr(body, "good") || strstr(body, "nochg")  || strstr(body, "OK"))
-		return 0;
+	line = trans->rsp_body + strspn(trans->rsp_body, "\r\n \t");
+
+	return retry_hint(trans, response_code(line, strcspn(line, "\r\n")));
+}
+
+/*
+ * DynDNS response validator for common_request_batch(), one line per
+ * hostname, in request order.  A single line, e.g. 'badauth', applies
+ * to all.  Returns the first error, if any, the rest is in @rc.
+ */
+int common_response_batch(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc)
+{
+	char *line = trans->rsp_body;
+	size_t i, lines = 0;
+	int status, err = 0;
 
-	if (strstr(body, "dnserr") || strstr(body, "911") || strstr(body, "abuse"))
-		return RC_DDNS_RSP_RETRY_LATER;
+	(void)info;
+	(void)alias;
 
-	if (strstr(body, "badauth") || strstr(body, "!donator"))
-		return RC_DDNS_RSP_AUTH_FAIL;
+	status = http_status_valid(trans->status);
+	for (i = 0; i < num; i++) {
+		char *next;
 
-	/* Loopia responds "[200 OK] nohost" when no DNS record exists */
-	if (strstr(body, "nohost"))
-		return RC_DDNS_RSP_NOHOST;
+		if (status) {
+			rc[i] = status;
+			goto next;
+		}
 
-	if (strstr(body, "nofqdn"))
-		return RC_DDNS_RSP_NOHOST;
+		line += strspn(line, "\r\n \t");
+		if (!*line) {
+			rc[i] = lines == 1 ? rc[0] : RC_DDNS_RSP_NOTOK;
+			goto next;
+		}
 
-	return RC_DDNS_RSP_NOTOK;
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		else
+			next = line + strlen(line);
+
+		rc[i] = retry_hint(trans, response_code(line, strlen(line)));
+		line  = next;
+		lines++;
+	next:
+		if (rc[i] && !err)
+			err = rc[i];
+	}
+
+	return err;
+}
+
+/* Characters that are never encoded, and the optional exceptions */
+#define URL_SAFE	0x01
+#define URL_DELIM	0x02	/* / ? & = */
+#define URL_SPACE	0x04
+
+static const unsigned char url_class[256] = {
+	['0' ... '9'] = URL_SAFE,
+	['A' ... 'Z'] = URL_SAFE,
+	['a' ... 'z'] = URL_SAFE,
+	['-'] = URL_SAFE, ['_'] = URL_SAFE, ['.'] = URL_SAFE, ['~'] = URL_SAFE,
+	['/'] = URL_DELIM, ['?'] = URL_DELIM, ['&'] = URL_DELIM, ['='] = URL_DELIM,
+	[' '] = URL_SPACE,
+};
+
+static int is_escape(const char *src, size_t len)
+{
+	return len >= 3 && src[0] == '%' && isxdigit((unsigned char)src[1]) && isxdigit((unsigned char)src[2]);
+}
+
+/**
+ * url_encode - URL encode string straight into a request buffer
+ * @dst:    Destination, always NUL terminated if @len > 0
+ * @len:    Size of @dst
+ * @src:    String to encode, need not be NUL terminated
+ * @srclen: Length of @src
+ * @flags:  %URL_KEEP_DELIMS, %URL_KEEP_ESCAPES, %URL_SPACE_PLUS
+ *
+ * Returns:
+ * Length of the encoded string, or -1 if it does not fit in @dst.
+ */
+int url_encode(char *dst, size_t len, const char *src, size_t srclen, int flags)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i, pos = 0;
+
+	if (!len)
+		return -1;
+
+	for (i = 0; i < srclen; i++) {
+		unsigned char ch = src[i];
+		int class = url_class[ch];
+
+		if ((class & URL_SAFE) || ((class & URL_DELIM) && (flags & URL_KEEP_DELIMS))) {
+			if (pos + 1 >= len)
+				goto full;
+			dst[pos++] = ch;
+		} else if ((class & URL_SPACE) && (flags & URL_SPACE_PLUS)) {
+			if (pos + 1 >= len)
+				goto full;
+			dst[pos++] = '+';
+		} else if ((flags & URL_KEEP_ESCAPES) && is_escape(&src[i], srclen - i)) {
+			if (pos + 3 >= len)
+				goto full;
+			memcpy(&dst[pos], &src[i], 3);
+			pos += 3;
+			i   += 2;
+		} else {
+			if (pos + 3 >= len)
+				goto full;
+			dst[pos++] = '%';
+			dst[pos++] = hex[ch >> 4];
+			dst[pos++] = hex[ch & 15];
+		}
+	}
+	dst[pos] = 0;
+
+	return pos;
+full:
+	dst[pos] = 0;
+	return -1;
+}
+
+PLUGIN_INIT(common_init)
+{
+	matcher = match_compile(codes, NELEMS(codes), MATCH_WORD);
+}
+
+PLUGIN_EXIT(common_exit)
+{
+	match_free(matcher);
+	matcher = NULL;
 }
 
 /**
@@ -26,7 +26,7 @@
 	"hostname=%s&"							\
 	"myip=%s&"							\
 	"%s "								\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -52,7 +52,7 @@ static ddns_system_t plugin = {
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *keepip;
-	if (strstr(info->system->name, "ipv6"))
+	if (alias->family == AF_INET6)
 		keepip = "keepipv4=1";
 	else
 		keepip = "keepipv6=1";
@@ -83,16 +83,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, CORE_NETWORKS_UPDATE_IP_REQUEST);
-	plugin_register_v6(&plugin, CORE_NETWORKS_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, CORE_NETWORKS_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@core-networks.de", CORE_NETWORKS_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
@@ -28,7 +28,7 @@
 	"password=%s&"							\
 	"hostname=%s&"							\
 	"myipv4=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -38,19 +38,29 @@
 	"password=%s&"							\
 	"hostname=%s&"							\
 	"myipv6=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
+#define DESEC_MAX_BATCH 20	/* Hostnames per update request */
+
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
+static int request_batch  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t **alias, size_t num);
+static int response_batch (http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc);
+
 static ddns_system_t plugin = {
 	.name         = "default@desec.io",
 
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
+	/* Hostnames with the same address in one request */
+	.batch          = DESEC_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
+
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
 	.checkip_ssl  = DYNDNS_MY_IP_SSL,
@@ -65,6 +75,11 @@ static ddns_system_t plugin_v6 = {
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
 
+	/* Hostnames with the same address in one request */
+	.batch          = DESEC_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
+
 	.checkip_name = "dns64.cloudflare-dns.com",
 	.checkip_url  = "/cdn-cgi/trace",
 	.checkip_ssl  = DDNS_CHECKIP_SSL_SUPPORTED,
@@ -74,19 +89,44 @@ static ddns_system_t plugin_v6 = {
 };
 
 
-static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+static int compose(ddns_t *ctx, ddns_info_t *info, const char *hostname, const char *address)
 {
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			info->server_url,
 			info->creds.username,
 			info->creds.password,
-			alias->name,
-			alias->address,
+			hostname,
+			address,
 			info->server_name.name,
 			info->user_agent);
 }
 
+static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	return compose(ctx, info, alias->name, alias->address);
+}
+
+/* The update API takes a comma separated list of hostnames */
+static int request_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num)
+{
+	size_t i, len = num * (sizeof(alias[0]->name) + 1);
+	char *hosts;
+
+	hosts = arena_alloc(ctx->arena, len);
+	if (!hosts)
+		return -1;
+
+	hosts[0] = 0;
+	for (i = 0; i < num; i++) {
+		if (i)
+			strlcat(hosts, ",", len);
+		strlcat(hosts, alias[i]->name, len);
+	}
+
+	return compose(ctx, info, hosts, alias[0]->address);
+}
+
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *body = trans->rsp_body;
@@ -102,17 +142,14 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
+/* One "good" for the whole request, or a dyndns2 style line per hostname */
+static int response_batch(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc)
 {
-	plugin_register(&plugin, DESEC_UPDATE_IP_REQUEST);
-	plugin_register(&plugin_v6, DESEC_UPDATE_IP6_REQUEST);
+	return common_response_batch(trans, info, alias, num, rc);
 }
 
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-	plugin_unregister(&plugin_v6);
-}
+PLUGIN_REGISTER(plugin, DESEC_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin_v6, DESEC_UPDATE_IP6_REQUEST);
 
 /**
  * Local Variables:
@@ -32,7 +32,7 @@
 	"password=%s&"							\
 	"ipaddr=%s&"							\
 	"updatetimeout=0 "						\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -93,16 +93,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DHIS_UPDATE_IP_REQUEST);
-	plugin_register(&plugin_ipv6, DHIS_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DHIS_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin_ipv6, DHIS_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
@@ -24,7 +24,7 @@
 #define DNSEVER_UPDATE_IP_REQUEST					\
 	"GET %s?"							\
 	"host[%s]=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -69,15 +69,7 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return 0;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DNSEVER_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DNSEVER_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
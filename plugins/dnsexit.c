@@ -29,7 +29,7 @@
 	"password=%s&"							\
 	"host=%s&"							\
 	"myip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -95,16 +95,8 @@ err:
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DNSEXIT_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&plugin, DNSEXIT_UPDATE_IP_HTTP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DNSEXIT_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@dnsexit.com", DNSEXIT_UPDATE_IP_HTTP_REQUEST);
 
 /**
  * Local Variables:
@@ -25,7 +25,7 @@
 	"GET %s?"							\
 	"u=%s&"							        \
 	"ip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -34,7 +34,7 @@
 	"GET %s?"							\
 	"u=%s&"		  		  	 	 	        \
 	"ip6=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -73,18 +73,9 @@ static ddns_system_t plugin_v6 = {
 
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
-	if (strstr(info->system->name, "ipv6"))
-		return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
-			info->server_url,
-			alias->name,
-			alias->address,
-			info->server_name.name,
-			info->creds.encoded_password,
-			info->user_agent);
-
 	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
+			alias->family == AF_INET6 ? DNSHOME_UPDATE_IP6_REQUEST
+						  : DNSHOME_UPDATE_IP_REQUEST,
 			info->server_url,
 			alias->name,
 			alias->address,
@@ -103,16 +94,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return 0;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DNSHOME_UPDATE_IP_REQUEST);
-	plugin_register(&plugin_v6, DNSHOME_UPDATE_IP6_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DNSHOME_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin_v6, DNSHOME_UPDATE_IP6_REQUEST);
 
 /**
  * Local Variables:
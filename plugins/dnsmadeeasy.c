@@ -27,7 +27,7 @@
 	"password=%s&"							\
 	"id=%s&"							\
 	"ip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -78,15 +78,7 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return 0;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DNSMADEEASY_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DNSMADEEASY_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
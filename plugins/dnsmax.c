@@ -31,7 +31,7 @@
 	"protocolversion=2.0&"						\
 	"updatehostname=%s&"						\
 	"ip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -96,17 +96,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&dnsmax_plugin, DNSMAX_UPDATE_IP_REQUEST);
-	plugin_register(&thatip_plugin, DNSMAX_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&dnsmax_plugin);
-	plugin_unregister(&thatip_plugin);
-}
+PLUGIN_REGISTER(dnsmax_plugin, DNSMAX_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(thatip_plugin, DNSMAX_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
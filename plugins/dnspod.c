@@ -19,17 +19,42 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <limits.h>
+
 #include "plugin.h"
 
+MEM_TAG("dnspod");
+
 /* dnspod.cn specific update request format */
 #define DNSPOD_API_REQUEST						\
-	"POST /%s HTTP/1.0\r\n"						\
+	"POST /%s HTTP/1.1\r\n"						\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n"						\
 	"Content-Length: %zu\r\n"					\
 	"Content-Type: application/x-www-form-urlencoded\r\n\r\n"	\
 	"%s"
 
+/* Same, for the record list, which may be sent compressed */
+#define DNSPOD_LIST_REQUEST						\
+	"POST /%s HTTP/1.1\r\n"						\
+	"Host: %s\r\n"							\
+	"User-Agent: %s\r\n"						\
+	HTTP_ACCEPT_GZIP						\
+	"Content-Length: %zu\r\n"					\
+	"Content-Type: application/x-www-form-urlencoded\r\n\r\n"	\
+	"%s"
+
+/*
+ * Record ids are looked up once per hostname and kept across updates,
+ * until an update fails.  The form for the update in progress is also
+ * kept here, for request().
+ */
+struct dnspod {
+	char post[512];
+	int  id[];		/* Per alias, zero if not known */
+};
+
+static int prefetch (ddns_t       *ctx,   ddns_info_t *info);
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
@@ -37,6 +62,7 @@ static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias
 static ddns_system_t plugin = {
 	.name         = "default@dnspod.cn",
 
+	.prefetch     = (prefetch_fn_t)prefetch,
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
@@ -52,6 +78,7 @@ static ddns_system_t plugin = {
 static ddns_system_t plugin_v6 = {
 	.name         = "ipv6@dnspod.cn",
 
+	.prefetch     = (prefetch_fn_t)prefetch,
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
@@ -66,10 +93,9 @@ static ddns_system_t plugin_v6 = {
 
 static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, char *domain, char *prefix)
 {
-	http_trans_t trans;
-	http_t client;
-	char *tmp;
+	plugin_rsp_t rsp;
 	char buffer[256];
+	long id;
 	int record_id = 0;
 	int rc, len;
 
@@ -86,31 +112,15 @@ static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias,
 	if (len >= (int)sizeof(buffer))
 		return -RC_BUFFER_OVERFLOW;
 
-	trans.req_len     = snprintf(ctx->request_buf, ctx->request_buflen, DNSPOD_API_REQUEST, "Record.List",
-				     info->server_name.name, info->user_agent, strlen(buffer), buffer);
-	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1; /* Save place for a \0 at the end */
-
-	rc = http_construct(&client);
-	if (rc)
-		return -rc;
-
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
-	client.ssl_enabled = info->ssl_enabled;
-
-	rc = http_init(&client, "Sending record list query",strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
-	if (rc)
-		return -rc;
-
-	rc = http_transaction(&client, &trans);
-	logit(LOG_DEBUG, "=> %s", trans.rsp_body);
-	http_exit(&client);
-	http_destruct(&client, 1);
+	len = snprintf(ctx->request_buf, ctx->request_buflen, DNSPOD_LIST_REQUEST, "Record.List",
+		       info->server_name.name, info->user_agent, strlen(buffer), buffer);
 
-	if (rc || (rc = http_status_valid(trans.status))) {
+	rc = plugin_query(ctx, info, "Sending record list query", len, &rsp);
+	if (!rc)
+		rc = http_status_valid(rsp.trans.status);
+	if (rc) {
 		logit(LOG_WARNING, "Failed fetching record ID, rc: %d", rc);
+		plugin_query_done(&rsp);
 		return -rc;
 	}
 
@@ -150,29 +160,31 @@ static int fetch_record_id(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias,
 	 *    }]
 	 *}
 	 */
-	tmp = strstr(trans.rsp_body, "[{");
-	if (tmp && 1 == sscanf(tmp, "[{\"id\":\"%d\"", &record_id))
-		return record_id;
+	if (json_get_int(&rsp.json, 0, "records[0].id", &id) || id <= 0 || id > INT_MAX)
+		record_id = -RC_DDNS_INVALID_OPTION;
+	else
+		record_id = id;
+	plugin_query_done(&rsp);
 
-	return -RC_DDNS_INVALID_OPTION;
+	return record_id;
 }
 
 /*
  * API_ID = info->creds.username
  * API_TOKEN = info->creds.password
  */
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+static struct dnspod *get_data(ddns_info_t *info)
 {
-	char *tmp;
-	char buffer[SERVER_NAME_LEN], domain[SERVER_NAME_LEN], prefix[SERVER_NAME_LEN];
-	int record_id;
-	int len;
-	char *record_type;
-	
-	if (strstr(info->system->name, "ipv6"))
-		record_type="AAAA";
-	else
-		record_type="A";
+	if (!info->data)
+		info->data = mem_calloc(1, sizeof(struct dnspod) + info->alias_count * sizeof(int));
+
+	return (struct dnspod *)info->data;
+}
+
+/* Domain and sub-domain, e.g. www and example.com, or @ for example.com itself */
+static int split_name(ddns_alias_t *alias, char *domain, char *prefix)
+{
+	char buffer[SERVER_NAME_LEN], *tmp;
 
 	strlcpy(buffer, alias->name, sizeof(buffer));
 	tmp = strchr(buffer, '.');
@@ -181,24 +193,93 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 	if (tmp[1] != 0 && strchr(tmp + 1, '.') != NULL) {
 		*tmp++ = 0;
-		strlcpy(domain, tmp, sizeof(domain));
-		strlcpy(prefix, buffer, sizeof(prefix));
+		strlcpy(domain, tmp, SERVER_NAME_LEN);
+		strlcpy(prefix, buffer, SERVER_NAME_LEN);
 	} else {
-		strlcpy(domain, alias->name, sizeof(domain));
-		strlcpy(prefix, "@", sizeof(prefix));
+		strlcpy(domain, alias->name, SERVER_NAME_LEN);
+		strlcpy(prefix, "@", SERVER_NAME_LEN);
+	}
+
+	return 0;
+}
+
+/* Record id of @alias, looked up unless known, or negative error code */
+static int get_record_id(ddns_t *ctx, ddns_info_t *info, struct dnspod *data, ddns_alias_t *alias,
+			 char *domain, char *prefix)
+{
+	int record_id;
+
+	record_id = data->id[alias - info->alias];
+	if (record_id > 0) {
+		logit(LOG_DEBUG, "DNSPod Record: '%s' ID: %u (cached)", prefix, record_id);
+		return record_id;
 	}
 
 	record_id = fetch_record_id(ctx, info, alias, domain, prefix);
 	if (record_id <= 0) {
 		logit(LOG_ERR, "Record '%s' not found in records list!", prefix);
 		if (record_id < 0)
-			return -record_id;
+			return record_id;
 
-		return RC_DDNS_INVALID_OPTION;
+		return -RC_DDNS_INVALID_OPTION;
 	}
 
 	logit(LOG_DEBUG, "DNSPod Record: '%s' ID: %u", prefix, record_id);
-	len = snprintf(buffer, sizeof(buffer),
+	data->id[alias - info->alias] = record_id;
+
+	return record_id;
+}
+
+/* Record ids of all hostnames looked up before the first update, see setup() */
+static int prefetch(ddns_t *ctx, ddns_info_t *info)
+{
+	char domain[SERVER_NAME_LEN], prefix[SERVER_NAME_LEN];
+	struct dnspod *data;
+	int rc = 0;
+	size_t i;
+
+	data = get_data(info);
+	if (!data)
+		return RC_OUT_OF_MEMORY;
+
+	for (i = 0; i < info->alias_count; i++) {
+		int record_id;
+
+		if (split_name(&info->alias[i], domain, prefix))
+			continue;
+
+		record_id = get_record_id(ctx, info, data, &info->alias[i], domain, prefix);
+		if (record_id < 0)
+			rc = -record_id;
+	}
+
+	return rc;
+}
+
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	struct dnspod *data;
+	char domain[SERVER_NAME_LEN], prefix[SERVER_NAME_LEN];
+	int record_id;
+	int len;
+	char *record_type;
+	
+	if (alias->family == AF_INET6)
+		record_type="AAAA";
+	else
+		record_type="A";
+
+	DO(split_name(alias, domain, prefix));
+
+	data = get_data(info);
+	if (!data)
+		return RC_OUT_OF_MEMORY;
+
+	record_id = get_record_id(ctx, info, data, alias, domain, prefix);
+	if (record_id < 0)
+		return -record_id;
+
+	len = snprintf(data->post, sizeof(data->post),
 		       "login_token=%s%%2C%s&"
 		       "format=json&"
 		       "domain=%s&"
@@ -209,35 +290,32 @@ static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 		       "sub_domain=%s",
 		       info->creds.username, info->creds.password,
 		       domain, record_type, record_id, "%E9%BB%98%E8%AE%A4", alias->address, prefix);
-	if (len >= (int)sizeof(buffer))
+	if (len >= (int)sizeof(data->post)) {
+		data->post[0] = 0;
 		return RC_BUFFER_OVERFLOW;
-
-	if (info->data)
-		free(info->data);
-	info->data = strdup(buffer);
+	}
 
 	return 0;
 }
 
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
+	struct dnspod *data = (struct dnspod *)info->data;
 	size_t len;
-	char *post;
 
 	(void)alias;
 
-	if (!info->data)
+	if (!data || !data->post[0])
 		return -RC_INVALID_POINTER;
 
-	post = (char *)info->data;
-	len  = strlen(post);
+	len = strlen(data->post);
 
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			"Record.Ddns",
 			info->server_name.name,
 			info->user_agent,
-			len, post);
+			len, data->post);
 }
 
 /*
@@ -260,30 +338,23 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
  */
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
+	struct dnspod *data = (struct dnspod *)info->data;
 	char *resp = trans->rsp_body;
 
-	(void)info;
-	(void)alias;
+	if (!http_status_valid(trans->status) && strstr(resp, alias->address))
+		return 0;
 
-	DO(http_status_valid(trans->status));
+	/* Record may have been removed or replaced, look it up again */
+	if (data)
+		data->id[alias - info->alias] = 0;
 
-	if (strstr(resp, alias->address))
-		return 0;
+	DO(http_status_valid(trans->status));
 
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DNSPOD_API_REQUEST);
-	plugin_register(&plugin_v6, DNSPOD_API_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-	plugin_unregister(&plugin_v6);
-}
+PLUGIN_REGISTER(plugin, DNSPOD_API_REQUEST);
+PLUGIN_REGISTER(plugin_v6, DNSPOD_API_REQUEST);
 
 /**
  * Local Variables:
@@ -26,7 +26,7 @@
 	"hostname=%s&"							\
 	"password=%s&"							\
 	"ip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -89,17 +89,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin_ddc24, DDC24_UPDATE_IP_REQUEST);
-	plugin_register(&plugin_moniker, DDC24_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin_ddc24);
-	plugin_unregister(&plugin_moniker);
-}
+PLUGIN_REGISTER(plugin_ddc24, DDC24_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin_moniker, DDC24_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
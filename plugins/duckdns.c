@@ -31,7 +31,7 @@
 	"domains=%s&"							\
 	"token=%s&"							\
 	"ip=%s "   							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -40,7 +40,7 @@
 	"domains=%s&"							\
 	"token=%s&"							\
 	"ipv6=%s "   							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -78,7 +78,8 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 	}
 
 	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
+			alias->family == AF_INET6 ? DUCKDNS_UPDATE_IP6_HTTP_REQUEST
+						  : DUCKDNS_UPDATE_IP_HTTP_REQUEST,
 			info->server_url,
 			name,
 			info->creds.username,
@@ -102,16 +103,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DUCKDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&plugin, DUCKDNS_UPDATE_IP6_HTTP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, DUCKDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@duckdns.org", DUCKDNS_UPDATE_IP6_HTTP_REQUEST);
 
 /**
  * Local Variables:
@@ -27,7 +27,7 @@
 	"host=%s&"							\
 	"password=%s&"							\
 	"ip4=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -36,7 +36,7 @@
 	"host=%s&"							\
 	"password=%s&"							\
 	"ip6=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -106,17 +106,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, DUIADNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&plugin_v6, DUIADNS_UPDATE_IP6_HTTP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-	plugin_unregister(&plugin_v6);
-}
+PLUGIN_REGISTER(plugin, DUIADNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(plugin_v6, DUIADNS_UPDATE_IP6_HTTP_REQUEST);
 
 /**
  * Local Variables:
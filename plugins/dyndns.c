@@ -47,7 +47,7 @@
 	"hostname=%s&"							\
 	"myip=%s"							\
 	"%s "      							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -57,19 +57,38 @@
 	"hostname=%s&"							\
 	"myipv6=%s"							\
 	"%s "      							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
 
+/* dyndns.org documents max 20 hostnames per request, no-ip the same */
+#define DYNDNS_MAX_BATCH 20
+
+/*
+ * Updates are plain GET requests, setting the address the provider
+ * already has is a no-op, so they are safe to replay, and may be sent
+ * as TLS 1.3 early data on a resumed session.
+ */
+#define DYNDNS_REQUEST							\
+	.request      = (req_fn_t)request,				\
+	.response     = (rsp_fn_t)response,				\
+	.early_data   = 1
+
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
 
+static int request_batch  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t **alias, size_t num);
+static int response_batch (http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc);
+
 static ddns_system_t dyndns = {
 	.name         = "default@dyndns.org",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
+
+	.batch          = DYNDNS_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -82,8 +101,7 @@ static ddns_system_t dyndns = {
 static ddns_system_t dnsomatic = {
 	.name         = "default@dnsomatic.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "myip.dnsomatic.com",
 	.checkip_url  = "/",
@@ -96,8 +114,7 @@ static ddns_system_t dnsomatic = {
 static ddns_system_t selfhost = {
 	.name         = "default@selfhost.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -110,8 +127,11 @@ static ddns_system_t selfhost = {
 static ddns_system_t no_ip = {
 	.name         = "default@no-ip.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
+
+	.batch          = DYNDNS_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
 
 	.checkip_name = "ip1.dynupdate.no-ip.com",
 	.checkip_url  = "/",
@@ -125,8 +145,11 @@ static ddns_system_t no_ip = {
 static ddns_system_t noip = {
 	.name         = "default@noip.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
+
+	.batch          = DYNDNS_MAX_BATCH,
+	.request_batch  = (req_batch_fn_t)request_batch,
+	.response_batch = (rsp_batch_fn_t)response_batch,
 
 	.checkip_name = "ip1.dynupdate.noip.com",
 	.checkip_url  = "/",
@@ -142,8 +165,7 @@ static ddns_system_t _3322 = {
 	.name         = "default@3322.org",
 	.alias        = "dyndns@3322.org",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "ip.3322.net",
 	.checkip_url  = "/",
@@ -157,8 +179,7 @@ static ddns_system_t henet = {
 	.name         = "default@he.net",
 	.alias        = "dyndns@he.net",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "checkip.dns.he.net",
 	.checkip_url  = "/",
@@ -174,8 +195,7 @@ static ddns_system_t henet = {
 static ddns_system_t tunnelbroker = {
 	.name         = "default@tunnelbroker.net",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -192,8 +212,7 @@ static ddns_system_t tunnelbroker = {
 static ddns_system_t spdyn = {
 	.name         = "default@spdyn.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "checkip4.spdyn.de",
 	.checkip_url  = "/",
@@ -206,8 +225,7 @@ static ddns_system_t spdyn = {
 static ddns_system_t spdyn_v6 = {
 	.name         = "ipv6@spdyn.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "checkip6.spdyn.de",
 	.checkip_url  = "/",
@@ -221,8 +239,7 @@ static ddns_system_t spdyn_v6 = {
 static ddns_system_t nsupdate_info_ipv4 = {
 	.name         = "ipv4@nsupdate.info",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "ipv4.nsupdate.info",
 	.checkip_url  = "/myip",
@@ -234,8 +251,7 @@ static ddns_system_t nsupdate_info_ipv4 = {
 static ddns_system_t nsupdate_info_ipv6 = {
 	.name         = "ipv6@nsupdate.info",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "ipv6.nsupdate.info",
 	.checkip_url  = "/myip",
@@ -251,8 +267,7 @@ static ddns_system_t nsupdate_info_ipv6 = {
 static ddns_system_t loopia = {
 	.name         = "default@loopia.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "dns.loopia.se",
 	.checkip_url  = "/checkip",
@@ -264,8 +279,7 @@ static ddns_system_t loopia = {
 static ddns_system_t googledomains = {
 	.name         = "default@domains.google.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "domains.google.com",
 	.checkip_url  = "/checkip",
@@ -278,8 +292,7 @@ static ddns_system_t googledomains = {
 static ddns_system_t dynu = {
 	.name         = "default@dynu.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "checkip.dynu.com",
 	.checkip_url  = "/",
@@ -291,8 +304,7 @@ static ddns_system_t dynu = {
 static ddns_system_t dyfi = {
 	.name         = "default@dy.fi",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = "checkip.dy.fi",
 	.checkip_url  = "/",
@@ -304,8 +316,7 @@ static ddns_system_t dyfi = {
 static ddns_system_t dode = {
 	.name         = "default@do.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -318,8 +329,7 @@ static ddns_system_t dode = {
 static ddns_system_t domopoli = {
 	.name         = "default@domopoli",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -332,8 +342,7 @@ static ddns_system_t domopoli = {
 static ddns_system_t inwx = {
 	.name         = "default@inwx.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -346,8 +355,7 @@ static ddns_system_t inwx = {
 static ddns_system_t inwxv6 = {
 	.name         = "ipv6@inwx.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -360,8 +368,7 @@ static ddns_system_t inwxv6 = {
 static ddns_system_t itsdns = {
 	.name         = "default@itsdns.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -374,8 +381,7 @@ static ddns_system_t itsdns = {
 static ddns_system_t opendns = {
 	.name         = "default@opendns.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -388,8 +394,7 @@ static ddns_system_t opendns = {
 static ddns_system_t joker = {
 	.name         = "default@joker.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -402,8 +407,7 @@ static ddns_system_t joker = {
 static ddns_system_t schokokeks = {
 	.name         = "default@schokokeks.org",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -416,8 +420,7 @@ static ddns_system_t schokokeks = {
 static ddns_system_t variomedia = {
 	.name         = "default@variomedia.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -430,8 +433,7 @@ static ddns_system_t variomedia = {
 static ddns_system_t udmedia = {
 	.name         = "default@udmedia.de",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -444,8 +446,7 @@ static ddns_system_t udmedia = {
 static ddns_system_t dyndnsit = {
 	.name         = "default@dyndns.it",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -458,8 +459,7 @@ static ddns_system_t dyndnsit = {
 static ddns_system_t infomaniak = {
 	.name         = "default@infomaniak.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -472,8 +472,7 @@ static ddns_system_t infomaniak = {
 static ddns_system_t oray = {
 	.name         = "default@oray.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -486,8 +485,7 @@ static ddns_system_t oray = {
 static ddns_system_t simply = {
 	.name         = "default@simply.com",
 
-	.request      = (req_fn_t)request,
-	.response     = (rsp_fn_t)response,
+	DYNDNS_REQUEST,
 
 	.checkip_name = DYNDNS_MY_IP_SERVER,
 	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
@@ -507,91 +505,64 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return common_response(trans, info, alias);
 }
 
-PLUGIN_INIT(plugin_init)
+static int request_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num)
 {
-	plugin_register(&dyndns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&dnsomatic, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&dnsomatic, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&selfhost, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&selfhost, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&no_ip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&no_ip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&noip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&noip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&_3322, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&_3322, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&henet, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&tunnelbroker, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&spdyn, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&spdyn_v6, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&nsupdate_info_ipv4, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&nsupdate_info_ipv6, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&loopia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&googledomains, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&googledomains, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&dynu, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&dynu, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&dyfi, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&dyfi, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&dode, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&dode, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&domopoli, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&domopoli, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&inwx, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&inwxv6, DYNDNS_UPDATE_IPV6_HTTP_REQUEST);
-	plugin_register(&itsdns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&itsdns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&opendns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&opendns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&joker, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&schokokeks, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&schokokeks, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&variomedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&variomedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&udmedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&udmedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&dyndnsit, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&infomaniak, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&infomaniak, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&oray, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register(&simply, DYNDNS_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&simply, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+	return common_request_batch(ctx, info, alias, num);
 }
 
-PLUGIN_EXIT(plugin_exit)
+static int response_batch(http_trans_t *trans, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc)
 {
-	plugin_unregister(&dyndns);
-	plugin_unregister(&dnsomatic);
-	plugin_unregister(&selfhost);
-	plugin_unregister(&no_ip);
-	plugin_unregister(&noip);
-	plugin_unregister(&_3322);
-	plugin_unregister(&henet);
-	plugin_unregister(&tunnelbroker);
-	plugin_unregister(&spdyn);
-	plugin_unregister(&spdyn_v6);
-	plugin_unregister(&nsupdate_info_ipv4);
-	plugin_unregister(&nsupdate_info_ipv6);
-	plugin_unregister(&loopia);
-	plugin_unregister(&googledomains);
-	plugin_unregister(&dynu);
-	plugin_unregister(&dyfi);
-	plugin_unregister(&dode);
-	plugin_unregister(&domopoli);
-	plugin_unregister(&inwx);
-	plugin_unregister(&inwxv6);
-	plugin_unregister(&itsdns);
-	plugin_unregister(&opendns);
-	plugin_unregister(&joker);
-	plugin_unregister(&schokokeks);
-	plugin_unregister(&variomedia);
-	plugin_unregister(&udmedia);
-	plugin_unregister(&dyndnsit);
-	plugin_unregister(&infomaniak);
-	plugin_unregister(&oray);
-	plugin_unregister(&simply);
+	return common_response_batch(trans, info, alias, num, rc);
 }
 
+PLUGIN_REGISTER(dyndns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(dnsomatic, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(dnsomatic, "ipv6@dnsomatic.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(selfhost, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(selfhost, "ipv6@selfhost.de", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(no_ip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(no_ip, "ipv6@no-ip.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(noip, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(noip, "ipv6@noip.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(_3322, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(_3322, "ipv6@3322.org", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(henet, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(tunnelbroker, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(spdyn, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(spdyn_v6, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(nsupdate_info_ipv4, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(nsupdate_info_ipv6, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(loopia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(googledomains, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(googledomains, "ipv6@domains.google.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(dynu, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(dynu, "ipv6@dynu.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(dyfi, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(dyfi, "ipv6@dy.fi", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(dode, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(dode, "ipv6@do.de", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(domopoli, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(domopoli, "ipv6@domopoli", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(inwx, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(inwxv6, DYNDNS_UPDATE_IPV6_HTTP_REQUEST);
+PLUGIN_REGISTER(itsdns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(itsdns, "ipv6@itsdns.de", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(opendns, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(opendns, "ipv6@opendns.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(joker, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(schokokeks, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(schokokeks, "ipv6@schokokeks.org", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(variomedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(variomedia, "ipv6@variomedia.de", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(udmedia, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(udmedia, "ipv6@udmedia.de", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(dyndnsit, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(infomaniak, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(infomaniak, "ipv6@infomaniak.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(oray, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER(simply, DYNDNS_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(simply, "ipv6@simply.com", DYNDNS_UPDATE_IP_HTTP_REQUEST);
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -27,7 +27,7 @@
 	"ipv4=%s&"							\
 	"hostname=%s&"							\
 	"token=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -36,7 +36,7 @@
 	"ipv6=%s&"							\
 	"hostname=%s&"							\
 	"token=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -107,17 +107,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin4, DYNV6_UPDATE_IP_REQUEST);
-	plugin_register(&plugin6, DYNV6_UPDATE_IP6_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin4);
-	plugin_unregister(&plugin6);
-}
+PLUGIN_REGISTER(plugin4, DYNV6_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin6, DYNV6_UPDATE_IP6_REQUEST);
 
 /**
  * Local Variables:
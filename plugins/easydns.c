@@ -21,6 +21,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "match.h"
 #include "plugin.h"
 
 /*
@@ -32,7 +33,7 @@
 	"hostname=%s&"							\
 	"myip=%s&"							\
 	"wildcard=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
@@ -70,6 +71,18 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 /*
  * NOERROR is the OK code here
  */
+/* In order of priority */
+static const match_rule_t codes[] = {
+	{ "NOERROR",            0                         },
+	{ "no update required", 0                         },
+	{ "OK",                 0                         },
+	{ "ACCESS",             RC_DDNS_RSP_AUTH_FAIL     },
+	{ "TOOSOON",            RC_DDNS_RSP_RETRY_LATER   },
+	{ "TOO_FREQ",           RC_DDNS_RSP_TOO_FREQUENT  },
+};
+
+static matcher_t *matcher;
+
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
@@ -79,27 +92,21 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 
 	DO(http_status_valid(trans->status));
 
-	if (strstr(resp, "NOERROR") || strstr(resp, "no update required") || strstr(resp, "OK"))
-		return 0;
-	if (strstr(resp, "ACCESS"))
-		return RC_DDNS_RSP_AUTH_FAIL;
-	if (strstr(resp, "TOOSOON"))
-		return RC_DDNS_RSP_RETRY_LATER;
-	if (strstr(resp, "TOO_FREQ"))
-		return RC_DDNS_RSP_TOO_FREQUENT;
-
-	return RC_DDNS_RSP_NOTOK;
+	return match_rc(matcher, resp, strlen(resp), RC_DDNS_RSP_NOTOK);
 }
 
+PLUGIN_REGISTER(plugin, EASYDNS_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@easydns.com", EASYDNS_UPDATE_IP_REQUEST);
+
 PLUGIN_INIT(plugin_init)
 {
-	plugin_register(&plugin, EASYDNS_UPDATE_IP_REQUEST);
-	plugin_register_v6(&plugin, EASYDNS_UPDATE_IP_REQUEST);
+	matcher = match_compile(codes, NELEMS(codes), 0);
 }
 
 PLUGIN_EXIT(plugin_exit)
 {
-	plugin_unregister(&plugin);
+	match_free(matcher);
+	matcher = NULL;
 }
 
 /**
@@ -21,19 +21,30 @@
  * Boston, MA  02110-1301, USA.
  */
 
-#include "sha1.h"
+#include "hash.h"
 #include "plugin.h"
 
+MEM_TAG("freedns");
+
 /* freedns.afraid.org specific update request format */
 #define FREEDNS_UPDATE_IP_REQUEST					\
 	"GET %s?"							\
 	"%s&"								\
 	"address=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
+
+/* Account listing of all hosts and their update keys */
+#define FREEDNS_LIST_REQUEST						\
+	"GET %s HTTP/1.1\r\n"						\
+	"Host: %s\r\n"							\
+	HTTP_ACCEPT_GZIP						\
+	"User-Agent: %s\r\n\r\n"
+
 #define SHA1_DIGEST_BYTES 20
 
+static int prefetch (ddns_t       *ctx,   ddns_info_t *info);
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
@@ -41,6 +52,7 @@ static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias
 static ddns_system_t plugin = {
 	.name         = "default@freedns.afraid.org",
 
+	.prefetch     = (prefetch_fn_t)prefetch,
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
@@ -56,111 +68,192 @@ static char *fetch_keys(ddns_t *ctx, ddns_info_t *info)
 {
 	unsigned char digestbuf[SHA1_DIGEST_BYTES] = { 0 };
 	char          digeststr[SHA1_DIGEST_BYTES * 2 + 1];
-	http_trans_t  trans;
-	http_t        client;
+	plugin_rsp_t  rsp;
 	char          buffer[384];
-	int           i, rc, level;
+	hash_ctx_t    sha;
+	int           rc, len, level;
 
-	rc = (http_construct(&client));
-	if (rc)
+	/* SHA1 hash of username and password */
+	if (hash_init(&sha, HASH_SHA1))
+		return NULL;
+	hash_update(&sha, info->creds.username, strlen(info->creds.username));
+	hash_update(&sha, "|", 1);
+	hash_update(&sha, info->creds.password, strlen(info->creds.password));
+	if (hash_final(&sha, digestbuf))
 		return NULL;
+	hash_hex(digestbuf, sizeof(digestbuf), digeststr);
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
+	snprintf(buffer, sizeof(buffer), "/api/?action=getdyndns&v=2&sha=%s", digeststr);
+	len = snprintf(ctx->request_buf, ctx->request_buflen, FREEDNS_LIST_REQUEST,
+		       buffer, info->server_name.name, info->user_agent);
 
-	client.ssl_enabled = info->ssl_enabled;
-	rc = http_init(&client, "Fetching account API key",strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
-	if (rc)
+	rc = plugin_query(ctx, info, "Fetching account API key", len, &rsp);
+	plugin_query_done(&rsp);
+	if (rc || (rc = http_status_valid(rsp.trans.status))) {
+		logit(LOG_DEBUG, "Failed fetching API key, rc: %d\n", rc);
 		return NULL;
+	}
 
-	/* SHA1 hash of username and password */
-	snprintf(buffer, sizeof(buffer), "%s|%s",
-		 info->creds.username, info->creds.password);
-	sha1((unsigned char *)buffer, strlen(buffer), digestbuf);
-	for (i = 0; i < SHA1_DIGEST_BYTES; i++)
-		sprintf(&digeststr[i * 2], "%02x", digestbuf[i]);
-
-	snprintf(buffer, sizeof(buffer), "/api/?action=getdyndns&v=2&sha=%s", digeststr);
-	trans.req_len     = snprintf(ctx->request_buf, ctx->request_buflen, GENERIC_HTTP_REQUEST,
-				     buffer, info->server_name.name, info->user_agent);
-	trans.req         = ctx->request_buf;
-	trans.rsp         = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
-
-	rc = http_transaction(&client, &trans);
-	if (strstr(trans.rsp_body, "ERROR:"))
+	if (strstr(rsp.trans.rsp_body, "ERROR:"))
 		level = LOG_ERR;
 	else
 		level = LOG_DEBUG;
-	logit(level, "=> %s", trans.rsp_body);
-	http_exit(&client);
-	http_destruct(&client, 1);
+	logit(level, "=> %s", rsp.trans.rsp_body);
 
-	if (rc || (rc = http_status_valid(trans.status))) {
-		logit(LOG_DEBUG, "Failed fetching API key, rc: %d\n", rc);
+	return arena_strdup(ctx->arena, rsp.trans.rsp_body);
+}
+
+/*
+ * The listing of all hostnames in the account, with their update keys,
+ * one "host|address|url" per line.  It is fetched once and indexed, in
+ * the same allocation so info->data can be freed by the core, and kept
+ * across updates.  Refetched when a hostname is missing, or an update
+ * fails, e.g. after changes to the account.
+ */
+struct entry {
+	char *host;
+	char *key;
+};
+
+struct keys {
+	char         *key;		/* Of the hostname being updated */
+	size_t        num;
+	struct entry  entry[];
+};
+
+static struct keys *index_keys(const char *buf)
+{
+	struct keys *keys;
+	char *text, *tmp, *line;
+	size_t lines = 1;
+	const char *p;
+
+	for (p = buf; *p; p++) {
+		if (*p == '\n')
+			lines++;
+	}
+
+	keys = mem_malloc(sizeof(*keys) + lines * sizeof(struct entry) + strlen(buf) + 1);
+	if (!keys)
 		return NULL;
+
+	keys->key = NULL;
+	keys->num = 0;
+	text = (char *)&keys->entry[lines];
+	strcpy(text, buf);
+
+	for (tmp = text, line = strsep(&tmp, "\n"); line; line = strsep(&tmp, "\n")) {
+		char *host, *url, *key;
+
+		line[strcspn(line, "\r")] = 0;
+		host = strsep(&line, "|");
+		strsep(&line, "|");		/* address */
+		url = strsep(&line, "|");
+		if (!*host || !url)
+			continue;
+
+		key = strchr(url, '?');
+		if (!key)
+			continue;
+
+		keys->entry[keys->num].host  = host;
+		keys->entry[keys->num++].key = key + 1;
 	}
 
-	return strdup(trans.rsp_body);
+	return keys;
 }
 
-/* FreeDNS requires an API key, the following code fetches yours */
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+static char *find_key(struct keys *keys, const char *name)
 {
-	char         *hash = NULL;
-#ifndef ENABLE_SIMULATION
-	char          host[256], updateurl[256];
-	char         *buf, *tmp, *line;
+	size_t i;
 
-	tmp = buf = fetch_keys(ctx, info);
+	if (!keys)
+		return NULL;
+
+	for (i = 0; i < keys->num; i++) {
+		if (!strcmp(keys->entry[i].host, name))
+			return keys->entry[i].key;
+	}
+
+	return NULL;
+}
+
+static int load_keys(ddns_t *ctx, ddns_info_t *info)
+{
+	char *buf;
+
+	buf = fetch_keys(ctx, info);
 	if (!buf) {
 		logit(LOG_ERR, "Cannot find your FreeDNS account API keys");
 		return RC_ERROR;
 	}
 
-	if (strstr(buf, "Failed authenticating to fetch API keys")) {
-		free(buf);
+	if (strstr(buf, "Failed authenticating to fetch API keys"))
 		return RC_DDNS_RSP_AUTH_FAIL;
-	}
 
-	for (line = strsep(&tmp, "\n"); line; line = strsep(&tmp, "\n")) {
-		int num;
+	mem_free(info->data);
+	info->data = index_keys(buf);
+	if (!info->data)
+		return RC_OUT_OF_MEMORY;
+
+	return 0;
+}
+
+/* Fetch the listing before the first update, see setup() */
+static int prefetch(ddns_t *ctx, ddns_info_t *info)
+{
+#ifndef ENABLE_SIMULATION
+	if (!info->data)
+		return load_keys(ctx, info);
+#endif
+
+	return 0;
+}
+
+/* FreeDNS requires an API key, the following code fetches yours */
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	struct keys *keys = info->data;
+#ifndef ENABLE_SIMULATION
+	if (keys) {
+		keys->key = find_key(keys, alias->name);
+		if (keys->key)
+			return 0;
 
-		num = sscanf(line, "%255[^|\r\n]|%*[^|\r\n]|%255[^|\r\n]", host, updateurl);
-		if (*line && num == 2 && !strcmp(host, alias->name)) {
-			hash = strstr(updateurl, "?");
-			break;
-		}
+		logit(LOG_DEBUG, "%s not in cached FreeDNS API keys, refetching", alias->name);
 	}
-	free(buf);
 
-	if (!hash) {
+	DO(load_keys(ctx, info));
+	keys = info->data;
+
+	keys->key = find_key(keys, alias->name);
+	if (!keys->key) {
 		logit(LOG_INFO, "Cannot find your DNS name in the list of API keys");
 		return 1;
 	}
-	hash++;
 #else
-	hash = "<NIL>";
+	if (!keys) {
+		info->data = keys = index_keys("");
+		if (!keys)
+			return RC_OUT_OF_MEMORY;
+	}
+	keys->key = "<NIL>";
 #endif /* ENABLE_SIMULATION */
 
-	if (info->data)
-		free(info->data);
-	info->data = strdup(hash);
-
 	return 0;
 }
 
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *hash = (char *)info->data;
+	struct keys *keys = info->data;
 
-	if (!hash)
+	if (!keys || !keys->key)
 		return 0;
 
 	return snprintf(ctx->request_buf, ctx->request_buflen,
 			info->system->server_req,
 			info->server_url,
-			hash, alias->address,
+			keys->key, alias->address,
 			info->server_name.name,
 			info->user_agent);
 }
@@ -176,28 +269,23 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
+	int rc;
 
-	(void)info;
-	(void)alias;
-
-	DO(http_status_valid(trans->status));
-
-	if (strstr(resp, alias->address))
+	rc = http_status_valid(trans->status);
+	if (!rc && strstr(resp, alias->address))
 		return 0;
 
-	return RC_DDNS_RSP_NOTOK;
-}
+	/* Stale key?  Fetch the listing again on the next attempt */
+	if (!rc || rc == RC_DDNS_RSP_AUTH_FAIL || rc == RC_DDNS_RSP_NOTOK) {
+		mem_free(info->data);
+		info->data = NULL;
+	}
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, FREEDNS_UPDATE_IP_REQUEST);
-	plugin_register_v6(&plugin, FREEDNS_UPDATE_IP_REQUEST);
+	return rc ? rc : RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, FREEDNS_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@freedns.afraid.org", FREEDNS_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
@@ -22,6 +22,7 @@
  */
 
 #include <ctype.h>
+#include "match.h"
 #include "plugin.h"
 
 /*
@@ -32,12 +33,16 @@
  * With the standard http stuff and basic base64 encoded auth.
  * The parameter here is the entire request, except the the alias.
  */
-#define GENERIC_BASIC_AUTH_UPDATE_IP_REQUEST				\
-	"GET %s%s "							\
-	"HTTP/1.0\r\n"							\
+#define GENERIC_HTTP_HEADERS						\
+	" HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"Authorization: Basic %s\r\n"					\
 	"User-Agent: %s\r\n\r\n"
+#define GENERIC_BASIC_AUTH_UPDATE_IP_REQUEST				\
+	"GET %s%s" GENERIC_HTTP_HEADERS
+
+/* Like url_encode() used to, leave the user's own URL syntax as is */
+#define GENERIC_URL_FLAGS (URL_KEEP_DELIMS | URL_KEEP_ESCAPES | URL_SPACE_PLUS)
 
 const char * const generic_responses[] =
     { "OK", "good", "true", "updated", "success", "nochg", NULL };
@@ -59,24 +64,49 @@ static ddns_system_t generic = {
 	.server_url   = ""
 };
 
-/* Replace %? with @str */
-static void replace_fmt(char *fmt, char *str, size_t fmtlen)
+/* URL encode @len bytes of @str at @pos in the request buffer */
+static int put(ddns_t *ctx, size_t *pos, const char *str, size_t len)
 {
-	char *src = fmt + fmtlen;
-	size_t len = strlen(str);
+	int num;
+
+	num = url_encode(&ctx->request_buf[*pos], ctx->request_buflen - *pos, str, len, GENERIC_URL_FLAGS);
+	if (num < 0)
+		return -1;
+	*pos += num;
 
-	memmove(fmt + len, src, strlen(src) + 1);
-	memcpy(fmt, str, strlen(str));
+	return 0;
 }
 
-/* Skip %? if it has not been specified */
-static void skip_fmt(char *fmt, size_t len)
+/* Value of a %? format specifier, NULL if unknown */
+static const char *fmt_value(char fmt, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *src = fmt + len;
+	switch (fmt) {
+	case 'u':
+		if (!info->creds.username[0]) {
+			logit(LOG_ERR, "Format specifier in ddns-path used: '%%u',"
+			      " but 'username' configuration option has not been specified!");
+		}
+		return info->creds.username;
 
-	memmove(fmt, src, strlen(src) + 1);
-}
+	case 'p':
+		if (!info->creds.password[0]) {
+			logit(LOG_ERR, "Format specifier in ddns-path used: '%%p',"
+			      " but 'password' configuration option has not been specified!");
+		}
+		return info->creds.password;
 
+	case 'h':
+		return alias->name;
+
+	case 'i':
+		return alias->address;
+
+	default:
+		break;
+	}
+
+	return NULL;
+}
 
 /*
  * Fully custom server URL, with % format specifiers
@@ -85,115 +115,58 @@ static void skip_fmt(char *fmt, size_t len)
  * %p - password, if HTTP basic auth is not used
  * %h - hostname
  * %i - IP address
+ * %% - a literal %, as is, or %25 if not followed by two hex digits
+ *
+ * The specifiers are expanded and the result URL encoded straight into
+ * the request buffer, in one pass.  Already encoded %XX is left as is.
  */
-static int custom_server_url(char *buf, ddns_info_t *info, ddns_alias_t *alias)
+static int custom_server_url(ddns_t *ctx, size_t *pos, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *ptr;
-
-	while ((ptr = strchr(buf, '%'))) {
-		if (!strncmp(ptr, "%u", 2)) {
-			if (strnlen(info->creds.username, USERNAME_LEN) <= 0) {
-				logit(LOG_ERR, "Format specifier in ddns-path used: '%%u',"
-				      " but 'username' configuration option has not been specified!");
-				skip_fmt(ptr, 2);
-			} else {
-				replace_fmt(ptr, info->creds.username, 2);
-			}
-
+	const char *ptr = info->server_url;
+	int rc = 0;
+
+	while (*ptr) {
+		const char *val;
+		size_t len;
+
+		len = strcspn(ptr, "%");
+		if (put(ctx, pos, ptr, len))
+			return -1;
+		ptr += len;
+		if (!*ptr)
+			break;
+
+		val = fmt_value(ptr[1], info, alias);
+		if (val) {
+			if (put(ctx, pos, val, strlen(val)))
+				return -1;
+			ptr += 2;
 			continue;
 		}
 
-		if (!strncmp(ptr, "%p", 2)) {
-			if (strnlen(info->creds.password, PASSWORD_LEN) <= 0) {
-				logit(LOG_ERR, "Format specifier in ddns-path used: '%%p',"
-				      " but 'password' configuration option has not been specified!");
-				skip_fmt(ptr, 2);
-			} else {
-				replace_fmt(ptr, info->creds.password, 2);
+		if (ptr[1] == '%') {
+			/* Keep %%XX as an escape, like the user likely intended */
+			ptr++;
+			if (isxdigit((unsigned char)ptr[1]) && isxdigit((unsigned char)ptr[2])) {
+				if (*pos + 1 >= ctx->request_buflen)
+					return -1;
+				ctx->request_buf[(*pos)++] = '%';
+				ptr++;
+				continue;
 			}
-
-			continue;
-		}
-
-		if (!strncmp(ptr, "%h", 2)) {
-			replace_fmt(ptr, alias->name, 2);
-			continue;
-		}
-
-		if (!strncmp(ptr, "%i", 2)) {
-			replace_fmt(ptr, alias->address, 2);
-			continue;
-		}
-
-		/* NOTE: This should be the last one */
-		if (!strncmp(ptr, "%%", 2)) {
-			replace_fmt(ptr, "%", 2);
-			continue;
-		}
-
-		logit(LOG_ERR, "Unknown format specifier in ddns-path: '%c'", ptr[1]);
-		return -1;
-	}
-
-	return strlen(buf);
-}
-
-static char tohex(char code)
-{
-	static const char hex[] = "0123456789abcdef";
-
-	return hex[code & 15];
-}
-
-/* Used to check if user already URL encoded */
-static int ishex(char *str)
-{
-	if (strlen(str) < 3)
-		return 0;
-
-	if (str[0] == '%' && isxdigit(str[1]) && isxdigit(str[2]))
-		return 1;
-
-	return 0;
-}
-
-/*
- * Simple URL encoder, with exceptions for /, ?, =, and &, which should
- * usually be encoded as well, but are here exposed raw to advanced
- * end-users.
- */
-static char *url_encode(char *str)
-{
-	char *buf, *ptr;
-
-	buf = calloc(strlen(str) * 3 + 1, sizeof(char));
-	if (!buf)
-		return NULL;
-	ptr = buf;
-
-	while (str[0]) {
-		char ch = str[0];
-
-		if (ishex(str)) {
-			*ptr++ = *str++;
-			*ptr++ = *str++;
-			*ptr++ = *str++;
-			continue;
+		} else if (!isxdigit((unsigned char)ptr[1]) || !isxdigit((unsigned char)ptr[2])) {
+			logit(LOG_ERR, "Unknown format specifier in ddns-path: '%c'", ptr[1]);
+			rc = 1;
 		}
 
-		if (isalnum(ch) || ch == '-' || ch == '_' || ch == '.' || ch == '~')
-			*ptr++ = ch;
-		else if (ch == '/' || ch == '?' || ch == '&' || ch == '=')
-			*ptr++ = ch;
-		else if (ch == ' ')
-			*ptr++ = '+';
-		else
-			*ptr++ = '%', *ptr++ = tohex(ch >> 4), *ptr++ = tohex(ch & 15);
-		str++;
+		/* Already encoded %XX, or a stray %, encoded as %25 */
+		len = 1 + strcspn(ptr + 1, "%");
+		if (put(ctx, pos, ptr, len))
+			return -1;
+		ptr += len;
 	}
-	*ptr = '\0';
 
-	return buf;
+	return rc;
 }
 
 /*
@@ -201,24 +174,30 @@ static char *url_encode(char *str)
  * custom{} section.  There is currently no way to only call it
  * once, in case a DDNS provider supports many hostnames in the
  * HTTP GET URL.
+ *
+ * The request is composed in place, the URL is encoded directly into
+ * the request buffer.  If it does not fit the full buffer length is
+ * returned, which the caller reports as an overflow.
  */
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char  buf[2 * sizeof(info->server_url)];
+	size_t pos = strlcpy(ctx->request_buf, "GET ", ctx->request_buflen);
 	char *arg = "";
-	char *url;
 	int ret;
 
-	/* Operate of copy of URL, may contain %-modifiers */
-	strlcpy(buf, info->server_url, sizeof(buf));
+	if (pos >= ctx->request_buflen)
+		return ctx->request_buflen;
 
 	/*
 	 * if the user has specified modifiers, then they probably know
 	 * how to append his hostname or IP, otherwise just append the
 	 * hostname or ip (depending on the append_myip option)
 	 */
-	if (strchr(buf, '%')) {
-		if (custom_server_url(buf, info, alias) <= 0)
+	if (strchr(info->server_url, '%')) {
+		ret = custom_server_url(ctx, &pos, info, alias);
+		if (ret < 0)
+			return ctx->request_buflen;
+		if (ret)
 			logit(LOG_ERR, "Invalid server URL: %s", info->server_url);
 	} else {
 		/* Backwards compat, default to append hostname */
@@ -226,33 +205,54 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 		if (info->append_myip)
 			arg = alias->address;
-	}
 
-	url = url_encode(buf);
-	if (!url)
-		return 0;
+		if (put(ctx, &pos, info->server_url, strlen(info->server_url)))
+			return ctx->request_buflen;
+	}
 
-	ret = snprintf(ctx->request_buf, ctx->request_buflen,
-		       info->system->server_req,
-		       url, arg,
+	ret = snprintf(&ctx->request_buf[pos], ctx->request_buflen - pos,
+		       "%s" GENERIC_HTTP_HEADERS, arg,
 		       info->server_name.name,
 		       info->creds.encoded_password,
 		       info->user_agent);
-	free(url);
+	if (ret < 0)
+		return ctx->request_buflen;
 
-	return ret;
+	return pos + ret;
+}
+
+/* Any of the ddns-response strings, compiled on first use */
+static matcher_t *get_matcher(ddns_info_t *info)
+{
+	match_rule_t rules[MAX_NUM_RESPONSES];
+	size_t i;
+
+	if (info->data)
+		return info->data;
+
+	for (i = 0; i < info->server_response_num; i++) {
+		rules[i].pattern = info->server_response[i];
+		rules[i].rc      = 0;
+	}
+	info->data = match_compile(rules, info->server_response_num, MATCH_NOCASE);
+
+	return info->data;
 }
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
 	char *resp = trans->rsp_body;
+	matcher_t *m;
 	size_t i;
 
-	(void)info;
 	(void)alias;
 
 	DO(http_status_valid(trans->status));
 
+	m = get_matcher(info);
+	if (m)
+		return match_find(m, resp, strlen(resp)) < 0 ? RC_DDNS_RSP_NOTOK : 0;
+
 	for (i = 0; i < info->server_response_num; i++) {
 		if (strcasestr(resp, info->server_response[i]))
 			return 0;
@@ -261,15 +261,7 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&generic, GENERIC_BASIC_AUTH_UPDATE_IP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&generic);
-}
+PLUGIN_REGISTER(generic, GENERIC_BASIC_AUTH_UPDATE_IP_REQUEST);
 
 /**
  * Local Variables:
@@ -27,7 +27,7 @@
 	"password=%s&"							\
 	"hostname=%s&"							\
 	"ip=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -37,7 +37,7 @@
 	"password=%s&"							\
 	"hostname=%s&"							\
 	"ip6=%s "							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -98,17 +98,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, MYONLINEPORTAL_UPDATE_IP_REQUEST);
-	plugin_register(&plugin_v6, MYONLINEPORTAL_UPDATE_IP6_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-	plugin_unregister(&plugin_v6);
-}
+PLUGIN_REGISTER(plugin, MYONLINEPORTAL_UPDATE_IP_REQUEST);
+PLUGIN_REGISTER(plugin_v6, MYONLINEPORTAL_UPDATE_IP6_REQUEST);
 
 /**
  * Local Variables:
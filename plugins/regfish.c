@@ -28,7 +28,7 @@
 	"authtype=secure&"						\
 	"token=%s&"							\
 	"ip=%s "   							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -39,7 +39,7 @@
 	"authtype=secure&"						\
 	"token=%s&"							\
 	"ipv6=%s "   							\
-	"HTTP/1.0\r\n"							\
+	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
@@ -62,7 +62,8 @@ static ddns_system_t plugin = {
 static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 {
 	return snprintf(ctx->request_buf, ctx->request_buflen,
-			info->system->server_req,
+			alias->family == AF_INET6 ? REGFISH_UPDATE_IP6_HTTP_REQUEST
+						  : REGFISH_UPDATE_IP_HTTP_REQUEST,
 			info->server_url,
 			alias->name,
 			info->creds.username,
@@ -86,16 +87,8 @@ static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 	return RC_DDNS_RSP_NOTOK;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, REGFISH_UPDATE_IP_HTTP_REQUEST);
-	plugin_register_v6(&plugin, REGFISH_UPDATE_IP6_HTTP_REQUEST);
-}
-
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
+PLUGIN_REGISTER(plugin, REGFISH_UPDATE_IP_HTTP_REQUEST);
+PLUGIN_REGISTER_V6(plugin, "ipv6@regfish.de", REGFISH_UPDATE_IP6_HTTP_REQUEST);
 
 /**
  * Local Variables:
@@ -0,0 +1,745 @@
+/* Plugin for RFC 2136 DNS UPDATE, signed with TSIG (RFC 8945)
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Updates the A, or AAAA, records of all hostnames in one signed DNS
+ * UPDATE message per zone, sent straight to the primary name server,
+ * e.g. BIND or Knot.  No HTTP involved, usually one UDP round-trip.
+ *
+ *     provider rfc2136 {
+ *         username    = hmac-sha256:keyname    # TSIG key, algorithm optional
+ *         password    = "base64 secret"
+ *         hostname    = { "host.example.com", "www.example.com" }
+ *         ddns-server = ns1.example.com        # Optional, default: SOA MNAME
+ *         ttl         = 300
+ *     }
+ *
+ * The zone, and unless given its primary name server, is found like
+ * nsupdate does it, from the SOA record.  Each record is replaced, all
+ * existing records of the same type for the name are deleted first.
+ * Names are sent uncompressed, canonical, so no libresolv is needed
+ * to build the message.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <resolv.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/nameser.h>
+#include <sys/socket.h>
+
+#include "plugin.h"
+#include "base64.h"
+#include "dnscache.h"
+#include "event.h"
+#include "hash.h"
+
+#define DNS_PORT		53
+#define DNS_UDP_MAX		512	/* Larger messages go over TCP */
+#define DNS_TIMEOUT		2000	/* msec, per attempt */
+#define DNS_RETRIES		3
+#define DNS_DEFAULT_TTL		300	/* sec, unless ttl is set */
+
+#define OPCODE_UPDATE		5
+#define TYPE_TSIG		250
+#define CLASS_ANY		255
+#define TSIG_FUDGE		300	/* sec, allowed clock skew */
+
+static const struct {
+	const char *name;
+	const char *wire;	/* Algorithm name in the TSIG record */
+	hash_alg_t  alg;
+} algs[] = {
+	{ "hmac-md5",    "hmac-md5.sig-alg.reg.int", HASH_MD5    },
+	{ "hmac-sha1",   "hmac-sha1",                HASH_SHA1   },
+	{ "hmac-sha256", "hmac-sha256",              HASH_SHA256 },
+};
+
+struct tsig {
+	const char    *alg_name;
+	hash_alg_t     alg;
+	char           name[NS_MAXDNAME];
+	unsigned char  secret[PASSWORD_LEN];
+	size_t         len;
+};
+
+static int update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc);
+
+static ddns_system_t plugin = {
+	.name         = "default@rfc2136",
+
+	.update       = (update_fn_t)update,
+
+	.checkip_name = DYNDNS_MY_IP_SERVER,
+	.checkip_url  = DYNDNS_MY_CHECKIP_URL,
+	.checkip_ssl  = DYNDNS_MY_IP_SSL,
+
+	.server_name  = "",
+	.server_url   = ""
+};
+
+static unsigned short get16(const unsigned char *ptr)
+{
+	return (ptr[0] << 8) | ptr[1];
+}
+
+static unsigned char *put16(unsigned char *ptr, unsigned short val)
+{
+	ptr[0] = val >> 8;
+	ptr[1] = val & 0xff;
+
+	return ptr + 2;
+}
+
+static unsigned char *put32(unsigned char *ptr, unsigned int val)
+{
+	ptr = put16(ptr, val >> 16);
+	return put16(ptr, val & 0xffff);
+}
+
+/* Uncompressed name in canonical, lower case, form, as TSIG wants it */
+static unsigned char *put_name(unsigned char *ptr, unsigned char *end, const char *name)
+{
+	while (*name && *name != '.') {
+		size_t i, label = strcspn(name, ".");
+
+		if (label > 63 || ptr + label + 1 >= end)
+			return NULL;
+
+		*ptr++ = label;
+		for (i = 0; i < label; i++)
+			*ptr++ = tolower((unsigned char)name[i]);
+
+		name += label;
+		if (*name)
+			name++;
+	}
+
+	if (ptr >= end)
+		return NULL;
+	*ptr++ = 0;
+
+	return ptr;
+}
+
+/* Skip a possibly compressed name, returns NULL if malformed */
+static const unsigned char *skip_name(const unsigned char *ptr, const unsigned char *end)
+{
+	while (ptr < end) {
+		if (!*ptr)
+			return ptr + 1;
+		if ((*ptr & 0xc0) == 0xc0)
+			return ptr + 2 <= end ? ptr + 2 : NULL;
+		ptr += *ptr + 1;
+	}
+
+	return NULL;
+}
+
+/* Skip @num resource records */
+static const unsigned char *skip_rrs(const unsigned char *ptr, const unsigned char *end, int num)
+{
+	while (ptr && num-- > 0) {
+		ptr = skip_name(ptr, end);
+		if (!ptr || ptr + RRFIXEDSZ > end)
+			return NULL;
+
+		ptr += RRFIXEDSZ + get16(ptr + 8);
+		if (ptr > end)
+			return NULL;
+	}
+
+	return ptr;
+}
+
+/* TSIG key from "[algorithm:]name" and the base64 encoded secret */
+static int tsig_key(ddns_info_t *info, struct tsig *key)
+{
+	const char *name = info->creds.username;
+	const char *sep = strchr(name, ':');
+	size_t i;
+
+	key->alg_name = algs[NELEMS(algs) - 1].wire;
+	key->alg      = algs[NELEMS(algs) - 1].alg;
+	if (sep) {
+		for (i = 0; i < NELEMS(algs); i++) {
+			if (!strncasecmp(name, algs[i].name, sep - name) && !algs[i].name[sep - name])
+				break;
+		}
+		if (i == NELEMS(algs)) {
+			logit(LOG_ERR, "Unsupported TSIG algorithm in '%s'", name);
+			return 1;
+		}
+
+		key->alg_name = algs[i].wire;
+		key->alg      = algs[i].alg;
+		name = sep + 1;
+	}
+	strlcpy(key->name, name, sizeof(key->name));
+
+	key->len = sizeof(key->secret);
+	if (base64_decode(key->secret, &key->len, (unsigned char *)info->creds.password,
+			  strlen(info->creds.password))) {
+		logit(LOG_ERR, "Invalid TSIG secret for key %s, must be base64", key->name);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * TSIG variables, RFC 8945 section 4.3.3, the record without MAC and
+ * original ID, in canonical form.  Returns end of variables in @buf.
+ */
+static unsigned char *tsig_vars(unsigned char *buf, unsigned char *end, struct tsig *key,
+				const unsigned char *signed_at, int error)
+{
+	unsigned char *ptr;
+
+	ptr = put_name(buf, end, key->name);
+	if (!ptr || ptr + 8 > end)
+		return NULL;
+	ptr = put16(ptr, CLASS_ANY);
+	ptr = put32(ptr, 0);	/* TTL */
+
+	ptr = put_name(ptr, end, key->alg_name);
+	if (!ptr || ptr + 14 > end)
+		return NULL;
+	memcpy(ptr, signed_at, 8);	/* Time signed and fudge */
+	ptr += 8;
+	ptr = put16(ptr, error);
+	ptr = put16(ptr, 0);	/* Other len */
+
+	return ptr;
+}
+
+/* MAC of @prior (request MAC, for replies), @msg and the TSIG variables */
+static int tsig_mac(struct tsig *key, const unsigned char *prior, size_t prior_len,
+		    const unsigned char *msg, size_t len, const unsigned char *signed_at,
+		    int error, unsigned char *mac)
+{
+	unsigned char vars[2 * NS_MAXCDNAME + 32], *end;
+	hmac_ctx_t hmac;
+
+	end = tsig_vars(vars, vars + sizeof(vars), key, signed_at, error);
+	if (!end)
+		return 1;
+
+	if (hmac_init(&hmac, key->alg, key->secret, key->len))
+		return 1;
+
+	if (prior) {
+		unsigned char hdr[2];
+
+		put16(hdr, prior_len);
+		hmac_update(&hmac, hdr, sizeof(hdr));
+		hmac_update(&hmac, prior, prior_len);
+	}
+	hmac_update(&hmac, msg, len);
+	hmac_update(&hmac, vars, end - vars);
+
+	return hmac_final(&hmac, mac);
+}
+
+/* Sign @msg of @len bytes, TSIG record appended, returns new length or -1 */
+static int tsig_sign(struct tsig *key, unsigned char *msg, int len, size_t size, unsigned char *mac)
+{
+	unsigned char signed_at[8], *ptr, *end = msg + size;
+	size_t mac_len = hash_size(key->alg);
+	time_t now = time(NULL);
+
+	put16(signed_at, (unsigned long long)now >> 32);
+	put32(signed_at + 2, now & 0xffffffff);
+	put16(signed_at + 6, TSIG_FUDGE);
+
+	if (tsig_mac(key, NULL, 0, msg, len, signed_at, 0, mac))
+		return -1;
+
+	ptr = put_name(msg + len, end, key->name);
+	if (!ptr || ptr + RRFIXEDSZ > end)
+		return -1;
+	ptr = put16(ptr, TYPE_TSIG);
+	ptr = put16(ptr, CLASS_ANY);
+	ptr = put32(ptr, 0);
+	ptr += 2;		/* RDLENGTH, below */
+
+	len = ptr - msg;
+	ptr = put_name(ptr, end, key->alg_name);
+	if (!ptr || ptr + 16 + mac_len > end)
+		return -1;
+	memcpy(ptr, signed_at, 8);
+	ptr += 8;
+	ptr = put16(ptr, mac_len);
+	memcpy(ptr, mac, mac_len);
+	ptr += mac_len;
+	memcpy(ptr, msg, 2);	/* Original ID */
+	ptr += 2;
+	ptr = put16(ptr, 0);	/* Error */
+	ptr = put16(ptr, 0);	/* Other len */
+
+	put16(msg + len - 2, ptr - (msg + len));
+	put16(msg + 10, get16(msg + 10) + 1);	/* ARCOUNT */
+
+	return ptr - msg;
+}
+
+/*
+ * Verify the TSIG of the server's reply, signed with the same key and
+ * chained to the MAC of our request.  Error replies for a bad key, or
+ * bad signature, are not signed, those are left to the caller.
+ */
+static int tsig_verify(struct tsig *key, unsigned char *rsp, int len, const unsigned char *req_mac)
+{
+	const unsigned char *ptr, *end = rsp + len, *tsig, *rdata, *mac;
+	unsigned char calc[HASH_MAX_SIZE], orig[2];
+	size_t mac_len = hash_size(key->alg);
+	int ar = get16(rsp + 10), rc;
+	long long skew;
+
+	if (ar < 1)
+		return 1;
+
+	ptr = rsp + HFIXEDSZ;
+	ptr = skip_name(ptr, end);	/* Zone */
+	if (!ptr || ptr + QFIXEDSZ > end)
+		return 1;
+	ptr = skip_rrs(ptr + QFIXEDSZ, end, get16(rsp + 6) + get16(rsp + 8) + ar - 1);
+	if (!ptr)
+		return 1;
+
+	tsig = ptr;
+	ptr = skip_name(ptr, end);
+	if (!ptr || ptr + RRFIXEDSZ > end || get16(ptr) != TYPE_TSIG)
+		return 1;
+
+	rdata = skip_name(ptr + RRFIXEDSZ, end);
+	if (!rdata || rdata + 10 > end || get16(rdata + 8) != mac_len)
+		return 1;
+	mac = rdata + 10;
+	if (mac + mac_len + 6 > end)
+		return 1;
+
+	skew = (long long)time(NULL) - (((long long)get16(rdata) << 32) | ((unsigned)get16(rdata + 2) << 16 | get16(rdata + 4)));
+	if (skew > TSIG_FUDGE || skew < -TSIG_FUDGE) {
+		logit(LOG_WARNING, "TSIG time of reply off by %lld sec, check system clock", skew);
+		return 1;
+	}
+
+	/* MAC covers the reply as it was before the TSIG was added */
+	memcpy(orig, rsp, 2);
+	memcpy(rsp, mac + mac_len, 2);
+	put16(rsp + 10, ar - 1);
+	rc = tsig_mac(key, req_mac, mac_len, rsp, tsig - rsp, rdata, get16(mac + mac_len + 2), calc);
+	put16(rsp + 10, ar);
+	memcpy(rsp, orig, 2);
+	if (rc)
+		return 1;
+
+	return memcmp(calc, mac, mac_len) != 0;
+}
+
+/*
+ * Zone of @name, and its primary name server, from the SOA record.  The
+ * hostname usually has no SOA, so walk up one label at a time.
+ */
+static int find_zone(const char *name, char *zone, char *primary)
+{
+#ifdef HAVE_RES_QUERY
+	unsigned char rsp[NS_PACKETSZ];
+
+	while (name && *name) {
+		const unsigned char *ptr, *end;
+		int n, an;
+
+		n = res_query(name, C_IN, T_SOA, rsp, sizeof(rsp));
+		if (n < HFIXEDSZ)
+			goto next;
+
+		end = rsp + n;
+		an  = get16(rsp + 6);
+		ptr = skip_name(rsp + HFIXEDSZ, end);
+		if (ptr)
+			ptr += QFIXEDSZ;
+
+		while (ptr && ptr < end && an-- > 0) {
+			const unsigned char *rr = ptr;
+
+			ptr = skip_name(ptr, end);
+			if (!ptr || ptr + RRFIXEDSZ > end)
+				break;
+
+			if (get16(ptr) == T_SOA &&
+			    dn_expand(rsp, end, rr, zone, NS_MAXDNAME) > 0 &&
+			    dn_expand(rsp, end, ptr + RRFIXEDSZ, primary, NS_MAXDNAME) > 0)
+				return 0;
+
+			ptr += RRFIXEDSZ + get16(ptr + 8);
+		}
+	next:
+		name = strchr(name, '.');
+		if (name)
+			name++;
+	}
+#else
+	(void)name;
+	(void)zone;
+	(void)primary;
+	logit(LOG_ERR, "Built without res_query(), cannot look up SOA record");
+#endif
+
+	return 1;
+}
+
+/* Is @name in @zone, or the apex of it */
+static int in_zone(const char *name, const char *zone)
+{
+	size_t nlen = strlen(name), zlen = strlen(zone);
+
+	if (nlen && name[nlen - 1] == '.')
+		nlen--;
+	if (nlen == zlen)
+		return !strncasecmp(name, zone, zlen);
+
+	return nlen > zlen && name[nlen - zlen - 1] == '.' && !strncasecmp(name + nlen - zlen, zone, zlen);
+}
+
+/* Wait for @sd to become ready for @events, or the deadline */
+static int wait_for(int sd, int events, long long deadline)
+{
+	struct pollfd pfd = { .fd = sd, .events = events };
+
+	while (1) {
+		long long now = event_msec();
+		int rc;
+
+		if (now >= deadline)
+			return 1;
+
+		rc = poll(&pfd, 1, (int)(deadline - now));
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		return rc <= 0;
+	}
+}
+
+/* Read exactly @len bytes from stream socket @sd */
+static int read_all(int sd, unsigned char *buf, size_t len, long long deadline)
+{
+	while (len > 0) {
+		ssize_t n;
+
+		if (wait_for(sd, POLLIN, deadline))
+			return 1;
+
+		n = recv(sd, buf, len, 0);
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			return 1;
+
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+/* DNS over TCP, for replies that are truncated, or requests too big for UDP */
+static int exchange_tcp(dns_addr_t *addr, const unsigned char *req, int len, unsigned char *rsp, size_t size)
+{
+	long long deadline = event_msec() + DNS_TIMEOUT;
+	unsigned char hdr[2];
+	int sd, rlen = -1;
+
+	sd = socket(addr->ss.ss_family, SOCK_STREAM, 0);
+	if (sd < 0)
+		return -1;
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if (connect(sd, (struct sockaddr *)&addr->ss, addr->len) && errno != EINPROGRESS)
+		goto done;
+	if (wait_for(sd, POLLOUT, deadline))
+		goto done;
+
+	put16(hdr, len);
+	if (send(sd, hdr, 2, MSG_NOSIGNAL) != 2 || send(sd, req, len, MSG_NOSIGNAL) != len)
+		goto done;
+
+	if (read_all(sd, hdr, 2, deadline) || get16(hdr) > size || get16(hdr) < HFIXEDSZ)
+		goto done;
+	if (read_all(sd, rsp, get16(hdr), deadline))
+		goto done;
+
+	rlen = get16(hdr);
+done:
+	close(sd);
+	return rlen;
+}
+
+/* Reply to @req, over UDP, unless too big, with TCP fallback on truncation */
+static int exchange(const char *host, int port, const unsigned char *req, int len,
+		    unsigned char *rsp, size_t size)
+{
+	dns_addr_t addr[DNSCACHE_MAX_ADDRS];
+	int attempt, num, rc;
+
+	rc = dnscache_resolve(host, port, AF_UNSPEC, addr, &num);
+	if (rc) {
+		logit(LOG_WARNING, "Failed resolving hostname %s: %s", host, gai_strerror(rc));
+		return -1;
+	}
+
+	for (attempt = 0; attempt < DNS_RETRIES; attempt++) {
+		dns_addr_t *a = &addr[attempt % num];
+		long long deadline;
+		ssize_t n = -1;
+		int sd;
+
+		if (len > DNS_UDP_MAX)
+			goto tcp;
+
+		sd = socket(a->ss.ss_family, SOCK_DGRAM, 0);
+		if (sd < 0)
+			return -1;
+
+		if (connect(sd, (struct sockaddr *)&a->ss, a->len) || send(sd, req, len, 0) < 0) {
+			logit(LOG_DEBUG, "Failed sending to %s: %s", host, strerror(errno));
+			close(sd);
+			continue;
+		}
+
+		deadline = event_msec() + DNS_TIMEOUT;
+		while (!wait_for(sd, POLLIN, deadline)) {
+			n = recv(sd, rsp, size, 0);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				break;	/* E.g., ECONNREFUSED */
+			}
+			if (n < HFIXEDSZ || !(rsp[2] & 0x80) || memcmp(rsp, req, 2)) {
+				n = -1;
+				continue;	/* Not ours */
+			}
+			break;
+		}
+		close(sd);
+
+		if (n < 0) {
+			logit(LOG_DEBUG, "No reply from %s, attempt %d of %d", host, attempt + 1, DNS_RETRIES);
+			continue;
+		}
+		if (!(rsp[2] & 0x02))	/* TC */
+			return n;
+
+		logit(LOG_DEBUG, "Reply from %s truncated, retrying over TCP", host);
+	tcp:
+		n = exchange_tcp(a, req, len, rsp, size);
+		if (n >= HFIXEDSZ && !memcmp(rsp, req, 2))
+			return n;
+	}
+
+	return -1;
+}
+
+/* Delete the RRset of the alias' type, then add its new address */
+static unsigned char *add_alias(unsigned char *ptr, unsigned char *end, ddns_alias_t *alias, int ttl)
+{
+	int type = alias->addr.family == AF_INET6 ? T_AAAA : T_A;
+	int rdlen = type == T_AAAA ? 16 : 4;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		ptr = put_name(ptr, end, alias->name);
+		if (!ptr || ptr + RRFIXEDSZ + rdlen > end)
+			return NULL;
+
+		ptr = put16(ptr, type);
+		if (i == 0) {
+			ptr = put16(ptr, CLASS_ANY);
+			ptr = put32(ptr, 0);
+			ptr = put16(ptr, 0);
+			continue;
+		}
+
+		ptr = put16(ptr, C_IN);
+		ptr = put32(ptr, ttl);
+		ptr = put16(ptr, rdlen);
+		memcpy(ptr, &alias->addr.in6, rdlen);
+		ptr += rdlen;
+	}
+
+	return ptr;
+}
+
+static int rcode_to_rc(int rcode)
+{
+	switch (rcode) {
+	case ns_r_noerror:
+		return 0;
+
+	case ns_r_servfail:
+		return RC_DDNS_RSP_RETRY_LATER;
+
+	case ns_r_refused:
+	case ns_r_notauth:
+		return RC_DDNS_RSP_AUTH_FAIL;
+
+	case ns_r_notzone:
+		return RC_DDNS_RSP_NOHOST;
+
+	default:
+		break;
+	}
+
+	return RC_DDNS_RSP_NOTOK;
+}
+
+/* One signed message for the aliases in @zone, results in @rc */
+static int update_zone(ddns_t *ctx, ddns_info_t *info, struct tsig *key, const char *zone,
+		       const char *primary, ddns_alias_t **alias, size_t num, int *rc)
+{
+	unsigned char *msg = (unsigned char *)ctx->request_buf, *ptr, *end;
+	unsigned char *rsp = (unsigned char *)ctx->work_buf->data;
+	unsigned char mac[HASH_MAX_SIZE];
+	const char *server = primary;
+	int port = DNS_PORT, ttl = info->ttl >= 0 ? info->ttl : DNS_DEFAULT_TTL;
+	int len, count = 0, res, rcode, n;
+	size_t i;
+
+	if (info->server_name.name[0]) {
+		server = info->server_name.name;
+		if (info->server_name.port > 0)
+			port = info->server_name.port;
+	}
+
+	end = msg + ctx->request_buflen;
+	memset(msg, 0, HFIXEDSZ);
+	msg[0] = rand() & 0xff;
+	msg[1] = rand() & 0xff;
+	msg[2] = OPCODE_UPDATE << 3;
+	put16(msg + 4, 1);	/* ZOCOUNT */
+
+	ptr = put_name(msg + HFIXEDSZ, end, zone);
+	if (!ptr || ptr + QFIXEDSZ > end)
+		goto overflow;
+	ptr = put16(ptr, T_SOA);
+	ptr = put16(ptr, C_IN);
+
+	for (i = 0; i < num; i++) {
+		if (rc[i] != -1 || !in_zone(alias[i]->name, zone))
+			continue;
+
+		ptr = add_alias(ptr, end, alias[i], ttl);
+		if (!ptr)
+			goto overflow;
+		count += 2;
+	}
+	put16(msg + 8, count);	/* UPCOUNT */
+
+	len = tsig_sign(key, msg, ptr - msg, end - msg, mac);
+	if (len < 0)
+		goto overflow;
+
+	logit(LOG_DEBUG, "Sending DNS UPDATE of %d records in zone %s to %s", count / 2, zone, server);
+	n = exchange(server, port, msg, len, rsp, ctx->work_buf->size);
+	if (n < 0) {
+		logit(LOG_WARNING, "No reply to DNS UPDATE from %s", server);
+		res = RC_TCP_RECV_ERROR;
+		goto done;
+	}
+
+	rcode = rsp[3] & 0x0f;
+	res = rcode_to_rc(rcode);
+	if (res)
+		logit(LOG_WARNING, "DNS UPDATE of zone %s refused by %s, rcode %d", zone, server, rcode);
+	else if (tsig_verify(key, rsp, n, mac)) {
+		logit(LOG_WARNING, "Invalid, or missing, TSIG in reply from %s", server);
+		res = RC_DDNS_RSP_AUTH_FAIL;
+	}
+	goto done;
+
+overflow:
+	logit(LOG_ERR, "DNS UPDATE for zone %s does not fit in buffer", zone);
+	res = RC_BUFFER_OVERFLOW;
+done:
+	for (i = 0; i < num; i++) {
+		if (rc[i] == -1 && in_zone(alias[i]->name, zone))
+			rc[i] = res;
+	}
+
+	return res;
+}
+
+/*
+ * All aliases in one message per zone.  Returns OK if the server(s)
+ * replied, the result of each alias is in @rc.
+ */
+static int update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num, int *rc)
+{
+	char zone[NS_MAXDNAME], primary[NS_MAXDNAME];
+	struct tsig key;
+	int err = 0;
+	size_t i;
+
+	for (i = 0; i < num; i++)
+		rc[i] = -1;
+
+	if (tsig_key(info, &key)) {
+		for (i = 0; i < num; i++)
+			rc[i] = RC_DDNS_INVALID_OPTION;
+		return RC_DDNS_INVALID_OPTION;
+	}
+
+	for (i = 0; i < num; i++) {
+		int res;
+
+		if (rc[i] != -1)
+			continue;
+
+		if (find_zone(alias[i]->name, zone, primary)) {
+			logit(LOG_WARNING, "Cannot find zone of %s, no SOA record", alias[i]->name);
+			rc[i] = RC_TCP_INVALID_REMOTE_ADDR;
+			err = rc[i];
+			continue;
+		}
+
+		res = update_zone(ctx, info, &key, zone, primary, alias, num, rc);
+		if (res == RC_TCP_RECV_ERROR || res == RC_BUFFER_OVERFLOW)
+			err = res;
+	}
+	memwipe(&key, sizeof(key));
+
+	return err;
+}
+
+PLUGIN_REGISTER(plugin, NULL);
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -23,11 +23,14 @@
 #include "plugin.h"
 #include "json.h"
 
+MEM_TAG("yandex");
+
 #define YANDEX_GET_REQUEST						\
 	"GET %s "							\
 	"HTTP/1.1\r\n"							\
 	"Host: %s\r\n"							\
 	"PddToken: %s\r\n"						\
+	HTTP_ACCEPT_GZIP						\
 	"User-Agent: %s\r\n\r\n"
 
 #define YANDEX_POST_REQUEST						\
@@ -40,15 +43,20 @@
 	"Content-Type: application/x-www-form-urlencoded\r\n\r\n"	\
 	"%s"
 
-/* XXX: please increase if not enough */
-#define TOKENS_EXPECTED		4096
-
+/*
+ * The record list of the domain is fetched once, and the record id of
+ * every hostname of the provider picked from it in one pass.  The ids
+ * are kept across updates, until an update fails.
+ */
 struct yandex {
 	char url[512];
 	int  len;
-	int  record_id;
+	int  record_id;		/* Of the update in progress, zero to create */
+	int  loaded;
+	int  id[];		/* Per alias, zero if not in the list */
 };
 
+static int prefetch (ddns_t       *ctx,   ddns_info_t *info);
 static int setup    (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int request  (ddns_t       *ctx,   ddns_info_t *info, ddns_alias_t *alias);
 static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias);
@@ -56,6 +64,7 @@ static int response (http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias
 static ddns_system_t plugin = {
 	.name         = "default@pdd.yandex.ru",
 
+	.prefetch     = (prefetch_fn_t)prefetch,
 	.setup        = (setup_fn_t)setup,
 	.request      = (req_fn_t)request,
 	.response     = (rsp_fn_t)response,
@@ -68,248 +77,123 @@ static ddns_system_t plugin = {
 	.server_url   = "/dynamic/update.php"
 };
 
-/* FIXME: remove and use parse_json() instead */
-static jsmntok_t *get_tokens(const char *response, int *n)
+static int is_object(const json_t *js)
 {
-	jsmn_parser *p;
-	jsmntok_t   *t;
-	int	     r;
-
-	p = malloc(sizeof(*p));
-	if (!p) {
-		logit(LOG_ERR, "Not enough memory");
-		return NULL;
-	}
-
-	t = malloc(sizeof(*t) * TOKENS_EXPECTED);
-	if (!t) {
-		logit(LOG_ERR, "Not enough memory");
-		free(p);
-		return NULL;
-	}
-
-	jsmn_init(p);
-	r = jsmn_parse(p, response, strlen(response), t, TOKENS_EXPECTED);
-	free(p);
-	*n = r;
-
-	if (r < 0) {
-		logit(LOG_ERR, "Failed to parse JSON");
-		free(t);
-		return NULL;
-	}
-
-	if ((r < 1) || (t[0].type != JSMN_OBJECT)) {
+	if (js->num <= 0 || js->tokens[0].type != JSMN_OBJECT) {
 		logit(LOG_ERR, "JSON object expected");
-		free(t);
-		return NULL;
+		return 0;
 	}
 
-	return t;
+	return 1;
+}
+
+static int success(const json_t *js)
+{
+	return is_object(js) && json_str_eq(js, 0, "success", "ok");
 }
 
-static int success(const char *response)
+static int get_record_id(const json_t *js, const char *subdomain)
 {
-	jsmntok_t *t;
-	int	   n, i;
-	int	   rc = 0;
+	int i, num, tok;
 
-	t = get_tokens(response, &n);
-	if (!t)
-		return 0;
+	tok = json_find(js, 0, "records");
+	if (tok < 0 || js->tokens[tok].type != JSMN_ARRAY) {
+		logit(LOG_ERR, "Got JSON document that cannot understand\n");
+		return -1;
+	}
 
-	for (i = 1; i < n - 1; i++) {
-		jsmntok_t *tok = &t[i];
+	num = js->tokens[tok].size;
+	for (tok++, i = 0; i < num; i++, tok = json_skip(js, tok)) {
+		long id;
 
-		if (jsoneq(response, tok, "success"))
+		if (!json_str_eq(js, tok, "subdomain", subdomain) ||
+		    !json_str_eq(js, tok, "type", "A"))
 			continue;
 
-		if (jsoneq(response, tok + 1, "ok") == 0) {
-			rc = 1;
-			break;
-		}
+		if (json_get_int(js, tok, "record_id", &id) || id <= 0)
+			continue;
+
+		return id;
 	}
 
-	free(t);
+	return 0;
+}
 
-	return rc;
+static struct yandex *get_data(ddns_info_t *info)
+{
+	if (!info->data)
+		info->data = mem_calloc(1, sizeof(struct yandex) + info->alias_count * sizeof(int));
+
+	return (struct yandex *)info->data;
 }
 
-static int get_record_id(const char *response, const char *subdomain)
+static int load_ids(ddns_t *ctx, ddns_info_t *info, struct yandex *y)
 {
-	jsmntok_t *t;
-	int	   n, i;
-	int	   record_id = 0;
-	int	   id_keyword_found = 0;
-
-	enum {
-		ST_UNKNOWN,
-		ST_FIND_RECORDS,
-		ST_FIND_RECORD_ID
-	} state = ST_UNKNOWN;
-
-	enum {
-		SUBDOMAIN_NONE,
-		SUBDOMAIN_KEYWORD,
-		SUBDOMAIN_VALUE
-	} subdomain_field = SUBDOMAIN_NONE;
-
-	enum {
-		TYPE_NONE,
-		TYPE_KEYWORD,
-		TYPE_VALUE
-	} type_field = TYPE_NONE;
-
-	t = get_tokens(response, &n);
-	if (!t)
-		return -1;
+	plugin_rsp_t rsp;
+	size_t i;
+	int rc, len;
 
-	for (i = 1; i < n; i++) {
-		jsmntok_t *tok = &t[i];
-
-		switch (tok->type) {
-		case JSMN_STRING:
-		case JSMN_PRIMITIVE:
-			if (jsoneq(response, tok, "records") == 0) {
-				state = ST_FIND_RECORDS;
-				break;
-			}
-
-			if (state != ST_FIND_RECORD_ID)
-				break;
-
-			if (jsoneq(response, tok, "subdomain") == 0) {
-				subdomain_field = SUBDOMAIN_KEYWORD;
-				break;
-			}
-
-			if (jsoneq(response, tok, "type") == 0) {
-				type_field = TYPE_KEYWORD;
-				break;
-			}
-
-			if (jsoneq(response, tok, "record_id") == 0) {
-				id_keyword_found = 1;
-				break;
-			}
-
-			if ((subdomain_field == SUBDOMAIN_KEYWORD) &&
-					(jsoneq(response, tok, subdomain)) == 0)
-				subdomain_field = SUBDOMAIN_VALUE;
-
-			if ((type_field == TYPE_KEYWORD) &&
-					(jsoneq(response, tok, "A")) == 0)
-				type_field = TYPE_VALUE;
-
-			if (id_keyword_found) {
-				char buf[129]; // additional byte for \0
-				size_t n = tok->end - tok->start;
-
-				id_keyword_found = 0;
-				if (n > sizeof(buf) - 1)
-					break;
-
-				memset(buf, 0, sizeof(buf));
-				strncpy(buf, response + tok->start, n);
-				record_id = strtol(buf, NULL, 10);
-			}
-
-			if (subdomain_field == SUBDOMAIN_VALUE &&
-					type_field == TYPE_VALUE &&
-					record_id > 0) {
-				free(t);
-				return record_id;
-			}
-
-			break;
-		case JSMN_ARRAY:
-			if (state != ST_FIND_RECORDS)
-				break;
-
-			state = ST_FIND_RECORD_ID;
-			break;
-		case JSMN_OBJECT:
-			if (state != ST_FIND_RECORD_ID)
-				break;
-
-			subdomain_field  = SUBDOMAIN_NONE;
-			type_field	 = TYPE_NONE;
-			id_keyword_found = 0;
-			break;
-
-		case JSMN_UNDEFINED:
-			break;
-		}
+	snprintf(y->url, sizeof(y->url), "/api2/admin/dns/list?domain=%s",
+		 info->creds.username);
+	len = snprintf(ctx->request_buf, ctx->request_buflen,
+		       YANDEX_GET_REQUEST, y->url,
+		       info->server_name.name,
+		       info->creds.password,
+		       info->user_agent);
+
+	rc = plugin_query(ctx, info, "Sending records list query", len, &rsp);
+	if (!rc)
+		rc = http_status_valid(rsp.trans.status);
+	if (rc) {
+		logit(LOG_WARNING, "Failed fetching record_id, rc: %d", rc);
+		goto done;
 	}
 
-	free(t);
+	rc = RC_DDNS_INVALID_OPTION;
+	if (!success(&rsp.json))
+		goto done;
 
-	if (state != ST_FIND_RECORD_ID) {
-		logit(LOG_ERR, "Got JSON document that cannot understand\n");
-		return -1;
+	for (i = 0; i < info->alias_count; i++) {
+		y->id[i] = get_record_id(&rsp.json, info->alias[i].name);
+		if (y->id[i] < 0)
+			goto done;
 	}
 
-	return 0;
+	y->loaded = 1;
+	rc = 0;
+done:
+	plugin_query_done(&rsp);
+
+	return rc;
 }
 
-static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+/* Record list fetched before the first update, see setup() */
+static int prefetch(ddns_t *ctx, ddns_info_t *info)
 {
 	struct yandex *y;
-	http_trans_t trans;
-	http_t client;
-	char *resp;
-	int rc = 0;
-
-	if (!info->data) {
-		info->data = malloc(sizeof(struct yandex));
-		if (!info->data)
-			return RC_OUT_OF_MEMORY;
-	}
-	y = (struct yandex *)info->data;
-	memset(y, 0, sizeof(struct yandex));
 
-	rc = http_construct(&client);
-	if (rc)
-		return rc;
+	y = get_data(info);
+	if (!y)
+		return RC_OUT_OF_MEMORY;
 
-	http_set_port(&client, info->server_name.port);
-	http_set_remote_name(&client, info->server_name.name);
+	if (!y->loaded)
+		return load_ids(ctx, info, y);
 
-	client.ssl_enabled = info->ssl_enabled;
-	rc = http_init(&client, "Sending records list query", TCP_AUTO);
-	if (rc) {
-		http_destruct(&client, 1);
-		return rc;
-	}
+	return 0;
+}
 
-	snprintf(y->url, sizeof(y->url), "/api2/admin/dns/list?domain=%s",
-		 info->creds.username);
-	trans.req_len = snprintf(ctx->request_buf, ctx->request_buflen,
-				 YANDEX_GET_REQUEST, y->url,
-				 info->server_name.name,
-				 info->creds.password,
-				 info->user_agent);
-	trans.req = ctx->request_buf;
-	trans.rsp = ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;
-
-	rc = http_transaction(&client, &trans);
-	http_exit(&client);
-	http_destruct(&client, 1);
-	if (rc || (rc = http_status_valid(trans.status))) {
-		logit(LOG_WARNING, "Failed fetching record_id, rc: %d", rc);
-		return rc;
-	}
+static int setup(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	struct yandex *y;
 
-	resp = trans.rsp_body;
-	logit(LOG_DEBUG, "Yandex response: %s", resp);
-	if (!success(resp))
-		return RC_DDNS_INVALID_OPTION;
+	y = get_data(info);
+	if (!y)
+		return RC_OUT_OF_MEMORY;
 
-	y->record_id = get_record_id(resp, alias->name);
-	if (y->record_id < 0)
-		return RC_DDNS_INVALID_OPTION;
+	if (!y->loaded)
+		DO(load_ids(ctx, info, y));
 
+	y->record_id = y->id[alias - info->alias];
 	if (y->record_id > 0) {
 		logit(LOG_INFO, "Updating record, id = %i", y->record_id);
 		y->len = snprintf(y->url, sizeof(y->url),
@@ -348,24 +232,33 @@ static int request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
 
 static int response(http_trans_t *trans, ddns_info_t *info, ddns_alias_t *alias)
 {
-	char *resp = trans->rsp_body;
-
-	(void)info;
-	(void)alias;
+	struct yandex *y = (struct yandex *)info->data;
+	json_t js;
+	long   id;
+	int    rc;
+
+	rc = http_status_valid(trans->status);
+	if (!rc) {
+		json_parse(&js, trans->rsp_body, strlen(trans->rsp_body));
+		if (!success(&js))
+			rc = RC_DDNS_RSP_NOTOK;
+		else if (y && !y->record_id) {
+			/* Created, update it next time, or look it up */
+			if (!json_get_int(&js, 0, "record.record_id", &id) && id > 0)
+				y->id[alias - info->alias] = id;
+			else
+				y->loaded = 0;
+		}
+		json_free(&js);
+	}
 
-	DO(http_status_valid(trans->status));
-	if (success(resp))
-		return 0;
+	/* Records may have been changed, fetch the list again */
+	if (rc && y)
+		y->loaded = 0;
 
-	return RC_DDNS_RSP_NOTOK;
+	return rc;
 }
 
-PLUGIN_INIT(plugin_init)
-{
-	plugin_register(&plugin, YANDEX_POST_REQUEST);
-}
+PLUGIN_REGISTER(plugin, YANDEX_POST_REQUEST);
+
 
-PLUGIN_EXIT(plugin_exit)
-{
-	plugin_unregister(&plugin);
-}
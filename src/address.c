@@ -0,0 +1,274 @@
+/* Address parsers and validator
+ *
+ * Copyright (C) 2003-2004  Narcis Ilisei <inarcis2002@hotpop.com>
+ * Copyright (C) 2006       Steve Horbachuk
+ * Copyright (C) 2010-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "address.h"
+#include "ddns.h"
+#include "log.h"
+
+/* Parse @str, IPv6 if it has a colon, the same test as plugins use */
+int addr_parse(ddns_addr_t *addr, const char *str)
+{
+	int family = strchr(str, ':') ? AF_INET6 : AF_INET;
+
+	memset(addr, 0, sizeof(*addr));
+	if (inet_pton(family, str, &addr->in6) != 1) {
+		addr->family = AF_UNSPEC;
+		return -1;
+	}
+	addr->family = family;
+
+	return 0;
+}
+
+/*
+ * Cloudflare would return requested hostname before client's ip address
+ * block cloudflare ips so that https://1.1.1.1/cdn-cgi/trace would work
+ * even if 1.1.1.1 is the first ip in the response body
+ */
+static int is_excepted(const ddns_addr_t *addr)
+{
+	static const unsigned char except4[][4] = {
+		{ 1, 1, 1, 1 }, { 1, 0, 0, 1 },
+		{ 1, 1, 1, 2 }, { 1, 0, 0, 2 },
+		{ 1, 1, 1, 3 }, { 1, 0, 0, 3 },
+	};
+	/* 2606:4700:4700::XXXX */
+	static const unsigned char prefix6[14] = { 0x26, 0x06, 0x47, 0x00, 0x47, 0x00 };
+	static const unsigned short except6[] = {
+		0x1111, 0x1001, 0x1112, 0x1002, 0x1113, 0x1003, 0x64, 0x6400
+	};
+	size_t i;
+
+	if (addr->family == AF_INET) {
+		for (i = 0; i < NELEMS(except4); i++) {
+			if (!memcmp(&addr->in, except4[i], 4))
+				return 1;
+		}
+
+		return 0;
+	}
+
+	if (memcmp(&addr->in6, prefix6, sizeof(prefix6)))
+		return 0;
+
+	for (i = 0; i < NELEMS(except6); i++) {
+		if (addr->in6.s6_addr[14] == except6[i] >> 8 && addr->in6.s6_addr[15] == (except6[i] & 0xff))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * IP address validator, discards empty, local, loopback and other
+ * globally invalid addresses
+ */
+int is_addr_valid(const ddns_addr_t *addr)
+{
+	char host[INET6_ADDRSTRLEN] = "";
+
+	if (addr->family != AF_INET && addr->family != AF_INET6)
+		return 0;
+
+	if (is_excepted(addr))
+		return 0;
+
+	inet_ntop(addr->family, &addr->in6, host, sizeof(host));
+	if (!verify_addr) {
+		logit(LOG_DEBUG, "IP address validation disabled, %s is thus valid.", host);
+		return 1;
+	}
+
+	if (addr->family == AF_INET) {
+		in_addr_t a = ntohl(addr->in.s_addr);
+
+		if (IN_ZERONET(a)   || IN_LOOPBACK(a) || IN_LINKLOCAL(a) ||
+		    IN_MULTICAST(a) || IN_EXPERIMENTAL(a))
+			goto error;
+
+		logit(LOG_DEBUG, "IPv4 address %s is valid.", host);
+		return 1;
+	}
+
+	if (!allow_ipv6) {
+		logit(LOG_INFO, "IPv6 address disallowed, enable with 'allow-ipv6 = true'");
+		return 0;
+	}
+
+	if (IN6_IS_ADDR_UNSPECIFIED(&addr->in6) || IN6_IS_ADDR_LOOPBACK(&addr->in6) ||
+	    IN6_IS_ADDR_LINKLOCAL(&addr->in6)   || IN6_IS_ADDR_SITELOCAL(&addr->in6))
+		goto error;
+
+	logit(LOG_DEBUG, "IPv6 address %s is valid.", host);
+	return 1;
+
+error:
+	logit(LOG_WARNING, "IP%s address %s is not a valid Internet address.",
+	      addr->family == AF_INET ? "v4" : "v6", host);
+	return 0;
+}
+
+int is_address_valid(int family, const char *host)
+{
+	ddns_addr_t addr;
+
+	memset(&addr, 0, sizeof(addr));
+	if (inet_pton(family, host, &addr.in6) != 1) {
+		logit(LOG_WARNING, "IP%s address %s is not a valid Internet address.",
+		      family == AF_INET ? "v4" : family == AF_INET6 ? "v6" : "", host);
+		return 0;
+	}
+	addr.family = family;
+
+	return is_addr_valid(&addr);
+}
+
+/**
+ * alias_set_address - Set address of an alias
+ * @alias:   Alias to update
+ * @address: Address string, or empty to clear
+ *
+ * Keeps the binary address, for comparisons, and the string from it,
+ * in canonical form, for requests and logs.  Anything that does not
+ * parse is kept as is, as a string only.
+ */
+void alias_set_address(ddns_alias_t *alias, const char *address)
+{
+	if (addr_parse(&alias->addr, address) ||
+	    !inet_ntop(alias->addr.family, &alias->addr.in6, alias->address, sizeof(alias->address)))
+		strlcpy(alias->address, address, sizeof(alias->address));
+}
+
+int parse_ipv4_address(char *buffer, char *address, size_t len)
+{
+	int found = 0;
+	static const char *accept = "0123456789.";
+	char *needle, *haystack, *end;
+	struct in_addr  addr;
+
+	haystack = buffer;
+	needle   = haystack;
+	end      = haystack + strlen(haystack) - 1;
+	while (needle && haystack < end) {
+		char ch;
+		size_t num = 0;
+
+		needle = strpbrk(haystack, accept);
+		if (needle) {
+			num = strspn(needle, accept);
+			if (num) {
+				ch = needle[num];
+				needle[num] = 0;
+
+				if (inet_pton(AF_INET, needle, &addr) == 1) {
+					inet_ntop(AF_INET, &addr, address, len);
+					if (is_address_valid(AF_INET, address)) {
+						found = 1;
+						break;
+					}
+				}
+
+				needle[num] = ch;
+			}
+		}
+
+		/* nothing yet, skip to next search point */
+		haystack = needle + num + 1;
+	}
+
+	return found;
+}
+
+int parse_ipv6_address(char *buffer, char *address, size_t len)
+{
+	int found = 0;
+	static const char *accept = "0123456789abcdefABCDEF:";
+	char *needle, *haystack, *end;
+	struct in6_addr addr;
+
+	haystack = buffer;
+	needle   = haystack;
+	end      = haystack + strlen(haystack) - 1;
+	while (needle && haystack < end) {
+		char ch;
+		size_t num = 0;
+
+		needle = strpbrk(haystack, accept);
+		if (needle) {
+			num = strspn(needle, accept);
+			if (num) {
+				ch = needle[num];
+				needle[num] = 0;
+
+				if (inet_pton(AF_INET6, needle, &addr) == 1) {
+					inet_ntop(AF_INET6, &addr, address, len);
+					if (is_address_valid(AF_INET6, address)) {
+						found = 1;
+						break;
+					}
+				}
+
+				needle[num] = ch;
+			}
+		}
+
+		/* nothing yet, skip to next search point */
+		haystack = needle + num + 1;
+	}
+
+	return found;
+}
+
+int parse_my_address(char *buffer, char *address, size_t len)
+{
+	if (parse_ipv6_address(buffer, address, len))
+		return 0;
+
+	return !parse_ipv4_address(buffer, address, len);
+}
+
+/* Like parse_my_address(), but only addresses of @family, unless AF_UNSPEC */
+int parse_family_address(int family, char *buffer, char *address, size_t len)
+{
+	switch (family) {
+	case AF_INET:
+		return !parse_ipv4_address(buffer, address, len);
+	case AF_INET6:
+		return !parse_ipv6_address(buffer, address, len);
+	default:
+		break;
+	}
+
+	return parse_my_address(buffer, address, len);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
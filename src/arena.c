@@ -0,0 +1,266 @@
+/* Per-cycle arena for short-lived allocations
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Plugins make a handful of short-lived allocations every cycle: JSON
+ * tokens of large responses, API keys fetched during setup, batched
+ * request bodies.  On a long-running router, with a simple malloc, such
+ * temporaries of varying sizes fragment the heap.  Instead they bump
+ * allocate from ctx->arena, which the core resets after each cycle, so
+ * nothing is freed individually.  If a cycle needed more than the first
+ * block, the blocks are replaced by one of the size of them all, so in
+ * steady state a cycle uses one block and no calls to malloc at all.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "resource.h"
+
+MEM_TAG("arena");
+
+#define ALIGN		16
+#define ALIGNED(len)	(((len) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+#define HEADER		ALIGNED(sizeof(struct block))
+
+struct block {
+	struct block *next;
+	size_t        size;		/* Of data, after the header */
+	size_t        used;
+};
+
+struct arena {
+	pthread_mutex_t  lock;		/* Shared by parallel update workers */
+	struct block    *head;		/* Current block, older ones follow */
+	char            *last;		/* Last allocation, for arena_realloc() */
+	size_t           total;		/* Allocated since last reset */
+};
+
+static struct block *block_new(size_t len)
+{
+	struct block *b;
+
+	if (len < ARENA_BLOCK_SIZE)
+		len = ARENA_BLOCK_SIZE;
+	len = ALIGNED(len);
+
+	b = mem_malloc(HEADER + len);
+	if (!b)
+		return NULL;
+
+	b->next = NULL;
+	b->size = len;
+	b->used = 0;
+
+	return b;
+}
+
+static void block_free(struct block *b)
+{
+	while (b) {
+		struct block *next = b->next;
+
+		mem_free(b);
+		b = next;
+	}
+}
+
+arena_t *arena_new(void)
+{
+	arena_t *arena;
+
+	arena = mem_calloc(1, sizeof(*arena));
+	if (!arena)
+		return NULL;
+
+	arena->head = block_new(ARENA_BLOCK_SIZE);
+	if (!arena->head) {
+		mem_free(arena);
+		return NULL;
+	}
+	pthread_mutex_init(&arena->lock, NULL);
+
+	return arena;
+}
+
+void arena_free(arena_t *arena)
+{
+	if (!arena)
+		return;
+
+	block_free(arena->head);
+	pthread_mutex_destroy(&arena->lock);
+	mem_free(arena);
+}
+
+/* Called with lock held */
+static void *alloc(arena_t *arena, size_t len)
+{
+	struct block *b = arena->head;
+	char *ptr;
+
+	len = ALIGNED(len ? len : 1);
+	if (b->size - b->used < len) {
+		b = block_new(len);
+		if (!b)
+			return NULL;
+
+		b->next     = arena->head;
+		arena->head = b;
+	}
+
+	ptr = (char *)b + HEADER + b->used;
+	b->used      += len;
+	arena->total += len;
+	arena->last   = ptr;
+
+	return ptr;
+}
+
+/**
+ * arena_alloc - Allocate memory that lives until the end of the cycle
+ * @arena: Arena, from ctx->arena
+ * @len:   Size in bytes
+ *
+ * The memory is not cleared, and must not be passed to free(), it is
+ * released by arena_reset().
+ *
+ * Returns:
+ * Pointer to @len bytes, or %NULL if out of memory.
+ */
+void *arena_alloc(arena_t *arena, size_t len)
+{
+	void *ptr;
+
+	if (!arena)
+		return NULL;
+
+	pthread_mutex_lock(&arena->lock);
+	ptr = alloc(arena, len);
+	pthread_mutex_unlock(&arena->lock);
+
+	return ptr;
+}
+
+/**
+ * arena_realloc - Grow an allocation
+ * @arena: Arena @ptr was allocated from
+ * @ptr:   Allocation, or %NULL for a new one
+ * @old:   Current size of @ptr
+ * @len:   New size in bytes
+ *
+ * The last allocation grows in place, if there is room in its block,
+ * otherwise the contents is copied to a new allocation.
+ *
+ * Returns:
+ * Pointer to @len bytes, or %NULL if out of memory, @ptr is then left
+ * as-is.
+ */
+void *arena_realloc(arena_t *arena, void *ptr, size_t old, size_t len)
+{
+	struct block *b;
+	void *p;
+
+	if (!arena)
+		return NULL;
+
+	pthread_mutex_lock(&arena->lock);
+	b = arena->head;
+	if (ptr && ptr == arena->last && len >= old) {
+		size_t start = (char *)ptr - ((char *)b + HEADER);
+
+		if (b->size - start >= ALIGNED(len)) {
+			arena->total += ALIGNED(len) - (b->used - start);
+			b->used       = start + ALIGNED(len);
+			pthread_mutex_unlock(&arena->lock);
+			return ptr;
+		}
+	}
+
+	p = alloc(arena, len);
+	if (p && ptr)
+		memcpy(p, ptr, old < len ? old : len);
+	pthread_mutex_unlock(&arena->lock);
+
+	return p;
+}
+
+char *arena_strdup(arena_t *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ptr;
+
+	ptr = arena_alloc(arena, len);
+	if (ptr)
+		memcpy(ptr, str, len);
+
+	return ptr;
+}
+
+/**
+ * arena_reset - Release everything allocated from the arena
+ * @arena: Arena, from ctx->arena
+ *
+ * Called by the core at the end of each cycle, when no plugin code is
+ * running.  Keeps one block, large enough for the whole cycle, up to
+ * %ARENA_MAX_KEEP.
+ */
+void arena_reset(arena_t *arena)
+{
+	struct block *b;
+
+	if (!arena)
+		return;
+
+	pthread_mutex_lock(&arena->lock);
+	b = arena->head;
+	if (b->next) {
+		size_t len = arena->total;
+
+		if (len > ARENA_MAX_KEEP)
+			len = ARENA_MAX_KEEP;
+
+		b = block_new(len);
+		if (b) {
+			block_free(arena->head);
+			arena->head = b;
+		} else {
+			/* Out of memory, keep the current block only */
+			b = arena->head;
+			block_free(b->next);
+			b->next = NULL;
+		}
+	}
+	b->used      = 0;
+	arena->last  = NULL;
+	arena->total = 0;
+	pthread_mutex_unlock(&arena->lock);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,161 @@
+/* Circuit breakers for failing DDNS and checkip servers
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * A server that is down costs a full connect, handshake, or timeout on
+ * every attempt.  Each DDNS server and checkip server has a circuit
+ * breaker, closed as long as the server replies.  After the threshold
+ * of failures in a row, circuit-breaker, the circuit opens and the
+ * server is skipped, without any attempt, for circuit-breaker-timeout.
+ * Then it is half-open, the next request is a probe.  A reply closes
+ * the circuit again, a failed probe opens it for twice as long as the
+ * last time, up to BREAKER_MAX_TIMEOUT.
+ *
+ * Only failures to get a reply count.  A server that replies, even to
+ * say no, is up, retry-later and bad credentials are handled elsewhere.
+ *
+ * Times are event_wall(), the counters and the time the circuit was
+ * opened are kept in the state file, see cache.c, so a restart does
+ * not start over with a server known to be down.
+ */
+
+#include <string.h>
+
+#include "breaker.h"
+#include "event.h"
+#include "log.h"
+
+int breaker_threshold = BREAKER_DEFAULT_THRESHOLD;
+int breaker_timeout   = BREAKER_DEFAULT_TIMEOUT;
+
+/* Time the circuit stays open, doubled for every failed probe */
+static int period(breaker_t *b)
+{
+	long long sec = breaker_timeout > 0 ? breaker_timeout : BREAKER_DEFAULT_TIMEOUT;
+	unsigned int n = b->trips > 1 ? b->trips - 1 : 0;
+
+	if (n > 12)
+		n = 12;
+	sec <<= n;
+	if (sec > BREAKER_MAX_TIMEOUT)
+		sec = BREAKER_MAX_TIMEOUT;
+
+	return (int)sec;
+}
+
+/**
+ * breaker_allow - May a request be sent to the server?
+ * @b:    Circuit breaker of the server
+ * @name: Server, for the log
+ *
+ * An open circuit that has timed out turns half-open, the request is
+ * then the probe.
+ *
+ * Returns:
+ * Non-zero if the request may be sent, zero if the server is skipped.
+ */
+int breaker_allow(breaker_t *b, const char *name)
+{
+	if (breaker_threshold <= 0 || b->state == BREAKER_CLOSED)
+		return 1;
+
+	if (b->state == BREAKER_OPEN) {
+		if (breaker_wait(b) > 0)
+			return 0;
+
+		logit(LOG_NOTICE, "Probing %s, failed %u times in a row.", name, b->fails);
+		b->state = BREAKER_HALF_OPEN;
+	}
+
+	return 1;
+}
+
+/* Same as breaker_allow(), without changing state, for pre-warming */
+int breaker_open(breaker_t *b)
+{
+	return breaker_threshold > 0 && b->state == BREAKER_OPEN && breaker_wait(b) > 0;
+}
+
+/* Time, in sec, until an open circuit is half-open, zero otherwise */
+int breaker_wait(breaker_t *b)
+{
+	time_t left;
+
+	if (b->state != BREAKER_OPEN)
+		return 0;
+
+	left = b->opened + period(b) - event_wall();
+	if (left < 0)
+		return 0;
+
+	return (int)left;
+}
+
+/**
+ * breaker_failure - Server did not reply
+ * @b:    Circuit breaker of the server
+ * @name: Server, for the log
+ *
+ * Returns:
+ * Non-zero if the circuit opened now.
+ */
+int breaker_failure(breaker_t *b, const char *name)
+{
+	b->fails++;
+	if (breaker_threshold <= 0 || b->state == BREAKER_OPEN)
+		return 0;
+	if (b->state == BREAKER_CLOSED && b->fails < (unsigned int)breaker_threshold)
+		return 0;
+
+	b->state  = BREAKER_OPEN;
+	b->opened = event_wall();
+	b->trips++;
+	logit(LOG_WARNING, "%s failed %u times in a row, skipping it for %d sec.",
+	      name, b->fails, period(b));
+
+	return 1;
+}
+
+/* Server replied, close the circuit */
+void breaker_success(breaker_t *b, const char *name)
+{
+	if (b->state != BREAKER_CLOSED)
+		logit(LOG_NOTICE, "%s is replying again, no longer skipped.", name);
+
+	memset(b, 0, sizeof(*b));
+}
+
+/* State from the state file, see cache.c */
+void breaker_restore(breaker_t *b, unsigned int fails, unsigned int trips, time_t opened)
+{
+	b->fails  = fails;
+	b->trips  = trips;
+	b->opened = opened;
+	b->state  = opened ? BREAKER_OPEN : BREAKER_CLOSED;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
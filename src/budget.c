@@ -0,0 +1,133 @@
+/* Cycle deadline and per-provider time budgets
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Every connect, handshake, and reply gets a full timeout, so without
+ * a bound a few providers that are down can stretch one cycle past the
+ * period.  The cycle has a deadline, cycle-deadline, and each provider
+ * a budget, provider-budget, for the time spent on it in a cycle, in
+ * address lookups, record verification, and updates together.
+ *
+ * The provider being worked on is set per thread, by budget_enter(),
+ * so the network code, which knows nothing of providers, can cut every
+ * timeout it sets short with budget_clamp().  What has not started when
+ * time is up is not started at all, see budget_expired(), the caller
+ * defers it to the next check.
+ */
+
+#include <pthread.h>
+
+#include "budget.h"
+#include "event.h"
+
+int budget_cycle_sec    = 0;
+int budget_provider_sec = 0;
+
+static pthread_key_t  key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static long long      cycle_until;	/* Set before any workers start */
+
+static void make_key(void)
+{
+	pthread_key_create(&key, NULL);
+}
+
+/* Deadline of the cycle, msec from event_msec(), or zero between cycles */
+void budget_cycle(long long until)
+{
+	cycle_until = until;
+}
+
+/* Start of a cycle, nothing spent yet of @sec, zero for no limit */
+void budget_reset(budget_t *b, int sec)
+{
+	b->limit = sec > 0 ? sec * 1000 : 0;
+	b->spent = 0;
+	b->start = 0;
+}
+
+/* Time spent by this thread, from now on, is spent by @b */
+void budget_enter(budget_t *b)
+{
+	pthread_once(&key_once, make_key);
+	b->start = event_msec();
+	pthread_setspecific(key, b);
+}
+
+void budget_leave(budget_t *b)
+{
+	b->spent += event_msec() - b->start;
+	b->start  = 0;
+	pthread_setspecific(key, NULL);
+}
+
+/**
+ * budget_deadline - When time is up for this thread
+ *
+ * The earliest of the cycle deadline and the end of the budget of the
+ * provider entered, if any.
+ *
+ * Returns:
+ * Deadline, msec from event_msec(), or zero if there is none.
+ */
+long long budget_deadline(void)
+{
+	long long until = cycle_until;
+	budget_t *b;
+
+	pthread_once(&key_once, make_key);
+	b = pthread_getspecific(key);
+	if (b && b->limit > 0) {
+		long long end = b->start + b->limit - b->spent;
+
+		if (!until || end < until)
+			until = end;
+	}
+
+	return until;
+}
+
+/* @deadline, or earlier if time is up before that */
+long long budget_clamp(long long deadline)
+{
+	long long until = budget_deadline();
+
+	if (until && until < deadline)
+		return until;
+
+	return deadline;
+}
+
+/* Time is up, for the cycle or the provider entered */
+int budget_expired(void)
+{
+	long long until = budget_deadline();
+
+	return until && event_msec() >= until;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,200 @@
+/* Shared pool of growable buffers
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Every transaction needs a request and a response buffer.  Most replies
+ * are a few hundred bytes, but some providers, e.g. Cloudflare, return
+ * record listings much larger than that.  Rather than every caller
+ * allocating a fixed size buffer, large enough for neither case, they
+ * borrow one from the pool and grow it on demand, up to BUF_MAX_SIZE.
+ * Returned buffers are kept, so in steady state nothing is allocated.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "bufpool.h"
+#include "resource.h"
+
+MEM_TAG("bufpool");
+
+struct buf_pool {
+	pthread_mutex_t  lock;	/* Shared by parallel update workers */
+	buf_t           *idle;
+	int              num;
+};
+
+buf_pool_t *buf_pool_new(void)
+{
+	buf_pool_t *pool;
+
+	pool = mem_calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pthread_mutex_init(&pool->lock, NULL);
+
+	return pool;
+}
+
+static void buf_free(buf_t *buf)
+{
+	mem_free(buf->data);
+	mem_free(buf);
+}
+
+void buf_pool_free(buf_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	while (pool->idle) {
+		buf_t *buf = pool->idle;
+
+		pool->idle = buf->next;
+		buf_free(buf);
+	}
+
+	pthread_mutex_destroy(&pool->lock);
+	mem_free(pool);
+}
+
+/**
+ * buf_get - Borrow a buffer from the pool
+ * @pool: Buffer pool, or %NULL to allocate a new buffer
+ * @size: Minimum size in bytes
+ *
+ * The contents of the buffer is undefined, only buf->data[0] is
+ * cleared.  Return the buffer with buf_put() when done.
+ *
+ * Returns:
+ * A buffer of at least @size bytes, or %NULL if out of memory.
+ */
+buf_t *buf_get(buf_pool_t *pool, size_t size)
+{
+	buf_t *buf = NULL, **pos;
+
+	if (size < BUF_MIN_SIZE)
+		size = BUF_MIN_SIZE;
+
+	if (pool) {
+		pthread_mutex_lock(&pool->lock);
+		for (pos = &pool->idle; *pos; pos = &(*pos)->next) {
+			if ((*pos)->size >= size)
+				break;
+		}
+
+		/* None big enough, grow the first idle one instead */
+		if (!*pos)
+			pos = &pool->idle;
+
+		buf = *pos;
+		if (buf) {
+			*pos = buf->next;
+			pool->num--;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	if (!buf) {
+		buf = mem_calloc(1, sizeof(*buf));
+		if (!buf)
+			return NULL;
+	}
+	buf->next = NULL;
+
+	if (buf_grow(buf, size)) {
+		buf_free(buf);
+		return NULL;
+	}
+	buf->data[0] = 0;
+
+	return buf;
+}
+
+/**
+ * buf_put - Return a buffer to the pool
+ * @pool: Buffer pool @buf was borrowed from, or %NULL
+ * @buf:  Buffer from buf_get(), may be %NULL
+ */
+void buf_put(buf_pool_t *pool, buf_t *buf)
+{
+	if (!buf)
+		return;
+
+	if (pool) {
+		pthread_mutex_lock(&pool->lock);
+		if (pool->num < BUF_POOL_SIZE) {
+			buf->next  = pool->idle;
+			pool->idle = buf;
+			pool->num++;
+			buf = NULL;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	if (buf)
+		buf_free(buf);
+}
+
+/**
+ * buf_grow - Make sure a buffer is at least @size bytes
+ * @buf:  Buffer from buf_get()
+ * @size: New minimum size, in bytes
+ *
+ * Buffers grow in powers of two, up to %BUF_MAX_SIZE.  The contents is
+ * preserved, but buf->data may move.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if @size exceeds the cap or out of memory.
+ */
+int buf_grow(buf_t *buf, size_t size)
+{
+	size_t len;
+	char *data;
+
+	if (buf->size >= size)
+		return 0;
+	if (size > BUF_MAX_SIZE)
+		return 1;
+
+	for (len = buf->size ? buf->size : BUF_MIN_SIZE; len < size; len *= 2)
+		;
+	if (len > BUF_MAX_SIZE)
+		len = BUF_MAX_SIZE;
+
+	data = mem_realloc(buf->data, len);
+	if (!data)
+		return 1;
+
+	buf->data = data;
+	buf->size = len;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
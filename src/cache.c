@@ -27,10 +27,35 @@
  * inadyn records each DNS entry to be updated in its own cache file,
  * enabling individual updates and tracking the file MTIME better.
  *
- * At startup inadyn will fall back to the old cache file and remove it
- * once it has read the IP and the modification time.
+ * One file per record does not scale either, on flash-backed routers
+ * with many hostnames every update is a small write and a new inode.
+ * So all records now live in a single state file, a header followed by
+ * fixed size records, read in one go at startup and replaced atomically
+ * by writing a temporary file and renaming it over the old one.  Apart
+ * from the address, the records also hold the time of the last update,
+ * the number of failed updates in a row, any provider record IDs, the
+ * last address changes seen, and the checkip reply time, the history
+ * used by adaptive-period.  Last, the circuit breakers of the DDNS and
+ * checkip servers, see breaker.c, so servers known to be down are still
+ * skipped after a restart.  Older files, version 1 without the history
+ * and version 2 without the breakers, are converted when read.
+ *
+ * Successful updates only mark the state as changed, it is written
+ * once at the end of each cycle by cache_flush(), and only if the
+ * content differs from what is already on disk.  How hard we try to
+ * get it onto the disk is set by the cache-sync option: not at all,
+ * fsync() once per cycle, or write and fsync() on every update.
+ *
+ * At startup inadyn falls back to the per-record .cache files, using
+ * the IP and the modification time, and removes them once they have
+ * been imported into the state file.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -39,76 +64,661 @@
 
 #include "ddns.h"
 #include "cache.h"
+#include "probe.h"
+#include "resolver.h"
+#include "trace.h"
+
+#define CACHE_MAGIC       0x494e4459	/* "INDY" */
+#define CACHE_VERSION     3
+#define CACHE_SYSNAME_LEN 64
+#define CACHE_ADDRESS_LEN 48		/* Same on all platforms */
+#define CACHE_HISTORY     8		/* Address changes per record */
+#define CACHE_CHECKIP     5		/* Circuit breakers of checkip servers */
+
+#define CACHE_SEED_THREADS 8
+#define CACHE_SEED_TIMEOUT 15		/* sec, for all seed lookups */
+
+struct cache_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reclen;		/* sizeof(struct cache_rec) */
+	uint32_t count;
+	uint32_t reserved;
+};
+
+/* Version 1 and 2, prefixes of the current record */
+struct cache_rec_v1 {
+	char     sysname[CACHE_SYSNAME_LEN];
+	char     name[SERVER_NAME_LEN];
+	char     address[CACHE_ADDRESS_LEN];
+	char     id[DDNS_ID_LEN];
+	int64_t  last_update;
+	uint32_t fails;
+	uint32_t reserved;
+};
+
+struct cache_rec_v2 {
+	char     sysname[CACHE_SYSNAME_LEN];
+	char     name[SERVER_NAME_LEN];
+	char     address[CACHE_ADDRESS_LEN];
+	char     id[DDNS_ID_LEN];
+	int64_t  last_update;
+	uint32_t fails;
+	uint32_t rtt;			/* msec, checkip reply time */
+	int64_t  changed[CACHE_HISTORY];
+};
+
+/* Circuit breaker, @id tells checkip servers apart, see breaker_id() */
+struct cache_breaker {
+	uint32_t id;
+	uint32_t fails;
+	uint32_t trips;
+	uint32_t reserved;
+	int64_t  opened;
+};
+
+struct cache_rec {
+	char     sysname[CACHE_SYSNAME_LEN];
+	char     name[SERVER_NAME_LEN];
+	char     address[CACHE_ADDRESS_LEN];
+	char     id[DDNS_ID_LEN];
+	int64_t  last_update;
+	uint32_t fails;
+	uint32_t rtt;			/* msec, checkip reply time */
+	int64_t  changed[CACHE_HISTORY];
+	struct cache_breaker server;	/* Of the provider */
+	struct cache_breaker checkip[CACHE_CHECKIP];
+};
+
+int           cache_sync = CACHE_SYNC_CYCLE;
+
+static char  *saved;			/* Last written, or loaded, state */
+static size_t saved_len;
+static int    dirty;
+
+static cache_stats_t stats;
 
 extern ddns_info_t *conf_info_iterator(int first);
 
-static int nslookup(ddns_alias_t *alias)
+/*
+ * Without a cached address, the DNS is asked what the hostname points
+ * to today.  On a fresh install with many hostnames, and a slow DNS,
+ * doing that one getaddrinfo() at a time can take minutes, so all are
+ * resolved concurrently by a few detached threads.  The main thread
+ * waits at most CACHE_SEED_TIMEOUT for them, any lookups still pending
+ * are left behind.  The pool is reference counted, whoever is last to
+ * let go of it, the main thread or a straggling worker, frees it.
+ */
+struct seed_job {
+	char          name[SERVER_NAME_LEN];
+	int           family;
+	int           done;
+	int           error;		/* EAI_*, zero on success */
+	char          address[MAX_ADDRESS_LEN];
+	ddns_alias_t *alias;		/* Only touched by the main thread */
+};
+
+struct seed_pool {
+	pthread_mutex_t  lock;
+	pthread_cond_t   cond;
+	int              refs;
+	size_t           num;
+	size_t           next;
+	size_t           done;
+	struct seed_job  jobs[];
+};
+
+static int nslookup(const char *name, int family, char *address, size_t len)
 {
 	int error;
 	struct addrinfo hints;
 	struct addrinfo *result;
 
 	memset(&hints, 0, sizeof(struct addrinfo));
-	hints.ai_family = AF_INET;	/* IPv4 */
+	hints.ai_family = family;	/* IPv4 or IPv6 */
 	hints.ai_socktype = SOCK_DGRAM;	/* Datagram socket */
 	hints.ai_flags = 0;
 	hints.ai_protocol = 0;          /* Any protocol */
 
-	error = getaddrinfo(alias->name, NULL, &hints, &result);
-	if (!error) {
+	error = getaddrinfo(name, NULL, &hints, &result);
+	if (error)
+		return error;
+
+	/* DNS reply for alias found, convert to IP# */
+	error = getnameinfo(result->ai_addr, result->ai_addrlen, address, len, NULL, 0, NI_NUMERICHOST);
+	freeaddrinfo(result);
+
+	return error;
+}
+
+static void seed_release(struct seed_pool *pool)
+{
+	int refs;
+
+	pthread_mutex_lock(&pool->lock);
+	refs = --pool->refs;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (refs)
+		return;
+
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+static void *seed_worker(void *arg)
+{
+	struct seed_pool *pool = (struct seed_pool *)arg;
+
+	while (1) {
 		char address[MAX_ADDRESS_LEN];
+		struct seed_job *job = NULL;
+		int error;
+
+		pthread_mutex_lock(&pool->lock);
+		if (pool->next < pool->num)
+			job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!job)
+			break;
+
+		error = nslookup(job->name, job->family, address, sizeof(address));
+
+		pthread_mutex_lock(&pool->lock);
+		job->error = error;
+		if (!error)
+			strlcpy(job->address, address, sizeof(job->address));
+		job->done = 1;
+		pool->done++;
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
 
-		/* DNS reply for alias found, convert to IP# */
-		if (!getnameinfo(result->ai_addr, result->ai_addrlen, address, sizeof(address), NULL, 0, NI_NUMERICHOST)) {
-			/* Update local record for next checkip call. */
-			alias->last_update = 0;
-			strlcpy(alias->address, address, sizeof(alias->address));
-			logit(LOG_INFO, "Resolving hostname %s => IP# %s", alias->name, address);
+	seed_release(pool);
+
+	return NULL;
+}
+
+static int seed_start(struct seed_pool *pool)
+{
+	pthread_t tid;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->refs++;
+	pthread_mutex_unlock(&pool->lock);
+
+	if (pthread_create(&tid, NULL, seed_worker, pool)) {
+		pthread_mutex_lock(&pool->lock);
+		pool->refs--;
+		pthread_mutex_unlock(&pool->lock);
+		return 1;
+	}
+	pthread_detach(tid);
+
+	return 0;
+}
+
+/* Same as the threads, but pipelined over the DNS-over-HTTPS resolver */
+static int seed_resolver(struct seed_pool *pool)
+{
+	resolver_query_t *query;
+	size_t i;
+
+	query = calloc(pool->num, sizeof(*query));
+	if (!query)
+		return 1;
+
+	for (i = 0; i < pool->num; i++) {
+		query[i].name   = pool->jobs[i].name;
+		query[i].family = pool->jobs[i].family;
+	}
+	resolver_lookup(query, pool->num, CACHE_SEED_TIMEOUT * 1000);
+
+	for (i = 0; i < pool->num; i++) {
+		ddns_alias_t *alias = pool->jobs[i].alias;
+
+		if (query[i].rc) {
+			logit(LOG_WARNING, "Failed resolving hostname %s: %s", alias->name,
+			      error_str(query[i].rc));
+			continue;
 		}
 
-		freeaddrinfo(result);
-		return 0;
+		alias->last_update = 0;
+		alias_set_address(alias, query[i].address);
+		logit(LOG_INFO, "Resolving hostname %s => IP# %s", alias->name, query[i].address);
 	}
+	free(query);
 
-	logit(LOG_WARNING, "Failed resolving hostname %s: %s", alias->name, gai_strerror(error));
+	return 0;
+}
 
-	return 1;
+/* Seed the address of all aliases in @pool from DNS, takes over @pool */
+static void seed(struct seed_pool *pool)
+{
+	struct timespec deadline;
+	size_t i, num_workers = 0;
+
+	if (!pool->num || (resolver_enabled() && !seed_resolver(pool))) {
+		seed_release(pool);
+		return;
+	}
+
+	while (num_workers < CACHE_SEED_THREADS && num_workers < pool->num) {
+		if (seed_start(pool))
+			break;
+		num_workers++;
+	}
+
+	logit(LOG_DEBUG, "Resolving %zu hostnames using %zu threads", pool->num, num_workers);
+	if (!num_workers) {
+		logit(LOG_WARNING, "Failed starting DNS lookup threads, resolving one by one.");
+		pool->refs++;
+		seed_worker(pool);
+	}
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += CACHE_SEED_TIMEOUT;
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->done < pool->num) {
+		if (pthread_cond_timedwait(&pool->cond, &pool->lock, &deadline) == ETIMEDOUT)
+			break;
+	}
+
+	for (i = 0; i < pool->num; i++) {
+		struct seed_job *job = &pool->jobs[i];
+		ddns_alias_t *alias = job->alias;
+
+		if (!job->done) {
+			logit(LOG_WARNING, "Timed out resolving hostname %s", alias->name);
+			continue;
+		}
+
+		if (job->error) {
+			logit(LOG_WARNING, "Failed resolving hostname %s: %s", alias->name,
+			      gai_strerror(job->error));
+			continue;
+		}
+
+		/* Update local record for next checkip call. */
+		alias->last_update = 0;
+		alias_set_address(alias, job->address);
+		logit(LOG_INFO, "Resolving hostname %s => IP# %s", alias->name, job->address);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	seed_release(pool);
+}
+
+/* Legacy per-record cache file, returns 1 if found */
+/*
+ * Records are keyed by provider and hostname.  The AAAA aliases of a
+ * dual-stack provider are stored as if they belonged to the IPv6 flavor
+ * of the provider, e.g., ipv6@dyndns.org, so a setup with one provider
+ * entry per family can be converted without losing the cached state.
+ */
+static const char *rec_sysname(ddns_info_t *info, ddns_alias_t *alias, char *buf, size_t len)
+{
+	const char *name = info->system->name;
+	const char *at;
+
+	if (!info->dual_stack || alias->family != AF_INET6)
+		return name;
+
+	at = strchr(name, '@');
+	snprintf(buf, len, "ipv6@%s", at ? at + 1 : name);
+
+	return buf;
 }
 
-static void read_one(ddns_alias_t *alias, const char *name, int nonslookup)
+static int read_one(ddns_alias_t *alias, const char *name)
 {
 	FILE *fp;
 	char path[256];
-
-	alias->last_update = 0;
-	memset(alias->address, 0, sizeof(alias->address));
+	struct stat st;
+	char address[MAX_ADDRESS_LEN];
 
 	cache_file(alias->name, name, path, sizeof(path));
 	fp = fopen(path, "r");
-	if (!fp) {
-		/* Exception for dnsomatic's special global hostname */
-		if (nonslookup || !strncmp(alias->name, "all.dnsomatic.com", sizeof(alias->name)))
-			return;
-
-		/* Try a DNS lookup of our last known IP#. */
-		nslookup(alias);
-	} else {
-		struct stat st;
-		char address[MAX_ADDRESS_LEN];
+	if (!fp)
+		return 0;
 
-		if (fgets(address, sizeof(address), fp)) {
-			logit(LOG_INFO, "Cached IP# %s for %s from previous invocation.", address, alias->name);
-			strlcpy(alias->address, address, sizeof(alias->address));
-		}
+	if (fgets(address, sizeof(address), fp)) {
+		address[strcspn(address, "\r\n")] = 0;
+		logit(LOG_INFO, "Cached IP# %s for %s from previous invocation.", address, alias->name);
+		alias_set_address(alias, address);
+	}
+
+	/* Initialize time since last update from modification time of cache file. */
+	if (!fstat(fileno(fp), &st)) {
+		alias->last_update = st.st_mtime;
+		logit(LOG_INFO, "Last update of %s on %s", alias->name, ctime(&st.st_mtime));
+	}
+
+	fclose(fp);
+
+	return 1;
+}
+
+static char *state_file(char *buf, size_t len)
+{
+	if (snprintf(buf, len, "%s/%s.state", cache_dir, ident) >= (int)len)
+		logit(LOG_WARNING, "Too long name for buffer: '%s/' + '%s' + '.state'", cache_dir, ident);
+
+	return buf;
+}
+
+/* Older state in @old, freed, to current records in @data, new fields zeroed */
+static int convert(char *old, char **data)
+{
+	struct cache_hdr *hdr = (struct cache_hdr *)old;
+	struct cache_rec *rec;
+	uint16_t version = hdr->version;
+	uint32_t i;
+	char *buf;
+
+	buf = calloc(1, sizeof(*hdr) + (size_t)hdr->count * sizeof(*rec));
+	if (!buf) {
+		free(old);
+		return -1;
+	}
+
+	memcpy(buf, hdr, sizeof(*hdr));
+	rec = (struct cache_rec *)(buf + sizeof(*hdr));
+	for (i = 0; i < hdr->count; i++) {
+		memcpy(&rec[i], old + sizeof(*hdr) + (size_t)i * hdr->reclen, hdr->reclen);
+		if (version == 1)
+			rec[i].rtt = 0;
+	}
+
+	hdr = (struct cache_hdr *)buf;
+	hdr->version = CACHE_VERSION;
+	hdr->reclen  = sizeof(*rec);
+	free(old);
+
+	logit(LOG_INFO, "Converting version %u state file, %u records.", version, hdr->count);
+	*data = buf;
+
+	return hdr->count;
+}
+
+/* Is @len bytes from load() a state file of @version, with records of @reclen? */
+static int is_version(struct cache_hdr *hdr, size_t len, uint16_t version, size_t reclen)
+{
+	return hdr->magic == CACHE_MAGIC && hdr->version == version && hdr->reclen == reclen &&
+		sizeof(*hdr) + (size_t)hdr->count * reclen == len;
+}
+
+/* Read the whole state file into @data, returns number of records or -1 */
+static int load(char **data)
+{
+	struct cache_hdr *hdr;
+	struct stat st;
+	char path[256];
+	char *buf;
+	ssize_t len;
+	int fd;
+
+	*data = NULL;
+
+	fd = open(state_file(path, sizeof(path)), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) || (size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+
+	buf = malloc(st.st_size);
+	if (!buf) {
+		close(fd);
+		return -1;
+	}
+
+	len = read(fd, buf, st.st_size);
+	close(fd);
+
+	hdr = (struct cache_hdr *)buf;
+	if (len == st.st_size && (is_version(hdr, len, 1, sizeof(struct cache_rec_v1)) ||
+				  is_version(hdr, len, 2, sizeof(struct cache_rec_v2))))
+		return convert(buf, data);
+
+	if (len != st.st_size || !is_version(hdr, len, CACHE_VERSION, sizeof(struct cache_rec))) {
+		logit(LOG_WARNING, "Ignoring invalid, or incompatible, state file %s", path);
+		free(buf);
+		return -1;
+	}
+
+	*data = buf;
+
+	return hdr->count;
+}
+
+static struct cache_rec *find(char *data, int num, const char *sysname, const char *name)
+{
+	struct cache_rec *rec;
+	int i;
+
+	if (!data)
+		return NULL;
+
+	rec = (struct cache_rec *)(data + sizeof(struct cache_hdr));
+	for (i = 0; i < num; i++, rec++) {
+		if (!strncmp(rec->sysname, sysname, sizeof(rec->sysname)) &&
+		    !strncmp(rec->name, name, sizeof(rec->name)))
+			return rec;
+	}
+
+	return NULL;
+}
+
+/* Only records that carry something worth remembering are stored */
+static int worth_saving(ddns_info_t *info, ddns_alias_t *alias)
+{
+	size_t i;
 
-		/* Initialize time since last update from modification time of cache file. */
-		if (!fstat(fileno(fp), &st)) {
-			alias->last_update = st.st_mtime;
-			logit(LOG_INFO, "Last update of %s on %s", alias->name, ctime(&st.st_mtime));
+	if (alias->last_update || alias->id[0] || alias->fails || alias->changed[0])
+		return 1;
+
+	if (info->breaker.fails)
+		return 1;
+	for (i = 0; i < info->checkip_num; i++) {
+		if (info->checkip[i].breaker.fails)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Tells checkip servers apart, in case the configured list changes */
+static uint32_t breaker_id(ddns_checkip_t *srv)
+{
+	char buf[SERVER_NAME_LEN + SERVER_URL_LEN + 16];
+	uint32_t id = 2166136261u;	/* FNV-1a */
+	char *ptr;
+
+	snprintf(buf, sizeof(buf), "%s:%d%s", srv->name.name, srv->name.port, srv->url);
+	for (ptr = buf; *ptr; ptr++)
+		id = (id ^ (unsigned char)*ptr) * 16777619u;
+
+	return id;
+}
+
+static void save_breaker(struct cache_breaker *rec, breaker_t *b, uint32_t id)
+{
+	rec->id     = id;
+	rec->fails  = b->fails;
+	rec->trips  = b->trips;
+	rec->opened = b->state == BREAKER_CLOSED ? 0 : b->opened;
+}
+
+/* Unless already known, e.g. from the record of another alias */
+static void load_breaker(breaker_t *b, struct cache_breaker *rec)
+{
+	if (b->fails || !rec->fails)
+		return;
+
+	breaker_restore(b, rec->fails, rec->trips, rec->opened);
+}
+
+/* Reply time of the fastest checkip server of @info, zero if unknown */
+static int checkip_rtt(ddns_info_t *info)
+{
+	int rtt = 0;
+	size_t i;
+
+	for (i = 0; i < info->checkip_num; i++) {
+		ddns_checkip_t *srv = &info->checkip[i];
+
+		if (srv->rtt > 0 && (!rtt || srv->rtt < rtt))
+			rtt = srv->rtt;
+	}
+
+	return rtt;
+}
+
+/* Make the rename itself durable, not just the file content */
+static void sync_dir(const char *path)
+{
+	char dir[256], *ptr;
+	int fd;
+
+	strlcpy(dir, path, sizeof(dir));
+	ptr = strrchr(dir, '/');
+	if (!ptr)
+		return;
+	*ptr = 0;
+
+	fd = open(dir, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	fsync(fd);
+	close(fd);
+}
+
+/*
+ * Write all records to a temporary file next to the state file, then
+ * rename it over the old one.  A crash midway leaves either the old or
+ * the new state, never a mix of both.  With @sync the file, and the
+ * directory holding it, are also fsync()'ed before returning.
+ */
+static int save(int sync)
+{
+	struct cache_hdr *hdr;
+	struct cache_rec *rec;
+	ddns_info_t *info;
+	char path[256], tmp[268];
+	size_t num = 0, len;
+	ssize_t rc;
+	char *buf;
+	int fd;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		num += info->alias_count;
+		info = conf_info_iterator(0);
+	}
+
+	len = sizeof(*hdr) + num * sizeof(*rec);
+	buf = calloc(1, len);
+	if (!buf)
+		return RC_OUT_OF_MEMORY;
+
+	hdr = (struct cache_hdr *)buf;
+	rec = (struct cache_rec *)(buf + sizeof(*hdr));
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i, j;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+			char name[CACHE_SYSNAME_LEN];
+
+			if (!worth_saving(info, alias))
+				continue;
+
+			strlcpy(rec->sysname, rec_sysname(info, alias, name, sizeof(name)), sizeof(rec->sysname));
+			strlcpy(rec->name, alias->name, sizeof(rec->name));
+			if (alias->last_update)
+				strlcpy(rec->address, alias->address, sizeof(rec->address));
+			strlcpy(rec->id, alias->id, sizeof(rec->id));
+			rec->last_update = alias->last_update;
+			rec->fails       = alias->fails;
+			rec->rtt         = checkip_rtt(info);
+			for (j = 0; j < NELEMS(rec->changed) && j < NELEMS(alias->changed); j++)
+				rec->changed[j] = alias->changed[j];
+			save_breaker(&rec->server, &info->breaker, 0);
+			for (j = 0; j < NELEMS(rec->checkip) && j < info->checkip_num; j++)
+				save_breaker(&rec->checkip[j], &info->checkip[j].breaker,
+					     breaker_id(&info->checkip[j]));
+			rec++;
+			hdr->count++;
 		}
 
-		fclose(fp);
+		info = conf_info_iterator(0);
+	}
+
+	hdr->magic   = CACHE_MAGIC;
+	hdr->version = CACHE_VERSION;
+	hdr->reclen  = sizeof(*rec);
+	len = sizeof(*hdr) + hdr->count * sizeof(*rec);
+	dirty = 0;
+
+	/* Avoid wearing out the flash with the same data */
+	if (saved && saved_len == len && !memcmp(saved, buf, len)) {
+		logit(LOG_DEBUG, "State unchanged, skipping write.");
+		stats.skipped++;
+		free(buf);
+		return 0;
+	}
+
+	state_file(path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		logit(LOG_WARNING, "Failed creating %s: %s", tmp, strerror(errno));
+		stats.failed++;
+		free(buf);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	rc = write(fd, buf, len);
+	if (rc == (ssize_t)len && sync && fsync(fd))
+		rc = -1;
+	if (close(fd) || rc != (ssize_t)len) {
+		logit(LOG_WARNING, "Failed writing %s: %s", tmp, strerror(errno));
+		stats.failed++;
+		unlink(tmp);
+		free(buf);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	if (rename(tmp, path)) {
+		logit(LOG_WARNING, "Failed replacing %s: %s", path, strerror(errno));
+		stats.failed++;
+		unlink(tmp);
+		free(buf);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	if (sync) {
+		sync_dir(path);
+		stats.synced++;
 	}
+	stats.written++;
+	PROBE(cache__save, (int)hdr->count, sync);
+
+	free(saved);
+	saved     = buf;
+	saved_len = len;
+
+	return 0;
 }
 
 char *cache_file(char *name, const char *sysname, char *buf, size_t len)
@@ -122,16 +732,44 @@ char *cache_file(char *name, const char *sysname, char *buf, size_t len)
 	return buf;
 }
 
+/* Remove per-record cache files once imported into the state file */
+static void remove_legacy(void)
+{
+	ddns_info_t *info;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+			char name[CACHE_SYSNAME_LEN];
+			char path[256];
+
+			cache_file(alias->name, rec_sysname(info, alias, name, sizeof(name)), path, sizeof(path));
+			if (!unlink(path))
+				logit(LOG_DEBUG, "Imported, and removed, %s", path);
+		}
+
+		info = conf_info_iterator(0);
+	}
+}
+
 /*
  * At boot, or when restarting inadyn at runtime, the memory struct holding our
  * current IP# is empty.  We want to avoid unnecessary updates of our DDNS server
  * record, since we might get locked out for abuse, so we "seed" each of the DDNS
- * records of our struct with the cached IP# from our cache file, or from a regular
- * DNS query.
+ * records of our struct with the cached IP# from our state file, a legacy cache
+ * file, or from a regular DNS query.
  */
 int read_cache_file(ddns_t *ctx)
 {
+	struct seed_pool *pool;
 	ddns_info_t *info;
+	size_t total = 0;
+	char *data;
+	int imported = 0;
+	int num;
 
 	/*
 	 * Clear DNS cache before querying for the IP below, this to
@@ -143,6 +781,24 @@ int read_cache_file(ddns_t *ctx)
 	if (!ctx)
 		return RC_INVALID_POINTER;
 
+	num = load(&data);
+	dirty = 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		total += info->alias_count;
+		info = conf_info_iterator(0);
+	}
+
+	pool = calloc(1, sizeof(*pool) + total * sizeof(struct seed_job));
+	if (!pool) {
+		free(data);
+		return RC_OUT_OF_MEMORY;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	pool->refs = 1;
+
 	info = conf_info_iterator(1);
 	while (info) {
 		/* XXX: Possibly move this exception to each plugin */
@@ -151,9 +807,16 @@ int read_cache_file(ddns_t *ctx)
 			"default@tunnelbroker.net"
 		};
 		const char *name = info->system->name;
+		char sysname[CACHE_SYSNAME_LEN];
 		size_t i, j;
 		int nonslookup = 0;
 
+		/* Unchanged on reload, already seeded */
+		if (info->initialized) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
 		/* Exceptions -- no name to lookup */
 		for (i = 0; i < NELEMS(except); i++) {
 			if (!strncmp(name, except[i], strlen(name))) {
@@ -163,38 +826,152 @@ int read_cache_file(ddns_t *ctx)
 		}
 
 // XXX: TODO better plugin identifiction here
-		for (j = 0; j < info->alias_count; j++)
-			read_one(&info->alias[j], name, nonslookup);
+		for (j = 0; j < info->alias_count; j++) {
+			ddns_alias_t *alias = &info->alias[j];
+			const char *recname = rec_sysname(info, alias, sysname, sizeof(sysname));
+			struct cache_rec *rec;
+
+			alias->last_update = 0;
+			alias->fails       = 0;
+			alias_set_address(alias, "");
+			memset(alias->id, 0, sizeof(alias->id));
+			memset(alias->changed, 0, sizeof(alias->changed));
+
+			rec = find(data, num, recname, alias->name);
+			if (rec) {
+				size_t k;
+
+				strlcpy(alias->id, rec->id, sizeof(alias->id));
+				alias->fails = rec->fails;
+				for (k = 0; k < NELEMS(rec->changed) && k < NELEMS(alias->changed); k++)
+					alias->changed[k] = rec->changed[k];
+
+				/* Until measured again, for hedging, see checkip_delay() */
+				for (k = 0; k < info->checkip_num; k++) {
+					if (!info->checkip[k].rtt)
+						info->checkip[k].rtt = rec->rtt;
+				}
+
+				load_breaker(&info->breaker, &rec->server);
+				for (k = 0; k < info->checkip_num; k++) {
+					ddns_checkip_t *srv = &info->checkip[k];
+					size_t l;
+
+					for (l = 0; l < NELEMS(rec->checkip); l++) {
+						if (rec->checkip[l].fails && rec->checkip[l].id == breaker_id(srv))
+							load_breaker(&srv->breaker, &rec->checkip[l]);
+					}
+				}
+
+				if (rec->last_update) {
+					time_t when = rec->last_update;
+
+					alias_set_address(alias, rec->address);
+					alias->last_update = when;
+					logit(LOG_INFO, "Cached IP# %s for %s from previous invocation.",
+					      alias->address, alias->name);
+					logit(LOG_INFO, "Last update of %s on %s", alias->name, ctime(&when));
+					continue;
+				}
+			}
+
+			if (read_one(alias, recname)) {
+				imported++;
+				continue;
+			}
+
+			/* Exception for dnsomatic's special global hostname */
+			if (nonslookup || !strncmp(alias->name, "all.dnsomatic.com", sizeof(alias->name)))
+				continue;
+
+			/* One quick cycle, e.g. from a hotplug script, updates instead */
+			if (once)
+				continue;
+
+			/* Try a DNS lookup of our last known IP#, below. */
+			if (pool->num < total) {
+				struct seed_job *job = &pool->jobs[pool->num++];
+
+				strlcpy(job->name, alias->name, sizeof(job->name));
+				job->family = alias->family;
+				job->alias  = alias;
+			}
+		}
 
 		info = conf_info_iterator(0);
 	}
 
+	seed(pool);
+
+	free(saved);
+	saved     = data;
+	saved_len = data ? sizeof(struct cache_hdr) + num * sizeof(struct cache_rec) : 0;
+
+	if (imported) {
+		logit(LOG_NOTICE, "Importing %d legacy cache file(s) into state file.", imported);
+		if (!save(1))
+			remove_legacy();
+	}
+
 	return 0;
 }
 
 /*
- * Update cache with new IP
- * /var/cache/inadyn/my.server.name.cache { LAST-IPADDR } MTIME
+ * Update cache with new IP, and any provider IDs, of @alias.  All
+ * records are saved to the state file in one go, by cache_flush(),
+ * unless cache-sync is set to always.
+ * /var/cache/inadyn/inadyn.state { HDR, REC, ... }
  */
 int write_cache_file(ddns_alias_t *alias, const char *name)
 {
-	FILE *fp;
-	char path[256];	
+	long long t = trace_start();
+	int rc = 0;
 
-	cache_file(alias->name, name, path, sizeof(path));
-	fp = fopen(path, "w");
-	if (fp) {
-		if (strstr(name, "v6"))
-			logit(LOG_NOTICE, "Updating IPv6 cache for %s", alias->name);
-		else
-			logit(LOG_NOTICE, "Updating IPv4 cache for %s", alias->name);
-		fprintf(fp, "%s", alias->address);
-		fclose(fp);
+	PROBE(cache__write, alias->name, alias->address);
+	if (alias->family == AF_INET6)
+		logit(LOG_NOTICE, "Updating IPv6 cache for %s", alias->name);
+	else
+		logit(LOG_NOTICE, "Updating IPv4 cache for %s", alias->name);
+
+	dirty = 1;
+	if (cache_sync == CACHE_SYNC_ALWAYS)
+		rc = save(1) ? 1 : 0;
+	trace_span(t, "cache", "cache %s", alias->name);
+
+	return rc;
+}
+
+/* Mark state as changed, e.g. failure counters, without any logging */
+void cache_touch(void)
+{
+	dirty = 1;
+}
 
+/**
+ * cache_flush - Write state file, if changed, at the end of a cycle
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error writing the state file.
+ */
+int cache_flush(void)
+{
+	long long t;
+	int rc;
+
+	if (!dirty)
 		return 0;
-	}
 
-	return 1;
+	t  = trace_start();
+	rc = save(cache_sync != CACHE_SYNC_NONE);
+	trace_span(t, "cache", "save state file");
+
+	return rc;
+}
+
+/* State file write counters since startup, for the metrics exporter */
+const cache_stats_t *cache_stats(void)
+{
+	return &stats;
 }
 
 /**
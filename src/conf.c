@@ -17,11 +17,26 @@
 
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 #include <confuse.h>
 
+#include "breaker.h"
 #include "cache.h"
+#include "ctrl.h"
 #include "ddns.h"
+#include "discover.h"
+#include "gateway.h"
+#include "ha.h"
+#include "event.h"
+#include "hook.h"
+#include "ifmon.h"
+#include "metrics.h"
+#include "resource.h"
+#include "resolver.h"
+#include "share.h"
 #include "ssl.h"
+#include "trace.h"
 
 /*
  * period        = 600
@@ -45,6 +60,11 @@
  */
 static LIST_HEAD(head, di) info_list = LIST_HEAD_INITIALIZER(info_list);
 
+static cfg_t *active_cfg;		/* Parsed from active_file */
+static char  *active_file;
+
+extern int ddns_same_provider(ddns_info_t *a, ddns_info_t *b);
+
 static void conf_errfunc(cfg_t *cfg, const char *format, va_list args)
 {
 	char fmt[80];
@@ -116,19 +136,14 @@ static int validate_hostname(cfg_t *cfg, const char *provider, cfg_opt_t *hostna
 
 	for (i = 0; i < cfg_opt_size(hostname); i++) {
 		char *name = cfg_opt_getnstr(hostname, i);
-		ddns_info_t info;
+		ddns_alias_t alias;
 
-		if (sizeof(info.alias[0].name) < strlen(name)) {
+		if (sizeof(alias.name) < strlen(name)) {
 			cfg_error(cfg, "Too long DDNS hostname (%s) in provider %s", name, provider);
 			return -1;
 		}
 	}
 
-	if (i >= DDNS_MAX_ALIAS_NUMBER) {
-		cfg_error(cfg, "Too many hostname aliases, MAX %d supported!", DDNS_MAX_ALIAS_NUMBER);
-		return -1;
-	}
-
 	return 0;
 }
 
@@ -221,6 +236,43 @@ static int getserver(const char *server, ddns_name_t *name)
 	return 0;
 }
 
+/*
+ * Checkip server, "[http[s]://]name[:port][/path]", the scheme and path
+ * are optional and default to @ssl and @path.
+ */
+static int getcheckip(const char *server, const char *path, int ssl, ddns_checkip_t *srv)
+{
+	char str[SERVER_NAME_LEN + SERVER_URL_LEN], *ptr;
+
+	if (!strncasecmp(server, "https://", 8)) {
+		server += 8;
+		ssl = 1;
+	} else if (!strncasecmp(server, "http://", 7)) {
+		server += 7;
+		ssl = 0;
+	}
+
+	strlcpy(str, server, sizeof(str));
+	ptr = strchr(str, '/');
+	if (ptr) {
+		strlcpy(srv->url, ptr, sizeof(srv->url));
+		*ptr = 0;
+	} else {
+		strlcpy(srv->url, path, sizeof(srv->url));
+	}
+
+	if (!strcasecmp(str, "default")) {
+		strlcpy(srv->name.name, DDNS_MY_IP_SERVER, sizeof(srv->name.name));
+		strlcpy(srv->url, DDNS_MY_CHECKIP_URL, sizeof(srv->url));
+		srv->name.port = 0;
+	} else if (getserver(str, &srv->name)) {
+		return 1;
+	}
+	srv->ssl = ssl;
+
+	return 0;
+}
+
 static int cfg_getserver(cfg_t *cfg, char *server, ddns_name_t *name)
 {
 	const char *str;
@@ -232,87 +284,95 @@ static int cfg_getserver(cfg_t *cfg, char *server, ddns_name_t *name)
 	return getserver(str, name);
 }
 
-#if 0
-/* TODO: Move to a separate file */
-#define string_startswith(string, prefix) strncasecmp(string, prefix, strlen(prefix)) == 0
-
+/*
+ * Proxy, "scheme://name:port", where the scheme is one of socks5h,
+ * socks5, socks4a, socks4 (or socks), or http for HTTP CONNECT.
+ */
+#ifndef DROP_PROXY
 static int parseproxy(const char *proxy, tcp_proxy_type_t *type, ddns_name_t *name)
 {
-	int ret = 0;
-	char *tmp, *str, *host, *protocol;
-	int len;
-
-	tmp = str = strdup(proxy);
-
-	do {
-		tmp = strstr(str, "://");
-		if (tmp) {
-			host = tmp + 3;
-			if (string_startswith(str, "socks5h"))
-				*type = PROXY_SOCKS5_HOSTNAME;
-			else if (string_startswith(str, "socks5"))
-				*type = PROXY_SOCKS5;
-			else if (string_startswith(str, "socks4a"))
-				*type = PROXY_SOCKS4A;
-			else if (string_startswith(str, "socks4") || string_startswith(str, "socks"))
-				*type = PROXY_SOCKS4;
-			else {
-				len = tmp - str;
-				protocol = malloc(len + 2);
-				strncpy(protocol, str, len);
-				protocol[len + 1] = 0;
-				logit(LOG_ERR, "Unsupported proxy protocol '%s'.", protocol);
-				free(protocol);
-				ret = 1;
-				break;
-			}
-
-			tmp = strchr(host, ':');
-			if (tmp) {
-				*tmp++ = 0;
-				name->port = atonum(tmp);
-				if (-1 == name->port) {
-					logit(LOG_ERR, "Invalid proxy port.");
-					ret = 1;
-					break;
-				}
+	struct {
+		const char      *scheme;
+		tcp_proxy_type_t type;
+	} schemes[] = {
+		{ "socks5h://", PROXY_SOCKS5_HOSTNAME },
+		{ "socks5://",  PROXY_SOCKS5          },
+		{ "socks4a://", PROXY_SOCKS4A         },
+		{ "socks4://",  PROXY_SOCKS4          },
+		{ "socks://",   PROXY_SOCKS4          },
+		{ "http://",    PROXY_HTTP_CONNECT    },
+	};
+	const char *ptr;
+	size_t i;
 
-				strlcpy(name->name, host, sizeof(name->name));
-			} else {
-				logit(LOG_ERR, "No proxy port is specified.");
-				ret = 1;
-				break;
-			}
-		} else {
-			/* Currently we do not support http proxy. */
-//			*type = PROXY_HTTP;
-//			logit(LOG_WARNING, "No proxy protocol is specified, use http proxy.");
+	for (i = 0; i < NELEMS(schemes); i++) {
+		size_t len = strlen(schemes[i].scheme);
 
-			logit(LOG_WARNING, "No proxy protocol is specified.");
-			ret = 1;
+		if (!strncasecmp(proxy, schemes[i].scheme, len)) {
+			*type = schemes[i].type;
+			proxy += len;
 			break;
 		}
-	} while (0);
+	}
 
-	free(str);
-	return ret;
+	if (i == NELEMS(schemes)) {
+		logit(LOG_ERR, "Unsupported, or missing, proxy protocol in '%s'.", proxy);
+		return 1;
+	}
+
+	ptr = strchr(proxy, ':');
+	if (!ptr || atonum(ptr + 1) <= 0) {
+		logit(LOG_ERR, "Missing, or invalid, proxy port in '%s'.", proxy);
+		return 1;
+	}
+
+	if (getserver(proxy, name)) {
+		logit(LOG_ERR, "Invalid proxy '%s'.", proxy);
+		return 1;
+	}
+
+	return 0;
 }
+#endif
 
 static int cfg_parseproxy(cfg_t *cfg, char *server, tcp_proxy_type_t *type, ddns_name_t *name)
 {
 	const char *str;
 
+	*type = NO_PROXY;
+	memset(name, 0, sizeof(*name));
+
 	str = cfg_getstr(cfg, server);
 	if (!str)
-		return 1;
+		return 0;
 
+#ifdef DROP_PROXY
+	logit(LOG_ERR, "Built without proxy support, cannot use %s.", str);
+	return 1;
+#else
 	return parseproxy(str, type, name);
-}
 #endif
+}
+
+/* Per provider period, zero (unset) means use the global default */
+static int cfg_getperiod(cfg_t *cfg, const char *name)
+{
+	int val = cfg_getint(cfg, name);
+
+	if (val <= 0)
+		return 0;
+	if (val < DDNS_MIN_PERIOD)
+		return DDNS_MIN_PERIOD;
+	if (val > DDNS_MAX_PERIOD)
+		return DDNS_MAX_PERIOD;
+
+	return val;
+}
 
 static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 {
 	ddns_system_t *system;
+	ddns_checkip_t *srv;
 	const char *str;
 	size_t j;
 
@@ -333,14 +393,18 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 
 	info->system = system;
 
-	if (getserver(system->checkip_name, &info->checkip_name))
+	srv = &info->checkip[0];
+	if (getserver(system->checkip_name, &srv->name))
 		goto error;
-	if (strlen(system->checkip_url) > sizeof(info->checkip_url))
+	if (strlen(system->checkip_url) > sizeof(srv->url))
 		goto error;
-	strlcpy(info->checkip_url, system->checkip_url, sizeof(info->checkip_url));
+	strlcpy(srv->url, system->checkip_url, sizeof(srv->url));
+	info->checkip_num = 1;
 
 	if (getserver(system->server_name, &info->server_name))
 		goto error;
+	/* Required for custom, optional override for all others, e.g. rfc2136 */
+	cfg_getserver(cfg, "ddns-server", &info->server_name);
 	if (strlen(system->server_url) > sizeof(info->server_url))
 		goto error;
 	strlcpy(info->server_url, system->server_url, sizeof(info->server_url));
@@ -349,13 +413,47 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 	info->ttl = cfg_getint(cfg, "ttl");
 	info->proxied = cfg_getbool(cfg, "proxied");
 	info->ssl_enabled = cfg_getbool(cfg, "ssl");
+	info->http2 = cfg_getbool(cfg, "http2");
+#ifndef ENABLE_HTTP2
+	if (info->http2)
+		logit(LOG_WARNING, "%s: built without HTTP/2 support, using HTTP/1.1", system->name);
+#endif
+	info->verify_record = cfg_getbool(cfg, "verify-record");
+	info->period = cfg_getperiod(cfg, "period");
+	info->retry_period = cfg_getperiod(cfg, "retry-period");
+	info->forced_update = cfg_getint(cfg, "forced-update");
+	if (info->forced_update < 0)
+		info->forced_update = 0;
+	info->budget = cfg_getint(cfg, "budget");
+	if (info->budget < 0)
+		info->budget = 0;
+	info->quota = cfg_getint(cfg, "quota");
+	if (info->quota < 0)
+		info->quota = system->quota;
+	info->quota_period = cfg_getint(cfg, "quota-period");
+	if (info->quota_period <= 0)
+		info->quota_period = system->quota_period > 0 ? system->quota_period : DDNS_QUOTA_PERIOD;
+	if (info->quota_period > DDNS_MAX_PERIOD)
+		info->quota_period = DDNS_MAX_PERIOD;
 	str = cfg_getstr(cfg, "username");
 	if (str && strlen(str) <= sizeof(info->creds.username))
 		strlcpy(info->creds.username, str, sizeof(info->creds.username));
 	str = cfg_getstr(cfg, "password");
 	if (str && strlen(str) <= sizeof(info->creds.password))
 		strlcpy(info->creds.password, str, sizeof(info->creds.password));
-	info->ifname = cfg_getstr(cfg, "iface");
+	str = cfg_getstr(cfg, "iface");
+	if (str)
+		info->ifname = strdup(str);
+
+	info->dual_stack = cfg_getbool(cfg, "dual-stack");
+	if (info->dual_stack && strstr(info->system->name, "ipv6")) {
+		logit(LOG_WARNING, "%s: dual-stack is for IPv4 providers, ignoring.", info->system->name);
+		info->dual_stack = 0;
+	}
+	if (info->dual_stack && !allow_ipv6) {
+		logit(LOG_WARNING, "%s: dual-stack requires allow-ipv6 = true, ignoring.", info->system->name);
+		info->dual_stack = 0;
+	}
 
 	for (j = 0; j < cfg_size(cfg, "hostname"); j++) {
 		size_t pos = info->alias_count;
@@ -364,19 +462,21 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 		if (!str)
 			continue;
 
-		if (info->alias_count == DDNS_MAX_ALIAS_NUMBER) {
-			logit(LOG_WARNING, "Too many hostname aliases, skipping %s ...", str);
-			continue;
-		}
-
 		strlcpy(info->alias[pos].name, str, sizeof(info->alias[pos].name));
+		info->alias[pos].family = strstr(info->system->name, "ipv6") ? AF_INET6 : AF_INET;
 		info->alias_count++;
+
+		if (info->dual_stack) {
+			pos++;
+			strlcpy(info->alias[pos].name, str, sizeof(info->alias[pos].name));
+			info->alias[pos].family = AF_INET6;
+			info->alias_count++;
+		}
 	}
 
 	if (custom) {
 		info->append_myip = cfg_getbool(cfg, "append-myip");
 
-		cfg_getserver(cfg, "ddns-server", &info->server_name);
 		str = cfg_getstr(cfg, "ddns-path");
 		if (str && strlen(str) <= sizeof(info->server_url))
 			strlcpy(info->server_url, str, sizeof(info->server_url));
@@ -417,43 +517,100 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 	 * This setting may only be disabled by the user, with the
 	 * custom provider section being the exeception to the rule.
 	 */
-	info->checkip_ssl = info->ssl_enabled;
+	srv->ssl = info->ssl_enabled;
 
 	/* Check known status of checkip server for provider */
 	switch (system->checkip_ssl) {
 	case DDNS_CHECKIP_SSL_UNSUPPORTED:
-		info->checkip_ssl = 0;
+		srv->ssl = 0;
 		break;
 
 	case DDNS_CHECKIP_SSL_REQUIRED:
-		info->checkip_ssl = 1;
+		srv->ssl = 1;
 		break;
 
 	default:
 	case DDNS_CHECKIP_SSL_SUPPORTED:
 		if (!cfg_getbool(cfg, "checkip-ssl"))
-			info->checkip_ssl = 0;
+			srv->ssl = 0;
 	}
 
-	/* The checkip server can be set for all provider types */
-	if (!cfg_getserver(cfg, "checkip-server", &info->checkip_name)) {
-		str = cfg_getstr(cfg, "checkip-path");
-		if (str && strlen(str) <= sizeof(info->checkip_url))
-			strlcpy(info->checkip_url, str, sizeof(info->checkip_url));
-		else
-			strlcpy(info->checkip_url, "/", sizeof(info->checkip_url));
+	/* The checkip server(s) can be set for all provider types */
+	if (cfg_size(cfg, "checkip-server")) {
+		const char *path;
+
+		path = cfg_getstr(cfg, "checkip-path");
+		if (!path || strlen(path) > sizeof(srv->url))
+			path = "/";
 
-		if (!strcasecmp(info->checkip_name.name, "default")) {
-			strlcpy(info->checkip_name.name, DDNS_MY_IP_SERVER, sizeof(info->checkip_name.name));
-			strlcpy(info->checkip_url, DDNS_MY_CHECKIP_URL, sizeof(info->checkip_url));
-			info->checkip_ssl = DDNS_MY_IP_SSL;
+		info->checkip_num = 0;
+		for (j = 0; j < cfg_size(cfg, "checkip-server"); j++) {
+			str = cfg_getnstr(cfg, "checkip-server", j);
+			if (info->checkip_num == DDNS_MAX_CHECKIP) {
+				logit(LOG_WARNING, "Too many checkip servers, skipping %s ...", str);
+				continue;
+			}
+
+			/*
+			 * If a custom checkip server is defined, the
+			 * checkip-ssl setting is fully honored.
+			 */
+			srv = &info->checkip[info->checkip_num];
+			if (getcheckip(str, path, cfg_getbool(cfg, "checkip-ssl"), srv)) {
+				logit(LOG_WARNING, "Invalid checkip server %s, skipping ...", str);
+				continue;
+			}
+			info->checkip_num++;
 		}
+	}
+
+	/* Built-in default as last resort, unless already in the list */
+	for (j = 0; j < info->checkip_num; j++) {
+		if (strstr(info->checkip[j].name.name, DDNS_MY_IP_SERVER))
+			break;
+	}
+	if (j == info->checkip_num) {
+		srv = &info->checkip[info->checkip_num++];
+		strlcpy(srv->name.name, DDNS_MY_IP_SERVER, sizeof(srv->name.name));
+		strlcpy(srv->url, DDNS_MY_CHECKIP_URL, sizeof(srv->url));
+		srv->ssl    = DDNS_MY_IP_SSL;
+		srv->backup = 1;
+	}
+
+	info->checkip_quorum = cfg_getint(cfg, "checkip-quorum");
+	if (info->checkip_quorum < 1)
+		info->checkip_quorum = 1;
 
-		/*
-		 * If a custom checkip server is defined, the
-		 * checkip-ssl setting is fully honored.
-		 */
-		info->checkip_ssl = cfg_getbool(cfg, "checkip-ssl");
+	/* Cheaper than HTTP, one UDP round-trip, checkip-server is the fallback */
+	str = cfg_getstr(cfg, "checkip-stun");
+	if (str && strlen(str) > 0 && getserver(str, &info->checkip_stun)) {
+		logit(LOG_WARNING, "Invalid checkip-stun server %s, skipping ...", str);
+		memset(&info->checkip_stun, 0, sizeof(info->checkip_stun));
+	}
+
+	str = cfg_getstr(cfg, "checkip-dns");
+	if (str && strlen(str) > 0) {
+		info->checkip_dns = discover_dns_lookup(str);
+		if (info->checkip_dns == DISCOVER_DNS_NONE)
+			logit(LOG_WARNING, "Unknown checkip-dns service %s, skipping ...", str);
+	}
+
+	/* Ask the gateway, saves a round-trip to the Internet */
+	str = cfg_getstr(cfg, "checkip-gateway");
+	if (str && strlen(str) > 0) {
+		info->checkip_gateway = gateway_lookup(str);
+		if (info->checkip_gateway == GATEWAY_NONE)
+			logit(LOG_WARNING, "Unknown checkip-gateway protocol %s, skipping ...", str);
+	}
+
+	str = cfg_getstr(cfg, "checkip-gateway-address");
+	if (str && strlen(str) > 0) {
+		struct in_addr addr;
+
+		if (inet_pton(AF_INET, str, &addr) == 1)
+			strlcpy(info->checkip_gateway_addr, str, sizeof(info->checkip_gateway_addr));
+		else
+			logit(LOG_WARNING, "Invalid checkip-gateway-address %s, using default route ...", str);
 	}
 
 	/* The checkip-command overrides any default or custom checkip-server */
@@ -462,16 +619,26 @@ static int set_provider_opts(cfg_t *cfg, ddns_info_t *info, int custom)
 		info->checkip_cmd = strdup(str);
 	else if (script_cmd)
 		info->checkip_cmd = strdup(script_cmd);
+	info->checkip_cmd_timeout = cfg_getint(cfg, "checkip-command-timeout");
+	if (info->checkip_cmd_timeout < 1)
+		info->checkip_cmd_timeout = DDNS_CHECKIP_CMD_TIMEOUT;
 
 	/* The per-provider user-agent setting, defaults to the global setting */
-	info->user_agent = cfg_getstr(cfg, "user-agent");
-	if (!info->user_agent)
-		info->user_agent = user_agent;
+	str = cfg_getstr(cfg, "user-agent");
+	if (!str)
+		str = user_agent;
+	info->user_agent = strdup(str);
+	if (!info->user_agent) {
+		logit(LOG_ERR, "Failed allocating memory for provider %s", info->system->name);
+		return 1;
+	}
+
+	/* A per-provider optional proxy, all connections go through it */
+	if (cfg_parseproxy(cfg, "proxy", &info->proxy_type, &info->proxy_name)) {
+		logit(LOG_ERR, "Failed setting up %s DDNS provider, skipping.", info->system->name);
+		return 1;
+	}
 
-	/* A per-proivder optional proxy server:port */
-#if 0
-	cfg_parseproxy(cfg, "proxy", &info->proxy_type, &info->proxy_name);
-#endif
 	return 0;
 
 error:
@@ -479,25 +646,64 @@ error:
 	return 1;
 }
 
+static void free_provider(ddns_info_t *info)
+{
+	memwipe(&info->creds, sizeof(info->creds));
+	common_free(info);
+	if (info->checkip_cmd)
+		free(info->checkip_cmd);
+	if (info->data)
+		mem_free(info->data);
+	free(info->ifname);
+	free(info->user_agent);
+	free(info->checkip);
+	free(info->alias);
+	free(info);
+}
+
+/*
+ * Aliases and checkip servers are sized to what the provider actually
+ * lists, most only have one or two, rather than a fixed max in each.
+ */
 static int create_provider(cfg_t *cfg, int custom)
 {
 	ddns_info_t *info;
+	size_t i, num;
 
 	info = calloc(1, sizeof(*info));
-	if (!info) {
-		logit(LOG_ERR, "Failed allocating memory for provider %s", cfg_title(cfg));
-		return 1;
-	}
-
-	http_construct(&info->checkip);
+	if (!info)
+		goto nomem;
+
+	/* Room for an AAAA alias per hostname, in case of dual-stack */
+	num = 2 * cfg_size(cfg, "hostname");
+	info->alias = calloc(num ? num : 1, sizeof(ddns_alias_t));
+	if (!info->alias)
+		goto nomem;
+
+	/* The list, or the default, plus the built-in fallback */
+	num = cfg_size(cfg, "checkip-server");
+	if (num > DDNS_MAX_CHECKIP)
+		num = DDNS_MAX_CHECKIP;
+	num = (num ? num : 1) + 1;
+	info->checkip = calloc(num, sizeof(ddns_checkip_t));
+	if (!info->checkip)
+		goto nomem;
+
+	for (i = 0; i < num; i++)
+		http_construct(&info->checkip[i].client);
 	http_construct(&info->server);
 	if (set_provider_opts(cfg, info, custom)) {
-		free(info);
+		free_provider(info);
 		return 1;
 	}
 
 	LIST_INSERT_HEAD(&info_list, info, link);
 	return 0;
+nomem:
+	logit(LOG_ERR, "Failed allocating memory for provider %s", cfg_title(cfg));
+	if (info)
+		free_provider(info);
+	return 1;
 }
 
 ddns_info_t *conf_info_iterator(int first)
@@ -521,20 +727,15 @@ void conf_info_cleanup(void)
 	ddns_info_t *ptr, *tmp;
 
 	LIST_FOREACH_SAFE(ptr, &info_list, link, tmp) {
-		if (ptr->creds.encoded_password)
-			free(ptr->creds.encoded_password);
-		if (ptr->checkip_cmd)
-			free(ptr->checkip_cmd);
-		if (ptr->data)
-			free(ptr->data);
 		LIST_REMOVE(ptr, link);
-		free(ptr);
+		free_provider(ptr);
 	}
 }
 
 cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 {
 	int ret = 0;
+	char *str;
 	size_t i;
 	cfg_opt_t provider_opts[] = {
 		CFG_FUNC    ("include",      &cfg_include),
@@ -543,16 +744,32 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_STR_LIST("hostname",     NULL, CFGF_NONE),
 		CFG_STR_LIST("alias",        NULL, CFGF_DEPRECATED),
 		CFG_BOOL    ("ssl",          cfg_true, CFGF_NONE),
+		CFG_BOOL    ("http2",        cfg_false, CFGF_NONE),
 		CFG_BOOL    ("wildcard",     cfg_false, CFGF_NONE),
 		CFG_INT     ("ttl",          -1, CFGF_NODEFAULT),
 		CFG_BOOL    ("proxied",      cfg_false, CFGF_NONE),
+		CFG_BOOL    ("verify-record", cfg_false, CFGF_NONE),
+		CFG_BOOL    ("dual-stack",   cfg_false, CFGF_NONE),
 		CFG_STR     ("iface",          NULL, CFGF_NONE), /* interface name */
-		CFG_STR     ("checkip-server", NULL, CFGF_NONE), /* Syntax:  name:port */
+		CFG_STR_LIST("checkip-server", NULL, CFGF_NONE), /* Syntax:  [http[s]://]name[:port][/path] */
 		CFG_STR     ("checkip-path",   NULL, CFGF_NONE), /* Default: "/" */
 		CFG_BOOL    ("checkip-ssl",    cfg_true, CFGF_NONE),
+		CFG_INT     ("checkip-quorum", 1, CFGF_NONE),    /* Agreeing replies, 1: fastest wins */
+		CFG_STR     ("checkip-stun",   NULL, CFGF_NONE), /* Syntax: name[:port] */
+		CFG_STR     ("checkip-dns",    NULL, CFGF_NONE), /* opendns, google, cloudflare */
+		CFG_STR     ("checkip-gateway", NULL, CFGF_NONE), /* natpmp, pcp, upnp */
+		CFG_STR     ("checkip-gateway-address", NULL, CFGF_NONE), /* Default: default route */
 		CFG_STR     ("checkip-command",NULL, CFGF_NONE), /* Syntax: /path/to/cmd [args] */
+		CFG_INT     ("checkip-command-timeout", DDNS_CHECKIP_CMD_TIMEOUT, CFGF_NONE), /* sec */
 		CFG_STR     ("user-agent",     NULL, CFGF_NONE),
-//		CFG_STR     ("proxy",          NULL, CFGF_NONE), /* Syntax:  name:port */
+		CFG_INT     ("period",         0, CFGF_NONE),    /* sec, 0: global period */
+		CFG_INT     ("retry-period",   0, CFGF_NONE),    /* sec, 0: global retry-period */
+		CFG_INT     ("forced-update",  0, CFGF_NONE),    /* sec, 0: global forced-update */
+		CFG_INT     ("budget",         0, CFGF_NONE),    /* sec, 0: global provider-budget */
+		CFG_INT     ("quota",         -1, CFGF_NONE),    /* Requests per quota-period, -1: plugin default */
+		CFG_INT     ("quota-period",   0, CFGF_NONE),    /* sec, 0: plugin default */
+		CFG_STR     ("proxy",          NULL, CFGF_NONE), /* Syntax:  scheme://name:port */
+		CFG_STR     ("ddns-server",    NULL, CFGF_NONE), /* Override, syntax: name[:port] */
 		CFG_END()
 	};
 	cfg_opt_t custom_opts[] = {
@@ -563,16 +780,31 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_STR_LIST("hostname",     NULL, CFGF_NONE),
 		CFG_STR_LIST("alias",        NULL, CFGF_DEPRECATED),
 		CFG_BOOL    ("ssl",          cfg_true, CFGF_NONE),
+		CFG_BOOL    ("http2",        cfg_false, CFGF_NONE),
 		CFG_BOOL    ("wildcard",     cfg_false, CFGF_NONE),
 		CFG_INT     ("ttl",          -1, CFGF_NODEFAULT),
 		CFG_BOOL    ("proxied",      cfg_false, CFGF_NONE),
+		CFG_BOOL    ("verify-record", cfg_false, CFGF_NONE),
+		CFG_BOOL    ("dual-stack",   cfg_false, CFGF_NONE),
 		CFG_STR     ("iface",          NULL, CFGF_NONE), /* interface name */
-		CFG_STR     ("checkip-server", NULL, CFGF_NONE), /* Syntax:  name:port */
+		CFG_STR_LIST("checkip-server", NULL, CFGF_NONE), /* Syntax:  [http[s]://]name[:port][/path] */
 		CFG_STR     ("checkip-path",   NULL, CFGF_NONE), /* Default: "/" */
 		CFG_BOOL    ("checkip-ssl",    cfg_true, CFGF_NONE),
+		CFG_INT     ("checkip-quorum", 1, CFGF_NONE),    /* Agreeing replies, 1: fastest wins */
+		CFG_STR     ("checkip-stun",   NULL, CFGF_NONE), /* Syntax: name[:port] */
+		CFG_STR     ("checkip-dns",    NULL, CFGF_NONE), /* opendns, google, cloudflare */
+		CFG_STR     ("checkip-gateway", NULL, CFGF_NONE), /* natpmp, pcp, upnp */
+		CFG_STR     ("checkip-gateway-address", NULL, CFGF_NONE), /* Default: default route */
 		CFG_STR     ("checkip-command",NULL, CFGF_NONE), /* Syntax: /path/to/cmd [args] */
+		CFG_INT     ("checkip-command-timeout", DDNS_CHECKIP_CMD_TIMEOUT, CFGF_NONE), /* sec */
 		CFG_STR     ("user-agent",     NULL, CFGF_NONE),
-//		CFG_STR     ("proxy",          NULL, CFGF_NONE), /* Syntax:  name:port */
+		CFG_INT     ("period",         0, CFGF_NONE),    /* sec, 0: global period */
+		CFG_INT     ("retry-period",   0, CFGF_NONE),    /* sec, 0: global retry-period */
+		CFG_INT     ("forced-update",  0, CFGF_NONE),    /* sec, 0: global forced-update */
+		CFG_INT     ("budget",         0, CFGF_NONE),    /* sec, 0: global provider-budget */
+		CFG_INT     ("quota",         -1, CFGF_NONE),    /* Requests per quota-period, -1: plugin default */
+		CFG_INT     ("quota-period",   0, CFGF_NONE),    /* sec, 0: plugin default */
+		CFG_STR     ("proxy",          NULL, CFGF_NONE), /* Syntax:  scheme://name:port */
 		/* Custom settings */
 		CFG_BOOL    ("append-myip",    cfg_false, CFGF_NONE),
 		CFG_STR     ("ddns-server",    NULL, CFGF_NONE),
@@ -584,13 +816,41 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 		CFG_BOOL("verify-address", cfg_true, CFGF_NONE),
 		CFG_BOOL("fake-address",  cfg_false, CFGF_NONE),
 		CFG_BOOL("allow-ipv6",    cfg_false, CFGF_NONE),
+		CFG_STR ("ipv6-address",  "stable", CFGF_NONE), /* stable, first */
+		CFG_STR ("ipv6-prefix",   NULL, CFGF_NONE), /* Syntax: 2001:db8::/32 */
+		CFG_STR ("ipv6-suffix",   NULL, CFGF_NONE), /* Syntax: ::1:2:3:4 */
 		CFG_BOOL("secure-ssl",    cfg_true, CFGF_NONE),
 		CFG_BOOL("broken-rtc",    cfg_false, CFGF_NONE),
 		CFG_STR ("ca-trust-file", NULL, CFGF_NONE),
 		CFG_STR ("cache-dir",	  NULL, CFGF_DEPRECATED | CFGF_DROP),
+		CFG_STR ("cache-sync",	  "cycle", CFGF_NONE), /* none, cycle, always */
+		CFG_STR ("event-backend", "poll", CFGF_NONE), /* poll, io_uring */
+		CFG_STR ("metrics-file",  NULL, CFGF_NONE),
+		CFG_STR ("control-socket", NULL, CFGF_NONE),
+		CFG_BOOL("trace",         cfg_false, CFGF_NONE),
+		CFG_STR ("trace-file",    NULL, CFGF_NONE),
+		CFG_STR ("resolver",	  NULL, CFGF_NONE), /* https://name[:port][/path] */
+		CFG_STR ("ha-state",	  NULL, CFGF_NONE), /* File with MASTER or BACKUP */
+		CFG_STR ("ha-peer",	  NULL, CFGF_NONE), /* Syntax: name[:port] */
+		CFG_STR ("ha-secret",	  NULL, CFGF_NONE), /* HMAC key for ha-peer */
+		CFG_STR ("shared-discovery", NULL, CFGF_NONE), /* File shared by instances on this host */
 		CFG_INT ("period",	  DDNS_DEFAULT_PERIOD, CFGF_NONE),
 		CFG_INT ("iterations",    DDNS_DEFAULT_ITERATIONS, CFGF_NONE),
 		CFG_INT ("forced-update", DDNS_FORCED_UPDATE_PERIOD, CFGF_NONE),
+		CFG_INT ("retry-period",  DDNS_ERROR_UPDATE_PERIOD, CFGF_NONE),
+		CFG_INT ("concurrency",   -1, CFGF_NONE),    /* -1: default, depends on --once */
+		CFG_INT ("prewarm",       0, CFGF_NONE), /* sec, 0: disabled */
+		CFG_BOOL("prefetch",      cfg_false, CFGF_NONE),
+		CFG_INT ("command-debounce", DDNS_DEFAULT_DEBOUNCE, CFGF_NONE), /* msec, 0: disabled */
+		CFG_BOOL("adaptive-period", cfg_false, CFGF_NONE),
+		CFG_INT ("period-min",    DDNS_MIN_PERIOD, CFGF_NONE),
+		CFG_INT ("period-max",    DDNS_ADAPTIVE_MAX_PERIOD, CFGF_NONE),
+		CFG_INT ("exec-timeout",  HOOK_DEFAULT_TIMEOUT, CFGF_NONE),
+		CFG_INT ("exec-concurrency", HOOK_DEFAULT_CONCURRENCY, CFGF_NONE),
+		CFG_INT ("circuit-breaker", BREAKER_DEFAULT_THRESHOLD, CFGF_NONE), /* 0: disabled */
+		CFG_INT ("circuit-breaker-timeout", BREAKER_DEFAULT_TIMEOUT, CFGF_NONE),
+		CFG_INT ("cycle-deadline", 0, CFGF_NONE), /* sec, 0: the period */
+		CFG_INT ("provider-budget", 0, CFGF_NONE), /* sec, 0: no limit */
 		CFG_STR ("iface",         NULL, CFGF_NONE),
 		CFG_STR ("user-agent",    NULL, CFGF_NONE),
 		CFG_SEC ("provider",      provider_opts, CFGF_MULTI | CFGF_TITLE),
@@ -630,8 +890,59 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 
 	/* Set global options */
 	ctx->normal_update_period_sec = cfg_getint(cfg, "period");
-	ctx->error_update_period_sec  = DDNS_ERROR_UPDATE_PERIOD;
+	ctx->error_update_period_sec  = cfg_getperiod(cfg, "retry-period");
+	if (!ctx->error_update_period_sec)
+		ctx->error_update_period_sec = DDNS_ERROR_UPDATE_PERIOD;
 	ctx->forced_update_period_sec = cfg_getint(cfg, "forced-update");
+	ctx->concurrency              = cfg_getint(cfg, "concurrency");
+	if (ctx->concurrency < 0)
+		ctx->concurrency      = once ? DDNS_ONCE_CONCURRENCY : DDNS_DEFAULT_CONCURRENCY;
+	if (ctx->concurrency == 0)
+		ctx->concurrency      = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ctx->concurrency < 1)
+		ctx->concurrency      = 1;
+	if (ctx->concurrency > DDNS_MAX_CONCURRENCY)
+		ctx->concurrency      = DDNS_MAX_CONCURRENCY;
+	ctx->prewarm                  = cfg_getint(cfg, "prewarm");
+	ctx->prefetch                 = cfg_getbool(cfg, "prefetch");
+	if (ctx->prewarm < 0)
+		ctx->prewarm          = 0;
+	if (ctx->prewarm > DDNS_MAX_PREWARM)
+		ctx->prewarm          = DDNS_MAX_PREWARM;
+	ctx->debounce                 = cfg_getint(cfg, "command-debounce");
+	if (ctx->debounce < 0)
+		ctx->debounce         = 0;
+	if (ctx->debounce > DDNS_MAX_DEBOUNCE)
+		ctx->debounce         = DDNS_MAX_DEBOUNCE;
+	ctx->adaptive                 = cfg_getbool(cfg, "adaptive-period");
+	ctx->period_min               = cfg_getperiod(cfg, "period-min");
+	if (!ctx->period_min)
+		ctx->period_min       = DDNS_MIN_PERIOD;
+	ctx->period_max               = cfg_getperiod(cfg, "period-max");
+	if (ctx->period_max < ctx->period_min)
+		ctx->period_max       = ctx->period_min;
+	hook_timeout                  = cfg_getint(cfg, "exec-timeout");
+	if (hook_timeout < 0)
+		hook_timeout          = 0;
+	hook_concurrency              = cfg_getint(cfg, "exec-concurrency");
+	if (hook_concurrency < 1)
+		hook_concurrency      = 1;
+	if (hook_concurrency > HOOK_MAX_CONCURRENCY)
+		hook_concurrency      = HOOK_MAX_CONCURRENCY;
+	breaker_threshold             = cfg_getint(cfg, "circuit-breaker");
+	if (breaker_threshold < 0)
+		breaker_threshold     = 0;
+	breaker_timeout               = cfg_getint(cfg, "circuit-breaker-timeout");
+	if (breaker_timeout < 1)
+		breaker_timeout       = 1;
+	if (breaker_timeout > BREAKER_MAX_TIMEOUT)
+		breaker_timeout       = BREAKER_MAX_TIMEOUT;
+	budget_cycle_sec              = cfg_getint(cfg, "cycle-deadline");
+	if (budget_cycle_sec < 0)
+		budget_cycle_sec      = 0;
+	budget_provider_sec           = cfg_getint(cfg, "provider-budget");
+	if (budget_provider_sec < 0)
+		budget_provider_sec   = 0;
 	if (once)
 		ctx->total_iterations = 1;
 	else
@@ -650,10 +961,52 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 	secure_ssl                    = cfg_getbool(cfg, "secure-ssl");
 	broken_rtc                    = cfg_getbool(cfg, "broken-rtc");
 	ca_trust_file                 = cfg_getstr(cfg, "ca-trust-file");
+#ifdef DROP_METRICS
+	if (cfg_getstr(cfg, "metrics-file"))
+		logit(LOG_WARNING, "Built without metrics support, ignoring metrics-file.");
+#else
+	metrics_file                  = cfg_getstr(cfg, "metrics-file");
+#endif
+	ctrl_path                     = cfg_getstr(cfg, "control-socket");
+	trace_file                    = cfg_getstr(cfg, "trace-file");
+	trace_enabled                 = cfg_getbool(cfg, "trace") || trace_file;
+	ha_state                      = cfg_getstr(cfg, "ha-state");
+	ha_peer                       = cfg_getstr(cfg, "ha-peer");
+	ha_secret                     = cfg_getstr(cfg, "ha-secret");
+	share_file                    = cfg_getstr(cfg, "shared-discovery");
+	str                           = cfg_getstr(cfg, "cache-sync");
+	if (!strcmp(str, "none"))
+		cache_sync            = CACHE_SYNC_NONE;
+	else if (!strcmp(str, "always"))
+		cache_sync            = CACHE_SYNC_ALWAYS;
+	else if (!strcmp(str, "cycle"))
+		cache_sync            = CACHE_SYNC_CYCLE;
+	else
+		logit(LOG_WARNING, "Unknown cache-sync policy %s, using cycle.", str);
+	str                           = cfg_getstr(cfg, "ipv6-address");
+	ipv6_policy                   = IFMON_POLICY_STABLE;
+	if (!strcmp(str, "first"))
+		ipv6_policy           = IFMON_POLICY_FIRST;
+	else if (strcmp(str, "stable"))
+		logit(LOG_WARNING, "Unknown ipv6-address policy %s, using stable.", str);
+	if (ifmon_match(cfg_getstr(cfg, "ipv6-prefix"), cfg_getstr(cfg, "ipv6-suffix")))
+		return NULL;
+	str                           = cfg_getstr(cfg, "event-backend");
+	event_backend                 = EVENT_BACKEND_POLL;
+	if (!strcmp(str, "io_uring")) {
+#ifdef ENABLE_IO_URING
+		event_backend         = EVENT_BACKEND_IO_URING;
+#else
+		logit(LOG_WARNING, "Built without io_uring support, using poll.");
+#endif
+	} else if (strcmp(str, "poll"))
+		logit(LOG_WARNING, "Unknown event-backend %s, using poll.", str);
 	if (ca_trust_file && !fexist(ca_trust_file)) {
 		logit(LOG_ERR, "Cannot find CA trust file %s", ca_trust_file);
 		return NULL;
 	}
+	if (resolver_set(cfg_getstr(cfg, "resolver")))
+		return NULL;
 
 	for (i = 0; i < cfg_size(cfg, "provider"); i++)
 		ret |= create_provider(cfg_getnsec(cfg, "provider", i), 0);
@@ -664,9 +1017,104 @@ cfg_t *conf_parse_file(char *file, ddns_t *ctx)
 	if (ret)
 		return NULL;
 
+	active_cfg  = cfg;
+	active_file = file;
+
 	return cfg;
 }
 
+/* Release the configuration in use, after conf_info_cleanup() */
+void conf_cleanup(void)
+{
+	if (active_cfg)
+		cfg_free(active_cfg);
+	active_cfg = NULL;
+}
+
+/**
+ * conf_reload - Reload .conf file, keeping state of unchanged providers
+ * @ctx: Context, global settings are updated
+ *
+ * Parses the configuration file again, into a fresh list of providers.
+ * Every provider that is identical to one in the running set, same
+ * plugin, credentials, hostnames, servers and options, is swapped for
+ * the old one, keeping its addresses, connections, cached plugin data
+ * and encoded credentials.  Only added or changed providers are set up
+ * from scratch, their ->initialized is zero.  Removed providers have
+ * their connections closed and are freed.
+ *
+ * If the new file cannot be parsed, the running configuration is kept.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero if the file could not be parsed.
+ */
+int conf_reload(ddns_t *ctx)
+{
+	struct head old = LIST_HEAD_INITIALIZER(old);
+	ddns_info_t *info, *tmp, *prev;
+	cfg_t *prev_cfg = active_cfg;
+	int kept = 0, added = 0;
+
+	if (!active_file)
+		return RC_FILE_IO_MISSING_FILE;
+
+	/* Move the running set aside, the new one is built in info_list */
+	while ((info = LIST_FIRST(&info_list))) {
+		LIST_REMOVE(info, link);
+		LIST_INSERT_HEAD(&old, info, link);
+	}
+
+	if (!conf_parse_file(active_file, ctx)) {
+		logit(LOG_ERR, "Failed reloading %s, keeping current configuration.", active_file);
+		conf_info_cleanup();
+		while ((info = LIST_FIRST(&old))) {
+			LIST_REMOVE(info, link);
+			LIST_INSERT_HEAD(&info_list, info, link);
+		}
+		return RC_FILE_IO_MISSING_FILE;
+	}
+
+	LIST_FOREACH_SAFE(info, &info_list, link, tmp) {
+		LIST_FOREACH(prev, &old, link) {
+			if (ddns_same_provider(prev, info))
+				break;
+		}
+
+		if (!prev) {
+			logit(LOG_INFO, "Provider %s added or changed.", info->system->name);
+			added++;
+			continue;
+		}
+
+		/* Identical, keep the old one and its runtime state */
+		LIST_REMOVE(prev, link);
+		LIST_INSERT_BEFORE(info, prev, link);
+		LIST_REMOVE(info, link);
+		free_provider(info);
+		kept++;
+	}
+
+	LIST_FOREACH_SAFE(info, &old, link, tmp) {
+		size_t i;
+
+		logit(LOG_INFO, "Provider %s removed or changed.", info->system->name);
+		http_exit(&info->server);
+		for (i = 0; i < info->checkip_num; i++)
+			http_exit(&info->checkip[i].client);
+
+		LIST_REMOVE(info, link);
+		free_provider(info);
+	}
+
+	/* Nothing refers to the old configuration any more */
+	if (prev_cfg && prev_cfg != active_cfg)
+		cfg_free(prev_cfg);
+
+	logit(LOG_NOTICE, "Reloaded %s, %d provider(s) kept, %d set up again.", active_file, kept, added);
+
+	return 0;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
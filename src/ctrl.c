@@ -0,0 +1,507 @@
+/* Control socket, live commands and state queries
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Signals can only tell inadyn to do something to all providers, and
+ * the sender never learns what happened.  With control-socket set, a
+ * Unix stream socket is registered with the main loop, and accepts one
+ * command line per connection:
+ *
+ *     update [NAME]	Force update of all, or matching, hostnames
+ *     check [NAME]	Check all, or matching, providers now
+ *     status [NAME]	State of all, or matching, providers, as JSON
+ *     stats		Metrics, in Prometheus text format
+ *     trace		Timeline of the last cycle, see trace.c
+ *
+ * NAME is either a provider, e.g. default@dyndns.org, or a hostname.
+ * The reply is written and the connection closed.  Commands are served
+ * while inadyn waits for its next check; during a check they wait in
+ * the listen backlog.  Updates and checks only mark providers as due,
+ * the main loop does the actual work as soon as the reply is sent.
+ *
+ * With socket activation the service manager may instead pass the
+ * control socket, named control, and a metrics socket, named metrics,
+ * e.g. TCP port 9612, that answers any HTTP request with the stats.
+ * Those are used as-is, and kept open across reloads.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "ctrl.h"
+#include "event.h"
+#include "metrics.h"
+#include "notify.h"
+#include "schedule.h"
+#include "trace.h"
+
+char *ctrl_path = NULL;
+
+static int   sd = -1;
+static char *bound;			/* Path we created, for unlink() */
+static int   inherited = -1;		/* From service manager, see notify.c */
+static int   msd = -1;			/* Metrics, only with socket activation */
+
+extern ddns_info_t *conf_info_iterator(int first);
+
+/* Does @arg, if given, match the provider or one of its hostnames? */
+static int match(ddns_info_t *info, ddns_alias_t *alias, const char *arg)
+{
+	if (!arg)
+		return 1;
+
+	if (!strcasecmp(info->system->name, arg))
+		return 1;
+
+	return alias && !strcasecmp(alias->name, arg);
+}
+
+static void json_str(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; str && *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void reply(FILE *fp, int matched, const char *arg)
+{
+	if (matched) {
+		fprintf(fp, "{ \"result\": \"ok\", \"matched\": %d }\n", matched);
+		return;
+	}
+
+	fprintf(fp, "{ \"result\": \"error\", \"error\": ");
+	json_str(fp, arg ? "no such provider or hostname" : "no providers");
+	fprintf(fp, " }\n");
+}
+
+/* Move @info to the front of the schedule */
+static void due_now(ddns_info_t *info)
+{
+	sched_del(info);
+	info->next_check = 0;
+	if (sched_add(info, 0))
+		logit(LOG_WARNING, "Failed rescheduling %s", info->system->name);
+}
+
+static int do_update(ddns_t *ctx, FILE *fp, const char *arg, int force)
+{
+	ddns_info_t *info;
+	int matched = 0;
+
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		int any = 0;
+		size_t i;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			if (!match(info, alias, arg))
+				continue;
+
+			if (force)
+				alias->force_addr_update = 1;
+			matched++;
+			any = 1;
+		}
+
+		if (any)
+			due_now(info);
+	}
+
+	if (matched) {
+		logit(LOG_INFO, "%s of %s requested on control socket.", force ? "Update" : "Check",
+		      arg ? arg : "all");
+		ddns_cmd(ctx, CMD_WAKEUP);
+	}
+
+	reply(fp, matched, arg);
+
+	return 0;
+}
+
+static int do_status(FILE *fp, const char *arg)
+{
+	time_t now = event_now();
+	ddns_info_t *info;
+	int first = 1;
+
+	fprintf(fp, "{ \"providers\": [");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		size_t i;
+		int next;
+
+		if (!match(info, NULL, arg)) {
+			for (i = 0; i < info->alias_count; i++) {
+				if (match(info, &info->alias[i], arg))
+					break;
+			}
+			if (i == info->alias_count)
+				continue;
+		}
+
+		next = info->next_check > now ? (int)(info->next_check - now) : 0;
+
+		fprintf(fp, "%s\n  { \"provider\": ", first ? "" : ",");
+		json_str(fp, info->system->name);
+		fprintf(fp, ", \"status\": ");
+		json_str(fp, error_name(info->status));
+		fprintf(fp, ", \"retries\": %u, \"next-check\": %d, \"hostnames\": [", info->retries, next);
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			fprintf(fp, "%s\n    { \"name\": ", i ? "," : "");
+			json_str(fp, alias->name);
+			fprintf(fp, ", \"address\": ");
+			json_str(fp, alias->address);
+			fprintf(fp, ", \"last-update\": %lld, \"fails\": %u, \"last-error\": ",
+				(long long)alias->last_update, alias->fails);
+			json_str(fp, error_name(alias->rc));
+			fprintf(fp, " }");
+		}
+		fprintf(fp, " ] }");
+		first = 0;
+	}
+	fprintf(fp, " ] }\n");
+
+	return 0;
+}
+
+static int do_trace(FILE *fp)
+{
+	if (!trace_enabled) {
+		fprintf(fp, "{ \"result\": \"error\", \"error\": \"tracing not enabled\" }\n");
+		return 0;
+	}
+
+	return trace_render(fp);
+}
+
+static void dispatch(ddns_t *ctx, FILE *fp, char *line)
+{
+	char *cmd, *arg;
+
+	cmd = strtok(line, " \t\r\n");
+	arg = strtok(NULL, " \t\r\n");
+	if (!cmd) {
+		fprintf(fp, "{ \"result\": \"error\", \"error\": \"empty command\" }\n");
+		return;
+	}
+
+	logit(LOG_DEBUG, "Control socket command: %s %s", cmd, arg ? arg : "");
+	if (!strcmp(cmd, "update"))
+		do_update(ctx, fp, arg, 1);
+	else if (!strcmp(cmd, "check"))
+		do_update(ctx, fp, arg, 0);
+	else if (!strcmp(cmd, "status"))
+		do_status(fp, arg);
+#ifndef DROP_METRICS
+	else if (!strcmp(cmd, "stats"))
+		metrics_render(fp);
+#endif
+	else if (!strcmp(cmd, "trace"))
+		do_trace(fp);
+	else {
+		fprintf(fp, "{ \"result\": \"error\", \"error\": \"unknown command\", \"command\": ");
+		json_str(fp, cmd);
+		fprintf(fp, " }\n");
+	}
+}
+
+/* Read up to @end, e.g. one command line, a client that dawdles is dropped */
+static int readline(int fd, char *buf, size_t len, const char *end)
+{
+	size_t pos = 0;
+
+	while (pos < len - 1) {
+		ssize_t n;
+
+		n = recv(fd, &buf[pos], len - 1 - pos, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+
+		pos += n;
+		buf[pos] = 0;
+		if (strstr(buf, end))
+			break;
+	}
+	buf[pos] = 0;
+
+	return pos ? 0 : -1;
+}
+
+/* Accept a client and read its request, up to @end, returns stream for the reply */
+static FILE *client(int fd, char *line, size_t len, const char *end)
+{
+	struct timeval tv = { CTRL_TIMEOUT / 1000, (CTRL_TIMEOUT % 1000) * 1000 };
+	FILE *fp;
+	int cd;
+
+	cd = accept(fd, NULL, NULL);
+	if (cd < 0)
+		return NULL;
+
+	/* The listening socket is non-blocking, the client must not be */
+	fcntl(cd, F_SETFD, fcntl(cd, F_GETFD) | FD_CLOEXEC);
+	fcntl(cd, F_SETFL, fcntl(cd, F_GETFL) & ~O_NONBLOCK);
+	setsockopt(cd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(cd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	if (readline(cd, line, len, end)) {
+		close(cd);
+		return NULL;
+	}
+
+	fp = fdopen(cd, "w");
+	if (!fp)
+		close(cd);
+
+	return fp;
+}
+
+static void ctrl_cb(int fd, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	char line[CTRL_MAX_CMD];
+	FILE *fp;
+
+	fp = client(fd, line, sizeof(line), "\n");
+	if (!fp)
+		return;
+
+	dispatch(ctx, fp, line);
+	fclose(fp);
+}
+
+/* Any request gets the metrics, e.g. GET /metrics from Prometheus */
+static void metrics_cb(int fd, void *arg)
+{
+	char req[CTRL_MAX_CMD];
+	FILE *fp;
+
+	fp = client(fd, req, sizeof(req), "\r\n\r\n");
+	if (!fp)
+		return;
+
+#ifdef DROP_METRICS
+	fprintf(fp, "HTTP/1.0 501 Not Implemented\r\n"
+		"Connection: close\r\n\r\n");
+#else
+	fprintf(fp, "HTTP/1.0 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Connection: close\r\n\r\n");
+	if (strncmp(req, "HEAD ", 5))
+		metrics_render(fp);
+#endif
+	fclose(fp);
+}
+
+/* Sockets passed by the service manager, opened once, never closed */
+static int activated(ddns_t *ctx)
+{
+	int fd;
+
+	fd = notify_fd("metrics");
+	if (fd != -1 && msd == -1) {
+		msd = fd;
+		fcntl(msd, F_SETFL, fcntl(msd, F_GETFL) | O_NONBLOCK);
+		logit(LOG_DEBUG, "Serving metrics on socket from service manager");
+	}
+	if (msd != -1)
+		event_add(msd, metrics_cb, ctx);
+
+	fd = notify_fd("control");
+	if (fd != -1 && inherited == -1) {
+		inherited = fd;
+		fcntl(inherited, F_SETFL, fcntl(inherited, F_GETFL) | O_NONBLOCK);
+		logit(LOG_DEBUG, "Listening for commands on socket from service manager");
+	}
+	if (inherited == -1)
+		return 0;
+
+	sd = inherited;
+	event_add(sd, ctrl_cb, ctx);
+
+	return 1;
+}
+
+/**
+ * ctrl_init - Open control socket and register it with the main loop
+ * @ctx: Context, ctx->cmd is set to %CMD_WAKEUP when the schedule changes
+ *
+ * Does nothing unless control-socket is set, or the service manager
+ * passed the socket.  Failing to open it is not fatal, inadyn can
+ * still be controlled with signals.
+ *
+ * Returns:
+ * Always POSIX OK(0).
+ */
+int ctrl_init(ddns_t *ctx)
+{
+	struct sockaddr_un sun;
+	mode_t old;
+
+	if (sd != -1 || activated(ctx) || !ctrl_path || !ctrl_path[0])
+		return 0;
+
+	if (strlen(ctrl_path) >= sizeof(sun.sun_path)) {
+		logit(LOG_ERR, "Control socket path %s too long.", ctrl_path);
+		return 0;
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strlcpy(sun.sun_path, ctrl_path, sizeof(sun.sun_path));
+
+	sd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sd < 0)
+		goto fail;
+
+	fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	/* Left behind by a previous instance that crashed */
+	unlink(ctrl_path);
+
+	/* Only the owner may send commands */
+	old = umask(0077);
+	if (bind(sd, (struct sockaddr *)&sun, sizeof(sun))) {
+		umask(old);
+		goto fail;
+	}
+	umask(old);
+
+	bound = strdup(ctrl_path);
+	if (listen(sd, 5) || event_add(sd, ctrl_cb, ctx))
+		goto fail;
+
+	logit(LOG_DEBUG, "Listening for commands on %s", ctrl_path);
+
+	return 0;
+fail:
+	logit(LOG_WARNING, "Cannot open control socket %s: %s", ctrl_path, strerror(errno));
+	ctrl_exit();
+
+	return 0;
+}
+
+/**
+ * ctrl_handoff - Ask an already running inadyn to check, or update, now
+ * @force: Force update of all hostnames, like --force, or only check
+ *
+ * Used by --once, e.g. from a hotplug script or cron, instead of
+ * running a second instance next to the daemon.  The daemon serves
+ * commands between cycles, so a reply that does not arrive in time
+ * still counts, the command is waiting in the listen backlog.
+ *
+ * Returns:
+ * POSIX OK(0) if the command was sent, non-zero if there is no daemon
+ * listening on the control-socket.
+ */
+int ctrl_handoff(int force)
+{
+	struct timeval tv = { CTRL_TIMEOUT / 1000, (CTRL_TIMEOUT % 1000) * 1000 };
+	const char *cmd = force ? "update\n" : "check\n";
+	struct sockaddr_un sun;
+	char buf[CTRL_MAX_CMD];
+	ssize_t len;
+	int cd;
+
+	if (!ctrl_path || !ctrl_path[0] || strlen(ctrl_path) >= sizeof(sun.sun_path))
+		return 1;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strlcpy(sun.sun_path, ctrl_path, sizeof(sun.sun_path));
+
+	cd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (cd < 0)
+		return 1;
+
+	setsockopt(cd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(cd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if (connect(cd, (struct sockaddr *)&sun, sizeof(sun)) ||
+	    send(cd, cmd, strlen(cmd), MSG_NOSIGNAL) != (ssize_t)strlen(cmd)) {
+		close(cd);
+		return 1;
+	}
+
+	len = recv(cd, buf, sizeof(buf) - 1, 0);
+	close(cd);
+
+	if (len > 0) {
+		buf[len] = 0;
+		buf[strcspn(buf, "\r\n")] = 0;
+		logit(LOG_DEBUG, "Reply from %s: %s", ctrl_path, buf);
+	}
+	logit(LOG_NOTICE, "%s handed over to inadyn running on %s", force ? "Update" : "Check", ctrl_path);
+
+	return 0;
+}
+
+void ctrl_exit(void)
+{
+	if (msd != -1)
+		event_del(msd);
+	if (sd == -1)
+		return;
+
+	event_del(sd);
+	if (sd != inherited)
+		close(sd);
+	sd = -1;
+
+	if (bound) {
+		unlink(bound);
+		free(bound);
+		bound = NULL;
+	}
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,10 +21,10 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ifaddrs.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -36,327 +36,213 @@
 #include <net/if.h>
 
 #include "ddns.h"
+#include "address.h"
+#include "breaker.h"
+#include "budget.h"
 #include "cache.h"
+#include "ctrl.h"
+#include "discover.h"
+#include "dnscache.h"
+#include "event.h"
+#include "gateway.h"
+#include "ha.h"
+#include "hook.h"
+#include "ifmon.h"
 #include "log.h"
+#include "metrics.h"
+#include "notify.h"
+#include "probe.h"
+#include "quota.h"
+#include "resolver.h"
+#include "schedule.h"
+#include "share.h"
+#include "ssl.h"
+#include "trace.h"
 #include "base64.h"
+#include "hash.h"
 #include "md5.h"
 #include "sha1.h"
 
 /* Conversation with the checkip server */
 #define DYNDNS_CHECKIP_HTTP_REQUEST  					\
-	"GET %s HTTP/1.0\r\n"						\
+	"GET %s HTTP/1.1\r\n"						\
 	"Host: %s\r\n"							\
 	"User-Agent: %s\r\n\r\n"
 
 /* Used to preserve values during reset at SIGHUP.  Time also initialized from cache file at startup. */
 static int cached_num_iterations = 0;
 extern ddns_info_t *conf_info_iterator(int first);
+extern int          conf_reload(ddns_t *ctx);
 
+static void prewarm(ddns_t *ctx, time_t due);
+static int  prewarm_idle(void);
+static void prefetch(ddns_t *ctx);
 
-static int wait_for_cmd(ddns_t *ctx)
-{
-	int counter;
-	ddns_cmd_t old_cmd;
-
-	if (!ctx)
-		return RC_INVALID_POINTER;
-
-	old_cmd = ctx->cmd;
-	if (old_cmd != NO_CMD)
-		return 0;
-
-	counter = ctx->update_period / ctx->cmd_check_period;
-	while (counter--) {
-		if (ctx->cmd != old_cmd)
-			break;
+/* A provider handled by an update worker, see run_concurrent() */
+struct update_job {
+	ddns_info_t *info;
+	int         *rc;		/* Result, per alias */
+};
 
-		sleep(ctx->cmd_check_period);
-	}
+static struct update_job *verify_concurrent(ddns_t *ctx, size_t *num);
+static void               free_jobs(struct update_job *jobs, size_t num);
 
-	return 0;
+/**
+ * ddns_cmd - Queue a command for the main loop
+ * @ctx: Context
+ * @cmd: Command, merged with any pending, the strongest one wins
+ *
+ * E.g., a check requested while a forced update is pending is part of
+ * it, and a burst of checks is one check.  Safe to call from a signal
+ * handler.
+ */
+void ddns_cmd(ddns_t *ctx, ddns_cmd_t cmd)
+{
+	if (ctx->cmd == NO_CMD || cmd < ctx->cmd)
+		ctx->cmd = cmd;
+	ctx->cmd_msec = event_msec();
+	ctx->cmds++;
 }
 
-static int shell_transaction(ddns_t *ctx, ddns_info_t *info, const char *cmd)
+/*
+ * Hotplug scripts and a flapping link tend to send commands in bursts.
+ * Wait until they have been quiet for the debounce time, but no more
+ * than DDNS_DEBOUNCE_LIMIT times that, so a burst is one pass of the
+ * main loop.  Stop and restart are always handled at once.
+ */
+static void debounce(ddns_t *ctx)
 {
-	FILE *pipe;
-	int rc = 0;
+	static unsigned int handled;
+	long long now = event_msec(), limit = now + (long long)ctx->debounce * DDNS_DEBOUNCE_LIMIT;
 
-	snprintf(ctx->request_buf, ctx->request_buflen,
-		"INADYN_PROVIDER=\"%s\" INADYN_USER=\"%s\" %s",
-		info->system->name, info->creds.username, cmd);
+	while (ctx->cmd != CMD_STOP && ctx->cmd != CMD_RESTART) {
+		long long until = ctx->cmd_msec + ctx->debounce;
+		int msec, next;
 
-	logit(LOG_DEBUG, "Starting command to get my public IP#: %s", ctx->request_buf);
+		if (until > limit)
+			until = limit;
+		now = event_msec();
+		if (now >= until)
+			break;
 
-	pipe = popen(ctx->request_buf, "r");
-	if (!pipe) {
-		logit(LOG_ERR, "Cannot run '%s': %s", ctx->request_buf, strerror(errno));
-		return errno;
-	}
+		/* A flapping ha-state is a burst too, keep reading it */
+		msec = (int)(until - now);
+		next = ha_next();
+		if (next >= 0 && next < msec)
+			msec = next;
 
-	/* TODO: timeout on fread */
-	rc = fread(ctx->work_buf, 1, ctx->work_buflen, pipe);
-	if (rc < 0) {
-		logit(LOG_ERR, "Error running '%s': %s", ctx->request_buf, strerror(errno));
-		ctx->work_buf[0] = 0;
-		rc = errno;
-	} else if (rc == 0) {
-		logit(LOG_ERR, "Error running '%s': 0 bytes read", ctx->request_buf);
-		ctx->work_buf[0] = 0;
-		rc = RC_INVALID_POINTER;
-	} else {
-		logit(LOG_DEBUG, "Command '%s' returns %d bytes", ctx->request_buf, rc);
-		ctx->work_buf[rc] = 0;
-		rc = 0;
+		if (event_wait(msec) < 0)
+			break;
+		ha_poll(ctx);
 	}
-	pclose(pipe);
 
-	return rc;
-}
-
-static int get_req_for_ip_server(ddns_t *ctx, ddns_info_t *info)
-{
-	return snprintf(ctx->request_buf, ctx->request_buflen,
-			DYNDNS_CHECKIP_HTTP_REQUEST, info->checkip_url,
-			info->checkip_name.name, info->user_agent);
+	if (ctx->cmds - handled > 1)
+		logit(LOG_DEBUG, "Merged %u commands received in a burst.", ctx->cmds - handled);
+	handled = ctx->cmds;
 }
 
 /*
- * Send req to IP server and get the response
+ * Sleep until the next period, or until a command arrives.  Signals
+ * wake us up immediately through the self-pipe in the event loop, so
+ * there is no need for periodic wakeups to check ctx->cmd.
  */
-static int server_transaction(ddns_t *ctx, ddns_info_t *provider)
+static int wait_for_cmd(ddns_t *ctx)
 {
-	int rc = 0;
-	http_t *client;
-	http_trans_t *trans;
+	time_t deadline, warm;
 
-	if (!provider) {
-		logit(LOG_ERR, "Cannot query our address, invalid DDNS provider data!");
+	if (!ctx)
 		return RC_INVALID_POINTER;
-	}
 
-	client = &provider->checkip;
-	client->ssl_enabled = provider->checkip_ssl;
-	DO(http_init(client, "Checking for IP# change", strstr(provider->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4));
+	if (ctx->cmd != NO_CMD)
+		goto done;
 
-	/* Prepare request for IP server */
-	memset(ctx->work_buf, 0, ctx->work_buflen);
-	memset(ctx->request_buf, 0, ctx->request_buflen);
-	memset(&ctx->http_transaction, 0, sizeof(ctx->http_transaction));
+	deadline = event_now() + ctx->update_period;
+	warm     = ctx->prewarm > 0 && ctx->update_period > ctx->prewarm ? deadline - ctx->prewarm : 0;
+	while (ctx->cmd == NO_CMD) {
+		time_t remaining = deadline - event_now();
+		int msec, next;
 
-	trans              = &ctx->http_transaction;
-	trans->req_len     = get_req_for_ip_server(ctx, provider);
-	trans->req         = ctx->request_buf;
-	trans->rsp         = ctx->work_buf;
-	trans->max_rsp_len = ctx->work_buflen - 1;	/* Save place for terminating \0 in string. */
-
-	logit(LOG_DEBUG, "Querying DDNS checkip server for my public IP#: %s", ctx->request_buf);
-
-	rc = http_transaction(client, &ctx->http_transaction);
-	if (trans->status != 200)
-		rc = RC_DDNS_INVALID_CHECKIP_RSP;
-
-	http_exit(client);
-	logit(LOG_DEBUG, "Server response: %s", trans->rsp);
-	logit(LOG_DEBUG, "Checked my IP, return code %d: %s", rc, error_str(rc));
-
-	return rc;
-}
-
-/*
- * IP address validator, discards empty, local, loopback and other
- * globally invalid addresses
- */
-static int is_address_valid(int family, const char *host)
-{
-	/*
-	 * cloudflare would return requested hostname before client's ip address
-	 * block cloudflare ips so that https://1.1.1.1/cdn-cgi/trace would work
-	 * even if 1.1.1.1 is the first ip in the response body
-	 */
-	static const char *except[] = {
-		"1.1.1.1",
-		"1.0.0.1",
-		"2606:4700:4700::1111",
-		"2606:4700:4700::1001",
-		"1.1.1.2",
-		"1.0.0.2",
-		"2606:4700:4700::1112",
-		"2606:4700:4700::1002",
-		"1.1.1.3",
-		"1.0.0.3",
-		"2606:4700:4700::1113",
-		"2606:4700:4700::1003",
-		"2606:4700:4700::64",
-		"2606:4700:4700::6400"
-	};
-	size_t i;
+		if (remaining <= 0)
+			break;
+		if (remaining > INT32_MAX / 1000)
+			remaining = INT32_MAX / 1000;
 
-	for (i = 0; i < NELEMS(except); i++) {
-		if (!strncmp(host, except[i], strlen(host))) {
-			return 0;
+		/* Connect to the servers of the providers due next */
+		if (warm && event_now() >= warm) {
+			warm = 0;
+			prewarm(ctx, deadline);
+			continue;
 		}
+		if (warm && warm - event_now() < remaining)
+			remaining = warm - event_now();
+
+		/* Wake up in time to kill a hook that runs for too long */
+		msec = remaining * 1000;
+		next = hook_next();
+		if (next >= 0 && next < msec)
+			msec = next;
+
+		/* ... and to close pre-warmed connections not used */
+		next = prewarm_idle();
+		if (next >= 0 && next < msec)
+			msec = next;
+
+		/* ... and to tell the service watchdog we are alive */
+		notify_watchdog();
+		next = notify_next();
+		if (next >= 0 && next < msec)
+			msec = next;
+
+		/* ... and to see if we have become the active node */
+		next = ha_next();
+		if (next >= 0 && next < msec)
+			msec = next;
+
+		if (event_wait(msec) < 0)
+			sleep(1);	/* Avoid busy loop on poll() error */
+		hook_reap();
+		ha_poll(ctx);
 	}
+done:
+	if (ctx->cmd != NO_CMD && ctx->debounce > 0)
+		debounce(ctx);
 
-	if (!verify_addr) {
-		logit(LOG_DEBUG, "IP address validation disabled, %s is thus valid.", host);
-		return 1;
-	}
-
-	if (family == AF_INET) {
-		in_addr_t addr;
-		struct in_addr address;
-
-		logit(LOG_DEBUG, "Checking IPv4 address %s ...", host);
-		if (!inet_pton(family, host, &address))
-			goto error;
-
-		addr = ntohl(address.s_addr);
-		if (IN_ZERONET(addr)   || IN_LOOPBACK(addr) || IN_LINKLOCAL(addr) ||
-		    IN_MULTICAST(addr) || IN_EXPERIMENTAL(addr))
-			goto error;
-
-		logit(LOG_DEBUG, "IPv4 address %s is valid.", host);
-		return 1;
-	}
-
-	if (!allow_ipv6) {
-		logit(LOG_INFO, "IPv6 address disallowed, enable with 'allow-ipv6 = true'");
-		return 0;
-	}
-
-	if (family == AF_INET6) {
-		struct in6_addr address, *addr = &address;
-
-		logit(LOG_DEBUG, "Checking IPv6 address %s ...", host);
-		if (!inet_pton(family, host, &address))
-			goto error;
-
-		if (IN6_IS_ADDR_UNSPECIFIED(addr) || IN6_IS_ADDR_LOOPBACK(addr) ||
-		    IN6_IS_ADDR_LINKLOCAL(addr)   || IN6_IS_ADDR_SITELOCAL(addr))
-			goto error;
-
-		logit(LOG_DEBUG, "IPv6 address %s is valid.", host);
-		return 1;
-	}
-
-error:
-	logit(LOG_WARNING, "IP%s address %s is not a valid Internet address.",
-	      family == AF_INET ? "v4" : family == AF_INET6 ? "v6" : "", host);
 	return 0;
 }
 
-static int parse_ipv4_address(char *buffer, char *address, size_t len)
+static int shell_transaction(ddns_t *ctx, ddns_info_t *info, const char *cmd)
 {
-	int found = 0;
-	static const char *accept = "0123456789.";
-	char *needle, *haystack, *end;
-	struct in_addr  addr;
-
-	haystack = buffer;
-	needle   = haystack;
-	end      = haystack + strlen(haystack) - 1;
-	while (needle && haystack < end) {
-		char ch;
-		size_t num = 0;
+	ssize_t len;
 
-		needle = strpbrk(haystack, accept);
-		if (needle) {
-			num = strspn(needle, accept);
-			if (num) {
-				ch = needle[num];
-				needle[num] = 0;
-
-				if (inet_pton(AF_INET, needle, &addr) == 1) {
-					inet_ntop(AF_INET, &addr, address, len);
-					if (is_address_valid(AF_INET, address)) {
-						found = 1;
-						break;
-					}
-				}
-
-				needle[num] = ch;
-			}
-		}
+	logit(LOG_DEBUG, "Starting command to get my public IP#: %s", cmd);
 
-		/* nothing yet, skip to next search point */
-		haystack = needle + num + 1;
+	len = os_shell_read(cmd, info->system->name, info->creds.username, ctx->work_buf->data,
+			    ctx->work_buf->size, info->checkip_cmd_timeout * 1000);
+	if (len < 0) {
+		if (errno == ETIMEDOUT)
+			logit(LOG_ERR, "Command '%s' did not finish in %d sec, killed.", cmd,
+			      info->checkip_cmd_timeout);
+		else
+			logit(LOG_ERR, "Error running '%s': %s", cmd, strerror(errno));
+		return RC_DDNS_INVALID_CHECKIP_RSP;
 	}
-
-	return found;
-}
-
-static int parse_ipv6_address(char *buffer, char *address, size_t len)
-{
-	int found = 0;
-	static const char *accept = "0123456789abcdefABCDEF:";
-	char *needle, *haystack, *end;
-	struct in6_addr addr;
-
-	haystack = buffer;
-	needle   = haystack;
-	end      = haystack + strlen(haystack) - 1;
-	while (needle && haystack < end) {
-		char ch;
-		size_t num = 0;
-
-		needle = strpbrk(haystack, accept);
-		if (needle) {
-			num = strspn(needle, accept);
-			if (num) {
-				ch = needle[num];
-				needle[num] = 0;
-
-				if (inet_pton(AF_INET6, needle, &addr) == 1) {
-					inet_ntop(AF_INET6, &addr, address, len);
-					if (is_address_valid(AF_INET6, address)) {
-						found = 1;
-						break;
-					}
-				}
-
-				needle[num] = ch;
-			}
-		}
-
-		/* nothing yet, skip to next search point */
-		haystack = needle + num + 1;
+	if (len == 0) {
+		logit(LOG_ERR, "Error running '%s': 0 bytes read", cmd);
+		return RC_DDNS_INVALID_CHECKIP_RSP;
 	}
 
-	return found;
-}
-
-static int parse_my_address(char *buffer, char *address, size_t len)
-{
-	if (parse_ipv6_address(buffer, address, len))
-		return 0;
-
-	return !parse_ipv4_address(buffer, address, len);
-}
-
-static int get_address_remote(ddns_t *ctx, ddns_info_t *info, char *address, size_t len)
-{
-	if (!info->server_url[0])
-		return 1;
-
-	DO(server_transaction(ctx, info));
-	if (!ctx || ctx->http_transaction.rsp_len <= 0 || !ctx->http_transaction.rsp)
-		return RC_INVALID_POINTER;
-
-	logit(LOG_DEBUG, "IP server response:");
-	logit(LOG_DEBUG, "%s", ctx->work_buf);
-
-	DO(parse_my_address(ctx->http_transaction.rsp_body, address, len));
+	logit(LOG_DEBUG, "Command '%s' returns %zd bytes", cmd, len);
 
 	return 0;
 }
 
-static int get_address_cmd(ddns_t *ctx, ddns_info_t *info, char *address, size_t len)
+static int get_address_cmd(ddns_t *ctx, ddns_info_t *info, int family, char *address, size_t len)
 {
 	DO(shell_transaction(ctx, info, info->checkip_cmd));
 	logit(LOG_DEBUG, "Command response:");
-	logit(LOG_DEBUG, "%s", ctx->work_buf);
+	logit(LOG_DEBUG, "%s", ctx->work_buf->data);
 
-	DO(parse_my_address(ctx->work_buf, address, len));
+	DO(parse_family_address(family, ctx->work_buf->data, address, len));
 
 	return 0;
 }
@@ -395,542 +281,2610 @@ static int get_ipv4_address_iface(const char *ifname, char *address, size_t len)
 	return 0;
 }
 
-static int get_address_iface(ddns_t *ctx, const char *ifname, char *address, size_t len)
+static int get_address_iface(const char *ifname, int family, char *address, size_t len)
 {
-	char *ptr, trailer[IFNAMSIZ + 2];
-	struct ifaddrs *ifaddr, *ifa;
-
-	/* Trailer to strip, if set by getnameinfo() */
-	snprintf(trailer, sizeof(trailer), "%%%s", ifname);
+	int rc;
 
 	logit(LOG_INFO, "Checking for IP# change, querying interface %s", ifname);
-	if (getifaddrs(&ifaddr))
+	rc = ifmon_address(ifname, family, address, len);
+	if (rc < 0 && family != AF_INET6)
 		return get_ipv4_address_iface(ifname, address, len);
 
-	memset(ctx->work_buf, 0, ctx->work_buflen);
-	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
-		int result, family;
-		char host[NI_MAXHOST] = "";
-		size_t pos;
-
-		if (!ifa->ifa_addr)
-			continue;
-
-		if (!string_compare(ifa->ifa_name, ifname))
-			continue;
+	return rc;
+}
 
-		pos = strlen(ctx->work_buf);
-		family = ifa->ifa_addr->sa_family;
-		if (family == AF_INET || family == AF_INET6) {
-			result = getnameinfo(ifa->ifa_addr, ((family == AF_INET)
-							     ? sizeof(struct sockaddr_in)
-							     : sizeof(struct sockaddr_in6)),
-					     host, NI_MAXHOST,
-					     NULL, 0, NI_NUMERICHOST);
-
-			if (result) {
-				logit(LOG_ERR, "getnameinfo() failed: %s", gai_strerror(result));
-				continue;
-			}
+/* One checkip server in a race, see get_address_remote() */
+struct checkip_query {
+	ddns_checkip_t *srv;
+	int             family;	/* AF_UNSPEC: any, from provider name */
+	http_trans_t    trans;
+	buf_t          *req;
+	buf_t          *rsp;
+	long long       start;
+	int             retried;
+	int             done;	/* 1: valid address, -1: failed */
+	char            address[MAX_ADDRESS_LEN];
+};
+
+/* Backup servers last, then those that fail less, then the fastest */
+static int checkip_cmp(const void *a, const void *b)
+{
+	const ddns_checkip_t *x = *(ddns_checkip_t * const *)a;
+	const ddns_checkip_t *y = *(ddns_checkip_t * const *)b;
 
-			ptr = strstr(host, trailer);
-			if (ptr)
-				*ptr = 0;
+	if (x->backup != y->backup)
+		return x->backup - y->backup;
+	if (x->fails != y->fails)
+		return x->fails < y->fails ? -1 : 1;
 
-			if (!is_address_valid(family, host)) {
-				logit(LOG_INFO, "Invalid/local address %s for %s, skipping ...", host, ifname);
-				continue;
-			}
+	return x->rtt - y->rtt;
+}
 
-			snprintf(&ctx->work_buf[pos], ctx->work_buflen - pos, "%s\n", host);
-		}
-	}
+/* Time to give the last started server before hedging with the next */
+static long long checkip_delay(ddns_checkip_t *srv)
+{
+	long long delay = srv->rtt ? 2 * srv->rtt : DDNS_CHECKIP_MAX_DELAY;
 
-	freeifaddrs(ifaddr);
-	DO(parse_my_address(ctx->work_buf, address, len));
+	if (delay < DDNS_CHECKIP_MIN_DELAY)
+		return DDNS_CHECKIP_MIN_DELAY;
+	if (delay > DDNS_CHECKIP_MAX_DELAY)
+		return DDNS_CHECKIP_MAX_DELAY;
 
-	return 0;
+	return delay;
 }
 
-static int get_address_backend(ddns_t *ctx, ddns_info_t *info, char *address, size_t len)
+static void checkip_start(ddns_t *ctx, ddns_info_t *info, struct checkip_query *q)
 {
-	char name[sizeof(info->checkip_name.name)];
-	char url[sizeof(info->checkip_url)];
-	int ssl, rc;
+	ddns_checkip_t *srv = q->srv;
+	int force = strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4;
+	int rc;
+
+	if (q->family != AF_UNSPEC)
+		force = q->family == AF_INET6 ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4;
+
+	q->start = event_msec();
+	srv->client.rc = RC_OUT_OF_MEMORY;
+	if (!q->req)
+		q->req = buf_get(ctx->pool, DDNS_HTTP_REQUEST_BUFFER_SIZE);
+	if (!q->rsp)
+		q->rsp = buf_get(ctx->pool, DDNS_HTTP_RESPONSE_BUFFER_SIZE);
+	if (!q->req || !q->rsp)
+		return;
+
+	q->trans.req_len = snprintf(q->req->data, q->req->size, DYNDNS_CHECKIP_HTTP_REQUEST,
+				    srv->url, srv->name.name, info->user_agent);
+	q->trans.req     = q->req->data;
+	q->trans.buf     = q->rsp;
+	if (q->trans.req_len < 0 || (size_t)q->trans.req_len >= q->req->size) {
+		srv->client.rc = RC_BUFFER_OVERFLOW;
+		return;
+	}
 
-	logit(LOG_DEBUG, "Get address for %s", info->system->name);
-	memset(address, 0, len);
+	logit(LOG_DEBUG, "Querying checkip server %s for my public IP#: %s", srv->name.name, q->trans.req);
+	srv->client.ssl_enabled = srv->ssl;
+	http_reuse(&srv->client);
+	rc = http_start(&srv->client, &q->trans, "Checking for IP# change", force);
+	if (!HTTP_PENDING(rc))
+		srv->client.rc = rc;
+}
 
-	if (info->checkip_cmd && info->checkip_cmd[0]) {
-		/* Get address from command */
-		return get_address_cmd(ctx, info, address, len);
-	}
-	
-	if (info->ifname && info->ifname[0]) {
-		/* Get address from specific interface */
-		return get_address_iface(ctx, info->ifname, address, len);
-	}
-	
-	if (iface && iface[0]) {
-		/* Get address from global interface */
-		return get_address_iface(ctx, iface, address, len);
+/* Conversation done, check the reply and update server statistics */
+static void checkip_finish(ddns_t *ctx, ddns_info_t *info, struct checkip_query *q)
+{
+	ddns_checkip_t *srv = q->srv;
+	http_t *client = &srv->client;
+	int elapsed = (int)(event_msec() - q->start);
+	int rc = client->rc;
+
+	/* Server may have closed a kept-alive connection, retry once */
+	if (rc && client->reused && q->trans.rsp_len == 0 && !q->retried) {
+		logit(LOG_DEBUG, "Kept-alive connection to %s lost, reconnecting", srv->name.name);
+		http_exit(client);
+		q->retried = 1;
+		checkip_start(ctx, info, q);
+		if (HTTP_PENDING(client->rc))
+			return;
+		rc = client->rc;
 	}
 
-	/* Get address from remote service */
-	if (!get_address_remote(ctx, info, address, len))
-		return 0;
+	if (!rc && q->trans.status != 200)
+		rc = RC_DDNS_INVALID_CHECKIP_RSP;
+	if (!rc) {
+		logit(LOG_DEBUG, "Server response: %s", q->trans.rsp);
+		if (parse_family_address(q->family, q->trans.rsp_body, q->address, sizeof(q->address)))
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+	http_release(client);
 
-	logit(LOG_WARNING, "Communication with checkip server %s failed, "
-	      "run again with 'inadyn -l debug' if problem persists",
-	      info->checkip_name.name);
+	if (rc) {
+		logit_limit(LOG_WARNING, "Communication with checkip server %s failed, "
+		      "run again with 'inadyn -l debug' if problem persists: %s",
+		      srv->name.name, error_str(rc));
+		srv->fails++;
+		breaker_failure(&srv->breaker, srv->name.name);
+		cache_touch();
+		q->done = -1;
+		return;
+	}
 
-	/* Skip fallback if it's the same server ... option: flip SSL bit? */
-	if (strstr(info->checkip_name.name, DDNS_MY_IP_SERVER))
-		goto error;
+	logit(LOG_DEBUG, "Checkip server %s says %s, in %d msec", srv->name.name, q->address, elapsed);
+	if (srv->breaker.fails)
+		cache_touch();
+	breaker_success(&srv->breaker, srv->name.name);
+	srv->rtt   = srv->rtt ? (3 * srv->rtt + elapsed) / 4 : elapsed;
+	srv->fails = 0;
+	q->done    = 1;
+}
 
-	logit(LOG_WARNING, "Retrying with built-in 'default', http://ifconfig.me/ip ...");
+/* Most replies agreeing on the same address, copied to @address */
+static int checkip_agree(struct checkip_query *q, int num, char *address, size_t len)
+{
+	int i, j, best = 0;
 
-	/* keep backup, for now, future extension: count failures and replace permanently */
-	strlcpy(name, info->checkip_name.name, sizeof(name));
-	strlcpy(url, info->checkip_url, sizeof(url));
-	ssl = info->checkip_ssl;
+	for (i = 0; i < num; i++) {
+		int votes = 0;
 
-	/* Retry with http(s)://ifconfig.me/ip */
-	strlcpy(info->checkip_name.name, DDNS_MY_IP_SERVER, sizeof(info->checkip_name.name));
-	strlcpy(info->checkip_url, DDNS_MY_CHECKIP_URL, sizeof(info->checkip_url));
-	info->checkip_ssl = DDNS_MY_IP_SSL;
-	rc = get_address_remote(ctx, info, address, len);
+		if (q[i].done != 1)
+			continue;
 
-	/* restore backup, for now, the official server may just have temporary problems */
-	strlcpy(info->checkip_name.name, name, sizeof(info->checkip_name.name));
-	strlcpy(info->checkip_url, url, sizeof(info->checkip_url));
-	info->checkip_ssl = ssl;
+		for (j = 0; j < num; j++) {
+			if (q[j].done == 1 && !strcmp(q[i].address, q[j].address))
+				votes++;
+		}
 
-	if (!rc) {
-		logit(LOG_WARNING, "Please note, http%s://%s%s seems unstable, consider overriding it in"
-		      "your configuration with 'checkip-server = default'", info->checkip_ssl ? "s" : "",
-		      info->checkip_name.name, info->checkip_url);
-		return 0;
+		if (votes > best) {
+			strlcpy(address, q[i].address, len);
+			best = votes;
+		}
 	}
 
-error:
-	logit(LOG_ERR, "Failed to get IP address for %s, giving up!", info->system->name);
-
-	return 1;
+	return best;
 }
 
 /*
- * Fetch IP, using any of the backends for each DDNS provider,
- * then check for address change.
+ * Race the checkip servers.  The best ones, by past failures and reply
+ * time, are started first.  With the default quorum of one the first
+ * valid reply wins, otherwise we wait until @quorum servers agree on
+ * the address.  Another server is started whenever one fails, or when
+ * the last one started is slower than usual, so a single slow server
+ * no longer holds up the check.  The backup, the built-in default, is
+ * only tried when all others have failed, or are skipped because their
+ * circuit breaker is open, see breaker.c.
  */
-static int get_address(ddns_t *ctx)
+static int get_address_remote(ddns_t *ctx, ddns_info_t *info, int family, char *address, size_t len)
 {
-	char address[MAX_ADDRESS_LEN];
-	ddns_info_t *info;
+	struct checkip_query q[DDNS_MAX_CHECKIP + 1];
+	ddns_checkip_t *order[DDNS_MAX_CHECKIP + 1];
+	http_t *clients[DDNS_MAX_CHECKIP + 1];
+	int num = 0, primary = 0, started = 0, quorum, votes = 0, i;
+	long long next = 0;
 
-	info = conf_info_iterator(1);
-	while (info) {
-		int anychange = 0;
-		size_t i;
+	if (!info->server_url[0] || !info->checkip_num)
+		return 1;
 
-		if (get_address_backend(ctx, info, address, sizeof(address)))
-			goto next;
+	for (i = 0; i < (int)info->checkip_num; i++) {
+		ddns_checkip_t *srv = &info->checkip[i];
 
-		for (i = 0; i < info->alias_count; i++) {
-			ddns_alias_t *alias = &info->alias[i];
+		if (!breaker_allow(&srv->breaker, srv->name.name))
+			continue;
 
-			alias->ip_has_changed = strncmp(alias->address, address, sizeof(alias->address)) != 0;
-			if (alias->ip_has_changed) {
-				anychange++;
-				strlcpy(alias->address, address, sizeof(alias->address));
+		order[num++] = srv;
+		if (!srv->backup)
+			primary++;
+	}
+	if (!num) {
+		logit_limit(LOG_WARNING, "All checkip servers of %s are failing, skipping check.",
+			    info->system->name);
+		return 1;
+	}
+	qsort(order, num, sizeof(order[0]), checkip_cmp);
+
+	quorum = info->checkip_quorum;
+	if (quorum > primary)
+		quorum = primary > 0 ? primary : 1;
+
+	memset(q, 0, sizeof(q));
+	while (1) {
+		int active = 0;
+
+		for (i = 0; i < started; i++) {
+			if (q[i].done)
+				continue;
+
+			if (!HTTP_PENDING(q[i].srv->client.rc))
+				checkip_finish(ctx, info, &q[i]);
+			if (!q[i].done)
+				active++;
+		}
+
+		votes = checkip_agree(q, started, address, len);
+		if (votes >= quorum)
+			break;
+
+		/* Start another if too few left to reach quorum, or hedge a slow one */
+		if (started < num) {
+			int backup = order[started]->backup;
+
+			if ((!backup && (active + votes < quorum || event_msec() >= next)) ||
+			    ( backup && !active)) {
+				if (backup)
+					logit(LOG_WARNING, "Retrying with built-in 'default', http%s://%s%s ...",
+					      order[started]->ssl ? "s" : "", order[started]->name.name,
+					      order[started]->url);
+
+				q[started].srv    = order[started];
+				q[started].family = family;
+				clients[started] = &order[started]->client;
+				checkip_start(ctx, info, &q[started]);
+				next = event_msec() + checkip_delay(order[started]);
+				started++;
+				continue;
 			}
+		}
 
-#ifdef ENABLE_SIMULATION
-			logit(LOG_WARNING, "In simulation, forcing IP# change ...");
-			alias->ip_has_changed = 1;
-#endif
+		if (!active)
+			break;
+
+		/* Wake up to hedge, unless only the backup remains */
+		if (http_poll_once(clients, started, started < num && !order[started]->backup ? next : 0) < 0)
+			break;
+	}
+
+	/* Still running, not needed anymore, but at least this slow */
+	for (i = 0; i < started; i++) {
+		ddns_checkip_t *srv = q[i].srv;
+
+		if (!q[i].done && http_cancel(&srv->client)) {
+			int elapsed = (int)(event_msec() - q[i].start);
+
+			if (srv->rtt < elapsed)
+				srv->rtt = elapsed;
 		}
+		buf_put(ctx->pool, q[i].req);
+		buf_put(ctx->pool, q[i].rsp);
+	}
 
-		if (!anychange)
-			logit(LOG_INFO, "No IP# change detected for %s, still at %s", info->system->name, address);
-		else
-			logit(LOG_INFO, "Current IP# %s at %s", address, info->system->name);
+	if (votes < quorum) {
+		logit_limit(LOG_WARNING, "No %d checkip servers agree on the address for %s", quorum, info->system->name);
+		return 1;
+	}
 
-	next:
-		info = conf_info_iterator(0);
+	for (i = 0; i < started; i++) {
+		if (q[i].done != 1 || !q[i].srv->backup || quorum > 1)
+			continue;
+
+		logit_limit(LOG_WARNING, "Please note, the checkip server(s) seem unstable, consider overriding "
+		      "in your configuration with 'checkip-server = default'");
+		break;
 	}
 
 	return 0;
 }
 
-static int time_to_check(ddns_t *ctx, ddns_alias_t *alias)
+/* Gateway, STUN, or DNS, discovery of the address */
+static int get_address_udp(ddns_t *ctx, ddns_info_t *info, int family, char *address, size_t len)
 {
-	time_t past_time = time(NULL) - alias->last_update;
+	int rc = 1;
+
+	/* The gateway only knows its own, usually IPv4, address */
+	if (info->checkip_gateway && family != AF_INET6) {
+		logit(LOG_DEBUG, "Asking gateway with %s for my public IP#", gateway_name(info->checkip_gateway));
+		rc = gateway_address(info->checkip_gateway, info->checkip_gateway_addr, address, len);
+		if (!rc && !is_address_valid(family, address)) {
+			logit_limit(LOG_WARNING, "Gateway has no public address (%s), double NAT?", address);
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+		}
+		if (!rc)
+			return 0;
 
-	return alias->force_addr_update ||
-		(past_time > ctx->forced_update_period_sec);
-}
+		logit_limit(LOG_WARNING, "Failed getting address from gateway with %s: %s",
+		      gateway_name(info->checkip_gateway), error_str(rc));
+	}
 
-static int check_alias_update_table(ddns_t *ctx)
-{
-	ddns_info_t *info;
+	if (info->checkip_stun.name[0]) {
+		logit(LOG_DEBUG, "Querying STUN server %s for my public IP#", info->checkip_stun.name);
+		rc = discover_stun(info->checkip_stun.name, info->checkip_stun.port, family, address, len);
+		if (!rc && !is_address_valid(family, address))
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+		if (!rc)
+			return 0;
 
-	/* Uses fix test if ip of server 0 has changed.
-	 * That should be OK even if changes check_address() to
-	 * iterate over servernum, but not if it's fix set to =! 0 */
-	info = conf_info_iterator(1);
-	while (info) {
-		size_t i;
+		logit_limit(LOG_WARNING, "Failed getting address from STUN server %s: %s",
+		      info->checkip_stun.name, error_str(rc));
+	}
 
-		for (i = 0; i < info->alias_count; i++) {
-			int override;
-			ddns_alias_t *alias = &info->alias[i];
+	if (info->checkip_dns) {
+		logit(LOG_DEBUG, "Querying %s DNS for my public IP#", discover_dns_name(info->checkip_dns));
+		rc = discover_dns(info->checkip_dns, family, address, len);
+		if (!rc && !is_address_valid(family, address))
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+		if (!rc)
+			return 0;
+
+		logit_limit(LOG_WARNING, "Failed getting address from %s DNS: %s",
+		      discover_dns_name(info->checkip_dns), error_str(rc));
+	}
+
+	if (rc != 1)
+		logit_limit(LOG_WARNING, "Falling back to checkip server(s) ...");
+	memset(address, 0, len);
+
+	return 1;
+}
 
-/* XXX: TODO time_to_check() will return false positive if the cache
- *     file is missing => causing unnecessary update.  We should save
- *     the cache file with the current IP instead and fall back to
- *     standard update interval!
+/*
+ * Address lookups done this cycle, shared by all providers using the
+ * same source.  Keyed by backend, source and address family, i.e. the
+ * command, the interface, or the set of checkip servers.  Dual-stack
+ * providers look up one address of each family, strictly, the others
+ * take the first valid address found, IPv6 preferred.
  */
-			override = time_to_check(ctx, alias);
-			if (!alias->ip_has_changed && !override) {
-				alias->update_required = 0;
-				continue;
-			}
+enum {
+	LOOKUP_CMD,
+	LOOKUP_IFACE,
+	LOOKUP_REMOTE,
+};
+
+struct lookup {
+	int          type;
+	int          family;
+	int          strict;	/* Only addresses of @family */
+	ddns_info_t *info;	/* First provider using this source */
+	const char  *ifname;
+	int          rc;
+	char         address[MAX_ADDRESS_LEN];
+};
+
+static int same_checkip(ddns_info_t *a, ddns_info_t *b)
+{
+	size_t i;
 
-			alias->update_required = 1;
-			logit(LOG_NOTICE, "Update %s for alias %s, new IP# %s",
-			      override ? "forced" : "needed", alias->name, alias->address);
-		}
+	if (a->checkip_num != b->checkip_num || a->checkip_quorum != b->checkip_quorum)
+		return 0;
 
-		info = conf_info_iterator(0);
+	for (i = 0; i < a->checkip_num; i++) {
+		ddns_checkip_t *x = &a->checkip[i];
+		ddns_checkip_t *y = &b->checkip[i];
+
+		if (strcmp(x->name.name, y->name.name) || x->name.port != y->name.port ||
+		    strcmp(x->url, y->url) || x->ssl != y->ssl)
+			return 0;
 	}
 
-	return 0;
+	if (strcmp(a->checkip_stun.name, b->checkip_stun.name) || a->checkip_stun.port != b->checkip_stun.port ||
+	    a->checkip_dns != b->checkip_dns)
+		return 0;
+
+	if (a->checkip_gateway != b->checkip_gateway || strcmp(a->checkip_gateway_addr, b->checkip_gateway_addr))
+		return 0;
+
+	/* Different proxies may well see different addresses */
+	return a->proxy_type == b->proxy_type && !strcmp(a->proxy_name.name, b->proxy_name.name) &&
+		a->proxy_name.port == b->proxy_name.port;
 }
 
-static int send_update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int *changed)
+static int same_str(const char *a, const char *b)
 {
-	int            rc;
-	http_trans_t   trans;
-	http_t        *client = &info->server;
+	if (!a || !b)
+		return a == b;
 
-	if (info->system->setup)
-		DO(info->system->setup(ctx, info, alias));
+	return !strcmp(a, b);
+}
 
-	client->ssl_enabled = info->ssl_enabled;
-	rc = http_init(client, "Sending IP# update to DDNS server", strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
-	if (rc) {
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
-		alias->force_addr_update = 1;
-		return rc;
-	}
+/* Same configuration?  On reload the state of unchanged providers is kept */
+int ddns_same_provider(ddns_info_t *a, ddns_info_t *b)
+{
+	size_t i;
 
-	memset(ctx->work_buf, 0, ctx->work_buflen);
-	memset(ctx->request_buf, 0, ctx->request_buflen);
-	memset(&trans, 0, sizeof(trans));
+	if (a->system != b->system || a->id != b->id)
+		return 0;
 
-	trans.req_len     = info->system->request(ctx, info, alias);
-	trans.req         = (char *)ctx->request_buf;
-	trans.rsp         = (char *)ctx->work_buf;
-	trans.max_rsp_len = ctx->work_buflen - 1;	/* Save place for a \0 at the end */
+	if (strcmp(a->creds.username, b->creds.username) || strcmp(a->creds.password, b->creds.password))
+		return 0;
 
-	if (trans.req_len < 0) {
-		logit(LOG_ERR, "Invalid HTTP GET request in %s provider, cannot update.", info->system->name);
-		rc = RC_ERROR;
+	if (strcmp(a->server_name.name, b->server_name.name) || a->server_name.port != b->server_name.port ||
+	    strcmp(a->server_url, b->server_url))
+		return 0;
 
-		goto exit;
+	if (a->server_response_num != b->server_response_num)
+		return 0;
+	for (i = 0; i < a->server_response_num; i++) {
+		if (strcmp(a->server_response[i], b->server_response[i]))
+			return 0;
 	}
 
-	ctx->request_buf[trans.req_len] = 0;
-	logit(LOG_DEBUG, "Sending alias table update to DDNS server: %s", ctx->request_buf);
+	if (!same_str(a->ifname, b->ifname) || !same_str(a->checkip_cmd, b->checkip_cmd) ||
+	    a->checkip_cmd_timeout != b->checkip_cmd_timeout || !same_checkip(a, b))
+		return 0;
+
+	if (a->alias_count != b->alias_count)
+		return 0;
+	for (i = 0; i < a->alias_count; i++) {
+		if (strcmp(a->alias[i].name, b->alias[i].name))
+			return 0;
+	}
+
+	if (a->wildcard != b->wildcard || a->ttl != b->ttl || a->proxied != b->proxied ||
+	    a->ssl_enabled != b->ssl_enabled || a->http2 != b->http2 || a->append_myip != b->append_myip ||
+	    a->verify_record != b->verify_record || a->dual_stack != b->dual_stack)
+		return 0;
+
+	if (a->period != b->period || a->retry_period != b->retry_period ||
+	    a->forced_update != b->forced_update || a->budget != b->budget)
+		return 0;
+
+	if (a->quota != b->quota || a->quota_period != b->quota_period)
+		return 0;
+
+	return same_str(a->user_agent, b->user_agent);
+}
+
+static struct lookup *lookup_find(struct lookup *cache, size_t num, struct lookup *key)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		struct lookup *l = &cache[i];
+
+		if (l->type != key->type || l->family != key->family || l->strict != key->strict)
+			continue;
+
+		switch (key->type) {
+		case LOOKUP_CMD:
+			if (!strcmp(l->info->checkip_cmd, key->info->checkip_cmd))
+				return l;
+			break;
+
+		case LOOKUP_IFACE:
+			if (!strcmp(l->ifname, key->ifname))
+				return l;
+			break;
+
+		default:
+			if (same_checkip(l->info, key->info))
+				return l;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Key of the checkip setup of @l, for shared-discovery.  Instances that
+ * ask the same servers, the same way, through the same proxy, share
+ * the address, see share.c.  Empty key on failure, nothing is shared.
+ */
+static void checkip_key(struct lookup *l, char *key)
+{
+	unsigned char digest[HASH_MAX_SIZE];
+	ddns_info_t *info = l->info;
+	hash_ctx_t hash;
+	char buf[SERVER_NAME_LEN + SERVER_URL_LEN + 64];
+	size_t i;
+
+	key[0] = 0;
+	if (hash_init(&hash, HASH_SHA256))
+		return;
+
+	for (i = 0; i < info->checkip_num; i++) {
+		ddns_checkip_t *srv = &info->checkip[i];
+
+		snprintf(buf, sizeof(buf), "%s:%d%s %d\n", srv->name.name, srv->name.port, srv->url, srv->ssl);
+		hash_update(&hash, buf, strlen(buf));
+	}
+
+	snprintf(buf, sizeof(buf), "%d %s:%d %d %d %s %d\n", info->checkip_quorum, info->checkip_stun.name,
+		 info->checkip_stun.port, info->checkip_dns, info->checkip_gateway,
+		 info->checkip_gateway_addr, l->strict);
+	hash_update(&hash, buf, strlen(buf));
+	snprintf(buf, sizeof(buf), "%d %s:%d\n", info->proxy_type, info->proxy_name.name, info->proxy_name.port);
+	hash_update(&hash, buf, strlen(buf));
+
+	if (!hash_final(&hash, digest))
+		hash_hex(digest, hash_size(HASH_SHA256), key);
+}
+
+static int get_address_source(ddns_t *ctx, struct lookup *l, char *address, size_t len)
+{
+	ddns_info_t *info = l->info;
+	int family = l->strict ? l->family : AF_UNSPEC;
+	char key[SHARE_KEY_LEN + 1] = "";
+
+	switch (l->type) {
+	case LOOKUP_CMD:
+		return get_address_cmd(ctx, info, family, address, len);
+
+	case LOOKUP_IFACE:
+		/* Kernel has not reported any address change since last time */
+		if (!l->strict && ifmon_active() && info->ifgen == ifmon_generation()) {
+			logit(LOG_DEBUG, "No address change reported for interface %s", l->ifname);
+			strlcpy(address, info->ifaddr, len);
+			return 0;
+		}
+
+		/* Get address from specific, or global, interface */
+		return get_address_iface(l->ifname, family, address, len);
+
+	default:
+		/* Another instance on this host may already have looked */
+		if (share_enabled()) {
+			checkip_key(l, key);
+			if (key[0] && !share_lookup(key, l->family, 2 * ctx->normal_update_period_sec, address, len))
+				return 0;
+		}
+
+		/* One UDP round-trip, if set up, before trying any HTTP checkip */
+		if (!get_address_udp(ctx, info, l->family, address, len))
+			goto found;
+
+		/* Get address from remote service(s) */
+		if (!get_address_remote(ctx, info, family, address, len))
+			goto found;
+
+		logit_limit(LOG_ERR, "Failed to get IP address for %s, giving up!", info->system->name);
+		return 1;
+	found:
+		if (key[0])
+			share_publish(key, l->family, address);
+		return 0;
+	}
+}
+
+/*
+ * Look up the address of @info, unless another provider already did
+ * this cycle using the same source.  @cache has room for two entries
+ * per provider, @num is the number of entries in use.  @family is
+ * AF_UNSPEC for any address, or the family of a dual-stack lookup.
+ */
+static int get_address_backend(ddns_t *ctx, ddns_info_t *info, int family, struct lookup *cache,
+			       size_t *num, char *address, size_t len)
+{
+	struct lookup key = { 0 }, *l;
+	long long t = trace_start();
+
+	logit(LOG_DEBUG, "Get address for %s", info->system->name);
+	PROBE(address__start, info->system->name, family);
+	memset(address, 0, len);
+
+	key.info   = info;
+	key.strict = family != AF_UNSPEC;
+	if (key.strict)
+		key.family = family;
+	else
+		key.family = strstr(info->system->name, "ipv6") ? AF_INET6 : AF_INET;
+	if (info->checkip_cmd && info->checkip_cmd[0]) {
+		key.type   = LOOKUP_CMD;
+	} else if ((info->ifname && info->ifname[0]) || (iface && iface[0])) {
+		key.type   = LOOKUP_IFACE;
+		key.ifname = info->ifname && info->ifname[0] ? info->ifname : iface;
+	} else {
+		key.type   = LOOKUP_REMOTE;
+	}
+
+	l = lookup_find(cache, *num, &key);
+	if (l) {
+		logit(LOG_DEBUG, "Reusing address looked up for %s", l->info->system->name);
+	} else {
+		l  = &cache[(*num)++];
+		*l = key;
+		l->rc = get_address_source(ctx, l, l->address, sizeof(l->address));
+	}
+
+	PROBE(address__done, info->system->name, l->rc, l->address);
+	trace_span(t, "discovery", "address %s", info->system->name);
+	if (l->rc)
+		return l->rc;
+
+	strlcpy(address, l->address, len);
+	if (key.type == LOOKUP_IFACE && !key.strict) {
+		strlcpy(info->ifaddr, address, sizeof(info->ifaddr));
+		info->ifgen = ifmon_generation();
+	}
+
+	return 0;
+}
+
+/* Compare with the aliases of @family, all for AF_UNSPEC, returns number changed */
+static int check_aliases(ddns_info_t *info, int family, const char *address)
+{
+	ddns_addr_t addr;
+	int anychange = 0;
+	size_t i;
+
+	addr_parse(&addr, address);
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		if (family != AF_UNSPEC && alias->family != family)
+			continue;
+
+		/* Binary compare, the same address may be written differently */
+		if (addr.family != AF_UNSPEC)
+			alias->ip_has_changed = !addr_equal(&alias->addr, &addr);
+		else
+			alias->ip_has_changed = strncmp(alias->address, address, sizeof(alias->address)) != 0;
+		if (alias->ip_has_changed) {
+			/* Remember when, for adaptive-period, not the first address seen */
+			if (alias->address[0]) {
+				memmove(&alias->changed[1], &alias->changed[0],
+					sizeof(alias->changed) - sizeof(alias->changed[0]));
+				alias->changed[0] = event_wall();
+				cache_touch();
+			}
+
+			anychange++;
+			alias_set_address(alias, address);
+		}
 
 #ifdef ENABLE_SIMULATION
-	logit(LOG_WARNING, "In simulation, skipping update to server ...");
-	goto exit;
+		logit(LOG_WARNING, "In simulation, forcing IP# change ...");
+		alias->ip_has_changed = 1;
 #endif
-	rc = http_transaction(client, &trans);
-	if (rc) {
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
-		logit(LOG_WARNING, "HTTP(S) Transaction failed, error %d: %s", rc, error_str(rc));
-		logit(LOG_INFO, "Update failed, forced update/retry in %d sec ...", ctx->cmd_check_period);
-		alias->force_addr_update = 1;
-		goto exit;
 	}
-	logit(LOG_DEBUG, "DDNS server response: %s", trans.rsp);
 
-	rc = info->system->response(&trans, info, alias);
-	if (rc) {
-		logit(LOG_WARNING, "%s error in DDNS server response: %s",
-		      rc == RC_DDNS_RSP_RETRY_LATER || rc == RC_DDNS_RSP_TOO_FREQUENT ? "Temporary" : "Fatal", error_str(rc));
-//		logit(LOG_WARNING, "[%d %s]", trans.status, trans.status_desc);
-		logit(LOG_DEBUG, "%s", trans.rsp_body != trans.rsp ? trans.rsp_body : "");
+	return anychange;
+}
+
+/* Dual-stack provider without an address of @family this cycle */
+static void skip_aliases(ddns_info_t *info, int family)
+{
+	size_t i;
+
+	logit_limit(LOG_WARNING, "No %s address for %s, skipping its records",
+		    family == AF_INET6 ? "IPv6" : "IPv4", info->system->name);
+	for (i = 0; i < info->alias_count; i++) {
+		if (info->alias[i].family == family)
+			info->alias[i].ip_has_changed = 0;
+	}
+}
+
+static int get_address(ddns_t *ctx)
+{
+	static const int dual[] = { AF_INET, AF_INET6 };
+	static const int any[]  = { AF_UNSPEC };
+	char address[MAX_ADDRESS_LEN];
+	struct lookup *cache;
+	ddns_info_t *info;
+	size_t num = 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		num++;
+		info = conf_info_iterator(0);
+	}
+
+	/* Dual-stack providers look up one address per family */
+	cache = calloc(num ? 2 * num : 1, sizeof(*cache));
+	if (!cache)
+		return RC_OUT_OF_MEMORY;
+
+	/* Interface addresses are read at most once per cycle */
+	ifmon_cycle();
+
+	num  = 0;
+	info = conf_info_iterator(1);
+	while (info) {
+		const int *family = info->dual_stack ? dual : any;
+		size_t i, families = info->dual_stack ? NELEMS(dual) : NELEMS(any);
+
+		if (!info->due)
+			goto next;
+
+		/* Out of time, e.g. waiting for the checkip servers of others */
+		budget_enter(&info->cycle_budget);
+		if (budget_expired()) {
+			budget_leave(&info->cycle_budget);
+			for (i = 0; i < info->alias_count; i++)
+				info->alias[i].ip_has_changed = 0;
+			info->status = RC_DDNS_OVER_BUDGET;
+			goto next;
+		}
+
+		for (i = 0; i < families; i++) {
+			log_event_t ev = { .provider = info->system->name, .address = address };
+			int anychange;
+
+			if (get_address_backend(ctx, info, family[i], cache, &num, address, sizeof(address))) {
+				if (budget_expired())
+					info->status = RC_DDNS_OVER_BUDGET;
+				if (family[i] != AF_UNSPEC)
+					skip_aliases(info, family[i]);
+				continue;
+			}
+
+			anychange = check_aliases(info, family[i], address);
+			ev.event  = anychange ? "address-changed" : "address-unchanged";
+			if (!anychange)
+				logit_event(LOG_INFO, &ev, "No IP# change detected for %s, still at %s", info->system->name, address);
+			else
+				logit_event(LOG_INFO, &ev, "Current IP# %s at %s", address, info->system->name);
+		}
+
+		budget_leave(&info->cycle_budget);
+
+		for (i = 0; i < info->checkip_num; i++)
+			http_stats_log(&info->checkip[i].client, "checkip");
+	next:
+		info = conf_info_iterator(0);
+	}
+	free(cache);
+
+	return 0;
+}
+
+/* Move @t along a clock step, if taken since startup, see event_clock() */
+static void restamp(time_t *t, time_t from, time_t until, time_t step, time_t now)
+{
+	if (!*t)
+		return;
+
+	if (*t >= from && *t <= until)
+		*t += step;
+	else if (*t > now)
+		*t = now;	/* From the state file, written with a clock ahead */
+}
+
+/*
+ * The wall clock was stepped, e.g. by the first NTP sync after boot on
+ * a system without RTC.  Update times taken since startup are moved
+ * along, so time_to_check() sees the same age as before the step,
+ * rather than every alias being decades overdue, or never due.
+ */
+static void clock_step(void)
+{
+	time_t from, until, step, now;
+	ddns_info_t *info;
+
+	step = event_clock(&from, &until);
+	if (!step)
+		return;
+
+	logit(LOG_NOTICE, "Wall clock stepped %+lld sec, adjusting update times.", (long long)step);
+	now = event_wall();
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		size_t i, j;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			restamp(&alias->last_update, from, until, step, now);
+			for (j = 0; j < NELEMS(alias->changed); j++)
+				restamp(&alias->changed[j], from, until, step, now);
+		}
+
+		restamp(&info->breaker.opened, from, until, step, now);
+		for (i = 0; i < info->checkip_num; i++)
+			restamp(&info->checkip[i].breaker.opened, from, until, step, now);
+	}
+	cache_touch();
+}
+
+static int time_to_check(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	time_t past_time = event_wall() - alias->last_update;
+	int forced = info->forced_update ? info->forced_update : ctx->forced_update_period_sec;
+
+	return alias->force_addr_update || (past_time > forced);
+}
+
+/*
+ * With verify-record, a changed address, or no cache file, e.g. after
+ * a reboot, does not mean the record is wrong, so we ask before
+ * updating.  Forced updates, by time or command, are always sent.
+ */
+static int want_verify(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	if (!info->verify_record || alias->force_addr_update)
+		return 0;
+
+	if (!alias->ip_has_changed && (alias->last_update || !time_to_check(ctx, info, alias)))
+		return 0;
+
+	return 1;
+}
+
+/* Wildcards cannot be looked up, and without an address there is nothing to compare */
+static int can_verify(ddns_alias_t *alias)
+{
+	return alias->name[0] != '*' && alias->address[0];
+}
+
+/* Same address, regardless of how it is written, e.g. IPv6 zero compression */
+static int is_current(ddns_alias_t *alias, const char *address)
+{
+	ddns_addr_t addr;
+
+	if (addr_parse(&addr, address) || !addr_equal(&addr, &alias->addr)) {
+		logit(LOG_DEBUG, "Name servers have %s at %s, not %s", alias->name, address, alias->address);
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Does the record already point to our address?  Asks the name servers
+ * of the zone directly, recursive resolvers may still have the old one,
+ * unless a DNS-over-HTTPS resolver is set, then it is asked instead.
+ * Any failure means we do not know, so the update is sent anyway.
+ */
+static int record_is_current(ddns_info_t *info, ddns_alias_t *alias)
+{
+	resolver_query_t query = { .name = alias->name, .family = alias->family };
+	long long t;
+	int current;
+
+	if (!can_verify(alias) || budget_expired())
+		return 0;
+
+	t = trace_start();
+	if (resolver_enabled())
+		current = !resolver_lookup(&query, 1, RESOLVER_TIMEOUT) && !query.rc;
+	else
+		current = !discover_auth(alias->name, alias->family, query.address, sizeof(query.address));
+	if (current)
+		current = is_current(alias, query.address);
+	trace_span(t, "verify", "verify %s", alias->name);
+
+	return current;
+}
+
+/*
+ * Out of time, the cycle deadline has passed, or the budget of @info is
+ * used up.  Aliases with a new address are sent on the next check, in
+ * DDNS_MIN_PERIOD, rather than lost, see next_period().
+ */
+static void defer_provider(ddns_info_t *info)
+{
+	size_t i;
+
+	logit(LOG_NOTICE, "Out of time for %s this cycle, deferring it.", info->system->name);
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+
+		if (alias->ip_has_changed)
+			alias->force_addr_update = 1;
+		alias->update_required = 0;
+	}
+
+	info->status = RC_DDNS_OVER_BUDGET;
+}
+
+static int check_alias_update_table(ddns_t *ctx)
+{
+	struct update_job *jobs;
+	size_t n = 0, num = 0;
+	ddns_info_t *info;
+
+	/* Name servers of all providers asked at once, see verify_concurrent() */
+	jobs = verify_concurrent(ctx, &num);
+
+	/* Uses fix test if ip of server 0 has changed.
+	 * That should be OK even if changes check_address() to
+	 * iterate over servernum, but not if it's fix set to =! 0 */
+	info = conf_info_iterator(1);
+	while (info) {
+		int *current = NULL;
+		size_t i;
+
+		if (jobs && n < num && jobs[n].info == info)
+			current = jobs[n++].rc;
+
+		budget_enter(&info->cycle_budget);
+		if (info->due && (info->status == RC_DDNS_OVER_BUDGET || budget_expired()))
+			defer_provider(info);
+
+		for (i = 0; info->due && info->status != RC_DDNS_OVER_BUDGET && i < info->alias_count; i++) {
+			int override;
+			ddns_alias_t *alias = &info->alias[i];
+			log_event_t ev = {
+				.provider = info->system->name,
+				.alias    = alias->name,
+				.address  = alias->address,
+			};
+
+			override = time_to_check(ctx, info, alias);
+			if (!alias->ip_has_changed && !override) {
+				alias->update_required = 0;
+				continue;
+			}
+
+			if (want_verify(ctx, info, alias) &&
+			    (current ? current[i] : record_is_current(info, alias))) {
+				ev.event = "update-skipped";
+				logit_event(LOG_INFO, &ev, "Alias %s already at %s, no update needed",
+					    alias->name, alias->address);
+				alias->update_required = 0;
+				if (!alias->last_update)
+					alias->last_update = event_wall();
+				write_cache_file(alias, info->system->name);
+				continue;
+			}
+
+			alias->update_required = 1;
+			ev.event = "update-needed";
+			logit_event(LOG_NOTICE, &ev, "Update %s for alias %s, new IP# %s",
+				    override ? "forced" : "needed", alias->name, alias->address);
+		}
+		budget_leave(&info->cycle_budget);
+
+		info = conf_info_iterator(0);
+	}
+	free_jobs(jobs, num);
+
+	return 0;
+}
+
+/*
+ * Result of an update of @alias, logged once, as text or as an event
+ * for log pipelines.  @replied is set if the server replied.
+ */
+static void update_result(ddns_info_t *info, ddns_alias_t *alias, int rc, long long start, int replied)
+{
+	log_event_t ev = {
+		.event    = rc ? "update-failed" : "update",
+		.provider = info->system->name,
+		.alias    = alias->name,
+		.address  = alias->address,
+		.server   = info->server_name.name,
+		.rc       = rc,
+		.start    = start,
+	};
+
+	PROBE(update__done, info->system->name, alias->name, rc, (int)(event_msec() - start));
+	trace_range(start * 1000, event_msec() * 1000, "update", "update %s", alias->name);
+	if (!rc)
+		logit_event(LOG_INFO, &ev, "Successful alias table update for %s => new IP# %s",
+			    alias->name, alias->address);
+	else if (!replied)
+		logit_event(LOG_WARNING, &ev, "%s Transaction failed for %s, error %d: %s",
+			    info->system->update ? "DNS" : "HTTP(S)", alias->name, rc, error_str(rc));
+	else
+		logit_event(LOG_WARNING, &ev, "%s error in DDNS server response for %s: %s",
+			    rc == RC_DDNS_RSP_RETRY_LATER || rc == RC_DDNS_RSP_TOO_FREQUENT ? "Temporary" : "Fatal",
+			    alias->name, error_str(rc));
+}
+
+/*
+ * Circuit breaker of the DDNS server, see breaker.c.  While it is open
+ * updates are skipped, and the provider is checked again when it is
+ * time for a probe, see next_period().
+ */
+static int circuit_open(ddns_info_t *info)
+{
+	int wait;
+
+	if (breaker_allow(&info->breaker, info->server_name.name))
+		return 0;
+
+	wait = breaker_wait(&info->breaker);
+	if (wait > info->retry_after)
+		info->retry_after = wait;
+
+	return 1;
+}
+
+/* The DDNS server replied, or not, to an update */
+static void circuit_result(ddns_info_t *info, int replied)
+{
+	int wait;
+
+	if (replied) {
+		breaker_success(&info->breaker, info->server_name.name);
+		return;
+	}
+
+	if (!breaker_failure(&info->breaker, info->server_name.name))
+		return;
+
+	wait = breaker_wait(&info->breaker);
+	if (wait > info->retry_after)
+		info->retry_after = wait;
+}
+
+/* Send update for one alias, after any plugin setup() */
+static int send_request(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int *changed)
+{
+	int            rc;
+	http_trans_t   trans = { 0 };
+	http_t        *client = &info->server;
+	long long      start = event_msec();
+
+	/* Connect after the request is ready, so it can go as TLS early data */
+	client->ssl_enabled = info->ssl_enabled;
+	client->http2       = info->http2;
+	client->early_data  = info->system->early_data;
+
+	trans.req_len     = info->system->request(ctx, info, alias);
+	trans.req         = (char *)ctx->request_buf;
+	trans.buf         = ctx->work_buf;
+
+	if (trans.req_len < 0) {
+		logit(LOG_ERR, "Invalid HTTP GET request in %s provider, cannot update.", info->system->name);
+		rc = RC_ERROR;
+
+		goto exit;
+	}
+	if ((size_t)trans.req_len >= ctx->request_buflen) {
+		logit(LOG_ERR, "HTTP request in %s provider does not fit in buffer, cannot update.", info->system->name);
+		rc = RC_BUFFER_OVERFLOW;
+
+		goto exit;
+	}
+
+	ctx->request_buf[trans.req_len] = 0;
+	logit(LOG_DEBUG, "Sending alias table update to DDNS server: %s", ctx->request_buf);
+
+	rc = quota_take(info);
+	if (rc)
+		goto exit;
+
+#ifdef ENABLE_SIMULATION
+	logit(LOG_WARNING, "In simulation, skipping update to server ...");
+	goto exit;
+#endif
+	PROBE(request__start, info->system->name, alias->name, trans.req_len);
+	rc = http_exchange(client, &trans, "Sending IP# update to DDNS server",
+			   strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
+	PROBE(request__done, info->system->name, alias->name, rc, rc ? 0 : trans.status);
+	if (rc && budget_expired())
+		rc = RC_DDNS_OVER_BUDGET;	/* Cut short, not the server failing */
+	else
+		circuit_result(info, !rc);
+	if (rc) {
+		/* Update failed, force update again on the next check, see next_period() */
+		update_result(info, alias, rc, start, 0);
+		alias->force_addr_update = 1;
+		goto exit;
+	}
+	logit(LOG_DEBUG, "DDNS server response: %s", trans.rsp);
+
+	rc = info->system->response(&trans, info, alias);
+	if (trans.retry_after > info->retry_after)
+		info->retry_after = trans.retry_after;
+	update_result(info, alias, rc, start, 1);
+	if (rc) {
+		logit(LOG_DEBUG, "%s", trans.rsp_body != trans.rsp ? trans.rsp_body : "");
+
+		/* Update failed, force update again on the next check, see next_period() */
+		alias->force_addr_update = 1;
+	} else {
+		alias->force_addr_update = 0;
+		if (changed)
+			(*changed)++;
+	}
+
+exit:
+	http_release(client);
+
+	return rc;
+}
+
+/*
+ * Plugins that update without HTTP, e.g. DNS UPDATE, get all aliases
+ * at once.  The plugin sets the result of each alias in @rc, and returns
+ * the error of any alias that got no reply from the server.
+ */
+static int send_native(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num,
+		       int *rc, int *changed)
+{
+	long long start = event_msec();
+	size_t i;
+	int err;
+
+	for (i = 0; i < num; i++)
+		logit(LOG_DEBUG, "Sending alias %s => %s to %s", alias[i]->name,
+		      alias[i]->address, info->system->name);
+
+	err = quota_take(info);
+	if (err) {
+		for (i = 0; i < num; i++)
+			rc[i] = err;
+		return err;
+	}
+
+#ifdef ENABLE_SIMULATION
+	logit(LOG_WARNING, "In simulation, skipping update to server ...");
+	for (i = 0; i < num; i++)
+		rc[i] = 0;
+	return 0;
+#endif
+	err = info->system->update(ctx, info, alias, num, rc);
+	circuit_result(info, !err);
+	for (i = 0; i < num; i++) {
+		update_result(info, alias[i], rc[i], start, !err || rc[i] != err);
+		if (rc[i]) {
+			/* Update failed, force update again on the next check, see next_period() */
+			alias[i]->force_addr_update = 1;
+			continue;
+		}
+
+		alias[i]->force_addr_update = 0;
+		if (changed)
+			(*changed)++;
+	}
+
+	return err;
+}
+
+/* Plugin setup, e.g. looking up record IDs, a span of its own when tracing */
+static int setup_alias(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias)
+{
+	long long t = trace_start();
+	int rc;
+
+	rc = info->system->setup(ctx, info, alias);
+	trace_span(t, "plugin", "setup %s", alias->name);
+	if (rc && budget_expired())
+		rc = RC_DDNS_OVER_BUDGET;
+
+	return rc;
+}
+
+static int send_update(ddns_t *ctx, ddns_info_t *info, ddns_alias_t *alias, int *changed)
+{
+	PROBE(update__start, info->system->name, alias->name, alias->address);
+	if (budget_expired())
+		return RC_DDNS_OVER_BUDGET;
+	if (circuit_open(info))
+		return RC_DDNS_CIRCUIT_OPEN;
+	if (info->system->setup)
+		DO(setup_alias(ctx, info, alias));
+
+	if (info->system->update) {
+		int rc;
+
+		send_native(ctx, info, &alias, 1, &rc, changed);
+		return rc;
+	}
+
+	return send_request(ctx, info, alias, changed);
+}
+
+/*
+ * Same as send_request(), but for several aliases with the same address
+ * in one request, for plugins that support it.  Results per alias in @rc.
+ */
+static int send_update_batch(ddns_t *ctx, ddns_info_t *info, ddns_alias_t **alias, size_t num,
+			     int *rc, int *changed)
+{
+	http_trans_t   trans = { 0 };
+	http_t        *client = &info->server;
+	long long      start = event_msec();
+	size_t         i;
+	int            err;
+
+	if (num == 1) {
+		rc[0] = send_request(ctx, info, alias[0], changed);
+		return rc[0];
+	}
+
+	client->ssl_enabled = info->ssl_enabled;
+	client->http2       = info->http2;
+	client->early_data  = info->system->early_data;
+
+	trans.req_len     = info->system->request_batch(ctx, info, alias, num);
+	trans.req         = (char *)ctx->request_buf;
+	trans.buf         = ctx->work_buf;
+
+	if (trans.req_len < 0) {
+		logit(LOG_ERR, "Invalid HTTP GET request in %s provider, cannot update.", info->system->name);
+		err = RC_ERROR;
+		goto fail;
+	}
+	if ((size_t)trans.req_len >= ctx->request_buflen) {
+		logit(LOG_ERR, "HTTP request in %s provider does not fit in buffer, cannot update.", info->system->name);
+		err = RC_BUFFER_OVERFLOW;
+		goto fail;
+	}
+
+	ctx->request_buf[trans.req_len] = 0;
+	logit(LOG_DEBUG, "Sending %zu aliases in one update to DDNS server: %s", num, ctx->request_buf);
+
+	err = quota_take(info);
+	if (err)
+		goto fail;
+
+#ifdef ENABLE_SIMULATION
+	logit(LOG_WARNING, "In simulation, skipping update to server ...");
+	err = 0;
+	goto fail;
+#endif
+	PROBE(request__start, info->system->name, alias[0]->name, trans.req_len);
+	err = http_exchange(client, &trans, "Sending IP# update to DDNS server",
+			    strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
+	PROBE(request__done, info->system->name, alias[0]->name, err, err ? 0 : trans.status);
+	if (err && budget_expired())
+		err = RC_DDNS_OVER_BUDGET;
+	else
+		circuit_result(info, !err);
+	if (err) {
+		for (i = 0; i < num; i++)
+			update_result(info, alias[i], err, start, 0);
+		goto fail;
+	}
+	logit(LOG_DEBUG, "DDNS server response: %s", trans.rsp);
+
+	err = info->system->response_batch(&trans, info, alias, num, rc);
+	if (trans.retry_after > info->retry_after)
+		info->retry_after = trans.retry_after;
+	for (i = 0; i < num; i++) {
+		update_result(info, alias[i], rc[i], start, 1);
+		if (rc[i]) {
+			alias[i]->force_addr_update = 1;
+			continue;
+		}
+
+		alias[i]->force_addr_update = 0;
+		if (changed)
+			(*changed)++;
+	}
+	http_release(client);
+
+	return err;
+fail:
+	/* Update failed, force update again on the next check, see next_period() */
+	for (i = 0; i < num; i++) {
+		rc[i] = err;
+		if (err)
+			alias[i]->force_addr_update = 1;
+	}
+	http_release(client);
+
+	return err;
+}
+
+/*
+ * Send all pending updates of a provider, results per alias in @rc.
+ * Plugins with batch support get aliases with the same address grouped
+ * in as few requests as possible, e.g. dyndns2 hostname=a,b,c
+ */
+static void send_updates(ddns_t *ctx, ddns_info_t *info, int *rc, int *changed)
+{
+	ddns_alias_t **list = NULL;
+	size_t batch = info->system->batch;
+	size_t *idx = NULL;
+	char *done = NULL;
+	int *res = NULL;
+	size_t i, j;
+
+	if (!info->system->request_batch || !info->system->response_batch)
+		batch = 1;
+	if (info->system->update)
+		batch = info->alias_count;
+	if (batch > info->alias_count)
+		batch = info->alias_count;
+
+	if (batch > 1) {
+		list = calloc(batch, sizeof(*list));
+		idx  = calloc(batch, sizeof(*idx));
+		res  = calloc(batch, sizeof(*res));
+		done = calloc(info->alias_count, sizeof(*done));
+		if (!list || !idx || !res || !done)
+			batch = 1;
+	}
+
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
+		size_t num = 0;
+		int err;
+
+		if (!alias->update_required || (batch > 1 && done[i]))
+			continue;
+
+		if (batch <= 1) {
+			rc[i] = send_update(ctx, info, alias, changed);
+			if (rc[i] && rc[i] != RC_DDNS_RECORD_CURRENT && exec_mode == EXEC_MODE_COMPAT)
+				break;
+			continue;
+		}
+
+		if (budget_expired()) {
+			rc[i] = RC_DDNS_OVER_BUDGET;
+			continue;
+		}
+		if (circuit_open(info)) {
+			rc[i] = RC_DDNS_CIRCUIT_OPEN;
+			continue;
+		}
+
+		for (j = i; j < info->alias_count && num < batch; j++) {
+			ddns_alias_t *next = &info->alias[j];
+
+			if (done[j] || !next->update_required)
+				continue;
+			if (!info->system->update && !addr_equal(&next->addr, &alias->addr))
+				continue;
+
+			/* E.g., look up record IDs, failed aliases are left out */
+			done[j] = 1;
+			PROBE(update__start, info->system->name, next->name, next->address);
+			if (info->system->setup) {
+				rc[j] = setup_alias(ctx, info, next);
+				if (rc[j])
+					continue;
+			}
+
+			idx[num]    = j;
+			list[num++] = next;
+		}
+
+		if (!num) {
+			if (exec_mode == EXEC_MODE_COMPAT)
+				break;
+			continue;
+		}
+
+		if (info->system->update)
+			err = send_native(ctx, info, list, num, res, changed);
+		else
+			err = send_update_batch(ctx, info, list, num, res, changed);
+		for (j = 0; j < num; j++)
+			rc[idx[j]] = res[j];
+		if (err && exec_mode == EXEC_MODE_COMPAT)
+			break;
+	}
+
+	free(list);
+	free(idx);
+	free(res);
+	free(done);
+}
+
+/*
+ * Concurrent checks and updates.  Each due provider is a job, handed out
+ * to a pool of up to concurrency threads, the shards.  Every worker has
+ * its own copy of the context, with private request and response
+ * buffers, and a job owns its ddns_info_t exclusively, connections and
+ * all, so send_update() and the plugin callbacks need no locks.  The
+ * addresses looked up this cycle are only read while the workers run.
+ * Only the network conversations run in parallel, all result handling,
+ * cache writes and script hooks remain in the main thread, as do the
+ * per-worker counters, merged into the metrics after each run.
+ */
+struct update_pool {
+	pthread_mutex_t    lock;
+	struct update_job *jobs;
+	size_t             num;
+	size_t             next;
+	void             (*run)(ddns_t *ctx, struct update_job *job);
+};
+
+struct update_worker {
+	pthread_t           tid;
+	int                 id;		/* Track on the trace timeline */
+	ddns_t              ctx;
+	struct update_pool *pool;
+	unsigned long       jobs;	/* Run by this worker */
+	long long           busy;	/* msec */
+};
+
+static void run_update(ddns_t *ctx, struct update_job *job)
+{
+	budget_enter(&job->info->cycle_budget);
+	send_updates(ctx, job->info, job->rc, NULL);
+	budget_leave(&job->info->cycle_budget);
+}
+
+static void run_pool(ddns_t *ctx, struct update_worker *worker)
+{
+	struct update_pool *pool = worker->pool;
+	long long start = event_msec();
+
+	while (1) {
+		struct update_job *job = NULL;
+
+		pthread_mutex_lock(&pool->lock);
+		if (pool->next < pool->num)
+			job = &pool->jobs[pool->next++];
+		pthread_mutex_unlock(&pool->lock);
+
+		if (!job)
+			break;
+
+		pool->run(ctx, job);
+		worker->jobs++;
+	}
+
+	worker->busy = event_msec() - start;
+}
+
+static void *update_worker(void *arg)
+{
+	struct update_worker *worker = (struct update_worker *)arg;
+
+	trace_thread(worker->id);
+	run_pool(&worker->ctx, worker);
+
+	return NULL;
+}
+
+static int start_worker(struct update_worker *worker, ddns_t *ctx, struct update_pool *pool)
+{
+	worker->pool = pool;
+	worker->ctx  = *ctx;
+	worker->ctx.work_buf = buf_get(ctx->pool, DDNS_HTTP_RESPONSE_BUFFER_SIZE);
+	worker->ctx.request  = buf_get(ctx->pool, DDNS_HTTP_REQUEST_BUFFER_SIZE);
+	if (!worker->ctx.work_buf || !worker->ctx.request)
+		goto fail;
+	worker->ctx.request_buf    = worker->ctx.request->data;
+	worker->ctx.request_buflen = worker->ctx.request->size;
+
+	if (pthread_create(&worker->tid, NULL, update_worker, worker))
+		goto fail;
+
+	return 0;
+fail:
+	buf_put(ctx->pool, worker->ctx.work_buf);
+	buf_put(ctx->pool, worker->ctx.request);
+
+	return 1;
+}
+
+static void free_jobs(struct update_job *jobs, size_t num)
+{
+	size_t i;
+
+	if (!jobs)
+		return;
+
+	for (i = 0; i < num; i++)
+		free(jobs[i].rc);
+	free(jobs);
+}
+
+/* One job per due provider, in configuration order, with room for results */
+static struct update_job *alloc_jobs(size_t *num)
+{
+	struct update_job *jobs;
+	ddns_info_t *info;
+	size_t i = 0, count = 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->due)
+			count++;
+		info = conf_info_iterator(0);
+	}
+
+	jobs = calloc(count ? count : 1, sizeof(*jobs));
+	if (!jobs)
+		return NULL;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (!info->due) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
+		jobs[i].info = info;
+		jobs[i].rc   = calloc(info->alias_count ? info->alias_count : 1, sizeof(int));
+		if (!jobs[i].rc) {
+			free_jobs(jobs, count);
+			return NULL;
+		}
+		i++;
+		info = conf_info_iterator(0);
+	}
+	*num = count;
+
+	return jobs;
+}
+
+/*
+ * Run @fn on all @num jobs, using at most @want threads, the calling
+ * thread included, and no more than concurrency.  Returns when all
+ * jobs are done.
+ */
+static void run_concurrent(ddns_t *ctx, struct update_job *jobs, size_t num, size_t want,
+			   void (*fn)(ddns_t *, struct update_job *))
+{
+	struct update_worker workers[DDNS_MAX_CONCURRENCY];
+	struct update_pool pool;
+	int i, num_workers = 1;
+
+	memset(&pool, 0, sizeof(pool));
+	pthread_mutex_init(&pool.lock, NULL);
+	pool.jobs = jobs;
+	pool.num  = num;
+	pool.run  = fn;
+
+	/* The calling thread is worker zero, so one less to start */
+	memset(workers, 0, sizeof(workers));
+	workers[0].pool = &pool;
+	while (num_workers < ctx->concurrency && (size_t)num_workers < want) {
+		workers[num_workers].id = num_workers;
+		if (start_worker(&workers[num_workers], ctx, &pool)) {
+			logit(LOG_WARNING, "Failed starting update worker, continuing with %d", num_workers);
+			break;
+		}
+		num_workers++;
+	}
+
+	logit(LOG_DEBUG, "Running %zu jobs using %d threads", num, num_workers);
+	run_pool(ctx, &workers[0]);
+
+	for (i = 0; i < num_workers; i++) {
+		struct update_worker *worker = &workers[i];
+
+		if (i > 0) {
+			pthread_join(worker->tid, NULL);
+			buf_put(ctx->pool, worker->ctx.work_buf);
+			buf_put(ctx->pool, worker->ctx.request);
+		}
+		metrics_worker(i, worker->jobs, worker->busy);
+	}
+	pthread_mutex_destroy(&pool.lock);
+}
+
+/*
+ * Send all pending updates, concurrently, and return one job per
+ * provider, in configuration order, with the results.  Returns NULL
+ * if there is nothing to gain from threads, the caller then falls
+ * back to calling send_update() itself.
+ */
+static struct update_job *update_concurrent(ddns_t *ctx, size_t *num)
+{
+	struct update_job *jobs;
+	ddns_info_t *info;
+	size_t i, pending = 0;
+
+	if (ctx->concurrency <= 1)
+		return NULL;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		for (i = 0; info->due && i < info->alias_count; i++) {
+			if (info->alias[i].update_required) {
+				pending++;
+				break;
+			}
+		}
+		info = conf_info_iterator(0);
+	}
+
+	if (pending < 2)
+		return NULL;
+
+	jobs = alloc_jobs(num);
+	if (!jobs)
+		return NULL;
+
+	run_concurrent(ctx, jobs, *num, pending, run_update);
+
+	return jobs;
+}
+
+static void run_verify(ddns_t *ctx, struct update_job *job)
+{
+	ddns_info_t *info = job->info;
+	size_t i;
+
+	budget_enter(&info->cycle_budget);
+	for (i = 0; i < info->alias_count; i++) {
+		if (job->rc[i])
+			job->rc[i] = record_is_current(info, &info->alias[i]);
+	}
+	budget_leave(&info->cycle_budget);
+}
+
+/*
+ * With a DNS-over-HTTPS resolver all lookups are pipelined by the main
+ * thread, over the kept-alive connections to the resolver.
+ */
+static struct update_job *verify_resolver(ddns_t *ctx, size_t *num)
+{
+	resolver_query_t *query;
+	struct update_job *jobs;
+	size_t i, j, n = 0;
+
+	jobs = alloc_jobs(num);
+	if (!jobs)
+		return NULL;
+
+	for (i = 0; i < *num; i++) {
+		ddns_info_t *info = jobs[i].info;
+
+		for (j = 0; j < info->alias_count; j++) {
+			ddns_alias_t *alias = &info->alias[j];
+
+			jobs[i].rc[j] = want_verify(ctx, info, alias) && can_verify(alias);
+			n += jobs[i].rc[j];
+		}
+	}
+	if (!n)
+		return jobs;
+
+	query = calloc(n, sizeof(*query));
+	if (!query) {
+		free_jobs(jobs, *num);
+		return NULL;
+	}
+
+	for (i = 0, n = 0; i < *num; i++) {
+		ddns_info_t *info = jobs[i].info;
+
+		for (j = 0; j < info->alias_count; j++) {
+			if (!jobs[i].rc[j])
+				continue;
+
+			query[n].name     = info->alias[j].name;
+			query[n++].family = info->alias[j].family;
+		}
+	}
+	resolver_lookup(query, n, RESOLVER_TIMEOUT);
+
+	for (i = 0, n = 0; i < *num; i++) {
+		ddns_info_t *info = jobs[i].info;
+
+		for (j = 0; j < info->alias_count; j++) {
+			if (!jobs[i].rc[j])
+				continue;
+
+			jobs[i].rc[j] = !query[n].rc && is_current(&info->alias[j], query[n].address);
+			n++;
+		}
+	}
+	free(query);
+
+	return jobs;
+}
+
+/*
+ * Ask the name servers about all aliases to verify, concurrently, with
+ * thousands of hostnames the round-trips would otherwise add up.  The
+ * answers are in one job per due provider, in configuration order.
+ * Returns NULL if there is nothing to gain from threads, the caller
+ * then asks one alias at a time.
+ */
+static struct update_job *verify_concurrent(ddns_t *ctx, size_t *num)
+{
+	struct update_job *jobs;
+	ddns_info_t *info;
+	size_t i, j, pending = 0;
+
+	if (resolver_enabled())
+		return verify_resolver(ctx, num);
+	if (ctx->concurrency <= 1)
+		return NULL;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		for (i = 0; info->due && i < info->alias_count; i++) {
+			if (want_verify(ctx, info, &info->alias[i])) {
+				pending++;
+				break;
+			}
+		}
+		info = conf_info_iterator(0);
+	}
+
+	if (pending < 2)
+		return NULL;
+
+	jobs = alloc_jobs(num);
+	if (!jobs)
+		return NULL;
+
+	for (i = 0; i < *num; i++) {
+		info = jobs[i].info;
+		for (j = 0; j < info->alias_count; j++)
+			jobs[i].rc[j] = want_verify(ctx, info, &info->alias[j]);
+	}
+	run_concurrent(ctx, jobs, *num, pending, run_verify);
+
+	return jobs;
+}
+
+/* Errors we can recover from by trying again later */
+static int is_transient(int rc)
+{
+	switch (rc) {
+	case RC_TCP_INVALID_REMOTE_ADDR: /* Probably temporary DNS error. */
+	case RC_TCP_CONNECT_FAILED:      /* Cannot connect to DDNS server atm. */
+	case RC_TCP_SEND_ERROR:
+	case RC_TCP_RECV_ERROR:
+	case RC_OS_INVALID_IP_ADDRESS:
+	case RC_DDNS_RSP_RETRY_LATER:
+	case RC_DDNS_INVALID_CHECKIP_RSP:
+	case RC_DDNS_RSP_TOO_FREQUENT:
+	case RC_DDNS_RATE_LIMITED:
+		return 1;
+	}
+
+	return 0;
+}
+
+static int update_alias_table(ddns_t *ctx)
+{
+	int rc = 0, remember = 0;
+	int anychange = 0;
+	struct update_job *jobs;
+	size_t n = 0, num = 0;
+	ddns_info_t *info;
+
+	/* Issue #15: On external trig. force update to random addr. */
+	if (ctx->forced_update_fake_addr) {
+		/* If the DDNS server responds with an error, we ignore it here,
+		 * since this is just to fool the DDNS server to register a a
+		 * change, i.e., an active user. */
+		info = conf_info_iterator(1);
+		while (info) {
+			size_t i;
+
+			for (i = 0; info->due && i < info->alias_count; i++) {
+				ddns_alias_t *alias = &info->alias[i];
+				if (alias->force_addr_update) {
+					char backup[sizeof(alias->address)];
+					char fake[sizeof(alias->address)];
+
+					strlcpy(backup, alias->address, sizeof(backup));
+
+					/* Picking random address in 203.0.113.0/24 ... */
+					snprintf(fake, sizeof(fake), "203.0.113.%d", (rand() + 1) % 255);
+					alias_set_address(alias, fake);
+					rc = send_update(ctx, info, alias, NULL);
+					alias_set_address(alias, backup);
+					if (rc)
+						break;
+				}
+			}
+
+			info = conf_info_iterator(0);
+		}
+
+		/* Play nice with server, wait a bit before sending actual IP */
+		sleep(3);
+	}
+
+	/* With concurrency > 1, all updates are sent here, results below */
+	jobs = update_concurrent(ctx, &num);
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i;
+		int *result = NULL, *batch = NULL;
+
+		/* Not due yet, scheduled for later */
+		if (!info->due) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
+		if (jobs && n < num && jobs[n].info == info)
+			result = jobs[n++].rc;
+
+		budget_enter(&info->cycle_budget);
+
+		/* Batched updates are all sent up front, results below */
+		if (!result && (info->system->batch > 1 || info->system->update)) {
+			batch = calloc(info->alias_count ? info->alias_count : 1, sizeof(int));
+			if (batch) {
+				send_updates(ctx, info, batch, &anychange);
+				result = batch;
+			}
+		}
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+			char *event = "update";
+			rc = 0;
+
+			if (!alias->update_required) {
+				if (exec_mode == EXEC_MODE_COMPAT)
+					continue;
+				event = "nochg";
+			} else if ((rc = result ? result[i] : send_update(ctx, info, alias, &anychange)) ==
+				   RC_DDNS_RECORD_CURRENT) {
+				/* Plugin found the record up to date, nothing sent */
+				metrics_update(info, rc);
+				logit(LOG_INFO, "Alias %s already at %s, no update needed", alias->name, alias->address);
+				alias->rc = 0;
+				alias->update_required = 0;
+				alias->force_addr_update = 0;
+				alias->last_update = event_wall();
+				alias->fails = 0;
+				write_cache_file(alias, info->system->name);
+				rc = 0;
+				if (exec_mode == EXEC_MODE_COMPAT)
+					continue;
+				event = "nochg";
+			} else if (rc) {
+				metrics_update(info, rc);
+
+				/* Queued, sent with the then current address, see quota.c */
+				if (rc == RC_DDNS_RATE_LIMITED) {
+					logit(LOG_NOTICE, "Request quota of %s used up, deferring update of %s.",
+					      info->system->name, alias->name);
+					alias->force_addr_update = 1;
+					if (!info->status)
+						info->status = rc;
+					rc = 0;
+					continue;
+				}
+
+				/* Out of time this cycle, sent on the next check */
+				if (rc == RC_DDNS_OVER_BUDGET) {
+					logit(LOG_NOTICE, "Out of time for %s this cycle, deferring update of %s.",
+					      info->system->name, alias->name);
+					alias->force_addr_update = 1;
+					if (!info->status)
+						info->status = rc;
+					rc = 0;
+					continue;
+				}
+
+				/* DDNS server failing, sent when it is time to probe it */
+				if (rc == RC_DDNS_CIRCUIT_OPEN) {
+					logit(LOG_NOTICE, "DDNS server %s of %s is failing, deferring update of %s.",
+					      info->server_name.name, info->system->name, alias->name);
+					alias->force_addr_update = 1;
+					if (!info->status)
+						info->status = rc;
+					rc = 0;
+					continue;
+				}
+
+				alias->rc = rc;
+				alias->fails++;
+				cache_touch();
+
+				/* Back off and retry only this provider, see next_period() */
+				if (is_transient(rc))
+					info->status = rc;
+				if (exec_mode == EXEC_MODE_COMPAT)
+					break;
+				event = "error";
+			} else {
+				/* Only reset if send_update() succeeds. */
+				metrics_update(info, rc);
+				alias->rc = 0;
+				alias->update_required = 0;
+				alias->last_update = event_wall();
+				alias->fails = 0;
+
+				/* Update cache file for this entry */
+				write_cache_file(alias, info->system->name);
+			}
+
+			/* Run command or script on successful update. */
+			hook_event(event, alias->name, alias->address, rc);
+		}
+		budget_leave(&info->cycle_budget);
+		free(batch);
+
+		if (RC_DDNS_RSP_NOTOK == rc || RC_DDNS_RSP_AUTH_FAIL == rc)
+			remember = rc;
+
+		if ((RC_DDNS_RSP_RETRY_LATER == rc || rc == RC_DDNS_RSP_TOO_FREQUENT) && !remember)
+			remember = rc;
+
+		info = conf_info_iterator(0);
+	}
+
+	free_jobs(jobs, num);
+
+	/* All cache updates of this cycle are written in one go */
+	cache_flush();
+
+	/* ... and sent to the standby node, if any */
+	ha_send();
+
+	/* Likewise, all --exec events in batch mode */
+	hook_flush();
+
+	/* Kept-alive connections only live for one pass over the aliases */
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->due)
+			http_stats_log(&info->server, info->system->name);
+		http_exit(&info->server);
+		info = conf_info_iterator(0);
+	}
+
+	return remember;
+}
+
+/*
+ * The base64 encoded user:pass is only computed for new, or changed,
+ * providers.  It lives in the provider, and is wiped along with it.
+ * Plugins built on common_request() have it in their pre-rendered
+ * request, so it is not even copied per update.
+ */
+static int get_encoded_user_passwd(void)
+{
+	char buf[USERNAME_LEN + PASSWORD_LEN + 1];
+	ddns_info_t *info;
+	int rc = 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t dlen = sizeof(info->creds.encoded_password);
+
+		/* Kept from before reload, credentials unchanged */
+		if (info->initialized || info->creds.encoded) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
+		/*
+		 * Concatenate username and password with a ':', without
+		 * snprintf(), since that can cause information loss if
+		 * the password has "\=" or similar in it, issue #57
+		 */
+		strlcpy(buf, info->creds.username, sizeof(buf));
+		strlcat(buf, ":", sizeof(buf));
+		strlcat(buf, info->creds.password, sizeof(buf));
+
+		if (base64_encode((unsigned char *)info->creds.encoded_password, &dlen,
+				  (unsigned char *)buf, strlen(buf))) {
+			logit(LOG_WARNING, "Failed base64 encoding user:pass for %s!", info->system->name);
+			memwipe(info->creds.encoded_password, sizeof(info->creds.encoded_password));
+			rc = RC_BUFFER_OVERFLOW;
+			break;
+		}
+
+		info->creds.encoded_password[dlen] = 0;
+		info->creds.encoded = 1;
+		info->creds.size = dlen;
+
+		info = conf_info_iterator(0);
+	}
+
+	memwipe(buf, sizeof(buf));
+
+	return rc;
+}
+
+static int init_context(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	struct timeval tv;
+
+	if (!ctx)
+		return RC_INVALID_POINTER;
+
+	/* Seed prng, used in silly IP randomizer */
+	if (!ctx->initialized) {
+		gettimeofday(&tv, NULL);
+		srand((unsigned int)tv.tv_usec);
+	}
+
+	/* Only providers added, or changed, since last reload */
+	info = conf_info_iterator(1);
+	while (info) {
+		http_t *update  = &info->server;
+		size_t i;
+
+		if (info->initialized) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
+		/* With a proxy, the remote name is still needed for the tunnel and SNI */
+		http_set_port(update, info->server_name.port);
+		http_set_remote_name(update, info->server_name.name);
+		http_set_proxy(update, info->proxy_type, info->proxy_name.name, info->proxy_name.port);
+
+		for (i = 0; i < info->checkip_num; i++) {
+			ddns_checkip_t *srv = &info->checkip[i];
+
+			http_set_port(&srv->client, srv->name.port);
+			http_set_remote_name(&srv->client, srv->name.name);
+			srv->client.early_data = 1; /* Plain GET, safe to replay */
+			http_set_proxy(&srv->client, info->proxy_type, info->proxy_name.name, info->proxy_name.port);
+		}
+
+		info = conf_info_iterator(0);
+	}
+
+	if (ctx->initialized)
+		return 0;
+
+	/* Restore values, if reset by SIGHUP.  Initialize time from cache file at startup. */
+	ctx->num_iterations = cached_num_iterations;
+
+	ctx->initialized = 1;
+
+	return 0;
+}
+
+/* One step of check_address(), a span on the trace timeline */
+static int step(ddns_t *ctx, int (*fn)(ddns_t *), const char *name)
+{
+	long long t = trace_start();
+	int rc;
+
+	rc = fn(ctx);
+	trace_span(t, "cycle", "%s", name);
+
+	return rc;
+}
+
+static int check_address(ddns_t *ctx)
+{
+	if (!ctx)
+		return RC_INVALID_POINTER;
+
+	/* Of an active/standby pair only the active node updates, see ha.c */
+	if (!ha_active()) {
+		logit(LOG_DEBUG, "Standby node, not checking addresses.");
+		return 0;
+	}
+
+	/* Get IP address from any of the different backends */
+	DO(step(ctx, get_address, "get_address"));
+
+	/* Step through aliases list, resolve them and check if they point to my IP */
+	DO(step(ctx, check_alias_update_table, "check_alias_update_table"));
+
+	/* Update IPs marked as not identical with my IP */
+	DO(step(ctx, update_alias_table, "update_alias_table"));
+
+	return 0;
+}
+
+/*
+ * Error filter.  Some errors are to be expected in a network
+ * application, some we can recover from, wait a shorter while and try
+ * again, whereas others are terminal, e.g., some OS errors.
+ */
+static int check_error(ddns_t *ctx, int rc)
+{
+	const char *errstr = "Error response from DDNS server";
+
+	/* dyn_dns_update_ip() failed, the (network) error is not fatal.
+	 * Providers that failed back off on their own, see next_period() */
+	if (rc == RC_OK || is_transient(rc))
+		return 0;
+
+	switch (rc) {
+	case RC_DDNS_RSP_NOTOK:
+	case RC_DDNS_RSP_AUTH_FAIL:
+		if (ignore_errors) {
+			logit(LOG_WARNING, "%s, ignoring ...", errstr);
+			break;
+		}
+		logit(LOG_ERR, "%s, exiting!", errstr);
+		return 1;
+
+	/* All other errors, socket creation failures, invalid pointers etc.  */
+	default:
+		logit(LOG_ERR, "Unrecoverable error %d, exiting ...", rc);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Next check of @alias, in sec from @now, by its history of address changes */
+static int alias_period(ddns_alias_t *alias, time_t now, int period, int min, int max)
+{
+	time_t *changed = alias->changed, since, lease = 0, next, window;
+	size_t i;
+	int p;
+
+	/* Stable for a long time, stretch the period */
+	since = changed[0] ? changed[0] : alias->last_update;
+	if (!since || since > now)
+		return period;
+	p = (now - since) / DDNS_ADAPTIVE_STRETCH;
+	if (p < period)
+		p = period;
+	if (p > max)
+		p = max;
+
+	/* Shortest address lifetime seen, likely the lease time */
+	for (i = 1; i < NELEMS(alias->changed) && changed[i]; i++) {
+		time_t life = changed[i - 1] - changed[i];
+
+		if (life >= min && (!lease || life < lease))
+			lease = life;
+	}
+	if (!lease)
+		return p;
+
+	/* Next change expected a whole number of leases after the last */
+	window = lease / 64;
+	if (window < min)
+		window = min;
+	next = changed[0] + lease;
+	while (next + window <= now)
+		next += lease;
+
+	if (now >= next - window)
+		return min;
+	if (next - window - now < p)
+		p = next - window - now;
+
+	return p;
+}
+
+/*
+ * With adaptive-period the check interval follows the address history
+ * of the provider's aliases, see check_aliases().  A provider is checked
+ * every period-min around the time its address is expected to change,
+ * judging by the shortest lifetime seen so far, e.g. a DHCP lease.  In
+ * between, and while the address stays stable, the period is stretched
+ * up to period-max.  Checks are started the checkip reply time early.
+ */
+static int adaptive_period(ddns_t *ctx, ddns_info_t *info, int period)
+{
+	int min = ctx->period_min, max = ctx->period_max, best = 0, rtt = 0;
+	time_t now = event_wall();
+	size_t i;
+
+	if (period < min)
+		period = min;
+	if (period > max)
+		period = max;
+
+	for (i = 0; i < info->alias_count; i++) {
+		int p = alias_period(&info->alias[i], now, period, min, max);
+
+		if (!best || p < best)
+			best = p;
+	}
+	if (!best)
+		best = period;
+
+	for (i = 0; i < info->checkip_num; i++) {
+		if (info->checkip[i].rtt > 0 && (!rtt || info->checkip[i].rtt < rtt))
+			rtt = info->checkip[i].rtt;
+	}
+	if (best > min)
+		best -= (rtt + 999) / 1000;
+	if (best < min)
+		best = min;
+
+	logit(LOG_DEBUG, "Adaptive period of %s: %d sec", info->system->name, best);
+
+	return best;
+}
+
+/*
+ * Period until the next check of @info.  After errors the provider
+ * backs off exponentially, from DDNS_MIN_RETRY_PERIOD up to its
+ * retry-period.  The delay is jittered, so clients that failed at the
+ * same time, e.g. in a server outage, do not all come back at once.
+ * A server that tells us when to come back, e.g. with Retry-After, is
+ * never retried sooner than that.  Updates held back by the request
+ * quota are not failures, they are sent as soon as there is a token.
+ * Nor are those held back by the circuit breaker of the DDNS server,
+ * they are sent when it is time to probe the server again.
+ */
+static int next_period(ddns_t *ctx, ddns_info_t *info)
+{
+	int cap, delay = DDNS_MIN_RETRY_PERIOD;
+
+	if (!info->status) {
+		int period = info->period ? info->period : ctx->normal_update_period_sec;
+
+		info->retries = 0;
+		if (ctx->adaptive)
+			return adaptive_period(ctx, info, period);
+
+		return period;
+	}
+
+	/* Cut short, not failing, so no backoff, see budget.c */
+	if (info->status == RC_DDNS_OVER_BUDGET)
+		return DDNS_MIN_PERIOD;
+
+	if (info->status == RC_DDNS_RATE_LIMITED || info->status == RC_DDNS_CIRCUIT_OPEN) {
+		if (info->retry_after < 1)
+			return 1;
+
+		return info->retry_after > DDNS_MAX_PERIOD ? DDNS_MAX_PERIOD : info->retry_after;
+	}
+
+	cap = info->retry_period ? info->retry_period : ctx->error_update_period_sec;
+	if (info->retries < 16)
+		delay <<= info->retries;
+	if (info->retries >= 16 || delay > cap)
+		delay = cap;
+	info->retries++;
+
+	delay = delay / 2 + rand() % (delay / 2 + 1);
+
+	if (info->retry_after > delay)
+		delay = info->retry_after > DDNS_MAX_PERIOD ? DDNS_MAX_PERIOD : info->retry_after;
+
+	return delay;
+}
+
+/* The best checkip server(s) of @info, unless the address comes from elsewhere */
+static size_t prewarm_checkip(ddns_info_t *info, http_t **clients)
+{
+	ddns_checkip_t *order[DDNS_MAX_CHECKIP + 1];
+	size_t i, num = 0, quorum = info->checkip_quorum;
 
-		/* Update failed, force update again in ctx->cmd_check_period seconds */
-		alias->force_addr_update = 1;
-	} else {
-		logit(LOG_INFO, "Successful alias table update for %s => new IP# %s",
-		      alias->name, alias->address);
+	if ((info->checkip_cmd && info->checkip_cmd[0]) || (info->ifname && info->ifname[0]) ||
+	    (iface && iface[0]) || info->checkip_stun.name[0] || info->checkip_dns ||
+	    info->checkip_gateway)
+		return 0;
+	if (!info->server_url[0])
+		return 0;
 
-		alias->force_addr_update = 0;
-		if (changed)
-			(*changed)++;
+	/* Not those skipped by their circuit breaker, see get_address_remote() */
+	for (i = 0; i < info->checkip_num; i++) {
+		if (!breaker_open(&info->checkip[i].breaker))
+			order[num++] = &info->checkip[i];
 	}
+	if (!num)
+		return 0;
+	qsort(order, num, sizeof(order[0]), checkip_cmp);
 
-exit:
-	http_exit(client);
+	if (quorum < 1)
+		quorum = 1;
+	for (i = 0; i < num && i < quorum; i++) {
+		order[i]->client.ssl_enabled = order[i]->ssl;
+		clients[i] = &order[i]->client;
+	}
 
-	return rc;
+	return i;
 }
 
-static int update_alias_table(ddns_t *ctx)
+/* Will any alias of @info be updated at @due, regardless of address? */
+static int prewarm_update(ddns_t *ctx, ddns_info_t *info, time_t due)
 {
-	int rc = 0, remember = 0;
-	int anychange = 0;
-	ddns_info_t *info;
-
-	/* Issue #15: On external trig. force update to random addr. */
-	if (ctx->forced_update_fake_addr) {
-		/* If the DDNS server responds with an error, we ignore it here,
-		 * since this is just to fool the DDNS server to register a a
-		 * change, i.e., an active user. */
-		info = conf_info_iterator(1);
-		while (info) {
-			size_t i;
+	time_t when = event_wall() + (due - event_now());
+	int forced = info->forced_update ? info->forced_update : ctx->forced_update_period_sec;
+	size_t i;
 
-			for (i = 0; i < info->alias_count; i++) {
-				ddns_alias_t *alias = &info->alias[i];
-				if (alias->force_addr_update) {
-					char backup[sizeof(alias->address)];
+	/* Only HTTP providers, with a DDNS server that replies */
+	if (info->system->update || breaker_open(&info->breaker))
+		return 0;
 
-					strlcpy(backup, alias->address, sizeof(backup));
+	for (i = 0; i < info->alias_count; i++) {
+		ddns_alias_t *alias = &info->alias[i];
 
-					/* Picking random address in 203.0.113.0/24 ... */
-					snprintf(alias->address, sizeof(alias->address), "203.0.113.%d", (rand() + 1) % 255);
-					TRY(send_update(ctx, info, alias, NULL));
+		if (alias->force_addr_update || when - alias->last_update > forced)
+			return 1;
+	}
 
-					strlcpy(alias->address, backup, sizeof(alias->address));
-				}
-			}
+	return 0;
+}
 
-			info = conf_info_iterator(0);
-		}
+/*
+ * Pre-warm the connections needed when the providers due at @due are
+ * checked: their checkip server(s), and the DDNS server if an update is
+ * certain, e.g. a forced update.  Resolving, connecting, and the TLS
+ * handshake are done now, so when the provider is due only the request
+ * remains.  Connections not ready in time are dropped, and those never
+ * used are closed after DDNS_PREWARM_IDLE sec, see prewarm_idle().
+ */
+static void prewarm(ddns_t *ctx, time_t due)
+{
+	long long idle_until = (due + DDNS_PREWARM_IDLE) * 1000LL;
+	long long deadline = due * 1000LL;
+	ddns_info_t *info;
+	http_t **clients;
+	int num = 0, max = 0, i;
 
-		/* Play nice with server, wait a bit before sending actual IP */
-		sleep(3);
+	info = conf_info_iterator(1);
+	while (info) {
+		max += info->checkip_num + 1;
+		info = conf_info_iterator(0);
 	}
+	if (!max)
+		return;
+
+	clients = calloc(max, sizeof(*clients));
+	if (!clients)
+		return;
 
 	info = conf_info_iterator(1);
 	while (info) {
-		size_t i;
+		int force = strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4;
+		http_t *list[DDNS_MAX_CHECKIP + 2];
+		int n, j;
 
-		for (i = 0; i < info->alias_count; i++) {
-			ddns_alias_t *alias = &info->alias[i];
-			char *event = "update";
-			rc = 0;
+		/* Not set up yet, e.g. during the startup delay, or not due */
+		if (!info->initialized || info->next_check > due) {
+			info = conf_info_iterator(0);
+			continue;
+		}
 
-			if (!alias->update_required) {
-				if (exec_mode == EXEC_MODE_COMPAT)
-					continue;
-				event = "nochg";
-			} else if ((rc = send_update(ctx, info, alias, &anychange))) {
-				if (exec_mode == EXEC_MODE_COMPAT)
-					break;
-				event = "error";
-			} else {
-				/* Only reset if send_update() succeeds. */
-				alias->update_required = 0;
-				alias->last_update = time(NULL);
+		n = prewarm_checkip(info, list);
+		if (prewarm_update(ctx, info, due)) {
+			info->server.ssl_enabled = info->ssl_enabled;
+			info->server.http2       = info->http2;
+			list[n++] = &info->server;
+		}
 
-				/* Update cache file for this entry */
-				write_cache_file(alias, info->system->name);
+		for (j = 0; j < n; j++) {
+			/* Shared checkip server, already started */
+			for (i = 0; i < num; i++) {
+				if (clients[i] == list[j])
+					break;
 			}
+			if (i < num)
+				continue;
 
-			/* Run command or script on successful update. */
-			if (script_exec)
-				os_shell_execute(script_exec, alias->address, alias->name, event, rc);
+			logit(LOG_DEBUG, "Pre-warming connection to %s for %s", list[j]->tcp.remote_host,
+			      info->system->name);
+			if (HTTP_PENDING(http_prewarm(list[j], "Pre-warming connection", force, idle_until)))
+				clients[num++] = list[j];
 		}
 
-		if (RC_DDNS_RSP_NOTOK == rc || RC_DDNS_RSP_AUTH_FAIL == rc)
-			remember = rc;
+		info = conf_info_iterator(0);
+	}
 
-		if ((RC_DDNS_RSP_RETRY_LATER == rc || rc == RC_DDNS_RSP_TOO_FREQUENT) && !remember)
-			remember = rc;
+	while (num > 0 && ctx->cmd == NO_CMD && event_msec() < deadline) {
+		if (http_poll_once(clients, num, deadline) <= 0)
+			break;
 
-		info = conf_info_iterator(0);
+		/* Signals, and the control socket, have their say */
+		event_wait(0);
+		notify_watchdog();
 	}
 
-	return remember;
+	/* Not ready in time, the update connects as usual */
+	for (i = 0; i < num; i++)
+		http_cancel(clients[i]);
+
+	free(clients);
 }
 
-static int get_encoded_user_passwd(void)
+/* Close pre-warmed connections not used, returns msec to next, or -1 */
+static int prewarm_idle(void)
 {
-	int rc = 0;
-	char *buf = NULL;
-	size_t len;
 	ddns_info_t *info;
-
-	/* Take base64 encoding into account when allocating buf */
-	len = sizeof(info->creds.password) + sizeof(info->creds.username) + 2;
-	len = (len / 3 + ((len % 3) ? 1 : 0)) * 4; /* output length = 4 * [input len / 3] */
-
-	buf = calloc(len, sizeof(char));
-	if (!buf)
-		return RC_OUT_OF_MEMORY;
+	int next = -1;
 
 	info = conf_info_iterator(1);
 	while (info) {
-		int rc2;
-		char *encode;
-		size_t dlen = 0;
-
-		info->creds.encoded = 0;
-
-		/*
-		 * Concatenate username and password with a ':', without
-		 * snprintf(), since that can cause information loss if
-		 * the password has "\=" or similar in it, issue #57
-		 */
-		strlcpy(buf, info->creds.username, len);
-		strlcat(buf, ":", len);
-		strlcat(buf, info->creds.password, len);
-
-		/* query required buffer size for base64 encoded data */
-		base64_encode(NULL, &dlen, (unsigned char *)buf, strlen(buf));
-
-		encode = malloc(dlen);
-		if (!encode) {
-			logit(LOG_WARNING, "Out of memory base64 encoding user:pass for %s!", info->system->name);
-			rc = RC_OUT_OF_MEMORY;
-			break;
-		}
+		size_t i;
+		int left;
 
-//		logit(LOG_DEBUG, "Base64 encode %s for %s ...", buf, info->system->name);
-		rc2 = base64_encode((unsigned char *)encode, &dlen, (unsigned char *)buf, strlen(buf));
-		if (rc2) {
-			logit(LOG_WARNING, "Failed base64 encoding user:pass for %s!", info->system->name);
-			free(encode);
-			rc = RC_BUFFER_OVERFLOW;
-			break;
+		for (i = 0; i < info->checkip_num; i++) {
+			left = http_idle(&info->checkip[i].client);
+			if (left >= 0 && (next < 0 || left < next))
+				next = left;
 		}
 
-//		logit(LOG_DEBUG, "Base64 encoded string: %s", encode);
-		info->creds.encoded_password = encode;
-		info->creds.encoded = 1;
-		info->creds.size = strlen(info->creds.encoded_password);
+		left = http_idle(&info->server);
+		if (left >= 0 && (next < 0 || left < next))
+			next = left;
 
 		info = conf_info_iterator(0);
 	}
 
-	memset(buf, 0, len);
-	free(buf);
+	return next;
+}
 
-	return rc;
+/* Plugin lookups, e.g. zone and record IDs, see prefetch() */
+static void run_prefetch(ddns_t *ctx, struct update_job *job)
+{
+	ddns_info_t *info = job->info;
+	long long t;
+	int rc;
+
+	t  = trace_start();
+	rc = info->system->prefetch(ctx, info);
+	trace_span(t, "plugin", "prefetch %s", info->system->name);
+	if (rc)
+		logit(LOG_INFO, "Failed prefetching %s data, looking it up on update: %s",
+		      info->system->name, error_str(rc));
+	else
+		logit(LOG_DEBUG, "Prefetched %s data", info->system->name);
+
+	http_exit(&info->server);
 }
 
-static int init_context(ddns_t *ctx)
+/*
+ * Plugins that need more than the update request, e.g. zone and record
+ * IDs, look these up once, while idle, rather than on the first update
+ * after an address change.  Providers are done concurrently, one job
+ * each, like updates.  A failed lookup is not retried here, setup()
+ * does it again when the update is due.  New providers, on reload, get
+ * their turn in the next idle wait.
+ */
+static void prefetch(ddns_t *ctx)
 {
+	struct update_job *jobs;
 	ddns_info_t *info;
-	struct timeval tv;
+	size_t num = 0;
 
-	if (!ctx)
-		return RC_INVALID_POINTER;
+	if (!ctx->prefetch || ctx->cmd != NO_CMD || !ha_active())
+		return;
 
-	if (ctx->initialized == 1)
-		return 0;
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->system->prefetch && !info->prefetched && info->initialized)
+			num++;
+		info = conf_info_iterator(0);
+	}
+	if (!num)
+		return;
 
-	/* Seed prng, used in silly IP randomizer */
-	gettimeofday(&tv, NULL);
-	srand((unsigned int)tv.tv_usec);
+	jobs = calloc(num, sizeof(*jobs));
+	if (!jobs)
+		return;
 
+	num  = 0;
 	info = conf_info_iterator(1);
 	while (info) {
-		http_t *checkip = &info->checkip;
-		http_t *update  = &info->server;
+		/* An open breaker is tried again in the next idle wait */
+		if (info->system->prefetch && !info->prefetched && info->initialized &&
+		    !breaker_open(&info->breaker)) {
+			info->prefetched = 1;
+			jobs[num++].info = info;
+		}
+		info = conf_info_iterator(0);
+	}
 
-		if (strlen(info->proxy_name.name)) {
-			http_set_port(checkip, info->proxy_name.port);
-			http_set_port(update,  info->proxy_name.port);
+	if (num)
+		run_concurrent(ctx, jobs, num, num, run_prefetch);
+	arena_reset(ctx->arena);
+	free(jobs);
+}
+
+/* Mark all providers due at @now, only those are checked in this pass */
+static void schedule_due(time_t now)
+{
+	ddns_info_t *info;
 
-			http_set_remote_name(checkip, info->proxy_name.name);
-			http_set_remote_name(update,  info->proxy_name.name);
-		} else {
-			http_set_port(checkip, info->checkip_name.port);
-			http_set_port(update,  info->server_name.port);
+	while ((info = sched_due(now))) {
+		info->due         = 1;
+		info->status      = 0;
+		info->retry_after = 0;
+		budget_reset(&info->cycle_budget, info->budget ? info->budget : budget_provider_sec);
+	}
+}
+
+/*
+ * Put providers checked in this pass back on the schedule, each on its
+ * own period, and sleep until the first one is due again.  A provider
+ * asking us to back off does not hold back any of the others.
+ */
+static int schedule_next(ddns_t *ctx, time_t now)
+{
+	ddns_info_t *info;
+	time_t next;
 
-			http_set_remote_name(checkip, info->checkip_name.name);
-			http_set_remote_name(update,  info->server_name.name);
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->due) {
+			int period = next_period(ctx, info);
+
+			if (info->status == RC_DDNS_RATE_LIMITED || info->status == RC_DDNS_CIRCUIT_OPEN ||
+			    info->status == RC_DDNS_OVER_BUDGET)
+				logit(LOG_NOTICE, "Will send deferred updates to %s in %d sec ...",
+				      info->system->name, period);
+			else if (info->status)
+				logit(LOG_WARNING, "Will retry %s again in %d sec, attempt %u ...",
+				      info->system->name, period, info->retries);
+
+			info->due = 0;
+			info->next_check = now + period;
+			DO(sched_add(info, info->next_check));
 		}
 
 		info = conf_info_iterator(0);
 	}
 
-	/* Restore values, if reset by SIGHUP.  Initialize time from cache file at startup. */
-	ctx->num_iterations = cached_num_iterations;
-
-	ctx->initialized = 1;
+	next = sched_next();
+	if (next < 0)
+		ctx->update_period = ctx->normal_update_period_sec;
+	else if (next > event_now())
+		ctx->update_period = next - event_now();
+	else
+		ctx->update_period = 0;
 
 	return 0;
 }
 
-static int check_address(ddns_t *ctx)
+/*
+ * (Re)build the schedule from all providers, e.g., after a reload when
+ * some may have been freed.  With @now all are checked in the next pass.
+ */
+static int schedule_all(int now)
 {
-	if (!ctx)
-		return RC_INVALID_POINTER;
+	ddns_info_t *info;
 
-	/* Get IP address from any of the different backends */
-	DO(get_address(ctx));
+	sched_clear();
 
-	/* Step through aliases list, resolve them and check if they point to my IP */
-	DO(check_alias_update_table(ctx));
+	info = conf_info_iterator(1);
+	while (info) {
+		if (now)
+			info->next_check = 0;
+		info->due = 0;
+		DO(sched_add(info, info->next_check));
+		info = conf_info_iterator(0);
+	}
 
-	/* Update IPs marked as not identical with my IP */
-	DO(update_alias_table(ctx));
+	return 0;
+}
+
+/* Set up providers added since startup, or last reload */
+static int init_providers(ddns_t *ctx)
+{
+	ddns_info_t *info;
+
+	DO(init_context(ctx));
+	DO(read_cache_file(ctx));
+	DO(get_encoded_user_passwd());
+
+	info = conf_info_iterator(1);
+	while (info) {
+		info->initialized = 1;
+		info = conf_info_iterator(0);
+	}
 
 	return 0;
 }
 
+/* Tell the service manager how the last cycle went, see notify.c */
+static void cycle_status(long long msec, int rc)
+{
+	ddns_info_t *info, *failed = NULL;
+	int num = 0, total = 0;
+
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		total++;
+		if (!info->status || info->status == RC_DDNS_RATE_LIMITED)
+			continue;
+		if (!failed)
+			failed = info;
+		num++;
+	}
+
+	if (rc)
+		notify("STATUS=Last cycle %lld.%03lld sec, error: %s", msec / 1000, msec % 1000,
+		       error_str(rc));
+	else if (failed)
+		notify("STATUS=Last cycle %lld.%03lld sec, %d of %d providers failing, %s: %s",
+		       msec / 1000, msec % 1000, num, total, failed->system->name,
+		       error_str(failed->status));
+	else
+		notify("STATUS=Last cycle %lld.%03lld sec, OK", msec / 1000, msec % 1000);
+}
+
 /*
- * Error filter.  Some errors are to be expected in a network
- * application, some we can recover from, wait a shorter while and try
- * again, whereas others are terminal, e.g., some OS errors.
+ * SIGHUP, reload .conf file in place.  Unchanged providers keep all of
+ * their state, only new or changed ones are set up.  If the file has a
+ * syntax error we keep going with what we have.
  */
-static int check_error(ddns_t *ctx, int rc)
+static int reload(ddns_t *ctx)
 {
-	const char *errstr = "Error response from DDNS server";
+	notify("RELOADING=1\nMONOTONIC_USEC=%lld", event_msec() * 1000);
+	if (conf_reload(ctx)) {
+		notify("READY=1");
+		return 0;
+	}
 
-	switch (rc) {
-	case RC_OK:
-		ctx->update_period = ctx->normal_update_period_sec;
-		break;
+	DO(init_providers(ctx));
+
+	/* Unchanged providers keep their schedule, new ones are due now */
+	DO(schedule_all(0));
+
+	/* Watched interfaces, gateways, and the HA peer may have changed */
+	ifmon_exit();
+	gateway_exit();
+	ha_exit();
+	share_exit();
+	share_init(ctx);
+	if (!once) {
+		ifmon_init(ctx);
+		gateway_init(ctx);
+		ha_init(ctx);
+	}
 
-	/* dyn_dns_update_ip() failed, inform the user the (network) error
-	 * is not fatal and that we will retry again in a short while. */
-	case RC_TCP_INVALID_REMOTE_ADDR: /* Probably temporary DNS error. */
-	case RC_TCP_CONNECT_FAILED:      /* Cannot connect to DDNS server atm. */
-	case RC_TCP_SEND_ERROR:
-	case RC_TCP_RECV_ERROR:
-	case RC_OS_INVALID_IP_ADDRESS:
-	case RC_DDNS_RSP_RETRY_LATER:
-	case RC_DDNS_INVALID_CHECKIP_RSP:
-	case RC_DDNS_RSP_TOO_FREQUENT:
-		ctx->update_period = ctx->error_update_period_sec;
-		logit(LOG_WARNING, "Will retry again in %d sec ...", ctx->update_period);
-		break;
+	/* And so may the control socket */
+	ctrl_exit();
+	if (!once)
+		ctrl_init(ctx);
 
-	case RC_DDNS_RSP_NOTOK:
-	case RC_DDNS_RSP_AUTH_FAIL:
-		if (ignore_errors) {
-			logit(LOG_WARNING, "%s, ignoring ...", errstr);
-			break;
-		}
-		logit(LOG_ERR, "%s, exiting!", errstr);
-		return 1;
+	/* Pick up any new ca-trust-file, or updated system CA store */
+	ssl_reload();
 
-	/* All other errors, socket creation failures, invalid pointers etc.  */
-	default:
-		logit(LOG_ERR, "Unrecoverable error %d, exiting ...", rc);
-		return 1;
-	}
+	/* Resolve everything again, resolv.conf may have changed */
+	dnscache_flush();
+	notify("READY=1");
 
 	return 0;
 }
@@ -944,6 +2898,9 @@ int ddns_main_loop(ddns_t *ctx)
 	if (!ctx)
 		return RC_INVALID_POINTER;
 
+	/* Started by systemd, or similar, see notify.c */
+	notify_init();
+
 	/* On first startup only, optionally wait for network and any NTP daemon
 	 * to set system time correctly.  Intended for devices without battery
 	 * backed real time clocks as initialization of time since last update
@@ -951,6 +2908,8 @@ int ddns_main_loop(ddns_t *ctx)
 	 * signals inadyn responds too. */
 	if (first_startup && startup_delay) {
 		logit(LOG_NOTICE, "Startup delay: %d sec ...", startup_delay);
+		notify("STATUS=Startup delay %d sec ...\nEXTEND_TIMEOUT_USEC=%lld", startup_delay,
+		       (startup_delay + DDNS_NOTIFY_TIMEOUT) * 1000000LL);
 		first_startup = 0;
 
 		/* Now sleep a while. Using the time set in update_period data member */
@@ -959,6 +2918,7 @@ int ddns_main_loop(ddns_t *ctx)
 
 		if (ctx->cmd == CMD_STOP) {
 			logit(LOG_NOTICE, "STOP command received, exiting.");
+			notify("STOPPING=1");
 			return 0;
 		}
 		if (ctx->cmd == CMD_RESTART) {
@@ -983,9 +2943,21 @@ int ddns_main_loop(ddns_t *ctx)
 		}
 	}
 
-	DO(init_context(ctx));
-	DO(read_cache_file(ctx));
-	DO(get_encoded_user_passwd());
+	DO(init_providers(ctx));
+
+	/* Everything is due on the first pass */
+	DO(schedule_all(1));
+
+	/* Addresses looked up by other instances on this host, if enabled */
+	share_init(ctx);
+
+	/* Wake up on interface address changes, or gateway announcements, instead of polling */
+	if (!once) {
+		ifmon_init(ctx);
+		gateway_init(ctx);
+		ha_init(ctx);
+		ctrl_init(ctx);
+	}
 
 	if (once && force) {
 			info = conf_info_iterator(1);
@@ -1001,39 +2973,81 @@ int ddns_main_loop(ddns_t *ctx)
 	/* Initialization done, create pidfile to indicate we are ready to communicate */
 	if (once == 0 && pidfile_name[0] && pidfile(pidfile_name))
 		logit(LOG_WARNING, "Failed creating pidfile: %s", strerror(errno));
+	notify("READY=1\nSTATUS=Started, checking %s ...", once ? "once" : "addresses");
+
+	/* Log messages are written out by the main loop, see log.c */
+	log_async(1);
 
 	/* DDNS client main loop */
 	while (1) {
+		time_t now = event_now();
+		long long start = event_msec(), msec, t;
+
+		/* Before anything is due, so update times are on the new clock */
+		clock_step();
+
+		/* Only providers that are due are checked in this pass */
+		schedule_due(now);
+
+		/* Work not done by the deadline is deferred, see budget.c */
+		budget_cycle(start + (budget_cycle_sec ? budget_cycle_sec : ctx->normal_update_period_sec) * 1000LL);
+
+		t = trace_cycle();
 		rc = check_address(ctx);
+		trace_span(t, "cycle", "check_address");
+		budget_cycle(0);
+		trace_write();
+		arena_reset(ctx->arena);
+		msec = event_msec() - start;
+		metrics_cycle(msec);
+		notify_watchdog();
 		if (RC_OK == rc) {
 			if (ctx->total_iterations != 0 &&
 			    ++ctx->num_iterations >= ctx->total_iterations)
 				break;
 		}
 
+		if (schedule_next(ctx, now)) {
+			rc = RC_OUT_OF_MEMORY;
+			break;
+		}
+
+		/* After scheduling, so next check times are current */
+		metrics_write();
+		cycle_status(msec, rc);
+
 		if (ctx->cmd == CMD_RESTART) {
-			logit(LOG_INFO, "RESTART command received. Restarting.");
+			logit(LOG_INFO, "RESTART command received, reloading configuration.");
 			ctx->cmd = NO_CMD;
-			rc = RC_RESTART;
-			break;
+			rc = reload(ctx);
+			if (rc)
+				break;
+			continue;
 		}
 
 		/* On error, check why, possibly need to retry sooner ... */
 		if (check_error(ctx, rc))
 			break;
 
-		/* Now sleep a while. Using the time set in update_period data member */
+		/* Plugin lookups ahead of the first update, see prefetch() */
+		prefetch(ctx);
+
+		/* Now sleep until the next provider is due, see schedule_next() */
 		wait_for_cmd(ctx);
 
 		if (ctx->cmd == CMD_STOP) {
 			logit(LOG_NOTICE, "STOP command received, exiting.");
+			notify("STOPPING=1");
 			rc = 0;
 			break;
 		}
 		if (ctx->cmd == CMD_RESTART) {
-			logit(LOG_INFO, "RESTART command received, restarting.");
-			rc = RC_RESTART;
-			break;
+			logit(LOG_INFO, "RESTART command received, reloading configuration.");
+			ctx->cmd = NO_CMD;
+			rc = reload(ctx);
+			if (rc)
+				break;
+			continue;
 		}
 		if (ctx->cmd == CMD_FORCED_UPDATE) {
 			logit(LOG_INFO, "FORCED_UPDATE command received, updating now.");
@@ -1048,16 +3062,49 @@ int ddns_main_loop(ddns_t *ctx)
 				info = conf_info_iterator(0);
 			}
 			ctx->cmd = NO_CMD;
+			if (schedule_all(1)) {
+				rc = RC_OUT_OF_MEMORY;
+				break;
+			}
 			continue;
 		}
 
 		if (ctx->cmd == CMD_CHECK_NOW) {
 			logit(LOG_INFO, "CHECK_NOW command received, checking ...");
 			ctx->cmd = NO_CMD;
+			if (schedule_all(1)) {
+				rc = RC_OUT_OF_MEMORY;
+				break;
+			}
 			continue;
 		}
+
+		/* Some providers made due, e.g. from the control socket */
+		if (ctx->cmd == CMD_WAKEUP)
+			ctx->cmd = NO_CMD;
+	}
+
+	log_async(0);
+	sched_clear();
+	ifmon_exit();
+	gateway_exit();
+	ha_exit();
+	share_exit();
+	ctrl_exit();
+
+	/* Close any kept-alive checkip connections */
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i;
+
+		for (i = 0; i < info->checkip_num; i++)
+			http_exit(&info->checkip[i].client);
+		info = conf_info_iterator(0);
 	}
 
+	/* Resolve everything again after SIGHUP, resolv.conf may have changed */
+	dnscache_flush();
+
 	/* Save old value, if restarted by SIGHUP */
 	cached_num_iterations = ctx->num_iterations;
 
@@ -0,0 +1,649 @@
+/* UDP based public address discovery, STUN and DNS
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * An HTTP checkip costs a TCP, and usually a TLS, handshake plus the
+ * HTTP exchange every period.  A single UDP round-trip does the same:
+ * either a STUN binding request (RFC 5389), where the server replies
+ * with the address and port it saw, or a DNS query to a service that
+ * answers with the address the query came from.
+ *
+ * Both are plain request/response, so there is no need for the event
+ * loop here.  Lost datagrams are retried a few times, and replies that
+ * do not match the transaction ID we sent are ignored.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <resolv.h>
+
+#include "budget.h"
+#include "compat.h"
+#include "discover.h"
+#include "dnscache.h"
+#include "error.h"
+#include "event.h"
+#include "log.h"
+
+#define STUN_HEADER_LEN		20
+#define STUN_BINDING_REQUEST	0x0001
+#define STUN_BINDING_RESPONSE	0x0101
+#define STUN_MAGIC_COOKIE	0x2112A442
+#define STUN_MAPPED_ADDRESS	0x0001
+#define STUN_XOR_MAPPED_ADDRESS	0x0020
+#define STUN_XOR_MAPPED_OLD	0x8020	/* Pre-RFC 5389 servers */
+
+#define DNS_PORT		53
+#define DNS_MAX_PACKET		512
+
+/* Query type zero means A or AAAA, depending on the address family */
+static const struct {
+	const char *name;
+	const char *server;
+	const char *qname;
+	int         qtype;
+	int         qclass;
+} services[] = {
+	[DISCOVER_DNS_OPENDNS]    = { "opendns",    "resolver1.opendns.com", "myip.opendns.com",        0,     C_IN    },
+	[DISCOVER_DNS_GOOGLE]     = { "google",     "ns1.google.com",        "o-o.myaddr.l.google.com", T_TXT, C_IN    },
+	[DISCOVER_DNS_CLOUDFLARE] = { "cloudflare", "one.one.one.one",       "whoami.cloudflare",       T_TXT, C_CHAOS },
+};
+
+static unsigned short get16(const unsigned char *ptr)
+{
+	return (ptr[0] << 8) | ptr[1];
+}
+
+static void put16(unsigned char *ptr, unsigned short val)
+{
+	ptr[0] = val >> 8;
+	ptr[1] = val & 0xff;
+}
+
+/* Random transaction ID, only needs to be hard to guess for off-path spoofers */
+static void random_id(unsigned char *id, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		id[i] = rand() & 0xff;
+}
+
+/*
+ * Send @req to @host:@port and wait for a reply that @match accepts,
+ * retrying %DISCOVER_RETRIES times, each waiting %DISCOVER_TIMEOUT.
+ * Returns length of the reply in @rsp, or -1 on failure.
+ */
+static ssize_t exchange(const char *host, int port, int family, const void *req, size_t reqlen,
+			unsigned char *rsp, size_t rsplen,
+			int (*match)(const unsigned char *rsp, ssize_t len, const void *req))
+{
+	dns_addr_t addr[DNSCACHE_MAX_ADDRS];
+	int attempt, num, rc;
+
+	rc = dnscache_resolve(host, port, family, addr, &num);
+	if (rc) {
+		logit(LOG_WARNING, "Failed resolving hostname %s: %s", host, gai_strerror(rc));
+		return -1;
+	}
+
+	for (attempt = 0; attempt < DISCOVER_RETRIES && !budget_expired(); attempt++) {
+		dns_addr_t *a = &addr[attempt % num];
+		long long deadline;
+		int sd;
+
+		sd = socket(a->ss.ss_family, SOCK_DGRAM, 0);
+		if (sd < 0) {
+			logit(LOG_WARNING, "Failed creating UDP socket: %s", strerror(errno));
+			return -1;
+		}
+
+		if (connect(sd, (struct sockaddr *)&a->ss, a->len) || send(sd, req, reqlen, 0) < 0) {
+			logit(LOG_DEBUG, "Failed sending to %s: %s", host, strerror(errno));
+			close(sd);
+			continue;
+		}
+
+		deadline = budget_clamp(event_msec() + DISCOVER_TIMEOUT);
+		while (1) {
+			struct pollfd pfd = { .fd = sd, .events = POLLIN };
+			long long now = event_msec();
+			ssize_t len;
+
+			if (now >= deadline)
+				break;
+
+			rc = poll(&pfd, 1, (int)(deadline - now));
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+
+			len = recv(sd, rsp, rsplen, 0);
+			if (len < 0) {
+				/* E.g., ICMP port unreachable */
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+
+			if (match(rsp, len, req)) {
+				close(sd);
+				return len;
+			}
+		}
+
+		close(sd);
+		logit(LOG_DEBUG, "No reply from %s, attempt %d of %d", host, attempt + 1, DISCOVER_RETRIES);
+	}
+
+	return -1;
+}
+
+static int stun_match(const unsigned char *rsp, ssize_t len, const void *req)
+{
+	if (len < STUN_HEADER_LEN || get16(rsp) != STUN_BINDING_RESPONSE)
+		return 0;
+
+	/* Magic cookie and transaction ID */
+	return !memcmp(rsp + 4, (const unsigned char *)req + 4, STUN_HEADER_LEN - 4);
+}
+
+/* Address from (XOR-)MAPPED-ADDRESS value, XOR'ed with cookie and ID if @xor */
+static int stun_address(const unsigned char *val, size_t vlen, const unsigned char *hdr, int xor,
+			char *address, size_t len)
+{
+	unsigned char addr[16];
+	size_t i, alen;
+	int family;
+
+	if (vlen < 8)
+		return 1;
+
+	switch (val[1]) {
+	case 1:
+		family = AF_INET;
+		alen   = 4;
+		break;
+
+	case 2:
+		family = AF_INET6;
+		alen   = 16;
+		break;
+
+	default:
+		return 1;
+	}
+
+	if (vlen < 4 + alen)
+		return 1;
+
+	memcpy(addr, val + 4, alen);
+	if (xor) {
+		/* Cookie, then transaction ID, follow the type and length */
+		for (i = 0; i < alen; i++)
+			addr[i] ^= hdr[4 + i];
+	}
+
+	return !inet_ntop(family, addr, address, len);
+}
+
+/**
+ * discover_stun - Get public address with a STUN binding request
+ * @host:    STUN server
+ * @port:    STUN server port, zero for %DISCOVER_STUN_PORT
+ * @family:  %AF_INET or %AF_INET6, the address family to discover
+ * @address: Buffer for the address, in text form
+ * @len:     Size of @address
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_CHECKIP_RSP on failure.
+ */
+int discover_stun(const char *host, int port, int family, char *address, size_t len)
+{
+	unsigned char req[STUN_HEADER_LEN], rsp[DNS_MAX_PACKET];
+	const unsigned char *ptr, *end;
+	int found = 0;
+	ssize_t n;
+
+	put16(req, STUN_BINDING_REQUEST);
+	put16(req + 2, 0);
+	put16(req + 4, STUN_MAGIC_COOKIE >> 16);
+	put16(req + 6, STUN_MAGIC_COOKIE & 0xffff);
+	random_id(req + 8, STUN_HEADER_LEN - 8);
+
+	n = exchange(host, port ? port : DISCOVER_STUN_PORT, family, req, sizeof(req),
+		     rsp, sizeof(rsp), stun_match);
+	if (n < 0)
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	end = rsp + STUN_HEADER_LEN + get16(rsp + 2);
+	if (end > rsp + n)
+		end = rsp + n;
+
+	/* Prefer XOR-MAPPED-ADDRESS, some NATs rewrite addresses in payloads */
+	for (ptr = rsp + STUN_HEADER_LEN; ptr + 4 <= end; ptr += 4 + ((get16(ptr + 2) + 3) & ~3)) {
+		unsigned short type = get16(ptr), vlen = get16(ptr + 2);
+
+		if (ptr + 4 + vlen > end)
+			break;
+
+		if (type == STUN_XOR_MAPPED_ADDRESS || type == STUN_XOR_MAPPED_OLD) {
+			if (!stun_address(ptr + 4, vlen, rsp, 1, address, len))
+				return 0;
+		} else if (type == STUN_MAPPED_ADDRESS && !found) {
+			found = !stun_address(ptr + 4, vlen, rsp, 0, address, len);
+		}
+	}
+
+	if (found)
+		return 0;
+
+	logit(LOG_WARNING, "No mapped address in STUN reply from %s", host);
+	return RC_DDNS_INVALID_CHECKIP_RSP;
+}
+
+static int dns_match(const unsigned char *rsp, ssize_t len, const void *req)
+{
+	const HEADER *hdr = (const HEADER *)rsp;
+
+	if (len < HFIXEDSZ || !hdr->qr)
+		return 0;
+
+	return !memcmp(rsp, req, 2);
+}
+
+/* Skip a possibly compressed name, returns NULL if malformed */
+static const unsigned char *dns_skip(const unsigned char *ptr, const unsigned char *end)
+{
+	while (ptr < end) {
+		if (!*ptr)
+			return ptr + 1;
+		if ((*ptr & 0xc0) == 0xc0)
+			return ptr + 2 <= end ? ptr + 2 : NULL;
+		ptr += *ptr + 1;
+	}
+
+	return NULL;
+}
+
+static int dns_query(unsigned char *buf, size_t len, const char *name, int qtype, int qclass, int rd)
+{
+	unsigned char *ptr = buf + HFIXEDSZ;
+	unsigned char *end = buf + len;
+
+	memset(buf, 0, HFIXEDSZ);
+	random_id(buf, 2);
+	if (rd)
+		buf[2] = 0x01;	/* RD */
+	put16(buf + 4, 1);	/* QDCOUNT */
+
+	while (*name) {
+		const char *dot = strchr(name, '.');
+		size_t label = dot ? (size_t)(dot - name) : strlen(name);
+
+		if (!label || label > 63 || ptr + label + 1 >= end)
+			return -1;
+
+		*ptr++ = label;
+		memcpy(ptr, name, label);
+		ptr  += label;
+		name += label;
+		if (*name)
+			name++;
+	}
+
+	if (ptr + 5 > end)
+		return -1;
+	*ptr++ = 0;
+	put16(ptr, qtype);
+	put16(ptr + 2, qclass);
+
+	return (int)(ptr + 4 - buf);
+}
+
+/**
+ * discover_dns - Get public address from a DNS service
+ * @service: One of %DISCOVER_DNS_OPENDNS, %DISCOVER_DNS_GOOGLE, ...
+ * @family:  %AF_INET or %AF_INET6, the address family to discover
+ * @address: Buffer for the address, in text form
+ * @len:     Size of @address
+ *
+ * The query is sent over @family, so the service sees, and replies
+ * with, our address of that family.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_CHECKIP_RSP on failure.
+ */
+int discover_dns(int service, int family, char *address, size_t len)
+{
+	unsigned char req[DNS_MAX_PACKET], rsp[DNS_MAX_PACKET];
+	const unsigned char *ptr, *end;
+	int qtype, qd, an, reqlen;
+	ssize_t n;
+
+	if (service <= DISCOVER_DNS_NONE || service >= (int)NELEMS(services))
+		return RC_DDNS_INVALID_OPTION;
+
+	qtype = services[service].qtype;
+	if (!qtype)
+		qtype = family == AF_INET6 ? T_AAAA : T_A;
+
+	reqlen = dns_query(req, sizeof(req), services[service].qname, qtype, services[service].qclass, 1);
+	if (reqlen < 0)
+		return RC_BUFFER_OVERFLOW;
+
+	n = exchange(services[service].server, DNS_PORT, family, req, reqlen, rsp, sizeof(rsp), dns_match);
+	if (n < 0)
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	if (((const HEADER *)rsp)->rcode != NOERROR) {
+		logit(LOG_WARNING, "DNS error %d from %s", ((const HEADER *)rsp)->rcode,
+		      services[service].server);
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	end = rsp + n;
+	ptr = rsp + HFIXEDSZ;
+	qd  = get16(rsp + 4);
+	an  = get16(rsp + 6);
+
+	while (ptr && qd-- > 0) {
+		ptr = dns_skip(ptr, end);
+		if (ptr)
+			ptr += QFIXEDSZ;
+	}
+
+	while (ptr && an-- > 0) {
+		unsigned short type, rdlen;
+
+		ptr = dns_skip(ptr, end);
+		if (!ptr || ptr + RRFIXEDSZ > end)
+			break;
+
+		type  = get16(ptr);
+		rdlen = get16(ptr + 8);
+		ptr  += RRFIXEDSZ;
+		if (ptr + rdlen > end)
+			break;
+
+		if (type == qtype && type == T_A && rdlen == 4)
+			return !inet_ntop(AF_INET, ptr, address, len) ? RC_DDNS_INVALID_CHECKIP_RSP : 0;
+		if (type == qtype && type == T_AAAA && rdlen == 16)
+			return !inet_ntop(AF_INET6, ptr, address, len) ? RC_DDNS_INVALID_CHECKIP_RSP : 0;
+
+		/* First character-string of the first TXT record */
+		if (type == qtype && type == T_TXT && rdlen > 0 && ptr[0] < rdlen) {
+			size_t slen = ptr[0] < len ? ptr[0] : len - 1;
+
+			memcpy(address, ptr + 1, slen);
+			address[slen] = 0;
+			return 0;
+		}
+
+		ptr += rdlen;
+	}
+
+	logit(LOG_WARNING, "No address in DNS reply from %s", services[service].server);
+	return RC_DDNS_INVALID_CHECKIP_RSP;
+}
+
+/*
+ * Name servers of the zone @name is in, from the system resolver.  The
+ * record itself usually has no NS, so walk up one label at a time, but
+ * stop before the TLD, its servers only refer us further down.
+ */
+static int auth_servers(const char *name, char ns[][NS_MAXDNAME], int max)
+{
+	unsigned char rsp[NS_PACKETSZ];
+	const char *zone = name;
+	int num = 0;
+
+	while (zone && strchr(zone, '.')) {
+		const unsigned char *ptr, *end;
+		int qd, an, n;
+
+		n = res_query(zone, C_IN, T_NS, rsp, sizeof(rsp));
+		if (n < HFIXEDSZ)
+			goto next;
+
+		end = rsp + n;
+		ptr = rsp + HFIXEDSZ;
+		qd  = get16(rsp + 4);
+		an  = get16(rsp + 6);
+
+		while (ptr && qd-- > 0) {
+			ptr = dns_skip(ptr, end);
+			if (ptr)
+				ptr += QFIXEDSZ;
+		}
+
+		while (ptr && an-- > 0 && num < max) {
+			unsigned short type, rdlen;
+
+			ptr = dns_skip(ptr, end);
+			if (!ptr || ptr + RRFIXEDSZ > end)
+				break;
+
+			type  = get16(ptr);
+			rdlen = get16(ptr + 8);
+			ptr  += RRFIXEDSZ;
+			if (ptr + rdlen > end)
+				break;
+
+			if (type == T_NS && dn_expand(rsp, end, ptr, ns[num], NS_MAXDNAME) > 0)
+				num++;
+
+			ptr += rdlen;
+		}
+
+		if (num)
+			return num;
+	next:
+		zone = strchr(zone, '.');
+		if (zone)
+			zone++;
+	}
+
+	return 0;
+}
+
+/* Address records in a reply, must all be the same */
+static int dns_address(const unsigned char *rsp, ssize_t n, int qtype, char *address, size_t len)
+{
+	const unsigned char *ptr, *end = rsp + n;
+	char addr[INET6_ADDRSTRLEN];
+	int qd, an, found = 0;
+
+	if (n < HFIXEDSZ || ((const HEADER *)rsp)->rcode != NOERROR)
+		return 1;
+
+	ptr = rsp + HFIXEDSZ;
+	qd  = get16(rsp + 4);
+	an  = get16(rsp + 6);
+
+	while (ptr && qd-- > 0) {
+		ptr = dns_skip(ptr, end);
+		if (ptr)
+			ptr += QFIXEDSZ;
+	}
+
+	while (ptr && an-- > 0) {
+		unsigned short type, rdlen;
+
+		ptr = dns_skip(ptr, end);
+		if (!ptr || ptr + RRFIXEDSZ > end)
+			return 1;
+
+		type  = get16(ptr);
+		rdlen = get16(ptr + 8);
+		ptr  += RRFIXEDSZ;
+		if (ptr + rdlen > end)
+			return 1;
+
+		if (type == qtype && rdlen == (qtype == T_A ? 4 : 16)) {
+			if (!inet_ntop(qtype == T_A ? AF_INET : AF_INET6, ptr, addr, sizeof(addr)))
+				return 1;
+			if (found && strcmp(addr, address))
+				return 1;
+
+			strlcpy(address, addr, len);
+			found = 1;
+		}
+
+		ptr += rdlen;
+	}
+
+	return !found;
+}
+
+/**
+ * discover_auth - Look up a record at its authoritative name servers
+ * @name:    Hostname to look up
+ * @family:  %AF_INET or %AF_INET6, for an A or AAAA record
+ * @address: Buffer for the address, in text form
+ * @len:     Size of @address
+ *
+ * Recursive resolvers may serve a stale record until its TTL runs out,
+ * so the query is sent without recursion directly to the name servers
+ * of the zone.  Only an authoritative answer, where all records of the
+ * type agree, is returned.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_CHECKIP_RSP if the record could not
+ * be found, or is not a single address.
+ */
+int discover_auth(const char *name, int family, char *address, size_t len)
+{
+	unsigned char req[DNS_MAX_PACKET], rsp[DNS_MAX_PACKET];
+	char ns[DISCOVER_AUTH_SERVERS][NS_MAXDNAME];
+	int i, num, qtype, reqlen;
+
+	qtype  = family == AF_INET6 ? T_AAAA : T_A;
+	reqlen = dns_query(req, sizeof(req), name, qtype, C_IN, 0);
+	if (reqlen < 0)
+		return RC_BUFFER_OVERFLOW;
+
+	num = auth_servers(name, ns, DISCOVER_AUTH_SERVERS);
+	if (!num) {
+		logit(LOG_DEBUG, "Cannot find name servers of %s", name);
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	for (i = 0; i < num; i++) {
+		ssize_t n;
+
+		n = exchange(ns[i], DNS_PORT, AF_UNSPEC, req, reqlen, rsp, sizeof(rsp), dns_match);
+		if (n < 0)
+			continue;
+
+		if (((const HEADER *)rsp)->aa && !dns_address(rsp, n, qtype, address, len)) {
+			logit(LOG_DEBUG, "Name server %s has %s at %s", ns[i], name, address);
+			return 0;
+		}
+
+		/* Authoritative, but not what we are looking for */
+		if (((const HEADER *)rsp)->aa)
+			break;
+	}
+
+	return RC_DDNS_INVALID_CHECKIP_RSP;
+}
+
+/**
+ * discover_query - Compose A or AAAA query, for a recursive resolver
+ * @buf:    Buffer for the query, in DNS wire format
+ * @len:    Size of @buf
+ * @name:   Hostname to look up
+ * @family: %AF_INET or %AF_INET6, for an A or AAAA record
+ *
+ * The transaction ID is zero, as recommended for DNS-over-HTTPS, so
+ * identical queries can be cached by HTTP caches.
+ *
+ * Returns:
+ * Length of the query, or -1 if @name does not fit in @buf.
+ */
+int discover_query(void *buf, size_t len, const char *name, int family)
+{
+	int n;
+
+	n = dns_query(buf, len, name, family == AF_INET6 ? T_AAAA : T_A, C_IN, 1);
+	if (n > 0)
+		put16(buf, 0);
+
+	return n;
+}
+
+/**
+ * discover_answer - Address in reply to discover_query()
+ * @rsp:     Reply, in DNS wire format
+ * @n:       Length of @rsp
+ * @family:  %AF_INET or %AF_INET6, as in the query
+ * @address: Buffer for the address, in text form
+ * @len:     Size of @address
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_CHECKIP_RSP if the reply is an error,
+ * or does not hold a single address.
+ */
+int discover_answer(const void *rsp, size_t n, int family, char *address, size_t len)
+{
+	if (dns_address(rsp, n, family == AF_INET6 ? T_AAAA : T_A, address, len))
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	return 0;
+}
+
+/* Service for .conf file name, or %DISCOVER_DNS_NONE if unknown */
+int discover_dns_lookup(const char *name)
+{
+	size_t i;
+
+	for (i = 1; i < NELEMS(services); i++) {
+		if (!strcasecmp(services[i].name, name))
+			return i;
+	}
+
+	return DISCOVER_DNS_NONE;
+}
+
+const char *discover_dns_name(int service)
+{
+	if (service <= DISCOVER_DNS_NONE || service >= (int)NELEMS(services))
+		return "none";
+
+	return services[service].name;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,280 @@
+/* In-process resolver cache, honoring record TTLs
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Every checkip query and every update used to start with a fresh
+ * getaddrinfo(), so a slow or flaky resolver added its latency to all
+ * of them.  Provider and checkip servers rarely move, so results are
+ * cached here, keyed by (host, port, family), for as long as the DNS
+ * records allow.
+ *
+ * getaddrinfo() does not tell the TTL, so when the resolver library
+ * is available we ask for the A/AAAA records separately, only on a
+ * cache miss.  Names from /etc/hosts, or when the query fails, get
+ * DNSCACHE_DEFAULT_TTL.  Entries of servers we fail to connect to are
+ * invalidated by tcp_connect(), in case they have moved.
+ */
+
+#include <netdb.h>
+#include <pthread.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+
+#include "compat.h"
+#include "dnscache.h"
+#include "event.h"
+#include "log.h"
+
+struct dns_entry {
+	char        host[256];
+	int         port;
+	int         family;
+	time_t      expires;
+
+	int         num;
+	dns_addr_t  addr[DNSCACHE_MAX_ADDRS];
+};
+
+/* Shared by parallel update workers */
+static pthread_mutex_t  lock = PTHREAD_MUTEX_INITIALIZER;
+static struct dns_entry cache[DNSCACHE_SIZE];
+
+static struct dns_entry *find(const char *host, int port, int family)
+{
+	int i;
+
+	for (i = 0; i < DNSCACHE_SIZE; i++) {
+		struct dns_entry *e = &cache[i];
+
+		if (e->num && e->port == port && e->family == family && !strcmp(e->host, host))
+			return e;
+	}
+
+	return NULL;
+}
+
+/* Reuse the entry for the same key, an empty one, or the one expiring first */
+static struct dns_entry *victim(const char *host, int port, int family)
+{
+	struct dns_entry *e, *oldest = &cache[0];
+	int i;
+
+	e = find(host, port, family);
+	if (e)
+		return e;
+
+	for (i = 0; i < DNSCACHE_SIZE; i++) {
+		e = &cache[i];
+		if (!e->num)
+			return e;
+		if (e->expires < oldest->expires)
+			oldest = e;
+	}
+
+	return oldest;
+}
+
+#ifdef HAVE_RES_QUERY
+/* Smallest TTL of the @type, or CNAME, records for @host, or -1 if unknown */
+static long query_ttl(const char *host, int type)
+{
+	unsigned char buf[NS_PACKETSZ], *ptr, *end;
+	HEADER *hdr = (HEADER *)buf;
+	int len, qd, an;
+	long ttl = -1;
+
+	len = res_query(host, C_IN, type, buf, sizeof(buf));
+	if (len < HFIXEDSZ)
+		return -1;
+	if (len > (int)sizeof(buf))
+		len = sizeof(buf);	/* Truncated */
+
+	end = buf + len;
+	ptr = buf + HFIXEDSZ;
+	qd  = ntohs(hdr->qdcount);
+	an  = ntohs(hdr->ancount);
+
+	while (qd-- > 0) {
+		int n = dn_skipname(ptr, end);
+
+		if (n < 0 || ptr + n + QFIXEDSZ > end)
+			return -1;
+		ptr += n + QFIXEDSZ;
+	}
+
+	while (an-- > 0) {
+		unsigned short rtype, rdlen;
+		unsigned long rttl;
+		int n = dn_skipname(ptr, end);
+
+		if (n < 0 || ptr + n + RRFIXEDSZ > end)
+			break;
+		ptr += n;
+
+		GETSHORT(rtype, ptr);
+		ptr += INT16SZ;		/* class */
+		GETLONG(rttl, ptr);
+		GETSHORT(rdlen, ptr);
+		if (ptr + rdlen > end)
+			break;
+		ptr += rdlen;
+
+		if (rtype != type && rtype != T_CNAME)
+			continue;
+		if (ttl < 0 || (long)rttl < ttl)
+			ttl = rttl;
+	}
+
+	return ttl;
+}
+#endif
+
+static long lookup_ttl(const char *host, int family)
+{
+	long ttl = -1;
+
+#ifdef HAVE_RES_QUERY
+	if (family != AF_INET6)
+		ttl = query_ttl(host, T_A);
+	if (ttl < 0 && family != AF_INET)
+		ttl = query_ttl(host, T_AAAA);
+#endif
+	if (ttl < 0)
+		return DNSCACHE_DEFAULT_TTL;
+	if (ttl > DNSCACHE_MAX_TTL)
+		return DNSCACHE_MAX_TTL;
+
+	return ttl;
+}
+
+/**
+ * dnscache_resolve - Look up addresses of host, from cache if possible
+ * @host:   Host name, or numeric address
+ * @port:   Port number, part of the key and returned addresses
+ * @family: %AF_INET, %AF_INET6, or %AF_UNSPEC
+ * @addr:   Array of %DNSCACHE_MAX_ADDRS addresses to fill in
+ * @num:    Number of addresses returned in @addr
+ *
+ * Addresses are in the order returned by getaddrinfo().
+ *
+ * Returns:
+ * POSIX OK(0), or an EAI_* error code from getaddrinfo().
+ */
+int dnscache_resolve(const char *host, int port, int family, dns_addr_t *addr, int *num)
+{
+	struct addrinfo hints, *servinfo, *ai;
+	struct dns_entry *e;
+	char service[10];
+	long ttl;
+	int rc, n = 0;
+
+	pthread_mutex_lock(&lock);
+	e = find(host, port, family);
+	if (e && e->expires > event_now()) {
+		memcpy(addr, e->addr, e->num * sizeof(dns_addr_t));
+		*num = e->num;
+		pthread_mutex_unlock(&lock);
+
+		logit(LOG_DEBUG, "Using cached address(es) for %s", host);
+		return 0;
+	}
+	pthread_mutex_unlock(&lock);
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family   = family;
+	hints.ai_socktype = SOCK_STREAM;	/* Stream socket */
+	hints.ai_flags    = AI_NUMERICSERV;	/* No service name lookup */
+	snprintf(service, sizeof(service), "%d", port);
+
+	rc = getaddrinfo(host, service, &hints, &servinfo);
+	if (rc)
+		return rc;
+
+	for (ai = servinfo; ai && n < DNSCACHE_MAX_ADDRS; ai = ai->ai_next) {
+		if (ai->ai_addrlen > sizeof(addr[n].ss))
+			continue;
+
+		memcpy(&addr[n].ss, ai->ai_addr, ai->ai_addrlen);
+		addr[n].len = ai->ai_addrlen;
+		n++;
+	}
+	freeaddrinfo(servinfo);
+
+	*num = n;
+	if (!n)
+		return EAI_NONAME;
+
+	/* Numeric addresses need no DNS queries, and no expiry */
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_flags = AI_NUMERICHOST;
+	if (!getaddrinfo(host, NULL, &hints, &servinfo)) {
+		freeaddrinfo(servinfo);
+		ttl = DNSCACHE_MAX_TTL;
+	} else {
+		ttl = lookup_ttl(host, family);
+	}
+
+	/* A zero TTL means the owner does not want it cached */
+	if (ttl <= 0)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+	e = victim(host, port, family);
+	strlcpy(e->host, host, sizeof(e->host));
+	e->port    = port;
+	e->family  = family;
+	e->expires = event_now() + ttl;
+	e->num     = n;
+	memcpy(e->addr, addr, n * sizeof(dns_addr_t));
+	pthread_mutex_unlock(&lock);
+
+	logit(LOG_DEBUG, "Caching %d address(es) for %s, TTL %ld sec", n, host, ttl);
+
+	return 0;
+}
+
+/* Forget addresses for host, e.g. after failing to connect to all of them */
+void dnscache_invalidate(const char *host, int port, int family)
+{
+	struct dns_entry *e;
+
+	pthread_mutex_lock(&lock);
+	e = find(host, port, family);
+	if (e)
+		e->num = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+void dnscache_flush(void)
+{
+	pthread_mutex_lock(&lock);
+	memset(cache, 0, sizeof(cache));
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
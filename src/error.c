@@ -25,9 +25,13 @@
 
 typedef struct {
 	int rc;
+	const char *p_sym;
 	const char *p_name;
 } ERROR_NAME;
 
+/* Code and its symbolic name */
+#define R(rc) rc, #rc
+
 #ifndef DROP_VERBOSE_STRINGS
 #define E(a) a
 #else
@@ -35,48 +39,57 @@ typedef struct {
 #endif
 
 static const ERROR_NAME global_error_table[] = {
-	{ RC_OK,                            "OK"                                },
-	{ RC_ERROR,                       E("Error"                            )},
-	{ RC_INVALID_POINTER,             E("Invalid pointer"                  )},
-	{ RC_OUT_OF_MEMORY,               E("Out of memory"                    )},
-	{ RC_BUFFER_OVERFLOW,             E("Too small internal buffer"        )},
-	{ RC_PIDFILE_EXISTS_ALREADY,      E("Already running"                  )},
-
-	{ RC_TCP_SOCKET_CREATE_ERROR,     E("Failed creating IP socket"        )},
-	{ RC_TCP_BAD_PARAMETER,           E("Invalid Internet port"            )},
-	{ RC_TCP_INVALID_REMOTE_ADDR,     E("Temporary network error (DNS)"    )},
-	{ RC_TCP_CONNECT_FAILED,          E("Failed connecting to DDNS server" )},
-	{ RC_TCP_SEND_ERROR,              E("Temporary network error (send)"   )},
-	{ RC_TCP_RECV_ERROR,              E("Temporary network error (recv)"   )},
-
-	{ RC_TCP_OBJECT_NOT_INITIALIZED,  E("Internal error (TCP)"             )},
-	{ RC_HTTP_OBJECT_NOT_INITIALIZED, E("Internal error (HTTP)"            )},
-
-	{ RC_HTTPS_NO_TRUSTED_CA_STORE,   E("System has no trusted CA store"             )},
-	{ RC_HTTPS_OUT_OF_MEMORY,         E("Out of memory (HTTPS)"                      )},
-	{ RC_HTTPS_FAILED_CONNECT,        E("Failed connecting to DDNS server (HTTPS)"   )},
-	{ RC_HTTPS_FAILED_GETTING_CERT,   E("Failed retrieving DDNS server cert (HTTPS)" )},
-	{ RC_HTTPS_SEND_ERROR,            E("Temporary network error (HTTPS send)"       )},
-	{ RC_HTTPS_RECV_ERROR,            E("Temporary network error (HTTPS recv)"       )},
-	{ RC_HTTPS_SNI_ERROR,             E("Failed setting HTTPS server name"           )},
-	{ RC_HTTPS_INVALID_REQUEST,       E("Invalid request (HTTPS)"                    )},
-
-	{ RC_DDNS_INVALID_CHECKIP_RSP,    E("Check IP server response not OK"  )},
-	{ RC_DDNS_INVALID_OPTION,         E("Invalid or missing DDNS option"   )},
-	{ RC_DDNS_RSP_NOTOK,              E("DDNS server response not OK"      )},
-	{ RC_DDNS_RSP_RETRY_LATER,        E("DDNS server busy, try later"      )},
-	{ RC_DDNS_RSP_AUTH_FAIL,          E("Authentication failure"           )},
-	{ RC_DDNS_RSP_TOO_FREQUENT,       E("DDNS warning, your update interval is set too low.")},
-
-	{ RC_OS_FORK_FAILURE,             E("Failed forking off child"         )},
-	{ RC_OS_CHANGE_PERSONA_FAILURE,   E("Failed dropping privileges"       )},
-	{ RC_OS_INVALID_UID,              E("Invalid or unknown UID"           )},
-	{ RC_OS_INVALID_GID,              E("Invalid or unknown GID"           )},
-
-	{ RC_FILE_IO_ACCESS_ERROR,        E("Failed create/modify file/dir"    )},
-	{ RC_FILE_IO_MISSING_FILE,        E("Missing .conf file"               )},
-
-	{ RC_OK, NULL }
+	{ R(RC_OK),                             "OK"                                },
+	{ R(RC_ERROR),                        E("Error"                            )},
+	{ R(RC_INVALID_POINTER),              E("Invalid pointer"                  )},
+	{ R(RC_OUT_OF_MEMORY),                E("Out of memory"                    )},
+	{ R(RC_BUFFER_OVERFLOW),              E("Too small internal buffer"        )},
+	{ R(RC_PIDFILE_EXISTS_ALREADY),       E("Already running"                  )},
+
+	{ R(RC_TCP_SOCKET_CREATE_ERROR),      E("Failed creating IP socket"        )},
+	{ R(RC_TCP_BAD_PARAMETER),            E("Invalid Internet port"            )},
+	{ R(RC_TCP_INVALID_REMOTE_ADDR),      E("Temporary network error (DNS)"    )},
+	{ R(RC_TCP_CONNECT_FAILED),           E("Failed connecting to DDNS server" )},
+	{ R(RC_TCP_SEND_ERROR),               E("Temporary network error (send)"   )},
+	{ R(RC_TCP_RECV_ERROR),               E("Temporary network error (recv)"   )},
+
+	{ R(RC_TCP_OBJECT_NOT_INITIALIZED),   E("Internal error (TCP)"             )},
+	{ R(RC_TCP_WANT_READ),                E("Waiting for data (TCP)"           )},
+	{ R(RC_TCP_WANT_WRITE),               E("Waiting to send (TCP)"            )},
+	{ R(RC_TCP_PROXY_FAILED),             E("Failed connecting through proxy"  )},
+	{ R(RC_HTTP_OBJECT_NOT_INITIALIZED),  E("Internal error (HTTP)"            )},
+	{ R(RC_HTTP_BAD_RESPONSE),            E("Invalid HTTP response"            )},
+
+	{ R(RC_HTTPS_NO_TRUSTED_CA_STORE),    E("System has no trusted CA store"             )},
+	{ R(RC_HTTPS_OUT_OF_MEMORY),          E("Out of memory (HTTPS)"                      )},
+	{ R(RC_HTTPS_FAILED_CONNECT),         E("Failed connecting to DDNS server (HTTPS)"   )},
+	{ R(RC_HTTPS_FAILED_GETTING_CERT),    E("Failed retrieving DDNS server cert (HTTPS)" )},
+	{ R(RC_HTTPS_SEND_ERROR),             E("Temporary network error (HTTPS send)"       )},
+	{ R(RC_HTTPS_RECV_ERROR),             E("Temporary network error (HTTPS recv)"       )},
+	{ R(RC_HTTPS_SNI_ERROR),              E("Failed setting HTTPS server name"           )},
+	{ R(RC_HTTPS_INVALID_REQUEST),        E("Invalid request (HTTPS)"                    )},
+
+	{ R(RC_DDNS_INVALID_CHECKIP_RSP),     E("Check IP server response not OK"  )},
+	{ R(RC_DDNS_INVALID_OPTION),          E("Invalid or missing DDNS option"   )},
+	{ R(RC_DDNS_RSP_NOHOST),              E("Invalid hostname, or no such host")},
+	{ R(RC_DDNS_RSP_NOTOK),               E("DDNS server response not OK"      )},
+	{ R(RC_DDNS_RSP_RETRY_LATER),         E("DDNS server busy, try later"      )},
+	{ R(RC_DDNS_RSP_AUTH_FAIL),           E("Authentication failure"           )},
+	{ R(RC_DDNS_RSP_TOO_FREQUENT),        E("DDNS warning, your update interval is set too low.")},
+	{ R(RC_DDNS_RATE_LIMITED),            E("Request quota used up, update deferred")},
+	{ R(RC_DDNS_CIRCUIT_OPEN),            E("DDNS server failing, update deferred")},
+	{ R(RC_DDNS_RECORD_CURRENT),          E("Record already up to date, not sent")},
+	{ R(RC_DDNS_OVER_BUDGET),             E("Out of time this cycle, update deferred")},
+
+	{ R(RC_OS_FORK_FAILURE),              E("Failed forking off child"         )},
+	{ R(RC_OS_CHANGE_PERSONA_FAILURE),    E("Failed dropping privileges"       )},
+	{ R(RC_OS_INVALID_UID),               E("Invalid or unknown UID"           )},
+	{ R(RC_OS_INVALID_GID),               E("Invalid or unknown GID"           )},
+
+	{ R(RC_FILE_IO_ACCESS_ERROR),         E("Failed create/modify file/dir"    )},
+	{ R(RC_FILE_IO_MISSING_FILE),         E("Missing .conf file"               )},
+
+	{ RC_OK, NULL, NULL }
 };
 
 static const char *unknown_error = "Unknown error";
@@ -94,6 +107,20 @@ const char *error_str(int rc)
 	return unknown_error;
 }
 
+/* Symbolic name of @rc, e.g. "RC_DDNS_RSP_NOTOK", for metrics labels */
+const char *error_name(int rc)
+{
+	const ERROR_NAME *it = global_error_table;
+
+	while (it->p_name) {
+		if (it->rc == rc)
+			return it->p_sym;
+		it++;
+	}
+
+	return "RC_UNKNOWN";
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -0,0 +1,275 @@
+/* Main loop event dispatcher, a small poll() wrapper
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Inadyn spends most of its life waiting for the next period.  Instead
+ * of waking up every second to check if a signal has changed ctx->cmd,
+ * all event sources (signals via a self-pipe, and any other descriptor
+ * registered here) are multiplexed with poll() and the process sleeps
+ * until either the deadline expires or one of them becomes readable.
+ *
+ * poll() rather than epoll/kqueue, because the number of descriptors
+ * is tiny and inadyn must build on Linux, *BSD and macOS alike.  On
+ * Linux the waiting can instead be done with io_uring, see uring.c,
+ * for the main loop and the HTTP engine alike, see event_poll().
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+
+#include "error.h"
+#include "event.h"
+#include "log.h"
+#include "uring.h"
+
+struct event {
+	int         fd;
+	event_cb_t  cb;
+	void       *arg;
+};
+
+static struct event events[EVENT_MAX_FDS];
+static int          num_events = 0;
+
+static time_t       started;		/* event_now() of first event_wall() */
+static time_t       offset;		/* Wall clock minus event_now() */
+
+int event_backend = EVENT_BACKEND_POLL;
+
+/**
+ * event_add - Register a descriptor with the main loop
+ * @fd:  Descriptor to watch for input
+ * @cb:  Callback to run when @fd is readable
+ * @arg: Optional argument to @cb
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int event_add(int fd, event_cb_t cb, void *arg)
+{
+	int i;
+
+	if (fd < 0 || !cb)
+		return RC_INVALID_POINTER;
+
+	for (i = 0; i < num_events; i++) {
+		if (events[i].fd == fd) {
+			events[i].cb  = cb;
+			events[i].arg = arg;
+			return 0;
+		}
+	}
+
+	if (num_events >= EVENT_MAX_FDS) {
+		logit(LOG_ERR, "Too many event sources, max %d supported.", EVENT_MAX_FDS);
+		return RC_BUFFER_OVERFLOW;
+	}
+
+	events[num_events].fd  = fd;
+	events[num_events].cb  = cb;
+	events[num_events].arg = arg;
+	num_events++;
+
+	return 0;
+}
+
+/**
+ * event_del - Unregister a descriptor from the main loop
+ * @fd: Descriptor previously registered with event_add()
+ *
+ * The descriptor is not closed, that's up to the caller.
+ */
+int event_del(int fd)
+{
+	int i;
+
+	for (i = 0; i < num_events; i++) {
+		if (events[i].fd != fd)
+			continue;
+
+		num_events--;
+		memmove(&events[i], &events[i + 1], (num_events - i) * sizeof(events[0]));
+		return 0;
+	}
+
+	return RC_INVALID_POINTER;
+}
+
+/**
+ * event_wait - Wait for, and dispatch, events
+ * @msec: Max time to wait, in milliseconds, -1 to wait forever
+ *
+ * Returns:
+ * Number of dispatched events, zero on timeout, or -1 on error.
+ */
+int event_wait(int msec)
+{
+	struct pollfd pfd[EVENT_MAX_FDS];
+	int i, num, rc;
+
+	num = num_events;
+	for (i = 0; i < num; i++) {
+		pfd[i].fd      = events[i].fd;
+		pfd[i].events  = POLLIN;
+		pfd[i].revents = 0;
+	}
+
+	/* Write out queued log messages before going to sleep */
+	log_flush();
+
+	rc = event_poll(pfd, num, msec);
+	if (rc <= 0) {
+		if (rc < 0 && errno == EINTR)
+			return 0;
+		if (rc < 0)
+			logit(LOG_WARNING, "Failed waiting for events: %s", strerror(errno));
+		return rc;
+	}
+
+	/* Callbacks may add/del events, so match on fd not position */
+	for (i = 0; i < num; i++) {
+		int j;
+
+		if (!pfd[i].revents)
+			continue;
+
+		for (j = 0; j < num_events; j++) {
+			if (events[j].fd != pfd[i].fd)
+				continue;
+
+			events[j].cb(events[j].fd, events[j].arg);
+			break;
+		}
+	}
+
+	return rc;
+}
+
+/**
+ * event_poll - Wait for descriptors, with the selected backend
+ * @pfd:  Descriptors and events to wait for
+ * @num:  Number of entries in @pfd
+ * @msec: Max time to wait, -1 to wait forever
+ *
+ * Same semantics as poll(), which is also the fallback when io_uring
+ * is selected but not available.
+ *
+ * Returns:
+ * Number of entries in @pfd with revents set, zero on timeout, or -1
+ * on error, with errno set.
+ */
+int event_poll(struct pollfd *pfd, int num, int msec)
+{
+	if (event_backend == EVENT_BACKEND_IO_URING)
+		return uring_poll(pfd, num, msec);
+
+	/* In case the backend was changed, e.g. on SIGHUP */
+	uring_exit();
+
+	return poll(pfd, num, msec);
+}
+
+/* Monotonic seconds, unaffected by NTP or the user setting the clock */
+time_t event_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return time(NULL);
+
+	return ts.tv_sec;
+}
+
+/*
+ * Timestamps that are persisted, or shown, are wall clock, but taken
+ * with event_wall(): the monotonic clock plus an offset that is only
+ * changed by event_clock(), once per cycle.  So intervals between them
+ * are monotonic, and a clock step, e.g. the first NTP sync on a system
+ * without RTC, is seen in one place where the timestamps can be moved
+ * along, instead of as every alias suddenly being decades overdue.
+ */
+static void clock_init(void)
+{
+	if (started)
+		return;
+
+	started = event_now();
+	offset  = time(NULL) - started;
+}
+
+/* Wall clock seconds, following the monotonic clock between event_clock() */
+time_t event_wall(void)
+{
+	clock_init();
+
+	return event_now() + offset;
+}
+
+/**
+ * event_clock - Check if the wall clock has been stepped
+ * @from:  Set to the event_wall() time of startup, before the step
+ * @until: Set to the event_wall() time now, before the step
+ *
+ * Timestamps from event_wall() in [@from, @until] have been taken by
+ * this process, and should be moved by the returned step to match the
+ * wall clock again.  Anything outside is from before startup, e.g. from
+ * the state file, and was never relative to this process' clock.
+ *
+ * Returns:
+ * Seconds the wall clock was stepped, or zero for none.
+ */
+time_t event_clock(time_t *from, time_t *until)
+{
+	time_t now, step;
+
+	clock_init();
+
+	now  = event_now();
+	step = time(NULL) - now - offset;
+	if (step >= -EVENT_CLOCK_SLACK && step <= EVENT_CLOCK_SLACK)
+		return 0;
+
+	*from   = started + offset;
+	*until  = now + offset;
+	offset += step;
+
+	return step;
+}
+
+/* Monotonic milliseconds, for connection and I/O timeouts */
+long long event_msec(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return (long long)time(NULL) * 1000;
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,876 @@
+/* Discovery of the public address from the default gateway
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Behind a consumer router the gateway already knows the public address,
+ * there is no need to ask a server on the Internet for it.  Three ways
+ * of asking the gateway are supported, all on the local network:
+ *
+ * - NAT-PMP (RFC 6886), a two byte request to UDP port 5351, the reply
+ *   holds the external IPv4 address
+ * - PCP (RFC 6887), the successor of NAT-PMP, has no request for just
+ *   the address, so a short-lived mapping of our own ephemeral port is
+ *   requested instead, the reply holds the address, and the mapping is
+ *   deleted again right away
+ * - UPnP IGD, the gateway is found with SSDP and its description read,
+ *   once, for the control URL of the WAN connection service, which is
+ *   then asked with the SOAP action GetExternalIPAddress
+ *
+ * The gateway is the default route, read from /proc/net/route, unless
+ * checkip-gateway-address is set.  NAT-PMP and PCP gateways announce
+ * changes of address to 224.0.0.1:5350, when heard a check is started
+ * immediately, the same as ifmon.c does for interface addresses.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "compat.h"
+#include "ddns.h"
+#include "event.h"
+#include "gateway.h"
+
+#define NATPMP_VERSION		0
+#define NATPMP_OP_ADDRESS	0
+#define NATPMP_RSP_LEN		12
+
+#define PCP_VERSION		2
+#define PCP_OP_ANNOUNCE		0
+#define PCP_OP_MAP		1
+#define PCP_RESPONSE		0x80
+#define PCP_HEADER_LEN		24
+#define PCP_MAP_LEN		36
+#define PCP_NONCE_LEN		12
+#define PCP_MAX_PACKET		1100
+
+#define ROUTE_GATEWAY		0x0002	/* RTF_GATEWAY in /proc/net/route */
+
+#define SSDP_GROUP		"239.255.255.250"
+#define SSDP_PORT		1900
+#define UPNP_MAX_XML		65536
+
+static const char *names[] = {
+	[GATEWAY_NATPMP] = "natpmp",
+	[GATEWAY_PCP]    = "pcp",
+	[GATEWAY_UPNP]   = "upnp",
+};
+
+/* WAN connection services, in order of preference */
+static const char *services[] = {
+	"urn:schemas-upnp-org:service:WANIPConnection:2",
+	"urn:schemas-upnp-org:service:WANIPConnection:1",
+	"urn:schemas-upnp-org:service:WANPPPConnection:1",
+};
+
+/* Control URL of the UPnP gateway, found once, forgotten on failure */
+static struct {
+	char        gw[INET_ADDRSTRLEN];	/* Asked for, empty: any */
+	char        host[256];
+	int         port;
+	char        path[256];
+	const char *service;
+} upnp;
+
+static int sd = -1;		/* Listener for announcements */
+
+extern ddns_info_t *conf_info_iterator(int first);
+
+static unsigned short get16(const unsigned char *ptr)
+{
+	return (ptr[0] << 8) | ptr[1];
+}
+
+static void put32(unsigned char *ptr, unsigned int val)
+{
+	ptr[0] = val >> 24;
+	ptr[1] = (val >> 16) & 0xff;
+	ptr[2] = (val >> 8) & 0xff;
+	ptr[3] = val & 0xff;
+}
+
+/* Default IPv4 gateway, from the Linux routing table */
+static int default_gateway(char *gw, size_t len)
+{
+	char line[256];
+	FILE *fp;
+	int rc = 1;
+
+	gw[0] = 0;
+	fp = fopen("/proc/net/route", "r");
+	if (!fp)
+		return 1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned int dst, addr, flags;
+		char ifname[32];
+
+		/* Skips the header line too, addresses are in network order */
+		if (sscanf(line, "%31s %x %x %x", ifname, &dst, &addr, &flags) != 4)
+			continue;
+		if (dst || !(flags & ROUTE_GATEWAY))
+			continue;
+
+		if (inet_ntop(AF_INET, &addr, gw, len)) {
+			rc = 0;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return rc;
+}
+
+/* UDP socket connected to @gw:@port, only replies from it are received */
+static int open_socket(const char *gw, int port)
+{
+	struct sockaddr_in sin;
+	int fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port   = htons(port);
+	if (inet_pton(AF_INET, gw, &sin.sin_addr) != 1) {
+		logit(LOG_WARNING, "Invalid gateway address %s", gw);
+		return -1;
+	}
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		logit(LOG_WARNING, "Failed creating UDP socket: %s", strerror(errno));
+		return -1;
+	}
+
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin))) {
+		logit(LOG_DEBUG, "Failed connecting to gateway %s: %s", gw, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * Send @req and wait for a reply that @match accepts.  The first wait
+ * is %GATEWAY_TIMEOUT, doubled on each retry, as RFC 6886 recommends.
+ * Returns length of the reply in @rsp, or -1 on failure.
+ */
+static ssize_t exchange(int fd, const void *req, size_t reqlen, unsigned char *rsp, size_t rsplen,
+			int (*match)(const unsigned char *rsp, ssize_t len, const void *req))
+{
+	int attempt, timeout = GATEWAY_TIMEOUT;
+
+	for (attempt = 0; attempt < GATEWAY_RETRIES && !budget_expired(); attempt++, timeout *= 2) {
+		long long deadline;
+
+		if (send(fd, req, reqlen, 0) < 0) {
+			logit(LOG_DEBUG, "Failed sending to gateway: %s", strerror(errno));
+			return -1;
+		}
+
+		deadline = budget_clamp(event_msec() + timeout);
+		while (1) {
+			struct pollfd pfd = { .fd = fd, .events = POLLIN };
+			long long now = event_msec();
+			ssize_t len;
+			int rc;
+
+			if (now >= deadline)
+				break;
+
+			rc = poll(&pfd, 1, (int)(deadline - now));
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+
+			len = recv(fd, rsp, rsplen, 0);
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				/* ICMP port unreachable, nothing there to ask */
+				if (errno == ECONNREFUSED)
+					return -1;
+				break;
+			}
+
+			if (match(rsp, len, req))
+				return len;
+		}
+
+		logit(LOG_DEBUG, "No reply from gateway, attempt %d of %d", attempt + 1, GATEWAY_RETRIES);
+	}
+
+	return -1;
+}
+
+static int natpmp_match(const unsigned char *rsp, ssize_t len, const void *req)
+{
+	return len >= NATPMP_RSP_LEN && rsp[0] == NATPMP_VERSION &&
+		rsp[1] == (PCP_RESPONSE | NATPMP_OP_ADDRESS);
+}
+
+static int natpmp_address(const char *gw, char *address, size_t len)
+{
+	unsigned char req[2] = { NATPMP_VERSION, NATPMP_OP_ADDRESS };
+	unsigned char rsp[PCP_MAX_PACKET];
+	ssize_t n;
+	int fd;
+
+	fd = open_socket(gw, GATEWAY_PORT);
+	if (fd < 0)
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	n = exchange(fd, req, sizeof(req), rsp, sizeof(rsp), natpmp_match);
+	close(fd);
+	if (n < 0)
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	if (get16(rsp + 2)) {
+		logit(LOG_WARNING, "NAT-PMP gateway %s failed, result code %d", gw, get16(rsp + 2));
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	if (!inet_ntop(AF_INET, rsp + 8, address, len))
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	return 0;
+}
+
+/* Reply to our MAP, or a NAT-PMP gateway telling it does not speak PCP */
+static int pcp_match(const unsigned char *rsp, ssize_t len, const void *req)
+{
+	if (len < 4 || rsp[1] != (PCP_RESPONSE | PCP_OP_MAP))
+		return 0;
+
+	if (rsp[0] == NATPMP_VERSION)
+		return 1;
+
+	return rsp[0] == PCP_VERSION && len >= PCP_HEADER_LEN + PCP_MAP_LEN &&
+		!memcmp(rsp + PCP_HEADER_LEN, (const unsigned char *)req + PCP_HEADER_LEN, PCP_NONCE_LEN);
+}
+
+static int pcp_address(const char *gw, char *address, size_t len)
+{
+	unsigned char req[PCP_HEADER_LEN + PCP_MAP_LEN] = { 0 };
+	unsigned char rsp[PCP_MAX_PACKET], *map = req + PCP_HEADER_LEN;
+	const unsigned char *ext;
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	ssize_t n;
+	size_t i;
+	int fd;
+
+	fd = open_socket(gw, GATEWAY_PORT);
+	if (fd < 0)
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+
+	/* The request must carry our address, as seen by the gateway */
+	if (getsockname(fd, (struct sockaddr *)&sin, &slen)) {
+		close(fd);
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	req[0] = PCP_VERSION;
+	req[1] = PCP_OP_MAP;
+	put32(req + 4, GATEWAY_PCP_LIFETIME);
+	req[18] = req[19] = 0xff;		/* IPv4-mapped client address */
+	memcpy(req + 20, &sin.sin_addr, 4);
+
+	for (i = 0; i < PCP_NONCE_LEN; i++)
+		map[i] = rand() & 0xff;
+	map[12] = IPPROTO_UDP;
+	memcpy(map + 16, &sin.sin_port, 2);	/* Internal port, ours */
+	map[30] = map[31] = 0xff;		/* Any external IPv4 address */
+
+	n = exchange(fd, req, sizeof(req), rsp, sizeof(rsp), pcp_match);
+	if (n < 0)
+		goto fail;
+
+	if (rsp[0] != PCP_VERSION) {
+		logit(LOG_WARNING, "Gateway %s does not support PCP, try checkip-gateway = natpmp", gw);
+		goto fail;
+	}
+	if (rsp[3]) {
+		logit(LOG_WARNING, "PCP gateway %s failed, result code %d", gw, rsp[3]);
+		goto fail;
+	}
+
+	/* Only wanted the address, delete the mapping again */
+	put32(req + 4, 0);
+	if (send(fd, req, sizeof(req), 0) < 0)
+		logit(LOG_DEBUG, "Failed deleting PCP mapping: %s", strerror(errno));
+	close(fd);
+
+	ext = rsp + PCP_HEADER_LEN + 20;
+	if (IN6_IS_ADDR_V4MAPPED((const struct in6_addr *)ext)) {
+		if (!inet_ntop(AF_INET, ext + 12, address, len))
+			return RC_DDNS_INVALID_CHECKIP_RSP;
+	} else if (!inet_ntop(AF_INET6, ext, address, len)) {
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	return 0;
+fail:
+	close(fd);
+	return RC_DDNS_INVALID_CHECKIP_RSP;
+}
+
+/* Value of header @name in the HTTP-like SSDP reply @msg */
+static int header(const char *msg, const char *name, char *buf, size_t len)
+{
+	size_t nlen = strlen(name), vlen;
+	const char *ptr;
+
+	for (ptr = msg; ptr && *ptr; ptr = strchr(ptr, '\n'), ptr = ptr ? ptr + 1 : NULL) {
+		if (strncasecmp(ptr, name, nlen) || ptr[nlen] != ':')
+			continue;
+
+		ptr += nlen + 1;
+		ptr += strspn(ptr, " \t");
+		vlen = strcspn(ptr, "\r\n");
+		if (vlen >= len)
+			return 1;
+
+		memcpy(buf, ptr, vlen);
+		buf[vlen] = 0;
+		return 0;
+	}
+
+	return 1;
+}
+
+/* Text of the first <@name> between @from and @to, or the end */
+static int element(const char *from, const char *to, const char *name, char *buf, size_t len)
+{
+	char open[64], close[64];
+	const char *ptr, *end;
+	size_t vlen;
+
+	snprintf(open, sizeof(open), "<%s>", name);
+	snprintf(close, sizeof(close), "</%s>", name);
+
+	ptr = strstr(from, open);
+	if (!ptr || (to && ptr >= to))
+		return 1;
+	ptr += strlen(open);
+
+	end = strstr(ptr, close);
+	if (!end || (to && end > to))
+		return 1;
+
+	ptr += strspn(ptr, " \t\r\n");
+	while (end > ptr && strchr(" \t\r\n", end[-1]))
+		end--;
+
+	vlen = end - ptr;
+	if (vlen >= len)
+		return 1;
+
+	memcpy(buf, ptr, vlen);
+	buf[vlen] = 0;
+
+	return 0;
+}
+
+/* Split http://host[:port][/path], only plain HTTP is used on the LAN */
+static int parse_url(const char *url, char *host, size_t hlen, int *port, char *path, size_t plen)
+{
+	const char *ptr, *slash;
+	size_t len;
+
+	if (strncasecmp(url, "http://", 7))
+		return 1;
+	url += 7;
+
+	slash = strchr(url, '/');
+	if (!slash)
+		slash = url + strlen(url);
+
+	ptr = memchr(url, ':', slash - url);
+	len = (ptr ? ptr : slash) - url;
+	if (!len || len >= hlen)
+		return 1;
+	memcpy(host, url, len);
+	host[len] = 0;
+
+	*port = ptr ? atoi(ptr + 1) : HTTP_DEFAULT_PORT;
+	if (*port <= 0 || *port > 65535)
+		return 1;
+
+	if (strlcpy(path, *slash ? slash : "/", plen) >= plen) {
+		logit(LOG_WARNING, "Too long path in UPnP URL %s", url - 7);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Find UPnP gateway, replies from others than @gw are ignored, unless empty */
+static int ssdp_search(const char *gw, char *url, size_t len)
+{
+	static const char req[] =
+		"M-SEARCH * HTTP/1.1\r\n"
+		"HOST: " SSDP_GROUP ":1900\r\n"
+		"MAN: \"ssdp:discover\"\r\n"
+		"MX: 1\r\n"
+		"ST: urn:schemas-upnp-org:device:InternetGatewayDevice:1\r\n"
+		"\r\n";
+	struct sockaddr_in sin;
+	int attempt, fd;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port   = htons(SSDP_PORT);
+	inet_pton(AF_INET, SSDP_GROUP, &sin.sin_addr);
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		logit(LOG_WARNING, "Failed creating UDP socket: %s", strerror(errno));
+		return 1;
+	}
+
+	/* Twice, UDP may be lost, each waiting half the time */
+	for (attempt = 0; attempt < 2; attempt++) {
+		long long deadline;
+
+		if (sendto(fd, req, sizeof(req) - 1, 0, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+			logit(LOG_DEBUG, "Failed sending SSDP search: %s", strerror(errno));
+			break;
+		}
+
+		deadline = budget_clamp(event_msec() + GATEWAY_SSDP_TIMEOUT / 2);
+		while (1) {
+			struct pollfd pfd = { .fd = fd, .events = POLLIN };
+			char rsp[1500], from[INET_ADDRSTRLEN];
+			struct sockaddr_in peer;
+			socklen_t plen = sizeof(peer);
+			long long now = event_msec();
+			ssize_t n;
+			int rc;
+
+			if (now >= deadline)
+				break;
+
+			rc = poll(&pfd, 1, (int)(deadline - now));
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+
+			n = recvfrom(fd, rsp, sizeof(rsp) - 1, 0, (struct sockaddr *)&peer, &plen);
+			if (n < 0)
+				continue;
+			rsp[n] = 0;
+
+			if (!inet_ntop(AF_INET, &peer.sin_addr, from, sizeof(from)))
+				continue;
+			if (gw[0] && strcmp(gw, from))
+				continue;
+
+			if (!header(rsp, "LOCATION", url, len)) {
+				close(fd);
+				return 0;
+			}
+		}
+	}
+
+	close(fd);
+	return 1;
+}
+
+/* Plain HTTP request to the gateway, the body is in @rsp on success */
+static int fetch(const char *host, int port, char *req, int reqlen, char *rsp, int rsplen, char **body)
+{
+	http_trans_t trans;
+	http_t client;
+	int rc;
+
+	http_construct(&client);
+	client.ssl_enabled = 0;
+	http_set_remote_name(&client, host);
+	http_set_port(&client, port);
+
+	rc = http_init(&client, "Querying UPnP gateway", TCP_FORCE_IPV4);
+	if (!rc) {
+		memset(&trans, 0, sizeof(trans));
+		trans.req         = req;
+		trans.req_len     = reqlen;
+		trans.rsp         = rsp;
+		trans.max_rsp_len = rsplen - 1;
+
+		rc = http_transaction(&client, &trans);
+		if (!rc && trans.status != 200)
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+		*body = trans.rsp_body;
+		http_exit(&client);
+	}
+	http_destruct(&client, 1);
+
+	return rc;
+}
+
+/* Control URL of the WAN connection service of the gateway */
+static int upnp_discover(const char *gw)
+{
+	char url[512], host[256], path[256], req[1024], ctl[512];
+	const char *svc, *start, *end;
+	char *xml, *body = NULL;
+	int rc = 1, port, len;
+	size_t i;
+
+	memset(&upnp, 0, sizeof(upnp));
+	if (ssdp_search(gw, url, sizeof(url))) {
+		logit(LOG_WARNING, "No UPnP gateway found%s%s", gw[0] ? " at " : "", gw);
+		return 1;
+	}
+	if (parse_url(url, host, sizeof(host), &port, path, sizeof(path))) {
+		logit(LOG_WARNING, "Unsupported UPnP description URL %s", url);
+		return 1;
+	}
+
+	xml = malloc(UPNP_MAX_XML);
+	if (!xml)
+		return 1;
+
+	len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\n"
+		       "Host: %s:%d\r\n"
+		       "User-Agent: %s\r\n"
+		       "Connection: close\r\n"
+		       "\r\n", path, host, port, user_agent);
+	if (len < 0 || len >= (int)sizeof(req) || fetch(host, port, req, len, xml, UPNP_MAX_XML, &body)) {
+		logit(LOG_WARNING, "Failed reading UPnP description %s", url);
+		goto done;
+	}
+
+	for (i = 0; i < NELEMS(services); i++) {
+		char type[128];
+
+		snprintf(type, sizeof(type), "<serviceType>%s</serviceType>", services[i]);
+		svc = strstr(body, type);
+		if (!svc)
+			continue;
+
+		/* The <service> element this type is in */
+		start = body;
+		while ((end = strstr(start, "<service>")) && end < svc)
+			start = end + 1;
+		end = strstr(svc, "</service>");
+
+		if (element(start, end, "controlURL", ctl, sizeof(ctl)))
+			continue;
+
+		upnp.service = services[i];
+		break;
+	}
+	if (!upnp.service) {
+		logit(LOG_WARNING, "No WAN connection service in UPnP description %s", url);
+		goto done;
+	}
+
+	/* Absolute, or relative to the description */
+	if (!strncasecmp(ctl, "http://", 7)) {
+		if (parse_url(ctl, upnp.host, sizeof(upnp.host), &upnp.port, upnp.path, sizeof(upnp.path))) {
+			logit(LOG_WARNING, "Unsupported UPnP control URL %s", ctl);
+			goto done;
+		}
+	} else {
+		strlcpy(upnp.host, host, sizeof(upnp.host));
+		upnp.port = port;
+		len = snprintf(upnp.path, sizeof(upnp.path), "%s%s", ctl[0] == '/' ? "" : "/", ctl);
+		if (len < 0 || len >= (int)sizeof(upnp.path)) {
+			logit(LOG_WARNING, "Too long UPnP control URL %s", ctl);
+			goto done;
+		}
+	}
+
+	strlcpy(upnp.gw, gw, sizeof(upnp.gw));
+	logit(LOG_DEBUG, "UPnP gateway %s:%d%s, service %s", upnp.host, upnp.port, upnp.path, upnp.service);
+	rc = 0;
+done:
+	if (rc)
+		upnp.service = NULL;
+	free(xml);
+
+	return rc;
+}
+
+static int upnp_address(const char *gw, char *address, size_t len)
+{
+	char req[1536], rsp[4096], soap[512], *body = NULL;
+	int n, rc;
+
+	if (!upnp.service || strcmp(upnp.gw, gw)) {
+		if (upnp_discover(gw))
+			return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	n = snprintf(soap, sizeof(soap), "<?xml version=\"1.0\"?>\r\n"
+		     "<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+		     "s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+		     "<s:Body><u:GetExternalIPAddress xmlns:u=\"%s\"/></s:Body>"
+		     "</s:Envelope>\r\n", upnp.service);
+	if (n < 0 || n >= (int)sizeof(soap))
+		return RC_BUFFER_OVERFLOW;
+
+	n = snprintf(req, sizeof(req), "POST %s HTTP/1.1\r\n"
+		     "Host: %s:%d\r\n"
+		     "User-Agent: %s\r\n"
+		     "Content-Type: text/xml; charset=\"utf-8\"\r\n"
+		     "SOAPAction: \"%s#GetExternalIPAddress\"\r\n"
+		     "Content-Length: %zu\r\n"
+		     "Connection: close\r\n"
+		     "\r\n%s", upnp.path, upnp.host, upnp.port, user_agent, upnp.service, strlen(soap), soap);
+	if (n < 0 || n >= (int)sizeof(req))
+		return RC_BUFFER_OVERFLOW;
+
+	rc = fetch(upnp.host, upnp.port, req, n, rsp, sizeof(rsp), &body);
+	if (!rc && element(body, NULL, "NewExternalIPAddress", address, len))
+		rc = RC_DDNS_INVALID_CHECKIP_RSP;
+	if (rc) {
+		/* Gateway may have restarted, on another port, look again next time */
+		logit(LOG_WARNING, "Failed GetExternalIPAddress from UPnP gateway %s", upnp.host);
+		upnp.service = NULL;
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	return 0;
+}
+
+/**
+ * gateway_address - Get public address from the gateway
+ * @proto:   %GATEWAY_NATPMP, %GATEWAY_PCP, or %GATEWAY_UPNP
+ * @gw:      Address of gateway, or %NULL, or empty, for the default route
+ * @address: Buffer for the address, in text form
+ * @len:     Size of @address
+ *
+ * Only IPv4 gateways are asked, the address is usually IPv4 as well,
+ * but a PCP gateway may also reply with an IPv6 address.  Without a
+ * default route a UPnP gateway is still searched for, whoever answers.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_CHECKIP_RSP on failure.
+ */
+int gateway_address(int proto, const char *gw, char *address, size_t len)
+{
+	char addr[INET_ADDRSTRLEN];
+
+	if (gw && gw[0]) {
+		strlcpy(addr, gw, sizeof(addr));
+	} else if (default_gateway(addr, sizeof(addr)) && proto != GATEWAY_UPNP) {
+		logit(LOG_WARNING, "Cannot find default gateway, please set checkip-gateway-address");
+		return RC_DDNS_INVALID_CHECKIP_RSP;
+	}
+
+	switch (proto) {
+	case GATEWAY_NATPMP:
+		return natpmp_address(addr, address, len);
+
+	case GATEWAY_PCP:
+		return pcp_address(addr, address, len);
+
+	case GATEWAY_UPNP:
+		return upnp_address(addr, address, len);
+
+	default:
+		break;
+	}
+
+	return RC_DDNS_INVALID_CHECKIP_RSP;
+}
+
+/* Protocol for .conf file name, or %GATEWAY_NONE if unknown */
+int gateway_lookup(const char *name)
+{
+	size_t i;
+
+	for (i = 1; i < NELEMS(names); i++) {
+		if (!strcasecmp(names[i], name))
+			return i;
+	}
+
+	return GATEWAY_NONE;
+}
+
+const char *gateway_name(int proto)
+{
+	if (proto <= GATEWAY_NONE || proto >= (int)NELEMS(names))
+		return "none";
+
+	return names[proto];
+}
+
+/* NAT-PMP address, or PCP ANNOUNCE, unsolicited from a gateway */
+static int is_announcement(const unsigned char *buf, ssize_t len)
+{
+	if (len >= NATPMP_RSP_LEN && buf[0] == NATPMP_VERSION && buf[1] == (PCP_RESPONSE | NATPMP_OP_ADDRESS))
+		return 1;
+
+	return len >= PCP_HEADER_LEN && buf[0] == PCP_VERSION && buf[1] == (PCP_RESPONSE | PCP_OP_ANNOUNCE);
+}
+
+/* Only the gateway we ask is trusted to tell us to check again */
+static int is_gateway(struct in_addr *sa)
+{
+	char from[INET_ADDRSTRLEN], gw[INET_ADDRSTRLEN];
+	ddns_info_t *info;
+	int dflt = 0;
+
+	if (!inet_ntop(AF_INET, sa, from, sizeof(from)))
+		return 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->checkip_gateway == GATEWAY_NATPMP || info->checkip_gateway == GATEWAY_PCP) {
+			if (!info->checkip_gateway_addr[0])
+				dflt = 1;
+			else if (!strcmp(info->checkip_gateway_addr, from))
+				return 1;
+		}
+		info = conf_info_iterator(0);
+	}
+
+	return dflt && !default_gateway(gw, sizeof(gw)) && !strcmp(gw, from);
+}
+
+static void gateway_cb(int fd, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	unsigned char buf[PCP_MAX_PACKET];
+	int changed = 0;
+
+	while (1) {
+		struct sockaddr_in sin;
+		socklen_t slen = sizeof(sin);
+		ssize_t len;
+
+		len = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&sin, &slen);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (is_announcement(buf, len) && is_gateway(&sin.sin_addr))
+			changed = 1;
+	}
+
+	if (!changed)
+		return;
+
+	logit(LOG_DEBUG, "Gateway announced a change, checking address.");
+	ddns_cmd(ctx, CMD_CHECK_NOW);
+}
+
+/**
+ * gateway_init - Listen for address announcements from the gateway
+ * @ctx: Context, ctx->cmd is set to %CMD_CHECK_NOW on announcement
+ *
+ * Only if any provider asks the gateway with NAT-PMP or PCP.  Failing
+ * to listen is not fatal, the address is then only checked every period.
+ *
+ * Returns:
+ * Always POSIX OK(0).
+ */
+int gateway_init(ddns_t *ctx)
+{
+	struct sockaddr_in sin;
+	struct ip_mreq mreq;
+	ddns_info_t *info;
+	int watch = 0, on = 1;
+
+	if (sd != -1)
+		return 0;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->checkip_gateway == GATEWAY_NATPMP || info->checkip_gateway == GATEWAY_PCP)
+			watch = 1;
+		info = conf_info_iterator(0);
+	}
+
+	if (!watch)
+		return 0;
+
+	sd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sd < 0)
+		goto fail;
+
+	/* Other NAT-PMP clients on this host may listen as well */
+	setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family      = AF_INET;
+	sin.sin_port        = htons(GATEWAY_CLIENT_PORT);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sd, (struct sockaddr *)&sin, sizeof(sin)))
+		goto fail;
+
+	/* All-hosts, usually already joined by the kernel */
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_multiaddr.s_addr = htonl(INADDR_ALLHOSTS_GROUP);
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	setsockopt(sd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+
+	fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if (event_add(sd, gateway_cb, ctx))
+		goto fail;
+
+	logit(LOG_DEBUG, "Listening for gateway announcements.");
+	return 0;
+fail:
+	logit(LOG_INFO, "Cannot listen for gateway announcements: %s", strerror(errno));
+	if (sd != -1)
+		close(sd);
+	sd = -1;
+
+	return 0;
+}
+
+void gateway_exit(void)
+{
+	/* The gateway may have changed too */
+	memset(&upnp, 0, sizeof(upnp));
+
+	if (sd == -1)
+		return;
+
+	event_del(sd);
+	close(sd);
+	sd = -1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
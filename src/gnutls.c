@@ -19,15 +19,34 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <pthread.h>
 #include <stdint.h>
 #include <gnutls/x509.h>
 
+#include "compat.h"
 #include "log.h"
 #include "http.h"
 #include "ssl.h"
 
 extern char *prognm;
 static gnutls_certificate_credentials_t xcred;
+static gnutls_priority_t priority;	/* Default priorities, parsed once */
+static int ca_loaded = 0;
+
+/* CA bundle loaded into xcred, and number of sessions using it */
+static pthread_mutex_t ca_lock = PTHREAD_MUTEX_INITIALIZER;
+static char            ca_file[256];
+static time_t          ca_mtime;
+static int             ca_reload;
+static int             ca_users;
+
+/* Last session with each server, shared by parallel update workers */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+	char           host[256];
+	gnutls_datum_t data;
+} cache[SSL_SESSION_CACHE_SIZE];
+static int cache_next;
 
 
 /* This function will verify the peer's certificate, and check
@@ -118,33 +137,120 @@ error:
 	return 0;
 }
 
-static int ssl_set_ca_location(void)
+/* Returns the CA bundle file loaded into @cred, or NULL on error */
+static const char *ca_load(gnutls_certificate_credentials_t cred)
 {
 	int num = 0;
 
 	/* A user defined CA PEM bundle overrides any built-ins or fall-backs */
 	if (ca_trust_file) {
 		logit(LOG_DEBUG, "Using CA PEM bundle: %s", ca_trust_file);
-		num = gnutls_certificate_set_x509_trust_file(xcred, ca_trust_file, GNUTLS_X509_FMT_PEM);
-		goto done;
+		if (gnutls_certificate_set_x509_trust_file(cred, ca_trust_file, GNUTLS_X509_FMT_PEM) <= 0)
+			return NULL;
+		return ca_trust_file;
 	}
 
 #ifdef gnutls_certificate_set_x509_system_trust /* Since 3.0.20 */
-	num = gnutls_certificate_set_x509_system_trust(xcred);
+	num = gnutls_certificate_set_x509_system_trust(cred);
+	if (num > 0)
+		return "";
 #endif
-	if (num <= 0)
-		num = gnutls_certificate_set_x509_trust_file(xcred, CAFILE1, GNUTLS_X509_FMT_PEM);
-	if (num <= 0)
-		num = gnutls_certificate_set_x509_trust_file(xcred, CAFILE2, GNUTLS_X509_FMT_PEM);
-done:
-	if (num <= 0)
+	num = gnutls_certificate_set_x509_trust_file(cred, CAFILE1, GNUTLS_X509_FMT_PEM);
+	if (num > 0)
+		return CAFILE1;
+	num = gnutls_certificate_set_x509_trust_file(cred, CAFILE2, GNUTLS_X509_FMT_PEM);
+	if (num > 0)
+		return CAFILE2;
+
+	return NULL;
+}
+
+/* Remember what we loaded, or tried to load, to detect changes later */
+static void ca_stamp(const char *file)
+{
+	strlcpy(ca_file, file ? file : "", sizeof(ca_file));
+	ca_mtime  = fmtime(ca_file);
+	ca_reload = 0;
+}
+
+/* Has the user picked, or replaced, the CA bundle since we loaded it? */
+static int ca_stale(void)
+{
+	if (ca_reload)
+		return 1;
+	if (ca_trust_file && strcmp(ca_trust_file, ca_file))
 		return 1;
 
-	return 0;
+	return fmtime(ca_file) != ca_mtime;
+}
+
+/*
+ * The credentials are shared by all sessions, possibly in parallel
+ * update workers, so the trust store is only loaded once.  When it
+ * needs reloading we wait until no session uses the credentials, and
+ * only replace them if the new trust store loads successfully.  On
+ * success the caller holds a reference, see ca_put().
+ */
+static int ssl_set_ca_location(void)
+{
+	const char *file;
+	int rc = 0;
+
+	pthread_mutex_lock(&ca_lock);
+	if (!ca_loaded) {
+		file = ca_load(xcred);
+		ca_stamp(file ? file : ca_trust_file);
+		if (file)
+			ca_loaded = 1;
+	} else if (!ca_users && ca_stale()) {
+		gnutls_certificate_credentials_t cred;
+
+		if (!gnutls_certificate_allocate_credentials(&cred)) {
+			gnutls_certificate_set_verify_function(cred, verify_certificate_callback);
+			file = ca_load(cred);
+			if (file) {
+				logit(LOG_DEBUG, "Reloaded CA trust store %s", file);
+				gnutls_certificate_free_credentials(xcred);
+				xcred = cred;
+			} else {
+				logit(LOG_WARNING, "Failed reloading CA trust store, keeping previous one.");
+				gnutls_certificate_free_credentials(cred);
+			}
+			ca_stamp(file ? file : ca_trust_file);
+		}
+	}
+
+	if (ca_loaded)
+		ca_users++;
+	else
+		rc = 1;
+	pthread_mutex_unlock(&ca_lock);
+
+	return rc;
+}
+
+/* Session done with the shared credentials */
+static void ca_put(void)
+{
+	pthread_mutex_lock(&ca_lock);
+	if (ca_users > 0)
+		ca_users--;
+	pthread_mutex_unlock(&ca_lock);
+}
+
+/* Reload CA trust store on next connection, e.g. on SIGHUP */
+void ssl_reload(void)
+{
+	pthread_mutex_lock(&ca_lock);
+	ca_reload = 1;
+	pthread_mutex_unlock(&ca_lock);
 }
 
 int ssl_init(void)
 {
+	const char *err;
+	int ret;
+
 	if (!gnutls_check_version("3.1.4")) {
 		logit(LOG_ERR, "%s requires GnuTLS 3.1.4 or later for SSL", prognm);
 		exit(1);
@@ -157,13 +263,41 @@ int ssl_init(void)
 	gnutls_certificate_allocate_credentials(&xcred);
 	gnutls_certificate_set_verify_function(xcred, verify_certificate_callback);
 
+	/* Use default priorities, the same for all sessions */
+	ret = gnutls_priority_init(&priority, "NORMAL", &err);
+	if (ret < 0) {
+		if (ret == GNUTLS_E_INVALID_REQUEST)
+			logit(LOG_ERR, "Syntax error at: %s", err);
+		priority = NULL;
+		return RC_HTTPS_INVALID_REQUEST;
+	}
+
 	return 0;
 }
 
 
 void ssl_exit(void)
 {
+	int i;
+
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].data.data)
+			gnutls_free(cache[i].data.data);
+		cache[i].data.data = NULL;
+		cache[i].data.size = 0;
+		cache[i].host[0]   = 0;
+	}
+	cache_next = 0;
+
+	if (priority)
+		gnutls_priority_deinit(priority);
+	priority = NULL;
+
 	gnutls_certificate_free_credentials(xcred);
+	ca_loaded  = 0;
+	ca_users   = 0;
+	ca_file[0] = 0;
+	ca_mtime   = 0;
 	gnutls_global_deinit();
 }
 
@@ -181,6 +315,53 @@ void ssl_get_info(http_t *client)
 #endif
 }
 
+/* Resume previous session with @host, if we have one */
+static void session_load(gnutls_session_t session, const char *host)
+{
+	int i;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (!cache[i].data.data || strcmp(cache[i].host, host))
+			continue;
+
+		gnutls_session_set_data(session, cache[i].data.data, cache[i].data.size);
+		break;
+	}
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/*
+ * Called when closing, rather than after the handshake, because with
+ * TLS 1.3 the session ticket arrives after the handshake has completed
+ */
+static void session_save(gnutls_session_t session, const char *host)
+{
+	gnutls_datum_t data;
+	int i;
+
+	if (gnutls_session_get_data2(session, &data))
+		return;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].data.data && !strcmp(cache[i].host, host))
+			break;
+	}
+
+	/* Not found, replace the oldest entry */
+	if (i == SSL_SESSION_CACHE_SIZE) {
+		i = cache_next;
+		cache_next = (cache_next + 1) % SSL_SESSION_CACHE_SIZE;
+	}
+
+	if (cache[i].data.data)
+		gnutls_free(cache[i].data.data);
+	strlcpy(cache[i].host, host, sizeof(cache[i].host));
+	cache[i].data = data;
+	pthread_mutex_unlock(&cache_lock);
+}
+
 int ssl_fail(http_t *client, int rc)
 {
 	if (!client)
@@ -191,19 +372,22 @@ int ssl_fail(http_t *client, int rc)
 	return rc;
 }
 
-int ssl_open(http_t *client, char *msg, int force)
+/* Map GNUTLS_E_AGAIN et al. to our non-blocking return codes, or zero */
+static int ssl_want(http_t *client, int ret)
 {
-	const gnutls_datum_t *cert_list;
-	unsigned int cert_list_size = 0;
-	gnutls_x509_crt_t cert;
-	const char *sn, *err;
-	char buf[256];
-	int port = 0;
-	size_t len;
+	if (ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED || (ret < 0 && !gnutls_error_is_fatal(ret)))
+		return gnutls_record_get_direction(client->ssl) ? RC_TCP_WANT_WRITE : RC_TCP_WANT_READ;
+
+	return 0;
+}
+
+int ssl_open(http_t *client, char *msg)
+{
+	const char *sn;
 	int ret;
 
 	if (!client->ssl_enabled)
-		return tcp_init(&client->tcp, msg, force);
+		return 0;
 
 	/* Try to figure out location of trusted CA certs on system */
 	if (ssl_set_ca_location())
@@ -211,9 +395,11 @@ int ssl_open(http_t *client, char *msg, int force)
 
 	/* Initialize TLS session */
 	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
-	ret = gnutls_init(&client->ssl, GNUTLS_CLIENT);
+	ret = gnutls_init(&client->ssl, GNUTLS_CLIENT | GNUTLS_NONBLOCK);
 	if (ret) {
 		logit(LOG_ERR, "Failed initializing HTTPS: %s", gnutls_strerror(ret));
+		client->ssl = NULL;
+		ca_put();
 		return RC_HTTPS_OUT_OF_MEMORY;
 	}
 
@@ -223,47 +409,69 @@ int ssl_open(http_t *client, char *msg, int force)
 	if (gnutls_server_name_set(client->ssl, GNUTLS_NAME_DNS, sn, strlen(sn)))
 		return ssl_fail(client, RC_HTTPS_SNI_ERROR);
 
-	/* Use default priorities */
-	ret = gnutls_priority_set_direct(client->ssl, "NORMAL", &err);
-	if (ret < 0) {
-		if (ret == GNUTLS_E_INVALID_REQUEST)
-			logit(LOG_ERR, "Syntax error at: %s", err);
-
+	/* Default priorities, see ssl_init() */
+	if (!priority || gnutls_priority_set(client->ssl, priority) < 0)
 		return ssl_fail(client, RC_HTTPS_INVALID_REQUEST);
-	}
 
 	/* put the x509 credentials to the current session */
 	gnutls_credentials_set(client->ssl, GNUTLS_CRD_CERTIFICATE, xcred);
+	session_load(client->ssl, sn);
 
-	/* connect to the peer */
-	http_get_port(client, &port);
-	if (!port)
-		http_set_port(client, HTTPS_DEFAULT_PORT);
-	DO(tcp_init(&client->tcp, msg, force));
+#ifdef ENABLE_HTTP2
+	if (client->http2) {
+		gnutls_datum_t alpn[] = {
+			{ (unsigned char *)"h2",       2 },
+			{ (unsigned char *)"http/1.1", 8 },
+		};
+
+		if (gnutls_alpn_set_protocols(client->ssl, alpn, NELEMS(alpn), 0))
+			return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
+	}
+#endif
 
 	/* Forward TCP socket to GnuTLS, the set_int() API is perhaps too new still ... since 3.1.9 */
 //	gnutls_transport_set_int(client->ssl, client->tcp.socket);
 	gnutls_transport_set_ptr(client->ssl, (gnutls_transport_ptr_t)(intptr_t)client->tcp.socket);
 
+	return 0;
+}
+
+int ssl_handshake(http_t *client)
+{
+	const gnutls_datum_t *cert_list;
+	unsigned int cert_list_size = 0;
+	gnutls_x509_crt_t cert;
+	const char *sn;
+	char buf[256];
+	size_t len;
+	int ret;
+
+	if (!client->ssl_enabled)
+		return 0;
+
 	/* Perform the TLS handshake, ignore non-fatal errors. */
-	do {
-		ret = gnutls_handshake(client->ssl);
-	}
-	while (ret != 0 && !gnutls_error_is_fatal(ret));
+	ret = gnutls_handshake(client->ssl);
+	if (ret) {
+		int want = ssl_want(client, ret);
+
+		if (want)
+			return want;
 
-	if (gnutls_error_is_fatal(ret)) {
+		http_get_remote_name(client, &sn);
 		logit(LOG_ERR, "SSL handshake with %s failed: %s", sn, gnutls_strerror(ret));
-		return ssl_fail(client, RC_HTTPS_FAILED_CONNECT);
+		return RC_HTTPS_FAILED_CONNECT;
 	}
 
 	client->connected = 1;
 	ssl_get_info(client);
+	if (gnutls_session_is_resumed(client->ssl))
+		logit(LOG_INFO, "SSL session resumed");
 
 	/* Get server's certificate (note: beware of dynamic allocation) - opt */
 	cert_list = gnutls_certificate_get_peers(client->ssl, &cert_list_size);
 	if (cert_list_size > 0) {
 		if (gnutls_x509_crt_init(&cert))
-			return ssl_fail(client, RC_HTTPS_FAILED_GETTING_CERT);
+			return RC_HTTPS_FAILED_GETTING_CERT;
 
 		gnutls_x509_crt_import(cert, &cert_list[0], GNUTLS_X509_FMT_DER);
 
@@ -283,50 +491,75 @@ int ssl_open(http_t *client, char *msg, int force)
 
 int ssl_close(http_t *client)
 {
-	if (client->ssl_enabled) {
-		if (client->connected)
+	if (client->ssl_enabled && client->ssl) {
+		if (client->connected) {
+			const char *sn;
+
+			http_get_remote_name(client, &sn);
+			session_save(client->ssl, sn);
 			gnutls_bye(client->ssl, GNUTLS_SHUT_WR);
+		}
 		gnutls_deinit(client->ssl);
+		client->ssl = NULL;
+		ca_put();
 	}
 	client->connected = 0;
 
 	return tcp_exit(&client->tcp);
 }
 
-int ssl_send(http_t *client, const char *buf, int len)
+/* Did the server select h2 in ALPN, see ssl_open() */
+int ssl_alpn_h2(http_t *client)
+{
+	gnutls_datum_t proto;
+
+	if (!client->ssl_enabled || !client->ssl)
+		return 0;
+	if (gnutls_alpn_get_selected_protocol(client->ssl, &proto))
+		return 0;
+
+	return proto.size == 2 && !memcmp(proto.data, "h2", 2);
+}
+
+int ssl_send(http_t *client, const char *buf, int len, int *sent)
 {
 	int ret;
 
 	if (!client->ssl_enabled)
-		return tcp_send(&client->tcp, buf, len);
-
-	do {
-		ret = gnutls_record_send(client->ssl, buf, len);
-	} while (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+		return tcp_send(&client->tcp, buf, len, sent);
 
+	*sent = 0;
+	ret = gnutls_record_send(client->ssl, buf, len);
 	if (ret < 0) {
+		int want = ssl_want(client, ret);
+
+		if (want)
+			return want;
+
 		logit(LOG_WARNING, "Failed sending HTTPS request: %s", gnutls_strerror(ret));
 		return RC_HTTPS_SEND_ERROR;
 	}
 
-	logit(LOG_DEBUG, "Successfully sent HTTPS request!");
+	*sent = ret;
+	if (ret == len)
+		logit(LOG_DEBUG, "Successfully sent HTTPS request!");
 
 	return 0;
 }
 
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int ret, len = 0;
+	int ret, want;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
-	do {
-		ret = gnutls_record_recv(client->ssl, buf + len, buf_len - len);
-		if (ret > 0) {
-			len += ret;
-		}
-	} while (ret > 0 || ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN);
+	*recv_len = 0;
+	ret = gnutls_record_recv(client->ssl, buf, buf_len);
+	if (ret >= 0) {
+		*recv_len = ret;
+		return 0;
+	}
 
 	/*
 	 * We may get GNUTLS_E_PREMATURE_TERMINATION here.  It happens
@@ -335,16 +568,15 @@ int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 	 * TLS handling.  OpenSSL seems to ignore this so we do too.
 	 *                       -- André Colomb
 	 */
-	if (ret < 0 && ret != GNUTLS_E_PREMATURE_TERMINATION) {
-		logit(LOG_WARNING, "Failed receiving HTTPS response: %s", gnutls_strerror(ret));
-		return RC_HTTPS_RECV_ERROR;
-	}
-
-	*recv_len = len;
+	if (ret == GNUTLS_E_PREMATURE_TERMINATION)
+		return 0;
 
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	want = ssl_want(client, ret);
+	if (want)
+		return want;
 
-	return 0;
+	logit(LOG_WARNING, "Failed receiving HTTPS response: %s", gnutls_strerror(ret));
+	return RC_HTTPS_RECV_ERROR;
 }
 
 /**
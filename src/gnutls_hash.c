@@ -19,6 +19,10 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <gnutls/gnutls.h>
+#include <gnutls/crypto.h>
+
+#include "hash.h"
 #include "md5.h"
 #include "sha1.h"
 #include <nettle/md5.h>
@@ -43,3 +47,56 @@ void sha1(const unsigned char *input, size_t ilen, unsigned char output[20])
 	sha1_update(&ctx, ilen, input);
 	sha1_digest(&ctx, SHA1_DIGEST_SIZE, output);
 }
+
+static gnutls_digest_algorithm_t md(hash_alg_t alg)
+{
+	switch (alg) {
+	case HASH_MD5:
+		return GNUTLS_DIG_MD5;
+	case HASH_SHA1:
+		return GNUTLS_DIG_SHA1;
+	case HASH_SHA256:
+		return GNUTLS_DIG_SHA256;
+	}
+
+	return GNUTLS_DIG_UNKNOWN;
+}
+
+/*
+ * Start a streaming hash, see hash.h.  Unlike the nettle functions
+ * above, gnutls_hash_init() uses any accelerated implementation that
+ * GnuTLS has registered, e.g. SHA-NI or ARMv8 crypto extensions.
+ */
+int hash_init(hash_ctx_t *ctx, hash_alg_t alg)
+{
+	gnutls_hash_hd_t hd;
+
+	ctx->alg  = alg;
+	ctx->priv = NULL;
+
+	if (gnutls_hash_init(&hd, md(alg)) < 0)
+		return -1;
+	ctx->priv = hd;
+
+	return 0;
+}
+
+int hash_update(hash_ctx_t *ctx, const void *data, size_t len)
+{
+	if (!ctx->priv)
+		return -1;
+
+	return gnutls_hash(ctx->priv, data, len) < 0 ? -1 : 0;
+}
+
+/* Write digest, unless @digest is NULL, and release the context */
+int hash_final(hash_ctx_t *ctx, unsigned char *digest)
+{
+	if (!ctx->priv)
+		return -1;
+
+	gnutls_hash_deinit(ctx->priv, digest);
+	ctx->priv = NULL;
+
+	return 0;
+}
@@ -0,0 +1,524 @@
+/* Active/standby coordination of two inadyn instances
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * On both routers of a VRRP pair, two inadyn would update the same
+ * hostnames every time the address changes.  With ha-state set, only
+ * the active node, according to the state file written by, e.g., a
+ * keepalived notify script, checks and updates, the standby just waits.
+ * The file holds a single word, MASTER or ACTIVE for the active node,
+ * BACKUP, STANDBY, FAULT or STOP for the standby.  A missing file means
+ * active, better an update too many than none at all.  The file is read
+ * every second, and a node that becomes active checks at once.
+ *
+ * With ha-peer set, the active node sends its state, the address, time
+ * of last update and record ID(s) of each hostname, to the peer after
+ * each cycle that changed it, and every HA_RESEND seconds.  The standby
+ * takes over records newer than its own, so after a failover it knows
+ * what the DNS already says and does not update every hostname again.
+ * Only datagrams from the address of the peer are accepted, and with
+ * ha-secret only those with a valid HMAC-SHA256.
+ *
+ * One datagram is text, a header line, one line per record, and last
+ * the HMAC of everything before it, "-" without ha-secret:
+ *
+ *     inadyn-ha 1
+ *     SYSTEM FAMILY HOSTNAME ADDRESS LAST-UPDATE ID
+ *     hmac HEX
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "cache.h"
+#include "ddns.h"
+#include "dnscache.h"
+#include "event.h"
+#include "ha.h"
+#include "hash.h"
+
+#define HA_HEADER		"inadyn-ha 1\n"
+#define HA_HMAC_LEN		(6 + 2 * HASH_MAX_SIZE + 1)	/* "hmac HEX\n" */
+
+char *ha_state;
+char *ha_peer;
+char *ha_secret;
+
+static int        active = 1;
+static int        sd = -1;
+static dns_addr_t peer[DNSCACHE_MAX_ADDRS];
+static int        num_peers;
+
+static unsigned long last_written;	/* cache_stats() at last send */
+static time_t        last_sent;
+
+extern ddns_info_t *conf_info_iterator(int first);
+
+/* Read ha-state, returns 1 if active, 0 if standby, or -1 if unknown */
+static int read_state(void)
+{
+	const char *standby[] = { "BACKUP", "STANDBY", "FAULT", "STOP" };
+	char word[32];
+	size_t i;
+	FILE *fp;
+	int rc;
+
+	fp = fopen(ha_state, "r");
+	if (!fp) {
+		logit_limit(LOG_WARNING, "Cannot read %s, assuming active node: %s", ha_state, strerror(errno));
+		return 1;
+	}
+	rc = fscanf(fp, "%31s", word);
+	fclose(fp);
+
+	/* Being written, try again next time */
+	if (rc != 1)
+		return -1;
+
+	if (!strcasecmp(word, "MASTER") || !strcasecmp(word, "ACTIVE"))
+		return 1;
+	for (i = 0; i < NELEMS(standby); i++) {
+		if (!strcasecmp(word, standby[i]))
+			return 0;
+	}
+
+	logit_limit(LOG_WARNING, "Unknown state %s in %s, assuming active node", word, ha_state);
+	return 1;
+}
+
+/* Returns 1 if the node just became active */
+static int update(void)
+{
+	int state;
+
+	if (!ha_state || !ha_state[0]) {
+		active = 1;
+		return 0;
+	}
+
+	state = read_state();
+	if (state < 0 || state == active)
+		return 0;
+
+	active = state;
+	if (active)
+		logit(LOG_NOTICE, "Active node, taking over DDNS updates.");
+	else
+		logit(LOG_NOTICE, "Standby node, leaving DDNS updates to the active node.");
+
+	return active;
+}
+
+/* Is this the node doing updates? */
+int ha_active(void)
+{
+	update();
+	return active;
+}
+
+/* Check ha-state, a node that becomes active checks its addresses at once */
+void ha_poll(ddns_t *ctx)
+{
+	if (update())
+		ddns_cmd(ctx, CMD_CHECK_NOW);
+}
+
+/* Time, in msec, until ha-state should be read again, or -1 for never */
+int ha_next(void)
+{
+	if (!ha_state || !ha_state[0])
+		return -1;
+
+	return HA_POLL_INTERVAL;
+}
+
+/* HMAC of @len bytes of @msg in hex, or "-" without ha-secret */
+static int sign(const char *msg, size_t len, char *hex)
+{
+	unsigned char digest[HASH_MAX_SIZE];
+	hmac_ctx_t hmac;
+
+	if (!ha_secret || !ha_secret[0]) {
+		strcpy(hex, "-");
+		return 0;
+	}
+
+	if (hmac_init(&hmac, HASH_SHA256, ha_secret, strlen(ha_secret)))
+		return -1;
+	hmac_update(&hmac, msg, len);
+	if (hmac_final(&hmac, digest))
+		return -1;
+
+	hash_hex(digest, hash_size(HASH_SHA256), hex);
+
+	return 0;
+}
+
+static void transmit(char *pkt, size_t len)
+{
+	char hex[2 * HASH_MAX_SIZE + 1];
+
+	if (sign(pkt, len, hex)) {
+		logit(LOG_WARNING, "Failed signing state for HA peer %s", ha_peer);
+		return;
+	}
+	len += snprintf(pkt + len, HA_HMAC_LEN + 1, "hmac %s\n", hex);
+
+	if (sendto(sd, pkt, len, 0, (struct sockaddr *)&peer[0].ss, peer[0].len) < 0)
+		logit_limit(LOG_WARNING, "Failed sending state to HA peer %s: %s", ha_peer, strerror(errno));
+}
+
+/**
+ * ha_send - Replicate state to the standby node
+ *
+ * Called at the end of each cycle.  Only the active node sends, and
+ * only if the state file has been written since last time, or after
+ * %HA_RESEND seconds, in case the peer has restarted since.
+ */
+void ha_send(void)
+{
+	char pkt[HA_MAX_PACKET + HA_HMAC_LEN + 1];
+	const cache_stats_t *st = cache_stats();
+	size_t len = 0, hdr = strlen(HA_HEADER);
+	ddns_info_t *info;
+	int num = 0;
+
+	if (sd == -1 || !active)
+		return;
+	if (st->written == last_written && event_now() - last_sent < HA_RESEND)
+		return;
+
+	last_written = st->written;
+	last_sent    = event_now();
+
+	memcpy(pkt, HA_HEADER, hdr);
+	len = hdr;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i;
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+			const char *id = alias->id;
+			char line[HA_MAX_PACKET];
+			int n;
+
+			if (!alias->last_update || !alias->address[0])
+				continue;
+			if (!id[0] || strpbrk(id, " \r\n"))
+				id = "-";
+
+			n = snprintf(line, sizeof(line), "%s %d %s %s %lld %s\n", info->system->name,
+				     alias->family == AF_INET6 ? 6 : 4, alias->name, alias->address,
+				     (long long)alias->last_update, id);
+			if (n < 0 || hdr + n > HA_MAX_PACKET)
+				continue;
+
+			if (len + n > HA_MAX_PACKET) {
+				transmit(pkt, len);
+				len = hdr;
+			}
+			memcpy(pkt + len, line, n);
+			len += n;
+			num++;
+		}
+
+		info = conf_info_iterator(0);
+	}
+
+	if (len > hdr)
+		transmit(pkt, len);
+	logit(LOG_DEBUG, "Sent %d records to HA peer %s", num, ha_peer);
+}
+
+static int is_peer(struct sockaddr_storage *ss)
+{
+	int i;
+
+	for (i = 0; i < num_peers; i++) {
+		struct sockaddr_storage *p = &peer[i].ss;
+
+		if (p->ss_family != ss->ss_family)
+			continue;
+
+		if (ss->ss_family == AF_INET &&
+		    !memcmp(&((struct sockaddr_in *)p)->sin_addr, &((struct sockaddr_in *)ss)->sin_addr,
+			    sizeof(struct in_addr)))
+			return 1;
+		if (ss->ss_family == AF_INET6 &&
+		    !memcmp(&((struct sockaddr_in6 *)p)->sin6_addr, &((struct sockaddr_in6 *)ss)->sin6_addr,
+			    sizeof(struct in6_addr)))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Check, and strip, the trailing HMAC of @msg */
+static int verify(char *msg, size_t len)
+{
+	char hex[2 * HASH_MAX_SIZE + 1], *ptr;
+	unsigned char diff = 0;
+	size_t i;
+
+	if (len < 2 || msg[len - 1] != '\n')
+		return -1;
+
+	msg[len - 1] = 0;
+	ptr = strrchr(msg, '\n');
+	if (!ptr || strncmp(ptr + 1, "hmac ", 5))
+		return -1;
+	ptr++;
+	*ptr = 0;
+
+	if (!ha_secret || !ha_secret[0])
+		return 0;
+
+	if (sign(msg, ptr - msg, hex) || strlen(ptr + 5) != strlen(hex))
+		return -1;
+
+	/* Same time for any mismatch */
+	for (i = 0; hex[i]; i++)
+		diff |= hex[i] ^ ptr[5 + i];
+
+	return diff ? -1 : 0;
+}
+
+static ddns_alias_t *find(const char *sysname, int family, const char *name)
+{
+	ddns_info_t *info;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		size_t i;
+
+		if (strcmp(info->system->name, sysname)) {
+			info = conf_info_iterator(0);
+			continue;
+		}
+
+		for (i = 0; i < info->alias_count; i++) {
+			ddns_alias_t *alias = &info->alias[i];
+
+			if (alias->family == family && !strcmp(alias->name, name))
+				return alias;
+		}
+
+		info = conf_info_iterator(0);
+	}
+
+	return NULL;
+}
+
+/* Take over records newer than ours, returns number of records changed */
+static int apply(char *msg)
+{
+	char *line, *save = NULL;
+	int num = 0;
+
+	line = strtok_r(msg, "\n", &save);
+	if (!line || strcmp(line, "inadyn-ha 1"))
+		return 0;
+
+	while ((line = strtok_r(NULL, "\n", &save))) {
+		char *sysname, *fam, *name, *address, *when, *id, *ptr = NULL;
+		unsigned char addr[sizeof(struct in6_addr)];
+		ddns_alias_t *alias;
+		long long last;
+		int family;
+
+		sysname = strtok_r(line, " ", &ptr);
+		fam     = strtok_r(NULL, " ", &ptr);
+		name    = strtok_r(NULL, " ", &ptr);
+		address = strtok_r(NULL, " ", &ptr);
+		when    = strtok_r(NULL, " ", &ptr);
+		id      = strtok_r(NULL, " ", &ptr);
+		if (!id)
+			continue;
+
+		family = !strcmp(fam, "6") ? AF_INET6 : AF_INET;
+		last   = strtoll(when, NULL, 10);
+		if (inet_pton(family, address, addr) != 1 || last <= 0)
+			continue;
+
+		alias = find(sysname, family, name);
+		if (!alias || alias->last_update >= (time_t)last)
+			continue;
+
+		logit(LOG_DEBUG, "HA peer updated %s to %s", alias->name, address);
+		alias_set_address(alias, address);
+		alias->last_update = (time_t)last;
+		alias->fails       = 0;
+		if (strcmp(id, "-"))
+			strlcpy(alias->id, id, sizeof(alias->id));
+		num++;
+	}
+
+	return num;
+}
+
+static void ha_cb(int fd, void *arg)
+{
+	char buf[HA_MAX_PACKET + HA_HMAC_LEN + 1];
+	int num = 0;
+
+	while (1) {
+		struct sockaddr_storage ss;
+		socklen_t slen = sizeof(ss);
+		ssize_t len;
+
+		len = recvfrom(fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *)&ss, &slen);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		buf[len] = 0;
+
+		if (!is_peer(&ss)) {
+			logit_limit(LOG_WARNING, "Dropping HA state from unknown sender.");
+			continue;
+		}
+		if (verify(buf, len)) {
+			logit_limit(LOG_WARNING, "Dropping HA state from %s, invalid HMAC, check ha-secret.", ha_peer);
+			continue;
+		}
+
+		num += apply(buf);
+	}
+
+	/* Keep the state file warm too, in case we restart before failover */
+	if (num) {
+		logit(LOG_INFO, "Replicated %d records from HA peer %s", num, ha_peer);
+		cache_touch();
+		cache_flush();
+	}
+}
+
+/**
+ * ha_init - Start replicating state with the HA peer
+ * @ctx: Context
+ *
+ * Only if ha-peer is set.  The peer listens on the same port as we do,
+ * %HA_DEFAULT_PORT unless given, e.g., ha-peer = 192.168.1.2:4747.  Not
+ * being able to replicate is not fatal, a failover then just updates
+ * hostnames the new active node did not know were already up to date.
+ *
+ * Returns:
+ * Always POSIX OK(0).
+ */
+int ha_init(ddns_t *ctx)
+{
+	char host[SERVER_NAME_LEN], *ptr;
+	struct sockaddr_storage ss;
+	int port = HA_DEFAULT_PORT, rc;
+
+	update();
+	if (!ha_peer || !ha_peer[0] || sd != -1)
+		return 0;
+
+	/* Port only after a hostname, or a bracketed IPv6 address */
+	strlcpy(host, ha_peer[0] == '[' ? ha_peer + 1 : ha_peer, sizeof(host));
+	ptr = strrchr(host, ']');
+	if (ptr)
+		*ptr++ = 0;
+	else if (strchr(host, ':') == strrchr(host, ':'))
+		ptr = strchr(host, ':');
+	if (ptr && *ptr == ':') {
+		*ptr++ = 0;
+		port = atoi(ptr);
+		if (port <= 0 || port > 65535) {
+			logit(LOG_WARNING, "Invalid port in ha-peer %s, not replicating state.", ha_peer);
+			return 0;
+		}
+	}
+
+	rc = dnscache_resolve(host, port, AF_UNSPEC, peer, &num_peers);
+	if (rc) {
+		logit(LOG_WARNING, "Failed resolving HA peer %s, not replicating state: %s", host, gai_strerror(rc));
+		num_peers = 0;
+		return 0;
+	}
+
+	sd = socket(peer[0].ss.ss_family, SOCK_DGRAM, 0);
+	if (sd < 0)
+		goto fail;
+
+	memset(&ss, 0, sizeof(ss));
+	ss.ss_family = peer[0].ss.ss_family;
+	if (ss.ss_family == AF_INET)
+		((struct sockaddr_in *)&ss)->sin_port = htons(port);
+	else
+		((struct sockaddr_in6 *)&ss)->sin6_port = htons(port);
+	if (bind(sd, (struct sockaddr *)&ss, peer[0].len))
+		goto fail;
+
+	fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if (event_add(sd, ha_cb, ctx))
+		goto fail;
+
+	if (!ha_secret || !ha_secret[0])
+		logit(LOG_NOTICE, "No ha-secret set, state from HA peer %s is not authenticated.", ha_peer);
+	logit(LOG_INFO, "Replicating state with HA peer %s, port %d", ha_peer, port);
+
+	return 0;
+fail:
+	logit(LOG_WARNING, "Cannot replicate state with HA peer %s: %s", ha_peer, strerror(errno));
+	if (sd != -1)
+		close(sd);
+	sd        = -1;
+	num_peers = 0;
+
+	return 0;
+}
+
+void ha_exit(void)
+{
+	num_peers    = 0;
+	last_sent    = 0;
+	last_written = 0;
+
+	if (sd == -1)
+		return;
+
+	event_del(sd);
+	close(sd);
+	sd = -1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,121 @@
+/* Streaming hash interface for builds without a TLS library
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+
+#include "compat.h"
+#include "hash.h"
+#include "md5.h"
+#include "sha1.h"
+#include "sha256.h"
+
+union state {
+	md5_context    md5;
+	sha1_context   sha1;
+	sha256_context sha256;
+};
+
+/* Start a streaming hash, see hash.h */
+int hash_init(hash_ctx_t *ctx, hash_alg_t alg)
+{
+	union state *st;
+
+	ctx->alg  = alg;
+	ctx->priv = NULL;
+
+	st = malloc(sizeof(*st));
+	if (!st)
+		return -1;
+
+	switch (alg) {
+	case HASH_MD5:
+		md5_starts(&st->md5);
+		break;
+	case HASH_SHA1:
+		sha1_starts(&st->sha1);
+		break;
+	case HASH_SHA256:
+		sha256_starts(&st->sha256);
+		break;
+	}
+	ctx->priv = st;
+
+	return 0;
+}
+
+int hash_update(hash_ctx_t *ctx, const void *data, size_t len)
+{
+	union state *st = ctx->priv;
+
+	if (!st)
+		return -1;
+
+	switch (ctx->alg) {
+	case HASH_MD5:
+		md5_update(&st->md5, data, len);
+		break;
+	case HASH_SHA1:
+		sha1_update(&st->sha1, data, len);
+		break;
+	case HASH_SHA256:
+		sha256_update(&st->sha256, data, len);
+		break;
+	}
+
+	return 0;
+}
+
+/* Write digest, unless @digest is NULL, and release the context */
+int hash_final(hash_ctx_t *ctx, unsigned char *digest)
+{
+	union state *st = ctx->priv;
+
+	if (!st)
+		return -1;
+
+	if (digest) {
+		switch (ctx->alg) {
+		case HASH_MD5:
+			md5_finish(&st->md5, digest);
+			break;
+		case HASH_SHA1:
+			sha1_finish(&st->sha1, digest);
+			break;
+		case HASH_SHA256:
+			sha256_finish(&st->sha256, digest);
+			break;
+		}
+	}
+
+	/* May hold key material, from HMAC */
+	memwipe(st, sizeof(*st));
+	free(st);
+	ctx->priv = NULL;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
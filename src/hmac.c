@@ -0,0 +1,128 @@
+/* HMAC (RFC 2104) on top of the streaming hash interface
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * The same for all backends, the hashing itself is done by the TLS
+ * library, or the bundled code, through hash_init() et al.
+ */
+
+#include <string.h>
+
+#include "compat.h"
+#include "hash.h"
+
+/**
+ * hmac_init - Start a keyed hash
+ * @ctx: HMAC context
+ * @alg: Hash algorithm
+ * @key: Secret key
+ * @len: Length of @key, keys longer than the block size are hashed
+ *
+ * Returns:
+ * POSIX OK(0), or -1 if the backend fails to set up the hash.
+ */
+int hmac_init(hmac_ctx_t *ctx, hash_alg_t alg, const void *key, size_t len)
+{
+	unsigned char k[HASH_BLOCK_SIZE] = { 0 };
+	unsigned char ipad[HASH_BLOCK_SIZE];
+	size_t i;
+
+	if (len > sizeof(k)) {
+		if (hash_digest(alg, key, len, k))
+			return -1;
+	} else if (len) {
+		memcpy(k, key, len);
+	}
+
+	for (i = 0; i < sizeof(k); i++) {
+		ipad[i]      = k[i] ^ 0x36;
+		ctx->opad[i] = k[i] ^ 0x5c;
+	}
+	memwipe(k, sizeof(k));
+
+	if (hash_init(&ctx->hash, alg)) {
+		memwipe(ctx->opad, sizeof(ctx->opad));
+		return -1;
+	}
+	hash_update(&ctx->hash, ipad, sizeof(ipad));
+	memwipe(ipad, sizeof(ipad));
+
+	return 0;
+}
+
+int hmac_update(hmac_ctx_t *ctx, const void *data, size_t len)
+{
+	return hash_update(&ctx->hash, data, len);
+}
+
+/**
+ * hmac_final - Finish keyed hash
+ * @ctx:    HMAC context
+ * @digest: Buffer of at least hash_size() bytes, or %NULL to abort
+ *
+ * The context is released, and the key wiped, also on error.
+ *
+ * Returns:
+ * POSIX OK(0), or -1 on backend error.
+ */
+int hmac_final(hmac_ctx_t *ctx, unsigned char *digest)
+{
+	unsigned char inner[HASH_MAX_SIZE];
+	hash_alg_t alg = ctx->hash.alg;
+	int rc;
+
+	rc = hash_final(&ctx->hash, digest ? inner : NULL);
+	if (!digest || rc)
+		goto done;
+
+	rc = hash_init(&ctx->hash, alg);
+	if (rc)
+		goto done;
+
+	hash_update(&ctx->hash, ctx->opad, sizeof(ctx->opad));
+	hash_update(&ctx->hash, inner, hash_size(alg));
+	rc = hash_final(&ctx->hash, digest);
+done:
+	memwipe(ctx->opad, sizeof(ctx->opad));
+	memwipe(inner, sizeof(inner));
+
+	return rc;
+}
+
+/* Lower case hex string of @digest, @str must fit 2 * @len + 1 */
+void hash_hex(const unsigned char *digest, size_t len, char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		*str++ = hex[digest[i] >> 4];
+		*str++ = hex[digest[i] & 0x0f];
+	}
+	*str = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
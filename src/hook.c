@@ -0,0 +1,273 @@
+/* Bounded-time executor of --exec hooks
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * The --exec hook runs in a process group of its own, so it, and any
+ * children it starts, can be killed if it runs for longer than the
+ * exec-timeout.  At most exec-concurrency hooks run at the same time,
+ * events arriving when all are busy are dropped, with a warning, so a
+ * slow hook cannot pile up processes.
+ *
+ * In the batch exec-mode all events of a cycle are collected and sent
+ * to one invocation of the hook, one event per line on stdin:
+ *
+ *     EVENT HOSTNAME ADDRESS ERROR
+ *
+ * SIGCHLD is ignored when a hook is set, see os.c, so hooks are reaped
+ * by the kernel.  Whether a hook is still running is checked by asking
+ * for its process group.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ddns.h"
+#include "event.h"
+#include "hook.h"
+#include "trace.h"
+
+int hook_timeout     = HOOK_DEFAULT_TIMEOUT;
+int hook_concurrency = HOOK_DEFAULT_CONCURRENCY;
+
+struct hook {
+	pid_t     pgid;
+	long long deadline;	/* msec, 0: no limit */
+};
+
+static struct hook running[HOOK_MAX_CONCURRENCY];
+static int         num_running;
+
+static FILE *batch;		/* Events of this cycle, batch exec-mode */
+static int   num_events;
+
+/*
+ * Start @script_exec, with @env, NULL terminated pairs of name and
+ * value, and stdin from @fd, unless -1.
+ */
+static int spawn(const char *env[], int fd)
+{
+	struct hook *h;
+	pid_t child;
+	int limit;
+
+	hook_reap();
+
+	limit = hook_concurrency;
+	if (limit < 1)
+		limit = 1;
+	if (limit > HOOK_MAX_CONCURRENCY)
+		limit = HOOK_MAX_CONCURRENCY;
+	if (num_running >= limit) {
+		logit_limit(LOG_WARNING, "%d hooks still running, skipping %s", num_running, script_exec);
+		return RC_OS_FORK_FAILURE;
+	}
+
+	child = fork();
+	switch (child) {
+	case 0:
+		setpgid(0, 0);
+		if (fd != -1)
+			dup2(fd, STDIN_FILENO);
+		for (; env[0]; env += 2)
+			setenv(env[0], env[1], 1);
+		if (iface)
+			setenv("INADYN_IFACE", iface, 1);
+
+		execl("/bin/sh", "sh", "-c", script_exec, (char *)0);
+		_exit(1);
+
+	case -1:
+		logit(LOG_WARNING, "Failed starting %s: %s", script_exec, strerror(errno));
+		return RC_OS_FORK_FAILURE;
+
+	default:
+		break;
+	}
+
+	/* Also here, in case we check before the child has run */
+	setpgid(child, child);
+
+	h = &running[num_running++];
+	h->pgid     = child;
+	h->deadline = hook_timeout > 0 ? event_msec() + hook_timeout * 1000LL : 0;
+
+	return 0;
+}
+
+/**
+ * hook_event - Run, or queue, the hook for one update event
+ * @event: Event name, nochg, update, or error
+ * @name:  Hostname
+ * @ip:    Address
+ * @error: Error code, or zero
+ *
+ * In the batch exec-mode the event is queued until hook_flush(),
+ * otherwise the hook is started immediately with the event in the
+ * environment.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_OS_FORK_FAILURE if the hook could not be started.
+ */
+int hook_event(const char *event, const char *name, const char *ip, int error)
+{
+	char errbuf[11];
+	const char *env[] = {
+		"INADYN_IP",            ip,
+		"INADYN_HOSTNAME",      name,
+		"INADYN_EVENT",         event,
+		"INADYN_ERROR",         errbuf,
+		"INADYN_ERROR_MESSAGE", error_str(error),
+		NULL
+	};
+	long long t;
+	int rc;
+
+	if (!script_exec)
+		return 0;
+
+	if (exec_mode == EXEC_MODE_BATCH) {
+		if (!batch)
+			batch = tmpfile();
+		if (!batch) {
+			logit(LOG_WARNING, "Failed queuing %s event for %s: %s", event, name, strerror(errno));
+			return RC_OS_FORK_FAILURE;
+		}
+
+		fprintf(batch, "%s %s %s %d\n", event, name, ip[0] ? ip : "-", error);
+		num_events++;
+		return 0;
+	}
+
+	snprintf(errbuf, sizeof(errbuf), "%d", error);
+
+	/* Only starting it, the hook runs on its own */
+	t  = trace_start();
+	rc = spawn(env, -1);
+	trace_span(t, "hook", "exec %s %s", event, name);
+
+	return rc;
+}
+
+/**
+ * hook_flush - Run the hook for all events queued this cycle
+ *
+ * The number of events is in %INADYN_EVENTS, the events on stdin.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_OS_FORK_FAILURE if the hook could not be started.
+ */
+int hook_flush(void)
+{
+	char numbuf[11];
+	const char *env[] = {
+		"INADYN_EVENTS", numbuf,
+		NULL
+	};
+	long long t;
+	int rc = 0;
+
+	if (!batch)
+		return 0;
+
+	if (num_events) {
+		t = trace_start();
+		snprintf(numbuf, sizeof(numbuf), "%d", num_events);
+		fflush(batch);
+		rewind(batch);
+		rc = spawn(env, fileno(batch));
+		trace_span(t, "hook", "exec %d events", num_events);
+	}
+
+	fclose(batch);
+	batch      = NULL;
+	num_events = 0;
+
+	return rc;
+}
+
+/* Forget hooks that are done, kill those that have run for too long */
+void hook_reap(void)
+{
+	long long now = event_msec();
+	int i = 0;
+
+	while (i < num_running) {
+		struct hook *h = &running[i];
+
+		if (kill(-h->pgid, 0) && errno == ESRCH)
+			goto done;
+
+		if (h->deadline && now >= h->deadline) {
+			logit(LOG_WARNING, "Hook %s did not finish in %d sec, killed.", script_exec, hook_timeout);
+			kill(-h->pgid, SIGKILL);
+			goto done;
+		}
+
+		i++;
+		continue;
+	done:
+		running[i] = running[--num_running];
+	}
+}
+
+/* Number of hooks still running, for the metrics */
+int hook_running(void)
+{
+	hook_reap();
+
+	return num_running;
+}
+
+/* Time, in msec, until the next hook should be killed, or -1 for none */
+int hook_next(void)
+{
+	long long now = event_msec(), next = -1;
+	int i;
+
+	for (i = 0; i < num_running; i++) {
+		long long left;
+
+		if (!running[i].deadline)
+			continue;
+
+		left = running[i].deadline - now;
+		if (left < 0)
+			left = 0;
+		if (left > INT32_MAX)
+			left = INT32_MAX;
+		if (next < 0 || left < next)
+			next = left;
+	}
+
+	return (int)next;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
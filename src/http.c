@@ -20,11 +20,26 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 
+#include "compat.h"
+#include "budget.h"
+#include "event.h"
+#include "log.h"
 #include "ssl.h"
 #include "http.h"
+#include "http2.h"
 #include "error.h"
+#include "probe.h"
+#include "replay.h"
+#include "trace.h"
 
 int http_construct(http_t *client)
 {
@@ -51,71 +66,846 @@ int http_destruct(http_t *client, int num)
 static int local_set_params(http_t *client)
 {
 	int timeout = 0;
+	int port = 0;
 
 	http_get_remote_timeout(client, &timeout);
 	if (timeout == 0)
 		http_set_remote_timeout(client, HTTP_DEFAULT_TIMEOUT);
 
+	http_get_port(client, &port);
+	if (port == 0)
+		http_set_port(client, client->ssl_enabled ? HTTPS_DEFAULT_PORT : HTTP_DEFAULT_PORT);
+
 	return 0;
 }
 
-int http_init(http_t *client, char *msg, int force)
+static const char *phase_names[] = {
+	[HTTP_PHASE_RESOLVE]    = "resolve",
+	[HTTP_PHASE_CONNECT]    = "connect",
+	[HTTP_PHASE_HANDSHAKE]  = "handshake",
+	[HTTP_PHASE_FIRST_BYTE] = "first_byte",
+	[HTTP_PHASE_COMPLETE]   = "complete",
+};
+
+/* Upper bounds of histogram buckets, msec, the last bucket is +Inf */
+static const long long hist_bounds[HTTP_HIST_BUCKETS] = {
+	5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+
+const char *http_phase_name(http_phase_t phase)
+{
+	if (phase >= HTTP_PHASE_MAX)
+		return "unknown";
+
+	return phase_names[phase];
+}
+
+/* Upper bound of @bucket in msec, -1 for the last, +Inf, bucket */
+long long http_hist_bound(int bucket)
 {
-	int rc = 0;
+	if (bucket < 0 || bucket >= HTTP_HIST_BUCKETS)
+		return -1;
+
+	return hist_bounds[bucket];
+}
 
-	do {
-		TRY(local_set_params(client));
-		TRY(ssl_open(client, msg, force));
+static void hist_add(http_hist_t *hist, long long msec)
+{
+	int i;
+
+	if (msec < 0)
+		msec = 0;
+
+	for (i = 0; i < HTTP_HIST_BUCKETS; i++) {
+		if (msec <= hist_bounds[i])
+			break;
 	}
-	while (0);
 
-	if (rc) {
-		http_exit(client);
-		return rc;
+	hist->count[i]++;
+	hist->num++;
+	hist->sum += msec;
+}
+
+/* Phases of a completed conversation, as spans on the trace timeline */
+static void trace_phases(http_t *client, long long now)
+{
+	const char *host = client->tcp.remote_host;
+	long long start = client->ts_start ? client->ts_start : client->ts_request;
+
+	if (!trace_enabled)
+		return;
+
+	trace_range(start * 1000, now * 1000, "http", "%s", host);
+	if (client->ts_start) {
+		if (client->tcp.resolved >= client->ts_start) {
+			trace_range(client->ts_start * 1000, client->tcp.resolved * 1000, "http", "resolve %s", host);
+			trace_range(client->tcp.resolved * 1000, client->ts_connected * 1000, "http", "connect %s", host);
+		}
+		if (client->ssl_enabled)
+			trace_range(client->ts_connected * 1000, client->ts_secure * 1000, "http", "handshake %s", host);
 	}
+	if (client->ts_first) {
+		trace_range(client->ts_request * 1000, client->ts_first * 1000, "http", "wait %s", host);
+		trace_range(client->ts_first * 1000, now * 1000, "http", "transfer %s", host);
+	}
+}
+
+/*
+ * Account a completed conversation.  Connection phases only count when
+ * the connection was set up for it, not when a kept-alive one is used.
+ */
+static void http_account(http_t *client)
+{
+	http_hist_t *phase = client->stats.phase;
+	long long now = event_msec();
+	long long resolve = -1, connect = -1, handshake = -1, first, total;
+
+	if (client->ts_start) {
+		if (client->tcp.resolved >= client->ts_start) {
+			resolve = client->tcp.resolved - client->ts_start;
+			connect = client->ts_connected - client->tcp.resolved;
+			hist_add(&phase[HTTP_PHASE_RESOLVE], resolve);
+			hist_add(&phase[HTTP_PHASE_CONNECT], connect);
+		}
+		if (client->ssl_enabled) {
+			handshake = client->ts_secure - client->ts_connected;
+			hist_add(&phase[HTTP_PHASE_HANDSHAKE], handshake);
+		}
+	}
+
+	first = (client->ts_first ? client->ts_first : now) - client->ts_request;
+	total = now - (client->ts_start ? client->ts_start : client->ts_request);
+	hist_add(&phase[HTTP_PHASE_FIRST_BYTE], first);
+	hist_add(&phase[HTTP_PHASE_COMPLETE], total);
+
+	logit(LOG_DEBUG, "%s: resolve %lld, connect %lld, handshake %lld, first byte %lld, total %lld msec",
+	      client->tcp.remote_host, resolve, connect, handshake, first, total);
+	PROBE(http__phases, client->tcp.remote_host, resolve, connect, handshake, first, total);
+	trace_phases(client, now);
+
+	/* Any next conversation on this connection is a reuse */
+	client->ts_start = 0;
+}
+
+/* Next state, every state gets a full timeout, or what is left of the budget */
+static void http_next(http_t *client, http_state_t state)
+{
+	client->state    = state;
+	client->deadline = budget_clamp(event_msec() + client->tcp.timeout);
+
+	if (state == HTTP_SEND || state == HTTP_STREAMS) {
+		client->ts_request = event_msec();
+		client->ts_first   = 0;
+	}
+}
+
+static int http_wait(http_t *client, int rc)
+{
+	client->events = rc == RC_TCP_WANT_READ ? POLLIN : POLLOUT;
+	return client->rc = rc;
+}
+
+/* Wake up when any connection attempt completes, or to start the next one */
+static int http_connecting(http_t *client, int rc)
+{
+	client->deadline = tcp_connect_deadline(&client->tcp);
+	return http_wait(client, rc);
+}
+
+static int http_fail(http_t *client, int rc)
+{
+	client->keepalive = 0;
+	client->stats.failed++;
+
+	/* A failed connect or handshake leaves nothing for http_exit() */
+	if (!client->initialized && !replay_file)
+		ssl_close(client);
+
+	/* Whatever we got, callers may want to log it */
+	if (client->trans && client->trans->rsp) {
+		http_parse_free(client->trans);
+		client->trans->rsp[client->trans->rsp_len] = 0;
+	}
+	replay_record(client, rc);
+
+	client->state = HTTP_FAILED;
+	return client->rc = rc;
+}
+
+/* Identifies the proxy, if any, a connection goes through */
+static void proxy_id(http_t *client, char *buf, size_t len)
+{
+	tcp_sock_t *tcp = &client->tcp;
+
+	if (tcp->proxy_type == NO_PROXY) {
+		buf[0] = 0;
+		return;
+	}
+
+	snprintf(buf, len, "%d:%s:%d", tcp->proxy_type, tcp->proxy_host, tcp->proxy_port);
+}
+
+/*
+ * A kept-alive connection can only be reused for the same server, via
+ * the same proxy, and only if the server has not closed it while we
+ * were away.  Anything readable on an idle connection, except TLS
+ * records without any data, is either EOF or junk, so either way we
+ * have to reconnect.
+ */
+static int http_reusable(http_t *client)
+{
+	char proxy[sizeof(client->conn_proxy)];
+	struct pollfd pfd;
+	int port = 0;
+
+	http_get_port(client, &port);
+	if (!client->tcp.remote_host || strcmp(client->conn_host, client->tcp.remote_host))
+		return 0;
+	if (port != client->conn_port || client->ssl_enabled != client->conn_ssl)
+		return 0;
+	proxy_id(client, proxy, sizeof(proxy));
+	if (strcmp(client->conn_proxy, proxy))
+		return 0;
+	if (client->h2)
+		return http2_reusable(client);
+
+	pfd.fd      = client->tcp.socket;
+	pfd.events  = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0)) {
+		char junk[1];
+		int len;
+
+		/* TLS 1.3 session tickets may arrive after the handshake, those are fine */
+		if (!client->ssl_enabled || !HTTP_PENDING(ssl_recv(client, junk, sizeof(junk), &len)))
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * With --replay nothing is sent, the recorded response is handed over
+ * by http_step() when the deadline, the recorded latency, expires.
+ */
+static int http_replay(http_t *client)
+{
+	int msec = 0;
 
 	client->initialized = 1;
+	if (!client->trans) {
+		http_next(client, HTTP_DONE);
+		return client->rc = 0;
+	}
+
+	http_next(client, HTTP_REPLAY);
+	client->ts_request = event_msec();
+	client->ts_first   = 0;
+
+	client->replay = replay_find(client, client->trans, &msec);
+	if (client->replay < 0)
+		return http_fail(client, RC_TCP_CONNECT_FAILED);
+
+	client->deadline = client->ts_request + msec;
+	client->events   = 0;
+
+	return client->rc = RC_TCP_WANT_READ;
+}
+
+/**
+ * http_start - Start a non-blocking HTTP(S) conversation
+ * @client: HTTP client, with remote name and port set
+ * @trans:  Request and response buffers, or %NULL to only connect
+ * @msg:    Prefix for log messages when connecting
+ * @force:  %TCP_FORCE_IPV4 or %TCP_FORCE_IPV6, or %TCP_AUTO
+ *
+ * Unless @client is already connected, this resolves the remote name
+ * and initiates the TCP connection, to the proxy if one is set.  The
+ * rest of the conversation, the proxy tunnel, the TLS handshake, sending
+ * the request and receiving the response, is driven by calling
+ * http_step() when client->tcp.socket is ready for client->events, or
+ * by http_poll() for one or more clients.
+ *
+ * Returns:
+ * POSIX OK(0) when done, HTTP_PENDING() while in progress, or an error.
+ */
+int http_start(http_t *client, http_trans_t *trans, const char *msg, int force)
+{
+	int rc;
+
+	ASSERT(client);
+
+	client->trans     = trans;
+	client->sent      = 0;
+	client->early     = 0;
+	client->events    = 0;
+	client->rc        = 0;
+	client->keepalive = 0;
+	if (msg)
+		client->msg = msg;
+	if (trans) {
+		if (trans->buf) {
+			trans->rsp         = trans->buf->data;
+			trans->max_rsp_len = trans->buf->size - 1;
+		}
+		trans->rsp_len = 0;
+		http_parse_init(trans);
+	}
+
+	if (client->initialized) {
+		if (!trans)
+			return 0;
+		if (replay_file)
+			return http_replay(client);
+
+		if (client->h2) {
+			rc = http2_submit(client, trans);
+			if (rc)
+				return http_fail(client, rc);
+			http_next(client, HTTP_STREAMS);
+		} else {
+			http_next(client, HTTP_SEND);
+		}
+		return http_step(client, POLLOUT);
+	}
+
+	local_set_params(client);
+	client->reused       = 0;
+	client->ts_start     = event_msec();
+	client->ts_connected = 0;
+	client->ts_secure    = 0;
+	client->tcp.resolved = 0;
+	strlcpy(client->conn_host, client->tcp.remote_host ? client->tcp.remote_host : "",
+		sizeof(client->conn_host));
+	http_get_port(client, &client->conn_port);
+	client->conn_ssl = client->ssl_enabled;
+	proxy_id(client, client->conn_proxy, sizeof(client->conn_proxy));
+	if (replay_file)
+		return http_replay(client);
+	http_next(client, HTTP_CONNECT);
+
+	rc = tcp_connect(&client->tcp, msg, force);
+	if (HTTP_PENDING(rc))
+		return http_connecting(client, rc);
+	if (rc)
+		return http_fail(client, rc);
+
+	/* Connected already, e.g. to localhost */
+	return http_step(client, POLLOUT);
+}
+
+/**
+ * http_step - Advance non-blocking HTTP(S) conversation
+ * @client:  HTTP client, from http_start()
+ * @revents: Events from poll(), zero if the timeout expired
+ *
+ * Returns:
+ * Same as http_start()
+ */
+int http_step(http_t *client, int revents)
+{
+	http_trans_t *trans;
+	const char *rsp;
+	int rc, len;
+
+	ASSERT(client);
+	trans = client->trans;
+
+	while (1) {
+		switch (client->state) {
+		case HTTP_CONNECT:
+			rc = tcp_connect_check(&client->tcp);
+			if (HTTP_PENDING(rc))
+				return http_connecting(client, rc);
+			if (rc)
+				return http_fail(client, rc);
+
+			http_next(client, HTTP_PROXY);
+			break;
+
+		case HTTP_PROXY:
+			rc = tcp_proxy(&client->tcp);
+			if (HTTP_PENDING(rc)) {
+				if (!revents) {
+					logit(LOG_WARNING, "Timed out waiting for proxy %s", client->tcp.proxy_host);
+					return http_fail(client, RC_TCP_PROXY_FAILED);
+				}
+				return http_wait(client, rc);
+			}
+			if (rc)
+				return http_fail(client, rc);
+			client->ts_connected = event_msec();
+
+			if (client->ssl_enabled)
+				PROBE(ssl__open, client->tcp.remote_host);
+			rc = ssl_open(client, (char *)client->msg);
+			if (rc)
+				return http_fail(client, rc);
+
+			http_next(client, HTTP_HANDSHAKE);
+			break;
+
+		case HTTP_HANDSHAKE:
+			rc = ssl_handshake(client);
+			if (HTTP_PENDING(rc)) {
+				if (!revents)
+					rc = RC_HTTPS_FAILED_CONNECT;
+				else
+					return http_wait(client, rc);
+			}
+			if (client->ssl_enabled)
+				PROBE(ssl__handshake, client->tcp.remote_host, rc);
+			if (rc)
+				return http_fail(client, rc);
+
+			client->initialized = 1;
+			client->ts_secure   = event_msec();
+			if (client->http2 && ssl_alpn_h2(client)) {
+				rc = http2_open(client);
+				if (rc)
+					return http_fail(client, rc);
+			}
+			if (!trans) {
+				http_next(client, HTTP_DONE);
+				break;
+			}
+
+			if (client->h2) {
+				rc = http2_submit(client, trans);
+				if (rc)
+					return http_fail(client, rc);
+				http_next(client, HTTP_STREAMS);
+				break;
+			}
+
+			http_next(client, HTTP_SEND);
+			break;
+
+		case HTTP_SEND:
+			while (client->sent < trans->req_len) {
+				rc = ssl_send(client, trans->req + client->sent, trans->req_len - client->sent, &len);
+				if (HTTP_PENDING(rc)) {
+					if (!revents && len == 0)
+						return http_fail(client, RC_TCP_SEND_ERROR);
+					return http_wait(client, rc);
+				}
+				if (rc)
+					return http_fail(client, rc);
+
+				client->sent += len;
+				revents = POLLOUT;
+			}
+
+			http_next(client, HTTP_RECV);
+			break;
+
+		case HTTP_RECV:
+			while (1) {
+				if (trans->rsp_len >= trans->max_rsp_len) {
+					if (http_grow(trans))
+						continue;
+
+					logit(LOG_WARNING, "Response from %s does not fit in %d bytes, truncated.",
+					      client->tcp.remote_host, trans->max_rsp_len);
+					trans->truncated = 1;
+					rc = http_parse(trans, 1);
+					break;
+				}
+
+				rc = ssl_recv(client, trans->rsp + trans->rsp_len, trans->max_rsp_len - trans->rsp_len, &len);
+				if (HTTP_PENDING(rc)) {
+					if (revents)
+						return http_wait(client, rc);
+
+					/* Unframed response from server that does not close */
+					if (trans->parse >= HTTP_PARSE_BODY) {
+						rc = http_parse(trans, 1);
+						break;
+					}
+
+					logit(LOG_WARNING, "Timed out waiting for reply from %s", client->tcp.remote_host);
+					return http_fail(client, RC_TCP_RECV_ERROR);
+				}
+				if (rc)
+					return http_fail(client, rc);
+				if (len == 0) {
+					/* Server closed connection */
+					if (trans->rsp_len == 0)
+						return http_fail(client, RC_TCP_RECV_ERROR);
+
+					rc = http_parse(trans, 1);
+					break;
+				}
+
+				/* Progress, restart timeout */
+				trans->rsp_len  += len;
+				client->deadline = budget_clamp(event_msec() + client->tcp.timeout);
+				if (!client->ts_first)
+					client->ts_first = event_msec();
+
+				rc = http_parse(trans, 0);
+				if (rc != RC_TCP_WANT_READ)
+					break;
+			}
+			if (rc)
+				return http_fail(client, rc);
+
+			logit(LOG_DEBUG, "Successfully received HTTP%s response (%d/%d bytes)!",
+			      client->ssl_enabled ? "S" : "", trans->rsp_len, trans->max_rsp_len);
+			client->keepalive = !trans->close;
+			replay_record(client, 0);
+			http_account(client);
+
+			http_next(client, HTTP_DONE);
+			break;
+
+		case HTTP_STREAMS:
+			rc = http2_step(client);
+			if (HTTP_PENDING(rc)) {
+				if (!revents) {
+					logit(LOG_WARNING, "Timed out waiting for reply from %s", client->tcp.remote_host);
+					return http_fail(client, RC_TCP_RECV_ERROR);
+				}
+				return http_wait(client, rc);
+			}
+			if (rc)
+				return http_fail(client, rc);
+
+			logit(LOG_DEBUG, "Successfully received HTTP/2 response(s) from %s", client->tcp.remote_host);
+			client->keepalive = http2_alive(client);
+			http_account(client);
+
+			http_next(client, HTTP_DONE);
+			break;
+
+		case HTTP_REPLAY:
+			if (revents || event_msec() < client->deadline)
+				return client->rc;
+
+			rc = replay_get(client->replay, &rsp, &len);
+			while (len > trans->max_rsp_len && http_grow(trans))
+				;
+			if (len > trans->max_rsp_len) {
+				len = trans->max_rsp_len;
+				trans->truncated = 1;
+			}
+			memcpy(trans->rsp, rsp, len);
+			trans->rsp_len   = len;
+			client->ts_first = event_msec();
+			if (rc)
+				return http_fail(client, rc);
+
+			rc = http_parse(trans, 1);
+			if (rc)
+				return http_fail(client, rc);
+
+			client->keepalive = !trans->close;
+			http_account(client);
+
+			http_next(client, HTTP_DONE);
+			break;
+
+		case HTTP_DONE:
+			client->events = 0;
+			return client->rc = 0;
+
+		case HTTP_FAILED:
+			return client->rc;
+
+		default:
+			return RC_HTTP_OBJECT_NOT_INITIALIZED;
+		}
+
+		/* Try next state before going back to poll() */
+		revents = POLLIN | POLLOUT;
+	}
+}
+
+/**
+ * http_poll_once - Wait for, and advance, non-blocking conversations
+ * @clients: Array of started HTTP clients, see http_start()
+ * @num:     Number of clients in @clients
+ * @wakeup:  Return no later than this, msec from event_msec(), or zero
+ *
+ * Like http_poll(), but returns after one round of poll(), so callers
+ * can act as soon as any conversation completes.
+ *
+ * Returns:
+ * Number of conversations that were in progress, zero when all are
+ * done, or -1 if poll() fails.
+ */
+int http_poll_once(http_t *clients[], int num, long long wakeup)
+{
+	struct pollfd pfd[num > 0 ? num * DNSCACHE_MAX_ADDRS : 1];
+	int cnt[num > 0 ? num : 1];
+	long long now, next = 0;
+	int i, n = 0, pending = 0, rc;
+
+	for (i = 0; i < num; i++) {
+		http_t *client = clients[i];
+
+		cnt[i] = 0;
+		if (!HTTP_PENDING(client->rc))
+			continue;
+		pending++;
+
+		/* Happy Eyeballs, several connection attempts may be racing */
+		if (client->state == HTTP_CONNECT) {
+			cnt[i] = tcp_connect_fds(&client->tcp, &pfd[n], DNSCACHE_MAX_ADDRS);
+		} else {
+			/* Replayed responses only wait for the deadline */
+			pfd[n].fd      = client->state == HTTP_REPLAY ? -1 : client->tcp.socket;
+			pfd[n].events  = client->events;
+			pfd[n].revents = 0;
+			cnt[i] = 1;
+		}
+		n += cnt[i];
+
+		if (!next || client->deadline < next)
+			next = client->deadline;
+	}
+
+	if (!pending)
+		return 0;
+
+	if (wakeup && wakeup < next)
+		next = wakeup;
+
+	/* Write out queued log messages while the servers think */
+	log_flush();
 
+	now = event_msec();
+	rc  = event_poll(pfd, n, next > now ? (int)(next - now) : 0);
+	if (rc < 0) {
+		if (errno == EINTR)
+			return pending;
+		return -1;
+	}
+
+	now = event_msec();
+	for (i = 0, n = 0; i < num; i++) {
+		http_t *client = clients[i];
+		int j, revents = 0;
+
+		for (j = 0; j < cnt[i]; j++)
+			revents |= pfd[n++].revents;
+
+		if (!HTTP_PENDING(client->rc))
+			continue;
+
+		if (revents)
+			http_step(client, revents);
+		else if (now >= client->deadline)
+			http_step(client, 0);
+	}
+
+	return pending;
+}
+
+/**
+ * http_poll - Drive one or more non-blocking conversations to completion
+ * @clients: Array of started HTTP clients, see http_start()
+ * @num:     Number of clients in @clients
+ *
+ * The result of each conversation is in client->rc.
+ *
+ * Returns:
+ * POSIX OK(0), or -1 if poll() fails.
+ */
+int http_poll(http_t *clients[], int num)
+{
+	int rc;
+
+	while ((rc = http_poll_once(clients, num, 0)) > 0)
+		;
+
+	return rc;
+}
+
+/**
+ * http_cancel - Abort a conversation in progress
+ * @client: HTTP client, from http_start()
+ *
+ * For when the result is no longer needed, e.g. another server already
+ * replied.  The connection is closed, since it is in an unknown state.
+ */
+int http_cancel(http_t *client)
+{
+	ASSERT(client);
+
+	if (!HTTP_PENDING(client->rc))
+		return 0;
+
+	client->keepalive = 0;
+	if (client->initialized)
+		http_exit(client);
+	else
+		ssl_close(client);
+	if (client->trans)
+		http_parse_free(client->trans);
+
+	client->state = HTTP_FAILED;
+	return client->rc = RC_ERROR;
+}
+
+/**
+ * http_reuse - Check if a kept-alive connection can be used again
+ * @client: HTTP client
+ *
+ * Closes the connection if it cannot be reused, e.g. if the server has
+ * closed it or @client now points to another server.
+ *
+ * Returns:
+ * Non-zero if the connection is still usable.
+ */
+int http_reuse(http_t *client)
+{
+	ASSERT(client);
+
+	/* Pre-warmed, but not used in time */
+	http_idle(client);
+	if (!client->initialized)
+		return 0;
+
+	if (http_reusable(client)) {
+		logit(LOG_DEBUG, "Reusing %sconnection to %s", client->idle_until ? "pre-warmed " : "",
+		      client->conn_host);
+		client->idle_until = 0;
+		client->reused = 1;
+		return 1;
+	}
+
+	http_exit(client);
 	return 0;
 }
 
+/**
+ * http_prewarm - Connect now, for a request that comes later
+ * @client:     HTTP client, with remote name and port set
+ * @msg:        Prefix for log messages when connecting
+ * @force:      %TCP_FORCE_IPV4 or %TCP_FORCE_IPV6, or %TCP_AUTO
+ * @idle_until: Close the connection if not used by then, msec
+ *
+ * Starts resolving, connecting and the TLS handshake of @client, the
+ * same as http_start() without a request, to be driven by http_poll().
+ * The request is later sent on the connection by http_reuse() et al.
+ * A connection that is still usable, e.g. kept alive since the last
+ * request, is left as-is.
+ *
+ * Returns:
+ * Same as http_start()
+ */
+int http_prewarm(http_t *client, const char *msg, int force, long long idle_until)
+{
+	int rc;
+
+	ASSERT(client);
+
+	if (client->initialized) {
+		if (http_reusable(client))
+			return 0;
+		http_exit(client);
+	}
+
+	rc = http_start(client, NULL, msg, force);
+	if (!rc || HTTP_PENDING(rc))
+		client->idle_until = idle_until;
+
+	return rc;
+}
+
+/**
+ * http_idle - Close pre-warmed connection that has not been used in time
+ * @client: HTTP client, from http_prewarm()
+ *
+ * Returns:
+ * Time left until @client is closed, in msec, or -1 if it is not a
+ * pre-warmed connection, or was closed now.
+ */
+int http_idle(http_t *client)
+{
+	long long left;
+
+	ASSERT(client);
+
+	if (!client->idle_until || HTTP_PENDING(client->rc))
+		return -1;
+	if (!client->initialized) {
+		/* Failed to connect, nothing to close */
+		client->idle_until = 0;
+		return -1;
+	}
+
+	left = client->idle_until - event_msec();
+	if (left > 0)
+		return left > INT32_MAX ? INT32_MAX : (int)left;
+
+	logit(LOG_DEBUG, "Pre-warmed connection to %s not used, closing", client->conn_host);
+	http_exit(client);
+
+	return -1;
+}
+
+int http_init(http_t *client, char *msg, int force)
+{
+	http_t *clients[] = { client };
+	int rc;
+
+	ASSERT(client);
+
+	if (http_reuse(client))
+		return 0;
+
+	rc = http_start(client, NULL, msg, force);
+	if (HTTP_PENDING(rc))
+		http_poll(clients, 1);
+
+	if (HTTP_PENDING(client->rc))
+		return http_fail(client, RC_TCP_CONNECT_FAILED);
+
+	return client->rc;
+}
+
 int http_exit(http_t *client)
 {
 	ASSERT(client);
 
+	client->state      = HTTP_IDLE;
+	client->idle_until = 0;
 	if (!client->initialized)
 		return 0;
 
 	client->initialized = 0;
+	client->keepalive   = 0;
+	http2_close(client);
+	if (replay_file)
+		return 0;
+
 	return ssl_close(client);
 }
 
-static void http_response_parse(http_trans_t *trans)
+/**
+ * http_release - Done with connection, for now
+ * @client: HTTP client
+ *
+ * Closes the connection, unless the last response allows it to be kept
+ * alive for another request to the same server.  Callers that do not
+ * intend to reuse @client soon must use http_exit() instead.
+ */
+int http_release(http_t *client)
 {
-	char *body;
-	char *rsp = trans->rsp_body = trans->rsp;
-	int status = trans->status = 0;
-	const char sep[] = "\r\n\r\n";
-
-	memset(trans->status_desc, 0, sizeof(trans->status_desc));
+	ASSERT(client);
 
-	if (rsp != NULL && (body = strstr(rsp, sep)) != NULL) {
-		body += strlen(sep);
-		trans->rsp_body = body;
-	}
+	if (client->initialized && client->keepalive)
+		return 0;
 
-	/*
-	 * %*c         : HTTP/1.0, 1.1 etc, discard read value
-	 * %4d         : HTTP status code, e.g. 200
-	 * %255[^\r\n] : HTTP status text, e.g. OK -- Reads max 255 bytes, including \0, not \r or \n
-	 */
-	if (sscanf(trans->rsp, "HTTP/1.%*c %4d %255[^\r\n]", &status, trans->status_desc) == 2)
-		trans->status = status;
+	return http_exit(client);
 }
 
 int http_transaction(http_t *client, http_trans_t *trans)
 {
-	int rc = 0;
+	http_t *clients[] = { client };
+	int rc;
 
 	ASSERT(client);
 	ASSERT(trans);
@@ -123,31 +913,183 @@ int http_transaction(http_t *client, http_trans_t *trans)
 	if (!client->initialized)
 		return RC_HTTP_OBJECT_NOT_INITIALIZED;
 
-	trans->rsp_len = 0;
-	do {
-		TRY(ssl_send(client, trans->req, trans->req_len));
-		TRY(ssl_recv(client, trans->rsp, trans->max_rsp_len, &trans->rsp_len));
-	}
-	while (0);
+	PROBE(http__start, client->tcp.remote_host, trans->req_len);
+	rc = http_start(client, trans, NULL, 0);
+	if (HTTP_PENDING(rc))
+		http_poll(clients, 1);
 
-	trans->rsp[trans->rsp_len] = 0;
-	http_response_parse(trans);
+	if (HTTP_PENDING(client->rc))
+		return RC_TCP_RECV_ERROR;
 
-	return rc;
+	/* Server may have closed a kept-alive connection, retry once */
+	if (client->rc && client->reused && trans->rsp_len == 0) {
+		logit(LOG_DEBUG, "Kept-alive connection to %s lost, reconnecting", client->conn_host);
+		http_exit(client);
+
+		rc = http_init(client, (char *)client->msg, client->tcp.force);
+		if (rc)
+			return rc;
+
+		rc = http_start(client, trans, NULL, 0);
+		if (HTTP_PENDING(rc))
+			http_poll(clients, 1);
+
+		if (HTTP_PENDING(client->rc))
+			return RC_TCP_RECV_ERROR;
+	}
+
+	PROBE(http__done, client->tcp.remote_host, client->rc, client->rc ? 0 : trans->status);
+	return client->rc;
 }
 
-int http_status_valid(int status)
+/**
+ * http_transactions - Send several requests on one connection
+ * @client: HTTP client, initialized with http_init()
+ * @trans:  Array of requests, and response buffers
+ * @num:    Number of requests in @trans
+ *
+ * On an HTTP/2 connection all requests are sent at once, as concurrent
+ * streams, and the responses are read as they arrive.  Otherwise this
+ * is the same as http_transaction() for each in turn.  The requests are
+ * not retried, beyond what http_transaction() does, so they should not
+ * depend on each other.
+ *
+ * Returns:
+ * POSIX OK(0) if all got a response, otherwise the first error.  The
+ * HTTP status of each is in @trans.
+ */
+int http_transactions(http_t *client, http_trans_t *trans[], int num)
 {
-	if (status == 200)
+	http_t *clients[] = { client };
+	int i, rc;
+
+	ASSERT(client);
+
+	if (!client->initialized)
+		return RC_HTTP_OBJECT_NOT_INITIALIZED;
+	if (num < 1)
 		return 0;
 
-	if (status == 401 || status == 403)
-		return RC_DDNS_RSP_AUTH_FAIL;
+	if (client->h2 && !replay_file) {
+		for (i = 1; i < num; i++) {
+			rc = http2_submit(client, trans[i]);
+			if (rc)
+				return http_fail(client, rc);
+		}
+
+		rc = http_start(client, trans[0], NULL, 0);
+		if (HTTP_PENDING(rc))
+			http_poll(clients, 1);
+		if (HTTP_PENDING(client->rc))
+			return RC_TCP_RECV_ERROR;
+
+		/* Server may have closed a kept-alive connection, retry once */
+		for (i = 0; i < num && !trans[i]->rsp_len; i++)
+			;
+		if (client->rc && client->reused && i == num) {
+			logit(LOG_DEBUG, "Kept-alive connection to %s lost, reconnecting", client->conn_host);
+			http_exit(client);
+
+			rc = http_init(client, (char *)client->msg, client->tcp.force);
+			if (rc)
+				return rc;
+
+			return http_transactions(client, trans, num);
+		}
 
-	if (status >= 500 && status < 600)
-		return RC_DDNS_RSP_RETRY_LATER;
+		return client->rc;
+	}
+
+	for (i = 0; i < num; i++) {
+		rc = http_transaction(client, trans[i]);
+		if (rc)
+			return rc;
+	}
 
-	return RC_DDNS_RSP_NOTOK;
+	return 0;
+}
+
+/**
+ * http_exchange - Connect, unless already connected, and send request
+ * @client: HTTP client, with remote name and port set
+ * @trans:  Request and response buffers
+ * @msg:    Prefix for log messages when connecting
+ * @force:  %TCP_FORCE_IPV4 or %TCP_FORCE_IPV6, or %TCP_AUTO
+ *
+ * Like http_init() followed by http_transaction(), but when a new
+ * connection is needed the request is known already during the TLS
+ * handshake.  So if client->early_data is set, and the session resumed
+ * allows it, the request is sent as TLS 1.3 early data, saving a round
+ * trip.  If the server rejects the early data, the request is sent
+ * again after the handshake.
+ *
+ * Returns:
+ * Same as http_transaction()
+ */
+int http_exchange(http_t *client, http_trans_t *trans, char *msg, int force)
+{
+	http_t *clients[] = { client };
+	int rc;
+
+	ASSERT(client);
+	ASSERT(trans);
+
+	if (http_reuse(client))
+		return http_transaction(client, trans);
+
+	rc = http_start(client, trans, msg, force);
+	if (HTTP_PENDING(rc))
+		http_poll(clients, 1);
+
+	if (HTTP_PENDING(client->rc))
+		return http_fail(client, RC_TCP_RECV_ERROR);
+
+	return client->rc;
+}
+
+/**
+ * http_stats_log - Log latency summary of a server at debug level
+ * @client: HTTP client, e.g. of a provider or checkip server
+ * @name:   What to call it in the log, e.g. the provider name
+ *
+ * Only logs if there have been new conversations since the last call.
+ * The 95th percentile is the upper bound of the bucket it falls in.
+ */
+void http_stats_log(http_t *client, const char *name)
+{
+	http_stats_t *stats = &client->stats;
+	http_hist_t *total = &stats->phase[HTTP_PHASE_COMPLETE];
+	char buf[256] = "";
+	unsigned long n = 0;
+	int i;
+
+	if (total->num == stats->logged)
+		return;
+	stats->logged = total->num;
+
+	if (!log_enabled(LOG_DEBUG))
+		return;
+
+	for (i = 0; i < HTTP_PHASE_MAX; i++) {
+		http_hist_t *hist = &stats->phase[i];
+		size_t len = strlen(buf);
+
+		if (!hist->num)
+			continue;
+
+		snprintf(buf + len, sizeof(buf) - len, "%s%s avg %lld", len ? ", " : "",
+			 phase_names[i], hist->sum / (long long)hist->num);
+	}
+
+	for (i = 0; i < HTTP_HIST_BUCKETS; i++) {
+		n += total->count[i];
+		if (n * 100 >= total->num * 95)
+			break;
+	}
+
+	logit(LOG_DEBUG, "Latency to %s (%s), %lu ok %lu failed: %s msec, p95 total %s%lld msec",
+	      name, client->tcp.remote_host ? client->tcp.remote_host : "?", total->num, stats->failed,
+	      buf, i < HTTP_HIST_BUCKETS ? "<= " : "> ", hist_bounds[i < HTTP_HIST_BUCKETS ? i : HTTP_HIST_BUCKETS - 1]);
 }
 
 int http_set_port(http_t *client, int port)
@@ -175,6 +1117,12 @@ int http_get_remote_name(http_t *client, const char **name)
 	return tcp_get_remote_name(&client->tcp, name);
 }
 
+int http_set_proxy(http_t *client, tcp_proxy_type_t type, const char *name, int port)
+{
+	ASSERT(client);
+	return tcp_set_proxy(&client->tcp, type, name, port);
+}
+
 int http_set_remote_timeout(http_t *client, int timeout)
 {
 	ASSERT(client);
@@ -0,0 +1,569 @@
+/* HTTP/2 transport, multiplexed requests over one connection
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Plugins, and the rest of inadyn, speak HTTP/1.1: requests are text,
+ * responses are parsed by http_parse().  So on an HTTP/2 connection
+ * each request is translated to a HEADERS frame, and DATA for a body,
+ * and the response is put back together in HTTP/1.1 form in trans->rsp,
+ * framed by the end of the stream instead of by Content-Length.
+ *
+ * All requests submitted before http2_step() go out as concurrent
+ * streams, the responses arrive in whatever order the server finishes
+ * them, see http_transactions().  Framing, flow control and HPACK are
+ * handled by libnghttp2, we only move the bytes between it and the TLS
+ * session.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <nghttp2/nghttp2.h>
+
+#include "compat.h"
+#include "budget.h"
+#include "event.h"
+#include "log.h"
+#include "http2.h"
+#include "replay.h"
+#include "ssl.h"
+
+struct stream {
+	struct stream *next;
+	http_trans_t  *trans;
+	int32_t        id;
+	const char    *body;		/* Request body, after the headers in trans->req */
+	size_t         body_len;
+	size_t         body_sent;
+	int            interim;		/* Skipping a 1xx response */
+	int            headers;		/* End of response headers is written */
+};
+
+struct http2 {
+	nghttp2_session *session;
+	http_t          *client;
+	struct stream   *streams;	/* Submitted, not yet closed */
+	const uint8_t   *out;		/* From nghttp2_session_mem_send(), not yet sent */
+	size_t           out_len;
+	int              rc;		/* Error from a callback */
+};
+
+/* Hop-by-hop, or replaced by pseudo-headers, RFC 9113, section 8.2.2 */
+static const char *dropped[] = {
+	"connection", "keep-alive", "proxy-connection", "transfer-encoding", "upgrade", "te", "host"
+};
+
+static void append(http_trans_t *trans, const void *data, size_t len)
+{
+	if (trans->truncated)
+		return;
+
+	while (trans->rsp_len + len > (size_t)trans->max_rsp_len) {
+		if (http_grow(trans))
+			continue;
+
+		logit(LOG_WARNING, "HTTP/2 response does not fit in %d bytes, truncated.", trans->max_rsp_len);
+		trans->truncated = 1;
+		len = trans->max_rsp_len - trans->rsp_len;
+		break;
+	}
+
+	memcpy(trans->rsp + trans->rsp_len, data, len);
+	trans->rsp_len += len;
+	trans->rsp[trans->rsp_len] = 0;
+}
+
+static int on_header(nghttp2_session *session, const nghttp2_frame *frame,
+		     const uint8_t *name, size_t namelen, const uint8_t *value, size_t valuelen,
+		     uint8_t flags, void *arg)
+{
+	struct stream *s;
+
+	if (frame->hd.type != NGHTTP2_HEADERS)
+		return 0;
+
+	/* Trailers, after the body, are dropped */
+	s = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+	if (!s || s->headers)
+		return 0;
+
+	if (namelen == 7 && !memcmp(name, ":status", 7)) {
+		s->interim = valuelen > 0 && value[0] == '1';
+		if (!s->interim) {
+			append(s->trans, "HTTP/1.1 ", 9);
+			append(s->trans, value, valuelen);
+			append(s->trans, "\r\n", 2);
+		}
+		return 0;
+	}
+
+	/* The body is framed by the end of the stream */
+	if (s->interim || name[0] == ':' || (namelen == 14 && !memcmp(name, "content-length", 14)))
+		return 0;
+
+	append(s->trans, name, namelen);
+	append(s->trans, ": ", 2);
+	append(s->trans, value, valuelen);
+	append(s->trans, "\r\n", 2);
+
+	return 0;
+}
+
+static int on_frame_recv(nghttp2_session *session, const nghttp2_frame *frame, void *arg)
+{
+	struct stream *s;
+
+	if (frame->hd.type != NGHTTP2_HEADERS)
+		return 0;
+
+	s = nghttp2_session_get_stream_user_data(session, frame->hd.stream_id);
+	if (!s || s->headers)
+		return 0;
+
+	/* The real response follows an interim one */
+	if (s->interim) {
+		s->interim = 0;
+		return 0;
+	}
+
+	append(s->trans, "\r\n", 2);
+	s->headers = 1;
+
+	return 0;
+}
+
+static int on_data(nghttp2_session *session, uint8_t flags, int32_t id,
+		   const uint8_t *data, size_t len, void *arg)
+{
+	struct stream *s;
+
+	s = nghttp2_session_get_stream_user_data(session, id);
+	if (s && s->headers)
+		append(s->trans, data, len);
+
+	return 0;
+}
+
+static int on_close(nghttp2_session *session, int32_t id, uint32_t error_code, void *arg)
+{
+	struct http2 *h2 = arg;
+	http_t *client = h2->client;
+	http_trans_t *trans = client->trans;
+	struct stream *s, **prev;
+	int rc;
+
+	s = nghttp2_session_get_stream_user_data(session, id);
+	if (!s)
+		return 0;
+
+	for (prev = &h2->streams; *prev; prev = &(*prev)->next) {
+		if (*prev == s) {
+			*prev = s->next;
+			break;
+		}
+	}
+
+	if (error_code || !s->headers) {
+		logit(LOG_WARNING, "HTTP/2 stream %d to %s closed without response: %s", id,
+		      client->tcp.remote_host, nghttp2_http2_strerror(error_code));
+		rc = RC_HTTP_BAD_RESPONSE;
+	} else {
+		rc = http_parse(s->trans, 1);
+	}
+	if (rc && !h2->rc)
+		h2->rc = rc;
+
+	/* One entry per stream in the --record file */
+	client->trans = s->trans;
+	replay_record(client, rc);
+	client->trans = trans;
+
+	nghttp2_session_set_stream_user_data(session, id, NULL);
+	free(s);
+
+	return 0;
+}
+
+static ssize_t body_read(nghttp2_session *session, int32_t id, uint8_t *buf, size_t len,
+			 uint32_t *flags, nghttp2_data_source *source, void *arg)
+{
+	struct stream *s = source->ptr;
+	size_t left = s->body_len - s->body_sent;
+
+	if (len > left)
+		len = left;
+	memcpy(buf, s->body + s->body_sent, len);
+	s->body_sent += len;
+	if (s->body_sent == s->body_len)
+		*flags |= NGHTTP2_DATA_FLAG_EOF;
+
+	return len;
+}
+
+static void nv_set(nghttp2_nv *nv, const char *name, size_t namelen, const char *value, size_t valuelen)
+{
+	nv->name     = (uint8_t *)name;
+	nv->namelen  = namelen;
+	nv->value    = (uint8_t *)value;
+	nv->valuelen = valuelen;
+	nv->flags    = NGHTTP2_NV_FLAG_NONE;
+}
+
+static int dropped_field(const char *name, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < NELEMS(dropped); i++) {
+		if (strlen(dropped[i]) == len && !memcmp(dropped[i], name, len))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Next line of @len bytes at @p, without CRLF, or NULL at end of @end */
+static const char *next_line(const char *p, const char *end, size_t *len)
+{
+	const char *eol;
+
+	eol = memchr(p, '\n', end - p);
+	if (!eol)
+		return NULL;
+
+	*len = eol - p;
+	if (*len && p[*len - 1] == '\r')
+		(*len)--;
+
+	return eol + 1;
+}
+
+/**
+ * http2_open - Start HTTP/2 session on a newly connected client
+ * @client: HTTP client, after the TLS handshake selected h2 in ALPN
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_OUT_OF_MEMORY.
+ */
+int http2_open(http_t *client)
+{
+	nghttp2_settings_entry iv[] = {
+		{ NGHTTP2_SETTINGS_ENABLE_PUSH, 0 },
+	};
+	nghttp2_session_callbacks *cb;
+	struct http2 *h2;
+	int rc;
+
+	http2_close(client);
+
+	h2 = calloc(1, sizeof(*h2));
+	if (!h2)
+		return RC_OUT_OF_MEMORY;
+
+	if (nghttp2_session_callbacks_new(&cb)) {
+		free(h2);
+		return RC_OUT_OF_MEMORY;
+	}
+
+	nghttp2_session_callbacks_set_on_header_callback(cb, on_header);
+	nghttp2_session_callbacks_set_on_frame_recv_callback(cb, on_frame_recv);
+	nghttp2_session_callbacks_set_on_data_chunk_recv_callback(cb, on_data);
+	nghttp2_session_callbacks_set_on_stream_close_callback(cb, on_close);
+
+	rc = nghttp2_session_client_new(&h2->session, cb, h2);
+	nghttp2_session_callbacks_del(cb);
+	if (rc) {
+		free(h2);
+		return RC_OUT_OF_MEMORY;
+	}
+
+	/* Connection preface, sent with the first request */
+	nghttp2_submit_settings(h2->session, NGHTTP2_FLAG_NONE, iv, NELEMS(iv));
+
+	h2->client = client;
+	client->h2 = h2;
+	logit(LOG_DEBUG, "Using HTTP/2 with %s", client->tcp.remote_host);
+
+	return 0;
+}
+
+/* Drop session, streams in progress are lost, the connection is closed by caller */
+void http2_close(http_t *client)
+{
+	struct http2 *h2 = client->h2;
+
+	if (!h2)
+		return;
+
+	nghttp2_session_del(h2->session);
+	while (h2->streams) {
+		struct stream *s = h2->streams;
+
+		h2->streams = s->next;
+		free(s);
+	}
+
+	free(h2);
+	client->h2 = NULL;
+}
+
+/**
+ * http2_submit - Queue request as a new stream
+ * @client: HTTP client, with an HTTP/2 session
+ * @trans:  Request, in HTTP/1.1 form, and response buffers
+ *
+ * The request is sent by http2_step(), together with any others queued
+ * before it.  The request must remain valid until then, the response
+ * is in @trans, as from an HTTP/1.1 server, when its stream closes.
+ *
+ * Returns:
+ * POSIX OK(0), %RC_HTTPS_INVALID_REQUEST if the request cannot be
+ * translated, or %RC_OUT_OF_MEMORY.
+ */
+int http2_submit(http_t *client, http_trans_t *trans)
+{
+	char names[HTTP2_MAX_HEADERS * 32];
+	nghttp2_nv nv[HTTP2_MAX_HEADERS];
+	nghttp2_data_provider data;
+	const char *p, *end, *line, *sp, *path;
+	const char *host = client->tcp.remote_host;
+	size_t host_len, len, used = 0;
+	struct http2 *h2 = client->h2;
+	struct stream *s;
+	int num = 4;
+
+	if (!h2)
+		return RC_HTTP_OBJECT_NOT_INITIALIZED;
+
+	/* Request line, METHOD SP PATH SP VERSION */
+	p   = trans->req;
+	end = p + trans->req_len;
+	line = p;
+	p = next_line(p, end, &len);
+	if (!p)
+		goto invalid;
+	sp = memchr(line, ' ', len);
+	if (!sp)
+		goto invalid;
+	path = sp + 1;
+	sp = memchr(path, ' ', line + len - path);
+	if (!sp)
+		goto invalid;
+
+	nv_set(&nv[0], ":method", 7, line, path - 1 - line);
+	nv_set(&nv[1], ":scheme", 7, "https", 5);
+	nv_set(&nv[3], ":path",   5, path, sp - path);
+	host_len = host ? strlen(host) : 0;
+
+	while (1) {
+		const char *name, *colon, *val;
+		size_t i, namelen;
+
+		line = p;
+		p = next_line(p, end, &len);
+		if (!p)
+			goto invalid;
+		if (!len)
+			break;
+
+		colon = memchr(line, ':', len);
+		if (!colon)
+			continue;
+
+		namelen = colon - line;
+		val = colon + 1;
+		while (val < line + len && (*val == ' ' || *val == '\t'))
+			val++;
+
+		/* Field names are lower case in HTTP/2 */
+		if (used + namelen > sizeof(names))
+			goto invalid;
+		for (i = 0; i < namelen; i++)
+			names[used + i] = tolower((unsigned char)line[i]);
+		name  = &names[used];
+		used += namelen;
+
+		if (namelen == 4 && !memcmp(name, "host", 4)) {
+			host     = val;
+			host_len = line + len - val;
+			continue;
+		}
+		if (dropped_field(name, namelen))
+			continue;
+
+		if (num >= HTTP2_MAX_HEADERS)
+			goto invalid;
+		nv_set(&nv[num++], name, namelen, val, line + len - val);
+	}
+	nv_set(&nv[2], ":authority", 10, host ? host : "", host_len);
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return RC_OUT_OF_MEMORY;
+	s->trans    = trans;
+	s->body     = p;
+	s->body_len = end - p;
+
+	data.source.ptr    = s;
+	data.read_callback = body_read;
+
+	s->id = nghttp2_submit_request(h2->session, NULL, nv, num, s->body_len ? &data : NULL, s);
+	if (s->id < 0) {
+		logit(LOG_ERR, "Failed queuing HTTP/2 request: %s", nghttp2_strerror(s->id));
+		free(s);
+		return RC_HTTPS_INVALID_REQUEST;
+	}
+	s->next = h2->streams;
+	h2->streams = s;
+
+	if (trans->buf) {
+		trans->rsp         = trans->buf->data;
+		trans->max_rsp_len = trans->buf->size - 1;
+	}
+	trans->rsp_len = 0;
+	http_parse_init(trans);
+
+	return 0;
+invalid:
+	logit(LOG_ERR, "Cannot send request to %s as HTTP/2, malformed or too many headers.",
+	      client->tcp.remote_host);
+	return RC_HTTPS_INVALID_REQUEST;
+}
+
+/**
+ * http2_step - Advance all streams of an HTTP/2 session
+ * @client: HTTP client, with requests from http2_submit()
+ *
+ * Sends what is queued, and reads responses, until the socket would
+ * block or all streams are closed.
+ *
+ * Returns:
+ * POSIX OK(0) when all streams are done, %RC_TCP_WANT_READ or
+ * %RC_TCP_WANT_WRITE when the socket is not ready, or an error,
+ * e.g. if any stream was closed without a complete response.
+ */
+int http2_step(http_t *client)
+{
+	struct http2 *h2 = client->h2;
+	char buf[4096];
+	ssize_t num;
+	int rc, len;
+
+	if (!h2)
+		return RC_HTTP_OBJECT_NOT_INITIALIZED;
+
+	while (1) {
+		if (!h2->out_len) {
+			num = nghttp2_session_mem_send(h2->session, &h2->out);
+			if (num < 0)
+				goto fail;
+			h2->out_len = num;
+		}
+
+		if (h2->out_len) {
+			len = 0;
+			rc  = ssl_send(client, (const char *)h2->out, h2->out_len, &len);
+			if (len > 0) {
+				h2->out     += len;
+				h2->out_len -= len;
+			}
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		if (h2->rc)
+			return h2->rc;
+		if (!h2->streams)
+			return 0;
+
+		/* E.g. GOAWAY from server with our streams still open */
+		if (!nghttp2_session_want_read(h2->session)) {
+			logit(LOG_WARNING, "HTTP/2 session with %s ended by server", client->tcp.remote_host);
+			return RC_TCP_RECV_ERROR;
+		}
+
+		len = 0;
+		rc  = ssl_recv(client, buf, sizeof(buf), &len);
+		if (rc)
+			return rc;
+		if (len == 0) {
+			logit(LOG_WARNING, "HTTP/2 connection closed by %s", client->tcp.remote_host);
+			return RC_TCP_RECV_ERROR;
+		}
+
+		/* Progress, restart timeout */
+		client->deadline = budget_clamp(event_msec() + client->tcp.timeout);
+		if (!client->ts_first)
+			client->ts_first = event_msec();
+
+		num = nghttp2_session_mem_recv(h2->session, (const uint8_t *)buf, len);
+		if (num < 0)
+			goto fail;
+	}
+
+fail:
+	logit(LOG_WARNING, "HTTP/2 error with %s: %s", client->tcp.remote_host, nghttp2_strerror((int)num));
+	return RC_HTTP_BAD_RESPONSE;
+}
+
+/* Can the session take more requests, e.g. no GOAWAY from the server */
+int http2_alive(http_t *client)
+{
+	struct http2 *h2 = client->h2;
+
+	return h2 && !h2->rc && nghttp2_session_want_read(h2->session);
+}
+
+/*
+ * Idle sessions receive frames at any time, e.g. SETTINGS, PING, or a
+ * GOAWAY before the server closes.  Process those before reuse, any
+ * replies go out with the next request.
+ */
+int http2_reusable(http_t *client)
+{
+	struct http2 *h2 = client->h2;
+	char buf[1024];
+	int rc, len;
+
+	if (!h2)
+		return 0;
+
+	while (1) {
+		len = 0;
+		rc  = ssl_recv(client, buf, sizeof(buf), &len);
+		if (HTTP_PENDING(rc))
+			break;
+		if (rc || len == 0)
+			return 0;
+		if (nghttp2_session_mem_recv(h2->session, (const uint8_t *)buf, len) < 0)
+			return 0;
+	}
+
+	return http2_alive(client);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,549 @@
+/* Incremental HTTP response parser
+ *
+ * Copyright (C) 2003-2004  Narcis Ilisei <inarcis2002@hotpop.com>
+ * Copyright (C) 2010-2021  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "log.h"
+#include "http.h"
+#include "error.h"
+
+#ifdef HAVE_ZLIB
+/*
+ * A gzip body is inflated as it arrives, into a buffer of its own, and
+ * replaces the compressed data in trans->rsp when the response is done.
+ * Like a response buffer from the pool it grows up to BUF_MAX_SIZE, the
+ * rest is dropped and the response marked truncated.
+ */
+struct http_gzip {
+	z_stream strm;
+	char    *out;
+	size_t   len;
+	size_t   size;
+	int      used;		/* Compressed bytes consumed */
+	int      end;		/* End of gzip stream seen */
+};
+#endif
+
+/* Does header @line, of @len bytes, start with field @name? */
+static const char *http_field(const char *line, size_t len, const char *name)
+{
+	size_t nlen = strlen(name);
+
+	if (len <= nlen || strncasecmp(line, name, nlen) || line[nlen] != ':')
+		return NULL;
+
+	line += nlen + 1;
+	while (*line == ' ' || *line == '\t')
+		line++;
+
+	return line;
+}
+
+/* Does header value at @val, up to end of line, contain @token? */
+static int http_token(const char *val, const char *token)
+{
+	size_t len = strlen(token);
+
+	if (!val)
+		return 0;
+
+	while (*val && *val != '\r' && *val != '\n') {
+		if (!strncasecmp(val, token, len))
+			return 1;
+		val++;
+	}
+
+	return 0;
+}
+
+/*
+ * Status line, e.g. "HTTP/1.1 200 OK".  Anything else is taken to be an
+ * old style reply without headers, e.g. from a simple checkip server.
+ */
+static int parse_status(http_trans_t *trans, const char *line, size_t len)
+{
+	char *ptr;
+
+	if (len < 12 || strncmp(line, "HTTP/1.", 7) || line[8] != ' ')
+		return 1;
+
+	trans->status = strtol(line + 9, &ptr, 10);
+	if (ptr != line + 12)
+		return 1;
+
+	/* HTTP/1.0 servers close, unless they say otherwise */
+	trans->close = line[7] == '0';
+
+	while (*ptr == ' ')
+		ptr++;
+	len -= ptr - line;
+	if (len >= sizeof(trans->status_desc))
+		len = sizeof(trans->status_desc) - 1;
+	memcpy(trans->status_desc, ptr, len);
+	trans->status_desc[len] = 0;
+
+	return 0;
+}
+
+/* Retry-After is either delta-seconds or an HTTP-date, RFC 9110 */
+static int retry_after(const char *val)
+{
+	struct tm tm;
+	time_t when;
+
+	if (*val >= '0' && *val <= '9')
+		return atoi(val);
+
+	memset(&tm, 0, sizeof(tm));
+	if (!strptime(val, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+		return 0;
+
+	when = timegm(&tm) - time(NULL);
+	if (when <= 0)
+		return 0;
+	if (when > INT32_MAX)
+		return INT32_MAX;
+
+	return (int)when;
+}
+
+static int parse_header(http_trans_t *trans, const char *line, size_t len)
+{
+	const char *val;
+
+	if ((val = http_field(line, len, "Content-Length"))) {
+		trans->content_len = atol(val);
+		if (trans->content_len < 0)
+			return RC_HTTP_BAD_RESPONSE;
+	} else if ((val = http_field(line, len, "Transfer-Encoding"))) {
+		trans->chunked = http_token(val, "chunked");
+	} else if ((val = http_field(line, len, "Connection"))) {
+		if (http_token(val, "close"))
+			trans->close = 1;
+		else if (http_token(val, "keep-alive"))
+			trans->close = 0;
+	} else if ((val = http_field(line, len, "Retry-After"))) {
+		trans->retry_after = retry_after(val);
+#ifdef HAVE_ZLIB
+	} else if ((val = http_field(line, len, "Content-Encoding"))) {
+		trans->gzip = http_token(val, "gzip");
+#endif
+	}
+
+	return 0;
+}
+
+/* End of headers, decide how to find the end of the body */
+static void parse_body(http_trans_t *trans)
+{
+	trans->body     = trans->pos;
+	trans->rsp_body = trans->rsp + trans->body;
+
+	/* Interim response, e.g. 100 Continue, the real one follows */
+	if (trans->status >= 100 && trans->status < 200) {
+		trans->rsp_len -= trans->pos;
+		memmove(trans->rsp, trans->rsp + trans->pos, trans->rsp_len + 1);
+		http_parse_init(trans);
+		return;
+	}
+
+	if (trans->status == 204 || trans->status == 304)
+		trans->parse = HTTP_PARSE_DONE;
+	else if (trans->chunked)
+		trans->parse = HTTP_PARSE_CHUNK_SIZE;
+	else
+		trans->parse = HTTP_PARSE_BODY;
+}
+
+/**
+ * http_parse_init - Prepare @trans for a new response
+ * @trans: HTTP transaction, with response buffer set
+ */
+void http_parse_init(http_trans_t *trans)
+{
+	trans->rsp_body       = trans->rsp;
+	trans->status         = 0;
+	trans->status_desc[0] = 0;
+	trans->parse          = HTTP_PARSE_STATUS;
+	trans->pos            = 0;
+	trans->body           = 0;
+	trans->body_len       = 0;
+	trans->content_len    = -1;
+	trans->chunk_len      = 0;
+	trans->chunked        = 0;
+	trans->close          = 0;
+	trans->retry_after    = 0;
+	trans->truncated      = 0;
+	trans->gzip           = 0;
+	trans->z              = NULL;
+
+	/* Bytes already read, e.g. after an interim response, are kept */
+	trans->rsp[trans->rsp_len] = 0;
+}
+
+/* Make room for more of the response, if trans->buf allows it */
+int http_grow(http_trans_t *trans)
+{
+	size_t body = trans->rsp_body - trans->rsp;
+
+	if (!trans->buf || buf_grow(trans->buf, trans->buf->size * 2))
+		return 0;
+
+	trans->rsp         = trans->buf->data;
+	trans->rsp_body    = trans->rsp + body;
+	trans->max_rsp_len = trans->buf->size - 1;
+
+	return 1;
+}
+
+#ifdef HAVE_ZLIB
+/* Inflate what has arrived of the body, when @done put it in place */
+static int gunzip(http_trans_t *trans, int done)
+{
+	struct http_gzip *z = trans->z;
+	unsigned char *in = (unsigned char *)trans->rsp + trans->body;
+	size_t len;
+	int rc;
+
+	if (!z) {
+		if (trans->body_len < 2) {
+			if (done)
+				trans->gzip = 0;
+			return 0;
+		}
+
+		/* No gzip magic, e.g. a replayed response, already decoded */
+		if (in[0] != 0x1f || in[1] != 0x8b) {
+			logit(LOG_DEBUG, "Body not gzip compressed, using it as is.");
+			trans->gzip = 0;
+			return 0;
+		}
+
+		z = calloc(1, sizeof(*z));
+		if (!z)
+			return RC_OUT_OF_MEMORY;
+		if (inflateInit2(&z->strm, 16 + MAX_WBITS) != Z_OK) {
+			free(z);
+			return RC_OUT_OF_MEMORY;
+		}
+		trans->z = z;
+	}
+
+	z->strm.next_in  = in + z->used;
+	z->strm.avail_in = trans->body_len - z->used;
+	while (z->strm.avail_in && !z->end) {
+		if (z->len == z->size) {
+			size_t size = z->size ? z->size * 2 : BUF_MIN_SIZE * 4;
+			char *out;
+
+			if (z->size >= BUF_MAX_SIZE) {
+				trans->truncated = 1;
+				break;
+			}
+			if (size > BUF_MAX_SIZE)
+				size = BUF_MAX_SIZE;
+
+			out = realloc(z->out, size);
+			if (!out)
+				return RC_OUT_OF_MEMORY;
+			z->out  = out;
+			z->size = size;
+		}
+
+		z->strm.next_out  = (unsigned char *)z->out + z->len;
+		z->strm.avail_out = z->size - z->len;
+		rc = inflate(&z->strm, Z_NO_FLUSH);
+		z->len = z->size - z->strm.avail_out;
+		if (rc == Z_STREAM_END)
+			z->end = 1;
+		else if (rc == Z_BUF_ERROR)
+			break;
+		else if (rc != Z_OK) {
+			logit(LOG_WARNING, "Failed decompressing response: %s",
+			      z->strm.msg ? z->strm.msg : "corrupt data");
+			return RC_HTTP_BAD_RESPONSE;
+		}
+	}
+	z->used = trans->body_len - z->strm.avail_in;
+
+	if (!done)
+		return 0;
+
+	if (!z->end && !trans->truncated)
+		logit(LOG_DEBUG, "Incomplete gzip stream, %zu bytes decoded", z->len);
+	logit(LOG_DEBUG, "Decompressed %d bytes of body to %zu", trans->body_len, z->len);
+
+	while (trans->body + z->len > (size_t)trans->max_rsp_len && http_grow(trans))
+		;
+
+	len = z->len;
+	if (trans->body + len > (size_t)trans->max_rsp_len) {
+		len = trans->max_rsp_len - trans->body;
+		trans->truncated = 1;
+	}
+	if (trans->truncated)
+		logit(LOG_WARNING, "Decompressed response does not fit, truncated.");
+
+	memcpy(trans->rsp + trans->body, z->out, len);
+	trans->body_len = len;
+	trans->rsp_len  = trans->body + trans->body_len;
+	trans->rsp[trans->rsp_len] = 0;
+	http_parse_free(trans);
+
+	return 0;
+}
+#else
+static int gunzip(http_trans_t *trans, int done)
+{
+	return 0;
+}
+#endif
+
+/**
+ * http_parse_free - Release decoder state of an unfinished response
+ * @trans: HTTP transaction
+ *
+ * Done by http_parse() when it returns anything but %RC_TCP_WANT_READ,
+ * so only needed when a transaction is abandoned half way.
+ */
+void http_parse_free(http_trans_t *trans)
+{
+#ifdef HAVE_ZLIB
+	struct http_gzip *z = trans->z;
+
+	if (!z)
+		return;
+
+	inflateEnd(&z->strm);
+	free(z->out);
+	free(z);
+	trans->z = NULL;
+#endif
+}
+
+static int parse(http_trans_t *trans, int eof)
+{
+	int rc;
+
+	while (trans->parse != HTTP_PARSE_DONE) {
+		char *end = trans->rsp + trans->rsp_len;
+		char *ptr = trans->rsp + trans->pos;
+		char *eol = NULL;
+		size_t len = 0;
+
+		/* All but the body are line based, wait for a full line */
+		if (trans->parse != HTTP_PARSE_BODY && trans->parse != HTTP_PARSE_CHUNK_DATA) {
+			eol = memchr(ptr, '\n', end - ptr);
+			if (!eol)
+				break;
+
+			len = eol - ptr;
+			if (len > 0 && ptr[len - 1] == '\r')
+				len--;
+			trans->pos = eol + 1 - trans->rsp;
+		}
+
+		switch (trans->parse) {
+		case HTTP_PARSE_STATUS:
+			if (parse_status(trans, ptr, len)) {
+				trans->pos   = 0;
+				trans->close = 1;
+				trans->parse = HTTP_PARSE_BODY;
+				break;
+			}
+			trans->parse = HTTP_PARSE_HEADERS;
+			break;
+
+		case HTTP_PARSE_HEADERS:
+			if (len == 0) {
+				parse_body(trans);
+				break;
+			}
+
+			rc = parse_header(trans, ptr, len);
+			if (rc)
+				return rc;
+			break;
+
+		case HTTP_PARSE_BODY:
+			trans->body_len = trans->rsp_len - trans->body;
+			trans->pos      = trans->rsp_len;
+			if (trans->content_len >= 0 && trans->body_len >= trans->content_len) {
+				trans->body_len = trans->content_len;
+				trans->pos      = trans->body + trans->body_len;
+				trans->parse    = HTTP_PARSE_DONE;
+				break;
+			}
+			goto out;
+
+		case HTTP_PARSE_CHUNK_SIZE:
+			trans->chunk_len = strtol(ptr, &eol, 16);
+			if (eol == ptr || trans->chunk_len < 0)
+				return RC_HTTP_BAD_RESPONSE;
+
+			trans->parse = trans->chunk_len ? HTTP_PARSE_CHUNK_DATA : HTTP_PARSE_TRAILER;
+			break;
+
+		case HTTP_PARSE_CHUNK_DATA:
+			len = end - ptr;
+			if ((long)len > trans->chunk_len)
+				len = trans->chunk_len;
+
+			memmove(trans->rsp + trans->body + trans->body_len, ptr, len);
+			trans->body_len  += len;
+			trans->pos       += len;
+			trans->chunk_len -= len;
+			if (trans->chunk_len)
+				goto out;
+
+			trans->parse = HTTP_PARSE_CHUNK_END;
+			break;
+
+		case HTTP_PARSE_CHUNK_END:
+			if (len)
+				return RC_HTTP_BAD_RESPONSE;
+			trans->parse = HTTP_PARSE_CHUNK_SIZE;
+			break;
+
+		case HTTP_PARSE_TRAILER:
+			if (len == 0)
+				trans->parse = HTTP_PARSE_DONE;
+			break;
+
+		default:
+			return RC_HTTP_BAD_RESPONSE;
+		}
+	}
+out:
+	/* Drop consumed chunk headers to make room for more data */
+	if (trans->chunked && trans->parse > HTTP_PARSE_BODY) {
+		int out = trans->body + trans->body_len;
+
+		if (out < trans->pos) {
+			memmove(trans->rsp + out, trans->rsp + trans->pos, trans->rsp_len - trans->pos);
+			trans->rsp_len -= trans->pos - out;
+			trans->pos      = out;
+		}
+	}
+
+	if (trans->parse != HTTP_PARSE_DONE) {
+		if (!eof) {
+			if (trans->gzip && trans->parse >= HTTP_PARSE_BODY) {
+				rc = gunzip(trans, 0);
+				if (rc)
+					return rc;
+			}
+			trans->rsp[trans->rsp_len] = 0;
+			return RC_TCP_WANT_READ;
+		}
+
+		/* Server closed, take what we got, headers or not */
+		if (trans->parse < HTTP_PARSE_BODY) {
+			trans->gzip     = 0;
+			trans->body     = 0;
+			trans->body_len = trans->rsp_len;
+			trans->rsp_body = trans->rsp;
+		} else if (trans->content_len >= 0 || trans->chunked) {
+			logit(LOG_DEBUG, "Incomplete response, %d bytes of body", trans->body_len);
+		}
+
+		trans->close = 1;
+		trans->parse = HTTP_PARSE_DONE;
+	} else if (trans->pos < trans->rsp_len) {
+		/* Junk after the response, cannot trust the connection */
+		trans->close = 1;
+	}
+
+	trans->rsp_len = trans->body + trans->body_len;
+	trans->rsp[trans->rsp_len] = 0;
+
+	if (trans->gzip)
+		return gunzip(trans, 1);
+
+	return 0;
+}
+
+/**
+ * http_parse - Incremental HTTP response parser
+ * @trans: HTTP transaction, with trans->rsp_len bytes in trans->rsp
+ * @eof:   No more data will arrive, server closed or timed out
+ *
+ * Call every time more data has been appended to trans->rsp.  Parsing
+ * continues from where the previous call stopped, tracking the status
+ * line, the headers that frame the response, and the body.  Chunked
+ * bodies are decoded in place as they arrive, so chunk headers do not
+ * take up space in the buffer.  A gzip Content-Encoding, only sent by
+ * servers when the request has %HTTP_ACCEPT_GZIP, is inflated as the
+ * body arrives, bounded by %BUF_MAX_SIZE.
+ *
+ * When done, trans->rsp holds the headers and the (decoded) body, and
+ * trans->rsp_body points to the latter.  If trans->close is set the
+ * connection cannot be used for another request.
+ *
+ * Returns:
+ * POSIX OK(0) when the response is complete, %RC_TCP_WANT_READ if more
+ * data is needed, or %RC_HTTP_BAD_RESPONSE on framing, or decompression,
+ * errors.
+ */
+int http_parse(http_trans_t *trans, int eof)
+{
+	int rc;
+
+	rc = parse(trans, eof);
+	if (rc != RC_TCP_WANT_READ)
+		http_parse_free(trans);
+
+	return rc;
+}
+
+int http_status_valid(int status)
+{
+	if (status == 200)
+		return 0;
+
+	if (status == 401 || status == 403)
+		return RC_DDNS_RSP_AUTH_FAIL;
+
+	/* Rate limited, usually with a Retry-After */
+	if (status == 429)
+		return RC_DDNS_RSP_TOO_FREQUENT;
+
+	if (status >= 500 && status < 600)
+		return RC_DDNS_RSP_RETRY_LATER;
+
+	return RC_DDNS_RSP_NOTOK;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
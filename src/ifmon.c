@@ -0,0 +1,631 @@
+/* Kernel interface address monitor, rtnetlink on Linux, PF_ROUTE on BSD
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * When inadyn reads its address from a local interface, there is no
+ * need to call getifaddrs() every period.  Instead we subscribe to the
+ * kernel's address change notifications and trigger a check as soon
+ * as the interface gains or loses a global address.  Every relevant
+ * change bumps a generation counter, which get_address_iface() uses
+ * to decide if its previous result is still valid.
+ *
+ * If the monitor socket cannot be opened, or the platform lacks one,
+ * ifmon_active() returns false and inadyn falls back to polling.
+ *
+ * The addresses of all interfaces are read with one getifaddrs() into
+ * a cache of binary addresses, shared by all providers, and kept until
+ * the generation changes.  When polling, every cycle is a generation.
+ *
+ * With IPv6 privacy extensions the kernel adds a new temporary address
+ * every few hours, and the old ones are deprecated before they expire.
+ * Picking the first address would then send needless updates, so by
+ * default temporary, deprecated, and not yet usable, addresses are
+ * skipped, and static, then EUI-64 and stable privacy, addresses are
+ * preferred.  The flags are not in getifaddrs(), on Linux they are read
+ * from /proc/net/if_inet6, elsewhere all addresses count as stable.
+ * Only if there is nothing else is a temporary address used.  Optional
+ * ipv6-prefix and ipv6-suffix settings narrow the choice down further.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "address.h"
+#include "ddns.h"
+#include "event.h"
+#include "ifmon.h"
+
+#if defined(HAVE_LINUX_RTNETLINK_H)
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#elif defined(HAVE_NET_ROUTE_H)
+#include <net/route.h>
+#endif
+
+/* IPv6 address flags, where known */
+#define ADDR_TEMPORARY	0x01	/* Privacy extensions, RFC 8981 */
+#define ADDR_DEPRECATED	0x02	/* Preferred lifetime expired */
+#define ADDR_UNUSABLE	0x04	/* Tentative, or duplicate */
+#define ADDR_PERMANENT	0x08	/* Set by the administrator */
+
+struct ifmon_addr {
+	char ifname[IF_NAMESIZE];
+	unsigned int flags;
+	union {
+		struct sockaddr     sa;
+		struct sockaddr_in  sin;
+		struct sockaddr_in6 sin6;
+	};
+};
+
+/* Snapshot of all interface addresses, one allocation */
+struct ifaddrs_cache {
+	unsigned int      generation;
+	size_t            num;
+	struct ifmon_addr addr[];
+};
+
+int ipv6_policy = IFMON_POLICY_STABLE;
+
+static int          sd = -1;
+static unsigned int generation = 1;
+static struct ifaddrs_cache *cache;
+
+static struct in6_addr prefix;		/* ipv6-prefix */
+static int             prefix_len = -1;
+static struct in6_addr suffix;		/* ipv6-suffix, interface identifier */
+static int             has_suffix;
+
+extern ddns_info_t *conf_info_iterator(int first);
+
+/* Is @index the global iface, or the iface of any provider? */
+static int is_watched(unsigned int index)
+{
+	char ifname[IF_NAMESIZE];
+	ddns_info_t *info;
+
+	if (!if_indextoname(index, ifname))
+		return 0;
+
+	if (iface && !strcmp(iface, ifname))
+		return 1;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->ifname && !strcmp(info->ifname, ifname))
+			return 1;
+		info = conf_info_iterator(0);
+	}
+
+	return 0;
+}
+
+#if defined(HAVE_LINUX_RTNETLINK_H)
+static int open_socket(void)
+{
+	struct sockaddr_nl sa;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.nl_family = AF_NETLINK;
+	sa.nl_groups = RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Only changes to global addresses are interesting, skip link-local etc. */
+static int is_relevant(char *buf, ssize_t len)
+{
+	struct nlmsghdr *nh;
+
+	for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+		struct ifaddrmsg *ifa;
+
+		if (nh->nlmsg_type != RTM_NEWADDR && nh->nlmsg_type != RTM_DELADDR)
+			continue;
+
+		ifa = NLMSG_DATA(nh);
+		if (ifa->ifa_scope != RT_SCOPE_UNIVERSE)
+			continue;
+		if (ifa->ifa_family == AF_INET6 && !allow_ipv6)
+			continue;
+
+		if (is_watched(ifa->ifa_index))
+			return 1;
+	}
+
+	return 0;
+}
+#elif defined(HAVE_NET_ROUTE_H)
+static int open_socket(void)
+{
+	return socket(PF_ROUTE, SOCK_RAW, 0);
+}
+
+/*
+ * The routing socket does not tell the scope of the address without
+ * walking the trailing sockaddrs, the layout of which differs between
+ * the BSDs.  Any address change on a watched interface is good enough,
+ * get_address_iface() filters out link-local addresses anyway.
+ */
+static int is_relevant(char *buf, ssize_t len)
+{
+	struct ifa_msghdr *ifam;
+	char *ptr;
+
+	for (ptr = buf; ptr + sizeof(*ifam) <= buf + len; ptr += ifam->ifam_msglen) {
+		ifam = (struct ifa_msghdr *)ptr;
+		if (ifam->ifam_msglen == 0)
+			break;
+
+		if (ifam->ifam_type != RTM_NEWADDR && ifam->ifam_type != RTM_DELADDR)
+			continue;
+
+		if (is_watched(ifam->ifam_index))
+			return 1;
+	}
+
+	return 0;
+}
+#else
+static int open_socket(void)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int is_relevant(char *buf, ssize_t len)
+{
+	return 0;
+}
+#endif
+
+static void ifmon_cb(int fd, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	char buf[8192];
+	int changed = 0;
+
+	while (1) {
+		ssize_t len;
+
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* Lost messages, cannot tell what changed so check anyway */
+			if (errno == ENOBUFS)
+				changed = 1;
+			break;
+		}
+		if (len == 0)
+			break;
+
+		if (is_relevant(buf, len))
+			changed = 1;
+	}
+
+	if (!changed)
+		return;
+
+	generation++;
+	logit(LOG_DEBUG, "Interface address changed, generation %u", generation);
+	ddns_cmd(ctx, CMD_CHECK_NOW);
+}
+
+/**
+ * ifmon_init - Start monitoring interface addresses
+ * @ctx: Context, ctx->cmd is set to %CMD_CHECK_NOW on change
+ *
+ * Only opens the monitor if the global iface, or any provider iface,
+ * is set.  Failing to open it is not fatal, we just keep polling.
+ *
+ * Returns:
+ * Always POSIX OK(0).
+ */
+int ifmon_init(ddns_t *ctx)
+{
+	ddns_info_t *info;
+	int watch = 0;
+
+	if (sd != -1)
+		return 0;
+
+	if (iface && iface[0])
+		watch = 1;
+
+	info = conf_info_iterator(1);
+	while (info) {
+		if (info->ifname && info->ifname[0])
+			watch = 1;
+		info = conf_info_iterator(0);
+	}
+
+	if (!watch)
+		return 0;
+
+	sd = open_socket();
+	if (sd < 0) {
+		logit(LOG_INFO, "Cannot monitor interface address changes, polling instead: %s",
+		      strerror(errno));
+		return 0;
+	}
+
+	fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if (event_add(sd, ifmon_cb, ctx)) {
+		close(sd);
+		sd = -1;
+		return 0;
+	}
+
+	/* Anything cached from before we started listening is stale */
+	generation++;
+	logit(LOG_DEBUG, "Monitoring interface address changes.");
+
+	return 0;
+}
+
+void ifmon_exit(void)
+{
+	free(cache);
+	cache = NULL;
+
+	if (sd == -1)
+		return;
+
+	event_del(sd);
+	close(sd);
+	sd = -1;
+}
+
+/* Without the monitor nothing tells us about changes, read again every cycle */
+void ifmon_cycle(void)
+{
+	if (sd == -1)
+		generation++;
+}
+
+#if defined(HAVE_LINUX_RTNETLINK_H)
+/* getifaddrs() does not tell the flags of IPv6 addresses, the kernel does here */
+static void read_flags(struct ifaddrs_cache *c)
+{
+	char line[128], hex[33], ifname[IF_NAMESIZE];
+	unsigned int index, plen, scope, flags;
+	FILE *fp;
+
+	fp = fopen("/proc/net/if_inet6", "r");
+	if (!fp)
+		return;
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct in6_addr in6;
+		size_t i;
+
+		if (sscanf(line, "%32s %x %x %x %x %15s", hex, &index, &plen, &scope, &flags, ifname) != 6)
+			continue;
+		for (i = 0; i < sizeof(in6.s6_addr); i++) {
+			if (sscanf(&hex[i * 2], "%2hhx", &in6.s6_addr[i]) != 1)
+				break;
+		}
+		if (i != sizeof(in6.s6_addr))
+			continue;
+
+		for (i = 0; i < c->num; i++) {
+			struct ifmon_addr *a = &c->addr[i];
+
+			if (a->sa.sa_family != AF_INET6 || strcmp(a->ifname, ifname))
+				continue;
+			if (memcmp(&a->sin6.sin6_addr, &in6, sizeof(in6)))
+				continue;
+
+			if (flags & IFA_F_TEMPORARY)
+				a->flags |= ADDR_TEMPORARY;
+			if (flags & IFA_F_DEPRECATED)
+				a->flags |= ADDR_DEPRECATED;
+			if (flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED))
+				a->flags |= ADDR_UNUSABLE;
+			if (flags & IFA_F_PERMANENT)
+				a->flags |= ADDR_PERMANENT;
+		}
+	}
+	fclose(fp);
+}
+#else
+static void read_flags(struct ifaddrs_cache *c)
+{
+}
+#endif
+
+/* Read all IPv4 and IPv6 addresses, once per generation */
+static int refresh(void)
+{
+	struct ifaddrs *ifaddr, *ifa;
+	struct ifaddrs_cache *c;
+	size_t num = 0;
+
+	if (cache && cache->generation == generation)
+		return 0;
+
+	if (getifaddrs(&ifaddr))
+		return -1;
+
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (ifa->ifa_addr && (ifa->ifa_addr->sa_family == AF_INET || ifa->ifa_addr->sa_family == AF_INET6))
+			num++;
+	}
+
+	c = malloc(sizeof(*c) + num * sizeof(c->addr[0]));
+	if (!c) {
+		freeifaddrs(ifaddr);
+		return -1;
+	}
+
+	c->generation = generation;
+	c->num        = 0;
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		struct ifmon_addr *a = &c->addr[c->num];
+
+		if (!ifa->ifa_addr)
+			continue;
+
+		switch (ifa->ifa_addr->sa_family) {
+		case AF_INET:
+			memcpy(&a->sin, ifa->ifa_addr, sizeof(a->sin));
+			break;
+		case AF_INET6:
+			memcpy(&a->sin6, ifa->ifa_addr, sizeof(a->sin6));
+			break;
+		default:
+			continue;
+		}
+
+		strlcpy(a->ifname, ifa->ifa_name, sizeof(a->ifname));
+		a->flags = 0;
+		c->num++;
+	}
+	freeifaddrs(ifaddr);
+	read_flags(c);
+
+	free(cache);
+	cache = c;
+
+	return 0;
+}
+
+static int match(const struct in6_addr *in6)
+{
+	int bytes = prefix_len / 8, bits = prefix_len % 8;
+
+	if (prefix_len > 0) {
+		if (memcmp(in6->s6_addr, prefix.s6_addr, bytes))
+			return 0;
+		if (bits && (in6->s6_addr[bytes] ^ prefix.s6_addr[bytes]) & (0xff << (8 - bits)))
+			return 0;
+	}
+
+	if (has_suffix && memcmp(&in6->s6_addr[8], &suffix.s6_addr[8], 8))
+		return 0;
+
+	return 1;
+}
+
+/* How good a choice @a is, higher is better, zero for not at all */
+static int rank(struct ifmon_addr *a)
+{
+	const struct in6_addr *in6 = &a->sin6.sin6_addr;
+
+	if (a->sa.sa_family != AF_INET6)
+		return 1;
+	if (!match(in6))
+		return 0;
+	if (ipv6_policy == IFMON_POLICY_FIRST)
+		return 1;
+
+	if (a->flags & (ADDR_DEPRECATED | ADDR_UNUSABLE))
+		return 0;
+	if (a->flags & ADDR_TEMPORARY)
+		return 1;
+	if (a->flags & ADDR_PERMANENT)
+		return 4;
+	if (in6->s6_addr[11] == 0xff && in6->s6_addr[12] == 0xfe)
+		return 3;	/* EUI-64 */
+
+	return 2;
+}
+
+/*
+ * Best valid address of @family on @ifname, see rank().  Of equally
+ * good addresses the lowest is used, not the first, the order of the
+ * addresses changes when they come and go.
+ */
+static int find_address(const char *ifname, int family, char *address, size_t len)
+{
+	struct ifmon_addr *best = NULL;
+	int best_rank = 0;
+	size_t i;
+
+	for (i = 0; i < cache->num; i++) {
+		struct ifmon_addr *a = &cache->addr[i];
+		char buf[INET6_ADDRSTRLEN];
+		const void *addr;
+		int r;
+
+		if (a->sa.sa_family != family || strcmp(a->ifname, ifname))
+			continue;
+
+		if (family == AF_INET)
+			addr = &a->sin.sin_addr;
+		else
+			addr = &a->sin6.sin6_addr;
+
+		if (!inet_ntop(family, addr, buf, sizeof(buf)))
+			continue;
+
+		if (!is_address_valid(family, buf)) {
+			logit(LOG_INFO, "Invalid/local address %s for %s, skipping ...", buf, ifname);
+			continue;
+		}
+
+		r = rank(a);
+		if (!r) {
+			logit(LOG_DEBUG, "Address %s for %s not eligible, skipping ...", buf, ifname);
+			continue;
+		}
+
+		/* IPv4, and the first policy, use the first one */
+		if (family == AF_INET || ipv6_policy == IFMON_POLICY_FIRST) {
+			best      = a;
+			best_rank = r;
+			break;
+		}
+
+		if (r < best_rank)
+			continue;
+		if (r == best_rank && memcmp(addr, &best->sin6.sin6_addr, sizeof(struct in6_addr)) >= 0)
+			continue;
+
+		best      = a;
+		best_rank = r;
+	}
+
+	if (!best)
+		return 1;
+
+	if (!inet_ntop(family, family == AF_INET ? (void *)&best->sin.sin_addr : (void *)&best->sin6.sin6_addr,
+		       address, len))
+		return 1;
+	if (ipv6_policy == IFMON_POLICY_STABLE && (best->flags & ADDR_TEMPORARY))
+		logit(LOG_DEBUG, "Only temporary IPv6 addresses on %s, using %s", ifname, address);
+
+	return 0;
+}
+
+/**
+ * ifmon_match - Set ipv6-prefix and ipv6-suffix
+ * @pfx: Prefix, e.g. 2001:db8::/32, or NULL
+ * @sfx: Interface identifier, e.g. ::1:2:3:4, or NULL
+ *
+ * Only IPv6 addresses of an interface in @pfx, ending in the last 64
+ * bits of @sfx, are used.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if either one is invalid.
+ */
+int ifmon_match(const char *pfx, const char *sfx)
+{
+	char buf[INET6_ADDRSTRLEN + 4], *ptr;
+
+	prefix_len = -1;
+	has_suffix = 0;
+
+	if (pfx) {
+		strlcpy(buf, pfx, sizeof(buf));
+		prefix_len = 128;
+		ptr = strchr(buf, '/');
+		if (ptr) {
+			*ptr++ = 0;
+			prefix_len = atoi(ptr);
+		}
+		if (inet_pton(AF_INET6, buf, &prefix) != 1 || prefix_len < 0 || prefix_len > 128) {
+			logit(LOG_ERR, "Invalid ipv6-prefix %s", pfx);
+			prefix_len = -1;
+			return 1;
+		}
+	}
+
+	if (sfx) {
+		if (inet_pton(AF_INET6, sfx, &suffix) != 1) {
+			logit(LOG_ERR, "Invalid ipv6-suffix %s", sfx);
+			return 1;
+		}
+		has_suffix = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * ifmon_address - Address of an interface
+ * @ifname:  Interface name
+ * @family:  AF_INET, AF_INET6, or AF_UNSPEC for any
+ * @address: Buffer for the address, as a string
+ * @len:     Size of @address
+ *
+ * Looks up the first valid global address of @ifname in the cache.
+ * With AF_UNSPEC IPv6 is preferred, the same as parse_my_address()
+ * does.  The cache is read again only when the generation has changed.
+ *
+ * Returns:
+ * POSIX OK(0), 1 if @ifname has no valid address, or -1 with errno
+ * set if the interface addresses cannot be read.
+ */
+int ifmon_address(const char *ifname, int family, char *address, size_t len)
+{
+	if (refresh())
+		return -1;
+
+	if (family != AF_UNSPEC)
+		return find_address(ifname, family, address, len);
+
+	if (!find_address(ifname, AF_INET6, address, len))
+		return 0;
+
+	return find_address(ifname, AF_INET, address, len);
+}
+
+/* Is the monitor running, i.e., can callers trust ifmon_generation()? */
+int ifmon_active(void)
+{
+	return sd != -1;
+}
+
+/* Bumped on every relevant address change */
+unsigned int ifmon_generation(void)
+{
+	return generation;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
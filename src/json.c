@@ -19,38 +19,272 @@
  * Boston, MA  02110-1301, USA.
  */
 
+/*
+ * jsmn can resume where it left off when it runs out of tokens, so the
+ * document is parsed only once: start with the arena embedded in the
+ * json_t and double it on JSMN_ERROR_NOMEM.  Lookups walk the token
+ * array using the child counts jsmn records, see json_skip().
+ */
+
+#include <stdlib.h>
 #include <string.h>
 
 #include "log.h"
 #include "json.h"
+#include "resource.h"
 
-int parse_json(const char *json, jsmntok_t *out_tokens[])
+MEM_TAG("json");
+
+/**
+ * json_parse - Parse JSON document, in one pass
+ * @js:   Document to fill in, need not be initialized
+ * @json: JSON text, must outlive @js
+ * @len:  Length of @json
+ *
+ * Returns:
+ * Number of tokens, or -1 on error.  Call json_free() in both cases.
+ */
+int json_parse(json_t *js, const char *json, size_t len)
 {
-	int num_tokens;
+	return json_parse_in(js, NULL, json, len);
+}
 
+/**
+ * json_parse_in - Parse JSON document, tokens from an arena
+ * @js:    Document to fill in, need not be initialized
+ * @arena: Where to grow the tokens, if needed, e.g. ctx->arena
+ * @json:  JSON text, must outlive @js
+ * @len:   Length of @json
+ *
+ * Like json_parse(), but documents too large for the embedded tokens
+ * use @arena instead of the heap, so @js must not outlive the cycle.
+ *
+ * Returns:
+ * Same as json_parse()
+ */
+int json_parse_in(json_t *js, arena_t *arena, const char *json, size_t len)
+{
 	jsmn_parser parser;
+	int rc;
+
+	js->json   = json;
+	js->tokens = js->local;
+	js->size   = JSON_LOCAL_TOKENS;
+	js->num    = 0;
+	js->arena  = arena;
+
 	jsmn_init(&parser);
-	num_tokens = jsmn_parse(&parser, json, strlen(json), NULL, 0);
+	while ((rc = jsmn_parse(&parser, json, len, js->tokens, js->size)) == JSMN_ERROR_NOMEM) {
+		jsmntok_t *tokens;
+		int size = js->size * 2;
 
-	if (num_tokens < 0) {
+		if (arena)
+			tokens = arena_realloc(arena, js->tokens == js->local ? NULL : js->tokens,
+					       js->size * sizeof(jsmntok_t), size * sizeof(jsmntok_t));
+		else if (js->tokens == js->local)
+			tokens = mem_malloc(size * sizeof(jsmntok_t));
+		else
+			tokens = mem_realloc(js->tokens, size * sizeof(jsmntok_t));
+
+		if (!tokens) {
+			logit(LOG_ERR, "Couldn't allocate memory to parse JSON.");
+			return -1;
+		}
+		if (js->tokens == js->local)
+			memcpy(tokens, js->local, sizeof(js->local));
+
+		js->tokens = tokens;
+		js->size   = size;
+	}
+
+	if (rc < 0) {
 		logit(LOG_ERR, "Failed to parse JSON.");
 		return -1;
 	}
 
-	if (num_tokens == 0) {
+	if (rc == 0) {
 		logit(LOG_WARNING, "No JSON found in string.");
 		return -1;
 	}
 
-	*out_tokens = malloc(num_tokens * sizeof(jsmntok_t));
+	js->num = rc;
+
+	return rc;
+}
+
+void json_free(json_t *js)
+{
+	if (js->tokens && js->tokens != js->local && !js->arena)
+		mem_free(js->tokens);
+	js->tokens = NULL;
+	js->num    = 0;
+}
+
+/* Index of the token after @tok and all its children, i.e. its next sibling */
+int json_skip(const json_t *js, int tok)
+{
+	int pending = 1;
+
+	while (pending > 0 && tok < js->num) {
+		/* Objects count keys, keys count their value, arrays elements */
+		pending += js->tokens[tok].size - 1;
+		tok++;
+	}
+
+	return tok;
+}
+
+/**
+ * json_find - Look up value by path
+ * @js:   Parsed document
+ * @tok:  Token to start from, zero for the document root
+ * @path: E.g., "result[0].id", "success", or "" for @tok itself
+ *
+ * Returns:
+ * Token index of the value, or -1 if not found.
+ */
+int json_find(const json_t *js, int tok, const char *path)
+{
+	if (tok < 0 || tok >= js->num)
+		return -1;
+
+	while (*path) {
+		const jsmntok_t *t = &js->tokens[tok];
+
+		if (*path == '.') {
+			path++;
+			continue;
+		}
+
+		if (*path == '[') {
+			char *end;
+			long i, idx;
+
+			idx = strtol(path + 1, &end, 10);
+			if (*end != ']' || idx < 0 || t->type != JSMN_ARRAY || idx >= t->size)
+				return -1;
+			path = end + 1;
+
+			for (tok++, i = 0; i < idx; i++)
+				tok = json_skip(js, tok);
+		} else {
+			size_t len = strcspn(path, ".[");
+			int i, num;
+
+			if (t->type != JSMN_OBJECT)
+				return -1;
+
+			num = t->size;
+			for (tok++, i = 0; i < num && tok < js->num; i++) {
+				const jsmntok_t *key = &js->tokens[tok];
+
+				if (key->end - key->start == (int)len &&
+				    !strncmp(js->json + key->start, path, len))
+					break;
+				tok = json_skip(js, tok + 1);
+			}
+			if (i == num)
+				return -1;
+
+			tok++;	/* the value */
+			path += len;
+		}
+
+		if (tok >= js->num)
+			return -1;
+	}
+
+	return tok;
+}
+
+/* Copy string value at @path, returns -1 if not a string, -2 if too long */
+int json_get_str(const json_t *js, int tok, const char *path, char *buf, size_t len)
+{
+	const jsmntok_t *t;
+	size_t n;
+
+	tok = json_find(js, tok, path);
+	if (tok < 0)
+		return -1;
+
+	t = &js->tokens[tok];
+	if (t->type != JSMN_STRING)
+		return -1;
+
+	n = t->end - t->start;
+	if (n >= len)
+		return -2;
+
+	memcpy(buf, js->json + t->start, n);
+	buf[n] = 0;
+
+	return 0;
+}
+
+/* Integer value at @path, a number or a numeric string */
+int json_get_int(const json_t *js, int tok, const char *path, long *out_value)
+{
+	char buf[24], *end;
+
+	tok = json_find(js, tok, path);
+	if (tok < 0)
+		return -1;
+
+	if (js->tokens[tok].type != JSMN_PRIMITIVE && js->tokens[tok].type != JSMN_STRING)
+		return -1;
+	if (js->tokens[tok].end - js->tokens[tok].start >= (int)sizeof(buf))
+		return -1;
+
+	memcpy(buf, js->json + js->tokens[tok].start, js->tokens[tok].end - js->tokens[tok].start);
+	buf[js->tokens[tok].end - js->tokens[tok].start] = 0;
+
+	*out_value = strtol(buf, &end, 10);
+	if (end == buf || *end)
+		return -1;
 
+	return 0;
+}
+
+int json_get_bool(const json_t *js, int tok, const char *path, int *out_value)
+{
+	tok = json_find(js, tok, path);
+	if (tok < 0)
+		return -1;
+
+	return json_bool(js->json, &js->tokens[tok], out_value);
+}
+
+/* Is the string at @path equal to @s? */
+int json_str_eq(const json_t *js, int tok, const char *path, const char *s)
+{
+	tok = json_find(js, tok, path);
+	if (tok < 0)
+		return 0;
+
+	return jsoneq(js->json, &js->tokens[tok], s) == 0;
+}
+
+/* Compat, a copy of the tokens for the caller to free() */
+int parse_json(const char *json, jsmntok_t *out_tokens[])
+{
+	json_t js;
+	int num_tokens;
+
+	num_tokens = json_parse(&js, json, strlen(json));
+	if (num_tokens < 0) {
+		json_free(&js);
+		return -1;
+	}
+
+	/* Always a copy, callers free() it, and may be outside MEM_TAG() */
+	*out_tokens = malloc(num_tokens * sizeof(jsmntok_t));
 	if (!(*out_tokens)) {
 		logit(LOG_ERR, "Couldn't allocate memory to parse JSON.");
+		json_free(&js);
 		return -1;
 	}
-
-	jsmn_init(&parser);
-	jsmn_parse(&parser, json, strlen(json), *out_tokens, num_tokens);
+	memcpy(*out_tokens, js.tokens, num_tokens * sizeof(jsmntok_t));
+	json_free(&js);
 
 	return num_tokens;
 }
@@ -19,16 +19,60 @@
  * Boston, MA  02110-1301, USA.
  */
 
+/*
+ * logit() checks the level before anything is formatted, so debug
+ * messages cost a compare unless enabled.  While the main loop runs,
+ * messages are formatted into a ring buffer instead of being written
+ * right away, by whichever thread logs them, and written to syslog or
+ * stderr by the main thread when it is about to wait for events.  So
+ * a backed up syslog daemon cannot stall an update in progress.  When
+ * the ring is full messages are dropped, and the number dropped logged
+ * when there is room again.  At debug level messages are written right
+ * away, in full, since that is what debugging needs.
+ *
+ * Producers claim a slot with compare-and-swap on the head, and mark
+ * it filled by setting its sequence number, so several update workers
+ * can log at the same time without a lock.  Only the main thread, the
+ * one calling log_async(), empties the ring.
+ *
+ * With the JSON log format every message is one JSON object, with the
+ * fields of log_event() as keys, for log pipelines to ingest as is.
+ */
+
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #define SYSLOG_NAMES		/* Expose syslog.h:prioritynames[] */
 #include <syslog.h>
 
 #include "compat.h"
+#include "error.h"
+#include "log.h"
 
-static int level   = LOG_NOTICE;
+int log_upto = LOG_NOTICE;
 static int enabled = 0;
+static int json    = 0;
+
+static const char *levels[] = {
+	"emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+struct slot {
+	unsigned long seq;	/* Position + 1 when filled, see enqueue() */
+	int           prio;
+	char          msg[LOG_MSG_LEN];
+};
+
+static struct slot     ring[LOG_RING_SIZE];
+static unsigned long   head;		/* Next slot to claim */
+static unsigned long   tail;		/* Next slot to write out */
+static unsigned long   dropped;
+static int             async;
+static pthread_t       owner;
+static pthread_mutex_t limit_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void log_init(char *ident, int log, int bg)
 {
@@ -40,12 +84,13 @@ void log_init(char *ident, int log, int bg)
 #endif
 
 	openlog(ident, log_opts, LOG_USER);
-	setlogmask(LOG_UPTO(level));
+	setlogmask(LOG_UPTO(log_upto));
 	enabled = 1;
 }
 
 void log_exit(void)
 {
+	log_async(0);
 	if (enabled)
 		closelog();
 }
@@ -56,7 +101,7 @@ int log_level(char *arg)
 
 	for (i = 0; prioritynames[i].c_name; i++) {
 		if (string_match(prioritynames[i].c_name, arg)) {
-			level = prioritynames[i].c_val;
+			log_upto = prioritynames[i].c_val;
 			return 0;
 		}
 	}
@@ -65,18 +110,290 @@ int log_level(char *arg)
 	if (-1 == rc)
 		return rc;
 
-	level = rc;
+	log_upto = rc;
 	return 0;
 }
 
-void vlogit(int prio, const char *fmt, va_list args)
+/**
+ * log_format - Set log message format
+ * @arg: "text", the default, or "json", one JSON object per message
+ *
+ * Returns:
+ * POSIX OK(0), or -1 on unknown format.
+ */
+int log_format(char *arg)
+{
+	if (!strcmp(arg, "text"))
+		json = 0;
+	else if (!strcmp(arg, "json"))
+		json = 1;
+	else
+		return -1;
+
+	return 0;
+}
+
+static void emit(int prio, const char *msg)
+{
+	if (enabled && log_upto != INTERNAL_NOPRI)
+		syslog(prio, "%s", msg);
+	else
+		fprintf(stderr, "%s\n", msg);
+}
+
+/* Format message into the next free slot, or drop it if there is none */
+static void enqueue(int prio, const char *fmt, va_list args)
+{
+	unsigned long pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	struct slot *slot;
+
+	while (1) {
+		long diff;
+
+		slot = &ring[pos % LOG_RING_SIZE];
+		diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			/* Free, claim it unless another thread beat us to it */
+			if (__atomic_compare_exchange_n(&head, &pos, pos + 1, 1,
+							__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			/* Still holds a message from the previous lap */
+			__atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->prio = prio;
+	vsnprintf(slot->msg, sizeof(slot->msg), fmt, args);
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * log_flush - Write out messages queued while in async mode
+ *
+ * Called from the main loop before it waits for events.  Does nothing
+ * unless called from the thread that enabled async mode.
+ */
+void log_flush(void)
+{
+	unsigned long num;
+
+	if (!async || !pthread_equal(owner, pthread_self()))
+		return;
+
+	while (1) {
+		struct slot *slot = &ring[tail % LOG_RING_SIZE];
+
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != tail + 1)
+			break;
+
+		emit(slot->prio, slot->msg);
+		__atomic_store_n(&slot->seq, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+		tail++;
+	}
+
+	num = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+	if (num) {
+		char msg[64];
+
+		snprintf(msg, sizeof(msg), "Log buffer full, %lu messages dropped.", num);
+		emit(LOG_WARNING, msg);
+	}
+}
+
+/**
+ * log_async - Queue log messages, for log_flush() to write out
+ * @on: Non-zero to enable, zero to flush and go back to writing directly
+ *
+ * Only enabled below debug level.  Must be called by the thread that
+ * runs the main loop, with no other threads logging.
+ */
+void log_async(int on)
+{
+	unsigned long i;
+
+	if (!on) {
+		log_flush();
+		async = 0;
+		return;
+	}
+
+	if (async || log_upto >= LOG_DEBUG)
+		return;
+
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		ring[i].seq = i;
+	head  = tail = 0;
+	owner = pthread_self();
+	async = 1;
+}
+
+/**
+ * log_suppress - Check rate limit of a message site, see logit_limit()
+ * @rl:   Rate limit state of the message site
+ * @prio: Priority of the message, for the summary of suppressed ones
+ *
+ * Allows %LOG_LIMIT_BURST messages per %LOG_LIMIT_INTERVAL seconds.  The
+ * number suppressed is logged with the first message of next interval.
+ *
+ * Returns:
+ * Non-zero if the message should be suppressed.
+ */
+int log_suppress(log_limit_t *rl, int prio)
 {
-	if (enabled && level != INTERNAL_NOPRI)
+	struct timespec ts;
+	int suppress = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	pthread_mutex_lock(&limit_lock);
+	if (!rl->start || ts.tv_sec - rl->start >= LOG_LIMIT_INTERVAL) {
+		if (rl->suppressed)
+			logitf(prio, "%u similar messages suppressed in the last %d sec.",
+			       rl->suppressed, (int)(ts.tv_sec - rl->start));
+		rl->start      = ts.tv_sec;
+		rl->num        = 0;
+		rl->suppressed = 0;
+	}
+
+	if (rl->num < LOG_LIMIT_BURST)
+		rl->num++;
+	else
+		suppress = ++rl->suppressed;
+	pthread_mutex_unlock(&limit_lock);
+
+	return suppress;
+}
+
+static void output(int prio, const char *fmt, va_list args)
+{
+	if (async)
+		enqueue(prio, fmt, args);
+	else if (enabled && log_upto != INTERNAL_NOPRI)
 		vsyslog(prio, fmt, args);
-	else if (prio <= level)
+	else
 		vfprintf(stderr, fmt, args), fprintf(stderr, "\n");
 }
 
+static void outputf(int prio, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	output(prio, fmt, args);
+	va_end(args);
+}
+
+/* Append to @ptr, never past @end, returns new end of string */
+static char *put(char *ptr, char *end, const char *fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(ptr, end - ptr, fmt, args);
+	va_end(args);
+
+	if (len < 0)
+		return ptr;
+	if (len >= end - ptr)
+		return end - 1;
+
+	return ptr + len;
+}
+
+/* Append "key":"str", with @str escaped and cut short if need be */
+static char *put_str(char *ptr, char *end, const char *key, const char *str)
+{
+	ptr = put(ptr, end, ",\"%s\":\"", key);
+	while (*str && end - ptr > 8) {
+		unsigned char c = *str++;
+
+		if (c == '"' || c == '\\')
+			ptr = put(ptr, end, "\\%c", c);
+		else if (c < 0x20)
+			ptr = put(ptr, end, "\\u%04x", c);
+		else
+			*ptr++ = c;
+	}
+
+	return put(ptr, end, "\"");
+}
+
+/* One JSON object per message, the message itself is cut short if need be */
+static void output_json(int prio, const log_event_t *ev, const char *fmt, va_list args)
+{
+	char msg[LOG_MSG_LEN], buf[LOG_MSG_LEN];
+	char *ptr = buf, *end = buf + sizeof(buf) - 1;
+	struct timespec ts;
+
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	ptr = put(ptr, end, "{\"time\":%lld.%03ld,\"level\":\"%s\"", (long long)ts.tv_sec,
+		  ts.tv_nsec / 1000000, prio >= 0 && prio < (int)NELEMS(levels) ? levels[prio] : "debug");
+	ptr = put_str(ptr, end, "event", ev && ev->event ? ev->event : "log");
+	if (ev) {
+		if (ev->provider)
+			ptr = put_str(ptr, end, "provider", ev->provider);
+		if (ev->alias)
+			ptr = put_str(ptr, end, "alias", ev->alias);
+		if (ev->address)
+			ptr = put_str(ptr, end, "address", ev->address);
+		if (ev->server)
+			ptr = put_str(ptr, end, "server", ev->server);
+		ptr = put(ptr, end, ",\"rc\":%d", ev->rc);
+		ptr = put_str(ptr, end, "error", error_str(ev->rc));
+		if (ev->start) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			ptr = put(ptr, end, ",\"duration_ms\":%lld",
+				  (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - ev->start);
+		}
+	}
+	ptr = put_str(ptr, end, "message", msg);
+
+	/* Room for this was left at the end */
+	*ptr++ = '}';
+	*ptr   = 0;
+
+	outputf(prio, "%s", buf);
+}
+
+void vlogit(int prio, const char *fmt, va_list args)
+{
+	if (prio > log_upto)
+		return;
+
+	if (json)
+		output_json(prio, NULL, fmt, args);
+	else
+		output(prio, fmt, args);
+}
+
+/**
+ * log_event - Log a structured event
+ * @prio: Syslog priority
+ * @ev:   Event fields, see log_event_t
+ * @fmt:  Message, the only thing logged with the text log format
+ */
+void log_event(int prio, const log_event_t *ev, const char *fmt, ...)
+{
+	va_list args;
+
+	if (prio > log_upto)
+		return;
+
+	va_start(args, fmt);
+	if (json)
+		output_json(prio, ev, fmt, args);
+	else
+		output(prio, fmt, args);
+	va_end(args);
+}
+
 void logitf(int prio, const char *fmt, ...)
 {
 	va_list args;
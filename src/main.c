@@ -31,7 +31,10 @@
 
 #include "log.h"
 #include "ddns.h"
+#include "ctrl.h"
 #include "error.h"
+#include "replay.h"
+#include "resolver.h"
 #include "ssl.h"
 
 int    once = 0;
@@ -60,6 +63,7 @@ cfg_t *cfg;
 
 extern cfg_t *conf_parse_file   (char *file, ddns_t *ctx);
 extern void   conf_info_cleanup (void);
+extern void   conf_cleanup      (void);
 
 
 static int alloc_context(ddns_t **pctx)
@@ -78,39 +82,50 @@ static int alloc_context(ddns_t **pctx)
 		ctx = *pctx;
 		memset(ctx, 0, sizeof(ddns_t));
 
-		/* Alloc space for http_to_ip_server data */
-		ctx->work_buflen = DDNS_HTTP_RESPONSE_BUFFER_SIZE;
-		ctx->work_buf = (char *)malloc(ctx->work_buflen);
+		ctx->pool = buf_pool_new();
+		if (!ctx->pool) {
+			rc = RC_OUT_OF_MEMORY;
+			break;
+		}
+
+		ctx->arena = arena_new();
+		if (!ctx->arena) {
+			rc = RC_OUT_OF_MEMORY;
+			break;
+		}
+
+		/* Alloc space for http_to_ip_server data, grows on demand */
+		ctx->work_buf = buf_get(ctx->pool, DDNS_HTTP_RESPONSE_BUFFER_SIZE);
 		if (!ctx->work_buf) {
 			rc = RC_OUT_OF_MEMORY;
 			break;
 		}
 
 		/* Alloc space for request data */
-		ctx->request_buflen = DDNS_HTTP_REQUEST_BUFFER_SIZE;
-		ctx->request_buf = (char *)malloc(ctx->request_buflen);
-		if (!ctx->request_buf) {
+		ctx->request = buf_get(ctx->pool, DDNS_HTTP_REQUEST_BUFFER_SIZE);
+		if (!ctx->request) {
 			rc = RC_OUT_OF_MEMORY;
 			break;
 		}
+		ctx->request_buf    = ctx->request->data;
+		ctx->request_buflen = ctx->request->size;
 
 		ctx->cmd = NO_CMD;
 		ctx->normal_update_period_sec = DDNS_DEFAULT_PERIOD;
 		ctx->update_period = DDNS_DEFAULT_PERIOD;
 		ctx->total_iterations = DDNS_DEFAULT_ITERATIONS;
 		ctx->cmd_check_period = DDNS_DEFAULT_CMD_CHECK_PERIOD;
+		ctx->concurrency = DDNS_DEFAULT_CONCURRENCY;
 
 		ctx->initialized = 0;
 	}
 	while (0);
 
 	if (rc) {
-
-		if (ctx->work_buf)
-			free(ctx->work_buf);
-
-		if (ctx->request_buf)
-			free(ctx->request_buf);
+		buf_put(ctx->pool, ctx->work_buf);
+		buf_put(ctx->pool, ctx->request);
+		buf_pool_free(ctx->pool);
+		arena_free(ctx->arena);
 
 		free(ctx);
 		*pctx = NULL;
@@ -124,15 +139,18 @@ static void free_context(ddns_t *ctx)
 	if (!ctx)
 		return;
 
-	if (ctx->work_buf) {
-		free(ctx->work_buf);
-		ctx->work_buf = NULL;
-	}
+	buf_put(ctx->pool, ctx->work_buf);
+	ctx->work_buf = NULL;
 
-	if (ctx->request_buf) {
-		free(ctx->request_buf);
-		ctx->request_buf = NULL;
-	}
+	buf_put(ctx->pool, ctx->request);
+	ctx->request     = NULL;
+	ctx->request_buf = NULL;
+
+	buf_pool_free(ctx->pool);
+	ctx->pool = NULL;
+
+	arena_free(ctx->arena);
+	ctx->arena = NULL;
 
 	conf_info_cleanup();
 	free(ctx);
@@ -272,9 +290,10 @@ static int usage(int code)
 		" -c, --cmd=/path/to/cmd         Script or command to run to check IP\n"
 		" -C, --continue-on-error        Ignore errors from DDNS provider\n"
 		" -e, --exec=/path/to/cmd        Script to run on DDNS update\n"
-		"     --exec-mode=MODE           Set script run mode: compat, event:\n"
+		"     --exec-mode=MODE           Set script run mode: compat, event, batch:\n"
 		"                                - compat: successful DDNS update only, default\n"
 		"                                - event: any update status\n"
+		"                                - batch: all events of a cycle, on stdin\n"
 #ifndef DROP_CHECK_CONFIG
 		"     --check-config             Verify syntax of configuration file and exit\n"
 #endif
@@ -286,12 +305,17 @@ static int usage(int code)
 		"                                and syslog messages.  Defaults to: %s\n"
 		" -j, --json                     JSON output format (-L only)\n"
 		" -l, --loglevel=LEVEL           Set log level: none, err, info, notice*, debug\n"
+		"     --log-format=FORMAT        Log messages as text*, or json: one object per\n"
+		"                                message, with keys for update events\n"
 		" -L, --list-providers           List available DDNS providers\n"
 		" -n, --foreground               Run in foreground with logging to stdout/stderr\n"
 		" -p, --drop-privs=USER[:GROUP]  Drop privileges after start to USER:GROUP\n"
 		"     --no-pidfile               Do not create PID file, for use with systemd\n"
 		" -P, --pidfile=FILE             File to store process ID for signaling %s\n"
 		"                                Default uses ident NAME: %s\n"
+		"     --record=FILE              Record all HTTP(S) transactions to FILE\n"
+		"     --replay=FILE              Replay transactions recorded in FILE, offline\n"
+		"     --replay-scale=PERCENT     Replay at PERCENT of recorded latency, default 100\n"
 		" -s, --syslog                   Log to syslog, default unless --foreground\n"
 		" -S, --show-provider NAME       Show information about DDNS provider NAME\n"
 		" -t, --startup-delay=SEC        Initial startup delay, default none\n"
@@ -301,11 +325,11 @@ static int usage(int code)
 		prognm, prognm, pidfn,
 		PACKAGE_BUGREPORT
 #else
-		" --force --cache-dir=PATH --exec-mode=MODE"
+		" --force --cache-dir=PATH --exec-mode=MODE --log-format=FORMAT"
 #ifndef DROP_CHECK_CONFIG
 		" --check-config"
 #endif
-		" --no-pidfile\n\n",
+		" --no-pidfile --record=FILE --replay=FILE --replay-scale=PERCENT\n\n",
 		prognm
 #endif
 		);
@@ -352,11 +376,15 @@ int main(int argc, char *argv[])
 		{ "ident",             1, 0, 'I' },
 		{ "json",              0, 0, 'j' },
 		{ "loglevel",          1, 0, 'l' },
+		{ "log-format",        1, 0, 131 },
 		{ "list-providers",    0, 0, 'L' },
 		{ "help",              0, 0, 'h' },
 		{ "foreground",        0, 0, 'n' },
 		{ "no-pidfile",        0, 0, 'N' },
 		{ "pidfile",           1, 0, 'P' },
+		{ "record",            1, 0, 132 },
+		{ "replay",            1, 0, 133 },
+		{ "replay-scale",      1, 0, 134 },
 		{ "drop-privs",        1, 0, 'p' },
 		{ "syslog",            0, 0, 's' },
 		{ "show-provider",     0, 0, 'S' },
@@ -399,6 +427,8 @@ int main(int argc, char *argv[])
 		case 130:	/* --exec-mode=MODE */
 			if (!strcmp(optarg, "event"))
 				exec_mode = EXEC_MODE_EVENT;
+			else if (!strcmp(optarg, "batch"))
+				exec_mode = EXEC_MODE_BATCH;
 			else if (!strcmp(optarg, "compat"))
 				exec_mode = EXEC_MODE_COMPAT;
 			else
@@ -435,6 +465,11 @@ int main(int argc, char *argv[])
 				return usage(1);
 			break;
 
+		case 131:	/* --log-format=FORMAT */
+			if (log_format(optarg))
+				return usage(1);
+			break;
+
 		case 'L':
 			list = 1;
 			break;
@@ -453,6 +488,20 @@ int main(int argc, char *argv[])
 			pidfile_name = strdup(optarg);
 			break;
 
+		case 132:	/* --record=FILE */
+			record_file = optarg;
+			break;
+
+		case 133:	/* --replay=FILE */
+			replay_file = optarg;
+			break;
+
+		case 134:	/* --replay-scale=PERCENT */
+			replay_scale = atoi(optarg);
+			if (replay_scale < 0)
+				return usage(1);
+			break;
+
 		case 'p':	/* --drop-privs=USER[:GROUP] */
 			parse_privs(optarg);
 			break;
@@ -554,6 +603,12 @@ int main(int argc, char *argv[])
 	if (rc)
 		goto leave;
 
+	rc = replay_init();
+	if (rc) {
+		ssl_exit();
+		goto leave;
+	}
+
 	do {
 		restart = 0;
 
@@ -574,14 +629,27 @@ int main(int argc, char *argv[])
 			break;
 		}
 
+		/* Already running as a daemon, let it do the work, unless recording */
+		if (once && !record_file && !replay_file && !ctrl_handoff(force)) {
+			free_context(ctx);
+			conf_cleanup();
+			break;
+		}
+
 		rc = ddns_main_loop(ctx);
-		if (rc == RC_RESTART)
+		if (rc == RC_RESTART) {
 			restart = 1;
 
+			/* Pick up any new ca-trust-file, or updated system CA store */
+			ssl_reload();
+		}
+
 		free_context(ctx);
-		cfg_free(cfg);
+		conf_cleanup();
 	} while (restart);
 
+	resolver_exit();
+	replay_exit();
 	ssl_exit();
 leave:
 	if (rc)
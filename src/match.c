@@ -0,0 +1,252 @@
+/* Multi-pattern matcher for classifying server responses
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Aho-Corasick automaton, compiled to a DFA so each input byte is one
+ * table lookup, finds all patterns in one pass over the response.  The
+ * alphabet is reduced to the bytes used by the patterns, every other
+ * byte is class zero, which keeps the table to a few KiB even for the
+ * user's own custom provider responses.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "match.h"
+#include "resource.h"
+
+MEM_TAG("match");
+
+struct matcher {
+	int            flags;
+	int            num;		/* Rules */
+	int            classes;
+	int            states;
+	unsigned char  class[256];
+	int           *rc;		/* Per rule */
+	int           *len;		/* Per rule, pattern length */
+	int           *out;		/* Per state, best rule ending here, or -1 */
+	int           *link;		/* Per state, next suffix state with output */
+	int           *next;		/* states x classes */
+};
+
+static unsigned char fold(const matcher_t *m, unsigned char c)
+{
+	return (m->flags & MATCH_NOCASE) ? tolower(c) : c;
+}
+
+static int is_word(unsigned char c)
+{
+	return isalnum(c) || c == '_';
+}
+
+/**
+ * match_compile - Compile table of patterns
+ * @rules: Patterns and result codes, in order of priority
+ * @num:   Number of @rules
+ * @flags: %MATCH_NOCASE, %MATCH_WORD
+ *
+ * Empty patterns never match.
+ *
+ * Returns:
+ * Matcher, or %NULL if out of memory.
+ */
+matcher_t *match_compile(const match_rule_t *rules, size_t num, int flags)
+{
+	int *fail, *queue, head = 0, tail = 0;
+	size_t total = 1, size, i;
+	unsigned char used[256] = { 0 };
+	matcher_t *m, tmp;
+	int c, s;
+
+	/* Classes first, they decide the size of the table */
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.flags = flags;
+	for (i = 0; i < num; i++) {
+		const unsigned char *p = (const unsigned char *)rules[i].pattern;
+
+		for (; p && *p; p++, total++)
+			used[fold(&tmp, *p)] = 1;
+	}
+
+	tmp.classes = 1;
+	for (c = 0; c < 256; c++) {
+		if (used[c])
+			tmp.class[c] = tmp.classes++;
+	}
+	for (c = 0; c < 256; c++)
+		tmp.class[c] = tmp.class[fold(&tmp, c)];
+
+	size = sizeof(*m) + (2 * num + 2 * total + total * tmp.classes) * sizeof(int);
+	m = mem_malloc(size);
+	if (!m)
+		return NULL;
+
+	memcpy(m, &tmp, sizeof(tmp));
+	m->num    = num;
+	m->states = 1;
+	m->rc     = (int *)&m[1];
+	m->len    = m->rc   + num;
+	m->out    = m->len  + num;
+	m->link   = m->out  + total;
+	m->next   = m->link + total;
+
+	memset(m->next, -1, total * m->classes * sizeof(int));
+	for (i = 0; i < total; i++)
+		m->out[i] = m->link[i] = -1;
+
+	/* Trie of all patterns */
+	for (i = 0; i < num; i++) {
+		const unsigned char *p = (const unsigned char *)rules[i].pattern;
+
+		m->rc[i]  = rules[i].rc;
+		m->len[i] = p ? strlen((const char *)p) : 0;
+		if (!m->len[i])
+			continue;
+
+		for (s = 0; *p; p++) {
+			int *n = &m->next[s * m->classes + m->class[*p]];
+
+			if (*n < 0)
+				*n = m->states++;
+			s = *n;
+		}
+		if (m->out[s] < 0)
+			m->out[s] = i;
+	}
+
+	/* Breadth first, fill in failure transitions to make it a DFA */
+	fail  = malloc(2 * m->states * sizeof(int));
+	if (!fail) {
+		mem_free(m);
+		return NULL;
+	}
+	queue = fail + m->states;
+
+	fail[0] = 0;
+	for (c = 0; c < m->classes; c++) {
+		int n = m->next[c];
+
+		if (n < 0) {
+			m->next[c] = 0;
+			continue;
+		}
+		fail[n] = 0;
+		queue[tail++] = n;
+	}
+
+	while (head < tail) {
+		s = queue[head++];
+
+		m->link[s] = m->out[fail[s]] >= 0 ? fail[s] : m->link[fail[s]];
+		if (m->link[s] == 0)
+			m->link[s] = -1;
+
+		for (c = 0; c < m->classes; c++) {
+			int n = m->next[s * m->classes + c];
+
+			if (n < 0) {
+				m->next[s * m->classes + c] = m->next[fail[s] * m->classes + c];
+				continue;
+			}
+
+			fail[n] = m->next[fail[s] * m->classes + c];
+			queue[tail++] = n;
+		}
+	}
+	free(fail);
+
+	return m;
+}
+
+void match_free(matcher_t *m)
+{
+	mem_free(m);
+}
+
+/* Whole word at @end - @len + 1 .. @end, if required */
+static int bounded(const matcher_t *m, const unsigned char *text, size_t tlen, size_t end, int len)
+{
+	size_t start = end + 1 - len;
+
+	if (!(m->flags & MATCH_WORD))
+		return 1;
+
+	if (is_word(text[start]) && start > 0 && is_word(text[start - 1]))
+		return 0;
+	if (is_word(text[end]) && end + 1 < tlen && is_word(text[end + 1]))
+		return 0;
+
+	return 1;
+}
+
+/**
+ * match_find - Find best matching pattern in @text
+ * @m:    Compiled matcher
+ * @text: Text to search, need not be NUL terminated
+ * @len:  Length of @text
+ *
+ * Returns:
+ * Index of the matching rule earliest in the table, or -1.
+ */
+int match_find(const matcher_t *m, const char *text, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)text;
+	int best = -1, s = 0;
+	size_t i;
+
+	if (!m)
+		return -1;
+
+	for (i = 0; i < len && best != 0; i++) {
+		int t;
+
+		s = m->next[s * m->classes + m->class[p[i]]];
+		for (t = m->out[s] >= 0 ? s : m->link[s]; t > 0; t = m->link[t]) {
+			int r = m->out[t];
+
+			if ((best < 0 || r < best) && bounded(m, p, len, i, m->len[r]))
+				best = r;
+		}
+	}
+
+	return best;
+}
+
+/* Result code of the best matching pattern, or @def */
+int match_rc(const matcher_t *m, const char *text, size_t len, int def)
+{
+	int r;
+
+	r = match_find(m, text, len);
+	if (r < 0)
+		return def;
+
+	return m->rc[r];
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
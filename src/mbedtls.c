@@ -1,73 +1,369 @@
+#include <pthread.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/net_sockets.h>
+
+#include "compat.h"
 #include "log.h"
 #include "http.h"
 #include "ssl.h"
 
-#define xstr(s) str(s)
-#define str(s) #s
+/* Last session with each server, shared by parallel update workers */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+	char                 host[256];
+	int                  valid;
+	mbedtls_ssl_session  session;
+} cache[SSL_SESSION_CACHE_SIZE];
+static int cache_next;
+
+/* Shared CA chain, and number of sessions using it */
+static pthread_mutex_t  ca_lock = PTHREAD_MUTEX_INITIALIZER;
+static mbedtls_x509_crt cacert;
+static int              ca_loaded;
+static char             ca_file[256];
+static time_t           ca_mtime;
+static int              ca_reload;
+static int              ca_users;
+
+/*
+ * One DRBG, seeded once, and one client config, shared by all sessions.
+ * The config is read-only once set up, the DRBG is serialized by us in
+ * case mbedtls is built without MBEDTLS_THREADING_C.  ALPN is set in the
+ * config, so sessions offering HTTP/2 use a second one, conf_h2.
+ */
+static pthread_mutex_t          rng_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t          conf_lock = PTHREAD_MUTEX_INITIALIZER;
+static mbedtls_entropy_context  entropy;
+static mbedtls_ctr_drbg_context ctr_drbg;
+static mbedtls_ssl_config       conf;
+static mbedtls_ssl_config       conf_h2;
+static int                      conf_ready;
 
 int ssl_init(void) { return 0; }
 
-void ssl_exit(void) {}
+void ssl_exit(void)
+{
+	int i;
+
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].valid)
+			mbedtls_ssl_session_free(&cache[i].session);
+		cache[i].valid   = 0;
+		cache[i].host[0] = 0;
+	}
+	cache_next = 0;
+
+	if (conf_ready) {
+		mbedtls_ssl_config_free(&conf);
+		mbedtls_ssl_config_free(&conf_h2);
+		mbedtls_ctr_drbg_free(&ctr_drbg);
+		mbedtls_entropy_free(&entropy);
+	}
+	conf_ready = 0;
+
+	if (ca_loaded)
+		mbedtls_x509_crt_free(&cacert);
+	ca_loaded  = 0;
+	ca_users   = 0;
+	ca_file[0] = 0;
+	ca_mtime   = 0;
+}
+
+/* Reload CA trust store on next connection, e.g. on SIGHUP */
+void ssl_reload(void)
+{
+	pthread_mutex_lock(&ca_lock);
+	ca_reload = 1;
+	pthread_mutex_unlock(&ca_lock);
+}
 
-int ssl_open(http_t *client, char *msg, int force)
+/* Returns the CA bundle file parsed into @crt, or NULL on error */
+static const char *ca_load(mbedtls_x509_crt *crt)
 {
-	int port = 0;
 	int rc;
 
-	if (!client->ssl_enabled)
-		return tcp_init(&client->tcp, msg, force);
+	/* A user defined CA PEM bundle overrides any built-ins or fall-backs */
+	if (ca_trust_file) {
+		rc = mbedtls_x509_crt_parse_file(crt, ca_trust_file);
+		if (rc) {
+			logit(LOG_DEBUG, "mbedtls_x509_crt_parse_file: %d", rc);
+			return NULL;
+		}
+		return ca_trust_file;
+	}
 
-	http_get_port(client, &port);
-	if (!port)
-		http_set_port(client, HTTPS_DEFAULT_PORT);
-	rc = tcp_init(&client->tcp, msg, force);
-	if (rc)
+	if (!mbedtls_x509_crt_parse_file(crt, CAFILE1))
+		return CAFILE1;
+
+	rc = mbedtls_x509_crt_parse_file(crt, CAFILE2);
+	if (rc) {
+		logit(LOG_DEBUG, "mbedtls_x509_crt_parse_file: %d", rc);
+		return NULL;
+	}
+
+	return CAFILE2;
+}
+
+/* Remember what we loaded, or tried to load, to detect changes later */
+static void ca_stamp(const char *file)
+{
+	strlcpy(ca_file, file ? file : "", sizeof(ca_file));
+	ca_mtime  = fmtime(ca_file);
+	ca_reload = 0;
+}
+
+/* Has the user picked, or replaced, the CA bundle since we loaded it? */
+static int ca_stale(void)
+{
+	if (ca_reload)
+		return 1;
+	if (ca_trust_file && strcmp(ca_trust_file, ca_file))
+		return 1;
+
+	return fmtime(ca_file) != ca_mtime;
+}
+
+/*
+ * Parse the CA bundle once, shared by all sessions.  When it needs to
+ * be reloaded we wait until no session uses it, and only replace it if
+ * the new bundle parses successfully.  On success the caller holds a
+ * reference, see ca_put().
+ */
+static mbedtls_x509_crt *ca_get(void)
+{
+	mbedtls_x509_crt *crt = NULL;
+	const char *file;
+
+	pthread_mutex_lock(&ca_lock);
+	if (!ca_loaded) {
+		mbedtls_x509_crt_init(&cacert);
+		file = ca_load(&cacert);
+		ca_stamp(file ? file : ca_trust_file);
+		if (file)
+			ca_loaded = 1;
+		else
+			mbedtls_x509_crt_free(&cacert);
+	} else if (!ca_users && ca_stale()) {
+		mbedtls_x509_crt fresh;
+
+		mbedtls_x509_crt_init(&fresh);
+		file = ca_load(&fresh);
+		if (file) {
+			logit(LOG_DEBUG, "Reloaded CA trust store %s", file);
+			mbedtls_x509_crt_free(&cacert);
+			cacert = fresh;
+		} else {
+			logit(LOG_WARNING, "Failed reloading CA trust store, keeping previous one.");
+			mbedtls_x509_crt_free(&fresh);
+		}
+		ca_stamp(file ? file : ca_trust_file);
+	}
+
+	if (ca_loaded) {
+		ca_users++;
+		crt = &cacert;
+	}
+	pthread_mutex_unlock(&ca_lock);
+
+	return crt;
+}
+
+/* Session done with the shared CA chain */
+static void ca_put(void)
+{
+	pthread_mutex_lock(&ca_lock);
+	if (ca_users > 0)
+		ca_users--;
+	pthread_mutex_unlock(&ca_lock);
+}
+
+static int rng(void *arg, unsigned char *buf, size_t len)
+{
+	int rc;
+
+	pthread_mutex_lock(&rng_lock);
+	rc = mbedtls_ctr_drbg_random(&ctr_drbg, buf, len);
+	pthread_mutex_unlock(&rng_lock);
+
+	return rc;
+}
+
+static int conf_setup(mbedtls_ssl_config *config)
+{
+	int rc;
+
+	rc = mbedtls_ssl_config_defaults(config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+					 MBEDTLS_SSL_PRESET_DEFAULT);
+	if (rc) {
+		logit(LOG_DEBUG, "mbedtls_ssl_config_defaults:%d", rc);
 		return rc;
+	}
 
-	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
+	mbedtls_ssl_conf_ca_chain(config, &cacert, NULL);
+	mbedtls_ssl_conf_rng(config, rng, NULL);
+
+	return 0;
+}
+
+/*
+ * Seed the DRBG and set up the client configs on first use.  They refer
+ * to the shared CA chain, so it must be loaded, see ca_get().
+ */
+static mbedtls_ssl_config *conf_get(int http2)
+{
+#if defined(ENABLE_HTTP2) && defined(MBEDTLS_SSL_ALPN)
+	static const char *alpn[] = { "h2", "http/1.1", NULL };
+#endif
+	int rc;
+
+	pthread_mutex_lock(&conf_lock);
+	if (conf_ready)
+		goto done;
 
-	mbedtls_ssl_init       (&client->ssl);
-	mbedtls_net_init       (&client->server_fd);
-	mbedtls_x509_crt_init  (&client->cacert);
-	mbedtls_ssl_config_init(&client->conf);
-	mbedtls_ctr_drbg_init  (&client->ctr_drbg);
-	mbedtls_entropy_init   (&client->entropy);
+	mbedtls_entropy_init(&entropy);
+	mbedtls_ctr_drbg_init(&ctr_drbg);
+	mbedtls_ssl_config_init(&conf);
+	mbedtls_ssl_config_init(&conf_h2);
 
-	rc = mbedtls_ctr_drbg_seed(&client->ctr_drbg, mbedtls_entropy_func, &client->entropy, PACKAGE_STRING, strlen(PACKAGE_STRING));
+	rc = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+				   (const unsigned char *)PACKAGE_STRING, strlen(PACKAGE_STRING));
 	if (rc) {
 		logit(LOG_DEBUG, "mbedtls_ctr_drbg_seed:%d", rc);
-		ssl_close(client);
-		return RC_HTTPS_OUT_OF_MEMORY;
+		goto fail;
 	}
 
-	rc = mbedtls_x509_crt_parse_file(&client->cacert, CAFILE1);
-	if (rc) {
-		rc = mbedtls_x509_crt_parse_file(&client->cacert, CAFILE2);
+	if (conf_setup(&conf) || conf_setup(&conf_h2))
+		goto fail;
+#if defined(ENABLE_HTTP2) && defined(MBEDTLS_SSL_ALPN)
+	mbedtls_ssl_conf_alpn_protocols(&conf_h2, alpn);
+#endif
+	conf_ready = 1;
+done:
+	pthread_mutex_unlock(&conf_lock);
+	return http2 ? &conf_h2 : &conf;
+fail:
+	mbedtls_ssl_config_free(&conf);
+	mbedtls_ssl_config_free(&conf_h2);
+	mbedtls_ctr_drbg_free(&ctr_drbg);
+	mbedtls_entropy_free(&entropy);
+	pthread_mutex_unlock(&conf_lock);
+	return NULL;
+}
+
+/* TLS records over our own, already connected, non-blocking socket */
+static int bio_send(void *arg, const unsigned char *buf, size_t len)
+{
+	http_t *client = arg;
+	int rc, sent;
+
+	rc = tcp_send(&client->tcp, (const char *)buf, (int)len, &sent);
+	if (rc == RC_TCP_WANT_WRITE)
+		return MBEDTLS_ERR_SSL_WANT_WRITE;
+	if (rc)
+		return MBEDTLS_ERR_NET_SEND_FAILED;
+
+	return sent;
+}
+
+static int bio_recv(void *arg, unsigned char *buf, size_t len)
+{
+	http_t *client = arg;
+	int rc, num;
+
+	rc = tcp_recv(&client->tcp, (char *)buf, (int)len, &num);
+	if (rc == RC_TCP_WANT_READ)
+		return MBEDTLS_ERR_SSL_WANT_READ;
+	if (rc)
+		return MBEDTLS_ERR_NET_RECV_FAILED;
+
+	return num;
+}
+
+/* Resume previous session with @host, if we have one */
+static void session_load(mbedtls_ssl_context *ssl, const char *host)
+{
+	int i;
+
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (!cache[i].valid || strcmp(cache[i].host, host))
+			continue;
+
+		mbedtls_ssl_set_session(ssl, &cache[i].session);
+		break;
 	}
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_x509_crt_parse_file: %d", rc);
-		ssl_close(client);
-		return RC_HTTPS_NO_TRUSTED_CA_STORE;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* Called when closing, with TLS 1.3 the ticket arrives after the handshake */
+static void session_save(mbedtls_ssl_context *ssl, const char *host)
+{
+	mbedtls_ssl_session session;
+	int i;
+
+	mbedtls_ssl_session_init(&session);
+	if (mbedtls_ssl_get_session(ssl, &session)) {
+		mbedtls_ssl_session_free(&session);
+		return;
 	}
 
-	rc = mbedtls_net_connect(&client->server_fd, client->tcp.remote_host, xstr(HTTPS_DEFAULT_PORT), MBEDTLS_NET_PROTO_TCP);
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_net_connect:%d '%s'", rc, client->tcp.remote_host);
+	pthread_mutex_lock(&cache_lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].valid && !strcmp(cache[i].host, host))
+			break;
+	}
+
+	/* Not found, replace the oldest entry */
+	if (i == SSL_SESSION_CACHE_SIZE) {
+		i = cache_next;
+		cache_next = (cache_next + 1) % SSL_SESSION_CACHE_SIZE;
+	}
+
+	if (cache[i].valid)
+		mbedtls_ssl_session_free(&cache[i].session);
+	strlcpy(cache[i].host, host, sizeof(cache[i].host));
+	cache[i].session = session;
+	cache[i].valid   = 1;
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/* Map MBEDTLS_ERR_SSL_WANT_* to our non-blocking return codes, or zero */
+static int ssl_want(int rc)
+{
+	if (rc == MBEDTLS_ERR_SSL_WANT_READ)
+		return RC_TCP_WANT_READ;
+	if (rc == MBEDTLS_ERR_SSL_WANT_WRITE)
+		return RC_TCP_WANT_WRITE;
+
+	return 0;
+}
+
+int ssl_open(http_t *client, char *msg)
+{
+	mbedtls_ssl_config *config;
+	int rc;
+
+	if (!client->ssl_enabled)
+		return 0;
+
+	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
+
+	mbedtls_ssl_init(&client->ssl);
+
+	client->cacert = ca_get();
+	if (!client->cacert) {
 		ssl_close(client);
-		return RC_TCP_CONNECT_FAILED;
+		return RC_HTTPS_NO_TRUSTED_CA_STORE;
 	}
 
-	rc = mbedtls_ssl_config_defaults(&client->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
-	if (rc) {
-		logit(LOG_DEBUG, "mbedtls_ssl_config_defaults:%d", rc);
+	config = conf_get(client->http2);
+	if (!config) {
 		ssl_close(client);
 		return RC_HTTPS_OUT_OF_MEMORY;
 	}
 
-	mbedtls_ssl_conf_ca_chain(&client->conf, &client->cacert, 0);
-	mbedtls_ssl_conf_rng(&client->conf, mbedtls_ctr_drbg_random, &client->ctr_drbg);
-
-	rc = mbedtls_ssl_setup(&client->ssl, &client->conf);
+	rc = mbedtls_ssl_setup(&client->ssl, config);
 	if (rc) {
 		logit(LOG_DEBUG, "mbedtls_ssl_setup:%d", rc);
 		ssl_close(client);
@@ -80,17 +376,30 @@ int ssl_open(http_t *client, char *msg, int force)
 		ssl_close(client);
 		return RC_HTTPS_SNI_ERROR;
 	}
+	session_load(&client->ssl, client->tcp.remote_host);
 
-	mbedtls_ssl_set_bio(&client->ssl, &client->server_fd, mbedtls_net_send, mbedtls_net_recv, 0);
+	/* The socket is still owned by client->tcp, see ssl_close() */
+	mbedtls_ssl_set_bio(&client->ssl, client, bio_send, bio_recv, NULL);
 
-	while (1) {
-		rc = mbedtls_ssl_handshake(&client->ssl);
-		if (!rc) { break; }
-		if (rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) {
-			logit(LOG_DEBUG, "mbedtls_ssl_handshake:%d", rc);
-			ssl_close(client);
-			return RC_HTTPS_OUT_OF_MEMORY;
-		}
+	return 0;
+}
+
+int ssl_handshake(http_t *client)
+{
+	int rc;
+
+	if (!client->ssl_enabled)
+		return 0;
+
+	rc = mbedtls_ssl_handshake(&client->ssl);
+	if (rc) {
+		int want = ssl_want(rc);
+
+		if (want)
+			return want;
+
+		logit(LOG_DEBUG, "mbedtls_ssl_handshake:%d", rc);
+		return RC_HTTPS_FAILED_CONNECT;
 	}
 
 	client->connected = 1;
@@ -102,65 +411,90 @@ int ssl_open(http_t *client, char *msg, int force)
 int ssl_close(http_t *client)
 {
 	if (client->ssl_enabled) {
-		if (client->connected)
+		if (client->connected) {
+			session_save(&client->ssl, client->tcp.remote_host);
 			mbedtls_ssl_close_notify(&client->ssl);
-		mbedtls_ssl_free       (&client->ssl      );
-		mbedtls_net_free       (&client->server_fd);
-		mbedtls_x509_crt_free  (&client->cacert   );
-		mbedtls_ssl_config_free(&client->conf     );
-		mbedtls_ctr_drbg_free  (&client->ctr_drbg );
-		mbedtls_entropy_free   (&client->entropy  );
+		}
+
+		/* The socket is closed by tcp_exit() below */
+		mbedtls_ssl_free(&client->ssl);
+
+		if (client->cacert)
+			ca_put();
+		client->cacert = NULL;
 	}
 	client->connected = 0;
 
 	return tcp_exit(&client->tcp);
 }
 
-int ssl_send(http_t *client, const char *buf, int len)
+/* Did the server select h2 in ALPN, see conf_get() */
+int ssl_alpn_h2(http_t *client)
+{
+#ifdef MBEDTLS_SSL_ALPN
+	const char *proto;
+
+	if (!client->ssl_enabled)
+		return 0;
+
+	proto = mbedtls_ssl_get_alpn_protocol(&client->ssl);
+
+	return proto && !strcmp(proto, "h2");
+#else
+	(void)client;
+	return 0;
+#endif
+}
+
+int ssl_send(http_t *client, const char *buf, int len, int *sent)
 {
 	int err;
 
 	if (!client->ssl_enabled)
-		return tcp_send(&client->tcp, buf, len);
+		return tcp_send(&client->tcp, buf, len, sent);
 
-	do {
-		err = mbedtls_ssl_write(&client->ssl, buf, len);
-	} while (err == MBEDTLS_ERR_SSL_WANT_WRITE);
+	*sent = 0;
+	err = mbedtls_ssl_write(&client->ssl, (const unsigned char *)buf, len);
+	if (err < 0) {
+		int want = ssl_want(err);
+
+		if (want)
+			return want;
 
-	if (err <= 0) {
 		return RC_HTTPS_SEND_ERROR;
 	}
 
-	logit(LOG_DEBUG, "Successfully sent HTTPS request!");
+	*sent = err;
+	if (err == len)
+		logit(LOG_DEBUG, "Successfully sent HTTPS request!");
 
 	return 0;
 }
 
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int err, len = 0;
+	int err;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
-	do {
-		err = mbedtls_ssl_read(&client->ssl, buf + len, buf_len - len);
-		if (err == 0 || err == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
-			err = 0;
-			client->connected = 0;
-			break;
-		}
-		if (err > 0)
-			len += err;
-	} while (err > 0 || err == MBEDTLS_ERR_SSL_WANT_READ);
+	*recv_len = 0;
+	err = mbedtls_ssl_read(&client->ssl, (unsigned char *)buf, buf_len);
+	if (err == 0 || err == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+		client->connected = 0;
+		return 0;
+	}
 
 	if (err < 0) {
+		int want = ssl_want(err);
+
+		if (want)
+			return want;
+
 		return RC_HTTPS_RECV_ERROR;
 	}
 
-	*recv_len = len;
-
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	*recv_len = err;
 
 	return 0;
 }
@@ -1,5 +1,9 @@
+#include <stdlib.h>
+
+#include "hash.h"
 #include "md5.h"
 #include "sha1.h"
+#include <mbedtls/md.h>
 #include <mbedtls/md5.h>
 #include <mbedtls/sha1.h>
 
@@ -8,3 +12,70 @@ void md5(const unsigned char *input, size_t ilen, unsigned char output[16]) { mb
 
 /* Calculate the SHA-1 hash checksum of the given input */
 void sha1(const unsigned char *input, size_t ilen, unsigned char output[20]) { mbedtls_sha1(input, ilen, output); };
+
+static mbedtls_md_type_t md(hash_alg_t alg)
+{
+	switch (alg) {
+	case HASH_MD5:
+		return MBEDTLS_MD_MD5;
+	case HASH_SHA1:
+		return MBEDTLS_MD_SHA1;
+	case HASH_SHA256:
+		return MBEDTLS_MD_SHA256;
+	}
+
+	return MBEDTLS_MD_NONE;
+}
+
+/* Start a streaming hash, see hash.h */
+int hash_init(hash_ctx_t *ctx, hash_alg_t alg)
+{
+	const mbedtls_md_info_t *info;
+	mbedtls_md_context_t *md_ctx;
+
+	ctx->alg  = alg;
+	ctx->priv = NULL;
+
+	info = mbedtls_md_info_from_type(md(alg));
+	if (!info)
+		return -1;
+
+	md_ctx = malloc(sizeof(*md_ctx));
+	if (!md_ctx)
+		return -1;
+
+	mbedtls_md_init(md_ctx);
+	if (mbedtls_md_setup(md_ctx, info, 0) || mbedtls_md_starts(md_ctx)) {
+		mbedtls_md_free(md_ctx);
+		free(md_ctx);
+		return -1;
+	}
+	ctx->priv = md_ctx;
+
+	return 0;
+}
+
+int hash_update(hash_ctx_t *ctx, const void *data, size_t len)
+{
+	if (!ctx->priv)
+		return -1;
+
+	return mbedtls_md_update(ctx->priv, data, len) ? -1 : 0;
+}
+
+/* Write digest, unless @digest is NULL, and release the context */
+int hash_final(hash_ctx_t *ctx, unsigned char *digest)
+{
+	int rc = 0;
+
+	if (!ctx->priv)
+		return -1;
+
+	if (digest && mbedtls_md_finish(ctx->priv, digest))
+		rc = -1;
+	mbedtls_md_free(ctx->priv);
+	free(ctx->priv);
+	ctx->priv = NULL;
+
+	return rc;
+}
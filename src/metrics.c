@@ -0,0 +1,441 @@
+/* Prometheus metrics exporter, textfile collector format
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * With metrics-file set, the state of inadyn is written at the end of
+ * every cycle in the Prometheus text exposition format, for the node
+ * exporter's textfile collector or anything else that can serve a
+ * file.  The file is written next to its final name and renamed over
+ * it, so a scraper never sees half of it.
+ *
+ * Nothing is collected just for the exporter, it only formats what is
+ * kept anyway: the HTTP latency histograms of each provider and checkip
+ * server, the schedule and backoff state, the aliases, and the state
+ * file counters.  The only additions are the per-provider update
+ * counters, the per-worker counters with concurrency, and the cycle
+ * time, a few additions per cycle.  So it costs
+ * one small file write per cycle when enabled, and nothing otherwise.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "ddns.h"
+#include "event.h"
+#include "hook.h"
+#include "metrics.h"
+#include "resource.h"
+
+char *metrics_file = NULL;
+
+static time_t        started;
+static unsigned long cycles;
+static long long     cycle_msec;	/* Duration of last cycle */
+
+static unsigned long worker_jobs[DDNS_MAX_CONCURRENCY];
+static long long     worker_msec[DDNS_MAX_CONCURRENCY];
+static int           num_workers;	/* Highest worker seen, plus one */
+
+extern ddns_info_t *conf_info_iterator(int first);
+
+/* Count the result of one update, called for every alias updated */
+void metrics_update(ddns_info_t *info, int rc)
+{
+	if (rc < 0 || rc >= DDNS_MAX_RC)
+		rc = RC_ERROR;
+
+	info->updates[rc]++;
+}
+
+/* Account one pass of the main loop, @msec is how long it took */
+void metrics_cycle(long long msec)
+{
+	if (!started)
+		started = time(NULL);
+
+	cycles++;
+	cycle_msec = msec;
+}
+
+/* Account @jobs run by update worker @id, busy for @msec, main thread only */
+void metrics_worker(int id, unsigned long jobs, long long msec)
+{
+	if (id < 0 || id >= DDNS_MAX_CONCURRENCY)
+		return;
+
+	worker_jobs[id] += jobs;
+	worker_msec[id] += msec;
+	if (id >= num_workers)
+		num_workers = id + 1;
+}
+
+/* Label values are quoted, with backslash, quote and newline escaped */
+static void label(FILE *fp, const char *name, const char *val)
+{
+	fprintf(fp, "%s=\"", name);
+	for (; val && *val; val++) {
+		switch (*val) {
+		case '\\':
+			fputs("\\\\", fp);
+			break;
+		case '"':
+			fputs("\\\"", fp);
+			break;
+		case '\n':
+			fputs("\\n", fp);
+			break;
+		default:
+			fputc(*val, fp);
+			break;
+		}
+	}
+	fputc('"', fp);
+}
+
+static void family(FILE *fp, const char *name, const char *type, const char *help)
+{
+	fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Start a sample of @name with provider label, caller adds the rest */
+static void sample(FILE *fp, const char *name, ddns_info_t *info)
+{
+	fprintf(fp, "%s{", name);
+	label(fp, "provider", info->system->name);
+}
+
+static void histogram(FILE *fp, ddns_info_t *info, const char *role, http_t *client)
+{
+	const char *server = client->tcp.remote_host;
+	int i, j;
+
+	for (i = 0; i < HTTP_PHASE_MAX; i++) {
+		http_hist_t *hist = &client->stats.phase[i];
+		unsigned long sum = 0;
+
+		if (!hist->num)
+			continue;
+
+		for (j = 0; j <= HTTP_HIST_BUCKETS; j++) {
+			long long le = http_hist_bound(j);
+			char bound[24];
+
+			sum += hist->count[j];
+			if (le < 0)
+				snprintf(bound, sizeof(bound), "+Inf");
+			else
+				snprintf(bound, sizeof(bound), "%lld.%03lld", le / 1000, le % 1000);
+
+			sample(fp, "inadyn_http_duration_seconds_bucket", info);
+			fputc(',', fp);
+			label(fp, "role", role);
+			fputc(',', fp);
+			label(fp, "server", server);
+			fputc(',', fp);
+			label(fp, "phase", http_phase_name(i));
+			fputc(',', fp);
+			label(fp, "le", bound);
+			fprintf(fp, "} %lu\n", sum);
+		}
+
+		sample(fp, "inadyn_http_duration_seconds_sum", info);
+		fputc(',', fp);
+		label(fp, "role", role);
+		fputc(',', fp);
+		label(fp, "server", server);
+		fputc(',', fp);
+		label(fp, "phase", http_phase_name(i));
+		fprintf(fp, "} %lld.%03lld\n", hist->sum / 1000, hist->sum % 1000);
+
+		sample(fp, "inadyn_http_duration_seconds_count", info);
+		fputc(',', fp);
+		label(fp, "role", role);
+		fputc(',', fp);
+		label(fp, "server", server);
+		fputc(',', fp);
+		label(fp, "phase", http_phase_name(i));
+		fprintf(fp, "} %lu\n", hist->num);
+	}
+}
+
+static void circuit(FILE *fp, ddns_info_t *info, const char *role, const char *server, breaker_t *b)
+{
+	sample(fp, "inadyn_circuit_state", info);
+	fputc(',', fp);
+	label(fp, "role", role);
+	fputc(',', fp);
+	label(fp, "server", server);
+	fprintf(fp, "} %d\n", b->state);
+}
+
+static void failures(FILE *fp, ddns_info_t *info, const char *role, http_t *client)
+{
+	sample(fp, "inadyn_http_failures_total", info);
+	fputc(',', fp);
+	label(fp, "role", role);
+	fputc(',', fp);
+	label(fp, "server", client->tcp.remote_host);
+	fprintf(fp, "} %lu\n", client->stats.failed);
+}
+
+/* Heap by subsystem, with --enable-memstat, descriptors and hooks */
+static void render_resources(FILE *fp)
+{
+	mem_tag_t *tag;
+	int num;
+
+	if (mem_tags()) {
+		family(fp, "inadyn_memory_bytes", "gauge", "Heap in use, by subsystem or plugin.");
+		for (tag = mem_tags(); tag; tag = tag->next)
+			fprintf(fp, "inadyn_memory_bytes{tag=\"%s\"} %zu\n", tag->name, tag->bytes);
+
+		family(fp, "inadyn_memory_peak_bytes", "gauge", "Most heap in use, by subsystem or plugin.");
+		for (tag = mem_tags(); tag; tag = tag->next)
+			fprintf(fp, "inadyn_memory_peak_bytes{tag=\"%s\"} %zu\n", tag->name, tag->peak);
+
+		family(fp, "inadyn_memory_allocations_total", "counter", "Heap allocations, by subsystem or plugin.");
+		for (tag = mem_tags(); tag; tag = tag->next)
+			fprintf(fp, "inadyn_memory_allocations_total{tag=\"%s\"} %lu\n", tag->name, tag->allocs);
+
+		family(fp, "inadyn_memory_frees_total", "counter", "Heap allocations released, by subsystem or plugin.");
+		for (tag = mem_tags(); tag; tag = tag->next)
+			fprintf(fp, "inadyn_memory_frees_total{tag=\"%s\"} %lu\n", tag->name, tag->frees);
+	}
+
+	num = res_fds();
+	if (num >= 0) {
+		family(fp, "inadyn_open_fds", "gauge", "Open file descriptors.");
+		fprintf(fp, "inadyn_open_fds %d\n", num);
+	}
+
+	family(fp, "inadyn_child_processes", "gauge", "Hooks still running.");
+	fprintf(fp, "inadyn_child_processes %d\n", hook_running());
+}
+
+static void render_providers(FILE *fp)
+{
+	time_t now = event_wall(), mono = event_now();
+	ddns_info_t *info;
+	size_t i;
+	int rc;
+
+	family(fp, "inadyn_updates_total", "counter", "DDNS updates sent, by result code.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		for (rc = 0; rc < DDNS_MAX_RC; rc++) {
+			if (!info->updates[rc])
+				continue;
+
+			sample(fp, "inadyn_updates_total", info);
+			fprintf(fp, ",code=\"%d\",", rc);
+			label(fp, "result", error_name(rc));
+			fprintf(fp, "} %lu\n", info->updates[rc]);
+		}
+	}
+
+	family(fp, "inadyn_provider_status", "gauge", "Result code of last check, zero if OK.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		sample(fp, "inadyn_provider_status", info);
+		fprintf(fp, "} %d\n", info->status);
+	}
+
+	family(fp, "inadyn_provider_retries", "gauge", "Failed checks in a row, backoff step.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		sample(fp, "inadyn_provider_retries", info);
+		fprintf(fp, "} %u\n", info->retries);
+	}
+
+	family(fp, "inadyn_provider_next_check_timestamp_seconds", "gauge", "When the provider is checked next.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		sample(fp, "inadyn_provider_next_check_timestamp_seconds", info);
+		fprintf(fp, "} %lld\n", (long long)(now + (info->next_check - mono)));
+	}
+
+	family(fp, "inadyn_alias_info", "gauge", "Address last sent for each hostname.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		for (i = 0; i < info->alias_count; i++) {
+			sample(fp, "inadyn_alias_info", info);
+			fputc(',', fp);
+			label(fp, "hostname", info->alias[i].name);
+			fputc(',', fp);
+			label(fp, "address", info->alias[i].address);
+			fprintf(fp, "} 1\n");
+		}
+	}
+
+	family(fp, "inadyn_alias_last_update_timestamp_seconds", "gauge", "Time of last successful update.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		for (i = 0; i < info->alias_count; i++) {
+			sample(fp, "inadyn_alias_last_update_timestamp_seconds", info);
+			fputc(',', fp);
+			label(fp, "hostname", info->alias[i].name);
+			fprintf(fp, "} %lld\n", (long long)info->alias[i].last_update);
+		}
+	}
+
+	family(fp, "inadyn_alias_failures", "gauge", "Failed updates in a row.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		for (i = 0; i < info->alias_count; i++) {
+			sample(fp, "inadyn_alias_failures", info);
+			fputc(',', fp);
+			label(fp, "hostname", info->alias[i].name);
+			fprintf(fp, "} %u\n", info->alias[i].fails);
+		}
+	}
+
+	family(fp, "inadyn_checkip_rtt_seconds", "gauge", "Moving average reply time of checkip server.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		for (i = 0; i < info->checkip_num; i++) {
+			ddns_checkip_t *srv = &info->checkip[i];
+
+			if (!srv->rtt)
+				continue;
+
+			sample(fp, "inadyn_checkip_rtt_seconds", info);
+			fputc(',', fp);
+			label(fp, "server", srv->name.name);
+			fprintf(fp, "} %d.%03d\n", srv->rtt / 1000, srv->rtt % 1000);
+		}
+	}
+
+	family(fp, "inadyn_http_duration_seconds", "histogram", "Duration of HTTP(S) conversations, by phase.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		histogram(fp, info, "update", &info->server);
+		for (i = 0; i < info->checkip_num; i++)
+			histogram(fp, info, "checkip", &info->checkip[i].client);
+	}
+
+	family(fp, "inadyn_circuit_state", "gauge", "Circuit breaker, 0: closed, 1: open, 2: half-open.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		circuit(fp, info, "update", info->server_name.name, &info->breaker);
+		for (i = 0; i < info->checkip_num; i++)
+			circuit(fp, info, "checkip", info->checkip[i].name.name, &info->checkip[i].breaker);
+	}
+
+	family(fp, "inadyn_http_failures_total", "counter", "Failed HTTP(S) conversations.");
+	for (info = conf_info_iterator(1); info; info = conf_info_iterator(0)) {
+		failures(fp, info, "update", &info->server);
+		for (i = 0; i < info->checkip_num; i++)
+			failures(fp, info, "checkip", &info->checkip[i].client);
+	}
+}
+
+/**
+ * metrics_render - Write all metrics in Prometheus text format
+ * @fp: Where to write, e.g. a file or a socket
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero if writing failed.
+ */
+int metrics_render(FILE *fp)
+{
+	const cache_stats_t *cs = cache_stats();
+
+	family(fp, "inadyn_build_info", "gauge", "Version of inadyn.");
+	fprintf(fp, "inadyn_build_info{version=\"%s\"} 1\n", VERSION);
+
+	family(fp, "inadyn_start_time_seconds", "gauge", "When inadyn started its first cycle.");
+	fprintf(fp, "inadyn_start_time_seconds %lld\n", (long long)started);
+
+	family(fp, "inadyn_cycles_total", "counter", "Passes of the main loop.");
+	fprintf(fp, "inadyn_cycles_total %lu\n", cycles);
+
+	family(fp, "inadyn_cycle_duration_seconds", "gauge", "Duration of the last pass of the main loop.");
+	fprintf(fp, "inadyn_cycle_duration_seconds %lld.%03lld\n", cycle_msec / 1000, cycle_msec % 1000);
+
+	if (num_workers) {
+		int i;
+
+		family(fp, "inadyn_worker_jobs_total", "counter", "Providers checked or updated, by worker thread.");
+		for (i = 0; i < num_workers; i++)
+			fprintf(fp, "inadyn_worker_jobs_total{worker=\"%d\"} %lu\n", i, worker_jobs[i]);
+
+		family(fp, "inadyn_worker_busy_seconds_total", "counter", "Time spent on checks and updates, by worker thread.");
+		for (i = 0; i < num_workers; i++)
+			fprintf(fp, "inadyn_worker_busy_seconds_total{worker=\"%d\"} %lld.%03lld\n", i,
+				worker_msec[i] / 1000, worker_msec[i] % 1000);
+	}
+
+	family(fp, "inadyn_cache_writes_total", "counter", "State file writes, by result.");
+	fprintf(fp, "inadyn_cache_writes_total{result=\"written\"} %lu\n", cs->written);
+	fprintf(fp, "inadyn_cache_writes_total{result=\"unchanged\"} %lu\n", cs->skipped);
+	fprintf(fp, "inadyn_cache_writes_total{result=\"failed\"} %lu\n", cs->failed);
+
+	family(fp, "inadyn_cache_syncs_total", "counter", "State file writes that were fsync()'ed.");
+	fprintf(fp, "inadyn_cache_syncs_total %lu\n", cs->synced);
+
+	render_resources(fp);
+	render_providers(fp);
+
+	return ferror(fp) ? RC_FILE_IO_ACCESS_ERROR : 0;
+}
+
+/**
+ * metrics_write - Replace metrics-file with the current metrics
+ *
+ * Does nothing unless metrics-file is set.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error writing the file.
+ */
+int metrics_write(void)
+{
+	char tmp[strlen(metrics_file ? metrics_file : "") + 5];
+	FILE *fp;
+	int rc;
+
+	if (!metrics_file)
+		return 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", metrics_file);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		logit(LOG_WARNING, "Failed creating %s: %s", tmp, strerror(errno));
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	rc = metrics_render(fp);
+	if (fclose(fp))
+		rc = RC_FILE_IO_ACCESS_ERROR;
+	if (rc) {
+		logit(LOG_WARNING, "Failed writing %s: %s", tmp, strerror(errno));
+		unlink(tmp);
+		return rc;
+	}
+
+	if (rename(tmp, metrics_file)) {
+		logit(LOG_WARNING, "Failed replacing %s: %s", metrics_file, strerror(errno));
+		unlink(tmp);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,250 @@
+/* Service manager integration, readiness, status, watchdog and sockets
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Started by systemd, or anything speaking the same protocol, inadyn
+ * tells the service manager when it is ready, what it is doing, and
+ * that it is still alive.  Messages are datagrams to $NOTIFY_SOCKET,
+ * so no library is needed, and without the variable nothing is sent.
+ *
+ * With WatchdogSec= set in the unit, $WATCHDOG_USEC is the time after
+ * which the service is considered hung.  The main loop pings twice per
+ * interval, so a cycle wedged in, e.g., a network stack that does not
+ * time out, gets the service restarted.
+ *
+ * Listening sockets passed with socket activation, $LISTEN_FDS, are
+ * looked up by their FileDescriptorName=, e.g. control or metrics.
+ * They stay open across reloads, see ctrl.c.
+ *
+ * The variables are cleared, so --exec hooks do not inherit them.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "event.h"
+#include "log.h"
+#include "notify.h"
+
+#define LISTEN_FDS_START 3
+
+static struct sockaddr_un addr;
+static socklen_t          addrlen;
+static int                sd = -1;
+
+static long long          interval;	/* msec, half of WatchdogSec=, 0: off */
+static long long          last_ping;
+
+static int                num_fds;
+static char              *fd_names[NOTIFY_MAX_FDS];
+
+static void init_notify(void)
+{
+	const char *path = getenv("NOTIFY_SOCKET");
+	const char *usec = getenv("WATCHDOG_USEC");
+	const char *pid  = getenv("WATCHDOG_PID");
+	size_t len;
+
+	if (!path || (path[0] != '/' && path[0] != '@'))
+		return;
+
+	len = strlen(path);
+	if (len >= sizeof(addr.sun_path)) {
+		logit(LOG_WARNING, "Service manager socket %s too long, ignoring.", path);
+		return;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path, len);
+	if (path[0] == '@')
+		addr.sun_path[0] = 0;	/* Abstract namespace */
+	addrlen = offsetof(struct sockaddr_un, sun_path) + len;
+
+	sd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (sd < 0) {
+		logit(LOG_WARNING, "Failed opening service manager socket: %s", strerror(errno));
+		return;
+	}
+	fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+
+	if (usec && (!pid || atoi(pid) == getpid()))
+		interval = strtoll(usec, NULL, 10) / 2000;
+	if (interval > 0)
+		logit(LOG_DEBUG, "Service watchdog enabled, ping every %lld msec", interval);
+}
+
+static void init_fds(void)
+{
+	const char *fds   = getenv("LISTEN_FDS");
+	const char *pid   = getenv("LISTEN_PID");
+	const char *names = getenv("LISTEN_FDNAMES");
+	char *list, *name;
+	int i;
+
+	if (!fds || !pid || atoi(pid) != getpid())
+		return;
+
+	num_fds = atoi(fds);
+	if (num_fds < 0)
+		num_fds = 0;
+	if (num_fds > NOTIFY_MAX_FDS) {
+		logit(LOG_WARNING, "Only %d of %d sockets from service manager used.", NOTIFY_MAX_FDS, num_fds);
+		num_fds = NOTIFY_MAX_FDS;
+	}
+
+	list = names ? strdup(names) : NULL;
+	name = list ? strtok(list, ":") : NULL;
+	for (i = 0; i < num_fds; i++) {
+		int fd = LISTEN_FDS_START + i;
+
+		fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+		fd_names[i] = strdup(name ? name : "unknown");
+		name = name ? strtok(NULL, ":") : NULL;
+	}
+	free(list);
+}
+
+/**
+ * notify_init - Pick up service manager settings from the environment
+ *
+ * Safe to call more than once, only the first call does anything.
+ */
+void notify_init(void)
+{
+	static int done;
+
+	if (done)
+		return;
+	done = 1;
+
+	init_notify();
+	init_fds();
+
+	unsetenv("NOTIFY_SOCKET");
+	unsetenv("WATCHDOG_USEC");
+	unsetenv("WATCHDOG_PID");
+	unsetenv("LISTEN_FDS");
+	unsetenv("LISTEN_PID");
+	unsetenv("LISTEN_FDNAMES");
+}
+
+/**
+ * notify - Send state to the service manager
+ * @fmt: Newline separated assignments, e.g. "READY=1\nSTATUS=Running"
+ *
+ * Returns:
+ * POSIX OK(0), also when not started by a service manager, or -1 if
+ * the message could not be sent.
+ */
+int notify(const char *fmt, ...)
+{
+	char msg[NOTIFY_MAX_MSG];
+	va_list ap;
+	int len;
+
+	if (sd < 0)
+		return 0;
+
+	va_start(ap, fmt);
+	len = vsnprintf(msg, sizeof(msg), fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return -1;
+	if ((size_t)len >= sizeof(msg))
+		len = sizeof(msg) - 1;
+
+	if (sendto(sd, msg, len, MSG_NOSIGNAL, (struct sockaddr *)&addr, addrlen) < 0) {
+		logit_limit(LOG_DEBUG, "Failed notifying service manager: %s", strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Tell the watchdog we are alive, if it is time to */
+void notify_watchdog(void)
+{
+	long long now;
+
+	if (interval <= 0)
+		return;
+
+	now = event_msec();
+	if (last_ping && now - last_ping < interval)
+		return;
+
+	if (!notify("WATCHDOG=1"))
+		last_ping = now;
+}
+
+/* Time, in msec, until the watchdog must be pinged, or -1 if disabled */
+int notify_next(void)
+{
+	long long left;
+
+	if (interval <= 0)
+		return -1;
+
+	left = last_ping + interval - event_msec();
+	if (left < 0)
+		left = 0;
+	if (left > INT32_MAX)
+		left = INT32_MAX;
+
+	return (int)left;
+}
+
+/**
+ * notify_fd - Listening socket passed by the service manager
+ * @name: FileDescriptorName= of the socket in the .socket unit
+ *
+ * Returns:
+ * The descriptor, or -1 if no socket with that name was passed.
+ */
+int notify_fd(const char *name)
+{
+	int i;
+
+	for (i = 0; i < num_fds; i++) {
+		if (!strcmp(fd_names[i], name))
+			return LISTEN_FDS_START + i;
+	}
+
+	return -1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
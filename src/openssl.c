@@ -19,10 +19,28 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <pthread.h>
+
+#include "compat.h"
 #include "log.h"
 #include "http.h"
 #include "ssl.h"
 
+/* Shared by all clients, possibly in parallel update workers */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static SSL_CTX        *ssl_ctx;
+
+/* CA bundle loaded into ssl_ctx, for detecting changes */
+static char            ca_file[256];
+static time_t          ca_mtime;
+static int             ca_reload;
+
+static struct {
+	char         host[256];
+	SSL_SESSION *session;
+} cache[SSL_SESSION_CACHE_SIZE];
+static int cache_next;
+
 int ssl_init(void)
 {
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
@@ -36,12 +54,36 @@ int ssl_init(void)
 
 void ssl_exit(void)
 {
+	int i;
+
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].session)
+			SSL_SESSION_free(cache[i].session);
+		cache[i].session = NULL;
+		cache[i].host[0] = 0;
+	}
+	cache_next = 0;
+
+	if (ssl_ctx)
+		SSL_CTX_free(ssl_ctx);
+	ssl_ctx = NULL;
+	ca_file[0] = 0;
+	ca_mtime   = 0;
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 	ERR_free_strings();
 	EVP_cleanup();
 #endif
 }
 
+/* Reload CA trust store on next connection, e.g. on SIGHUP */
+void ssl_reload(void)
+{
+	pthread_mutex_lock(&lock);
+	ca_reload = 1;
+	pthread_mutex_unlock(&lock);
+}
+
 static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 {
 	char    buf[256];
@@ -91,26 +133,43 @@ static int verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
 	return 1;
 }
 
-static int ssl_set_ca_location(http_t *client)
+/* Returns the CA bundle file loaded, or NULL on error */
+static const char *ssl_set_ca_location(SSL_CTX *ctx)
 {
-	int ret;
-
 	/* A user defined CA PEM bundle overrides any built-ins or fall-backs */
 	if (ca_trust_file) {
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, ca_trust_file, NULL);
-		goto done;
+		if (SSL_CTX_load_verify_locations(ctx, ca_trust_file, NULL) < 1)
+			return NULL;
+		return ca_trust_file;
 	}
 
-	ret = SSL_CTX_set_default_verify_paths(client->ssl_ctx);
-	if (ret < 1)
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, CAFILE1, NULL);
-	if (ret < 1)
-		ret = SSL_CTX_load_verify_locations(client->ssl_ctx, CAFILE2, NULL);
-done:
-	if (ret < 1)
+	if (SSL_CTX_set_default_verify_paths(ctx) == 1)
+		return X509_get_default_cert_file();
+	if (SSL_CTX_load_verify_locations(ctx, CAFILE1, NULL) == 1)
+		return CAFILE1;
+	if (SSL_CTX_load_verify_locations(ctx, CAFILE2, NULL) == 1)
+		return CAFILE2;
+
+	return NULL;
+}
+
+/* Remember what we loaded, or tried to load, to detect changes later */
+static void ca_stamp(const char *file)
+{
+	strlcpy(ca_file, file ? file : "", sizeof(ca_file));
+	ca_mtime  = fmtime(ca_file);
+	ca_reload = 0;
+}
+
+/* Has the user picked, or replaced, the CA bundle since we loaded it? */
+static int ca_stale(void)
+{
+	if (ca_reload)
+		return 1;
+	if (ca_trust_file && strcmp(ca_trust_file, ca_file))
 		return 1;
 
-	return 0;
+	return fmtime(ca_file) != ca_mtime;
 }
 
 static int ssl_error_cb(const char *str, size_t len, void *data)
@@ -138,71 +197,307 @@ static int ssl_fail(http_t *client, int rc)
 	if (!client)
 		return rc;
 
-	if (!client->ssl_ctx)
-		tcp_exit(&client->tcp);
-	else
-		ssl_close(client);
+	ssl_close(client);
 
 	return rc;
 }
 
-int ssl_open(http_t *client, char *msg, int force)
+/*
+ * Set up the shared SSL_CTX on first use, and again when the CA trust
+ * store must be reloaded.  Connections in progress hold a reference to
+ * the previous SSL_CTX, so it is freed when the last one is closed.
+ * Called with lock held.
+ */
+static int ssl_ctx_init(void)
 {
-	const char *sn;
-	char buf[512];
-	int port = 0;
-	X509 *cert;
-	int rc;
-
-	if (!client->ssl_enabled)
-		return tcp_init(&client->tcp, msg, force);
+	const char *file;
+	SSL_CTX *ctx;
 
-	http_get_port(client, &port);
-	if (!port)
-		http_set_port(client, HTTPS_DEFAULT_PORT);
-	DO(tcp_init(&client->tcp, msg, force));
+	if (ssl_ctx && !ca_stale())
+		return 0;
 
-	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
-	client->ssl_ctx = SSL_CTX_new(SSLv23_client_method());
-	if (!client->ssl_ctx)
-		return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
+	ctx = SSL_CTX_new(SSLv23_client_method());
+	if (!ctx)
+		return RC_HTTPS_OUT_OF_MEMORY;
 
 	/* POODLE, only allow TLSv1.x or later */
 #ifndef OPENSSL_NO_EC
-	SSL_CTX_set_options(client->ssl_ctx, SSL_OP_SINGLE_ECDH_USE | SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+	SSL_CTX_set_options(ctx, SSL_OP_SINGLE_ECDH_USE | SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
 #else
-	SSL_CTX_set_options(client->ssl_ctx, SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
+	SSL_CTX_set_options(ctx, SSL_OP_SINGLE_DH_USE | SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION);
 #endif
 	/* verify should be optional. routers might not have accurate time setting */
-	SSL_CTX_set_verify(client->ssl_ctx, SSL_VERIFY_PEER, verify_callback);
-	SSL_CTX_set_verify_depth(client->ssl_ctx, 150);
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, verify_callback);
+	SSL_CTX_set_verify_depth(ctx, 150);
+
+	/* We keep track of sessions ourselves, see session_save() */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
 
 	/* Try to figure out location of trusted CA certs on system */
-	if (ssl_set_ca_location(client))
-		return ssl_fail(client, RC_HTTPS_NO_TRUSTED_CA_STORE);
+	file = ssl_set_ca_location(ctx);
+	if (!file) {
+		SSL_CTX_free(ctx);
+		ca_stamp(ca_trust_file);
+		if (!ssl_ctx)
+			return RC_HTTPS_NO_TRUSTED_CA_STORE;
+
+		logit(LOG_WARNING, "Failed reloading CA trust store, keeping previous one.");
+		return 0;
+	}
+
+	logit(LOG_DEBUG, "Loaded CA trust store %s", file);
+	ca_stamp(file);
+
+	if (ssl_ctx)
+		SSL_CTX_free(ssl_ctx);
+	ssl_ctx = ctx;
+
+	return 0;
+}
+
+/* Resume previous session with @host, if we have one */
+static void session_load(SSL *ssl, const char *host)
+{
+	int i;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (!cache[i].session || strcmp(cache[i].host, host))
+			continue;
+
+		SSL_set_session(ssl, cache[i].session);
+		break;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Called when closing, rather than after the handshake, because with
+ * TLS 1.3 the session ticket arrives after the handshake has completed
+ */
+static void session_save(SSL *ssl, const char *host)
+{
+	SSL_SESSION *session;
+	int i;
+
+	session = SSL_get1_session(ssl);
+	if (!session)
+		return;
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_SESSION_is_resumable(session)) {
+		SSL_SESSION_free(session);
+		return;
+	}
+#endif
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < SSL_SESSION_CACHE_SIZE; i++) {
+		if (cache[i].session && !strcmp(cache[i].host, host))
+			break;
+	}
+
+	/* Not found, replace the oldest entry */
+	if (i == SSL_SESSION_CACHE_SIZE) {
+		i = cache_next;
+		cache_next = (cache_next + 1) % SSL_SESSION_CACHE_SIZE;
+	}
+
+	if (cache[i].session)
+		SSL_SESSION_free(cache[i].session);
+	strlcpy(cache[i].host, host, sizeof(cache[i].host));
+	cache[i].session = session;
+	pthread_mutex_unlock(&lock);
+}
+
+/* Map SSL_ERROR_WANT_* to our non-blocking return codes, or -1 */
+static int ssl_want(http_t *client, int rc)
+{
+	switch (SSL_get_error(client->ssl, rc)) {
+	case SSL_ERROR_WANT_READ:
+		return RC_TCP_WANT_READ;
+
+	case SSL_ERROR_WANT_WRITE:
+		return RC_TCP_WANT_WRITE;
+
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+/*
+ * TLS 1.3 early data, the request is sent in the first flight when the
+ * session resumed allows it, before the handshake has completed.  Only
+ * for requests that are safe to replay, see http_exchange().  Whatever
+ * is written counts as sent, see ssl_handshake() for when the server
+ * rejects it.
+ */
+static int early_write(http_t *client)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	http_trans_t *trans = client->trans;
+	size_t len;
+
+	/* Decided before the handshake starts, sticks until it is done */
+	if (!client->early) {
+		SSL_SESSION *session;
+
+		if (!client->early_data || !trans || !SSL_in_before(client->ssl))
+			return 0;
+
+		/* The request is HTTP/1.1, but ALPN may yet choose h2 */
+		if (client->http2)
+			return 0;
+
+		session = SSL_get_session(client->ssl);
+		if (!session || SSL_SESSION_get_max_early_data(session) < (uint32_t)trans->req_len)
+			return 0;
+
+		logit(LOG_DEBUG, "Sending request as TLS early data");
+		client->early = 1;
+	}
+
+	while (client->sent < trans->req_len) {
+		int rc;
 
-	client->ssl = SSL_new(client->ssl_ctx);
-	if (!client->ssl)
-		return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
+		ERR_clear_error();
+		rc = SSL_write_early_data(client->ssl, trans->req + client->sent,
+					  trans->req_len - client->sent, &len);
+		if (rc <= 0) {
+			int want = ssl_want(client, rc);
+
+			if (want > 0)
+				return want;
+
+			ssl_check_error();
+			return RC_HTTPS_SEND_ERROR;
+		}
+
+		client->sent += len;
+	}
+#else
+	(void)client;
+#endif
+
+	return 0;
+}
+
+/* After the handshake, if the early data was rejected we must send again */
+static void early_done(http_t *client)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!client->early)
+		return;
+
+	client->early = 0;
+	if (SSL_get_early_data_status(client->ssl) == SSL_EARLY_DATA_ACCEPTED) {
+		logit(LOG_DEBUG, "TLS early data accepted by server");
+		return;
+	}
+
+	logit(LOG_DEBUG, "TLS early data rejected by server, resending request");
+	client->sent = 0;
+#else
+	(void)client;
+#endif
+}
+
+int ssl_open(http_t *client, char *msg)
+{
+	const char *sn;
+	int rc;
+
+	if (!client->ssl_enabled)
+		return 0;
+
+	logit(LOG_INFO, "%s, initiating HTTPS ...", msg);
+
+	pthread_mutex_lock(&lock);
+	rc = ssl_ctx_init();
+	if (!rc) {
+		client->ssl = SSL_new(ssl_ctx);
+		if (!client->ssl)
+			rc = RC_HTTPS_OUT_OF_MEMORY;
+	}
+	pthread_mutex_unlock(&lock);
+	if (rc)
+		return ssl_fail(client, rc);
 
 	/* SSL SNI support: tell the servername we want to speak to */
 	http_get_remote_name(client, &sn);
 	if (!SSL_set_tlsext_host_name(client->ssl, sn))
 		return ssl_fail(client, RC_HTTPS_SNI_ERROR);
 
+	session_load(client->ssl, sn);
+
+#if defined(ENABLE_HTTP2) && OPENSSL_VERSION_NUMBER >= 0x10002000L
+	if (client->http2) {
+		static const unsigned char alpn[] = "\x02h2\x08http/1.1";
+
+		if (SSL_set_alpn_protos(client->ssl, alpn, sizeof(alpn) - 1))
+			return ssl_fail(client, RC_HTTPS_OUT_OF_MEMORY);
+	}
+#endif
+
 	SSL_set_fd(client->ssl, client->tcp.socket);
+
+	return 0;
+}
+
+/* Did the server select h2 in ALPN, see ssl_open() */
+int ssl_alpn_h2(http_t *client)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	const unsigned char *proto = NULL;
+	unsigned int len = 0;
+
+	if (!client->ssl_enabled || !client->ssl)
+		return 0;
+
+	SSL_get0_alpn_selected(client->ssl, &proto, &len);
+
+	return len == 2 && !memcmp(proto, "h2", 2);
+#else
+	(void)client;
+	return 0;
+#endif
+}
+
+int ssl_handshake(http_t *client)
+{
+	char buf[512];
+	X509 *cert;
+	int rc;
+
+	if (!client->ssl_enabled)
+		return 0;
+
+	rc = early_write(client);
+	if (rc)
+		return rc;
+
+	ERR_clear_error();
 	rc = SSL_connect(client->ssl);
-	if (rc < 0) {
+	if (rc <= 0) {
+		int want = ssl_want(client, rc);
+
+		if (want > 0)
+			return want;
+
 		ssl_check_error();
-		return ssl_fail(client, RC_HTTPS_FAILED_CONNECT);
+		return RC_HTTPS_FAILED_CONNECT;
 	}
 
 	client->connected = 1;
-	logit(LOG_INFO, "SSL connection using %s", SSL_get_cipher(client->ssl));
+	logit(LOG_INFO, "SSL connection using %s%s", SSL_get_cipher(client->ssl),
+	      SSL_session_reused(client->ssl) ? ", resumed session" : "");
+	early_done(client);
 
 	cert = SSL_get_peer_certificate(client->ssl);
 	if (!cert)
-		return ssl_fail(client, RC_HTTPS_FAILED_GETTING_CERT);
+		return RC_HTTPS_FAILED_GETTING_CERT;
 
 	if (SSL_get_verify_result(client->ssl) == X509_V_OK)
 		logit(LOG_DEBUG, "Certificate OK");
@@ -222,75 +517,76 @@ int ssl_close(http_t *client)
 	if (client->ssl_enabled) {
 		if (client->ssl) {
 			/* SSL/TLS close_notify */
-			if (client->connected)
+			if (client->connected) {
+				const char *sn;
+
+				http_get_remote_name(client, &sn);
+				session_save(client->ssl, sn);
 				SSL_shutdown(client->ssl);
+			}
 
 			/* Clean up. */
 			SSL_free(client->ssl);
 			client->ssl = NULL;
 		}
-		if (client->ssl_ctx) {
-			SSL_CTX_free(client->ssl_ctx);
-			client->ssl_ctx = NULL;
-		}
 	}
 	client->connected = 0;
 
 	return tcp_exit(&client->tcp);
 }
 
-int ssl_send(http_t *client, const char *buf, int len)
+int ssl_send(http_t *client, const char *buf, int len, int *sent)
 {
-	int rc, err = SSL_ERROR_NONE;
+	int rc;
 
 	if (!client->ssl_enabled)
-		return tcp_send(&client->tcp, buf, len);
-
-	do {
-		ERR_clear_error();
-		rc = SSL_write(client->ssl, buf, len);
-		if (rc <= 0)
-			err = SSL_get_error(client->ssl, rc);
-	} while (err == SSL_ERROR_WANT_WRITE);
+		return tcp_send(&client->tcp, buf, len, sent);
 
+	*sent = 0;
+	ERR_clear_error();
+	rc = SSL_write(client->ssl, buf, len);
 	if (rc <= 0) {
+		int want = ssl_want(client, rc);
+
+		if (want > 0)
+			return want;
+
 		ssl_check_error();
 		return RC_HTTPS_SEND_ERROR;
 	}
 
-	logit(LOG_DEBUG, "Successfully sent HTTPS request!");
+	*sent = rc;
+	if (rc == len)
+		logit(LOG_DEBUG, "Successfully sent HTTPS request!");
 
 	return 0;
 }
 
 int ssl_recv(http_t *client, char *buf, int buf_len, int *recv_len)
 {
-	int rc, err, len = 0;
+	int rc;
 
 	if (!client->ssl_enabled)
 		return tcp_recv(&client->tcp, buf, buf_len, recv_len);
 
-	err = SSL_ERROR_NONE;
-	do {
-		ERR_clear_error();
-		rc = SSL_read(client->ssl, buf + len, buf_len - len);
-		if (rc > 0) {
-			len += rc;
-		} else {
-			err = SSL_get_error(client->ssl, rc);
-		}
-	} while (rc > 0 || err == SSL_ERROR_WANT_READ);
-
-	if (rc < 0) {
-		ssl_check_error();
-		return RC_HTTPS_RECV_ERROR;
+	*recv_len = 0;
+	ERR_clear_error();
+	rc = SSL_read(client->ssl, buf, buf_len);
+	if (rc > 0) {
+		*recv_len = rc;
+		return 0;
 	}
 
-	*recv_len = len;
+	/* Zero is a TLS close_notify, or the server just closing the connection */
+	if (rc == 0)
+		return 0;
 
-	logit(LOG_DEBUG, "Successfully received HTTPS response (%d/%d bytes)!", *recv_len, buf_len);
+	rc = ssl_want(client, rc);
+	if (rc > 0)
+		return rc;
 
-	return 0;
+	ssl_check_error();
+	return RC_HTTPS_RECV_ERROR;
 }
 
 /**
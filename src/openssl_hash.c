@@ -19,27 +19,83 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include "hash.h"
 #include "md5.h"
 #include "sha1.h"
-#include <openssl/md5.h>
-#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+#define EVP_MD_CTX_new  EVP_MD_CTX_create
+#define EVP_MD_CTX_free EVP_MD_CTX_destroy
+#endif
+
+static const EVP_MD *md(hash_alg_t alg)
+{
+	switch (alg) {
+	case HASH_MD5:
+		return EVP_md5();
+	case HASH_SHA1:
+		return EVP_sha1();
+	case HASH_SHA256:
+		return EVP_sha256();
+	}
+
+	return NULL;
+}
+
+/* Start a streaming hash, see hash.h */
+int hash_init(hash_ctx_t *ctx, hash_alg_t alg)
+{
+	EVP_MD_CTX *evp;
+
+	ctx->alg  = alg;
+	ctx->priv = NULL;
+
+	evp = EVP_MD_CTX_new();
+	if (!evp)
+		return -1;
+
+	if (!EVP_DigestInit_ex(evp, md(alg), NULL)) {
+		EVP_MD_CTX_free(evp);
+		return -1;
+	}
+	ctx->priv = evp;
+
+	return 0;
+}
+
+int hash_update(hash_ctx_t *ctx, const void *data, size_t len)
+{
+	if (!ctx->priv)
+		return -1;
+
+	return EVP_DigestUpdate(ctx->priv, data, len) ? 0 : -1;
+}
+
+/* Write digest, unless @digest is NULL, and release the context */
+int hash_final(hash_ctx_t *ctx, unsigned char *digest)
+{
+	int rc = 0;
+
+	if (!ctx->priv)
+		return -1;
+
+	if (digest && !EVP_DigestFinal_ex(ctx->priv, digest, NULL))
+		rc = -1;
+	EVP_MD_CTX_free(ctx->priv);
+	ctx->priv = NULL;
+
+	return rc;
+}
 
 /* Calculate the MD5 hash checksum of the given input */
 void md5(const unsigned char *input, size_t ilen, unsigned char output[16])
 {
-	MD5_CTX ctx;
-
-	MD5_Init(&ctx);
-	MD5_Update(&ctx, input, ilen);
-	MD5_Final(output, &ctx);
+	hash_digest(HASH_MD5, input, ilen, output);
 }
 
 /* Calculate the SHA-1 hash checksum of the given input */
 void sha1(const unsigned char *input, size_t ilen, unsigned char output[20])
 {
-	SHA_CTX ctx;
-
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, input, ilen);
-	SHA1_Final(output, &ctx);
+	hash_digest(HASH_SHA1, input, ilen, output);
 }
@@ -20,7 +20,10 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <fcntl.h>
 #include <libgen.h>		/* dirname() */
+#include <poll.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -28,55 +31,118 @@
 #include <stdlib.h>		/* atoi() */
 
 #include "log.h"
+#include "budget.h"
 #include "cache.h"
+#include "event.h"
 
 static void *param = NULL;
+static int   sigpipe[2] = { -1, -1 };
 
 
 /**
- * Execute shell script on successful update.
- * @cmd:  Full path to script or command to run
- * @ip:   IP address to set as %INADYN_IP env. variable
- * @name: String to set as %INADYN_HOSTNAME env. variable
- * @event:Event name to set as %INADYN_EVENT env. variable
- * @error:Error code to set as %INADYN_ERROR env. variable
+ * os_shell_read - Run command and read its output, with a timeout
+ * @cmd:     Command, or script, run with /bin/sh -c
+ * @name:    Provider name to set as %INADYN_PROVIDER env. variable
+ * @user:    Username to set as %INADYN_USER env. variable
+ * @buf:     Buffer for the output, always NUL terminated
+ * @len:     Size of @buf
+ * @timeout: Max time, in msec, to wait for the command to finish
  *
- * If inadyn has been started with the --iface=IFNAME command line
- * option the IFNAME is sent to the script as %INADYN_IFACE.
+ * The command runs in a process group of its own, so any children it
+ * starts are killed with it if @timeout expires.  Output beyond @len
+ * is discarded, we only need the first address anyway.
  *
  * Returns:
- * Posix %OK(0), or %RC_OS_FORK_FAILURE on vfork() failure
+ * Number of bytes read, or -1 on error, with @errno set.  %ETIMEDOUT
+ * if the command did not finish in time.
  */
-int os_shell_execute(char *cmd, char *ip, char *name, char *event, int error)
+ssize_t os_shell_read(const char *cmd, const char *name, const char *user, char *buf, size_t len, int timeout)
 {
-	int rc = 0;
-	int child;
-	char errbuf[11];
+	long long deadline;
+	size_t pos = 0;
+	int fd[2], err = 0;
+	pid_t child;
+
+	if (pipe(fd))
+		return -1;
 
-	child = vfork();
+	child = fork();
 	switch (child) {
 	case 0:
-		snprintf(errbuf, sizeof(errbuf), "%d", error);
-		setenv("INADYN_IP", ip, 1);
-		setenv("INADYN_HOSTNAME", name, 1);
-		setenv("INADYN_EVENT", event, 1);
-		setenv("INADYN_ERROR", errbuf, 1);
-		setenv("INADYN_ERROR_MESSAGE", error_str(error), 1);
-		if (iface)
-			setenv("INADYN_IFACE", iface, 1);
+		setpgid(0, 0);
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		setenv("INADYN_PROVIDER", name, 1);
+		setenv("INADYN_USER", user, 1);
 
 		execl("/bin/sh", "sh", "-c", cmd, (char *)0);
-		exit(1);
-		break;
+		_exit(1);
 
 	case -1:
-		rc = RC_OS_FORK_FAILURE;
-		break;
+		close(fd[0]);
+		close(fd[1]);
+		return -1;
+
 	default:
 		break;
 	}
 
-	return rc;
+	close(fd[1]);
+	fcntl(fd[0], F_SETFD, fcntl(fd[0], F_GETFD) | FD_CLOEXEC);
+	fcntl(fd[0], F_SETFL, fcntl(fd[0], F_GETFL) | O_NONBLOCK);
+
+	deadline = budget_clamp(event_msec() + timeout);
+	while (1) {
+		struct pollfd pfd = { .fd = fd[0], .events = POLLIN };
+		long long now = event_msec();
+		char dummy[128];
+		ssize_t num;
+		int rc;
+
+		if (now >= deadline) {
+			err = ETIMEDOUT;
+			break;
+		}
+
+		rc = poll(&pfd, 1, (int)(deadline - now));
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			err = errno;
+			break;
+		}
+		if (rc == 0)
+			continue;
+
+		/* Keep reading, even when full, so the command is not blocked */
+		if (pos < len - 1)
+			num = read(fd[0], &buf[pos], len - 1 - pos);
+		else
+			num = read(fd[0], dummy, sizeof(dummy));
+		if (num < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			err = errno;
+			break;
+		}
+		if (num == 0)
+			break;	/* EOF, command done */
+
+		if (pos < len - 1)
+			pos += num;
+	}
+	close(fd[0]);
+	buf[pos] = 0;
+
+	/* Reaped by the SIGCHLD handler, or ignored, see os_install_child_handler() */
+	if (err) {
+		kill(-child, SIGKILL);
+		errno = err;
+		return -1;
+	}
+
+	return pos;
 }
 
 /**
@@ -91,30 +157,41 @@ int os_shell_execute(char *cmd, char *ip, char *name, char *event, int error)
  * printf() is not one of the safe syscalls to be used, according to
  * POSIX signal(7). The calls are commented, since they are most likely
  * also only needed for debugging.
+ *
+ * The signal is also written to a self-pipe, registered with the main
+ * loop, to wake up the daemon immediately from event_wait().
  */
 static void unix_signal_handler(int signo)
 {
 	ddns_t *ctx = (ddns_t *)param;
+	int saved_errno = errno;
+	unsigned char sig = signo;
+
+	if (sigpipe[1] != -1) {
+		/* Wake up main loop, if pipe is full a wakeup is already pending */
+		if (write(sigpipe[1], &sig, sizeof(sig)) < 0)
+			errno = saved_errno;
+	}
 
 	if (ctx == NULL)
 		return;
 
 	switch (signo) {
 	case SIGHUP:
-		ctx->cmd = CMD_RESTART;
+		ddns_cmd(ctx, CMD_RESTART);
 		break;
 
 	case SIGINT:
 	case SIGTERM:
-		ctx->cmd = CMD_STOP;
+		ddns_cmd(ctx, CMD_STOP);
 		break;
 
 	case SIGUSR1:
-		ctx->cmd = CMD_FORCED_UPDATE;
+		ddns_cmd(ctx, CMD_FORCED_UPDATE);
 		break;
 
 	case SIGUSR2:
-		ctx->cmd = CMD_CHECK_NOW;
+		ddns_cmd(ctx, CMD_CHECK_NOW);
 		break;
 
 	default:
@@ -122,6 +199,31 @@ static void unix_signal_handler(int signo)
 	}
 }
 
+/* Drain self-pipe, ctx->cmd has already been set by the handler */
+static void signal_cb(int fd, void *arg)
+{
+	unsigned char buf[16];
+
+	(void)arg;
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static int signal_pipe(void)
+{
+	int i;
+
+	if (pipe(sigpipe))
+		return 1;
+
+	for (i = 0; i < 2; i++) {
+		fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC);
+		fcntl(sigpipe[i], F_SETFL, fcntl(sigpipe[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	return event_add(sigpipe[0], signal_cb, NULL);
+}
+
 static int signal_ignore(int signo)
 {
 	struct sigaction sa = { 0 };
@@ -163,7 +265,8 @@ static int os_install_child_handler(void)
  * Install signal handler for signals HUP, INT, TERM and USR1
  *
  * Also block exactly the handled signals, only for the duration
- * of the handler.  All other signals are left alone.
+ * of the handler.  All other signals are left alone.  Signals are
+ * forwarded to the main loop through a self-pipe.
  */
 int os_install_signal_handler(void *ctx)
 {
@@ -179,7 +282,8 @@ int os_install_signal_handler(void *ctx)
 #endif
 		sa.sa_handler = unix_signal_handler;
 
-		rc = (sigemptyset(&sa.sa_mask)        ||
+		rc = (signal_pipe()                   ||
+		      sigemptyset(&sa.sa_mask)        ||
 		      sigaddset(&sa.sa_mask, SIGHUP)  ||
 		      sigaddset(&sa.sa_mask, SIGINT)  ||
 		      sigaddset(&sa.sa_mask, SIGTERM) ||
@@ -23,14 +23,167 @@
 
 #include "config.h"
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <dirent.h>		/* readdir() et al */
 #include <string.h>
 
 #include "ddns.h"
+#include "quota.h"
+#include "resource.h"
+#include "trace.h"
+
+MEM_TAG("plugin");
+
+#define INDEX_MIN_SIZE 128	/* Slots, power of two, 2x the built-in plugins */
+
+/*
+ * Exact, case insensitive, lookups of name and alias go through an
+ * open addressing hash table instead of scanning the list.  Plugins
+ * are added as they register; after an unregister the whole index is
+ * rebuilt on the next lookup.  Substring (loose) matching still walks
+ * the list, it is only a fallback for guessing at a provider name.
+ */
+struct slot {
+	const char    *key;
+	ddns_system_t *plugin;
+};
 
 static char *plugpath = NULL;   /* Set by first load. */
 static TAILQ_HEAD(, ddns_system) plugins = TAILQ_HEAD_INITIALIZER(plugins);
+static int builtin_done;
+
+/* Registry of built-in plugins, bounds provided by the linker */
+#ifdef __APPLE__
+extern const plugin_entry_t builtin_start[] __asm("section$start$__DATA$inadyn_plugins");
+extern const plugin_entry_t builtin_stop[]  __asm("section$end$__DATA$inadyn_plugins");
+#else
+extern const plugin_entry_t __start_inadyn_plugins[];
+extern const plugin_entry_t __stop_inadyn_plugins[];
+#define builtin_start __start_inadyn_plugins
+#define builtin_stop  __stop_inadyn_plugins
+#endif
+
+static struct slot *index_slot;
+static size_t       index_size;	/* Zero if not built, falls back to list */
+static size_t       index_used;
+static int          index_stale;
+
+static unsigned int index_hash(const char *key)
+{
+	unsigned int hash = 2166136261u;	/* FNV-1a */
+
+	while (*key) {
+		hash ^= (unsigned char)tolower((unsigned char)*key++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/* First registered wins, same as the list order used for lookups before */
+static void index_put(const char *key, ddns_system_t *plugin)
+{
+	size_t i;
+
+	if (!key)
+		return;
+
+	for (i = index_hash(key) & (index_size - 1); index_slot[i].key; i = (i + 1) & (index_size - 1)) {
+		if (!strcasecmp(index_slot[i].key, key))
+			return;
+	}
+
+	index_slot[i].key    = key;
+	index_slot[i].plugin = plugin;
+	index_used++;
+}
+
+/* Rebuild index from the list, at least twice the size of all keys */
+static void index_build(void)
+{
+	ddns_system_t *p, *tmp;
+	size_t size = INDEX_MIN_SIZE, keys = 0;
+
+	PLUGIN_ITERATOR(p, tmp)
+		keys += p->alias ? 2 : 1;
+	while (size < keys * 2)
+		size *= 2;
+
+	mem_free(index_slot);
+	index_slot  = mem_calloc(size, sizeof(struct slot));
+	index_size  = index_slot ? size : 0;
+	index_used  = 0;
+	index_stale = 0;
+	if (!index_slot)
+		return;
+
+	PLUGIN_ITERATOR(p, tmp) {
+		index_put(p->name, p);
+		index_put(p->alias, p);
+	}
+}
+
+static void index_add(ddns_system_t *plugin)
+{
+	if (index_stale || !index_size || (index_used + 2) * 2 > index_size) {
+		index_build();
+		return;
+	}
+
+	index_put(plugin->name, plugin);
+	index_put(plugin->alias, plugin);
+}
+
+static ddns_system_t *index_find(const char *name)
+{
+	size_t i;
+
+	for (i = index_hash(name) & (index_size - 1); index_slot[i].key; i = (i + 1) & (index_size - 1)) {
+		if (!strcasecmp(index_slot[i].key, name))
+			return index_slot[i].plugin;
+	}
+
+	return NULL;
+}
+
+/*
+ * Link the built-in plugins into the list on first use, no allocations.
+ * The ipv6 variants are placed after their IPv4 plugin, so the order is
+ * the same as when they registered from constructors, and for a shared
+ * alias the IPv4 plugin is found first, whatever the order in the
+ * registry.
+ */
+static void builtin_init(void)
+{
+	const plugin_entry_t *e;
+
+	if (builtin_done)
+		return;
+	builtin_done = 1;
+
+	for (e = builtin_start; e < builtin_stop; e++) {
+		if (e->v4)
+			continue;
+
+		e->system->server_req = e->req;
+		TAILQ_INSERT_TAIL(&plugins, e->system, link);
+	}
+
+	for (e = builtin_start; e < builtin_stop; e++) {
+		char *name = e->system->name;
+
+		if (!e->v4)
+			continue;
+
+		memcpy(e->system, e->v4, sizeof(*e->system));
+		e->system->name       = name;
+		e->system->server_req = e->req;
+		TAILQ_INSERT_AFTER(&plugins, (ddns_system_t *)e->v4, e->system, link);
+	}
+
+	index_stale = 1;
+}
 
 int plugin_register(ddns_system_t *plugin, const char *req)
 {
@@ -49,6 +202,7 @@ int plugin_register(ddns_system_t *plugin, const char *req)
 
 	plugin->server_req = req;
 	TAILQ_INSERT_TAIL(&plugins, plugin, link);
+	index_add(plugin);
 
 	return 0;
 }
@@ -58,13 +212,13 @@ int plugin_register_v6(ddns_system_t *plugin, const char *req)
 {
 	ddns_system_t *p;
 
-	p = malloc(sizeof(*p));
+	p = mem_malloc(sizeof(*p));
 	if (!p)
 		return 1;
 
 	memcpy(p, plugin, sizeof(*p));
 	/* default@foo.org -> ipv6@foo.org */
-	p->name = strdup(plugin->name);
+	p->name = mem_strdup(plugin->name);
 	p->cloned = 1;
 	sprintf(p->name, "ipv6%s", plugin->name + 7);
 
@@ -80,18 +234,21 @@ int plugin_unregister(ddns_system_t *plugin)
 	if (!plugin_v4)		/* already unregistered */
 		return 0;
 
-	name = strdup(plugin->name);
+	name = mem_strdup(plugin->name);
 	if (strstr(name, "default@"))
 		sprintf(name, "ipv6%s", plugin->name + 7);
 
 	TAILQ_REMOVE(&plugins, plugin, link);
+	index_stale = 1;
+
 	plugin_v6 = plugin_find(name, 0);
 	if (plugin_v6 && plugin_v6->cloned) {
 		TAILQ_REMOVE(&plugins, plugin_v6, link);
-		free(plugin_v6->name);
-		free(plugin_v6);
+		index_stale = 1;
+		mem_free(plugin_v6->name);
+		mem_free(plugin_v6);
 	}
-	free(name);
+	mem_free(name);
 	/* XXX: Unfinished, add cleanup code here! */
 
 	return 0;
@@ -101,6 +258,7 @@ static ddns_system_t *search_plugin(const char *name, int loose)
 {
 	ddns_system_t *p, *tmp;
 
+	builtin_init();
 	if (loose) {
 		PLUGIN_ITERATOR(p, tmp) {
 			if (strcasestr(p->name, name))
@@ -112,6 +270,12 @@ static ddns_system_t *search_plugin(const char *name, int loose)
 		return NULL;
 	}
 
+	if (index_stale)
+		index_build();
+	if (index_size)
+		return index_find(name);
+
+	/* Out of memory for the index, one at a time then */
 	PLUGIN_ITERATOR(p, tmp) {
 		if (!strcasecmp(p->name, name))
 			return p;
@@ -132,6 +296,7 @@ int plugin_list(int json)
 {
 	ddns_system_t *p, *tmp;
 
+	builtin_init();
 	if (json) {
 		int prev = 0;
 
@@ -242,7 +407,7 @@ ddns_system_t *plugin_find(const char *name, int loose)
 	}
 
 	/* Check for multiple instances of plugin */
-	tmp = strdup(name);
+	tmp = mem_strdup(name);
 	if (!tmp)
 		return NULL;
 
@@ -253,7 +418,7 @@ ddns_system_t *plugin_find(const char *name, int loose)
 
 	p = search_plugin(name, loose);
 	if (p) {
-		free(tmp);
+		mem_free(tmp);
 		return p;
 	}
 
@@ -262,9 +427,9 @@ ddns_system_t *plugin_find(const char *name, int loose)
 		char *path;
 		size_t len = strlen(plugpath) + strlen(name) + 5;
 
-		path = malloc(len);
+		path = mem_malloc(len);
 		if (!path) {
-			free(tmp);
+			mem_free(tmp);
 			return NULL;
 		}
 
@@ -274,20 +439,179 @@ ddns_system_t *plugin_find(const char *name, int loose)
 			 name, noext ? ".so" : "");
 
 		p = search_plugin(path, loose);
-		free(path);
+		mem_free(path);
 		if (p) {
-			free(tmp);
+			mem_free(tmp);
 			return p;
 		}
 	}
 
-	free(tmp);
+	mem_free(tmp);
 	errno = ENOENT;
 
 	return NULL;
 }
 
+/* The body, if it is a JSON document, into @rsp->json */
+static void query_json(ddns_t *ctx, plugin_rsp_t *rsp)
+{
+#ifndef DROP_JSON
+	const char *body = rsp->trans.rsp_body;
+
+	body += strspn(body, " \t\r\n");
+	if ((*body == '{' || *body == '[') && json_parse_in(&rsp->json, ctx->arena, body, strlen(body)) < 0)
+		json_free(&rsp->json);
+#endif
+}
+
+/**
+ * plugin_query - Lookup request, e.g. a zone or record id, to the provider
+ * @ctx:  Context, with the request in @ctx->request_buf
+ * @info: Provider
+ * @msg:  Prefix for log messages when connecting
+ * @len:  Length of request
+ * @rsp:  Response, status and headers in @rsp->trans, JSON in @rsp->json
+ *
+ * The request is sent on the same kept-alive connection, into the same
+ * pooled response buffer, as the update that usually follows.  So a
+ * lookup followed by an update, or several lookups, cost one connect.
+ * The body is parsed if it is a JSON document, otherwise @rsp->json.num
+ * is zero.  The response is valid until the next request on @ctx, and
+ * plugin_query_done() must always be called to release the JSON.
+ *
+ * Returns:
+ * POSIX OK(0), %RC_DDNS_RATE_LIMITED if the request quota is used up,
+ * or transport error.  The HTTP status is up to the caller.
+ */
+int plugin_query(ddns_t *ctx, ddns_info_t *info, char *msg, size_t len, plugin_rsp_t *rsp)
+{
+	http_trans_t *trans = &rsp->trans;
+	http_t *client = &info->server;
+	long long t = trace_start();
+	int rc;
+
+	memset(&rsp->json, 0, sizeof(rsp->json));
+	if (len >= ctx->request_buflen)
+		return RC_BUFFER_OVERFLOW;
+
+	/* Lookups count against the provider's request quota too */
+	DO(quota_take(info));
+
+	/* Same as for updates, or the connection cannot be reused */
+	client->ssl_enabled = info->ssl_enabled;
+	client->http2       = info->http2;
+	rc = http_init(client, msg, strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
+	if (rc)
+		return rc;
+
+	trans->req     = ctx->request_buf;
+	trans->req_len = len;
+	trans->buf     = ctx->work_buf;
+
+	logit(LOG_DEBUG, "Request:\n%s", ctx->request_buf);
+	rc = http_transaction(client, trans);
+	http_release(client);
+	trace_span(t, "plugin", "%s %s", msg, info->system->name);
+	if (rc)
+		return rc;
+
+	logit(LOG_DEBUG, "Response:\n%s", trans->rsp);
+	query_json(ctx, rsp);
+
+	return 0;
+}
+
+void plugin_query_done(plugin_rsp_t *rsp)
+{
+	json_free(&rsp->json);
+}
+
+/**
+ * plugin_queries - Several lookup requests to the provider at once
+ * @ctx:  Context
+ * @info: Provider
+ * @msg:  Prefix for log messages when connecting
+ * @req:  Array of @num requests, each a NUL terminated string
+ * @rsp:  Array of @num responses, as from plugin_query()
+ * @num:  Number of requests
+ *
+ * Like plugin_query(), but for requests that do not depend on each
+ * other, e.g. the record IDs of several hostnames.  If the provider
+ * connection is HTTP/2 they are sent as concurrent streams, otherwise
+ * one after the other on the kept-alive connection.  Each response has
+ * a buffer of its own, so they are all valid until plugin_queries_done(),
+ * which must always be called.
+ *
+ * Returns:
+ * POSIX OK(0) if all requests got a response, %RC_DDNS_RATE_LIMITED if
+ * the request quota is used up, or transport error.
+ */
+int plugin_queries(ddns_t *ctx, ddns_info_t *info, char *msg, char *req[], plugin_rsp_t rsp[], size_t num)
+{
+	http_t *client = &info->server;
+	long long t = trace_start();
+	http_trans_t **list;
+	size_t i;
+	int rc;
+
+	memset(rsp, 0, num * sizeof(*rsp));
+
+	list = arena_alloc(ctx->arena, num * sizeof(*list));
+	if (!list)
+		return RC_OUT_OF_MEMORY;
+
+	for (i = 0; i < num; i++) {
+		DO(quota_take(info));
+
+		rsp[i].buf = buf_get(ctx->pool, DDNS_HTTP_RESPONSE_BUFFER_SIZE);
+		if (!rsp[i].buf)
+			return RC_OUT_OF_MEMORY;
+
+		rsp[i].trans.req     = req[i];
+		rsp[i].trans.req_len = strlen(req[i]);
+		rsp[i].trans.buf     = rsp[i].buf;
+		list[i] = &rsp[i].trans;
+		logit(LOG_DEBUG, "Request:\n%s", req[i]);
+	}
+
+	client->ssl_enabled = info->ssl_enabled;
+	client->http2       = info->http2;
+	rc = http_init(client, msg, strstr(info->system->name, "ipv6") ? TCP_FORCE_IPV6 : TCP_FORCE_IPV4);
+	if (rc)
+		return rc;
+
+	rc = http_transactions(client, list, num);
+	http_release(client);
+	trace_span(t, "plugin", "%zu x %s %s", num, msg, info->system->name);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < num; i++) {
+		logit(LOG_DEBUG, "Response:\n%s", rsp[i].trans.rsp);
+		query_json(ctx, &rsp[i]);
+	}
+
+	return 0;
+}
+
+void plugin_queries_done(ddns_t *ctx, plugin_rsp_t rsp[], size_t num)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		json_free(&rsp[i].json);
+		buf_put(ctx->pool, rsp[i].buf);
+		rsp[i].buf = NULL;
+	}
+}
+
 /* Private daemon API *******************************************************/
+
+/*
+ * Unused, all plugins are built-in and listed in the registry, see
+ * src/Makefile.am.  Should external plugins return, load them on demand
+ * from plugin_find(), by provider name, instead of all at startup.
+ */
 #if o
 /**
  * load_one - Load one plugin
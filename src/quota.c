@@ -0,0 +1,93 @@
+/* Per-provider request quota, a token bucket
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Providers limit how many API requests a client may send, e.g.
+ * Cloudflare allows 1200 per five minutes.  Each provider has a bucket
+ * of at most quota tokens, refilled at quota tokens per quota-period.
+ * Every request, plugin lookups as well as updates, takes one token.
+ *
+ * When the bucket is empty the request is not sent.  The alias is left
+ * with a forced update, and the provider is checked again when the
+ * next token is due, so all updates held back in the meantime go out
+ * as one, with the address current at that time.
+ *
+ * To stay in integers the level is counted in msec of the period:
+ * every msec adds quota, a request costs quota_period * 1000, and a
+ * full bucket holds quota such requests.
+ */
+
+#include "event.h"
+#include "quota.h"
+
+/**
+ * quota_take - Take a token for one request to the provider
+ * @info: Provider
+ *
+ * If no token is available, @info->retry_after is raised to when the
+ * next one is, so the scheduler comes back then, see next_period().
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_RATE_LIMITED if the request must wait.
+ */
+int quota_take(ddns_info_t *info)
+{
+	long long now, cost, full, wait;
+
+	if (info->quota <= 0 || info->quota_period <= 0)
+		return 0;
+
+	now  = event_msec();
+	cost = info->quota_period * 1000LL;
+	full = cost * info->quota;
+
+	if (!info->quota_ts) {
+		info->quota_level = full;
+	} else if (now > info->quota_ts) {
+		info->quota_level += (now - info->quota_ts) * info->quota;
+		if (info->quota_level > full)
+			info->quota_level = full;
+	}
+	info->quota_ts = now;
+
+	if (info->quota_level >= cost) {
+		info->quota_level -= cost;
+		return 0;
+	}
+
+	wait = (cost - info->quota_level + info->quota - 1) / info->quota;
+	logit(LOG_DEBUG, "%s: request quota used up, next request in %lld msec",
+	      info->system->name, wait);
+
+	wait = (wait + 999) / 1000;
+	if (wait > info->retry_after)
+		info->retry_after = (int)wait;
+
+	return RC_DDNS_RATE_LIMITED;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
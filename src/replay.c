@@ -0,0 +1,316 @@
+/* Record and replay of HTTP transactions
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * With --record every HTTP(S) transaction, to providers and checkip
+ * servers alike, is appended to a file, request and response verbatim
+ * with the time it took.  With --replay those responses are fed back
+ * through the http_t engine instead of connecting anywhere, after the
+ * recorded delay scaled by --replay-scale, so whole update cycles,
+ * multi-step provider flows included, can be profiled offline and
+ * deterministically.  Each transaction is one header line followed by
+ * the raw request and response, each ending with a newline:
+ *
+ *     T HOST PORT SSL RC MSEC REQ_LEN RSP_LEN
+ *
+ * A request is answered by the first unused transaction to the same
+ * server with the same request line, or failing that, the first unused
+ * one to the same server, so requests with e.g. time stamps in them
+ * still match.  When all are used the last one with the same request
+ * line, or to the same server, is used again, for replaying more cycles
+ * than were recorded.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "log.h"
+#include "replay.h"
+
+char *record_file  = NULL;
+char *replay_file  = NULL;
+int   replay_scale = REPLAY_DEFAULT_SCALE;
+
+struct trans {
+	char  host[256];
+	int   port;
+	int   ssl;
+	int   rc;
+	int   msec;
+	char *req;
+	int   req_len;
+	char *rsp;
+	int   rsp_len;
+	int   used;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE           *record;
+static struct trans   *table;
+static int             num;
+
+/* Length of the request line, e.g. GET /nic/update?... HTTP/1.1 */
+static int reqline(const char *req, int len)
+{
+	const char *end = memchr(req, '\n', len);
+
+	return end ? (int)(end - req) : len;
+}
+
+static char *load_data(FILE *fp, int len)
+{
+	char *data;
+
+	if (len < 0)
+		return NULL;
+
+	data = malloc(len + 1);
+	if (!data)
+		return NULL;
+
+	if ((int)fread(data, 1, len, fp) != len || getc(fp) != '\n') {
+		free(data);
+		return NULL;
+	}
+	data[len] = 0;
+
+	return data;
+}
+
+static int load(const char *file)
+{
+	char line[512];
+	FILE *fp;
+
+	fp = fopen(file, "r");
+	if (!fp) {
+		logit(LOG_ERR, "Failed opening replay file %s: %s", file, strerror(errno));
+		return RC_FILE_IO_MISSING_FILE;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct trans *t, *tmp;
+
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		tmp = realloc(table, (num + 1) * sizeof(*table));
+		if (!tmp)
+			goto fail;
+		table = tmp;
+
+		t = &table[num];
+		memset(t, 0, sizeof(*t));
+		if (sscanf(line, "T %255s %d %d %d %d %d %d", t->host, &t->port, &t->ssl,
+			   &t->rc, &t->msec, &t->req_len, &t->rsp_len) != 7)
+			goto fail;
+
+		t->req = load_data(fp, t->req_len);
+		if (!t->req)
+			goto fail;
+		t->rsp = load_data(fp, t->rsp_len);
+		if (!t->rsp) {
+			free(t->req);
+			goto fail;
+		}
+
+		num++;
+	}
+	fclose(fp);
+
+	logit(LOG_INFO, "Replaying %d recorded transactions from %s, at %d%% latency",
+	      num, file, replay_scale);
+
+	return 0;
+fail:
+	logit(LOG_ERR, "Invalid replay file %s, transaction %d", file, num + 1);
+	fclose(fp);
+
+	return RC_FILE_IO_ACCESS_ERROR;
+}
+
+/**
+ * replay_init - Open --record file and load --replay file, if set
+ *
+ * The record file may hold credentials, e.g. in Authorization headers,
+ * so it is only readable by the owner.
+ *
+ * Returns:
+ * POSIX OK(0), or an %RC_FILE_IO_* error.
+ */
+int replay_init(void)
+{
+	int fd;
+
+	if (replay_file)
+		DO(load(replay_file));
+
+	if (!record_file)
+		return 0;
+
+	fd = open(record_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1 || !(record = fdopen(fd, "w"))) {
+		logit(LOG_ERR, "Failed opening record file %s: %s", record_file, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+	fprintf(record, "# Recorded by %s, see --replay\n", PACKAGE_STRING);
+
+	return 0;
+}
+
+void replay_exit(void)
+{
+	int i;
+
+	if (record)
+		fclose(record);
+	record = NULL;
+
+	for (i = 0; i < num; i++) {
+		free(table[i].req);
+		free(table[i].rsp);
+	}
+	free(table);
+	table = NULL;
+	num   = 0;
+}
+
+/**
+ * replay_record - Append completed, or failed, transaction to --record file
+ * @client: HTTP client, before http_account() clears the timestamps
+ * @rc:     Result of the transaction
+ */
+void replay_record(http_t *client, int rc)
+{
+	http_trans_t *trans = client->trans;
+	long long msec;
+	int port = 0;
+
+	if (!record || !trans)
+		return;
+
+	msec = event_msec() - (client->ts_start ? client->ts_start : client->ts_request);
+	http_get_port(client, &port);
+
+	pthread_mutex_lock(&lock);
+	fprintf(record, "T %s %d %d %d %lld %d %d\n", client->conn_host[0] ? client->conn_host : "-",
+		port, client->ssl_enabled, rc, msec, trans->req_len, trans->rsp_len);
+	fwrite(trans->req, 1, trans->req_len, record);
+	fputc('\n', record);
+	fwrite(trans->rsp, 1, trans->rsp_len, record);
+	fputc('\n', record);
+	fflush(record);
+	pthread_mutex_unlock(&lock);
+}
+
+/**
+ * replay_find - Find recorded transaction for a request
+ * @client: HTTP client, with remote name and port set
+ * @trans:  Request to answer
+ * @msec:   Delay before the response, scaled recorded latency
+ *
+ * Returns:
+ * Transaction id for replay_get(), or -1 if there is none for the server.
+ */
+int replay_find(http_t *client, http_trans_t *trans, int *msec)
+{
+	int i, id = -1, any = -1, last = -1, same_last = 0, len, port = 0;
+	const char *host;
+
+	http_get_remote_name(client, &host);
+	http_get_port(client, &port);
+	len = reqline(trans->req, trans->req_len);
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < num; i++) {
+		struct trans *t = &table[i];
+		int same;
+
+		if (!host || strcmp(t->host, host) || t->port != port)
+			continue;
+
+		same = reqline(t->req, t->req_len) == len && !memcmp(t->req, trans->req, len);
+		if (same || last < 0 || !same_last)
+			last = i;
+		if (same)
+			same_last = 1;
+		if (t->used)
+			continue;
+
+		if (same) {
+			id = i;
+			break;
+		}
+		if (any < 0)
+			any = i;
+	}
+
+	if (id < 0)
+		id = any >= 0 ? any : last;
+	if (id >= 0) {
+		table[id].used = 1;
+		*msec = (int)((long long)table[id].msec * replay_scale / 100);
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (id < 0)
+		logit(LOG_WARNING, "No recorded transaction for %s:%d, %.*s", host ? host : "-", port, len, trans->req);
+	else
+		logit(LOG_DEBUG, "Replaying transaction %d for %s:%d after %d msec", id, host, port, *msec);
+
+	return id;
+}
+
+/**
+ * replay_get - Recorded response of transaction
+ * @id:  Transaction id, from replay_find()
+ * @rsp: Set to response, as received
+ * @len: Set to length of @rsp
+ *
+ * Returns:
+ * Recorded result of the transaction, POSIX OK(0) or error code.
+ */
+int replay_get(int id, const char **rsp, int *len)
+{
+	if (id < 0 || id >= num)
+		return RC_TCP_CONNECT_FAILED;
+
+	*rsp = table[id].rsp;
+	*len = table[id].rsp_len;
+
+	return table[id].rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,308 @@
+/* DNS-over-HTTPS resolver for alias lookups
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * ISP resolvers may be slow, or even rewrite answers, which makes both
+ * seeding aliases at startup and verify-record lookups slow and wrong.
+ * With a resolver configured, those lookups are instead sent as DNS
+ * messages over HTTPS (RFC 8484) to the resolver of choice.
+ *
+ * The HTTP engine already keeps connections alive, shares the TLS
+ * context and resumes TLS sessions, so lookups after the first cost no
+ * handshake at all.  All lookups of a batch are pipelined: up to
+ * RESOLVER_CONNECTIONS are in flight at the same time, one on each
+ * kept-alive connection, the next one is sent as soon as a reply
+ * arrives.  Only called from the main thread.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+
+#include "budget.h"
+#include "discover.h"
+#include "event.h"
+#include "http.h"
+#include "log.h"
+#include "resolver.h"
+
+#define DNS_MAX_QUERY	512
+#define REQ_MAX_LEN	(1024 + DNS_MAX_QUERY)
+#define RSP_MAX_LEN	8192
+
+struct conn {
+	http_t            client;
+	http_trans_t      trans;
+	resolver_query_t *query;	/* In flight, or NULL */
+	int               retried;	/* Kept-alive connection was lost */
+	char              req[REQ_MAX_LEN];
+	char              rsp[RSP_MAX_LEN];
+};
+
+static char        host[SERVER_NAME_LEN];
+static char        path[SERVER_URL_LEN];
+static int         port;
+static struct conn conn[RESOLVER_CONNECTIONS];
+static int         constructed;
+
+/**
+ * resolver_set - Set DNS-over-HTTPS resolver
+ * @url: https://name[:port][/path], or %NULL to use the system resolver
+ *
+ * The path defaults to %RESOLVER_DEFAULT_PATH.  Connections to a
+ * previous resolver are closed when next used.
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_DDNS_INVALID_OPTION if @url is not valid.
+ */
+int resolver_set(const char *url)
+{
+	char str[SERVER_NAME_LEN];
+	const char *ptr;
+	char *colon;
+
+	host[0] = 0;
+	if (!url)
+		return 0;
+
+	if (strncasecmp(url, "https://", 8)) {
+		logit(LOG_ERR, "Resolver %s is not an https:// URL", url);
+		return RC_DDNS_INVALID_OPTION;
+	}
+	url += 8;
+
+	ptr = strchr(url, '/');
+	strlcpy(path, ptr ? ptr : RESOLVER_DEFAULT_PATH, sizeof(path));
+	if ((size_t)(ptr ? ptr - url : (long)strlen(url)) >= sizeof(str)) {
+		logit(LOG_ERR, "Resolver name too long");
+		return RC_DDNS_INVALID_OPTION;
+	}
+	strlcpy(str, url, ptr ? (size_t)(ptr - url) + 1 : sizeof(str));
+
+	port  = HTTPS_DEFAULT_PORT;
+	colon = strchr(str, ':');
+	if (colon) {
+		*colon++ = 0;
+		port = atonum(colon);
+		if (port <= 0 || port > 65535) {
+			logit(LOG_ERR, "Invalid port in resolver %s", url);
+			return RC_DDNS_INVALID_OPTION;
+		}
+	}
+	if (!str[0]) {
+		logit(LOG_ERR, "Missing name in resolver URL");
+		return RC_DDNS_INVALID_OPTION;
+	}
+	strlcpy(host, str, sizeof(host));
+
+	return 0;
+}
+
+int resolver_enabled(void)
+{
+	return host[0] != 0;
+}
+
+/* DNS query for @query, in an HTTP POST request */
+static int compose(struct conn *c, resolver_query_t *query)
+{
+	unsigned char dns[DNS_MAX_QUERY];
+	int len, hdr;
+
+	len = discover_query(dns, sizeof(dns), query->name, query->family);
+	if (len < 0)
+		return RC_BUFFER_OVERFLOW;
+
+	hdr = snprintf(c->req, sizeof(c->req),
+		       "POST %s HTTP/1.1\r\n"
+		       "Host: %s\r\n"
+		       "User-Agent: %s\r\n"
+		       "Accept: application/dns-message\r\n"
+		       "Content-Type: application/dns-message\r\n"
+		       "Content-Length: %d\r\n"
+		       "\r\n", path, host, user_agent, len);
+	if (hdr < 0 || hdr + len > (int)sizeof(c->req))
+		return RC_BUFFER_OVERFLOW;
+	memcpy(c->req + hdr, dns, len);
+
+	memset(&c->trans, 0, sizeof(c->trans));
+	c->trans.req         = c->req;
+	c->trans.req_len     = hdr + len;
+	c->trans.rsp         = c->rsp;
+	c->trans.max_rsp_len = sizeof(c->rsp) - 1;
+	c->query             = query;
+
+	return 0;
+}
+
+/* Send composed query, connecting first unless kept alive */
+static int send_query(struct conn *c)
+{
+	http_t *client = &c->client;
+
+	client->ssl_enabled = 1;
+	http_set_remote_name(client, host);
+	http_set_port(client, port);
+	http_reuse(client);
+
+	return http_start(client, &c->trans, "Connecting to DNS-over-HTTPS resolver", TCP_AUTO);
+}
+
+/* Result of the query in flight on @c, returns 1 if it was sent again */
+static int finish(struct conn *c)
+{
+	resolver_query_t *query = c->query;
+	http_t *client = &c->client;
+	http_trans_t *trans = &c->trans;
+	int rc = client->rc;
+
+	if (rc) {
+		int lost = client->reused && trans->rsp_len == 0;
+
+		http_exit(client);
+
+		/* Server closed the kept-alive connection while we were away */
+		if (lost && !c->retried) {
+			logit(LOG_DEBUG, "Kept-alive connection to %s lost, reconnecting", host);
+			c->retried = 1;
+			if (HTTP_PENDING(send_query(c)))
+				return 1;
+			return finish(c);
+		}
+	} else {
+		if (trans->status != 200)
+			rc = RC_DDNS_INVALID_CHECKIP_RSP;
+		else
+			rc = discover_answer(trans->rsp_body, trans->body_len, query->family,
+					     query->address, sizeof(query->address));
+		http_release(client);
+	}
+
+	query->rc = rc;
+	logit(LOG_DEBUG, "Resolver %s: %s => %s", host, query->name, rc ? error_str(rc) : query->address);
+
+	c->query   = NULL;
+	c->retried = 0;
+
+	return 0;
+}
+
+/**
+ * resolver_lookup - Look up addresses of several hostnames at once
+ * @query:   Hostnames, with address family, results are filled in
+ * @num:     Number of entries in @query
+ * @timeout: Give up on lookups not done by then, msec
+ *
+ * Returns:
+ * POSIX OK(0) when all lookups have been tried, the result of each is
+ * in query->rc, or %RC_DDNS_INVALID_OPTION if no resolver is set.
+ */
+int resolver_lookup(resolver_query_t *query, size_t num, int timeout)
+{
+	http_t *clients[RESOLVER_CONNECTIONS];
+	long long deadline = budget_clamp(event_msec() + timeout);
+	size_t i, next = 0, done = 0;
+
+	if (!resolver_enabled())
+		return RC_DDNS_INVALID_OPTION;
+
+	for (i = 0; i < RESOLVER_CONNECTIONS; i++) {
+		if (!constructed)
+			http_construct(&conn[i].client);
+		clients[i] = &conn[i].client;
+	}
+	constructed = 1;
+
+	logit(LOG_DEBUG, "Resolving %zu hostnames using %s", num, host);
+	while (done < num) {
+		for (i = 0; i < RESOLVER_CONNECTIONS && next < num; i++) {
+			struct conn *c = &conn[i];
+
+			if (c->query)
+				continue;
+
+			if (compose(c, &query[next])) {
+				query[next++].rc = RC_BUFFER_OVERFLOW;
+				done++;
+				continue;
+			}
+			next++;
+
+			if (!HTTP_PENDING(send_query(c)))
+				done += !finish(c);
+		}
+
+		if (event_msec() >= deadline) {
+			for (i = 0; i < RESOLVER_CONNECTIONS; i++) {
+				struct conn *c = &conn[i];
+
+				if (!c->query)
+					continue;
+
+				http_cancel(&c->client);
+				c->query->rc = RC_TCP_RECV_ERROR;
+				c->query     = NULL;
+				c->retried   = 0;
+			}
+			for (; next < num; next++)
+				query[next].rc = RC_TCP_RECV_ERROR;
+
+			logit(LOG_WARNING, "Timed out resolving %zu hostnames using %s", num - done, host);
+			break;
+		}
+
+		if (http_poll_once(clients, RESOLVER_CONNECTIONS, deadline) < 0)
+			continue;
+
+		for (i = 0; i < RESOLVER_CONNECTIONS; i++) {
+			struct conn *c = &conn[i];
+
+			if (c->query && !HTTP_PENDING(c->client.rc))
+				done += !finish(c);
+		}
+	}
+
+	return 0;
+}
+
+/* Close kept-alive connections to the resolver */
+void resolver_exit(void)
+{
+	int i;
+
+	if (!constructed)
+		return;
+
+	for (i = 0; i < RESOLVER_CONNECTIONS; i++) {
+		http_exit(&conn[i].client);
+		http_destruct(&conn[i].client, 1);
+	}
+	constructed = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
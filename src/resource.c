@@ -0,0 +1,202 @@
+/* Heap and resource accounting, for the metrics
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Built with --enable-memstat, core subsystems and plugins allocate
+ * through the mem_*() wrappers, which put a small header in front of
+ * every allocation: the tag of the allocating file and the size.  So
+ * mem_free() knows what to account, wherever it is called from.  Each
+ * tag counts allocations, frees, bytes in use and the peak, exposed by
+ * the metrics, so slow growth of one subsystem shows over weeks.
+ *
+ * Counters are updated with atomics, since the update workers allocate
+ * concurrently.  Without --enable-memstat the wrappers are plain libc
+ * calls, and only the descriptor and child process counts remain.
+ */
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resource.h"
+
+#ifdef ENABLE_MEMSTAT
+/* In front of every allocation, sized to keep malloc() alignment */
+union mem_hdr {
+	struct {
+		mem_tag_t *tag;
+		size_t     len;
+	} h;
+	long double  ld;
+	long long    ll;
+	void        *ptr;
+};
+
+static mem_tag_t *tags;
+
+/* Called by constructors, before main(), so no locking */
+void mem_register(mem_tag_t *tag)
+{
+	mem_tag_t **pos = &tags;
+
+	/* Sorted by name, for stable metrics */
+	while (*pos && strcmp((*pos)->name, tag->name) < 0)
+		pos = &(*pos)->next;
+
+	tag->next = *pos;
+	*pos = tag;
+}
+
+mem_tag_t *mem_tags(void)
+{
+	return tags;
+}
+
+static void account(mem_tag_t *tag, size_t len)
+{
+	size_t bytes, peak;
+
+	__atomic_add_fetch(&tag->allocs, 1, __ATOMIC_RELAXED);
+	bytes = __atomic_add_fetch(&tag->bytes, len, __ATOMIC_RELAXED);
+
+	peak = __atomic_load_n(&tag->peak, __ATOMIC_RELAXED);
+	while (bytes > peak &&
+	       !__atomic_compare_exchange_n(&tag->peak, &peak, bytes, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static void unaccount(mem_tag_t *tag, size_t len)
+{
+	__atomic_add_fetch(&tag->frees, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&tag->bytes, len, __ATOMIC_RELAXED);
+}
+
+void *mem_tag_malloc(mem_tag_t *tag, size_t len)
+{
+	union mem_hdr *hdr;
+
+	if (len > (size_t)-1 - sizeof(*hdr))
+		return NULL;
+
+	hdr = malloc(sizeof(*hdr) + len);
+	if (!hdr)
+		return NULL;
+
+	hdr->h.tag = tag;
+	hdr->h.len = len;
+	account(tag, len);
+
+	return hdr + 1;
+}
+
+void *mem_tag_calloc(mem_tag_t *tag, size_t num, size_t len)
+{
+	void *ptr;
+
+	if (len && num > (size_t)-1 / len)
+		return NULL;
+
+	ptr = mem_tag_malloc(tag, num * len);
+	if (ptr)
+		memset(ptr, 0, num * len);
+
+	return ptr;
+}
+
+/* Accounted to the tag of the original allocation, if any */
+void *mem_tag_realloc(mem_tag_t *tag, void *ptr, size_t len)
+{
+	union mem_hdr *hdr, *tmp;
+
+	if (!ptr)
+		return mem_tag_malloc(tag, len);
+	if (len > (size_t)-1 - sizeof(*hdr))
+		return NULL;
+
+	hdr = (union mem_hdr *)ptr - 1;
+	tag = hdr->h.tag;
+
+	tmp = realloc(hdr, sizeof(*hdr) + len);
+	if (!tmp)
+		return NULL;
+
+	unaccount(tag, tmp->h.len);
+	tmp->h.len = len;
+	account(tag, len);
+
+	return tmp + 1;
+}
+
+char *mem_tag_strdup(mem_tag_t *tag, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ptr;
+
+	ptr = mem_tag_malloc(tag, len);
+	if (ptr)
+		memcpy(ptr, str, len);
+
+	return ptr;
+}
+
+void mem_tag_free(void *ptr)
+{
+	union mem_hdr *hdr;
+
+	if (!ptr)
+		return;
+
+	hdr = (union mem_hdr *)ptr - 1;
+	unaccount(hdr->h.tag, hdr->h.len);
+	free(hdr);
+}
+#endif /* ENABLE_MEMSTAT */
+
+/* Open descriptors of the process, or -1 if it cannot be told */
+int res_fds(void)
+{
+	struct dirent *d;
+	DIR *dir;
+	int num = 0;
+
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		dir = opendir("/dev/fd");
+	if (!dir)
+		return -1;
+
+	while ((d = readdir(dir))) {
+		if (d->d_name[0] != '.')
+			num++;
+	}
+	closedir(dir);
+
+	/* Not counting the one of the directory itself */
+	return num - 1;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
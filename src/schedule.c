@@ -0,0 +1,210 @@
+/* Provider check scheduler, a small min-heap of deadlines
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Every provider has its own period, retry period after errors, and
+ * forced update interval.  Rather than waking up for the shortest of
+ * them and walking every provider, the main loop keeps one deadline
+ * per provider in a binary min-heap.  The root is the next wakeup,
+ * and each wakeup pops only the entries that are actually due.
+ *
+ * The number of entries is small, so looking up an entry to move it
+ * is a linear scan.  Deadlines are in event_now() seconds.
+ */
+
+#include <stdlib.h>
+
+#include "error.h"
+#include "schedule.h"
+
+struct entry {
+	time_t  when;
+	void   *arg;
+};
+
+static struct entry *heap;
+static size_t        num;
+static size_t        size;
+
+static void swap(size_t a, size_t b)
+{
+	struct entry tmp = heap[a];
+
+	heap[a] = heap[b];
+	heap[b] = tmp;
+}
+
+static void sift_up(size_t i)
+{
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+
+		if (heap[parent].when <= heap[i].when)
+			break;
+
+		swap(i, parent);
+		i = parent;
+	}
+}
+
+static void sift_down(size_t i)
+{
+	while (1) {
+		size_t left = 2 * i + 1, right = left + 1, min = i;
+
+		if (left < num && heap[left].when < heap[min].when)
+			min = left;
+		if (right < num && heap[right].when < heap[min].when)
+			min = right;
+		if (min == i)
+			break;
+
+		swap(i, min);
+		i = min;
+	}
+}
+
+static void remove_at(size_t i)
+{
+	num--;
+	if (i == num)
+		return;
+
+	heap[i] = heap[num];
+	sift_down(i);
+	sift_up(i);
+}
+
+static int find(void *arg)
+{
+	size_t i;
+
+	for (i = 0; i < num; i++) {
+		if (heap[i].arg == arg)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * sched_add - Schedule, or reschedule, an entry
+ * @arg:  Opaque entry, e.g. a provider
+ * @when: Deadline in event_now() seconds, zero or in the past for now
+ *
+ * An entry can only be scheduled once, adding it again moves it.
+ *
+ * Returns:
+ * POSIX OK(0) on success, non-zero on error.
+ */
+int sched_add(void *arg, time_t when)
+{
+	int i;
+
+	if (!arg)
+		return RC_INVALID_POINTER;
+
+	i = find(arg);
+	if (i >= 0) {
+		heap[i].when = when;
+		sift_down(i);
+		sift_up(i);
+		return 0;
+	}
+
+	if (num == size) {
+		size_t len = size ? size * 2 : 8;
+		struct entry *ptr;
+
+		ptr = realloc(heap, len * sizeof(*heap));
+		if (!ptr)
+			return RC_OUT_OF_MEMORY;
+
+		heap = ptr;
+		size = len;
+	}
+
+	heap[num].when = when;
+	heap[num].arg  = arg;
+	sift_up(num++);
+
+	return 0;
+}
+
+/* Drop @arg from the schedule, if it is scheduled at all */
+void sched_del(void *arg)
+{
+	int i;
+
+	i = find(arg);
+	if (i >= 0)
+		remove_at(i);
+}
+
+/* Drop all entries, e.g. before the entries themselves are freed */
+void sched_clear(void)
+{
+	free(heap);
+	heap = NULL;
+	num  = 0;
+	size = 0;
+}
+
+/**
+ * sched_due - Pop the next entry that is due
+ * @now: Current event_now() time
+ *
+ * Call repeatedly until it returns %NULL to collect everything that is
+ * due.  Popped entries are no longer scheduled, add them back when the
+ * work is done.
+ *
+ * Returns:
+ * The @arg of an entry with a deadline no later than @now, or %NULL.
+ */
+void *sched_due(time_t now)
+{
+	void *arg;
+
+	if (!num || heap[0].when > now)
+		return NULL;
+
+	arg = heap[0].arg;
+	remove_at(0);
+
+	return arg;
+}
+
+/* Deadline of the earliest entry, or -1 if nothing is scheduled */
+time_t sched_next(void)
+{
+	if (!num)
+		return -1;
+
+	return heap[0].when;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,141 @@
+/* SHA-256 cryptographic hash function, FIPS 180-4
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "sha256.h"
+
+#define ROR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)	(((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x, y, z)	(((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x)		(ROR(x,  2) ^ ROR(x, 13) ^ ROR(x, 22))
+#define S1(x)		(ROR(x,  6) ^ ROR(x, 11) ^ ROR(x, 25))
+#define G0(x)		(ROR(x,  7) ^ ROR(x, 18) ^ ((x) >>  3))
+#define G1(x)		(ROR(x, 17) ^ ROR(x, 19) ^ ((x) >> 10))
+
+static const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+void sha256_starts(sha256_context *ctx)
+{
+	static const uint32_t iv[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	ctx->total = 0;
+	memcpy(ctx->state, iv, sizeof(iv));
+}
+
+static void sha256_process(sha256_context *ctx, const unsigned char data[64])
+{
+	uint32_t w[64], s[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)data[i * 4] << 24 | (uint32_t)data[i * 4 + 1] << 16 |
+		       (uint32_t)data[i * 4 + 2] << 8 | (uint32_t)data[i * 4 + 3];
+	for (; i < 64; i++)
+		w[i] = G1(w[i - 2]) + w[i - 7] + G0(w[i - 15]) + w[i - 16];
+
+	memcpy(s, ctx->state, sizeof(s));
+	for (i = 0; i < 64; i++) {
+		t1 = s[7] + S1(s[4]) + CH(s[4], s[5], s[6]) + K[i] + w[i];
+		t2 = S0(s[0]) + MAJ(s[0], s[1], s[2]);
+		memmove(&s[1], &s[0], 7 * sizeof(s[0]));
+		s[4] += t1;
+		s[0]  = t1 + t2;
+	}
+
+	for (i = 0; i < 8; i++)
+		ctx->state[i] += s[i];
+}
+
+void sha256_update(sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+	size_t fill, left;
+
+	left = ctx->total & 63;
+	ctx->total += ilen;
+
+	if (left) {
+		fill = 64 - left;
+		if (ilen < fill) {
+			memcpy(&ctx->buffer[left], input, ilen);
+			return;
+		}
+
+		memcpy(&ctx->buffer[left], input, fill);
+		sha256_process(ctx, ctx->buffer);
+		input += fill;
+		ilen  -= fill;
+	}
+
+	for (; ilen >= 64; input += 64, ilen -= 64)
+		sha256_process(ctx, input);
+
+	if (ilen)
+		memcpy(ctx->buffer, input, ilen);
+}
+
+void sha256_finish(sha256_context *ctx, unsigned char output[32])
+{
+	unsigned char pad[72] = { 0x80 };
+	uint64_t bits = ctx->total * 8;
+	size_t left, len;
+	int i;
+
+	left = ctx->total & 63;
+	len  = left < 56 ? 56 - left : 120 - left;
+	for (i = 0; i < 8; i++)
+		pad[len + i] = bits >> (56 - i * 8);
+	sha256_update(ctx, pad, len + 8);
+
+	for (i = 0; i < 8; i++) {
+		output[i * 4]     = ctx->state[i] >> 24;
+		output[i * 4 + 1] = ctx->state[i] >> 16;
+		output[i * 4 + 2] = ctx->state[i] >> 8;
+		output[i * 4 + 3] = ctx->state[i];
+	}
+}
+
+void sha256(const unsigned char *input, size_t ilen, unsigned char output[32])
+{
+	sha256_context ctx;
+
+	sha256_starts(&ctx);
+	sha256_update(&ctx, input, ilen);
+	sha256_finish(&ctx, output);
+	memset(&ctx, 0, sizeof(ctx));
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
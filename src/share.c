@@ -0,0 +1,412 @@
+/* Address discovery shared by the inadyn instances on a host
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Several inadyn on one host, for different users or configurations,
+ * would each ask the same checkip servers for the same address.  With
+ * shared-discovery they share the result in a small file, mapped into
+ * each instance, with one record per checkip setup and address family.
+ * The setup is keyed by a hash of the checkip servers, STUN, DNS, and
+ * gateway settings, and proxy, so only instances asking the same way
+ * share an address.
+ *
+ * One instance, whoever holds the lock on FILE.leader, is the leader.
+ * It looks up the address as usual, every period, and publishes what
+ * it finds.  The others use the published address as long as it is at
+ * most two of their periods old, so if the leader stops, or does not
+ * use their setup, they look up, and publish, the address themselves.
+ * When the leader goes away the first instance to notice takes over.
+ *
+ * Records are written under an flock() of the file, by one instance at
+ * a time, and read without any lock using a sequence counter per
+ * record, odd while being written, read before and after copying.  A
+ * reader that sees it odd, or changed, copies again.
+ *
+ * When a published address changes the file is touched, and on Linux
+ * the others, watching it with inotify, check their addresses at once.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "ddns.h"
+#include "event.h"
+#include "share.h"
+
+#define SHARE_MAGIC		0x494e4453	/* "INDS" */
+#define SHARE_VERSION		1
+#define SHARE_ADDRESS_LEN	48		/* Same on all platforms */
+#define SHARE_RETRIES		1000		/* Reads of a record being written */
+
+struct share_rec {
+	uint32_t seq;			/* Odd while being written */
+	int32_t  family;		/* Of the lookup */
+	int64_t  when;			/* Looked up, wall clock */
+	int32_t  pid;			/* Of the instance that looked */
+	int32_t  reserved;
+	char     key[SHARE_KEY_LEN + 1];
+	char     address[SHARE_ADDRESS_LEN];
+};
+
+struct share_map {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t reclen;		/* sizeof(struct share_rec) */
+	uint32_t num;			/* SHARE_MAX_RECORDS */
+	uint32_t reserved;
+	struct share_rec rec[SHARE_MAX_RECORDS];
+};
+
+char *share_file;
+
+static struct share_map *map;
+static int fd     = -1;		/* Mapped file, flock() when writing */
+static int leader = -1;		/* FILE.leader, locked while we lead */
+static int led;			/* We hold the leader lock */
+static int wd     = -1;		/* inotify */
+
+static uint32_t seen[SHARE_MAX_RECORDS];
+
+/*
+ * Copy of record @i, consistent, or returns non-zero if never written,
+ * or if the writer seems to have died halfway, it was killed while
+ * holding the flock(), the next write of the record fixes it.
+ */
+static int read_rec(int i, struct share_rec *copy)
+{
+	struct share_rec *rec = &map->rec[i];
+	int retries = SHARE_RETRIES;
+	uint32_t seq;
+
+	do {
+		if (!retries--)
+			return 1;
+
+		seq = __atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		memcpy(copy, rec, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&rec->seq, __ATOMIC_RELAXED));
+
+	copy->key[SHARE_KEY_LEN] = 0;
+	copy->address[SHARE_ADDRESS_LEN - 1] = 0;
+
+	return seq == 0;
+}
+
+/* Lead if nobody else does, called every lookup, cheap when already leading */
+static int is_leader(void)
+{
+	if (led || leader == -1)
+		return led;
+
+	if (!flock(leader, LOCK_EX | LOCK_NB)) {
+		logit(LOG_INFO, "Leading shared address discovery in %s", share_file);
+		led = 1;
+	}
+
+	return led;
+}
+
+int share_enabled(void)
+{
+	return map != NULL;
+}
+
+/**
+ * share_lookup - Address looked up by another instance
+ * @key:     Checkip setup, see checkip_key() in ddns.c
+ * @family:  Address family of the lookup
+ * @max_age: sec, how old an address to accept
+ * @address: Buffer for the address
+ * @len:     Size of @address
+ *
+ * The leader, and any instance running --once, always looks up the
+ * address itself, so this fails for them.
+ *
+ * Returns:
+ * POSIX OK(0), or 1 if the address must be looked up.
+ */
+int share_lookup(const char *key, int family, int max_age, char *address, size_t len)
+{
+	struct share_rec rec;
+	time_t now = time(NULL);
+	unsigned char bin[sizeof(struct in6_addr)];
+	int i;
+
+	if (!map || once || is_leader())
+		return 1;
+
+	for (i = 0; i < SHARE_MAX_RECORDS; i++) {
+		if (read_rec(i, &rec) || rec.family != family || strcmp(rec.key, key))
+			continue;
+
+		if (rec.when > now || now - rec.when > max_age)
+			return 1;
+		if (inet_pton(AF_INET, rec.address, bin) != 1 && inet_pton(AF_INET6, rec.address, bin) != 1)
+			return 1;
+
+		logit(LOG_INFO, "Using address %s, looked up %lld sec ago by inadyn PID %d",
+		      rec.address, (long long)(now - rec.when), (int)rec.pid);
+		strlcpy(address, rec.address, len);
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * share_publish - Publish address looked up for the other instances
+ * @key:     Checkip setup, see checkip_key() in ddns.c
+ * @family:  Address family of the lookup
+ * @address: Address found
+ *
+ * Replaces the record of the same setup, or the oldest one.  If the
+ * address changed, the file is touched to notify the others.
+ */
+void share_publish(const char *key, int family, const char *address)
+{
+	struct share_rec *rec = NULL, copy;
+	uint32_t seq;
+	int i, changed;
+
+	if (!map)
+		return;
+
+	if (flock(fd, LOCK_EX)) {
+		logit(LOG_WARNING, "Failed locking %s: %s", share_file, strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < SHARE_MAX_RECORDS; i++) {
+		struct share_rec *r = &map->rec[i];
+
+		if (r->family == family && !strncmp(r->key, key, sizeof(r->key))) {
+			rec = r;
+			break;
+		}
+		if (!rec || r->when < rec->when)
+			rec = r;
+	}
+
+	memcpy(&copy, rec, sizeof(copy));
+	changed = strcmp(copy.address, address) || copy.family != family || strncmp(copy.key, key, sizeof(copy.key));
+
+	/* Odd, also if the last writer died halfway */
+	seq = (copy.seq & ~1U) + 1;
+	__atomic_store_n(&rec->seq, seq, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	rec->family = family;
+	rec->when   = time(NULL);
+	rec->pid    = getpid();
+	strlcpy(rec->key, key, sizeof(rec->key));
+	strlcpy(rec->address, address, sizeof(rec->address));
+
+	__atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+	seen[rec - map->rec] = seq + 1;
+
+	if (changed && futimens(fd, NULL))
+		logit(LOG_DEBUG, "Failed touching %s: %s", share_file, strerror(errno));
+
+	flock(fd, LOCK_UN);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* Published by someone else since last time, and not just refreshed? */
+static int is_news(void)
+{
+	struct share_rec rec;
+	int i, news = 0;
+
+	for (i = 0; i < SHARE_MAX_RECORDS; i++) {
+		if (read_rec(i, &rec) || rec.seq == seen[i])
+			continue;
+
+		seen[i] = rec.seq;
+		if (rec.pid != getpid())
+			news = 1;
+	}
+
+	return news;
+}
+
+static void share_cb(int ifd, void *arg)
+{
+	ddns_t *ctx = (ddns_t *)arg;
+	char buf[sizeof(struct inotify_event) + 256];
+
+	while (read(ifd, buf, sizeof(buf)) > 0)
+		;
+
+	if (!is_news())
+		return;
+
+	logit(LOG_DEBUG, "Shared address changed, checking.");
+	ddns_cmd(ctx, CMD_CHECK_NOW);
+}
+
+static void watch(ddns_t *ctx)
+{
+	int ifd;
+
+	ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ifd < 0)
+		return;
+
+	if (inotify_add_watch(ifd, share_file, IN_ATTRIB) < 0 || event_add(ifd, share_cb, ctx)) {
+		close(ifd);
+		return;
+	}
+
+	wd = ifd;
+	is_news();
+}
+#else
+static void watch(ddns_t *ctx)
+{
+}
+#endif
+
+/* Map @share_file, initializing it if new, or from another version */
+static int open_map(void)
+{
+	struct stat st;
+	char path[256];
+	void *ptr;
+
+	fd = open(share_file, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+	if (fd < 0)
+		return -1;
+
+	if (flock(fd, LOCK_EX))
+		return -1;
+
+	if (fstat(fd, &st))
+		goto fail;
+
+	if ((size_t)st.st_size != sizeof(*map) && ftruncate(fd, sizeof(*map)))
+		goto fail;
+
+	ptr = mmap(NULL, sizeof(*map), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ptr == MAP_FAILED)
+		goto fail;
+	map = ptr;
+
+	if (map->magic != SHARE_MAGIC || map->version != SHARE_VERSION ||
+	    map->reclen != sizeof(struct share_rec) || map->num != SHARE_MAX_RECORDS) {
+		if ((size_t)st.st_size)
+			logit(LOG_NOTICE, "Reinitializing incompatible %s", share_file);
+		memset(map, 0, sizeof(*map));
+		map->magic   = SHARE_MAGIC;
+		map->version = SHARE_VERSION;
+		map->reclen  = sizeof(struct share_rec);
+		map->num     = SHARE_MAX_RECORDS;
+	}
+	flock(fd, LOCK_UN);
+
+	snprintf(path, sizeof(path), "%s.leader", share_file);
+	leader = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+	if (leader < 0)
+		logit(LOG_WARNING, "Cannot open %s, not leading: %s", path, strerror(errno));
+
+	return 0;
+fail:
+	flock(fd, LOCK_UN);
+	return -1;
+}
+
+/**
+ * share_init - Map the file of shared-discovery
+ * @ctx: Context, ctx->cmd is set to %CMD_CHECK_NOW on change
+ *
+ * Failing is not fatal, the address is then looked up as usual.
+ *
+ * Returns:
+ * Always POSIX OK(0).
+ */
+int share_init(ddns_t *ctx)
+{
+	if (map || !share_file || !share_file[0])
+		return 0;
+
+	if (open_map()) {
+		logit(LOG_WARNING, "Cannot share address discovery in %s: %s", share_file, strerror(errno));
+		share_exit();
+		return 0;
+	}
+
+	/* A quick --once only publishes, see share_lookup() */
+	if (!once) {
+		watch(ctx);
+		is_leader();
+	}
+	logit(LOG_DEBUG, "Sharing address discovery in %s", share_file);
+
+	return 0;
+}
+
+void share_exit(void)
+{
+	if (wd != -1) {
+		event_del(wd);
+		close(wd);
+		wd = -1;
+	}
+
+	if (map)
+		munmap(map, sizeof(*map));
+	map = NULL;
+
+	if (fd != -1)
+		close(fd);
+	fd = -1;
+
+	/* Let someone else lead */
+	if (leader != -1)
+		close(leader);
+	leader = -1;
+	led    = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -21,6 +21,8 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
 #include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,13 +31,15 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
-#include <arpa/nameser.h>
 #include <net/if.h>
 #include <netinet/in.h>
-#include <resolv.h>
 
+#include "compat.h"
+#include "budget.h"
+#include "event.h"
 #include "http.h"
 #include "log.h"
+#include "probe.h"
 #include "tcp.h"
 
 int tcp_construct(tcp_sock_t *tcp)
@@ -72,238 +76,764 @@ static int soerror(int sd)
 	return errno = code;
 }
 
+static void set_params(tcp_sock_t *tcp)
+{
+	int port = 0;
+
+	tcp_get_port(tcp, &port);
+	if (port == 0)
+		tcp_set_port(tcp, HTTP_DEFAULT_PORT);
+
+}
+
+/* With a proxy, the TCP connection is to the proxy, not the remote host */
+static const char *peer_host(tcp_sock_t *tcp)
+{
+	return tcp->proxy_type != NO_PROXY ? tcp->proxy_host : tcp->remote_host;
+}
+
+static int peer_port(tcp_sock_t *tcp)
+{
+	return tcp->proxy_type != NO_PROXY ? tcp->proxy_port : tcp->port;
+}
+
+static void forget_addrs(tcp_sock_t *tcp)
+{
+	tcp->num_addrs = 0;
+	tcp->next_addr = 0;
+}
+
+static int family(int force)
+{
+	if (force & TCP_FORCE_IPV4)
+		return AF_INET;		/* Force to use IPV4 */
+	if (force & TCP_FORCE_IPV6)
+		return AF_INET6;	/* Force to use IPV6 */
+
+	return AF_UNSPEC;		/* Allow IPv4 or IPv6 */
+}
+
 /*
- * In the wonderful world of network programming the manual states that
- * EINPROGRESS is only a possible error on non-blocking sockets.  Real world
- * experience, however, suggests otherwise.  Simply poll() for completion and
- * then continue. --Joachim
+ * RFC 8305, section 4: alternate between address families, starting
+ * with the family of the first address, otherwise keep the order from
+ * getaddrinfo(), which is already sorted according to RFC 6724.
  */
-static int check_error(int sd, int msec)
+static void interleave(tcp_sock_t *tcp)
 {
-	struct pollfd pfd = { sd, POLLOUT, 0 };
+	dns_addr_t sorted[DNSCACHE_MAX_ADDRS];
+	int used[DNSCACHE_MAX_ADDRS] = { 0 };
+	int i, n = 0, fam;
 
-	if (EINPROGRESS == errno) {
-		logit(LOG_INFO, "Waiting (%d sec) for three-way handshake to complete ...", msec / 1000);
-		if (poll (&pfd, 1, msec) > 0 && !soerror(sd)) {
-			logit(LOG_INFO, "Connected.");
-			return 0;
+	if (tcp->num_addrs < 2)
+		return;
+
+	fam = tcp->addr[0].ss.ss_family;
+	while (n < tcp->num_addrs) {
+		for (i = 0; i < tcp->num_addrs; i++) {
+			if (!used[i] && tcp->addr[i].ss.ss_family == fam)
+				break;
+		}
+
+		/* None left of that family, take the next of any family */
+		if (i == tcp->num_addrs) {
+			for (i = 0; used[i]; i++)
+				;
 		}
+
+		used[i] = 1;
+		sorted[n++] = tcp->addr[i];
+		fam = fam == AF_INET6 ? AF_INET : AF_INET6;
 	}
 
-	return 1;
+	memcpy(tcp->addr, sorted, n * sizeof(sorted[0]));
 }
 
-static void set_timeouts(int sd, int timeout)
+static const char *numeric(dns_addr_t *addr, char *host, size_t len)
 {
-	struct timeval sv;
+	if (getnameinfo((struct sockaddr *)&addr->ss, addr->len, host, len, NULL, 0, NI_NUMERICHOST))
+		strlcpy(host, "?", len);
 
-	memset(&sv, 0, sizeof(sv));
-	sv.tv_sec  =  timeout / 1000;
-	sv.tv_usec = (timeout % 1000) * 1000;
-	if (-1 == setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &sv, sizeof(sv)))
-		logit(LOG_INFO, "Failed setting receive timeout socket option: %s", strerror(errno));
-	if (-1 == setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO, &sv, sizeof(sv)))
-		logit(LOG_INFO, "Failed setting send timeout socket option: %s", strerror(errno));
+	return host;
 }
 
-static void set_params(tcp_sock_t *tcp)
+/* Abort attempt @i, keeping the others in the race */
+static void drop_attempt(tcp_sock_t *tcp, int i)
 {
-	int port = 0;
+	close(tcp->attempt[i].sd);
 
-	tcp_get_port(tcp, &port);
-	if (port == 0)
-		tcp_set_port(tcp, HTTP_DEFAULT_PORT);
+	tcp->num_attempts--;
+	memmove(&tcp->attempt[i], &tcp->attempt[i + 1], (tcp->num_attempts - i) * sizeof(tcp->attempt[0]));
+}
 
+static void drop_attempts(tcp_sock_t *tcp)
+{
+	while (tcp->num_attempts > 0)
+		drop_attempt(tcp, tcp->num_attempts - 1);
 }
 
-int tcp_init(tcp_sock_t *tcp, char *msg, int force)
+/*
+ * Start a non-blocking connect to the next address from the resolver.
+ * Attempts already in progress are kept, the first one to complete
+ * wins, see tcp_connect_check().
+ */
+static int connect_next(tcp_sock_t *tcp)
 {
-	int rc = 0;
+	char host[NI_MAXHOST];
+
+	while (tcp->next_addr < tcp->num_addrs) {
+		dns_addr_t *ai = &tcp->addr[tcp->next_addr++];
+		struct sockaddr *sa = (struct sockaddr *)&ai->ss;
+		int sd;
+
+		sd = socket(sa->sa_family, SOCK_STREAM, 0);
+		if (sd == -1) {
+			if (!tcp->force)
+				logit(LOG_ERR, "Error creating client socket: %s", strerror(errno));
+			continue;
+		}
+
+		fcntl(sd, F_SETFD, fcntl(sd, F_GETFD) | FD_CLOEXEC);
+		fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+		logit(LOG_INFO, "%s, %sconnecting to %s%s([%s]:%d)", tcp->msg, tcp->tries++ ? "re" : "",
+		      tcp->proxy_type != NO_PROXY ? "proxy " : "", peer_host(tcp),
+		      numeric(ai, host, sizeof(host)), peer_port(tcp));
+
+		if (!connect(sd, sa, ai->len)) {
+			/* Connected already, e.g. to localhost */
+			drop_attempts(tcp);
+			tcp->socket = sd;
+			return 0;
+		}
+
+		if (errno == EINPROGRESS) {
+			long long now = event_msec();
+
+			logit(LOG_INFO, "Waiting (%d sec) for three-way handshake to complete ...",
+			      tcp->timeout / 1000);
+
+			tcp->attempt[tcp->num_attempts].sd   = sd;
+			tcp->attempt[tcp->num_attempts].addr = ai;
+			tcp->num_attempts++;
+			tcp->next_attempt = now + TCP_ATTEMPT_DELAY;
+			tcp->deadline     = budget_clamp(now + tcp->timeout);
+
+			return RC_TCP_WANT_WRITE;
+		}
+
+		if (!tcp->force)
+			logit(LOG_INFO, "Failed connecting to that server: %s", strerror(errno));
+		close(sd);
+	}
+
+	/* No more addresses, but the race may still be on */
+	if (tcp->num_attempts > 0)
+		return RC_TCP_WANT_WRITE;
+
+	return RC_TCP_CONNECT_FAILED;
+}
+
+/* Final verdict of connect attempt, on failure retry without address family */
+static int connect_done(tcp_sock_t *tcp, int rc)
+{
+	if (rc == RC_TCP_WANT_WRITE)
+		return rc;
+
+	PROBE(tcp__connected, peer_host(tcp), rc);
+	forget_addrs(tcp);
+	if (!rc) {
+		tcp->initialized = 1;
+		return 0;
+	}
+
+	if (!tcp->force)
+		logit_limit(LOG_WARNING, "Failed connecting to %s: %s", peer_host(tcp), strerror(errno));
+	tcp_exit(tcp);
+
+	/* Server may have moved, look it up again next time */
+	dnscache_invalidate(peer_host(tcp), peer_port(tcp), family(tcp->force));
+
+	if (tcp->force) {
+		/* fallback to auto mode which select ipv4 or ipv6 in case the previous mode failed */
+		return tcp_connect(tcp, tcp->msg, TCP_AUTO);
+	}
+
+	return rc;
+}
+
+/**
+ * tcp_connect - Resolve remote host and start connecting to it
+ * @tcp:   Socket object, with remote name and port set
+ * @msg:   Prefix for log messages
+ * @force: %TCP_FORCE_IPV4 or %TCP_FORCE_IPV6, or %TCP_AUTO
+ *
+ * The socket is non-blocking, so the connect is only initiated.  The
+ * caller is expected to poll() the descriptors from tcp_connect_fds()
+ * for %POLLOUT, until tcp_connect_deadline(), and then call
+ * tcp_connect_check().
+ *
+ * Connection attempts to the addresses of the remote host are raced
+ * according to Happy Eyeballs (RFC 8305).  A new attempt is started
+ * every %TCP_ATTEMPT_DELAY msec, or as soon as the previous one fails,
+ * alternating between IPv6 and IPv4.  The first to succeed wins.
+ *
+ * Returns:
+ * POSIX OK(0) when connected, %RC_TCP_WANT_WRITE while in progress,
+ * or an error code.
+ */
+int tcp_connect(tcp_sock_t *tcp, const char *msg, int force)
+{
+	int s;
 
 	ASSERT(tcp);
 
 	if (tcp->initialized == 1)
 		return 0;
 
+	/* remote address */
+	if (!tcp->remote_host || (tcp->proxy_type != NO_PROXY && !tcp->proxy_host))
+		return RC_TCP_OBJECT_NOT_INITIALIZED;
+
 	set_params(tcp);
-	do {
-		int s, sd, tries = 0;
-		char port[10];
-		char host[NI_MAXHOST];
-		struct addrinfo hints, *servinfo, *ai;
-		struct sockaddr *sa;
-		socklen_t len;
-
-		/* remote address */
-		if (!tcp->remote_host)
-			break;
+	tcp->msg   = msg;
+	tcp->force = force;
+	tcp->tries = 0;
+
+	/* Obtain address(es) matching host/port, see dnscache.c */
+	s = dnscache_resolve(peer_host(tcp), peer_port(tcp), family(force), tcp->addr, &tcp->num_addrs);
+	if (s != 0) {
+		if (!force)
+			logit_limit(LOG_WARNING, "Failed resolving hostname %s: %s", peer_host(tcp), gai_strerror(s));
+		tcp_exit(tcp);
+		if (force)
+			return tcp_connect(tcp, msg, TCP_AUTO);
+		return RC_TCP_INVALID_REMOTE_ADDR;
+	}
+	tcp->resolved  = event_msec();
+	tcp->next_addr = 0;
+	interleave(tcp);
+	PROBE(tcp__connect, peer_host(tcp), peer_port(tcp), (int)tcp->num_addrs);
 
-		/* Clear DNS cache before calling getaddrinfo(). */
-		res_init();
+	return connect_done(tcp, connect_next(tcp));
+}
 
-		/* Obtain address(es) matching host/port */
-		memset(&hints, 0, sizeof(struct addrinfo));
-		hints.ai_family = AF_UNSPEC;		/* Allow IPv4 or IPv6 */
-		if (force & TCP_FORCE_IPV6)
-			hints.ai_family = AF_INET6;		/* Force to use IPV6 */
+/**
+ * tcp_connect_check - Check connection attempts in progress
+ * @tcp: Socket object, in progress from tcp_connect()
+ *
+ * Call when any of the descriptors from tcp_connect_fds() is ready, or
+ * when tcp_connect_deadline() has passed.  Attempts that have failed,
+ * or timed out, are dropped and the next address is tried.
+ *
+ * Returns:
+ * Same as tcp_connect()
+ */
+int tcp_connect_check(tcp_sock_t *tcp)
+{
+	struct pollfd pfd[DNSCACHE_MAX_ADDRS];
+	char host[NI_MAXHOST];
+	int i, n;
 
-		if (force & TCP_FORCE_IPV4)
-			hints.ai_family = AF_INET;		/* Force to use IPV4 */
+	ASSERT(tcp);
 
-		hints.ai_socktype = SOCK_STREAM;	/* Stream socket */
-		hints.ai_flags = AI_NUMERICSERV;	/* No service name lookup */
-		snprintf(port, sizeof(port), "%d", tcp->port);
+	if (tcp->initialized == 1)
+		return 0;
 
-		s = getaddrinfo(tcp->remote_host, port, &hints, &servinfo);
-		if (s != 0 || !servinfo) {
-			if (!force)
-				logit(LOG_WARNING, "Failed resolving hostname %s: %s", tcp->remote_host, gai_strerror(s));
-			rc = RC_TCP_INVALID_REMOTE_ADDR;
-			break;
-		}
-		ai = servinfo;
-
-		while (1) {
-			sd = socket(ai->ai_family, SOCK_STREAM, 0);
-			if (sd == -1) {
-				if (!force)
-					logit(LOG_ERR, "Error creating client socket: %s", strerror(errno));
-				rc = RC_TCP_SOCKET_CREATE_ERROR;
-				break;
-			}
+	if (!tcp->num_attempts)
+		return RC_TCP_OBJECT_NOT_INITIALIZED;
+
+	n = tcp_connect_fds(tcp, pfd, NELEMS(pfd));
+	if (poll(pfd, n, 0) > 0) {
+		for (i = n - 1; i >= 0; i--) {
+			if (!pfd[i].revents)
+				continue;
 
-			/* Now we try connecting to the server, on connect fail, try next DNS record */
-			sa  = ai->ai_addr;
-			len = ai->ai_addrlen;
-
-			if (getnameinfo(sa, len, host, sizeof(host), NULL, 0, NI_NUMERICHOST))
-				goto next;
-
-			set_timeouts(sd, tcp->timeout);
-
-			logit(LOG_INFO, "%s, %sconnecting to %s([%s]:%d)", msg, tries ? "re" : "",
-			      tcp->remote_host, host, tcp->port);
-			if (connect(sd, sa, len) && check_error(sd, tcp->timeout)) {
-			next:
-				tries++;
-
-				ai = ai->ai_next;
-				if (ai) {
-					if (!force)
-						logit(LOG_INFO, "Failed connecting to that server: %s",
-					    		errno != EINPROGRESS ? strerror(errno) : "retrying ...");
-					close(sd);
-					continue;
-				}
-
-				if (!force)
-					logit(LOG_WARNING, "Failed connecting to %s: %s", tcp->remote_host, strerror(errno));
-				close(sd);
-				rc = RC_TCP_CONNECT_FAILED;
-			} else {
-				tcp->socket = sd;
-				tcp->initialized = 1;
+			if (!soerror(pfd[i].fd)) {
+				logit(LOG_INFO, "Connected to %s.", numeric(tcp->attempt[i].addr, host, sizeof(host)));
+
+				/* We have a winner, abort the others */
+				tcp->socket = tcp->attempt[i].sd;
+				tcp->num_attempts--;
+				memmove(&tcp->attempt[i], &tcp->attempt[i + 1], (tcp->num_attempts - i) * sizeof(tcp->attempt[0]));
+				drop_attempts(tcp);
+
+				return connect_done(tcp, 0);
 			}
 
-			break;
+			if (!tcp->force)
+				logit(LOG_INFO, "Failed connecting to %s: %s",
+				      numeric(tcp->attempt[i].addr, host, sizeof(host)), strerror(errno));
+			drop_attempt(tcp, i);
 		}
+	}
 
-		freeaddrinfo(servinfo);
+	/* The latest attempt got a full timeout, so all of them have timed out */
+	if (tcp->num_attempts && event_msec() >= tcp->deadline) {
+		if (!tcp->force)
+			logit(LOG_INFO, "Timed out connecting to %s", peer_host(tcp));
+		drop_attempts(tcp);
+		errno = ETIMEDOUT;
 	}
-	while (0);
 
-	if (rc) {
-		tcp_exit(tcp);
-		if (force) {
-			/* fallback to auto mode which select ipv4 or ipv6 in case the previous mode failed */
-			return tcp_init(tcp, msg, TCP_AUTO); 
+	/* Start next attempt when all have failed, or when it's time */
+	if (!tcp->num_attempts || event_msec() >= tcp->next_attempt)
+		return connect_done(tcp, connect_next(tcp));
+
+	return RC_TCP_WANT_WRITE;
+}
+
+/**
+ * tcp_connect_fds - Descriptors of connection attempts in progress
+ * @tcp: Socket object, in progress from tcp_connect()
+ * @pfd: Array to fill in, with %POLLOUT events
+ * @max: Size of @pfd
+ *
+ * Returns:
+ * Number of descriptors in @pfd.
+ */
+int tcp_connect_fds(tcp_sock_t *tcp, struct pollfd *pfd, int max)
+{
+	int i;
+
+	ASSERT(tcp);
+
+	for (i = 0; i < tcp->num_attempts && i < max; i++) {
+		pfd[i].fd      = tcp->attempt[i].sd;
+		pfd[i].events  = POLLOUT;
+		pfd[i].revents = 0;
+	}
+
+	return i;
+}
+
+/* When to call tcp_connect_check() next, even if nothing is ready */
+long long tcp_connect_deadline(tcp_sock_t *tcp)
+{
+	ASSERT(tcp);
+
+	if (tcp->next_addr < tcp->num_addrs && tcp->next_attempt < tcp->deadline)
+		return tcp->next_attempt;
+
+	return tcp->deadline;
+}
+
+#ifndef DROP_PROXY
+/* Proxy handshake phases, see tcp_proxy() */
+enum {
+	PROXY_IDLE = 0,
+	PROXY_AUTH,		/* SOCKS5 method selection */
+	PROXY_REPLY,		/* Reply to CONNECT request */
+	PROXY_OPEN,		/* Tunnel to remote host established */
+};
+
+/* Address of the remote host, for proxies that do not resolve names */
+static int proxy_resolve(tcp_sock_t *tcp, int fam, dns_addr_t *addr)
+{
+	dns_addr_t addrs[DNSCACHE_MAX_ADDRS];
+	int num = 0, rc;
+
+	rc = dnscache_resolve(tcp->remote_host, tcp->port, fam, addrs, &num);
+	if (rc || !num) {
+		logit_limit(LOG_WARNING, "Failed resolving hostname %s: %s", tcp->remote_host,
+			    rc ? gai_strerror(rc) : "no address");
+		return 1;
+	}
+	*addr = addrs[0];
+
+	return 0;
+}
+
+/* SOCKS4, or SOCKS4A where the proxy resolves the name, no user id */
+static int socks4_request(tcp_sock_t *tcp)
+{
+	unsigned char *p = tcp->proxy_buf;
+	size_t len;
+
+	*p++ = 4;
+	*p++ = 1;		/* CONNECT */
+	*p++ = tcp->port >> 8;
+	*p++ = tcp->port & 0xff;
+
+	if (tcp->proxy_type == PROXY_SOCKS4A) {
+		len = strlen(tcp->remote_host) + 1;
+		if (len > sizeof(tcp->proxy_buf) - 9)
+			return -1;
+
+		/* 0.0.0.1, the name follows the empty user id */
+		memcpy(p, "\0\0\0\1\0", 5);
+		p += 5;
+		memcpy(p, tcp->remote_host, len);
+		p += len;
+	} else {
+		dns_addr_t addr;
+
+		if (proxy_resolve(tcp, AF_INET, &addr))
+			return -1;
+
+		memcpy(p, &((struct sockaddr_in *)&addr.ss)->sin_addr, 4);
+		p += 4;
+		*p++ = 0;
+	}
+
+	return p - tcp->proxy_buf;
+}
+
+/* SOCKS5 CONNECT, with the name for the proxy to resolve, or an address */
+static int socks5_request(tcp_sock_t *tcp)
+{
+	unsigned char *p = tcp->proxy_buf;
+
+	*p++ = 5;
+	*p++ = 1;		/* CONNECT */
+	*p++ = 0;
+
+	if (tcp->proxy_type == PROXY_SOCKS5_HOSTNAME) {
+		size_t len = strlen(tcp->remote_host);
+
+		if (len > 255)
+			return -1;
+
+		*p++ = 3;
+		*p++ = len;
+		memcpy(p, tcp->remote_host, len);
+		p += len;
+	} else {
+		dns_addr_t addr;
+
+		if (proxy_resolve(tcp, family(tcp->force), &addr))
+			return -1;
+
+		if (addr.ss.ss_family == AF_INET6) {
+			*p++ = 4;
+			memcpy(p, &((struct sockaddr_in6 *)&addr.ss)->sin6_addr, 16);
+			p += 16;
+		} else {
+			*p++ = 1;
+			memcpy(p, &((struct sockaddr_in *)&addr.ss)->sin_addr, 4);
+			p += 4;
 		}
-		return rc;
 	}
 
+	*p++ = tcp->port >> 8;
+	*p++ = tcp->port & 0xff;
+
+	return p - tcp->proxy_buf;
+}
+
+static int connect_request(tcp_sock_t *tcp)
+{
+	char authority[300];
+	int len;
+
+	snprintf(authority, sizeof(authority), strchr(tcp->remote_host, ':') ? "[%s]:%d" : "%s:%d",
+		 tcp->remote_host, tcp->port);
+	len = snprintf((char *)tcp->proxy_buf, sizeof(tcp->proxy_buf),
+		       "CONNECT %s HTTP/1.1\r\n"
+		       "Host: %s\r\n"
+		       "\r\n", authority, authority);
+	if (len < 0 || len >= (int)sizeof(tcp->proxy_buf))
+		return -1;
+
+	return len;
+}
+
+/* Send @len bytes of request in proxy_buf, then wait for reply in @phase */
+static int proxy_queue(tcp_sock_t *tcp, int len, int phase)
+{
+	if (len < 0)
+		return RC_TCP_PROXY_FAILED;
+
+	tcp->proxy_out   = len;
+	tcp->proxy_pos   = 0;
+	tcp->proxy_phase = phase;
+
 	return 0;
 }
 
-int tcp_exit(tcp_sock_t *tcp)
+/* Receive until there are @need bytes in proxy_buf */
+static int proxy_recv(tcp_sock_t *tcp, int need)
 {
+	while (tcp->proxy_pos < need) {
+		int rc, len;
+
+		rc = tcp_recv(tcp, (char *)tcp->proxy_buf + tcp->proxy_pos, need - tcp->proxy_pos, &len);
+		if (rc)
+			return rc;
+		if (len == 0) {
+			logit(LOG_WARNING, "Proxy %s closed connection", tcp->proxy_host);
+			return RC_TCP_PROXY_FAILED;
+		}
+
+		tcp->proxy_pos += len;
+	}
+
+	return 0;
+}
+
+/*
+ * The reply is read exactly, never beyond its end, anything after it
+ * is from the remote host.  For HTTP CONNECT that means one byte at a
+ * time, but only until the end of the headers.
+ */
+static int proxy_reply(tcp_sock_t *tcp)
+{
+	unsigned char *buf = tcp->proxy_buf;
+	int rc, code = 0;
+
+	switch (tcp->proxy_type) {
+	case PROXY_SOCKS4:
+	case PROXY_SOCKS4A:
+		rc = proxy_recv(tcp, 8);
+		if (rc)
+			return rc;
+
+		code = buf[1];
+		if (code == 90)
+			return 0;
+		break;
+
+	case PROXY_SOCKS5:
+	case PROXY_SOCKS5_HOSTNAME:
+		rc = proxy_recv(tcp, 5);
+		if (rc)
+			return rc;
+
+		/* Bound address, which we do not need, and port */
+		switch (buf[3]) {
+		case 1:
+			rc = proxy_recv(tcp, 4 + 4 + 2);
+			break;
+		case 3:
+			rc = proxy_recv(tcp, 4 + 1 + buf[4] + 2);
+			break;
+		case 4:
+			rc = proxy_recv(tcp, 4 + 16 + 2);
+			break;
+		default:
+			logit(LOG_WARNING, "Invalid reply from proxy %s", tcp->proxy_host);
+			return RC_TCP_PROXY_FAILED;
+		}
+		if (rc)
+			return rc;
+
+		code = buf[1];
+		if (code == 0)
+			return 0;
+		break;
+
+	default:
+		while (tcp->proxy_pos < 4 || memcmp(buf + tcp->proxy_pos - 4, "\r\n\r\n", 4)) {
+			if (tcp->proxy_pos >= (int)sizeof(tcp->proxy_buf) - 1) {
+				logit(LOG_WARNING, "Too long reply from proxy %s", tcp->proxy_host);
+				return RC_TCP_PROXY_FAILED;
+			}
+
+			rc = proxy_recv(tcp, tcp->proxy_pos + 1);
+			if (rc)
+				return rc;
+		}
+		buf[tcp->proxy_pos] = 0;
+
+		if (sscanf((char *)buf, "HTTP/%*d.%*d %d", &code) == 1 && code / 100 == 2)
+			return 0;
+		break;
+	}
+
+	logit(LOG_WARNING, "Proxy %s refused connection to %s:%d, code %d", tcp->proxy_host,
+	      tcp->remote_host, tcp->port, code);
+
+	return RC_TCP_PROXY_FAILED;
+}
+
+/**
+ * tcp_proxy - Set up tunnel through proxy to remote host
+ * @tcp: Socket object, connected by tcp_connect()
+ *
+ * Non-blocking, like tcp_send() and tcp_recv(), call again when the
+ * socket is ready for the event asked for.  Returns OK immediately if
+ * no proxy is set, or the tunnel is already up.  SOCKS5 is without any
+ * authentication, SOCKS4 without a user id.
+ *
+ * Returns:
+ * POSIX OK(0) when the tunnel is up, %RC_TCP_WANT_READ or
+ * %RC_TCP_WANT_WRITE while in progress, or an error code.
+ */
+int tcp_proxy(tcp_sock_t *tcp)
+{
+	unsigned char *buf = tcp->proxy_buf;
+	int rc, len;
+
 	ASSERT(tcp);
 
+	if (tcp->proxy_type == NO_PROXY || tcp->proxy_phase == PROXY_OPEN)
+		return 0;
 	if (!tcp->initialized)
+		return RC_TCP_OBJECT_NOT_INITIALIZED;
+
+	if (tcp->proxy_phase == PROXY_IDLE) {
+		switch (tcp->proxy_type) {
+		case PROXY_SOCKS4:
+		case PROXY_SOCKS4A:
+			rc = proxy_queue(tcp, socks4_request(tcp), PROXY_REPLY);
+			break;
+
+		case PROXY_SOCKS5:
+		case PROXY_SOCKS5_HOSTNAME:
+			/* Version 5, one method: no authentication */
+			memcpy(buf, "\5\1\0", 3);
+			rc = proxy_queue(tcp, 3, PROXY_AUTH);
+			break;
+
+		default:
+			rc = proxy_queue(tcp, connect_request(tcp), PROXY_REPLY);
+			break;
+		}
+		if (rc)
+			return rc;
+	}
+
+	while (1) {
+		while (tcp->proxy_pos < tcp->proxy_out) {
+			rc = tcp_send(tcp, (char *)buf + tcp->proxy_pos, tcp->proxy_out - tcp->proxy_pos, &len);
+			if (rc)
+				return rc;
+
+			tcp->proxy_pos += len;
+		}
+
+		/* Request sent, now for the reply */
+		if (tcp->proxy_out) {
+			tcp->proxy_out = 0;
+			tcp->proxy_pos = 0;
+		}
+
+		if (tcp->proxy_phase == PROXY_AUTH) {
+			rc = proxy_recv(tcp, 2);
+			if (rc)
+				return rc;
+
+			if (buf[0] != 5 || buf[1] != 0) {
+				logit(LOG_WARNING, "Proxy %s requires authentication, not supported.",
+				      tcp->proxy_host);
+				return RC_TCP_PROXY_FAILED;
+			}
+
+			rc = proxy_queue(tcp, socks5_request(tcp), PROXY_REPLY);
+			if (rc)
+				return rc;
+			continue;
+		}
+
+		rc = proxy_reply(tcp);
+		if (rc)
+			return rc;
+
+		logit(LOG_DEBUG, "Tunnel to %s:%d through proxy %s up.", tcp->remote_host, tcp->port,
+		      tcp->proxy_host);
+		tcp->proxy_phase = PROXY_OPEN;
+
 		return 0;
+	}
+}
+#else
+/* Built without proxy support, conf.c never sets one */
+int tcp_proxy(tcp_sock_t *tcp)
+{
+	return 0;
+}
+#endif
 
+int tcp_exit(tcp_sock_t *tcp)
+{
+	ASSERT(tcp);
+
+	/* May also be called to abort a connect in progress */
+	forget_addrs(tcp);
+	drop_attempts(tcp);
 	if (tcp->socket > -1) {
 		close(tcp->socket);
 		tcp->socket = -1;
 	}
 
 	tcp->initialized = 0;
+#ifndef DROP_PROXY
+	tcp->proxy_phase = 0;
+#endif
 
 	return 0;
 }
 
-int tcp_send(tcp_sock_t *tcp, const char *buf, int len)
+/**
+ * tcp_send - Non-blocking send
+ * @tcp:  Connected socket object
+ * @buf:  Data to send
+ * @len:  Length of @buf
+ * @sent: Number of bytes sent, may be less than @len
+ *
+ * Returns:
+ * POSIX OK(0), %RC_TCP_WANT_WRITE if the socket buffer is full, or
+ * %RC_TCP_SEND_ERROR.
+ */
+int tcp_send(tcp_sock_t *tcp, const char *buf, int len, int *sent)
 {
+	ssize_t num;
+
 	ASSERT(tcp);
+	ASSERT(sent);
 
+	*sent = 0;
 	if (!tcp->initialized)
 		return RC_TCP_OBJECT_NOT_INITIALIZED;
-again:
-	if (send(tcp->socket, buf, len, 0) == -1) {
-		int err = errno;
-		if(err == EAGAIN || err == EWOULDBLOCK){
-			goto again;
-		}
+
+	num = send(tcp->socket, buf, len, 0);
+	if (num == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return RC_TCP_WANT_WRITE;
+
 		logit(LOG_WARNING, "Network error while sending query/update: %s", strerror(errno));
 		return RC_TCP_SEND_ERROR;
 	}
 
+	*sent = (int)num;
+
 	return 0;
 }
 
+/**
+ * tcp_recv - Non-blocking receive
+ * @tcp:      Connected socket object
+ * @buf:      Buffer to receive into
+ * @len:      Size of @buf
+ * @recv_len: Number of bytes received, zero on end of stream
+ *
+ * Returns:
+ * POSIX OK(0), %RC_TCP_WANT_READ if there is nothing to read yet, or
+ * %RC_TCP_RECV_ERROR.
+ */
 int tcp_recv(tcp_sock_t *tcp, char *buf, int len, int *recv_len)
 {
-	int rc = 0;
-	int remaining_bytes = len;
-	int total_bytes = 0;
+	ssize_t num;
 
 	ASSERT(tcp);
 	ASSERT(buf);
 	ASSERT(recv_len);
 
+	*recv_len = 0;
 	if (!tcp->initialized)
 		return RC_TCP_OBJECT_NOT_INITIALIZED;
 
-	while (remaining_bytes > 0) {
-		int bytes;
-		int err = 0;
-		int chunk_size = remaining_bytes > TCP_DEFAULT_READ_CHUNK_SIZE
-			? TCP_DEFAULT_READ_CHUNK_SIZE
-			: remaining_bytes;
-
-		bytes = recv(tcp->socket, buf + total_bytes, chunk_size, 0);
-		err = errno;
-		if(bytes == -1 && (err == EAGAIN || err == EWOULDBLOCK)){
-			continue;
-		}
-		if (bytes < 0) {
-			logit(LOG_WARNING, "Network error while waiting for reply: %s", strerror(errno));
-			rc = RC_TCP_RECV_ERROR;
-			break;
-		}
-
-		if (bytes == 0) {
-			if (total_bytes == 0)
-				rc = RC_TCP_RECV_ERROR;
-			break;
-		}
+	num = recv(tcp->socket, buf, len, 0);
+	if (num == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return RC_TCP_WANT_READ;
 
-		total_bytes    += bytes;
-		remaining_bytes = len - total_bytes;
+		logit(LOG_WARNING, "Network error while waiting for reply: %s", strerror(errno));
+		return RC_TCP_RECV_ERROR;
 	}
 
-	*recv_len = total_bytes;
+	*recv_len = (int)num;
 
-	return rc;
+	return 0;
 }
 
 int tcp_set_port(tcp_sock_t *tcp, int port)
@@ -344,6 +874,20 @@ int tcp_get_remote_name(tcp_sock_t *tcp, const char **name)
 	return 0;
 }
 
+int tcp_set_proxy(tcp_sock_t *tcp, tcp_proxy_type_t type, const char *name, int port)
+{
+	ASSERT(tcp);
+
+	if (port < 0 || port > TCP_SOCKET_MAX_PORT)
+		return RC_TCP_BAD_PARAMETER;
+
+	tcp->proxy_type = name && name[0] ? type : NO_PROXY;
+	tcp->proxy_host = name;
+	tcp->proxy_port = port;
+
+	return 0;
+}
+
 int tcp_set_remote_timeout(tcp_sock_t *tcp, int timeout)
 {
 	ASSERT(tcp);
@@ -0,0 +1,329 @@
+/* Per-cycle trace timeline, in the Chrome trace event format
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * The metrics tell how long cycles take, not why one of them took 40
+ * sec.  With trace, or trace-file, set every step of a cycle is kept as
+ * a span on a timeline: address discovery per provider, verification of
+ * each alias, plugin setup and its lookups, the phases of each HTTP(S)
+ * conversation, updates, state file writes, and hooks started.  At the
+ * end of the cycle the timeline is written to the trace-file, and kept
+ * for the trace command of the control socket.
+ *
+ * The format is the Chrome trace event format, JSON, as read by e.g.
+ * https://ui.perfetto.dev.  Each worker thread, see concurrency, has a
+ * track of its own, so it shows what runs in parallel and what is still
+ * done one step after the other by the main thread.
+ *
+ * Timestamps are monotonic microseconds, the same clock as event_msec().
+ * Spans are recorded when they end, by any thread.  Spans that end
+ * between cycles, e.g. of prewarmed connections, are part of the next.
+ * Not tracing costs one test per span.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ddns.h"
+#include "trace.h"
+
+int   trace_enabled = 0;
+char *trace_file    = NULL;
+
+struct trace_event {
+	long long   ts;		/* usec */
+	long long   dur;	/* usec */
+	const char *cat;
+	int         tid;	/* Worker, zero for the main thread */
+	char        label[TRACE_LABEL_LEN];
+};
+
+struct timeline {
+	struct trace_event *ev;
+	size_t              num;
+	unsigned long       dropped;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   key;
+static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
+static struct timeline cur;	/* Being recorded */
+static struct timeline last;	/* Of the last cycle */
+
+static void make_key(void)
+{
+	pthread_key_create(&key, NULL);
+}
+
+static long long now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return (long long)time(NULL) * 1000000;
+
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void add(long long start, long long end, const char *cat, const char *fmt, va_list ap)
+{
+	struct trace_event *ev;
+	int tid;
+
+	pthread_once(&key_once, make_key);
+	tid = (int)(intptr_t)pthread_getspecific(key);
+
+	pthread_mutex_lock(&lock);
+	if (!cur.ev)
+		goto done;
+	if (cur.num >= TRACE_MAX_EVENTS) {
+		cur.dropped++;
+		goto done;
+	}
+
+	ev = &cur.ev[cur.num++];
+	ev->ts  = start;
+	ev->dur = end > start ? end - start : 0;
+	ev->cat = cat;
+	ev->tid = tid;
+	vsnprintf(ev->label, sizeof(ev->label), fmt, ap);
+done:
+	pthread_mutex_unlock(&lock);
+}
+
+static void release(void)
+{
+	free(cur.ev);
+	free(last.ev);
+	memset(&cur, 0, sizeof(cur));
+	memset(&last, 0, sizeof(last));
+}
+
+/**
+ * trace_cycle - Start of a cycle
+ *
+ * Sets up the timelines when tracing, or frees them if tracing has been
+ * disabled, e.g. by a reload.
+ *
+ * Returns:
+ * Start of the cycle, for trace_span(), or zero when not tracing.
+ */
+long long trace_cycle(void)
+{
+	pthread_mutex_lock(&lock);
+	if (!trace_enabled) {
+		release();
+		goto done;
+	}
+
+	if (!cur.ev)
+		cur.ev  = calloc(TRACE_MAX_EVENTS, sizeof(*cur.ev));
+	if (!last.ev)
+		last.ev = calloc(TRACE_MAX_EVENTS, sizeof(*last.ev));
+	if (!cur.ev || !last.ev) {
+		logit(LOG_WARNING, "Failed allocating trace timeline, tracing disabled.");
+		trace_enabled = 0;
+		release();
+	}
+done:
+	pthread_mutex_unlock(&lock);
+
+	return trace_start();
+}
+
+/* Start of a span, or zero when not tracing */
+long long trace_start(void)
+{
+	if (!trace_enabled)
+		return 0;
+
+	return now();
+}
+
+/**
+ * trace_span - Record a span that ends now
+ * @start: From trace_start(), nothing is recorded if zero
+ * @cat:   Category, a string constant, e.g. "http"
+ * @fmt:   Label, printf() style
+ */
+void trace_span(long long start, const char *cat, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!start || !trace_enabled)
+		return;
+
+	va_start(ap, fmt);
+	add(start, now(), cat, fmt, ap);
+	va_end(ap);
+}
+
+/* Record a span in the past, e.g. from event_msec() stamps * 1000 */
+void trace_range(long long start, long long end, const char *cat, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!trace_enabled)
+		return;
+
+	va_start(ap, fmt);
+	add(start, end, cat, fmt, ap);
+	va_end(ap);
+}
+
+/* Spans recorded by the calling thread go on the track of worker @id */
+void trace_thread(int id)
+{
+	pthread_once(&key_once, make_key);
+	pthread_setspecific(key, (void *)(intptr_t)id);
+}
+
+static void json_str(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+/**
+ * trace_render - Timeline of the last cycle, in Chrome trace event format
+ * @fp: Stream to write to
+ *
+ * Returns:
+ * POSIX OK(0), or %RC_FILE_IO_ACCESS_ERROR on write error.
+ */
+int trace_render(FILE *fp)
+{
+	int pid = (int)getpid();
+	int tid, max = 0;
+	size_t i;
+
+	pthread_mutex_lock(&lock);
+	for (i = 0; i < last.num; i++) {
+		if (last.ev[i].tid > max)
+			max = last.ev[i].tid;
+	}
+
+	fprintf(fp, "{ \"displayTimeUnit\": \"ms\", \"otherData\": { \"dropped\": %lu },\n"
+		"  \"traceEvents\": [", last.dropped);
+	for (tid = 0; tid <= max; tid++) {
+		fprintf(fp, "%s\n    { \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, "
+			"\"args\": { \"name\": ", tid ? "," : "", pid, tid);
+		if (tid)
+			fprintf(fp, "\"worker %d\" } }", tid);
+		else
+			fprintf(fp, "\"main\" } }");
+	}
+
+	for (i = 0; i < last.num; i++) {
+		struct trace_event *ev = &last.ev[i];
+
+		fprintf(fp, ",\n    { \"name\": ");
+		json_str(fp, ev->label);
+		fprintf(fp, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %lld, \"pid\": %d, \"tid\": %d }",
+			ev->cat, ev->ts, ev->dur, pid, ev->tid);
+	}
+	fprintf(fp, " ] }\n");
+	pthread_mutex_unlock(&lock);
+
+	return ferror(fp) ? RC_FILE_IO_ACCESS_ERROR : 0;
+}
+
+/**
+ * trace_write - End of a cycle, keep its timeline and write trace-file
+ *
+ * The trace-file, if set, is replaced atomically.
+ *
+ * Returns:
+ * POSIX OK(0), or non-zero on error writing the file.
+ */
+int trace_write(void)
+{
+	char tmp[strlen(trace_file ? trace_file : "") + 5];
+	struct timeline swap;
+	FILE *fp;
+	int rc;
+
+	if (!trace_enabled)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+	swap = last;
+	last = cur;
+	cur  = swap;
+	cur.num     = 0;
+	cur.dropped = 0;
+	pthread_mutex_unlock(&lock);
+
+	if (last.dropped)
+		logit(LOG_DEBUG, "Trace timeline full, %lu spans dropped.", last.dropped);
+
+	if (!trace_file)
+		return 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", trace_file);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		logit(LOG_WARNING, "Failed creating %s: %s", tmp, strerror(errno));
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	rc = trace_render(fp);
+	if (fclose(fp))
+		rc = RC_FILE_IO_ACCESS_ERROR;
+	if (rc) {
+		logit(LOG_WARNING, "Failed writing %s: %s", tmp, strerror(errno));
+		unlink(tmp);
+		return rc;
+	}
+
+	if (rename(tmp, trace_file)) {
+		logit(LOG_WARNING, "Failed replacing %s: %s", trace_file, strerror(errno));
+		unlink(tmp);
+		return RC_FILE_IO_ACCESS_ERROR;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,392 @@
+/* io_uring backend for event_poll(), Linux only
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * The HTTP engine, and the TLS libraries below it, are built around
+ * readiness: wait for a socket to become readable or writable, then
+ * let the library call send() or recv().  This backend keeps that, but
+ * arms one IORING_OP_POLL_ADD for every descriptor of a wait, plus an
+ * IORING_OP_TIMEOUT, and submits the lot, and waits, with a single
+ * io_uring_enter().
+ *
+ * Polls that have not fired when the wait returns are left armed, and
+ * cancelled in the same submission as the next wait, so every wait is
+ * one system call.  Completions from an earlier wait are told apart by
+ * a generation number in the user_data of each request.
+ *
+ * Every thread, e.g. the update workers, gets a ring of its own, torn
+ * down when the thread exits.  If the kernel does not support io_uring,
+ * or seccomp forbids it, poll() is used instead.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "log.h"
+#include "uring.h"
+
+#define URING_ENTRIES	128		/* Requests per wait, incl. cancels */
+#define URING_TIMEOUT	0xffffffffULL	/* Index of the timeout request */
+#define URING_CANCEL	(~0ULL)		/* user_data of cancel requests */
+
+/* A request submitted by an earlier wait, still in the kernel */
+struct armed {
+	__u64 data;
+	int   cancelled;
+};
+
+struct uring {
+	int                  fd;
+
+	unsigned            *sq_head;
+	unsigned            *sq_tail;
+	unsigned             sq_mask;
+	unsigned             sq_entries;
+	unsigned            *sq_array;
+	struct io_uring_sqe *sqes;
+
+	unsigned            *cq_head;
+	unsigned            *cq_tail;
+	unsigned             cq_mask;
+	struct io_uring_cqe *cqes;
+
+	void                *sq_ptr;
+	size_t               sq_len;
+	void                *cq_ptr;
+	size_t               cq_len;
+	size_t               sqes_len;
+
+	struct __kernel_timespec ts;	/* Of the timeout, until submitted */
+	__u64                gen;	/* Of the current wait */
+	struct armed         armed[URING_ENTRIES];
+	int                  num_armed;
+};
+
+static pthread_key_t  key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int            broken;	/* Setup failed, use poll() */
+
+static void uring_free(void *arg)
+{
+	struct uring *r = (struct uring *)arg;
+
+	if (!r)
+		return;
+
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr)
+		munmap(r->cq_ptr, r->cq_len);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_len);
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r);
+}
+
+static void make_key(void)
+{
+	pthread_key_create(&key, uring_free);
+}
+
+static void *ring_map(int fd, size_t len, off_t off)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, off);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	return ptr;
+}
+
+static struct uring *uring_new(void)
+{
+	struct io_uring_params p;
+	struct uring *r;
+
+	r = calloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	p.flags      = IORING_SETUP_CQSIZE;
+	p.cq_entries = URING_ENTRIES * 4;
+	r->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+	if (r->fd < 0)
+		goto fail;
+
+	/* Cancelled requests must not be lost, or they stay armed forever */
+	if (!(p.features & IORING_FEAT_NODROP)) {
+		errno = ENOTSUP;
+		goto fail;
+	}
+
+	r->sq_len   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_len   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+	r->sq_ptr = ring_map(r->fd, r->sq_len, IORING_OFF_SQ_RING);
+	r->cq_ptr = ring_map(r->fd, r->cq_len, IORING_OFF_CQ_RING);
+	r->sqes   = ring_map(r->fd, r->sqes_len, IORING_OFF_SQES);
+	if (!r->sq_ptr || !r->cq_ptr || !r->sqes)
+		goto fail;
+
+	r->sq_head    = (unsigned *)((char *)r->sq_ptr + p.sq_off.head);
+	r->sq_tail    = (unsigned *)((char *)r->sq_ptr + p.sq_off.tail);
+	r->sq_mask    = *(unsigned *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_entries = p.sq_entries;
+	r->sq_array   = (unsigned *)((char *)r->sq_ptr + p.sq_off.array);
+
+	r->cq_head    = (unsigned *)((char *)r->cq_ptr + p.cq_off.head);
+	r->cq_tail    = (unsigned *)((char *)r->cq_ptr + p.cq_off.tail);
+	r->cq_mask    = *(unsigned *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+	r->cqes       = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+
+	return r;
+fail:
+	logit(LOG_WARNING, "Cannot use io_uring, falling back to poll(): %s", strerror(errno));
+	uring_free(r);
+
+	return NULL;
+}
+
+/* Ring of the calling thread, set up on first use */
+static struct uring *uring_get(void)
+{
+	struct uring *r;
+
+	if (__atomic_load_n(&broken, __ATOMIC_RELAXED))
+		return NULL;
+
+	pthread_once(&once, make_key);
+	r = pthread_getspecific(key);
+	if (r)
+		return r;
+
+	r = uring_new();
+	if (!r) {
+		__atomic_store_n(&broken, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	pthread_setspecific(key, r);
+
+	return r;
+}
+
+static struct io_uring_sqe *sqe_get(struct uring *r, __u8 op, __u64 data)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned idx  = tail & r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode    = op;
+	sqe->user_data = data;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	return sqe;
+}
+
+static void arm(struct uring *r, __u64 data)
+{
+	r->armed[r->num_armed].data      = data;
+	r->armed[r->num_armed].cancelled = 0;
+	r->num_armed++;
+}
+
+static void disarm(struct uring *r, __u64 data)
+{
+	int i;
+
+	for (i = 0; i < r->num_armed; i++) {
+		if (r->armed[i].data != data)
+			continue;
+
+		r->armed[i] = r->armed[--r->num_armed];
+		break;
+	}
+}
+
+/* Collect completions, returns number of descriptors of this wait ready */
+static int reap(struct uring *r, struct pollfd *pfd, int *timeout)
+{
+	unsigned head = *r->cq_head;
+	unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	int num = 0;
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &r->cqes[head & r->cq_mask];
+		__u64 data = cqe->user_data;
+
+		head++;
+		if (data == URING_CANCEL)
+			continue;
+
+		disarm(r, data);
+		if (data >> 32 != r->gen)
+			continue;
+
+		if ((data & URING_TIMEOUT) == URING_TIMEOUT) {
+			*timeout = 1;
+			continue;
+		}
+
+		if (cqe->res < 0)
+			pfd[data & URING_TIMEOUT].revents = cqe->res == -EBADF ? POLLNVAL : POLLERR;
+		else
+			pfd[data & URING_TIMEOUT].revents = cqe->res;
+		num++;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+
+	return num;
+}
+
+/**
+ * uring_poll - Like poll(), using the io_uring of the calling thread
+ * @pfd:  Descriptors and events to wait for
+ * @num:  Number of entries in @pfd
+ * @msec: Max time to wait, -1 to wait forever
+ *
+ * Falls back to poll() if io_uring is not available, if the wait does
+ * not fit in the ring, or for a zero @msec, which never sleeps anyway.
+ *
+ * Returns:
+ * Number of entries in @pfd with revents set, zero on timeout, or -1
+ * on error, with errno set.
+ */
+int uring_poll(struct pollfd *pfd, int num, int msec)
+{
+	struct uring *r;
+	unsigned pending;
+	int i, ready = 0, timeout = 0, polls = 0, cancels = 0;
+
+	if (!msec)
+		return poll(pfd, num, msec);
+
+	r = uring_get();
+	if (!r)
+		return poll(pfd, num, msec);
+
+	for (i = 0; i < num; i++) {
+		if (pfd[i].fd >= 0)
+			polls++;
+	}
+	for (i = 0; i < r->num_armed; i++) {
+		if (!r->armed[i].cancelled)
+			cancels++;
+	}
+
+	pending = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	if (pending + cancels + polls + 1 > r->sq_entries ||
+	    r->num_armed + polls + 1 > URING_ENTRIES)
+		return poll(pfd, num, msec);
+
+	r->gen = (r->gen + 1) & 0x7fffffff;
+
+	for (i = 0; i < r->num_armed; i++) {
+		struct io_uring_sqe *sqe;
+
+		if (r->armed[i].cancelled)
+			continue;
+
+		sqe = sqe_get(r, IORING_OP_ASYNC_CANCEL, URING_CANCEL);
+		sqe->addr = r->armed[i].data;
+		r->armed[i].cancelled = 1;
+	}
+
+	for (i = 0; i < num; i++) {
+		struct io_uring_sqe *sqe;
+		__u64 data = r->gen << 32 | i;
+
+		pfd[i].revents = 0;
+		if (pfd[i].fd < 0)
+			continue;
+
+		sqe = sqe_get(r, IORING_OP_POLL_ADD, data);
+		sqe->fd          = pfd[i].fd;
+		sqe->poll_events = pfd[i].events;
+		arm(r, data);
+	}
+
+	if (msec > 0) {
+		struct io_uring_sqe *sqe;
+		__u64 data = r->gen << 32 | URING_TIMEOUT;
+
+		r->ts.tv_sec  = msec / 1000;
+		r->ts.tv_nsec = (msec % 1000) * 1000000LL;
+
+		sqe = sqe_get(r, IORING_OP_TIMEOUT, data);
+		sqe->addr = (unsigned long)&r->ts;
+		sqe->len  = 1;
+		arm(r, data);
+	}
+
+	/* Completions from earlier waits may wake us up, keep waiting */
+	while (!ready && !timeout) {
+		unsigned submit = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+
+		if (syscall(__NR_io_uring_enter, r->fd, submit, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+				ready = reap(r, pfd, &timeout);
+				if (ready || errno == EINTR)
+					break;
+				continue;
+			}
+			return -1;
+		}
+
+		ready = reap(r, pfd, &timeout);
+	}
+
+	return ready;
+}
+
+/* Release the ring of the calling thread, e.g. when poll() is selected */
+void uring_exit(void)
+{
+	struct uring *r;
+
+	pthread_once(&once, make_key);
+	r = pthread_getspecific(key);
+	if (!r)
+		return;
+
+	pthread_setspecific(key, NULL);
+	uring_free(r);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
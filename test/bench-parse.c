@@ -0,0 +1,410 @@
+/* Microbenchmarks of the parsers that run on every update cycle
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Every file in a subdirectory of the corpus is fed to one parser:
+ *
+ *   address/  is_address_valid(), one address per line
+ *   checkip/  parse_my_address(), checkip server replies
+ *   iface/    parse_my_address(), checkip-command output, e.g. ip addr
+ *   http/     http_parse(), complete HTTP responses
+ *   json/     json_parse(), provider API replies
+ *   dyndns/   common_response(), DynDNS style update replies
+ *
+ * Each input is parsed over and over for a while, the time per call is
+ * reported together with the result of the parser.  The results do not
+ * depend on timing, so the output of -r, results only, can be diffed
+ * before and after a parser change.  The time includes copying the
+ * input to a scratch buffer, since most parsers modify their input.
+ *
+ * The subdirectories double as seed corpora for fuzzers, and -x runs
+ * one parser on files given on the command line, e.g.
+ *
+ *   afl-fuzz -i corpus/http -o findings -- ./bench-parse -x http @@
+ */
+
+#include "config.h"
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "address.h"
+#include "ddns.h"
+#include "error.h"
+#include "http.h"
+#include "json.h"
+#include "log.h"
+
+#define WORK_SIZE	65536	/* Largest input, incl. room for parsers */
+#define MAX_INPUTS	256	/* Per suite */
+#define RESULT_LEN	128
+
+/* Normally set by main.c from .conf and command line */
+int   allow_ipv6  = 1;
+int   verify_addr = 1;
+char *prognm      = "bench-parse";
+
+struct input {
+	char   name[64];
+	char  *data;
+	size_t len;
+};
+
+struct suite {
+	const char *name;
+	const char *func;
+	void      (*run)(const struct input *in, char *result, size_t len);
+};
+
+static char work[WORK_SIZE];
+static int  segment;		/* -s, feed http_parse() this many bytes at a time */
+
+static void run_address(const struct input *in, char *result, size_t len)
+{
+	char *line, *next;
+	int num = 0, valid = 0;
+
+	memcpy(work, in->data, in->len + 1);
+	for (line = work; *line; line = next) {
+		next = line + strcspn(line, "\r\n");
+		if (*next)
+			*next++ = 0;
+		if (!*line)
+			continue;
+
+		num++;
+		if (is_address_valid(strchr(line, ':') ? AF_INET6 : AF_INET, line))
+			valid++;
+	}
+
+	snprintf(result, len, "%d of %d valid", valid, num);
+}
+
+static void run_checkip(const struct input *in, char *result, size_t len)
+{
+	char address[64];
+
+	memcpy(work, in->data, in->len + 1);
+	if (parse_my_address(work, address, sizeof(address)))
+		snprintf(result, len, "no address");
+	else
+		snprintf(result, len, "%s", address);
+}
+
+static void run_http(const struct input *in, char *result, size_t len)
+{
+	http_trans_t trans;
+	size_t pos = 0;
+	int rc;
+
+	memset(&trans, 0, sizeof(trans));
+	trans.rsp         = work;
+	trans.max_rsp_len = sizeof(work) - 1;
+	http_parse_init(&trans);
+
+	/* Like data arriving from the server, one read at a time */
+	do {
+		size_t num = in->len - pos;
+
+		if (segment > 0 && num > (size_t)segment)
+			num = segment;
+
+		memcpy(&trans.rsp[trans.rsp_len], &in->data[pos], num);
+		trans.rsp_len += num;
+		pos += num;
+
+		rc = http_parse(&trans, 0);
+	} while (rc == RC_TCP_WANT_READ && pos < in->len);
+
+	/* Server closed */
+	if (rc == RC_TCP_WANT_READ)
+		rc = http_parse(&trans, 1);
+
+	snprintf(result, len, "%s status %d body %d%s", error_name(rc), trans.status,
+		 trans.body_len, trans.close ? " close" : "");
+}
+
+#ifndef DROP_JSON
+static void run_json(const struct input *in, char *result, size_t len)
+{
+	json_t js;
+	int num;
+
+	num = json_parse(&js, in->data, in->len);
+	json_free(&js);
+
+	if (num < 0)
+		snprintf(result, len, "error");
+	else
+		snprintf(result, len, "%d tokens", num);
+}
+#endif
+
+static void run_dyndns(const struct input *in, char *result, size_t len)
+{
+	http_trans_t trans;
+	int rc;
+
+	memcpy(work, in->data, in->len + 1);
+	memset(&trans, 0, sizeof(trans));
+	trans.status   = 200;
+	trans.rsp      = work;
+	trans.rsp_len  = in->len;
+	trans.rsp_body = work;
+
+	rc = common_response(&trans, NULL, NULL);
+	snprintf(result, len, "%s", error_name(rc));
+}
+
+static const struct suite suites[] = {
+	{ "address", "is_address_valid()", run_address },
+	{ "checkip", "parse_my_address()", run_checkip },
+	{ "iface",   "parse_my_address()", run_checkip },
+	{ "http",    "http_parse()",       run_http    },
+#ifndef DROP_JSON
+	{ "json",    "json_parse()",       run_json    },
+#endif
+	{ "dyndns",  "common_response()",  run_dyndns  },
+};
+
+static long long now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int load(struct input *in, const char *path, const char *name)
+{
+	FILE *fp;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	/* Leave room for parsers that add to the input, e.g. a NUL */
+	in->data = malloc(WORK_SIZE / 2);
+	if (!in->data) {
+		fclose(fp);
+		return -1;
+	}
+
+	in->len = fread(in->data, 1, WORK_SIZE / 2 - 1, fp);
+	in->data[in->len] = 0;
+	snprintf(in->name, sizeof(in->name), "%s", name);
+	fclose(fp);
+
+	return 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+	return strcmp(((const struct input *)a)->name, ((const struct input *)b)->name);
+}
+
+/* Run one input until at least @msec have passed, returns nsec per call */
+static double measure(const struct suite *s, const struct input *in, int msec)
+{
+	char result[RESULT_LEN];
+	long long start, elapsed, calls = 0, batch = 1;
+
+	start = now_nsec();
+	do {
+		long long i;
+
+		for (i = 0; i < batch; i++)
+			s->run(in, result, sizeof(result));
+		calls  += batch;
+		batch  *= 2;
+		elapsed = now_nsec() - start;
+	} while (elapsed < (long long)msec * 1000000LL);
+
+	return (double)elapsed / calls;
+}
+
+static int bench(const struct suite *s, const char *corpus, int msec, int results)
+{
+	struct input in[MAX_INPUTS];
+	char path[512];
+	struct dirent *d;
+	size_t i, num = 0;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "%s/%s", corpus, s->name);
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	while ((d = readdir(dir)) && num < NELEMS(in)) {
+		char file[1024];
+
+		if (d->d_name[0] == '.')
+			continue;
+
+		snprintf(file, sizeof(file), "%s/%s", path, d->d_name);
+		if (!load(&in[num], file, d->d_name))
+			num++;
+	}
+	closedir(dir);
+	qsort(in, num, sizeof(in[0]), compare);
+
+	printf("\n%s, %s\n", s->name, s->func);
+	for (i = 0; i < num; i++) {
+		char result[RESULT_LEN];
+
+		s->run(&in[i], result, sizeof(result));
+		if (results)
+			printf("  %-24s %s\n", in[i].name, result);
+		else
+			printf("  %-24s %6zu bytes %10.1f ns  %s\n", in[i].name, in[i].len,
+			       measure(s, &in[i], msec), result);
+		free(in[i].data);
+	}
+
+	return 0;
+}
+
+/* Parse each file once, for fuzzers and for checking a single input */
+static int execute(const struct suite *s, char *files[], int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++) {
+		char result[RESULT_LEN];
+		struct input in;
+
+		if (load(&in, files[i], files[i]))
+			return 1;
+
+		s->run(&in, result, sizeof(result));
+		printf("%s: %s\n", files[i], result);
+		free(in.data);
+	}
+
+	return 0;
+}
+
+static const struct suite *find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < NELEMS(suites); i++) {
+		if (!strcmp(suites[i].name, name))
+			return &suites[i];
+	}
+
+	fprintf(stderr, "No such suite %s\n", name);
+	return NULL;
+}
+
+static int usage(int rc)
+{
+	size_t i;
+
+	fprintf(stderr,
+		"Usage: bench-parse [-hr] [-m MSEC] [-s BYTES] [-t SUITE] [CORPUS]\n"
+		"       bench-parse [-s BYTES] -x SUITE FILE...\n"
+		"\n"
+		"  -m MSEC   Time each input for at least MSEC, default 100\n"
+		"  -r        Results only, parse each input once, no timing\n"
+		"  -s BYTES  Feed http_parse() BYTES at a time, default all at once\n"
+		"  -t SUITE  Only run SUITE\n"
+		"  -x SUITE  Run SUITE once on each FILE, e.g., from afl-fuzz\n"
+		"\n"
+		"CORPUS is the directory with one subdirectory per suite, default corpus\n"
+		"\n"
+		"Suites:\n");
+	for (i = 0; i < NELEMS(suites); i++)
+		fprintf(stderr, "  %-9s %s\n", suites[i].name, suites[i].func);
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct suite *only = NULL, *exec = NULL;
+	const char *corpus = "corpus";
+	int c, msec = 100, results = 0, rc = 0;
+	size_t i;
+
+	while ((c = getopt(argc, argv, "hm:rs:t:x:")) != EOF) {
+		switch (c) {
+		case 'm':
+			msec = atoi(optarg);
+			break;
+		case 'r':
+			results = 1;
+			break;
+		case 's':
+			segment = atoi(optarg);
+			break;
+		case 't':
+			only = find(optarg);
+			if (!only)
+				return usage(1);
+			break;
+		case 'x':
+			exec = find(optarg);
+			if (!exec)
+				return usage(1);
+			break;
+		case 'h':
+			return usage(0);
+		default:
+			return usage(1);
+		}
+	}
+
+	/* Invalid inputs are expected, don't drown the results in warnings */
+	log_level("emerg");
+
+	if (exec)
+		return execute(exec, &argv[optind], argc - optind);
+
+	if (optind < argc)
+		corpus = argv[optind];
+
+	for (i = 0; i < NELEMS(suites); i++) {
+		if (only && only != &suites[i])
+			continue;
+		rc |= bench(&suites[i], corpus, msec, results);
+	}
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,534 @@
+/* Benchmark of the TLS backend against a local TLS server
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+
+/*
+ * Drives the TLS layer, ssl_open(), ssl_handshake(), ssl_send() and
+ * ssl_recv(), the same way for all backends, OpenSSL, mbedtls, and
+ * GnuTLS, against the same server, so the numbers from builds with
+ * different backends, or on different targets, can be compared:
+ *
+ *   full      Handshake, without a session to resume
+ *   resumed   Handshake, resuming the session of the previous one
+ *   download  ssl_recv() throughput, GET of -f FILE from the server
+ *   upload    ssl_send() throughput, to a server that discards it, until
+ *             the last record is handed to the kernel
+ *
+ * For handshakes the wall time, the CPU time, the CPU cycles, if the
+ * kernel lets us count them, and the heap used by the connection once
+ * it is up are reported.  The TCP connect is not included.  Each
+ * connection ends with a request and the reply, so TLS 1.3 session
+ * tickets, sent after the handshake, arrive before ssl_close() saves
+ * the session.
+ *
+ * The server is any TLS server that answers HTTP/1.0 and serves a file,
+ * e.g. openssl s_server -WWW, and for uploads one that reads and drops
+ * what it gets, e.g. openssl s_server.  See bench-tls.sh, which starts
+ * both, or run them on the build host and point the target at it.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "ddns.h"
+#include "error.h"
+#include "http.h"
+#include "log.h"
+#include "ssl.h"
+
+#if defined(CONFIG_OPENSSL)
+#include <openssl/crypto.h>
+#elif defined(CONFIG_MBEDTLS)
+#include <mbedtls/version.h>
+#else
+#include <gnutls/gnutls.h>
+#endif
+
+#define IO_TIMEOUT	10000	/* msec */
+#define CHUNK_SIZE	16384	/* One TLS record */
+#define MAX_SAMPLES	10000
+
+/* Normally set by main.c from .conf and command line */
+int    secure_ssl    = 0;	/* The server has a self-signed cert */
+int    broken_rtc    = 0;
+char  *ca_trust_file = NULL;
+int    allow_ipv6    = 1;
+int    verify_addr   = 1;
+char  *prognm        = "bench-tls";
+
+struct sample {
+	long long wall;		/* nsec */
+	long long cpu;		/* nsec */
+	long long cycles;	/* -1 if not counted */
+	long      heap;		/* bytes */
+};
+
+static const char *host;
+static const char *port;
+static int         cycles_fd = -1;
+
+static long long now_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long cpu_nsec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Count CPU cycles in user space, if the kernel allows it */
+static void cycles_init(void)
+{
+#ifdef __linux__
+	struct perf_event_attr pe;
+
+	memset(&pe, 0, sizeof(pe));
+	pe.type           = PERF_TYPE_HARDWARE;
+	pe.size           = sizeof(pe);
+	pe.config         = PERF_COUNT_HW_CPU_CYCLES;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv     = 1;
+
+	cycles_fd = syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+	if (cycles_fd != -1)
+		ioctl(cycles_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static long long cycles(void)
+{
+	long long val;
+
+	if (cycles_fd == -1 || read(cycles_fd, &val, sizeof(val)) != sizeof(val))
+		return -1;
+
+	return val;
+}
+
+/* Bytes allocated, or with an older C library, resident, in pages */
+static long heap_used(void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	return (long)mallinfo2().uordblks;
+#else
+	long pages = 0, rss = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%ld %ld", &pages, &rss) != 2)
+		rss = 0;
+	fclose(fp);
+
+	return rss * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static const char *backend(void)
+{
+	static char buf[64];
+
+#if defined(CONFIG_OPENSSL)
+	snprintf(buf, sizeof(buf), "%s", OpenSSL_version(OPENSSL_VERSION));
+#elif defined(CONFIG_MBEDTLS)
+	snprintf(buf, sizeof(buf), "mbedtls %s", MBEDTLS_VERSION_STRING);
+#else
+	snprintf(buf, sizeof(buf), "GnuTLS %s", gnutls_check_version(NULL));
+#endif
+
+	return buf;
+}
+
+/* Wait for the socket to be ready for what ssl_*() asked for */
+static int ready(http_t *client, int rc)
+{
+	struct pollfd pfd = {
+		.fd     = client->tcp.socket,
+		.events = rc == RC_TCP_WANT_READ ? POLLIN : POLLOUT,
+	};
+
+	if (poll(&pfd, 1, IO_TIMEOUT) != 1) {
+		fprintf(stderr, "Timed out waiting for %s:%s\n", host, port);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Connected, non-blocking, like tcp_connect() leaves it */
+static int connect_to(http_t *client, const char *name, const char *service)
+{
+	struct addrinfo hints, *ai;
+	int sd, rc;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	rc = getaddrinfo(host, service, &hints, &ai);
+	if (rc) {
+		fprintf(stderr, "Cannot resolve %s: %s\n", host, gai_strerror(rc));
+		return -1;
+	}
+
+	sd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (sd == -1 || connect(sd, ai->ai_addr, ai->ai_addrlen)) {
+		fprintf(stderr, "Cannot connect to %s:%s: %s\n", host, service, strerror(errno));
+		if (sd != -1)
+			close(sd);
+		freeaddrinfo(ai);
+		return -1;
+	}
+	freeaddrinfo(ai);
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	memset(client, 0, sizeof(*client));
+	client->tcp.socket      = sd;
+	client->tcp.initialized = 1;
+	client->tcp.remote_host = name;	/* SNI, and the session cache key */
+	client->ssl_enabled     = 1;
+
+	return 0;
+}
+
+static int handshake(http_t *client)
+{
+	int rc;
+
+	rc = ssl_open(client, "Benchmark");
+	if (rc)
+		return rc;
+
+	while ((rc = ssl_handshake(client)) == RC_TCP_WANT_READ || rc == RC_TCP_WANT_WRITE) {
+		if (ready(client, rc))
+			return RC_TCP_CONNECT_FAILED;
+	}
+
+	return rc;
+}
+
+static int send_all(http_t *client, const char *buf, size_t len)
+{
+	size_t pos = 0;
+
+	while (pos < len) {
+		int rc, num;
+
+		rc = ssl_send(client, buf + pos, len - pos, &num);
+		if (rc == RC_TCP_WANT_READ || rc == RC_TCP_WANT_WRITE) {
+			if (ready(client, rc))
+				return RC_TCP_SEND_ERROR;
+			continue;
+		}
+		if (rc)
+			return rc;
+		pos += num;
+	}
+
+	return 0;
+}
+
+/* Read until the server closes, returns bytes read, or -1 */
+static long long recv_all(http_t *client)
+{
+	static char buf[CHUNK_SIZE];
+	long long total = 0;
+
+	while (1) {
+		int rc, num;
+
+		rc = ssl_recv(client, buf, sizeof(buf), &num);
+		if (rc == RC_TCP_WANT_READ || rc == RC_TCP_WANT_WRITE) {
+			if (ready(client, rc))
+				return -1;
+			continue;
+		}
+		if (rc)
+			return total ? total : -1;
+		if (num == 0)
+			return total;
+		total += num;
+	}
+}
+
+static long long get(http_t *client, const char *path)
+{
+	char req[256];
+
+	snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\n\r\n", path);
+	if (send_all(client, req, strlen(req)))
+		return -1;
+
+	return recv_all(client);
+}
+
+/* One connection, to @name, its handshake in @s */
+static int connection(const char *name, const char *path, struct sample *s)
+{
+	long long wall, cpu, cyc;
+	http_t client;
+	long heap;
+	int rc;
+
+	if (connect_to(&client, name, port))
+		return -1;
+
+	heap = heap_used();
+	cyc  = cycles();
+	cpu  = cpu_nsec();
+	wall = now_nsec();
+	rc   = handshake(&client);
+	s->wall = now_nsec() - wall;
+	s->cpu  = cpu_nsec() - cpu;
+	s->cycles = cyc < 0 ? -1 : cycles() - cyc;
+	s->heap = heap_used() - heap;
+
+	if (!rc && get(&client, path) < 0)
+		rc = RC_TCP_RECV_ERROR;
+	if (rc)
+		fprintf(stderr, "Failed connecting to %s:%s: %s\n", host, port, error_str(rc));
+	ssl_close(&client);
+
+	return rc ? -1 : 0;
+}
+
+static int compare(const void *a, const void *b)
+{
+	const struct sample *x = a, *y = b;
+
+	return (x->wall > y->wall) - (x->wall < y->wall);
+}
+
+static void report(const char *what, struct sample *s, int num)
+{
+	long long cpu = 0, cyc = 0, wall = 0;
+	long heap = 0;
+	int i;
+
+	if (num < 1)
+		return;
+
+	qsort(s, num, sizeof(s[0]), compare);
+	for (i = 0; i < num; i++) {
+		wall += s[i].wall;
+		cpu  += s[i].cpu;
+		heap += s[i].heap;
+		if (cyc >= 0 && s[i].cycles >= 0)
+			cyc += s[i].cycles;
+		else
+			cyc = -1;
+	}
+
+	printf("%-10s %6d  %8.3f %8.3f %8.3f %8.3f  %8.3f  ", what, num,
+	       s[0].wall / 1e6, s[num / 2].wall / 1e6, wall / num / 1e6, s[num - 1].wall / 1e6,
+	       cpu / num / 1e6);
+	if (cyc < 0)
+		printf("%10s", "n/a");
+	else
+		printf("%10lld", cyc / num);
+	printf("  %9ld\n", heap / num);
+}
+
+static int handshakes(int num, const char *path)
+{
+	struct sample *full, *resumed;
+	int i, rc = 0;
+
+	full    = calloc(num, sizeof(*full));
+	resumed = calloc(num, sizeof(*resumed));
+	if (!full || !resumed) {
+		free(full);
+		free(resumed);
+		return 1;
+	}
+
+	/* Shared context, CA store, etc., set up once, not measured */
+	if (connection("warmup.bench", path, &full[0]))
+		rc = 1;
+
+	/* A new name every time, nothing to resume */
+	for (i = 0; !rc && i < num; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "full%d.bench", i);
+		if (connection(name, path, &full[i]))
+			rc = 1;
+	}
+
+	/* The same name every time, resuming the session of the last one */
+	for (i = 0; !rc && i < num; i++) {
+		if (connection("resumed.bench", path, &resumed[i]))
+			rc = 1;
+	}
+
+	if (!rc) {
+		printf("%-10s %6s  %8s %8s %8s %8s  %8s  %10s  %9s\n", "handshake", "num",
+		       "min", "median", "avg", "max", "cpu", "cycles", "heap");
+		printf("%-10s %6s  %8s %8s %8s %8s  %8s  %10s  %9s\n", "", "",
+		       "msec", "msec", "msec", "msec", "msec", "", "bytes");
+		report("full", full, num);
+		report("resumed", resumed, num);
+	}
+
+	free(full);
+	free(resumed);
+
+	return rc;
+}
+
+/* Throughput, @upload is sent to a server discarding it, else downloaded */
+static int transfer(const char *what, const char *path, const char *service, long long upload)
+{
+	long long wall, cpu, bytes;
+	http_t client;
+	int rc;
+
+	if (connect_to(&client, "resumed.bench", service))
+		return 1;
+
+	rc = handshake(&client);
+	if (rc) {
+		fprintf(stderr, "Failed connecting to %s:%s: %s\n", host, service, error_str(rc));
+		ssl_close(&client);
+		return 1;
+	}
+
+	cpu  = cpu_nsec();
+	wall = now_nsec();
+	if (upload) {
+		static char buf[CHUNK_SIZE];
+
+		for (bytes = 0; !rc && bytes < upload; bytes += sizeof(buf))
+			rc = send_all(&client, buf, sizeof(buf));
+	} else {
+		bytes = get(&client, path);
+		if (bytes < 0)
+			rc = RC_TCP_RECV_ERROR;
+	}
+	wall = now_nsec() - wall;
+	cpu  = cpu_nsec() - cpu;
+	ssl_close(&client);
+
+	if (rc) {
+		fprintf(stderr, "Failed %s: %s\n", what, error_str(rc));
+		return 1;
+	}
+
+	printf("%-10s %10lld bytes  %8.3f msec  %8.1f MiB/s  cpu %8.3f msec\n", what, bytes,
+	       wall / 1e6, wall ? bytes / (wall / 1e9) / 1048576 : 0, cpu / 1e6);
+
+	return 0;
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: bench-tls [-h] [-f PATH] [-n NUM] [-s KIB] [-u PORT] HOST PORT\n"
+		"\n"
+		"  -f PATH   File to download from the server, default /bench.bin\n"
+		"  -n NUM    Handshakes of each kind, default 100\n"
+		"  -s KIB    Bytes to upload, in KiB, default 4096\n"
+		"  -u PORT   Upload to PORT on HOST, a server that discards what it gets\n"
+		"\n"
+		"The server on PORT answers HTTP/1.0 GET requests, e.g. s_server -WWW\n");
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = "/bench.bin", *upload = NULL;
+	int c, num = 100, size = 4096, rc = 0;
+
+	while ((c = getopt(argc, argv, "f:hn:s:u:")) != EOF) {
+		switch (c) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'n':
+			num = atoi(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 'u':
+			upload = optarg;
+			break;
+		case 'h':
+			return usage(0);
+		default:
+			return usage(1);
+		}
+	}
+
+	if (argc - optind != 2 || num < 1 || num > MAX_SAMPLES || size < 1)
+		return usage(1);
+	host = argv[optind];
+	port = argv[optind + 1];
+
+	/* Self-signed server cert, don't drown the results in warnings */
+	log_level("emerg");
+	cycles_init();
+	ssl_init();
+
+	printf("TLS benchmark: %s, %s:%s\n\n", backend(), host, port);
+	rc |= handshakes(num, path);
+	if (!rc) {
+		printf("\n");
+		rc |= transfer("download", path, port, 0);
+		if (upload)
+			rc |= transfer("upload", path, upload, (long long)size * 1024);
+	}
+
+	ssl_exit();
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
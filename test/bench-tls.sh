@@ -0,0 +1,86 @@
+#!/bin/sh
+# Benchmark the TLS backend against a local openssl s_server
+#
+# Usage: bench-tls.sh [serve], settings in the environment:
+#
+#   NUM=100          Handshakes of each kind, full and resumed
+#   KIB=4096         KiB to download and to upload
+#   KEY=ec           ec: P-256, rsa: RSA 2048 server key
+#   PORT=4433        Server port, for handshakes and downloads
+#   UPLOAD=4434      Server port, for uploads
+#
+# Two openssl s_server are started, one serving a file of KIB KiB,
+# -WWW, and one that reads, and drops, what it gets.  The server is the
+# same for all backends, so the numbers of builds with OpenSSL, mbedtls,
+# and GnuTLS can be compared.
+#
+# For a target without openssl, start only the servers on the build
+# host, with `bench-tls.sh serve`, and run bench-tls on the target:
+#
+#   ./bench-tls -n 100 -u 4434 BUILDHOST 4433
+set -e
+
+NUM=${NUM:-100}
+KIB=${KIB:-4096}
+KEY=${KEY:-ec}
+PORT=${PORT:-4433}
+UPLOAD=${UPLOAD:-4434}
+
+bench=${BENCH:-./bench-tls}
+openssl=${OPENSSL:-openssl}
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/inadyn-bench-tls.XXXXXX")
+
+# Stop one server, if still running
+stop()
+{
+    [ -n "$1" ] || return 0
+    kill "$1" 2>/dev/null || true
+    wait "$1" 2>/dev/null || true
+}
+
+cleanup()
+{
+    stop "$wpid"
+    stop "$upid"
+    wpid=""
+    upid=""
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+case "$KEY" in
+    rsa)
+	keyopt="-newkey rsa:2048"
+	;;
+    *)
+	keyopt="-newkey ec -pkeyopt ec_paramgen_curve:prime256v1"
+	;;
+esac
+
+# shellcheck disable=SC2086
+"$openssl" req -x509 $keyopt -nodes -days 1 -subj /CN=bench.example \
+	   -keyout "$dir/key.pem" -out "$dir/cert.pem" 2>"$dir/req.log"
+dd if=/dev/zero of="$dir/bench.bin" bs=1024 count="$KIB" 2>/dev/null
+
+# Serves files relative to its working directory
+(cd "$dir" && exec "$openssl" s_server -quiet -accept "$PORT" -cert cert.pem -key key.pem -WWW) \
+    >/dev/null 2>"$dir/www.log" &
+wpid=$!
+
+# Reads what the client sends, and drops it
+"$openssl" s_server -quiet -accept "$UPLOAD" -cert "$dir/cert.pem" -key "$dir/key.pem" \
+	   </dev/null >/dev/null 2>"$dir/upload.log" &
+upid=$!
+sleep 1
+
+if [ "$1" = "serve" ]; then
+    echo "Serving on port $PORT, uploads on port $UPLOAD, Ctrl-C to stop"
+    wait "$wpid"
+    exit 0
+fi
+
+"$bench" -n "$NUM" -s "$KIB" -u "$UPLOAD" 127.0.0.1 "$PORT"
+echo "server key: $KEY, $("$openssl" version)"
+
+cleanup
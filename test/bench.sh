@@ -0,0 +1,186 @@
+#!/bin/sh
+# Load test inadyn against a local mock DDNS and checkip server
+#
+# Usage: bench.sh, settings in the environment:
+#
+#   PROVIDERS=100    Number of custom providers
+#   HOSTS=5          Hostnames per provider
+#   CYCLES=10        Update cycles after the first, cold, one
+#   MODE=update      update: force update of all hostnames (SIGUSR1),
+#                    check: only check the address (SIGUSR2)
+#   PROTO=dyndns     dyndns: dyndns2 style, json: Cloudflare style replies
+#   CONCURRENCY=1    Providers updated in parallel
+#   DELAY=0          msec, server reply delay
+#   JITTER=0         msec, random extra delay
+#   LOSS=0           percent, requests dropped by the server
+#   RATE=0           requests per second before HTTP 429, 0: unlimited
+#   STRACE=0         1: count syscalls with strace -c
+#   VALGRIND=0       1: count allocations with valgrind
+#
+# Reports the cycle times, from the metrics-file, peak RSS, and if
+# enabled, syscalls and allocations.
+set -e
+
+PROVIDERS=${PROVIDERS:-100}
+HOSTS=${HOSTS:-5}
+CYCLES=${CYCLES:-10}
+MODE=${MODE:-update}
+PROTO=${PROTO:-dyndns}
+CONCURRENCY=${CONCURRENCY:-1}
+DELAY=${DELAY:-0}
+JITTER=${JITTER:-0}
+LOSS=${LOSS:-0}
+RATE=${RATE:-0}
+STRACE=${STRACE:-0}
+VALGRIND=${VALGRIND:-0}
+
+srcdir=${srcdir:-.}
+inadyn=${INADYN:-../src/inadyn}
+mock=${MOCK:-./mock-server}
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/inadyn-bench.XXXXXX")
+conf=$dir/bench.conf
+metrics=$dir/metrics.prom
+
+cleanup()
+{
+    [ -n "$pid" ]  && kill "$pid"  2>/dev/null && wait "$pid"  2>/dev/null
+    [ -n "$spid" ] && kill "$spid" 2>/dev/null && wait "$spid" 2>/dev/null
+    [ -n "$mpid" ] && kill "$mpid" 2>/dev/null && wait "$mpid" 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+# Value of a metric without labels, from the metrics-file
+metric()
+{
+    sed -n "s/^$1 //p" "$metrics" 2>/dev/null
+}
+
+# Wait for the main loop to finish cycle $1, or give up after a minute
+wait_cycle()
+{
+    i=0
+    while [ "$(metric inadyn_cycles_total)" != "$1" ]; do
+	i=$((i + 1))
+	if [ $i -gt 600 ] || ! kill -0 "$pid" 2>/dev/null; then
+	    echo "Timed out waiting for cycle $1" >&2
+	    exit 1
+	fi
+	sleep 0.1
+    done
+}
+
+"$mock" -d "$DELAY" -j "$JITTER" -l "$LOSS" -r "$RATE" >"$dir/port" 2>"$dir/mock.log" &
+mpid=$!
+while [ ! -s "$dir/port" ]; do
+    sleep 0.1
+done
+port=$(cat "$dir/port")
+
+case "$PROTO" in
+    json)
+	path="/client/v4/zones/bench/dns_records/%h?content=%i"
+	response="'\"success\":true'"
+	;;
+    *)
+	path="/nic/update?hostname=%h&myip=%i"
+	response="good"
+	;;
+esac
+
+cat <<EOF >"$conf"
+period         = 600
+concurrency    = $CONCURRENCY
+metrics-file   = $metrics
+EOF
+
+p=1
+while [ $p -le "$PROVIDERS" ]; do
+    hosts=""
+    h=1
+    while [ $h -le "$HOSTS" ]; do
+	hosts="$hosts${hosts:+, }\"h$h.p$p.bench.example\""
+	h=$((h + 1))
+    done
+
+    cat <<EOF >>"$conf"
+
+custom bench$p@example.com {
+    ssl            = false
+    username       = bench
+    password       = bench$p
+    ddns-server    = 127.0.0.1:$port
+    ddns-path      = "$path"
+    ddns-response  = $response
+    checkip-server = http://127.0.0.1:$port/ip
+    hostname       = { $hosts }
+}
+EOF
+    p=$((p + 1))
+done
+
+if [ "$VALGRIND" = "1" ]; then
+    valgrind --log-file="$dir/valgrind.log" "$inadyn" -n -N --cache-dir="$dir" -f "$conf" -l error &
+else
+    "$inadyn" -n -N --cache-dir="$dir" -f "$conf" -l error &
+fi
+pid=$!
+
+start=$(date +%s.%N)
+wait_cycle 1
+cold=$(metric inadyn_cycle_duration_seconds)
+
+if [ "$STRACE" = "1" ]; then
+    strace -c -f -p "$pid" -o "$dir/strace.log" &
+    spid=$!
+    sleep 0.5
+fi
+
+[ "$MODE" = "check" ] && sig=USR2 || sig=USR1
+times=""
+n=1
+while [ $n -le "$CYCLES" ]; do
+    kill -$sig "$pid"
+    n=$((n + 1))
+    wait_cycle $n
+    times="$times $(metric inadyn_cycle_duration_seconds)"
+done
+end=$(date +%s.%N)
+
+rss=$(sed -n 's/^VmHWM:[[:space:]]*//p' "/proc/$pid/status" 2>/dev/null)
+
+if [ -n "$spid" ]; then
+    kill -INT "$spid"
+    wait "$spid" 2>/dev/null || true
+    spid=""
+fi
+
+kill -TERM "$pid"
+wait "$pid" 2>/dev/null || true
+pid=""
+
+kill -TERM "$mpid"
+wait "$mpid" 2>/dev/null || true
+mpid=""
+
+echo "inadyn benchmark: $PROVIDERS providers x $HOSTS hostnames, $PROTO, mode $MODE, concurrency $CONCURRENCY"
+echo "server: delay $DELAY msec, jitter $JITTER msec, loss $LOSS%, rate limit $RATE/sec"
+echo "cold cycle:     $cold sec"
+echo "$times" | awk '{
+	n = split($0, t, " ");
+	for (i = 1; i <= n; i++) { sum += t[i]; if (i == 1 || t[i] < min) min = t[i]; if (t[i] > max) max = t[i]; }
+	if (n) printf "warm cycles:    %d, min %.3f avg %.3f max %.3f sec\n", n, min, sum / n, max;
+}'
+echo "$start $end" | awk '{ printf "wall time:      %.3f sec\n", $2 - $1 }'
+echo "peak RSS:       ${rss:-unknown}"
+cat "$dir/mock.log"
+
+if [ -f "$dir/strace.log" ]; then
+    echo "syscalls during warm cycles:"
+    sed -n '/^% time/,$p' "$dir/strace.log"
+fi
+
+if [ -f "$dir/valgrind.log" ]; then
+    sed -n 's/.*total heap usage:/heap usage:/p' "$dir/valgrind.log"
+fi
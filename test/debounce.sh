@@ -0,0 +1,122 @@
+#!/bin/sh
+# Check that a burst of commands is merged into one pass of the main loop
+#
+# Usage: debounce.sh, settings in the environment:
+#
+#   DEBOUNCE=3000    msec, command-debounce
+#
+# Runs inadyn against a local mock server, with ha-state set.  Inside
+# the debounce window the node fails over, standby to active, twice,
+# with check requests (SIGUSR2) in between.  All four must end up in
+# one check of the address, one cycle in the metrics-file.
+set -e
+
+DEBOUNCE=${DEBOUNCE:-3000}
+
+inadyn=${INADYN:-../src/inadyn}
+mock=${MOCK:-./mock-server}
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/inadyn-debounce.XXXXXX")
+conf=$dir/debounce.conf
+state=$dir/ha-state
+metrics=$dir/metrics.prom
+log=$dir/inadyn.log
+
+# Stop one process, if still running
+stop()
+{
+    [ -n "$1" ] || return 0
+    kill "$1" 2>/dev/null || true
+    wait "$1" 2>/dev/null || true
+}
+
+cleanup()
+{
+    stop "$pid"
+    stop "$mpid"
+    pid=""
+    mpid=""
+    rm -rf "$dir"
+}
+trap cleanup EXIT INT TERM
+
+fail()
+{
+    echo "FAIL: $*" >&2
+    sed 's/^/  /' "$log" >&2
+    exit 1
+}
+
+# Value of a metric without labels, from the metrics-file
+metric()
+{
+    sed -n "s/^$1 //p" "$metrics" 2>/dev/null
+}
+
+# Wait for the main loop to finish cycle $1, or give up after a minute
+wait_cycle()
+{
+    i=0
+    while [ "$(metric inadyn_cycles_total)" != "$1" ]; do
+	i=$((i + 1))
+	if [ $i -gt 600 ] || ! kill -0 "$pid" 2>/dev/null; then
+	    fail "timed out waiting for cycle $1"
+	fi
+	sleep 0.1
+    done
+}
+
+# A failover, the ha-state file is read every second
+failover()
+{
+    echo BACKUP >"$state"
+    sleep 1.2
+    echo MASTER >"$state"
+}
+
+"$mock" >"$dir/port" 2>"$dir/mock.log" &
+mpid=$!
+while [ ! -s "$dir/port" ]; do
+    sleep 0.1
+done
+port=$(cat "$dir/port")
+
+echo MASTER >"$state"
+cat <<EOF >"$conf"
+period           = 600
+command-debounce = $DEBOUNCE
+ha-state         = $state
+metrics-file     = $metrics
+
+custom debounce@example.com {
+    ssl            = false
+    username       = debounce
+    password       = debounce
+    ddns-server    = 127.0.0.1:$port
+    ddns-path      = "/nic/update?hostname=%h&myip=%i"
+    ddns-response  = good
+    checkip-server = http://127.0.0.1:$port/ip
+    hostname       = debounce.example
+}
+EOF
+
+"$inadyn" -n -N --cache-dir="$dir" -f "$conf" -l debug >"$log" 2>&1 &
+pid=$!
+wait_cycle 1
+
+failover
+sleep 1
+kill -USR2 "$pid"
+sleep 0.2
+kill -USR2 "$pid"
+failover
+
+wait_cycle 2
+
+# Nothing left over for another pass
+sleep $((DEBOUNCE / 1000 + 2))
+cycles=$(metric inadyn_cycles_total)
+[ "$cycles" = 2 ] || fail "burst took $((cycles - 1)) cycles, expected 1"
+grep -q "Merged 4 commands" "$log" || fail "expected 4 commands merged"
+
+echo "PASS: 4 commands in one cycle"
@@ -0,0 +1,480 @@
+/* Mock DDNS and checkip server for benchmarks and load tests
+ *
+ * Copyright (C) 2026  Joachim Wiberg <troglobit@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, visit the Free Software Foundation
+ * website at http://www.gnu.org/licenses/gpl-2.0.html or write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * A single threaded HTTP/1.1 server, driven by poll(), that answers
+ * just enough of three protocols to keep inadyn busy:
+ *
+ *   GET /ip...                    checkip, the address in plain text
+ *   GET /nic/update?hostname=...  dyndns2, one "good ADDR" per hostname
+ *   ANY /client/v4/...            Cloudflare style JSON API
+ *
+ * Connections are kept alive unless the client asks otherwise.  Every
+ * reply can be delayed, dropped, or refused with 429 when the rate
+ * limit is exceeded, to see how inadyn copes with slow and flaky
+ * servers.  Counters are printed to stderr on exit.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define MAX_CONN	1024
+#define MAX_REQ		8192
+
+struct conn {
+	int        sd;
+	char       req[MAX_REQ];
+	size_t     len;
+	char      *rsp;		/* Pending reply, sent when due */
+	size_t     rsp_len;
+	size_t     sent;
+	long long  due;		/* msec, reply is held back until then */
+	int        drop;	/* Close instead of replying */
+	int        close;	/* Close after reply */
+};
+
+static struct conn   conns[MAX_CONN];
+static int           num;
+
+static int           delay;		/* msec */
+static int           jitter;		/* msec */
+static int           loss;		/* percent */
+static int           rate;		/* requests per second, 0: unlimited */
+static int           rotate;		/* change address every N checkips */
+static char          address[64] = "203.0.113.1";
+
+static volatile sig_atomic_t running = 1;
+
+static struct {
+	unsigned long conns;
+	unsigned long requests;
+	unsigned long checkip;
+	unsigned long dyndns;
+	unsigned long hostnames;
+	unsigned long json;
+	unsigned long dropped;
+	unsigned long limited;
+	unsigned long notfound;
+} stats;
+
+static long long now_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void stop(int signo)
+{
+	(void)signo;
+	running = 0;
+}
+
+/* Token bucket, refilled every second */
+static int limited(void)
+{
+	static long long second;
+	static int used;
+	long long now;
+
+	if (!rate)
+		return 0;
+
+	now = now_msec() / 1000;
+	if (now != second) {
+		second = now;
+		used   = 0;
+	}
+
+	return ++used > rate;
+}
+
+static void reply(struct conn *c, int status, const char *reason, const char *type, const char *body)
+{
+	size_t len = strlen(body);
+
+	free(c->rsp);
+	c->rsp_len = 0;
+	c->sent    = 0;
+	c->rsp     = malloc(len + 256);
+	if (!c->rsp)
+		return;
+
+	c->rsp_len = snprintf(c->rsp, len + 256,
+			      "HTTP/1.1 %d %s\r\n"
+			      "Content-Type: %s\r\n"
+			      "Content-Length: %zu\r\n"
+			      "%s"
+			      "%s"
+			      "\r\n%s",
+			      status, reason, type, len,
+			      status == 429 ? "Retry-After: 1\r\n" : "",
+			      c->close ? "Connection: close\r\n" : "",
+			      body);
+}
+
+static void checkip(struct conn *c)
+{
+	char body[96];
+
+	stats.checkip++;
+	if (rotate && stats.checkip % rotate == 0)
+		snprintf(address, sizeof(address), "203.0.113.%lu", 1 + (stats.checkip / rotate) % 254);
+
+	snprintf(body, sizeof(body), "%s\n", address);
+	reply(c, 200, "OK", "text/plain", body);
+}
+
+/* dyndns2: hostname=a,b,c&myip=ADDR, one result line per hostname */
+static void dyndns(struct conn *c, char *query)
+{
+	char body[4096] = "", *hosts, *ip = address, *ptr;
+	size_t len = 0;
+
+	stats.dyndns++;
+	hosts = strstr(query, "hostname=");
+	ptr   = strstr(query, "myip=");
+	if (ptr) {
+		ip = ptr + 5;
+		ip[strcspn(ip, "& ")] = 0;
+	}
+	if (!hosts) {
+		reply(c, 200, "OK", "text/plain", "notfqdn\n");
+		return;
+	}
+
+	hosts += 9;
+	hosts[strcspn(hosts, "& ")] = 0;
+	for (ptr = strtok(hosts, ","); ptr; ptr = strtok(NULL, ",")) {
+		stats.hostnames++;
+		len += snprintf(&body[len], sizeof(body) - len, "good %s\n", ip);
+		if (len >= sizeof(body))
+			break;
+	}
+
+	reply(c, 200, "OK", "text/plain", body);
+}
+
+/* Cloudflare style, same shape of reply for zone, record and update */
+static void json(struct conn *c, const char *method, char *path)
+{
+	char body[512];
+
+	stats.json++;
+	if (!strcmp(method, "GET") && strstr(path, "/dns_records") && !strstr(path, "content="))
+		snprintf(body, sizeof(body),
+			 "{\"result\":[{\"id\":\"372e67954025e0ba6aaa6d586b9e0b59\",\"type\":\"A\","
+			 "\"content\":\"%s\",\"proxied\":false,\"ttl\":1}],\"success\":true,"
+			 "\"errors\":[],\"messages\":[],\"result_info\":{\"page\":1,\"count\":1}}", address);
+	else if (strstr(path, "/dns_records"))
+		snprintf(body, sizeof(body),
+			 "{\"result\":{\"id\":\"372e67954025e0ba6aaa6d586b9e0b59\",\"type\":\"A\","
+			 "\"content\":\"%s\",\"proxied\":false,\"ttl\":1},\"success\":true,"
+			 "\"errors\":[],\"messages\":[]}", address);
+	else
+		snprintf(body, sizeof(body),
+			 "{\"result\":[{\"id\":\"023e105f4ecef8ad9ca31a8372d0c353\",\"name\":\"example.com\"}],"
+			 "\"success\":true,\"errors\":[],\"messages\":[]}");
+
+	reply(c, 200, "OK", "application/json", body);
+}
+
+static void handle(struct conn *c)
+{
+	char method[16], path[2048];
+
+	stats.requests++;
+	if (sscanf(c->req, "%15s %2047s", method, path) != 2) {
+		c->close = 1;
+		reply(c, 400, "Bad Request", "text/plain", "");
+		return;
+	}
+
+	c->close = strcasestr(c->req, "Connection: close") || strstr(c->req, "HTTP/1.0");
+	c->due   = now_msec() + delay + (jitter ? rand() % jitter : 0);
+	if (loss && rand() % 100 < loss) {
+		stats.dropped++;
+		c->drop = 1;
+		return;
+	}
+
+	if (limited()) {
+		stats.limited++;
+		reply(c, 429, "Too Many Requests", "text/plain", "");
+		return;
+	}
+
+	if (!strncmp(path, "/ip", 3))
+		checkip(c);
+	else if (!strncmp(path, "/nic/update", 11))
+		dyndns(c, path);
+	else if (!strncmp(path, "/client/v4/", 11))
+		json(c, method, path);
+	else {
+		stats.notfound++;
+		reply(c, 404, "Not Found", "text/plain", "");
+	}
+}
+
+static void conn_close(int i)
+{
+	close(conns[i].sd);
+	free(conns[i].rsp);
+	conns[i] = conns[--num];
+}
+
+/* Complete request, headers and any Content-Length body? */
+static size_t complete(struct conn *c)
+{
+	char *end, *cl;
+	size_t hdr;
+
+	c->req[c->len] = 0;
+	end = strstr(c->req, "\r\n\r\n");
+	if (!end)
+		return 0;
+
+	hdr = end - c->req + 4;
+	cl  = strcasestr(c->req, "Content-Length:");
+	if (cl && cl < end)
+		hdr += strtoul(cl + 15, NULL, 10);
+
+	return hdr <= c->len ? hdr : 0;
+}
+
+static void readable(int i)
+{
+	struct conn *c = &conns[i];
+	size_t used;
+	ssize_t n;
+
+	n = recv(c->sd, &c->req[c->len], sizeof(c->req) - 1 - c->len, 0);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		conn_close(i);
+		return;
+	}
+	c->len += n;
+
+	used = complete(c);
+	if (!used) {
+		if (c->len >= sizeof(c->req) - 1)
+			conn_close(i);
+		return;
+	}
+
+	handle(c);
+	memmove(c->req, &c->req[used], c->len - used);
+	c->len -= used;
+}
+
+/* Send reply once due, returns non-zero if the connection was closed */
+static int writable(int i)
+{
+	struct conn *c = &conns[i];
+	ssize_t n;
+
+	if (c->drop) {
+		conn_close(i);
+		return 1;
+	}
+
+	n = send(c->sd, &c->rsp[c->sent], c->rsp_len - c->sent, MSG_NOSIGNAL);
+	if (n < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		conn_close(i);
+		return 1;
+	}
+
+	c->sent += n;
+	if (c->sent < c->rsp_len)
+		return 0;
+
+	free(c->rsp);
+	c->rsp = NULL;
+	if (c->close) {
+		conn_close(i);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int pending(struct conn *c)
+{
+	return c->rsp || c->drop;
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: mock-server [-h] [-a ADDR] [-d MSEC] [-j MSEC] [-l PCT] [-p PORT] [-r NUM] [-R NUM]\n"
+		"\n"
+		"  -a ADDR  Address returned by checkip, default 203.0.113.1\n"
+		"  -d MSEC  Delay every reply, default 0\n"
+		"  -j MSEC  Add random 0..MSEC to delay, default 0\n"
+		"  -l PCT   Drop PCT percent of requests, closing the connection\n"
+		"  -p PORT  Listen on 127.0.0.1:PORT, default 0, any free port\n"
+		"  -r NUM   Reply 429 beyond NUM requests per second, default unlimited\n"
+		"  -R NUM   Change checkip address every NUM checkip requests\n"
+		"\n"
+		"The port is printed on stdout once the server is ready.\n");
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in sin = { 0 };
+	socklen_t len = sizeof(sin);
+	struct pollfd pfd[MAX_CONN + 1];
+	int c, i, sd, port = 0, on = 1;
+
+	while ((c = getopt(argc, argv, "a:d:hj:l:p:r:R:")) != EOF) {
+		switch (c) {
+		case 'a':
+			snprintf(address, sizeof(address), "%s", optarg);
+			break;
+		case 'd':
+			delay = atoi(optarg);
+			break;
+		case 'j':
+			jitter = atoi(optarg);
+			break;
+		case 'l':
+			loss = atoi(optarg);
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'R':
+			rotate = atoi(optarg);
+			break;
+		case 'h':
+			return usage(0);
+		default:
+			return usage(1);
+		}
+	}
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	sd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sd < 0) {
+		perror("socket");
+		return 1;
+	}
+	setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	sin.sin_family      = AF_INET;
+	sin.sin_port        = htons(port);
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(sd, (struct sockaddr *)&sin, sizeof(sin)) || listen(sd, 512)) {
+		perror("bind");
+		return 1;
+	}
+	fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	getsockname(sd, (struct sockaddr *)&sin, &len);
+	printf("%d\n", ntohs(sin.sin_port));
+	fflush(stdout);
+
+	while (running) {
+		long long now = now_msec(), next = 0;
+		int timeout = -1;
+
+		pfd[0].fd     = sd;
+		pfd[0].events = num < MAX_CONN ? POLLIN : 0;
+		for (i = 0; i < num; i++) {
+			pfd[i + 1].fd     = conns[i].sd;
+			pfd[i + 1].events = POLLIN;
+			if (pending(&conns[i])) {
+				if (conns[i].due <= now)
+					pfd[i + 1].events = POLLOUT;
+				else if (!next || conns[i].due < next)
+					next = conns[i].due;
+			}
+		}
+		if (next)
+			timeout = next > now ? (int)(next - now) : 0;
+
+		if (poll(pfd, num + 1, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		/* Back to front, conn_close() moves the last one into place */
+		for (i = num - 1; i >= 0; i--) {
+			if (pending(&conns[i])) {
+				if (conns[i].due <= now_msec())
+					writable(i);
+				continue;
+			}
+			if (pfd[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+				readable(i);
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			int cd;
+
+			while (num < MAX_CONN && (cd = accept(sd, NULL, NULL)) >= 0) {
+				fcntl(cd, F_SETFL, fcntl(cd, F_GETFL) | O_NONBLOCK);
+				memset(&conns[num], 0, sizeof(conns[num]));
+				conns[num++].sd = cd;
+				stats.conns++;
+			}
+		}
+	}
+
+	fprintf(stderr, "mock-server: %lu connections, %lu requests: %lu checkip, %lu dyndns2 (%lu hostnames), "
+		"%lu json, %lu dropped, %lu rate limited, %lu not found\n",
+		stats.conns, stats.requests, stats.checkip, stats.dyndns, stats.hostnames,
+		stats.json, stats.dropped, stats.limited, stats.notfound);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */